@@ -0,0 +1,273 @@
+/*
+ * cpu-topology.c - Топология процессоров из sysfs и раскладка потоков по ядрам
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/cpu-topology.h"
+
+static int read_sysfs_int (const char *path, int def) {
+  FILE *f = fopen (path, "r");
+  if (!f) {
+    return def;
+  }
+  int x;
+  if (fscanf (f, "%d", &x) != 1) {
+    x = def;
+  }
+  fclose (f);
+  return x;
+}
+
+/* "0-3,8-11" -> битовая маска */
+static int parse_cpu_list (const char *s, unsigned long long *mask) {
+  int cnt = 0;
+  while (*s && *s != '\n') {
+    char *end;
+    long a = strtol (s, &end, 10), b = a;
+    if (end == s) {
+      return -1;
+    }
+    s = end;
+    if (*s == '-') {
+      b = strtol (s + 1, &end, 10);
+      if (end == s + 1) {
+        return -1;
+      }
+      s = end;
+    }
+    if (a < 0 || b < a) {
+      return -1;
+    }
+    for (; a <= b && a < CPU_TOPOLOGY_MAX_CPUS; a++) {
+      mask[a >> 6] |= 1ULL << (a & 63);
+      cnt++;
+    }
+    if (*s == ',') {
+      s++;
+    }
+  }
+  return cnt;
+}
+
+/* узел процессора - ссылка nodeN в его каталоге */
+static int cpu_node (const char *root, int cpu) {
+  char path[512];
+  snprintf (path, sizeof (path), "%s/devices/system/cpu/cpu%d", root, cpu);
+  DIR *d = opendir (path);
+  if (!d) {
+    return 0;
+  }
+  int node = 0;
+  struct dirent *e;
+  while ((e = readdir (d))) {
+    if (!strncmp (e->d_name, "node", 4) && e->d_name[4] >= '0' && e->d_name[4] <= '9') {
+      node = atoi (e->d_name + 4);
+      break;
+    }
+  }
+  closedir (d);
+  return node;
+}
+
+static int cmp_cpu_info (const void *a, const void *b) {
+  const struct cpu_info *x = a, *y = b;
+  if (x->node != y->node) {
+    return x->node - y->node;
+  }
+  if (x->package != y->package) {
+    return x->package - y->package;
+  }
+  if (x->core != y->core) {
+    return x->core - y->core;
+  }
+  return x->cpu - y->cpu;
+}
+
+int cpu_topology_load (struct cpu_topology *T, const char *root, const unsigned long long *allowed) {
+  unsigned long long online[CPU_TOPOLOGY_MAX_CPUS / 64];
+  char path[512], buf[4096];
+  int i;
+
+  memset (T, 0, sizeof (*T));
+  memset (online, 0, sizeof (online));
+
+  snprintf (path, sizeof (path), "%s/devices/system/cpu/online", root);
+  FILE *f = fopen (path, "r");
+  if (!f) {
+    return 0;
+  }
+  int ok = fgets (buf, sizeof (buf), f) && parse_cpu_list (buf, online) > 0;
+  fclose (f);
+  if (!ok) {
+    return 0;
+  }
+
+  for (i = 0; i < CPU_TOPOLOGY_MAX_CPUS; i++) {
+    if (!(online[i >> 6] & (1ULL << (i & 63))) || (allowed && !(allowed[i >> 6] & (1ULL << (i & 63))))) {
+      continue;
+    }
+    struct cpu_info *C = &T->cpu[T->cpus++];
+    C->cpu = i;
+    snprintf (path, sizeof (path), "%s/devices/system/cpu/cpu%d/topology/core_id", root, i);
+    C->core = read_sysfs_int (path, i);
+    snprintf (path, sizeof (path), "%s/devices/system/cpu/cpu%d/topology/physical_package_id", root, i);
+    C->package = read_sysfs_int (path, 0);
+    C->node = cpu_node (root, i);
+  }
+
+  qsort (T->cpu, T->cpus, sizeof (struct cpu_info), cmp_cpu_info);
+
+  for (i = 0; i < T->cpus; i++) {
+    struct cpu_info *C = &T->cpu[i];
+    if (!i || C->core != C[-1].core || C->package != C[-1].package || C->node != C[-1].node) {
+      T->core_first[T->cores++] = i;
+      if (!i || C->node != C[-1].node) {
+        T->nodes++;
+      }
+    }
+    T->core_cpus[T->cores - 1]++;
+  }
+  return T->cpus;
+}
+
+static void add_cpu (struct cpu_layout *L, int role, int cpu) {
+  L->cpu[role][L->n[role]++] = cpu;
+}
+
+static void add_cores (struct cpu_layout *L, int role, const struct cpu_topology *T, int first, int cnt) {
+  int c, j;
+  for (c = first; c < first + cnt; c++) {
+    for (j = 0; j < T->core_cpus[c]; j++) {
+      add_cpu (L, role, T->cpu[T->core_first[c] + j].cpu);
+    }
+  }
+}
+
+void cpu_layout_plan (struct cpu_layout *L, const struct cpu_topology *T, int policy, int part, int parts) {
+  memset (L, 0, sizeof (*L));
+  L->part = part;
+  L->parts = parts;
+  if (policy == CPU_AFFINITY_NONE || T->cores <= 0 || part < 0) {
+    return;
+  }
+
+  int first = 0, cnt = T->cores, r;
+  if (parts > 1) {
+    if (T->cores >= parts) {
+      first = part * T->cores / parts;
+      cnt = (part + 1) * T->cores / parts - first;
+    } else {
+      first = part % T->cores;
+      cnt = 1;
+    }
+  }
+  L->first_core = first;
+  L->cores = cnt;
+
+  if (policy == CPU_AFFINITY_AUTO && cnt < 3) {
+    /* одному процессу на паре ядер планировщик справится сам; воркеров всё же разводим по долям */
+    if (parts > 1) {
+      L->policy = CPU_AFFINITY_AUTO;
+      for (r = 0; r < CPU_ROLE_MAX; r++) {
+        add_cores (L, r, T, first, cnt);
+      }
+    }
+    return;
+  }
+  L->policy = policy == CPU_AFFINITY_AUTO ? CPU_AFFINITY_SPREAD : policy;
+
+  int conn_first = first + 2, conn_cnt = cnt - 2;
+  if (cnt >= 3) {
+    add_cores (L, CPU_ROLE_EPOLL, T, first, 1);
+    add_cores (L, CPU_ROLE_ENGINE, T, first + 1, 1);
+  } else if (cnt == 2) {
+    /* epoll и engine делят первое ядро, по SMT-соседу на каждый, если они есть */
+    const struct cpu_info *C = &T->cpu[T->core_first[first]];
+    add_cpu (L, CPU_ROLE_EPOLL, C[0].cpu);
+    add_cpu (L, CPU_ROLE_ENGINE, T->core_cpus[first] > 1 ? C[1].cpu : C[0].cpu);
+    conn_first = first + 1;
+    conn_cnt = 1;
+  } else {
+    for (r = 0; r < CPU_ROLE_MAX; r++) {
+      add_cores (L, r, T, first, 1);
+    }
+    return;
+  }
+
+  L->pin_each = 1;
+  add_cores (L, CPU_ROLE_OTHER, T, conn_first, conn_cnt);
+  if (L->policy == CPU_AFFINITY_COMPACT) {
+    add_cores (L, CPU_ROLE_CONNECTION, T, conn_first, conn_cnt);
+  } else {
+    int j, c, more = 1;
+    for (j = 0; more; j++) {
+      more = 0;
+      for (c = conn_first; c < conn_first + conn_cnt; c++) {
+        if (j < T->core_cpus[c]) {
+          add_cpu (L, CPU_ROLE_CONNECTION, T->cpu[T->core_first[c] + j].cpu);
+          more = 1;
+        }
+      }
+    }
+  }
+}
+
+int cpu_layout_thread_cpus (const struct cpu_layout *L, int role, int k, const short **cpus) {
+  if (L->policy == CPU_AFFINITY_NONE || role < 0 || role >= CPU_ROLE_MAX || !L->n[role]) {
+    return 0;
+  }
+  if (role == CPU_ROLE_CONNECTION && L->pin_each) {
+    *cpus = &L->cpu[role][k % L->n[role]];
+    return 1;
+  }
+  *cpus = L->cpu[role];
+  return L->n[role];
+}
+
+static const char *policy_names[] = { "none", "auto", "spread", "compact" };
+
+int cpu_affinity_parse_policy (const char *s) {
+  int i;
+  for (i = 0; i < (int) (sizeof (policy_names) / sizeof (policy_names[0])); i++) {
+    if (!strcmp (s, policy_names[i])) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char *cpu_affinity_policy_name (int policy) {
+  return policy >= 0 && policy < (int) (sizeof (policy_names) / sizeof (policy_names[0])) ? policy_names[policy] : "?";
+}
+
+static int cmp_short (const void *a, const void *b) {
+  return *(const short *) a - *(const short *) b;
+}
+
+int cpu_layout_format (const struct cpu_layout *L, int role, char *buf, int len) {
+  short s[CPU_TOPOLOGY_MAX_CPUS];
+  int n = L->n[role], i, j, w = 0;
+  if (len <= 0) {
+    return 0;
+  }
+  buf[0] = 0;
+  if (L->policy == CPU_AFFINITY_NONE || !n) {
+    return snprintf (buf, len, "-");
+  }
+  memcpy (s, L->cpu[role], n * sizeof (short));
+  qsort (s, n, sizeof (short), cmp_short);
+  for (i = 0; i < n && w < len; i = j) {
+    for (j = i + 1; j < n && s[j] == s[j - 1] + 1; j++) {
+    }
+    if (j - i > 1) {
+      w += snprintf (buf + w, len - w, "%s%d-%d", i ? "," : "", s[i], s[j - 1]);
+    } else {
+      w += snprintf (buf + w, len - w, "%s%d", i ? "," : "", s[i]);
+    }
+  }
+  return w < len ? w : len - 1;
+}
@@ -0,0 +1,77 @@
+/*
+ * cpu-topology.h - Топология процессоров из sysfs и раскладка потоков по ядрам
+ *
+ * cpu_topology_load читает /sys/devices/system/cpu: доступные процессоры,
+ * их физические ядра (SMT-соседи), сокеты и NUMA-узлы. Процессоры
+ * упорядочиваются по узлу, сокету и ядру, так что соседние ядра в списке
+ * физически близки.
+ *
+ * cpu_layout_plan делит ядра между воркерами (-M) непрерывными отрезками
+ * и внутри своей доли отдаёт потоку epoll и потоку JC_ENGINE по
+ * выделенному ядру целиком, а потоки JC_CONNECTION раскладывает по
+ * оставшимся: spread - сначала по одному логическому процессору на
+ * ядро, потом по SMT-соседям; compact - ядро заполняется целиком, затем
+ * следующее. Остальные классы потоков получают множество оставшихся
+ * ядер без привязки к конкретному.
+ */
+
+#pragma once
+
+#define CPU_TOPOLOGY_MAX_CPUS 1024
+
+enum cpu_affinity_policy {
+  CPU_AFFINITY_NONE,
+  CPU_AFFINITY_AUTO,        /* выделенные ядра, если их в доле хватает; иначе только доля */
+  CPU_AFFINITY_SPREAD,
+  CPU_AFFINITY_COMPACT
+};
+
+enum cpu_role {
+  CPU_ROLE_EPOLL,
+  CPU_ROLE_ENGINE,
+  CPU_ROLE_CONNECTION,
+  CPU_ROLE_OTHER,
+  CPU_ROLE_MAX
+};
+
+struct cpu_info {
+  short cpu;
+  short core;
+  short package;
+  short node;
+};
+
+struct cpu_topology {
+  int cpus;
+  int cores;
+  int nodes;
+  struct cpu_info cpu[CPU_TOPOLOGY_MAX_CPUS];
+  short core_first[CPU_TOPOLOGY_MAX_CPUS];   /* индекс первого процессора ядра в cpu[] */
+  short core_cpus[CPU_TOPOLOGY_MAX_CPUS];
+};
+
+struct cpu_layout {
+  int policy;               /* фактическая; NONE - потоки не закрепляются */
+  int part, parts;
+  int first_core, cores;
+  int pin_each;             /* JC_CONNECTION закрепляются по одному процессору */
+  int n[CPU_ROLE_MAX];
+  short cpu[CPU_ROLE_MAX][CPU_TOPOLOGY_MAX_CPUS];
+};
+
+/* root - корень sysfs ("/sys"), allowed - битовая маска разрешённых процессоров или NULL;
+   возвращает число процессоров, 0 - топология недоступна */
+int cpu_topology_load (struct cpu_topology *T, const char *root, const unsigned long long *allowed);
+
+/* part из parts - доля воркера; parts <= 1 - все ядра одному процессу */
+void cpu_layout_plan (struct cpu_layout *L, const struct cpu_topology *T, int policy, int part, int parts);
+
+/* процессоры k-го потока роли; возвращает их число, 0 - не закреплять */
+int cpu_layout_thread_cpus (const struct cpu_layout *L, int role, int k, const short **cpus);
+
+/* "none", "auto", "spread", "compact"; -1 - неизвестное имя */
+int cpu_affinity_parse_policy (const char *s);
+const char *cpu_affinity_policy_name (int policy);
+
+/* список процессоров роли в виде "0-3,8"; возвращает длину */
+int cpu_layout_format (const struct cpu_layout *L, int role, char *buf, int len);
@@ -52,6 +52,7 @@
 
 volatile int mpq_blocks_allocated, mpq_blocks_allocated_max, mpq_blocks_allocations, mpq_blocks_true_allocations, mpq_blocks_wasted, mpq_blocks_prepared;
 volatile int mpq_small_blocks_allocated, mpq_small_blocks_allocated_max;
+volatile int spq_blocks_allocated;
 
 __thread int mpq_this_thread_id;
 __thread void **thread_hazard_pointers;
@@ -78,6 +79,7 @@ MODULE_STAT_FUNCTION
   SBP_PRINT_I32 (mpq_blocks_prepared);
   SBP_PRINT_I32 (mpq_small_blocks_allocated);
   SBP_PRINT_I32 (mpq_small_blocks_allocated_max);
+  SBP_PRINT_I32 (spq_blocks_allocated);
   SB_SUM_ONE_I (mpq_active);
   SB_SUM_ONE_I (mpq_allocated);
 MODULE_STAT_FUNCTION_END
@@ -459,8 +461,12 @@ long mpq_block_push (struct mp_queue_block *QB, mqn_value_t val) {
 	return t; // pushed OK
       }
     }
+    // Блок заполнен или занят: закрываем его, mpq_push перейдёт к следующему
+    if (++iterations > 10) {
+      __sync_fetch_and_or (&QB->mqb_tail, MQN_SAFE);
+      return -1L;
+    }
     // Collision - exponential backoff with randomization
-    iterations++;
     if (iterations > 1) {
       // Экспоненциальная задержка: 1, 2, 4, 8, 16, 32, 64 циклов
       int delay = (backoff < max_backoff) ? backoff : max_backoff;
@@ -542,9 +548,208 @@ struct mp_queue *alloc_mp_queue_w (void) {
   return MQ;
 }
 
+/* {{{ single-consumer queues */
+
+static struct sp_queue_block *alloc_spq_block (int size) {
+  struct sp_queue_block *B = NULL;
+  long bytes = offsetof (struct sp_queue_block, spb_vals) + size * sizeof (mqn_value_t);
+#ifdef _WIN32
+  B = _aligned_malloc (bytes, 64);
+#else
+  if (posix_memalign ((void **)&B, 64, bytes)) {
+    B = NULL;
+  }
+#endif
+  if (!B) {
+    return NULL;
+  }
+  memset (B, 0, bytes);
+  B->spb_size = size;
+  __sync_fetch_and_add (&spq_blocks_allocated, 1);
+  return B;
+}
+
+static void free_spq_block (struct sp_queue_block *B) {
+  __sync_fetch_and_add (&spq_blocks_allocated, -1);
+#ifdef _WIN32
+  _aligned_free (B);
+#else
+  free (B);
+#endif
+}
+
+static struct mp_queue *alloc_sp_queue (int magic) {
+  struct mp_queue *MQ = NULL;
+#ifdef _WIN32
+  MQ = (struct mp_queue *)_aligned_malloc (sizeof (*MQ), 64);
+#else
+  if (posix_memalign ((void **)&MQ, 64, sizeof (*MQ))) {
+    MQ = NULL;
+  }
+#endif
+  if (!MQ) {
+    kprintf ("[ERROR] alloc_sp_queue: failed to allocate memory\n");
+    return NULL;
+  }
+  memset (MQ, 0, sizeof (*MQ));
+  MQ->mq_sp_head = MQ->mq_sp_tail = alloc_spq_block (SPQ_SMALL_BLOCK_SIZE);
+  if (!MQ->mq_sp_head) {
+    free (MQ);
+    return NULL;
+  }
+  MQ->mq_magic = magic;
+  MODULE_STAT->mpq_allocated ++;
+  MODULE_STAT->mpq_active ++;
+  return MQ;
+}
+
+struct mp_queue *alloc_mp_queue_spsc (void) {
+  return alloc_sp_queue (MQ_MAGIC_SPSC);
+}
+
+struct mp_queue *alloc_mp_queue_mpsc (void) {
+  return alloc_sp_queue (MQ_MAGIC_MPSC);
+}
+
+static long spsc_push (struct mp_queue *MQ, mqn_value_t val) {
+  struct sp_queue_block *B = MQ->mq_sp_tail;
+  long t = B->spb_tail;
+  if (t < B->spb_size) {
+    B->spb_tail = t + 1;
+    __atomic_store_n (&B->spb_vals[t], val, __ATOMIC_RELEASE);
+    return t;
+  }
+  struct sp_queue_block *NB = alloc_spq_block (SPQ_BLOCK_SIZE);
+  if (!NB) {
+    return -1;
+  }
+  NB->spb_vals[0] = val;
+  NB->spb_tail = 1;
+  MQ->mq_sp_tail = NB;
+  // the consumer leaves B only after seeing spb_next, and we never touch B again
+  __atomic_store_n (&B->spb_next, NB, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static long mpsc_push (struct mp_queue *MQ, mqn_value_t val) {
+  void **hptr = mqb_hazard_ptr[get_this_thread_id()];
+  while (1) {
+    struct sp_queue_block *B = MQ->mq_sp_tail;
+    barrier ();
+    hptr[0] = B;
+    barrier ();
+    __sync_synchronize ();
+    if (MQ->mq_sp_tail != B) {
+      continue;
+    }
+
+    long t = __sync_fetch_and_add (&B->spb_tail, 1);
+    if (t < B->spb_size) {
+      __atomic_store_n (&B->spb_vals[t], val, __ATOMIC_RELEASE);
+      hptr[0] = 0;
+      return t;
+    }
+
+    // block is full: the first producer to get here links the next one
+    struct sp_queue_block *NB = B->spb_next;
+    if (!NB) {
+      NB = alloc_spq_block (SPQ_BLOCK_SIZE);
+      if (!NB) {
+        hptr[0] = 0;
+        return -1;
+      }
+      if (!__sync_bool_compare_and_swap (&B->spb_next, 0, NB)) {
+        free_spq_block (NB);
+        NB = B->spb_next;
+      }
+    }
+    __sync_bool_compare_and_swap (&MQ->mq_sp_tail, B, NB);
+  }
+}
+
+/* MPSC producers that came too late for B may still hold it; free it once they let go */
+static void retire_mpsc_block (struct mp_queue *MQ, struct sp_queue_block *B) {
+  __sync_bool_compare_and_swap (&MQ->mq_sp_tail, B, B->spb_next);
+  __sync_synchronize ();
+  B->spb_retired_next = MQ->mq_sp_retired;
+  MQ->mq_sp_retired = B;
+
+  struct sp_queue_block **P = &MQ->mq_sp_retired;
+  while (*P) {
+    struct sp_queue_block *X = *P;
+    if (is_hazard_ptr (X, 0, 0)) {
+      P = &X->spb_retired_next;
+    } else {
+      *P = X->spb_retired_next;
+      free_spq_block (X);
+    }
+  }
+}
+
+static mqn_value_t sp_queue_pop (struct mp_queue *MQ) {
+  struct sp_queue_block *B = MQ->mq_sp_head;
+  while (1) {
+    long h = B->spb_head;
+    if (h < B->spb_size) {
+      mqn_value_t v = __atomic_load_n (&B->spb_vals[h], __ATOMIC_ACQUIRE);
+      if (!v) {
+        if (MQ->mq_magic == MQ_MAGIC_SPSC || __atomic_load_n (&B->spb_tail, __ATOMIC_ACQUIRE) <= h) {
+          return 0;
+        }
+        // slot h is taken by a producer which is about to store the value
+        while (!(v = __atomic_load_n (&B->spb_vals[h], __ATOMIC_ACQUIRE))) {
+          barrier ();
+        }
+      }
+      B->spb_head = h + 1;
+      return v;
+    }
+    struct sp_queue_block *NB = __atomic_load_n (&B->spb_next, __ATOMIC_ACQUIRE);
+    if (!NB) {
+      return 0;
+    }
+    MQ->mq_sp_head = NB;
+    if (MQ->mq_magic == MQ_MAGIC_SPSC) {
+      free_spq_block (B);
+    } else {
+      retire_mpsc_block (MQ, B);
+    }
+    B = NB;
+  }
+}
+
+static int sp_queue_is_empty (struct mp_queue *MQ) {
+  struct sp_queue_block *B = MQ->mq_sp_head;
+  long h = B->spb_head;
+  if (h < B->spb_size) {
+    return !__atomic_load_n (&B->spb_vals[h], __ATOMIC_ACQUIRE);
+  }
+  return !__atomic_load_n (&B->spb_next, __ATOMIC_ACQUIRE);
+}
+
+static void clear_sp_queue (struct mp_queue *MQ) {
+  struct sp_queue_block *B, *BN;
+  for (B = MQ->mq_sp_head; B; B = BN) {
+    BN = B->spb_next;
+    free_spq_block (B);
+  }
+  for (B = MQ->mq_sp_retired; B; B = BN) {
+    BN = B->spb_retired_next;
+    free_spq_block (B);
+  }
+  MQ->mq_sp_head = MQ->mq_sp_tail = MQ->mq_sp_retired = 0;
+  MQ->mq_magic = 0;
+}
+
+/* }}} */
+
 /* invoke only if sure that nobody else may be using this mp_queue in parallel */
 void clear_mp_queue (struct mp_queue *MQ) {
   MODULE_STAT->mpq_active --;
+  if (MQ->mq_magic == MQ_MAGIC_SPSC || MQ->mq_magic == MQ_MAGIC_MPSC) {
+    clear_sp_queue (MQ);
+    return;
+  }
   assert (MQ->mq_magic == MQ_MAGIC || MQ->mq_magic == MQ_MAGIC_SEM);
   assert (MQ->mq_head && MQ->mq_tail);
   struct mp_queue_block *QB = MQ->mq_head, *QBN;
@@ -630,6 +835,9 @@ mqn_value_t mpq_pop (struct mp_queue *MQ, int flags) {
 /* 1 = definitely empty (for some serialization), 0 = possibly non-empty;
    may invoke mpq_push() to discard empty block */
 int mpq_is_empty (struct mp_queue *MQ) {
+  if (MQ->mq_magic == MQ_MAGIC_SPSC || MQ->mq_magic == MQ_MAGIC_MPSC) {
+    return sp_queue_is_empty (MQ);
+  }
   void **hptr = &mqb_hazard_ptr[get_this_thread_id()][0];
   struct mp_queue_block *QB;
   while (1) {
@@ -780,6 +988,9 @@ mqn_value_t mpq_pop_w (struct mp_queue *MQ, int flags) {
 }
 
 mqn_value_t mpq_pop_nw (struct mp_queue *MQ, int flags) {
+  if (MQ->mq_magic == MQ_MAGIC_SPSC || MQ->mq_magic == MQ_MAGIC_MPSC) {
+    return sp_queue_pop (MQ);
+  }
   assert (MQ->mq_magic == MQ_MAGIC_SEM);
   int s = -1, iterations = flags & MPQF_MAX_ITERATIONS;
   while (iterations --> 0) {
@@ -804,6 +1015,14 @@ mqn_value_t mpq_pop_nw (struct mp_queue *MQ, int flags) {
 }
 
 long mpq_push_w (struct mp_queue *MQ, mqn_value_t v, int flags) {
+  if (MQ->mq_magic == MQ_MAGIC_SPSC) {
+    assert (v);
+    return spsc_push (MQ, v);
+  }
+  if (MQ->mq_magic == MQ_MAGIC_MPSC) {
+    assert (v);
+    return mpsc_push (MQ, v);
+  }
   assert (MQ->mq_magic == MQ_MAGIC_SEM);
   long res = mpq_push (MQ, v, flags);
 #if MPQ_USE_POSIX_SEMAPHORES
@@ -76,6 +76,8 @@ typedef struct mp_queue_node {
 
 #define MQ_MAGIC	0x1aed9b43
 #define MQ_MAGIC_SEM	0x1aedcd21
+#define MQ_MAGIC_SPSC	0x1aed5c51
+#define MQ_MAGIC_MPSC	0x1aed3c51
 
 struct mp_queue_block {
   long mqb_head __attribute__ ((aligned(64)));
@@ -88,10 +90,34 @@ struct mp_queue_block {
   mpq_node_t mqb_nodes[MPQ_BLOCK_SIZE] __attribute__ ((aligned(64)));
 };
 
+/*
+  Blocks of single-consumer queues (MQ_MAGIC_SPSC, MQ_MAGIC_MPSC): a slot is
+  published by storing a non-zero value into it, so the consumer needs
+  neither CAS nor hazard pointers. The first block of a queue is small.
+*/
+#define SPQ_SMALL_BLOCK_SIZE	32
+#define SPQ_BLOCK_SIZE	512
+
+struct sp_queue_block {
+  long spb_head __attribute__ ((aligned(64)));  // consumer only
+  struct sp_queue_block *spb_retired_next;
+  long spb_tail __attribute__ ((aligned(64)));  // producer(s); may run past spb_size in MPSC queues
+  struct sp_queue_block *spb_next;
+  int spb_size;
+  mqn_value_t spb_vals[0] __attribute__ ((aligned(64)));
+};
+
 struct mp_queue {
-  struct mp_queue_block *mq_head __attribute__ ((aligned(64)));
+  union {
+    struct mp_queue_block *mq_head;
+    struct sp_queue_block *mq_sp_head;
+  } __attribute__ ((aligned(64)));
   int mq_magic;
-  struct mp_queue_block *mq_tail __attribute__ ((aligned(64)));
+  struct sp_queue_block *mq_sp_retired;  // MPSC blocks the consumer left while producers still held them
+  union {
+    struct mp_queue_block *mq_tail;
+    struct sp_queue_block *mq_sp_tail;
+  } __attribute__ ((aligned(64)));
 #if MPQ_USE_POSIX_SEMAPHORES
   sem_t mq_sem __attribute__ ((aligned(64)));
 #else
@@ -101,6 +127,7 @@ struct mp_queue {
 
 extern volatile int mpq_blocks_allocated, mpq_blocks_allocated_max, mpq_blocks_allocations, mpq_blocks_true_allocations, mpq_blocks_wasted, mpq_blocks_prepared;
 extern volatile int mpq_small_blocks_allocated, mpq_small_blocks_allocated_max;
+extern volatile int spq_blocks_allocated;
 
 #define MAX_MPQ_THREADS	256
 extern __thread int mpq_this_thread_id;
@@ -125,6 +152,16 @@ void init_mp_queue_w (struct mp_queue *MQ);
 void clear_mp_queue (struct mp_queue *MQ); // frees all mpq block chain; invoke only if nobody else is using mp-queue
 void free_mp_queue (struct mp_queue *MQ);  // same + invoke free()
 
+/*
+  Cheaper queues for a single consumer: SPSC for one producer at a time,
+  MPSC for any number of producers. Only mpq_push_w (), mpq_pop_nw (),
+  mpq_is_empty () and free_mp_queue () may be used with them. Pops must
+  never run concurrently (e.g. they all happen in one job), and neither may
+  pushes into an SPSC queue; a push and a pop may.
+*/
+struct mp_queue *alloc_mp_queue_spsc (void);
+struct mp_queue *alloc_mp_queue_mpsc (void);
+
 // flags for mpq_push / mpq_pop functions
 #define	MPQF_RECURSIVE	8192
 #define	MPQF_STORE_PTR	4096
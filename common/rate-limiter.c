@@ -14,6 +14,7 @@
 #include <windows.h>
 #else
 #include <pthread.h>
+#include <sched.h>
 #endif
 
 #include "common/rate-limiter.h"
@@ -921,3 +922,361 @@ void rate_limiter_cleanup(rate_limiter_t *limiter) {
     vkprintf(1, "Rate limiter cleaned up\n");
     free(limiter);
 }
+
+/*
+    Шардированный лимитер с бинарными ключами
+*/
+
+typedef struct {
+    rate_limit_key_t key;
+    uint64_t last_ns;           // 0 - слот не занимали
+    uint64_t window_start_ns;
+    double level;               // токены (token bucket) или вода (leaky bucket)
+    double rate;                // множитель лимита (adaptive)
+    uint32_t count;             // запросов в текущем окне
+    uint32_t prev_count;        // в предыдущем окне (sliding window)
+    uint32_t recent_requests;
+    uint32_t recent_rejections;
+} rate_limit_slot_t;
+
+// Счётчики меняются под блокировкой шарда; выравнивание против ложного разделения
+struct rate_limit_shard {
+    volatile int lock;
+    uint64_t requests;
+    uint64_t rejections;
+    uint64_t evictions;
+    rate_limit_slot_t *slots;
+} __attribute__((aligned(64)));
+
+_Static_assert(sizeof(rate_limit_key_t) == 24, "rate_limit_key_t is hashed as three words");
+
+#define RATE_SHARD_SPINS 128
+
+static inline void rate_shard_lock(rate_limit_shard_t *shard) {
+    while (__sync_lock_test_and_set(&shard->lock, 1)) {
+        // держатель мог быть вытеснен: долго не крутимся, отдаём процессор
+        for (int spins = 0; shard->lock; spins++) {
+            if (spins == RATE_SHARD_SPINS) {
+#ifdef _WIN32
+                SwitchToThread();
+#else
+                sched_yield();
+#endif
+                spins = 0;
+            }
+        }
+    }
+}
+
+static inline void rate_shard_unlock(rate_limit_shard_t *shard) {
+    __sync_lock_release(&shard->lock);
+}
+
+static uint64_t rate_now_ns(void) {
+#ifdef _WIN32
+    return GetTickCount64() * 1000000ULL;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Финализатор MurmurHash3: у IPv4-ключа адрес целиком в старших битах слова
+static inline uint64_t rate_mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t rate_key_hash(const rate_limit_key_t *key) {
+    uint64_t w[3];
+    memcpy(w, key, sizeof(w));
+    return rate_mix64(w[0] ^ rate_mix64(w[1] ^ rate_mix64(w[2])));
+}
+
+void rate_limit_key_ipv4(rate_limit_key_t *key, uint32_t ip, int secret_id) {
+    memset(key, 0, sizeof(*key));
+    key->addr[10] = 0xff;
+    key->addr[11] = 0xff;
+    key->addr[12] = ip >> 24;
+    key->addr[13] = ip >> 16;
+    key->addr[14] = ip >> 8;
+    key->addr[15] = ip;
+    key->secret_id = secret_id;
+}
+
+void rate_limit_key_ipv6(rate_limit_key_t *key, const uint8_t ip[16], int secret_id) {
+    memset(key, 0, sizeof(*key));
+    memcpy(key->addr, ip, 16);
+    key->secret_id = secret_id;
+}
+
+// Параметры по умолчанию выводятся из max_requests за window_seconds
+static uint64_t rate_window_ns(const rate_limit_config_t *config) {
+    return (uint64_t)(config->window_seconds > 0 ? config->window_seconds : 1) * 1000000000ULL;
+}
+
+static double rate_per_second(const rate_limit_config_t *config, uint64_t rate) {
+    if (rate) return (double)rate;
+    return (double)config->max_requests / (config->window_seconds > 0 ? config->window_seconds : 1);
+}
+
+static double rate_bucket_capacity(const rate_limit_config_t *config) {
+    double capacity = config->bucket_capacity ? config->bucket_capacity : config->max_requests;
+    if (config->enable_burst) {
+        capacity += config->burst_capacity;
+    }
+    return capacity;
+}
+
+static double rate_adaptive_clamp(const rate_limit_config_t *config, double rate) {
+    double max_rate = config->max_rate > 0 ? config->max_rate : 1.0;
+    if (rate > max_rate) rate = max_rate;
+    if (rate < config->min_rate) rate = config->min_rate;
+    return rate;
+}
+
+static void rate_slot_init(rate_limiter_sharded_t *limiter, rate_limit_slot_t *slot,
+                           const rate_limit_key_t *key, uint64_t now) {
+    memset(slot, 0, sizeof(*slot));
+    slot->key = *key;
+    slot->last_ns = now;
+    slot->window_start_ns = now;
+    if (limiter->config.algorithm == RATE_LIMIT_TOKEN_BUCKET) {
+        slot->level = rate_bucket_capacity(&limiter->config);
+    }
+    slot->rate = rate_adaptive_clamp(&limiter->config, 1.0);
+}
+
+// Запись ключа или свободный слот окна; устаревшие записи считаются свободными
+static rate_limit_slot_t* rate_shard_find(rate_limiter_sharded_t *limiter, rate_limit_shard_t *shard,
+                                          const rate_limit_key_t *key, uint64_t hash, uint64_t now) {
+    rate_limit_slot_t *free_slot = NULL, *oldest = NULL;
+
+    for (int i = 0; i < RATE_LIMIT_PROBE; i++) {
+        rate_limit_slot_t *slot = &shard->slots[(hash + i) & limiter->shard_mask];
+        int live = slot->last_ns && (now <= slot->last_ns || now - slot->last_ns <= limiter->idle_ns);
+
+        if (slot->last_ns && !memcmp(&slot->key, key, sizeof(*key))) {
+            if (!live) {
+                rate_slot_init(limiter, slot, key, now);
+            }
+            return slot;
+        }
+        if (!live) {
+            if (!free_slot) free_slot = slot;
+        } else if (!oldest || slot->last_ns < oldest->last_ns) {
+            oldest = slot;
+        }
+    }
+
+    if (!free_slot) {
+        free_slot = oldest;
+        shard->evictions++;
+    }
+    rate_slot_init(limiter, free_slot, key, now);
+    return free_slot;
+}
+
+static rate_limit_status_t rate_slot_check(rate_limiter_sharded_t *limiter, rate_limit_slot_t *slot,
+                                           uint64_t now) {
+    const rate_limit_config_t *config = &limiter->config;
+    uint64_t window = rate_window_ns(config);
+    double elapsed = (now - slot->last_ns) * 1e-9;
+
+    switch (config->algorithm) {
+        case RATE_LIMIT_TOKEN_BUCKET: {
+            double capacity = rate_bucket_capacity(config);
+            slot->level += elapsed * rate_per_second(config, config->refill_rate);
+            if (slot->level > capacity) slot->level = capacity;
+            if (slot->level >= 1.0) {
+                slot->level -= 1.0;
+                return RATE_LIMIT_OK;
+            }
+            return RATE_LIMIT_EXCEEDED;
+        }
+
+        case RATE_LIMIT_SLIDING_WINDOW: {
+            // Счётчик прошлого окна учитывается с весом непрошедшей его части
+            uint64_t in_window = now - slot->window_start_ns;
+            if (in_window >= window) {
+                uint64_t windows = in_window / window;
+                slot->prev_count = windows == 1 ? slot->count : 0;
+                slot->count = 0;
+                slot->window_start_ns += windows * window;
+                in_window -= windows * window;
+            }
+            double weight = 1.0 - (double)in_window / window;
+            if (slot->prev_count * weight + slot->count < config->max_requests) {
+                slot->count++;
+                return RATE_LIMIT_OK;
+            }
+            return RATE_LIMIT_EXCEEDED;
+        }
+
+        case RATE_LIMIT_LEAKY_BUCKET:
+            slot->level -= elapsed * rate_per_second(config, config->leak_rate);
+            if (slot->level < 0) slot->level = 0;
+            if (slot->level + 1.0 <= config->max_requests) {
+                slot->level += 1.0;
+                return RATE_LIMIT_OK;
+            }
+            return RATE_LIMIT_EXCEEDED;
+
+        case RATE_LIMIT_ADAPTIVE:
+            if (now - slot->window_start_ns >= window) {
+                slot->count = 0;
+                slot->window_start_ns = now;
+            }
+            // Как rate_limit_adaptive: множитель падает при доле отказов выше половины
+            if (slot->recent_requests > 0) {
+                double rejection_ratio = (double)slot->recent_rejections / slot->recent_requests;
+                slot->rate = rate_adaptive_clamp(config, slot->rate * (rejection_ratio > 0.5 ? 0.9 : 1.1));
+                if (slot->recent_requests > 1000) {
+                    slot->recent_requests /= 2;
+                    slot->recent_rejections /= 2;
+                }
+            }
+            slot->recent_requests++;
+            if (slot->count < (uint64_t)(config->max_requests * slot->rate)) {
+                slot->count++;
+                return RATE_LIMIT_OK;
+            }
+            slot->recent_rejections++;
+            return RATE_LIMIT_EXCEEDED;
+
+        case RATE_LIMIT_FIXED_WINDOW:
+        default:
+            if (now - slot->window_start_ns >= window) {
+                slot->count = 0;
+                slot->window_start_ns = now;
+            }
+            if (slot->count < config->max_requests) {
+                slot->count++;
+                return RATE_LIMIT_OK;
+            }
+            return RATE_LIMIT_EXCEEDED;
+    }
+}
+
+rate_limiter_sharded_t* rate_limiter_sharded_init(const rate_limit_config_t *config,
+                                                  size_t max_entries, time_t idle_seconds) {
+    if (!config || !max_entries || idle_seconds <= 0) return NULL;
+
+    rate_limiter_sharded_t *limiter = calloc(1, sizeof(rate_limiter_sharded_t));
+    if (!limiter) return NULL;
+    memcpy(&limiter->config, config, sizeof(rate_limit_config_t));
+
+    // Заполнение таблиц не больше половины, чтобы окна проб не переполнялись
+    size_t per_shard = RATE_LIMIT_PROBE * 2;
+    while (per_shard * RATE_LIMIT_SHARDS < max_entries * 2) {
+        per_shard <<= 1;
+    }
+    limiter->shard_mask = per_shard - 1;
+    limiter->idle_ns = (uint64_t)idle_seconds * 1000000000ULL;
+
+    limiter->shards = calloc(RATE_LIMIT_SHARDS, sizeof(rate_limit_shard_t));
+    if (!limiter->shards) {
+        free(limiter);
+        return NULL;
+    }
+    for (int i = 0; i < RATE_LIMIT_SHARDS; i++) {
+        limiter->shards[i].slots = calloc(per_shard, sizeof(rate_limit_slot_t));
+        if (!limiter->shards[i].slots) {
+            rate_limiter_sharded_cleanup(limiter);
+            return NULL;
+        }
+    }
+    limiter->start_time = time(NULL);
+
+    vkprintf(1, "Sharded rate limiter initialized: algorithm=%s, %d shards x %zu slots, idle=%lds\n",
+             rate_limit_algorithm_to_string(config->algorithm), RATE_LIMIT_SHARDS, per_shard,
+             (long)idle_seconds);
+
+    return limiter;
+}
+
+rate_limit_status_t rate_limit_check_key_at(rate_limiter_sharded_t *limiter, const rate_limit_key_t *key,
+                                            uint64_t now_ns) {
+    if (!limiter || !key) return RATE_LIMIT_ERROR;
+    if (!now_ns) now_ns = 1;
+
+    uint64_t hash = rate_key_hash(key);
+    rate_limit_shard_t *shard = &limiter->shards[(hash >> 32) % RATE_LIMIT_SHARDS];
+
+    rate_shard_lock(shard);
+    rate_limit_slot_t *slot = rate_shard_find(limiter, shard, key, hash, now_ns);
+    // время читалось до блокировки, другой поток мог успеть записать более позднее
+    if (now_ns < slot->last_ns) now_ns = slot->last_ns;
+    rate_limit_status_t status = rate_slot_check(limiter, slot, now_ns);
+    slot->last_ns = now_ns;
+    shard->requests++;
+    if (status != RATE_LIMIT_OK) {
+        shard->rejections++;
+    }
+    rate_shard_unlock(shard);
+
+    return status;
+}
+
+rate_limit_status_t rate_limit_check_key(rate_limiter_sharded_t *limiter, const rate_limit_key_t *key) {
+    return rate_limit_check_key_at(limiter, key, rate_now_ns());
+}
+
+void rate_limiter_sharded_get_stats(rate_limiter_sharded_t *limiter, rate_limiter_stats_t *stats) {
+    if (!limiter || !stats) return;
+
+    memset(stats, 0, sizeof(*stats));
+    uint64_t now = rate_now_ns();
+    for (int i = 0; i < RATE_LIMIT_SHARDS; i++) {
+        rate_limit_shard_t *shard = &limiter->shards[i];
+        rate_shard_lock(shard);
+        stats->total_requests += shard->requests;
+        stats->total_rejections += shard->rejections;
+        for (uint32_t j = 0; j <= limiter->shard_mask; j++) {
+            uint64_t last = shard->slots[j].last_ns;
+            if (last && (now <= last || now - last <= limiter->idle_ns)) {
+                stats->active_entries++;
+            }
+        }
+        rate_shard_unlock(shard);
+    }
+    stats->max_entries = (size_t)RATE_LIMIT_SHARDS * (limiter->shard_mask + 1);
+    stats->uptime_seconds = time(NULL) - limiter->start_time;
+
+    if (stats->total_requests > 0) {
+        stats->rejection_rate = (double)stats->total_rejections /
+                               (double)stats->total_requests * 100.0;
+    }
+    if (stats->uptime_seconds > 0) {
+        stats->requests_per_second = stats->total_requests / stats->uptime_seconds;
+    }
+}
+
+uint64_t rate_limiter_sharded_evictions(rate_limiter_sharded_t *limiter) {
+    uint64_t total = 0;
+    if (!limiter) return 0;
+
+    for (int i = 0; i < RATE_LIMIT_SHARDS; i++) {
+        rate_shard_lock(&limiter->shards[i]);
+        total += limiter->shards[i].evictions;
+        rate_shard_unlock(&limiter->shards[i]);
+    }
+    return total;
+}
+
+void rate_limiter_sharded_cleanup(rate_limiter_sharded_t *limiter) {
+    if (!limiter) return;
+
+    if (limiter->shards) {
+        for (int i = 0; i < RATE_LIMIT_SHARDS; i++) {
+            free(limiter->shards[i].slots);
+        }
+        free(limiter->shards);
+    }
+    free(limiter);
+}
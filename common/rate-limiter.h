@@ -220,6 +220,61 @@ time_t rate_limit_calculate_reset_time(rate_limiter_t *limiter, const char *key)
 char* rate_limit_status_to_string(rate_limit_status_t status);
 const char* rate_limit_algorithm_to_string(rate_limit_algorithm_t algo);
 
+/*
+    Шардированный лимитер с бинарными ключами
+
+    Для проверок на горячем пути (адрес клиента при accept): ключ
+    фиксированного размера вместо строки, RATE_LIMIT_SHARDS шардов со своей
+    спин-блокировкой вместо одного мьютекса, записи лежат прямо в таблице
+    шарда с открытой адресацией и ничего не выделяют на промахе. Запись,
+    к которой не обращались idle_seconds, считается свободным слотом и
+    переиспользуется при следующей вставке рядом - общего обхода таблицы
+    нет. Если все RATE_LIMIT_PROBE слотов окна заняты живыми записями,
+    вытесняется самая давняя.
+
+    Алгоритмы и их параметры - те же, что в rate_limit_config_t; время
+    в наносекундах, поэтому скорости не округляются до секунд. Белые и
+    чёрные списки и колбэки есть только у строкового API.
+*/
+
+#define RATE_LIMIT_SHARDS 64
+#define RATE_LIMIT_PROBE 16
+
+// Адрес клиента и номер секрета; сравнивается побайтно
+typedef struct {
+    uint8_t addr[16];           // IPv6 или IPv4 как ::ffff:a.b.c.d
+    int32_t secret_id;          // -1 - без секрета
+    uint32_t reserved;          // всегда 0
+} rate_limit_key_t;
+
+typedef struct rate_limit_shard rate_limit_shard_t;
+
+typedef struct {
+    rate_limit_config_t config;
+    uint64_t idle_ns;
+    uint32_t shard_mask;        // слотов в шарде - 1
+    rate_limit_shard_t *shards;
+    time_t start_time;
+} rate_limiter_sharded_t;
+
+void rate_limit_key_ipv4(rate_limit_key_t *key, uint32_t ip, int secret_id);    // ip в порядке хоста
+void rate_limit_key_ipv6(rate_limit_key_t *key, const uint8_t ip[16], int secret_id);
+
+// max_entries - на сколько живых ключей рассчитана таблица: она заполняется не больше чем наполовину
+rate_limiter_sharded_t* rate_limiter_sharded_init(const rate_limit_config_t *config,
+                                                  size_t max_entries, time_t idle_seconds);
+void rate_limiter_sharded_cleanup(rate_limiter_sharded_t *limiter);
+
+// Из любого потока
+rate_limit_status_t rate_limit_check_key(rate_limiter_sharded_t *limiter, const rate_limit_key_t *key);
+// То же с явным монотонным временем, для тестов и бенчмарков
+rate_limit_status_t rate_limit_check_key_at(rate_limiter_sharded_t *limiter, const rate_limit_key_t *key,
+                                            uint64_t now_ns);
+
+// active_entries - живые записи, max_entries - слотов всего
+void rate_limiter_sharded_get_stats(rate_limiter_sharded_t *limiter, rate_limiter_stats_t *stats);
+uint64_t rate_limiter_sharded_evictions(rate_limiter_sharded_t *limiter);
+
 #ifdef __cplusplus
 }
 #endif
@@ -383,6 +383,23 @@ int parse_ipv6 (unsigned short ipv6[8], char *str) {
   return -1;
 }
 
+struct hostent *(*kdb_gethostbyname_hook) (const char *name, int *answered);
+
+static struct hostent *kdb_gethostbyname_external (const char *name) {
+  if (kdb_gethostbyname_hook) {
+    int answered = 0;
+    struct hostent *h = kdb_gethostbyname_hook (name, &answered);
+    if (answered) {
+      return h;
+    }
+  }
+#ifdef __linux__
+  return gethostbyname (name) ?: gethostbyname2 (name, AF_INET6);
+#else
+  return gethostbyname (name);
+#endif
+}
+
 struct hostent *kdb_gethostbyname (const char *name) {
   if (!kdb_hosts_loaded) {
     kdb_load_hosts ();
@@ -403,19 +420,11 @@ struct hostent *kdb_gethostbyname (const char *name) {
   }
 
   if (kdb_hosts_loaded <= 0) {
-#ifdef __linux__
-    return gethostbyname (name) ?: gethostbyname2 (name, AF_INET6);
-#else
-    return gethostbyname (name);
-#endif
+    return kdb_gethostbyname_external (name);
   }
 
   if (len >= 128) {
-#ifdef __linux__
-    return gethostbyname (name) ?: gethostbyname2 (name, AF_INET6);
-#else
-    return gethostbyname (name);
-#endif
+    return kdb_gethostbyname_external (name);
   }
 
   struct host *res = getHash (&Hosts, name, len, 0);
@@ -423,11 +432,7 @@ struct hostent *kdb_gethostbyname (const char *name) {
 
   if (!res) {
     if (strchr (name, '.') || strchr (name, ':')) {
-#ifdef __linux__
-      return gethostbyname (name) ?: gethostbyname2 (name, AF_INET6);
-#else
-      return gethostbyname (name);
-#endif
+      return kdb_gethostbyname_external (name);
     } else {
       return 0;
     }
@@ -31,6 +31,8 @@ extern int kdb_hosts_loaded;
 int kdb_load_hosts (void);
 
 struct hostent *kdb_gethostbyname (const char *name);
+/* net-dns-resolver: ответ из кэша; *answered == 0 - решать блокирующим запросом */
+extern struct hostent *(*kdb_gethostbyname_hook) (const char *name, int *answered);
 char *detect_hostname (void);
 
 #ifdef __cplusplus
@@ -20,6 +20,7 @@
 
 #define _FILE_OFFSET_BITS 64
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -28,6 +29,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #include "common/structured-logger.h"
 #include "common/kprintf.h"
@@ -38,7 +40,6 @@ static void *async_logger_worker(void *arg);
 static int write_log_entry(const struct log_entry *entry);
 static int format_json_log(const struct log_entry *entry, char *buffer, size_t buffer_size);
 static int format_standard_log(const struct log_entry *entry, char *buffer, size_t buffer_size);
-static int async_log_enqueue(const struct log_entry *entry);
 static const char *log_level_to_string(enum log_level level);
 
 /* Logging statistics - defined in header */
@@ -51,8 +52,9 @@ static struct logger_config global_logger_config = {
     .enable_async_logging = 1,
     .enable_context_logging = 1,
     .max_message_size = 1024,
-    .buffer_size = 10000,
+    .buffer_size = 256,
     .flush_interval_seconds = 5,
+    .flush_interval_ms = 50,
     .enable_file_logging = 1,
     .enable_stdout_logging = 1,
     .enable_stderr_logging = 1,
@@ -62,19 +64,70 @@ static struct logger_config global_logger_config = {
     .max_log_files = 10
 };
 
-/* Async logging buffer */
-struct log_buffer {
-    struct log_entry *entries;
-    int capacity;
-    int head;
-    int tail;
-    int count;
-    pthread_mutex_t buffer_mutex;
-    pthread_cond_t buffer_not_full;
-    pthread_cond_t buffer_not_empty;
+/*
+ * Async logging: каждый поток-производитель пишет неформатированные
+ * log_entry в собственный SPSC ring без блокировок. Единственный drain
+ * thread забирает записи из всех ring'ов, форматирует их пачкой в общий
+ * arena-буфер и выполняет один writev() на каждый поток вывода за проход.
+ * При переполнении ring запись отбрасывается и учитывается в dropped.
+ *
+ * Ring живёт, пока жив его поток: освобождает его только drain thread
+ * после выхода владельца. structured_logger_cleanup () лишь дочитывает
+ * ring'и, поэтому производитель, успевший пройти проверку
+ * async_logger_running, пишет в память, которая остаётся его, а после
+ * повторного init поток продолжает писать в тот же ring.
+ */
+#define MAX_LOG_RINGS 256
+#define LOG_LINE_MAX 2048
+#define LOG_ARENA_SIZE (256 * 1024)
+#define LOG_IOV_MAX 512
+
+enum log_stream {
+    LOG_STREAM_FILE = 0,
+    LOG_STREAM_ERROR_FILE,
+    LOG_STREAM_STDOUT,
+    LOG_STREAM_STDERR,
+    LOG_STREAM_MAX
+};
+
+struct log_ring {
+    /* Пишется только владельцем */
+    unsigned long long head __attribute__((aligned(64)));
+    long long dropped;
+    long long enqueued;
+    long long level_distribution[LOG_LEVEL_MAX];
+    long long format_distribution[LOG_FORMAT_MAX];
+    /* Пишется только drain thread */
+    unsigned long long tail __attribute__((aligned(64)));
+    int owner_exited;
+    unsigned mask;
+    struct log_entry entries[0] __attribute__((aligned(64)));
+};
+
+struct log_batch {
+    char arena[LOG_ARENA_SIZE];
+    int arena_used;
+    struct iovec iov[LOG_STREAM_MAX][LOG_IOV_MAX];
+    int iov_cnt[LOG_STREAM_MAX];
 };
 
-static struct log_buffer async_log_buffer = {0};
+static struct log_ring *log_rings[MAX_LOG_RINGS];
+static int log_rings_num = 0;
+static unsigned log_ring_capacity = 0;
+static pthread_mutex_t log_rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t log_ring_key;
+static int log_ring_key_created = 0;
+/* поколение init: неудачная регистрация ring повторяется только после нового init */
+static int log_rings_generation = 0;
+static __thread struct log_ring *this_log_ring = NULL;
+static __thread int this_log_ring_failed = 0;
+
+/* Счётчики ring'ов, освобождённых drain thread после выхода владельца */
+static long long retired_rings_dropped = 0;
+static long long retired_rings_enqueued = 0;
+static long long unregistered_drops = 0;
+
+static struct log_batch *drain_batch = NULL;
 static pthread_t async_logger_thread = 0;
 static int async_logger_running = 0;
 static pthread_mutex_t logger_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -95,6 +148,73 @@ struct log_context {
 
 static __thread struct log_context current_context = {0};
 
+static unsigned round_up_pow2(unsigned x) {
+    unsigned r = 1;
+    while (r < x && r < (1u << 20)) {
+        r <<= 1;
+    }
+    return r;
+}
+
+/* Вызывается при завершении потока-владельца: ring дочитывается и освобождается drain thread */
+static void log_ring_thread_exit(void *arg) {
+    int i;
+    pthread_mutex_lock(&log_rings_mutex);
+    for (i = 0; i < log_rings_num; i++) {
+        if (log_rings[i] == arg) {
+            __sync_synchronize();
+            log_rings[i]->owner_exited = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&log_rings_mutex);
+}
+
+static struct log_ring *log_ring_register(void) {
+    if (this_log_ring_failed == log_rings_generation) {
+        return NULL;
+    }
+    struct log_ring *R = NULL;
+    size_t size = sizeof(struct log_ring) + (size_t)log_ring_capacity * sizeof(struct log_entry);
+    if (posix_memalign((void **)&R, 64, size) != 0) {
+        this_log_ring_failed = log_rings_generation;
+        return NULL;
+    }
+    memset(R, 0, sizeof(struct log_ring));
+    R->mask = log_ring_capacity - 1;
+
+    pthread_mutex_lock(&log_rings_mutex);
+    int slot = -1, i;
+    for (i = 0; i < log_rings_num; i++) {
+        if (!log_rings[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0 && log_rings_num < MAX_LOG_RINGS) {
+        slot = log_rings_num;
+    }
+    if (slot < 0) {
+        pthread_mutex_unlock(&log_rings_mutex);
+        free(R);
+        this_log_ring_failed = log_rings_generation;
+        return NULL;
+    }
+    __sync_synchronize();
+    log_rings[slot] = R;
+    if (slot == log_rings_num) {
+        __sync_synchronize();
+        log_rings_num++;
+    }
+    pthread_mutex_unlock(&log_rings_mutex);
+
+    if (log_ring_key_created) {
+        pthread_setspecific(log_ring_key, R);
+    }
+    this_log_ring = R;
+    return R;
+}
+
 // Инициализация structured logger
 int structured_logger_init(const char *log_file_path) {
     pthread_mutex_lock(&logger_mutex);
@@ -114,21 +234,21 @@ int structured_logger_init(const char *log_file_path) {
         global_logger_config.log_file_path[sizeof(global_logger_config.log_file_path) - 1] = '\0';
     }
     
-    // Создание async buffer
-    async_log_buffer.capacity = global_logger_config.buffer_size;
-    async_log_buffer.entries = calloc(async_log_buffer.capacity, sizeof(struct log_entry));
-    if (!async_log_buffer.entries) {
-        pthread_mutex_unlock(&logger_mutex);
-        return -1;
+    // Параметры новых per-thread rings и drain буфер; уже созданные ring'и сохраняют свой размер
+    log_rings_generation++;
+    log_ring_capacity = round_up_pow2(global_logger_config.buffer_size > 0 ? global_logger_config.buffer_size : 256);
+    if (!drain_batch) {
+        drain_batch = malloc(sizeof(struct log_batch));
+        if (!drain_batch) {
+            pthread_mutex_unlock(&logger_mutex);
+            return -1;
+        }
+    }
+    drain_batch->arena_used = 0;
+    memset(drain_batch->iov_cnt, 0, sizeof(drain_batch->iov_cnt));
+    if (!log_ring_key_created) {
+        log_ring_key_created = (pthread_key_create(&log_ring_key, log_ring_thread_exit) == 0);
     }
-    
-    async_log_buffer.head = 0;
-    async_log_buffer.tail = 0;
-    async_log_buffer.count = 0;
-    
-    pthread_mutex_init(&async_log_buffer.buffer_mutex, NULL);
-    pthread_cond_init(&async_log_buffer.buffer_not_full, NULL);
-    pthread_cond_init(&async_log_buffer.buffer_not_empty, NULL);
     
     // Открытие log файлов
     if (global_logger_config.enable_file_logging) {
@@ -168,56 +288,167 @@ int structured_logger_init(const char *log_file_path) {
                    "Structured logger initialized",
                    "version=1.0;config=%s", global_logger_config.log_file_path);
 
-    vkprintf(1, "Structured logger initialized with async=%s, format=%s\n",
+    vkprintf(1, "Structured logger initialized with async=%s, format=%s, ring=%u\n",
              global_logger_config.enable_async_logging ? "enabled" : "disabled",
-             global_logger_config.enable_json_format ? "JSON" : "standard");
+             global_logger_config.enable_json_format ? "JSON" : "standard",
+             log_ring_capacity);
 
     return 0;
 }
 
-/* Async logger worker thread */
-static void *async_logger_worker(void *arg) {
-    struct log_entry entry;
-    
-    while (async_logger_running) {
-        // Получение entry из buffer
-        pthread_mutex_lock(&async_log_buffer.buffer_mutex);
-        
-        while (async_log_buffer.count == 0 && async_logger_running) {
-            struct timespec timeout;
-            clock_gettime(CLOCK_REALTIME, &timeout);
-            timeout.tv_sec += global_logger_config.flush_interval_seconds;
-            pthread_cond_timedwait(&async_log_buffer.buffer_not_empty, 
-                                 &async_log_buffer.buffer_mutex, &timeout);
+static int log_stream_fd(enum log_stream stream) {
+    switch (stream) {
+        case LOG_STREAM_FILE: return log_file_handle ? fileno(log_file_handle) : -1;
+        case LOG_STREAM_ERROR_FILE: return error_log_file_handle ? fileno(error_log_file_handle) : -1;
+        case LOG_STREAM_STDOUT: return STDOUT_FILENO;
+        case LOG_STREAM_STDERR: return STDERR_FILENO;
+        default: return -1;
+    }
+}
+
+/* Один writev() на поток вывода; короткие записи дописываются */
+static void log_batch_flush(struct log_batch *B) {
+    int s;
+    for (s = 0; s < LOG_STREAM_MAX; s++) {
+        int cnt = B->iov_cnt[s];
+        if (!cnt) {
+            continue;
         }
-        
-        if (!async_logger_running) {
-            pthread_mutex_unlock(&async_log_buffer.buffer_mutex);
+        int fd = log_stream_fd(s);
+        struct iovec *iov = B->iov[s];
+        while (fd >= 0 && cnt > 0) {
+            ssize_t r = writev(fd, iov, cnt);
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                logger_stats.failed_writes++;
+                break;
+            }
+            logger_stats.batched_writes++;
+            while (cnt > 0 && (size_t)r >= iov->iov_len) {
+                r -= iov->iov_len;
+                iov++;
+                cnt--;
+            }
+            if (cnt > 0) {
+                iov->iov_base = (char *)iov->iov_base + r;
+                iov->iov_len -= r;
+            }
+        }
+        B->iov_cnt[s] = 0;
+    }
+    B->arena_used = 0;
+}
+
+static void log_batch_add_stream(struct log_batch *B, enum log_stream stream, char *line, int len) {
+    struct iovec *v = &B->iov[stream][B->iov_cnt[stream]++];
+    v->iov_base = line;
+    v->iov_len = len;
+}
+
+/* Форматирует запись один раз и ссылается на неё из iovec всех нужных потоков */
+static void log_batch_append(struct log_batch *B, const struct log_entry *entry) {
+    int s;
+    if (B->arena_used + LOG_LINE_MAX + 1 > LOG_ARENA_SIZE) {
+        log_batch_flush(B);
+    }
+    for (s = 0; s < LOG_STREAM_MAX; s++) {
+        if (B->iov_cnt[s] >= LOG_IOV_MAX) {
+            log_batch_flush(B);
             break;
         }
-        
-        if (async_log_buffer.count > 0) {
-            entry = async_log_buffer.entries[async_log_buffer.tail];
-            async_log_buffer.tail = (async_log_buffer.tail + 1) % async_log_buffer.capacity;
-            async_log_buffer.count--;
-            pthread_cond_signal(&async_log_buffer.buffer_not_full);
+    }
+
+    char *line = B->arena + B->arena_used;
+    int len;
+    if (global_logger_config.enable_json_format) {
+        len = format_json_log(entry, line, LOG_LINE_MAX);
+    } else {
+        len = format_standard_log(entry, line, LOG_LINE_MAX);
+    }
+    if (len < 0) {
+        return;
+    }
+    if (len > LOG_LINE_MAX - 1) {
+        len = LOG_LINE_MAX - 1;
+    }
+    line[len++] = '\n';
+    B->arena_used += len;
+
+    if (global_logger_config.enable_file_logging && log_file_handle) {
+        log_batch_add_stream(B, LOG_STREAM_FILE, line, len);
+        if (entry->is_error && error_log_file_handle) {
+            log_batch_add_stream(B, LOG_STREAM_ERROR_FILE, line, len);
         }
-        
-        pthread_mutex_unlock(&async_log_buffer.buffer_mutex);
-        
-        // Запись log entry
-        if (async_log_buffer.count >= 0) {
-            write_log_entry(&entry);
-            logger_stats.async_log_operations++;
+    }
+    if (global_logger_config.enable_stdout_logging && entry->level <= LOG_LEVEL_INFO) {
+        log_batch_add_stream(B, LOG_STREAM_STDOUT, line, len);
+    }
+    if (global_logger_config.enable_stderr_logging && entry->level >= LOG_LEVEL_WARNING) {
+        log_batch_add_stream(B, LOG_STREAM_STDERR, line, len);
+    }
+}
+
+/* Забирает все записи из всех rings; возвращает количество обработанных */
+static int log_rings_drain(struct log_batch *B) {
+    int processed = 0;
+    int i, n = log_rings_num;
+    __sync_synchronize();
+    for (i = 0; i < n; i++) {
+        struct log_ring *R = log_rings[i];
+        if (!R) {
+            continue;
+        }
+        int exited = R->owner_exited;
+        __sync_synchronize();
+        unsigned long long head = R->head;
+        __sync_synchronize();
+        unsigned long long tail = R->tail;
+        while (tail != head) {
+            log_batch_append(B, &R->entries[tail & R->mask]);
+            tail++;
+            processed++;
+        }
+        __sync_synchronize();
+        R->tail = tail;
+        if (exited) {
+            pthread_mutex_lock(&log_rings_mutex);
+            log_rings[i] = NULL;
+            pthread_mutex_unlock(&log_rings_mutex);
+            __sync_fetch_and_add(&retired_rings_dropped, R->dropped);
+            __sync_fetch_and_add(&retired_rings_enqueued, R->enqueued);
+            free(R);
         }
     }
-    
+    logger_stats.async_log_operations += processed;
+    return processed;
+}
+
+/* Async logger worker thread */
+static void *async_logger_worker(void *arg) {
+    int interval_ms = global_logger_config.flush_interval_ms > 0 ? global_logger_config.flush_interval_ms
+                                                                 : global_logger_config.flush_interval_seconds * 1000;
+    if (interval_ms <= 0) {
+        interval_ms = 50;
+    }
+    struct timespec delay = { .tv_sec = interval_ms / 1000, .tv_nsec = (interval_ms % 1000) * 1000000L };
+
+    while (async_logger_running) {
+        log_rings_drain(drain_batch);
+        log_batch_flush(drain_batch);
+        nanosleep(&delay, NULL);
+    }
+
+    // Финальный проход после остановки
+    log_rings_drain(drain_batch);
+    log_batch_flush(drain_batch);
     return NULL;
 }
 
-// Запись log entry
+// Синхронная запись log entry
 static int write_log_entry(const struct log_entry *entry) {
-    char formatted_message[2048];
+    char formatted_message[LOG_LINE_MAX];
     int result = 0;
     
     // Форматирование сообщения
@@ -318,45 +549,43 @@ static int format_standard_log(const struct log_entry *entry, char *buffer, size
     );
 }
 
-// Основная logging функция
-int structured_log(enum log_level level, 
-                  const char *component,
-                  const char *subsystem,
-                  const char *message,
-                  const char *context_format, ...) {
-    
-    if (level < global_logger_config.min_level) {
-        return 0;
-    }
-    
-    struct log_entry entry;
+static void log_copy_str(char *dst, const char *src, size_t size) {
+    size_t len = strnlen(src, size - 1);
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+// Заполнение записи на месте (в слоте ring или на стеке для sync режима)
+static void fill_log_entry(struct log_entry *entry,
+                           enum log_level level,
+                           const char *component,
+                           const char *subsystem,
+                           const char *message,
+                           const char *context_format, va_list args) {
     struct timeval tv;
     
     // Получение времени
     gettimeofday(&tv, NULL);
-    entry.timestamp = tv.tv_sec;
-    entry.precise_time = tv;
-    entry.level = level;
-    entry.format = global_logger_config.output_format;
-    entry.thread_id = (int)pthread_self();
-    entry.connection_id = 0; // Будет установлен вызывающим
-    entry.client_ip = 0;     // Будет установлен вызывающим
-    entry.is_error = (level >= LOG_LEVEL_ERROR);
-    entry.is_security_event = (strcmp(component, "security") == 0);
+    entry->timestamp = tv.tv_sec;
+    entry->precise_time = tv;
+    entry->level = level;
+    entry->format = global_logger_config.output_format;
+    entry->thread_id = (int)pthread_self();
+    entry->connection_id = 0; // Будет установлен вызывающим
+    entry->client_ip = 0;     // Будет установлен вызывающим
+    entry->is_error = (level >= LOG_LEVEL_ERROR);
+    entry->is_security_event = (component && strcmp(component, "security") == 0);
     
     // Копирование базовых полей
-    strncpy(entry.component, component ? component : "unknown", sizeof(entry.component) - 1);
-    strncpy(entry.subsystem, subsystem ? subsystem : "main", sizeof(entry.subsystem) - 1);
-    strncpy(entry.message, message ? message : "No message", sizeof(entry.message) - 1);
+    log_copy_str(entry->component, component ? component : "unknown", sizeof(entry->component));
+    log_copy_str(entry->subsystem, subsystem ? subsystem : "main", sizeof(entry->subsystem));
+    log_copy_str(entry->message, message ? message : "No message", sizeof(entry->message));
     
     // Обработка контекста
     if (context_format && global_logger_config.enable_context_logging) {
-        va_list args;
-        va_start(args, context_format);
-        vsnprintf(entry.context_data, sizeof(entry.context_data), context_format, args);
-        va_end(args);
+        vsnprintf(entry->context_data, sizeof(entry->context_data), context_format, args);
     } else {
-        entry.context_data[0] = '\0';
+        entry->context_data[0] = '\0';
     }
     
     // Добавление контекстной информации
@@ -369,47 +598,79 @@ int structured_log(enum log_level level,
                 current_context.request_id[0] ? " request_id=" : "",
                 current_context.request_id[0] ? current_context.request_id : "");
         
-        if (entry.context_data[0]) {
-            strncat(entry.context_data, ";", sizeof(entry.context_data) - strlen(entry.context_data) - 1);
-            strncat(entry.context_data, context_append, sizeof(entry.context_data) - strlen(entry.context_data) - 1);
+        if (entry->context_data[0]) {
+            strncat(entry->context_data, ";", sizeof(entry->context_data) - strlen(entry->context_data) - 1);
+            strncat(entry->context_data, context_append, sizeof(entry->context_data) - strlen(entry->context_data) - 1);
         } else {
-            strncpy(entry.context_data, context_append, sizeof(entry.context_data) - 1);
+            snprintf(entry->context_data, sizeof(entry->context_data), "%s", context_append);
         }
     }
-    
-    // Обновление статистики
-    logger_stats.total_log_entries++;
-    logger_stats.log_level_distribution[level]++;
-    logger_stats.log_format_distribution[entry.format]++;
-    
-    // Запись через async или sync
-    if (global_logger_config.enable_async_logging) {
-        return async_log_enqueue(&entry);
-    } else {
-        logger_stats.sync_log_operations++;
-        return write_log_entry(&entry);
+}
+
+// Резервирование слота в ring текущего потока; NULL - ring полон
+static struct log_entry *async_log_reserve(struct log_ring **ring) {
+    struct log_ring *R = this_log_ring;
+    if (!R) {
+        R = log_ring_register();
+        if (!R) {
+            __sync_fetch_and_add(&unregistered_drops, 1);
+            return NULL;
+        }
     }
+    *ring = R;
+    unsigned long long head = R->head;
+    if (head - R->tail > R->mask) {
+        R->dropped++;
+        return NULL;
+    }
+    return &R->entries[head & R->mask];
+}
+
+// Публикация заполненного слота для drain thread
+static void async_log_commit(struct log_ring *R, const struct log_entry *entry) {
+    R->enqueued++;
+    R->level_distribution[entry->level]++;
+    R->format_distribution[entry->format]++;
+    __sync_synchronize();
+    R->head++;
 }
 
-// Async log enqueue
-static int async_log_enqueue(const struct log_entry *entry) {
-    pthread_mutex_lock(&async_log_buffer.buffer_mutex);
+// Основная logging функция
+int structured_log(enum log_level level, 
+                  const char *component,
+                  const char *subsystem,
+                  const char *message,
+                  const char *context_format, ...) {
     
-    // Ожидание места в buffer
-    while (async_log_buffer.count >= async_log_buffer.capacity) {
-        logger_stats.buffer_overflows++;
-        pthread_cond_wait(&async_log_buffer.buffer_not_full, &async_log_buffer.buffer_mutex);
+    if (level < global_logger_config.min_level) {
+        return 0;
     }
     
-    // Добавление в buffer
-    async_log_buffer.entries[async_log_buffer.head] = *entry;
-    async_log_buffer.head = (async_log_buffer.head + 1) % async_log_buffer.capacity;
-    async_log_buffer.count++;
+    va_list args;
+    va_start(args, context_format);
     
-    pthread_cond_signal(&async_log_buffer.buffer_not_empty);
-    pthread_mutex_unlock(&async_log_buffer.buffer_mutex);
+    // Запись через async (без блокировок) или sync
+    if (global_logger_config.enable_async_logging && async_logger_running) {
+        struct log_ring *R = NULL;
+        struct log_entry *slot = async_log_reserve(&R);
+        if (slot) {
+            fill_log_entry(slot, level, component, subsystem, message, context_format, args);
+            async_log_commit(R, slot);
+        }
+        va_end(args);
+        return slot ? 0 : -1;
+    }
     
-    return 0;
+    struct log_entry entry;
+    fill_log_entry(&entry, level, component, subsystem, message, context_format, args);
+    va_end(args);
+    
+    // Обновление статистики
+    logger_stats.total_log_entries++;
+    logger_stats.log_level_distribution[level]++;
+    logger_stats.log_format_distribution[entry.format]++;
+    logger_stats.sync_log_operations++;
+    return write_log_entry(&entry);
 }
 
 // Установка контекста для текущего thread
@@ -460,25 +721,54 @@ int structured_logger_set_level(enum log_level level) {
 
 // Получение статистики
 void structured_logger_get_stats(struct logger_stats *stats) {
-    if (stats) {
-        memcpy(stats, &logger_stats, sizeof(struct logger_stats));
+    int i, j;
+    if (!stats) {
+        return;
+    }
+    memcpy(stats, &logger_stats, sizeof(struct logger_stats));
+    stats->total_log_entries += retired_rings_enqueued;
+    stats->dropped_entries += retired_rings_dropped + unregistered_drops;
+
+    // Суммирование per-thread счётчиков
+    pthread_mutex_lock(&log_rings_mutex);
+    for (i = 0; i < log_rings_num; i++) {
+        struct log_ring *R = log_rings[i];
+        if (!R) {
+            continue;
+        }
+        stats->active_rings++;
+        stats->total_log_entries += R->enqueued;
+        stats->dropped_entries += R->dropped;
+        for (j = 0; j < LOG_LEVEL_MAX; j++) {
+            stats->log_level_distribution[j] += R->level_distribution[j];
+        }
+        for (j = 0; j < LOG_FORMAT_MAX; j++) {
+            stats->log_format_distribution[j] += R->format_distribution[j];
+        }
     }
+    pthread_mutex_unlock(&log_rings_mutex);
+    stats->buffer_overflows += stats->dropped_entries;
 }
 
 // Вывод статистики
 void structured_logger_print_stats(void) {
+    struct logger_stats st;
+    structured_logger_get_stats(&st);
     vkprintf(1, "Structured Logger Statistics:\n");
-    vkprintf(1, "  Total Log Entries: %lld\n", logger_stats.total_log_entries);
+    vkprintf(1, "  Total Log Entries: %lld\n", st.total_log_entries);
     vkprintf(1, "  Log Level Distribution:\n");
-    vkprintf(1, "    DEBUG: %lld\n", logger_stats.log_level_distribution[LOG_LEVEL_DEBUG]);
-    vkprintf(1, "    INFO: %lld\n", logger_stats.log_level_distribution[LOG_LEVEL_INFO]);
-    vkprintf(1, "    WARNING: %lld\n", logger_stats.log_level_distribution[LOG_LEVEL_WARNING]);
-    vkprintf(1, "    ERROR: %lld\n", logger_stats.log_level_distribution[LOG_LEVEL_ERROR]);
-    vkprintf(1, "    CRITICAL: %lld\n", logger_stats.log_level_distribution[LOG_LEVEL_CRITICAL]);
-    vkprintf(1, "  Buffer Overflows: %lld\n", logger_stats.buffer_overflows);
-    vkprintf(1, "  Failed Writes: %lld\n", logger_stats.failed_writes);
-    vkprintf(1, "  Async Operations: %lld\n", logger_stats.async_log_operations);
-    vkprintf(1, "  Sync Operations: %lld\n", logger_stats.sync_log_operations);
+    vkprintf(1, "    DEBUG: %lld\n", st.log_level_distribution[LOG_LEVEL_DEBUG]);
+    vkprintf(1, "    INFO: %lld\n", st.log_level_distribution[LOG_LEVEL_INFO]);
+    vkprintf(1, "    WARNING: %lld\n", st.log_level_distribution[LOG_LEVEL_WARNING]);
+    vkprintf(1, "    ERROR: %lld\n", st.log_level_distribution[LOG_LEVEL_ERROR]);
+    vkprintf(1, "    CRITICAL: %lld\n", st.log_level_distribution[LOG_LEVEL_CRITICAL]);
+    vkprintf(1, "  Buffer Overflows: %lld\n", st.buffer_overflows);
+    vkprintf(1, "  Dropped Entries: %lld\n", st.dropped_entries);
+    vkprintf(1, "  Failed Writes: %lld\n", st.failed_writes);
+    vkprintf(1, "  Async Operations: %lld\n", st.async_log_operations);
+    vkprintf(1, "  Batched Writes: %lld\n", st.batched_writes);
+    vkprintf(1, "  Active Rings: %d\n", st.active_rings);
+    vkprintf(1, "  Sync Operations: %lld\n", st.sync_log_operations);
     
     pthread_mutex_lock(&logger_mutex);
     vkprintf(1, "  Async Logger: %s\n", async_logger_running ? "Running" : "Stopped");
@@ -489,12 +779,12 @@ void structured_logger_print_stats(void) {
 
 // Очистка logger
 void structured_logger_cleanup(void) {
+    int i;
     pthread_mutex_lock(&logger_mutex);
     
-    // Остановка async logger
+    // Остановка async logger (drain thread делает финальный проход)
     if (async_logger_running) {
         async_logger_running = 0;
-        pthread_cond_signal(&async_log_buffer.buffer_not_empty);
         pthread_join(async_logger_thread, NULL);
     }
     
@@ -508,21 +798,27 @@ void structured_logger_cleanup(void) {
         error_log_file_handle = NULL;
     }
     
-    // Очистка buffer
-    if (async_log_buffer.entries) {
-        free(async_log_buffer.entries);
-        async_log_buffer.entries = NULL;
+    // Rings не освобождаются: потоки-владельцы могут писать в них прямо сейчас,
+    // записи после финального прохода дочитает drain thread следующего init.
+    // Освобождаются только ring'и потоков, которые уже вышли
+    pthread_mutex_lock(&log_rings_mutex);
+    for (i = 0; i < log_rings_num; i++) {
+        struct log_ring *R = log_rings[i];
+        if (R && R->owner_exited) {
+            log_rings[i] = NULL;
+            retired_rings_dropped += R->dropped;
+            retired_rings_enqueued += R->enqueued;
+            free(R);
+        }
     }
+    pthread_mutex_unlock(&log_rings_mutex);
+    free(drain_batch);
+    drain_batch = NULL;
     
     pthread_mutex_unlock(&logger_mutex);
     
-    pthread_mutex_destroy(&async_log_buffer.buffer_mutex);
-    pthread_cond_destroy(&async_log_buffer.buffer_not_full);
-    pthread_cond_destroy(&async_log_buffer.buffer_not_empty);
-    pthread_mutex_destroy(&logger_mutex);
-    
     memset(&logger_stats, 0, sizeof(logger_stats));
     memset(&global_logger_config, 0, sizeof(global_logger_config));
     
     vkprintf(1, "Structured logger cleaned up\n");
-}
\ No newline at end of file
+}
@@ -63,6 +63,9 @@ struct logger_stats {
     long long failed_writes;
     long long async_log_operations;
     long long sync_log_operations;
+    long long dropped_entries;      // записи, отброшенные при переполнении per-thread ring
+    long long batched_writes;       // количество writev() из drain thread
+    int active_rings;               // зарегистрированные per-thread rings
 };
 
 // Logger configuration
@@ -72,8 +75,9 @@ struct logger_config {
     int enable_async_logging;
     int enable_context_logging;
     int max_message_size;
-    int buffer_size;
+    int buffer_size;                // ёмкость per-thread ring (округляется до степени 2)
     int flush_interval_seconds;
+    int flush_interval_ms;          // период drain thread; 0 - использовать flush_interval_seconds
     char log_file_path[512];
     char error_log_file_path[512];
     int enable_file_logging;
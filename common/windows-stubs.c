@@ -620,6 +620,19 @@ void create_all_outbound_connections(void) {}
 int tcp_rpc_add_proxy_domain(const char *domain, int port) { (void)domain; (void)port; return 0; }
 int tcp_rpcs_set_ext_secret(void *secret) { (void)secret; return 0; }
 void tcp_set_max_accept_rate(int rate) { (void)rate; }
+void tcp_set_ip_acl_file(const char *filename, unsigned flags) { (void)filename; (void)flags; }
+void tcp_set_ip_acl_whitelist_only(int enable) { (void)enable; }
+int tcp_load_ip_acl(void) { return 0; }
+int tcp_reload_ip_acl(void) { return 0; }
+unsigned plugin_active_hooks;
+void plugins_add_file(const char *path) { (void)path; }
+void plugins_set_dir(const char *dir) { (void)dir; }
+int plugins_load(void) { return 0; }
+void plugin_hook_config_reload(void) {}
+int plugin_hook_accept(int fd, unsigned ip, const unsigned char ipv6[16], int port) { (void)fd; (void)ip; (void)ipv6; (void)port; return 0; }
+int plugin_hook_connection(int type, void *C) { (void)type; (void)C; return 0; }
+int plugin_hook_data_received(void *C, int bytes) { (void)C; (void)bytes; return 0; }
+int plugin_hook_handshake(void *C, const unsigned char header[64], int secret_index, int target_dc) { (void)C; (void)header; (void)secret_index; (void)target_dc; return 0; }
 void net_add_nat_info(unsigned int ip, unsigned int mask) { (void)ip; (void)mask; }
 void tcp_set_max_connections(int max) { (void)max; }
 
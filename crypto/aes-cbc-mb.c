@@ -0,0 +1,182 @@
+/*
+    This file is part of Mtproto-proxy Library.
+
+    Mtproto-proxy Library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Mtproto-proxy Library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Mtproto-proxy Library.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2024-2026 MTProto Proxy Enhanced Project
+              2024-2026 Dupley Maxim Igorevich (Maestro7IT)
+*/
+
+#include "crypto/aes-cbc-mb.h"
+
+#include <assert.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <wmmintrin.h>
+
+#include "common/cpuid.h"
+
+#define AES_MB_TARGET __attribute__ ((target ("aes,sse2")))
+
+int aes_cbc_mb_available (void) {
+  return (kdb_cpuid ()->ecx >> 25) & 1;
+}
+
+/* {{{ расширение ключа AES-256 (Intel AES-NI White Paper, 5.3) */
+static inline AES_MB_TARGET __m128i key_256_assist_1 (__m128i t1, __m128i t2) {
+  t2 = _mm_shuffle_epi32 (t2, 0xff);
+  __m128i t4 = _mm_slli_si128 (t1, 4);
+  t1 = _mm_xor_si128 (t1, t4);
+  t4 = _mm_slli_si128 (t4, 4);
+  t1 = _mm_xor_si128 (t1, t4);
+  t4 = _mm_slli_si128 (t4, 4);
+  t1 = _mm_xor_si128 (t1, t4);
+  return _mm_xor_si128 (t1, t2);
+}
+
+static inline AES_MB_TARGET __m128i key_256_assist_2 (__m128i t1, __m128i t3) {
+  __m128i t2 = _mm_shuffle_epi32 (_mm_aeskeygenassist_si128 (t1, 0), 0xaa);
+  __m128i t4 = _mm_slli_si128 (t3, 4);
+  t3 = _mm_xor_si128 (t3, t4);
+  t4 = _mm_slli_si128 (t4, 4);
+  t3 = _mm_xor_si128 (t3, t4);
+  t4 = _mm_slli_si128 (t4, 4);
+  t3 = _mm_xor_si128 (t3, t4);
+  return _mm_xor_si128 (t3, t2);
+}
+
+AES_MB_TARGET void aes_cbc_mb_set_encrypt_key (struct aes_cbc_mb_key *K, const unsigned char key[32]) {
+  __m128i *rk = (__m128i *) K->rk;
+  __m128i t1 = _mm_loadu_si128 ((const __m128i *) key);
+  __m128i t3 = _mm_loadu_si128 ((const __m128i *) (key + 16));
+  rk[0] = t1;
+  rk[1] = t3;
+#define KEY_256_STEP(i, rcon) \
+  t1 = key_256_assist_1 (t1, _mm_aeskeygenassist_si128 (t3, rcon)); \
+  rk[i] = t1; \
+  t3 = key_256_assist_2 (t1, t3); \
+  rk[i + 1] = t3;
+  KEY_256_STEP (2, 0x01);
+  KEY_256_STEP (4, 0x02);
+  KEY_256_STEP (6, 0x04);
+  KEY_256_STEP (8, 0x08);
+  KEY_256_STEP (10, 0x10);
+  KEY_256_STEP (12, 0x20);
+#undef KEY_256_STEP
+  rk[14] = key_256_assist_1 (t1, _mm_aeskeygenassist_si128 (t3, 0x40));
+}
+/* }}} */
+
+/*
+  Шифрует ровно m блоков в каждом из K потоков. K - константа после
+  встраивания; циклы по потокам развёрнуты принудительно (иначе при -O2
+  состояния уходят в память), так что K независимых цепочек aesenc живут
+  в регистрах и заполняют конвейер.
+*/
+static inline __attribute__ ((always_inline)) AES_MB_TARGET void cbc_encrypt_lanes (struct aes_cbc_mb_lane **A, const int K, int m) {
+  __m128i s[AES_CBC_MB_MAX_LANES];
+  const __m128i *rk[AES_CBC_MB_MAX_LANES];
+  const unsigned char *in[AES_CBC_MB_MAX_LANES];
+  unsigned char *out[AES_CBC_MB_MAX_LANES];
+  int j, r;
+
+  for (j = 0; j < K; j++) {
+    s[j] = _mm_loadu_si128 ((const __m128i *) A[j]->iv);
+    rk[j] = (const __m128i *) A[j]->key->rk;
+    in[j] = A[j]->in;
+    out[j] = A[j]->out;
+  }
+
+  long off, end = (long) m * 16;
+  for (off = 0; off < end; off += 16) {
+#pragma GCC unroll 8
+    for (j = 0; j < K; j++) {
+      __m128i x = _mm_loadu_si128 ((const __m128i *) (in[j] + off));
+      s[j] = _mm_xor_si128 (_mm_xor_si128 (x, s[j]), rk[j][0]);
+    }
+    for (r = 1; r < 14; r++) {
+#pragma GCC unroll 8
+      for (j = 0; j < K; j++) {
+        s[j] = _mm_aesenc_si128 (s[j], rk[j][r]);
+      }
+    }
+#pragma GCC unroll 8
+    for (j = 0; j < K; j++) {
+      s[j] = _mm_aesenclast_si128 (s[j], rk[j][14]);
+      _mm_storeu_si128 ((__m128i *) (out[j] + off), s[j]);
+    }
+  }
+
+  for (j = 0; j < K; j++) {
+    _mm_storeu_si128 ((__m128i *) A[j]->iv, s[j]);
+    A[j]->in += end;
+    A[j]->out += end;
+    A[j]->blocks -= m;
+  }
+}
+
+AES_MB_TARGET void aes_cbc_mb_encrypt (struct aes_cbc_mb_lane *L, int n) {
+  assert (n <= AES_CBC_MB_MAX_LANES);
+  struct aes_cbc_mb_lane *A[AES_CBC_MB_MAX_LANES];
+  int i, k = 0;
+  for (i = 0; i < n; i++) {
+    if (L[i].blocks > 0) {
+      A[k++] = &L[i];
+    }
+  }
+
+  /* потоки разной длины: общий минимум вперемешку, затем короткие выбывают */
+  while (k > 0) {
+    int m = A[0]->blocks;
+    for (i = 1; i < k; i++) {
+      if (A[i]->blocks < m) {
+        m = A[i]->blocks;
+      }
+    }
+    switch (k) {
+    case 1: cbc_encrypt_lanes (A, 1, m); break;
+    case 2: cbc_encrypt_lanes (A, 2, m); break;
+    case 3: cbc_encrypt_lanes (A, 3, m); break;
+    case 4: cbc_encrypt_lanes (A, 4, m); break;
+    case 5: cbc_encrypt_lanes (A, 5, m); break;
+    case 6: cbc_encrypt_lanes (A, 6, m); break;
+    case 7: cbc_encrypt_lanes (A, 7, m); break;
+    default: cbc_encrypt_lanes (A, 8, m); break;
+    }
+    int kk = 0;
+    for (i = 0; i < k; i++) {
+      if (A[i]->blocks > 0) {
+        A[kk++] = A[i];
+      }
+    }
+    k = kk;
+  }
+}
+
+#else
+
+int aes_cbc_mb_available (void) {
+  return 0;
+}
+
+void aes_cbc_mb_set_encrypt_key (struct aes_cbc_mb_key *K, const unsigned char key[32]) {
+  assert (0 && "AES-NI is not available");
+}
+
+void aes_cbc_mb_encrypt (struct aes_cbc_mb_lane *L, int n) {
+  assert (0 && "AES-NI is not available");
+}
+
+#endif
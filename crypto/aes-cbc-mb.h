@@ -0,0 +1,53 @@
+/*
+    This file is part of Mtproto-proxy Library.
+
+    Mtproto-proxy Library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Mtproto-proxy Library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Mtproto-proxy Library.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2024-2026 MTProto Proxy Enhanced Project
+              2024-2026 Dupley Maxim Igorevich (Maestro7IT)
+*/
+
+#pragma once
+
+/*
+  Многопоточное (multi-buffer) шифрование AES-256-CBC.
+
+  CBC-шифрование последовательно внутри потока: каждый блок ждёт результата
+  предыдущего, и конвейер AES-NI простаивает. Независимые потоки (разные
+  соединения со своими ключами и IV) шифруются здесь вперемешку - раунды
+  до AES_CBC_MB_MAX_LANES потоков чередуются, результат каждого потока
+  побайтно совпадает с однопоточным EVP_aes_256_cbc().
+*/
+
+#define AES_CBC_MB_MAX_LANES 8
+
+struct aes_cbc_mb_key {
+  unsigned char rk[15][16];
+} __attribute__ ((aligned (16)));
+
+struct aes_cbc_mb_lane {
+  const struct aes_cbc_mb_key *key;
+  unsigned char *iv;            /* вход и выход: цепочечное значение потока */
+  const unsigned char *in;
+  unsigned char *out;           /* может совпадать с in */
+  int blocks;                   /* число 16-байтных блоков */
+};
+
+/* 1, если процессор поддерживает AES-NI */
+int aes_cbc_mb_available (void);
+
+void aes_cbc_mb_set_encrypt_key (struct aes_cbc_mb_key *K, const unsigned char key[32]);
+
+/* шифрует n <= AES_CBC_MB_MAX_LANES потоков; in, out и iv продвигаются */
+void aes_cbc_mb_encrypt (struct aes_cbc_mb_lane *L, int n);
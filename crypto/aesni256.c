@@ -24,6 +24,7 @@
 #include "crypto/aesni256.h"
 
 #include <assert.h>
+#include <string.h>
 
 EVP_CIPHER_CTX *evp_cipher_ctx_init (const EVP_CIPHER *cipher, unsigned char *key, unsigned char iv[16], int is_encrypt) {
   EVP_CIPHER_CTX *evp_ctx = EVP_CIPHER_CTX_new();
@@ -37,3 +38,15 @@ EVP_CIPHER_CTX *evp_cipher_ctx_init (const EVP_CIPHER *cipher, unsigned char *ke
 void evp_crypt (EVP_CIPHER_CTX *evp_ctx, const void *in, void *out, int size) {
   assert (EVP_CipherUpdate(evp_ctx, out, &size, in, size) == 1);
 }
+
+void evp_cipher_ctx_get_iv (EVP_CIPHER_CTX *evp_ctx, unsigned char iv[16]) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+  assert (EVP_CIPHER_CTX_get_updated_iv (evp_ctx, iv, 16) == 1);
+#else
+  memcpy (iv, EVP_CIPHER_CTX_iv (evp_ctx), 16);
+#endif
+}
+
+void evp_cipher_ctx_set_iv (EVP_CIPHER_CTX *evp_ctx, const unsigned char iv[16]) {
+  assert (EVP_CipherInit_ex (evp_ctx, NULL, NULL, NULL, iv, -1) == 1);
+}
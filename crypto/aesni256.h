@@ -28,3 +28,7 @@
 EVP_CIPHER_CTX *evp_cipher_ctx_init (const EVP_CIPHER *cipher, unsigned char *key, unsigned char iv[16], int is_encrypt);
 
 void evp_crypt (EVP_CIPHER_CTX *evp_ctx, const void *in, void *out, int size);
+
+/* current chaining value of a CBC context, and its replacement (key schedule kept) */
+void evp_cipher_ctx_get_iv (EVP_CIPHER_CTX *evp_ctx, unsigned char iv[16]);
+void evp_cipher_ctx_set_iv (EVP_CIPHER_CTX *evp_ctx, const unsigned char iv[16]);
@@ -43,6 +43,8 @@
 #include "engine/engine-net.h"
 
 #include "net/net-tcp-rpc-client.h"
+#include "net/net-ip-acl.h"
+#include "net/net-plugins.h"
 
 void default_close_network_sockets (void) /* {{{ */ {
   engine_t *E = engine_state;
@@ -102,6 +104,11 @@ void engine_do_open_port (void) /* {{{ */ {
   int start_port = engine_state->start_port;
   int end_port = engine_state->end_port;
 
+  if (engine_state->sfd > 0) {
+    // inherited from the previous binary on hot upgrade
+    return;
+  }
+
   if (port > 0 && port < PRIVILEGED_TCP_PORTS) {
     assert (try_open_port (port, 1) >= 0);
     return;
@@ -206,6 +213,24 @@ static int f_parse_option_net (int val) {
         exit (2);
       }
       break;
+    case 374:
+      tcp_set_ip_acl_file (optarg, IP_ACL_BLACKLIST);
+      break;
+    case 375:
+      tcp_set_ip_acl_file (optarg, IP_ACL_WHITELIST);
+      break;
+    case 376:
+      tcp_set_ip_acl_whitelist_only (1);
+      break;
+    case 377:
+      plugins_add_file (optarg);
+      break;
+    case 378:
+      plugins_set_dir (optarg);
+      break;
+    case 379:
+      tcp_set_zerocopy_threshold (atoi (optarg));
+      break;
     case 373:
       {
         engine_t *E = engine_state;
@@ -248,4 +273,10 @@ void engine_add_net_parse_options (void) {
   parse_option_net_builtin ("max-dh-accept-rate", required_argument, 0, 250, LONGOPT_TCP_SET, "max number of DH connections per second that is allowed to accept");
   parse_option_net_builtin ("nat-info", required_argument, 0, 372, LONGOPT_NET_SET, "<local-addr>:<global-addr>\tsets network address translation for RPC protocol handshake");
   parse_option_net_builtin ("address", required_argument, 0, 373, LONGOPT_NET_SET, "tries to bind socket only to specified address");
+  parse_option_net_builtin ("ip-blacklist", required_argument, 0, 374, LONGOPT_TCP_SET, "<file>\trejects inbound connections from listed CIDR prefixes (one per line, reloaded on SIGHUP)");
+  parse_option_net_builtin ("ip-whitelist", required_argument, 0, 375, LONGOPT_TCP_SET, "<file>\tCIDR prefixes that bypass --ip-blacklist (reloaded on SIGHUP)");
+  parse_option_net_builtin ("ip-whitelist-only", no_argument, 0, 376, LONGOPT_TCP_SET, "accept inbound connections only from --ip-whitelist prefixes");
+  parse_option_net_builtin ("plugin", required_argument, 0, 377, LONGOPT_TCP_SET, "<file.so>\tloads plugin (may be repeated); its config is read from <file>.conf");
+  parse_option_net_builtin ("plugin-dir", required_argument, 0, 378, LONGOPT_TCP_SET, "<dir>\tloads all *.so plugins from directory");
+  parse_option_net_builtin ("zerocopy-threshold", required_argument, 0, 379, LONGOPT_TCP_SET, "<bytes>\tsends socket writes of at least this size with MSG_ZEROCOPY (default 0, off)");
 }
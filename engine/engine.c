@@ -64,6 +64,7 @@
 #include "net/net-connections.h"
 #include "net/net-crypto-aes.h"
 #include "net/net-msg-buffers.h"
+#include "net/net-plugins.h"
 #include "net/net-thread.h"
 
 #include "vv/vv-io.h"
@@ -92,6 +93,8 @@ static int default_parse_option (int val) {
 
 /* {{{ SIGNAL ACTIONS */
 static void default_sighup (void) {
+  tcp_reload_ip_acl ();
+  plugin_hook_config_reload ();
 }
 
 static void default_sigusr1 (void) {
@@ -216,6 +219,16 @@ void engine_init (const char *const pwd_filename, int do_not_open_port) {
     exit (1);
   }
 
+  if (tcp_load_ip_acl () < 0) {
+    kprintf ("fatal: cannot load ip acl files\n");
+    exit (1);
+  }
+
+  if (plugins_load () < 0) {
+    kprintf ("fatal: cannot load plugins\n");
+    exit (1);
+  }
+
   if (change_user_group (username, groupname) < 0) {
     kprintf ("fatal: cannot change user to %s\n", username ? username : "(none)");
     exit (1);
@@ -696,6 +709,12 @@ static int f_parse_option_engine (int val) {
     case 302:
       engine_set_required_tcp_io_threads (atoi (optarg));
       break;
+    case 303:
+      if (jobs_set_cpu_affinity_policy (optarg) < 0) {
+        kprintf ("unknown cpu affinity policy '%s'\n", optarg);
+        return -1;
+      }
+      break;
     default:
       return -1;
   }
@@ -722,6 +741,7 @@ void engine_add_engine_parse_options (void) {
   parse_option_engine_builtin ("single-thread", no_argument, 0, 259, LONGOPT_JOBS_SET, "disable multithread mode (run in single-thread mode)");
   parse_option_engine_builtin ("tcp-cpu-threads", required_argument, 0, 301, LONGOPT_JOBS_SET, "number of tcp-cpu threads");
   parse_option_engine_builtin ("tcp-iothreads", required_argument, 0, 302, LONGOPT_JOBS_SET, "number of tcp-io threads");
+  parse_option_engine_builtin ("cpu-affinity", required_argument, 0, 303, LONGOPT_JOBS_SET, "pin job threads to cores: none, auto (default), spread or compact");
 }
 
 void default_parse_extra_args (int argc, char *argv[]) /* {{{ */ {
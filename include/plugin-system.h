@@ -8,6 +8,9 @@
  * - Контекст плагина с данными и состоянием
  * - Приоритеты выполнения хуков
  * - Безопасная выгрузка плагинов
+ *
+ * Хост (net/net-plugins.c) вызывает хук, только если на него подписан хотя бы
+ * один плагин; контекст хука не копирует адреса и данные, а ссылается на них.
  */
 
 #ifndef PLUGIN_SYSTEM_H
@@ -16,6 +19,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <arpa/inet.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,8 +33,8 @@ extern "C" {
  * Версия API плагинов
  * ============================================================================ */
 
-#define MTPLUGIN_API_VERSION_MAJOR 1
-#define MTPLUGIN_API_VERSION_MINOR 0
+#define MTPLUGIN_API_VERSION_MAJOR 2
+#define MTPLUGIN_API_VERSION_MINOR 1
 #define MTPLUGIN_API_VERSION_PATCH 0
 #define MTPLUGIN_API_VERSION ((MTPLUGIN_API_VERSION_MAJOR << 16) | \
                              (MTPLUGIN_API_VERSION_MINOR << 8) | \
@@ -101,23 +109,43 @@ typedef enum {
  * Структуры данных
  * ============================================================================ */
 
-/* Контекст хука */
+struct raw_message;
+
+/* Контекст хука: собирается на стеке хоста, указатели действительны только во время вызова */
 typedef struct {
     plugin_hook_type_t hook_type;   // Тип хука
-    void *data;                     // Данные хука
-    size_t data_size;               // Размер данных
-    void *user_data;                // Пользовательские данные
-    void *plugin_data;              // Данные плагина
-    int connection_fd;              // FD подключения (если есть)
-    char client_ip[64];             // IP клиента
+    int connection_fd;              // FD подключения (-1, если нет)
+    uint32_t client_ipv4;           // IPv4 клиента в порядке байт хоста, 0 для IPv6
     uint16_t client_port;           // Порт клиента
-    uint64_t timestamp;             // Временная метка
-    uint64_t sequence;              // Порядковый номер
-    int priority;                   // Приоритет
-    char result_data[1024];         // Результаты обработки
+    const unsigned char *client_ipv6; // 16 байт IPv6 клиента (NULL для IPv4)
+    const void *data;               // Начало данных: указатель в raw_message, без копии
+    size_t data_size;               // Длина непрерывного фрагмента data
+    struct raw_message *raw;        // Всё сообщение (только чтение), если есть
+    int secret_index;               // HOOK_MTPROTO_HANDSHAKE: индекс секрета, -1 без секрета
+    int target_dc;                  // HOOK_MTPROTO_HANDSHAKE: запрошенный DC
+    void *user_data;                // Данные вызывающей стороны
+    const char *result_msg;         // Причина решения (статическая строка плагина)
     int result_code;                // Код результата
+    size_t raw_size;                // Длина raw (HOOK_DATA_RECEIVED: только новые байты), API 2.1
 } plugin_hook_context_t;
 
+/**
+ * @brief Текстовый адрес клиента (для логов плагина)
+ * @return Длина строки или -1
+ */
+static inline int plugin_format_client_ip(const plugin_hook_context_t *ctx, char *buf, size_t size) {
+    if (ctx->client_ipv4 || !ctx->client_ipv6) {
+        uint32_t ip = ctx->client_ipv4;
+        return snprintf(buf, size, "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 255, (ip >> 8) & 255, ip & 255);
+    }
+#ifndef _WIN32
+    if (inet_ntop(AF_INET6, ctx->client_ipv6, buf, size)) {
+        return (int)strlen(buf);
+    }
+#endif
+    return -1;
+}
+
 /* Информация о плагине */
 typedef struct {
     uint32_t api_version;           // Версия API
@@ -148,10 +176,14 @@ typedef struct {
     uint64_t unload_count;          // Количество выгрузок
     uint64_t hook_calls[HOOK_COUNT]; // Вызовы хуков
     uint64_t hook_errors[HOOK_COUNT]; // Ошибки хуков
-    uint64_t total_execution_time_us; // Общее время выполнения (мкс)
-    uint64_t avg_execution_time_us;   // Среднее время (мкс)
-    uint64_t max_execution_time_us;   // Макс время (мкс)
+    uint64_t hook_time_ns[HOOK_COUNT]; // Время в хуках по типам (нс)
+    uint64_t total_execution_time_ns; // Общее время выполнения (нс)
+    uint64_t avg_execution_time_ns;   // Среднее время вызова (нс)
+    uint64_t max_execution_time_ns;   // Макс время вызова (нс)
     uint64_t memory_used;           // Используемая память
+    uint64_t total_requests;        // Заполняет плагин: обработано запросов
+    uint64_t total_blocked;         // Заполняет плагин: отклонено
+    void *plugin_data;              // Вход plugin_get_stats: данные плагина
     int last_error_code;            // Последняя ошибка
     char last_error_msg[256];       // Сообщение об ошибке
 } plugin_stats_t;
@@ -172,6 +204,13 @@ typedef struct plugin_handle plugin_handle_t;
 typedef plugin_result_t (*plugin_hook_callback_t)(plugin_hook_context_t *ctx, 
                                                   void *plugin_data);
 
+/* Подписка плагина на хук */
+typedef struct {
+    plugin_hook_type_t hook_type;
+    plugin_hook_callback_t callback;
+    int priority;                   // Чем выше, тем раньше выполняется
+} plugin_hook_desc_t;
+
 /* ============================================================================
  * Экспортируемые функции плагина
  * ============================================================================ */
@@ -249,6 +288,18 @@ typedef int (*plugin_unregister_hook_func)(plugin_hook_type_t hook_type,
  */
 typedef void (*plugin_get_stats_func)(plugin_stats_t *stats);
 
+/**
+ * @brief Таблица хуков плагина (см. PLUGIN_DECLARE_HOOKS)
+ * @param count Количество элементов таблицы
+ * @return Указатель на статическую таблицу подписок
+ * 
+ * Экспортируемое имя: plugin_get_hooks
+ * Сигнатура: const plugin_hook_desc_t* plugin_get_hooks(int* count);
+ * Хост читает таблицу после plugin_init и раскладывает callback'и по
+ * массивам хуков, передавая каждому plugin_data, полученные из plugin_init.
+ */
+typedef const plugin_hook_desc_t* (*plugin_get_hooks_func)(int *count);
+
 /* ============================================================================
  * Менеджер плагинов (хост)
  * ============================================================================ */
@@ -282,6 +333,7 @@ typedef struct {
 struct plugin_handle {
     char name[MTPLUGIN_NAME_MAX_LEN];
     char path[MTPLUGIN_PATH_MAX_LEN];
+    char config_path[MTPLUGIN_PATH_MAX_LEN]; // <путь без .so>.conf
     void *dl_handle;
     plugin_info_t info;
     plugin_config_t config;
@@ -297,6 +349,11 @@ struct plugin_handle {
     plugin_register_hook_func register_hook;
     plugin_unregister_hook_func unregister_hook;
     plugin_get_stats_func get_stats;
+    plugin_get_hooks_func get_hooks;
+    
+    // Время в тактах счётчика, пересчитывается в stats при чтении статистики
+    uint64_t hook_ticks[HOOK_COUNT];
+    uint64_t max_ticks;
 };
 
 typedef struct {
@@ -316,6 +373,10 @@ typedef struct {
     
     int hook_count[HOOK_COUNT];
     
+    // Пересчёт тактов в наносекунды
+    uint64_t start_ticks;
+    double start_time_ns;
+    
     bool initialized;
     bool running;
 } plugin_manager_t;
@@ -430,14 +491,14 @@ const char *plugin_get_api_version_string(void);
  * Макросы для объявления плагина
  * ============================================================================ */
 
-#define PLUGIN_DECLARE_INFO(name, desc, version, author, license) \
+#define PLUGIN_DECLARE_INFO(_name, _desc, _version, _author, _license) \
     static plugin_info_t g_plugin_info = { \
         .api_version = MTPLUGIN_API_VERSION, \
-        .name = name, \
-        .description = desc, \
-        .version = version, \
-        .author = author, \
-        .license = license, \
+        .name = _name, \
+        .description = _desc, \
+        .version = _version, \
+        .author = _author, \
+        .license = _license, \
         .dependencies = NULL, \
         .dependency_count = 0, \
         .supported_hooks = NULL, \
@@ -448,8 +509,14 @@ const char *plugin_get_api_version_string(void);
         return &g_plugin_info; \
     }
 
-#define PLUGIN_REGISTER_HOOK(manager, hook_type, callback, priority, data) \
-    plugin_manager_execute_hook(manager, hook_type, callback, priority, data)
+/* PLUGIN_DECLARE_HOOKS({HOOK_CONNECTION_ACCEPT, on_accept, 100}, ...) */
+#define PLUGIN_DECLARE_HOOKS(...) \
+    static const plugin_hook_desc_t g_plugin_hooks[] = { __VA_ARGS__ }; \
+    \
+    const plugin_hook_desc_t* plugin_get_hooks(int *count) { \
+        *count = (int)(sizeof(g_plugin_hooks) / sizeof(g_plugin_hooks[0])); \
+        return g_plugin_hooks; \
+    }
 
 #ifdef __cplusplus
 }
@@ -40,6 +40,7 @@
 #else
 #include <unistd.h>
 #ifdef __linux__
+#include <sched.h>
 #include <sys/syscall.h>
 #include <linux/futex.h>
 #endif
@@ -56,6 +57,7 @@
 #include "net/net-connections.h"
 #include "jobs/jobs.h"
 #include "common/common-stats.h"
+#include "common/cpu-topology.h"
 
 //#include "auto/engine/engine.h"
 
@@ -71,6 +73,10 @@ struct job_thread_stat {
 };
 struct job_thread_stat JobThreadsStats[MAX_JOB_THREADS] __attribute__((aligned(128)));
 
+static int jobs_cpu_policy = CPU_AFFINITY_AUTO;
+static int jobs_cpu_part, jobs_cpu_parts;
+static struct cpu_layout JobsLayout;
+
 #define MODULE jobs
 
 MODULE_STAT_TYPE {
@@ -332,6 +338,19 @@ MODULE_STAT_FUNCTION
   SB_SUM_ONE_LL (jobs_allocated_memory);
   SB_SUM_ONE_LL (timer_ops);
   SB_SUM_ONE_LL (timer_ops_scheduler);
+
+  static const char *role_names[CPU_ROLE_MAX] = { "epoll", "engine", "connection", "other" };
+  char cpus[256];
+  sb_printf (sb,
+    "cpu_affinity_policy\t%s\n"
+    "cpu_affinity_partition\t%d/%d cores %d+%d\n",
+    cpu_affinity_policy_name (JobsLayout.policy),
+    JobsLayout.part, JobsLayout.parts, JobsLayout.first_core, JobsLayout.cores
+  );
+  for (i = 0; i < CPU_ROLE_MAX; i++) {
+    cpu_layout_format (&JobsLayout, i, cpus, sizeof (cpus));
+    sb_printf (sb, "cpu_affinity_%s\t%s\n", role_names[i], cpus);
+  }
 MODULE_STAT_FUNCTION_END
 
 long long jobs_get_allocated_memoty (void) {
@@ -437,6 +456,79 @@ void check_main_thread (void) {
 
 static void set_job_interrupt_signal_handler (void);
 
+/* {{{ thread placement */
+
+int jobs_set_cpu_affinity_policy (const char *name) {
+  int policy = cpu_affinity_parse_policy (name);
+  if (policy < 0) {
+    return -1;
+  }
+  jobs_cpu_policy = policy;
+  return 0;
+}
+
+void jobs_set_cpu_partition (int part, int parts) {
+  jobs_cpu_part = part;
+  jobs_cpu_parts = parts;
+}
+
+static int job_class_cpu_role (int thread_class) {
+  switch (thread_class) {
+  case JC_EPOLL:
+    return CPU_ROLE_EPOLL;
+  case JC_ENGINE:
+    return CPU_ROLE_ENGINE;
+  case JC_CONNECTION:
+    return CPU_ROLE_CONNECTION;
+  default:
+    return CPU_ROLE_OTHER;
+  }
+}
+
+static void plan_job_threads_layout (void) {
+#ifdef __linux__
+  static struct cpu_topology T;
+  unsigned long long allowed[CPU_TOPOLOGY_MAX_CPUS / 64];
+  cpu_set_t cur;
+  int i;
+
+  // stay inside the cpuset we were started with (taskset, cgroups)
+  memset (allowed, 0, sizeof (allowed));
+  if (sched_getaffinity (0, sizeof (cur), &cur) < 0) {
+    CPU_ZERO (&cur);
+  }
+  for (i = 0; i < CPU_SETSIZE && i < CPU_TOPOLOGY_MAX_CPUS; i++) {
+    if (CPU_ISSET (i, &cur)) {
+      allowed[i >> 6] |= 1ULL << (i & 63);
+    }
+  }
+  if (cpu_topology_load (&T, "/sys", allowed) > 0) {
+    cpu_layout_plan (&JobsLayout, &T, jobs_cpu_policy, jobs_cpu_part, jobs_cpu_parts);
+    vkprintf (1, "cpu affinity: policy %s, %d cpus in %d cores on %d nodes, using cores %d+%d\n", cpu_affinity_policy_name (JobsLayout.policy), T.cpus, T.cores, T.nodes, JobsLayout.first_core, JobsLayout.cores);
+  }
+#endif
+}
+
+// returns 1 if *set should be applied to the k-th thread of this class
+static int job_thread_cpu_set (int thread_class, int k, void *set) {
+#ifdef __linux__
+  const short *cpus;
+  int n = cpu_layout_thread_cpus (&JobsLayout, job_class_cpu_role (thread_class), k, &cpus), i;
+  if (n <= 0) {
+    return 0;
+  }
+  CPU_ZERO ((cpu_set_t *) set);
+  for (i = 0; i < n; i++) {
+    CPU_SET (cpus[i], (cpu_set_t *) set);
+  }
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/* }}} */
+
 void *job_thread (void *arg);
 void *job_thread_sub (void *arg);
 
@@ -492,10 +584,25 @@ int create_job_thread_ex (int thread_class, void *(*thread_work)(void *)) {
 #endif
 
 
+#ifdef __linux__
+  cpu_set_t cpus;
+#else
+  long long cpus;
+#endif
+  if (thread_class == JC_MAIN) {
+    plan_job_threads_layout ();
+  }
+  int pin = job_thread_cpu_set (thread_class, JC->cur_threads, &cpus);
+
   if (thread_class != JC_MAIN) {
     pthread_attr_t attr;
     pthread_attr_init (&attr);
     pthread_attr_setstacksize (&attr, JOB_THREAD_STACK_SIZE);
+#ifdef __linux__
+    if (pin) {
+      pthread_attr_setaffinity_np (&attr, sizeof (cpus), &cpus);
+    }
+#endif
   
     int r = pthread_create (&JT->pthread_id, &attr, thread_work, (void *) JT);
 
@@ -510,6 +617,11 @@ int create_job_thread_ex (int thread_class, void *(*thread_work)(void *)) {
     assert (!main_job_thread);
     get_this_thread_id ();
     JT->pthread_id = main_pthread_id;
+#ifdef __linux__
+    if (pin) {
+      pthread_setaffinity_np (main_pthread_id, sizeof (cpus), &cpus);
+    }
+#endif
     this_job_thread = main_job_thread = JT;
     set_job_interrupt_signal_handler ();
     assert (JT->id == 1);
@@ -933,8 +1045,20 @@ void *job_thread_ex (void *arg, void (*work_one)(void *, int)) {
 
   int prev_now = 0;
   long long last_rdtsc = 0;
+  int jobs_since_idle = 0;
   while (1) {
     void *job = mpq_pop_nw (Q, 4);
+    if (!job || ++jobs_since_idle >= JOB_THREAD_IDLE_PERIOD) {
+      jobs_since_idle = 0;
+      for (cb = jobs_cb_list; cb; cb = cb->next) {
+        if (cb->idle) {
+          cb->idle ();
+        }
+      }
+      if (!job) {
+        job = mpq_pop_nw (Q, 4);
+      }
+    }
     if (!job) {
       double wait_start = get_utime_monotonic ();
       MODULE_STAT->locked_since = wait_start;
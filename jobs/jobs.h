@@ -277,6 +277,10 @@ int create_job_thread_ex (int thread_class, void *(*thread_work)(void *));
 int create_new_job_class (int job_class, int min_threads, int max_threads);
 int create_new_job_class_sub (int job_class, int min_threads, int max_threads, int subclass_cnt);
 void *job_thread_ex (void *arg, void (*work_one)(void *, int));
+/* thread placement policy (none, auto, spread, compact); must be set before init_async_jobs () */
+int jobs_set_cpu_affinity_policy (const char *name);
+/* share of cores for this process among -M workers; part < 0 disables placement */
+void jobs_set_cpu_partition (int part, int parts);
 
 /* creates a new async job as described */
 job_t create_async_job (job_function_t run_job, unsigned long long job_signals, int job_subclass, int custom_bytes, unsigned long long job_type, JOB_REF_ARG (parent_job));
@@ -405,8 +409,11 @@ job_t job_timer_alloc (int thread_class, double (*alarm)(void *), void *extra);
 struct thread_callback {
   struct thread_callback *next;
   void (*new_thread)(void);
+  void (*idle)(void);  // optional: job queue is empty (and every JOB_THREAD_IDLE_PERIOD jobs), flush deferred per-thread work
 };
 
+#define JOB_THREAD_IDLE_PERIOD 64
+
 void register_thread_callback (struct thread_callback *cb);
 job_t alloc_timer_manager (int thread_class);
 
@@ -67,6 +67,12 @@
 #include "net/net-tcp-rpc-server.h"
 #include "net/net-tcp-rpc-client.h"
 #include "net/net-tcp-rpc-ext-server.h"
+#include "net/net-hot-upgrade.h"
+#include "net/net-latency-tracer.h"
+#include "net/net-fault-inject.h"
+#include "net/net-dns-resolver.h"
+#include "net/net-ip-acl.h"
+#include "net/net-socks5-server.h"
 #include "net/net-crypto-aes.h"
 #include "net/net-crypto-dh.h"
 #include "mtproto-common.h"
@@ -114,6 +120,7 @@ const char FullVersionStr[] = VERSION_STR " compiled at " __DATE__ " " __TIME__
 #define	MAX_POST_SIZE	(262144 * 4 - 4096)
 
 #define	DEFAULT_WINDOW_CLAMP	131072
+#define	DEFAULT_DRAIN_TIMEOUT	300
 
 // #define DEFAULT_OUTBOUND_CONNECTION_CREATION_RATE	1000000
 
@@ -199,6 +206,8 @@ struct ext_connection {
   long long out_conn_id;
   long long auth_key_id;
   struct ext_connection *lru_prev, *lru_next;
+  double query_time; // first unanswered query forwarded at, 0 - none (see rpc_target_lb_query_sent)
+  struct latency_trace trace; // sampled query waiting for its answer, trace.start = 0 - none
 };
 
 struct ext_connection_ref {
@@ -350,10 +359,12 @@ struct ext_connection *create_ext_connection (connection_job_t CI, long long in_
     Ex->o_prev = H->o_prev;
     H->o_prev->o_next = Ex;
     H->o_prev = Ex;
+    CONN_INFO(CO)->pool_bound_clients ++;
     Ex->out_fd = CONN_INFO(CO)->fd;
     Ex->out_gen = CONN_INFO(CO)->generation;
   }
   Ex->auth_key_id = auth_key_id;
+  Ex->trace.start = 0;
   return Ex;
 }
 
@@ -366,10 +377,17 @@ void remove_ext_connection (struct ext_connection *Ex, int send_notifications) {
   if (Ex->out_fd) {
     assert ((unsigned) Ex->out_fd < MAX_CONNECTIONS);
     assert (Ex->o_next);
-    if (send_notifications & 1) {
-      connection_job_t CO = connection_get_by_fd_generation (Ex->out_fd, Ex->out_gen);
-      if (CO) {
+    connection_job_t CO = connection_get_by_fd_generation (Ex->out_fd, Ex->out_gen);
+    if (CO) {
+      // a draining pool connection is closed once this drops to zero
+      CONN_INFO(CO)->pool_bound_clients --;
+      if (Ex->query_time) {
+	rpc_target_lb_query_done (CO, -1);
+      }
+      if (send_notifications & 1) {
 	_notify_remote_closed (JOB_REF_PASS (CO), Ex->out_conn_id);
+      } else {
+	job_decref (JOB_REF_PASS (CO));
       }
     }
   }
@@ -429,6 +447,13 @@ struct worker_stats {
 
   long long ext_connections, ext_connections_created;
   long long http_queries, http_bad_headers;
+
+  struct ext_secret_stat secrets[EXT_SECRET_MAX], secrets_unmatched;
+  struct socks5_server_stat socks5;
+  struct latency_trace_stat latency;
+#ifdef FAULT_INJECTION
+  struct fault_inject_stat faults;
+#endif
 };
 
 struct worker_stats *WStats, SumStats;
@@ -452,6 +477,14 @@ long long mtproto_proxy_errors;
 char proxy_tag[16];
 int proxy_tag_set;
 
+/* -S <secret>:<proxy tag> overrides proxy_tag for clients of that secret */
+static char secret_proxy_tag[EXT_SECRET_MAX][16];
+static int secret_proxy_tag_set[EXT_SECRET_MAX];
+
+/* --socks5-port: SOCKS5 clients relayed by the same engine */
+static int socks5_sfd, socks5_port;
+static int socks5_no_auth, socks5_allow_private, socks5_allow_only;
+
 static void update_local_stats_copy (struct worker_stats *S) {
   S->cnt++;
   __sync_synchronize();
@@ -461,6 +494,16 @@ static void update_local_stats_copy (struct worker_stats *S) {
   fetch_connections_stat (&S->conn);
   fetch_aes_crypto_stat (&S->allocated_aes_crypto, &S->allocated_aes_crypto_temp);
   fetch_buffers_stat (&S->bufs);
+  fetch_ext_secret_stats (S->secrets, &S->secrets_unmatched);
+#ifndef _WIN32
+  fetch_socks5_server_stat (&S->socks5);
+#endif
+  if (latency_trace_rate) {
+    fetch_latency_trace_stat (&S->latency);
+  }
+#ifdef FAULT_INJECTION
+  fetch_fault_inject_stat (&S->faults);
+#endif
 
   UPD (ev_heap_size); 
 
@@ -534,6 +577,7 @@ static inline void add_stats (struct worker_stats *W) {
   UPD (bufs.max_allocated_buffer_bytes);
   UPD (bufs.max_buffer_chunks);
   UPD (bufs.buffer_chunk_alloc_ops);
+  UPD (bufs.remote_free_pending);
 
   UPD (ev_heap_size); 
 
@@ -558,6 +602,32 @@ static inline void add_stats (struct worker_stats *W) {
   UPD (ext_connections_created); 
   UPD (http_queries); 
   UPD (http_bad_headers);
+
+  int i;
+  for (i = 0; i <= EXT_SECRET_MAX; i++) {
+    struct ext_secret_stat *F = i < EXT_SECRET_MAX ? &W->secrets[i] : &W->secrets_unmatched;
+    struct ext_secret_stat *T = i < EXT_SECRET_MAX ? &SumStats.secrets[i] : &SumStats.secrets_unmatched;
+    T->connections += F->connections;
+    T->handshake_rejects += F->handshake_rejects;
+    T->replay_hits += F->replay_hits;
+    T->rpcs += F->rpcs;
+    T->bytes_in += F->bytes_in;
+    T->bytes_out += F->bytes_out;
+  }
+  UPD (socks5.accepted);
+  UPD (socks5.handshake_errors);
+  UPD (socks5.auth_failures);
+  UPD (socks5.connect_failures);
+  UPD (socks5.acl_rejects);
+  UPD (socks5.relays);
+  UPD (socks5.active_relays);
+  UPD (socks5.bytes_in);
+  UPD (socks5.bytes_out);
+  UPD (socks5.read_stops);
+  latency_trace_stat_add (&SumStats.latency, &W->latency);
+#ifdef FAULT_INJECTION
+  fault_inject_stat_add (&SumStats.faults, &W->faults);
+#endif
 #undef UPD
 }
 
@@ -604,6 +674,10 @@ void compute_stats_sum (void) {
  */
 
 
+#ifndef _WIN32
+static void hot_upgrade_prepare_stats (stats_buffer_t *sb);
+#endif
+
 void mtfront_prepare_stats (stats_buffer_t *sb) {
   struct connections_stat conn;
   struct buffers_stat bufs;
@@ -664,6 +738,7 @@ void mtfront_prepare_stats (stats_buffer_t *sb) {
 	     "total_network_buffers_used_size\t%lld\n"
 	     "total_network_buffers_allocated_bytes\t%lld\n"
 	     "total_network_buffers_used\t%d\n"
+	     "total_network_buffers_remote_free\t%lld\n"
 	     "total_network_buffer_chunks_allocated\t%d\n"
 	     "total_network_buffer_chunks_allocated_max\t%d\n"
 	     "mtproto_proxy_errors\t%lld\n"
@@ -730,6 +805,7 @@ void mtfront_prepare_stats (stats_buffer_t *sb) {
 	     SW(bufs.total_used_buffers_size),
 	     SW(bufs.allocated_buffer_bytes),
 	     SW(bufs.total_used_buffers),
+	     SW(bufs.remote_free_pending),
 	     SW(bufs.allocated_buffer_chunks),
 	     SW(bufs.max_allocated_buffer_chunks),
 	     S(mtproto_proxy_errors),
@@ -743,6 +819,82 @@ void mtfront_prepare_stats (stats_buffer_t *sb) {
 	     proxy_mode,
 	     proxy_tag_set
   );
+
+  /* autoscaled middle-end pools, summed over the targets of each DC */
+  int i, j;
+  for (i = 0; i < CurConf->auth_clusters; i++) {
+    struct mf_cluster *MFC = &CurConf->auth_cluster[i];
+    int size = 0, ready = 0, draining = 0, queue = 0, rtt = 0, ups = 0, downs = 0, lb_rtt = 0, outstanding = 0;
+    long long backlog = 0;
+    for (j = 0; j < MFC->targets_num; j++) {
+      struct conn_target_info *CT = CONN_TARGET_INFO (MFC->cluster_targets[j]);
+      size += CT->pool_size;
+      ready += CT->ready_outbound_connections;
+      draining += CT->pool_draining;
+      backlog += CT->pool_backlog_bytes;
+      ups += CT->pool_scale_ups;
+      downs += CT->pool_scale_downs;
+      if (CT->pool_queue_depth > queue) {
+        queue = CT->pool_queue_depth;
+      }
+      if (CT->pool_rtt_us > rtt) {
+        rtt = CT->pool_rtt_us;
+      }
+      if (CT->lb_rtt_us > lb_rtt) {
+        lb_rtt = CT->lb_rtt_us;
+      }
+      outstanding += CT->lb_outstanding;
+    }
+    sb_printf (sb, "dc_pool_%d	size=%d ready=%d draining=%d backlog=%lld queue=%d rtt_us=%d scale_ups=%d scale_downs=%d answer_rtt_us=%d outstanding=%d\n",
+	       MFC->cluster_id, size, ready, draining, backlog, queue, rtt, ups, downs, lb_rtt, outstanding);
+  }
+  /* per -S secret; the master of -M workers serves no clients itself */
+  struct ext_secret_stat secrets[EXT_SECRET_MAX], unmatched;
+  fetch_ext_secret_stats (secrets, &unmatched);
+  for (i = 0; i <= tcp_rpcs_ext_secret_count (); i++) {
+    int last = i == tcp_rpcs_ext_secret_count ();
+    struct ext_secret_stat *L = last ? &unmatched : &secrets[i], *W = last ? &SumStats.secrets_unmatched : &SumStats.secrets[i];
+    if (last) {
+      sb_printf (sb, "secret_unmatched\t");
+    } else {
+      sb_printf (sb, "secret_%d\tproxy_tag_set=%d ", i, secret_proxy_tag_set[i] || proxy_tag_set);
+    }
+    sb_printf (sb, "connections=%lld rpcs=%lld bytes_in=%lld bytes_out=%lld handshake_rejects=%lld replay_hits=%lld\n",
+	       L->connections + W->connections, L->rpcs + W->rpcs, L->bytes_in + W->bytes_in, L->bytes_out + W->bytes_out,
+	       L->handshake_rejects + W->handshake_rejects, L->replay_hits + W->replay_hits);
+  }
+  if (latency_trace_rate) {
+    struct latency_trace_stat L;
+    fetch_latency_trace_stat (&L);
+    latency_trace_stat_add (&L, &SumStats.latency);
+    latency_trace_print_stat (sb, &L);
+  }
+#ifdef FAULT_INJECTION
+  struct fault_inject_stat F;
+  fetch_fault_inject_stat (&F);
+  fault_inject_stat_add (&F, &SumStats.faults);
+  fault_inject_print_stat (sb, &F);
+#endif
+#ifndef _WIN32
+  if (socks5_port) {
+    struct socks5_server_stat L;
+    fetch_socks5_server_stat (&L);
+    sb_printf (sb, "socks5\taccepted=%lld handshake_errors=%lld auth_failures=%lld connect_failures=%lld acl_rejects=%lld relays=%lld active_relays=%lld bytes_in=%lld bytes_out=%lld read_stops=%lld\n",
+	       L.accepted + SumStats.socks5.accepted, L.handshake_errors + SumStats.socks5.handshake_errors,
+	       L.auth_failures + SumStats.socks5.auth_failures, L.connect_failures + SumStats.socks5.connect_failures,
+	       L.acl_rejects + SumStats.socks5.acl_rejects,
+	       L.relays + SumStats.socks5.relays, L.active_relays + SumStats.socks5.active_relays,
+	       L.bytes_in + SumStats.socks5.bytes_in, L.bytes_out + SumStats.socks5.bytes_out, L.read_stops + SumStats.socks5.read_stops);
+  }
+  hot_upgrade_prepare_stats (sb);
+
+  struct dns_resolver_stat dns;
+  dns_resolver_get_stat (&dns);
+  sb_printf (sb, "dns_resolver\tqueries=%lld retries=%lld timeouts=%lld answers=%lld bad_answers=%lld pending=%d\n"
+	     "dns_cache\tentries=%d hits=%lld negative_hits=%lld misses=%lld evictions=%lld\n",
+	     dns.queries_sent, dns.retries, dns.timeouts, dns.answers, dns.bad_answers, dns.pending,
+	     dns.cache_entries, dns.cache_hits, dns.cache_negative_hits, dns.cache_misses, dns.cache_evictions);
+#endif
 #undef S
 #undef S1
 #undef SW
@@ -859,8 +1011,17 @@ struct client_packet_info {
   struct raw_message msg;
   connection_job_t conn;
   int type;
+  long long rx_rdtsc; // rpcc_execute entered at, if latency tracing is on
 };
 
+/* first answer to a forwarded query: delay sample for the middle-end connection C */
+static inline void ext_connection_answered (struct ext_connection *Ex, connection_job_t C) {
+  if (Ex->query_time) {
+    rpc_target_lb_query_done (C, get_utime_monotonic () - Ex->query_time);
+    Ex->query_time = 0;
+  }
+}
+
 int process_client_packet (struct tl_in_state *tlio_in, int op, connection_job_t C) {
   int len = tl_fetch_unread ();
   assert (op == tl_fetch_int ());
@@ -877,12 +1038,22 @@ int process_client_packet (struct tl_in_state *tlio_in, int op, connection_job_t
       struct ext_connection *Ex = find_ext_connection_by_out_conn_id (out_conn_id);
       connection_job_t D = 0;
       if (Ex && Ex->out_fd == CONN_INFO(C)->fd && Ex->out_gen == CONN_INFO(C)->generation) {
+	ext_connection_answered (Ex, C);
 	D = connection_get_by_fd_generation (Ex->in_fd, Ex->in_gen);
       }
       if (D) {
 	vkprintf (2, "proxying answer into connection %d:%llx\n", Ex->in_fd, Ex->in_conn_id);
 	tot_forwarded_responses++;
+	struct latency_trace T = Ex->trace;
+	if (T.start) {
+	  Ex->trace.start = 0;
+	  latency_trace_stage (&T, LT_MIDDLE_END, latency_trace_rx);
+	  latency_trace_stage (&T, LT_REPLY_QUEUE, rdtsc ());
+	}
 	client_send_message (JOB_REF_PASS(D), Ex->in_conn_id, tlio_in, flags);
+	if (T.start) {
+	  latency_trace_finish (&T, LT_CLIENT_WRITE);
+	}
       } else {
 	vkprintf (2, "external connection not found, dropping proxied answer\n");
 	dropped_responses++;
@@ -899,6 +1070,7 @@ int process_client_packet (struct tl_in_state *tlio_in, int op, connection_job_t
       struct ext_connection *Ex = find_ext_connection_by_out_conn_id (out_conn_id);
       connection_job_t D = 0;
       if (Ex && Ex->out_fd == CONN_INFO(C)->fd && Ex->out_gen == CONN_INFO(C)->generation) {
+	ext_connection_answered (Ex, C);
 	D = connection_get_by_fd_generation (Ex->in_fd, Ex->in_gen);
       }
       if (D) {
@@ -945,6 +1117,7 @@ int client_packet_job_run (job_t job, int op, struct job_thread *JT) {
   case JS_RUN: {
     struct tl_in_state *tlio_in = tl_in_state_alloc ();
     tlf_init_raw_message (tlio_in, &D->msg, D->msg.total_bytes, 0);
+    latency_trace_rx = D->rx_rdtsc;
     process_client_packet (tlio_in, D->type, D->conn);
     tl_in_state_free (tlio_in);
     return JOB_COMPLETED;
@@ -978,6 +1151,7 @@ int rpcc_execute (connection_job_t C, int op, struct raw_message *msg) {
 
   switch (op) {
   case RPC_PONG:
+    rpc_target_lb_pong (C, msg);
     break;
   case RPC_PROXY_ANS:
   case RPC_SIMPLE_ACK:
@@ -987,6 +1161,7 @@ int rpcc_execute (connection_job_t C, int op, struct raw_message *msg) {
     D->msg = *msg;
     D->type = op;
     D->conn = job_incref (C);
+    D->rx_rdtsc = latency_trace_rate ? rdtsc () : 0;
     schedule_job (JOB_REF_PASS (job));
     return 1;
   }
@@ -1025,6 +1200,7 @@ int mtfront_client_close (connection_job_t C, int who) {
   int fd = CONN_INFO(C)->fd;
   assert ((unsigned) fd < MAX_CONNECTIONS);
   vkprintf (1, "Disconnected from RPC Middle-End (fd=%d)\n", fd);
+  rpc_target_lb_conn_closed (C);
   if (D->extra_int) {
     assert (D->extra_int == get_conn_tag (C));
     struct ext_connection *H = &ExtConnectionHead[fd], *Ex, *Ex_next;
@@ -1532,6 +1708,7 @@ struct rpcs_exec_data {
   connection_job_t conn;
   int op;
   int rpc_flags;
+  struct latency_trace trace;
 };
 
 int do_rpcs_execute (void *_data, int s_len) {
@@ -1539,13 +1716,26 @@ int do_rpcs_execute (void *_data, int s_len) {
   assert (s_len == sizeof (struct rpcs_exec_data));
   assert (data);
 
+  if (CONN_INFO(data->conn)->flags & C_ERROR) {
+    // the close notification may overtake this callback: forwarding now would create an ext_connection nobody removes
+    vkprintf (2, "ext_rpcs_execute: connection %d already failed, dropping packet\n", CONN_INFO(data->conn)->fd);
+    rwm_free (&data->msg);
+    job_decref (JOB_REF_PASS (data->conn));
+    return JOB_COMPLETED;
+  }
+
   lru_insert_conn (data->conn);
 
   int len = data->msg.total_bytes;
   struct tl_in_state *tlio_in = tl_in_state_alloc ();
   tlf_init_raw_message (tlio_in, &data->msg, len, 0);
 
+  if (data->trace.start) {
+    latency_trace_stage (&data->trace, LT_QUEUE, rdtsc ());
+    latency_trace_cur = &data->trace;
+  }
   int res = forward_mtproto_packet (tlio_in, data->conn, len, 0, data->rpc_flags);
+  latency_trace_cur = 0;
   tl_in_state_free (tlio_in);
   job_decref (JOB_REF_PASS (data->conn));
 
@@ -1575,6 +1765,11 @@ int ext_rpcs_execute (connection_job_t c, int op, struct raw_message *msg) {
   rwm_move (&data.msg, msg);
   data.conn = job_incref (c);
   data.rpc_flags = TCP_RPC_DATA(c)->flags & (RPC_F_QUICKACK | RPC_F_DROPPED | RPC_F_COMPACT_MEDIUM | RPC_F_EXTMODE3);
+  data.trace.start = 0;
+  if (latency_trace_rate && latency_trace_sample ()) {
+    data.trace.start = data.trace.last = latency_trace_rx;
+    latency_trace_stage (&data.trace, LT_PARSE, rdtsc ());
+  }
 
   schedule_job_callback (JC_ENGINE, do_rpcs_execute, &data, sizeof (struct rpcs_exec_data));
 
@@ -1669,6 +1864,9 @@ int client_send_message (JOB_REF_ARG(C), long long in_conn_id, struct tl_in_stat
   if (CONN_INFO(C)->type == &ct_http_server_mtfront) {
     return http_send_message (JOB_REF_PASS(C), tlio_in, flags);
   }
+  if (CONN_INFO(C)->type == &ct_tcp_rpc_ext_server_mtfront) {
+    tcp_rpcs_ext_secret_traffic (C, 0, 0, TL_IN_REMAINING);
+  }
   TLS_START (JOB_REF_CREATE_PASS (C)) {
     assert (tl_copy_through (tlio_in, tlio_out, TL_IN_REMAINING, 1) >= 0);
   } TLS_END;
@@ -1695,12 +1893,24 @@ conn_target_job_t choose_proxy_target (int target_dc) {
   int attempts = 5;
   while (attempts --> 0) {
     assert (MFC->targets_num > 0);
-    conn_target_job_t S = MFC->cluster_targets[lrand48() % MFC->targets_num];
+    int n = MFC->targets_num, i = lrand48() % n;
+    conn_target_job_t S = MFC->cluster_targets[i];
+    if (n > 1) {
+      // power of two choices: the other candidate is a different random target
+      conn_target_job_t S2 = MFC->cluster_targets[(i + 1 + lrand48() % (n - 1)) % n];
+      if (rpc_target_lb_target_cost (S2) < rpc_target_lb_target_cost (S)) {
+        S = S2;
+      }
+    }
     connection_job_t C = 0;
     rpc_target_choose_random_connections (S, 0, 1, &C);
-    if (C && TCP_RPC_DATA(C)->extra_int == get_conn_tag (C)) {
+    if (C) {
+      // a connection that has just failed is still in the tree, but no longer tagged
+      int ready = TCP_RPC_DATA(C)->extra_int == get_conn_tag (C);
       job_decref (JOB_REF_PASS (C));
-      return S;
+      if (ready) {
+        return S;
+      }
     }
   }
   return 0;
@@ -1712,8 +1922,6 @@ static int forward_mtproto_enc_packet (struct tl_in_state *tlio_in, connection_j
   }
   vkprintf (2, "received mtproto encrypted packet of %d bytes from connection %p (#%d~%d), key=%016llx\n", len, C, CONN_INFO(C)->fd, CONN_INFO(C)->generation, auth_key_id);
 
-  CONN_INFO(C)->query_start_time = get_utime_monotonic ();
-
   conn_target_job_t S = choose_proxy_target (TCP_RPC_DATA(C)->extra_int4);
 
   assert (TL_IN_REMAINING == len);
@@ -1763,6 +1971,8 @@ int forward_tcp_query (struct tl_in_state *tlio_in, connection_job_t c, conn_tar
   int c_fd = CONN_INFO(c)->fd;
   struct ext_connection *Ex = get_ext_connection_by_in_fd (c_fd);
 
+  CONN_INFO(c)->query_start_time = get_utime_monotonic ();
+
   if (CONN_INFO(c)->type == &ct_tcp_rpc_ext_server_mtfront) {
     flags |= TCP_RPC_DATA(c)->flags & RPC_F_DROPPED;
     flags |= 0x1000;
@@ -1789,7 +1999,7 @@ int forward_tcp_query (struct tl_in_state *tlio_in, connection_job_t c, conn_tar
   if (!d) {
     int attempts = 5;
     while (S && attempts --> 0) {
-      rpc_target_choose_random_connections (S, 0, 1, &d);
+      d = rpc_target_choose_p2c_connection (S, 0);
       if (d) {
 	if (TCP_RPC_DATA(d)->extra_int == get_conn_tag (d)) {
 	  break;
@@ -1808,6 +2018,7 @@ int forward_tcp_query (struct tl_in_state *tlio_in, connection_job_t c, conn_tar
     }
     if (flags & RPC_F_DROPPED) {
       // there was at least one dropped inbound packet on this connection, have to close it now instead of forwarding next queries
+      job_decref (JOB_REF_PASS (d));
       fail_connection (c, -35);
       return 0;
     }
@@ -1820,10 +2031,28 @@ int forward_tcp_query (struct tl_in_state *tlio_in, connection_job_t c, conn_tar
 
   vkprintf (3, "forwarding user query from connection %d~%d (ext_conn_id %llx) into connection %d~%d (ext_conn_id %llx)\n", Ex->in_fd, Ex->in_gen, Ex->in_conn_id, Ex->out_fd, Ex->out_gen, Ex->out_conn_id);
 
-  if (proxy_tag_set) {
+  const char *tag = proxy_tag_set ? proxy_tag : NULL;
+  if (CONN_INFO(c)->type == &ct_tcp_rpc_ext_server_mtfront) {
+    int secret_id = tcp_rpcs_ext_secret_id (c);
+    if (secret_id >= 0 && secret_proxy_tag_set[secret_id]) {
+      tag = secret_proxy_tag[secret_id];
+    }
+    tcp_rpcs_ext_secret_traffic (c, 1, TL_IN_REMAINING, 0);
+  }
+  if (tag) {
     flags |= 8;
   }
 
+  if (!Ex->query_time) {
+    Ex->query_time = CONN_INFO(c)->query_start_time;
+    rpc_target_lb_query_sent (d);
+  }
+
+  struct latency_trace *T = latency_trace_cur;
+  if (T) {
+    latency_trace_stage (T, LT_FORWARD, rdtsc ());
+  }
+
   TLS_START (JOB_REF_PASS (d)); // open tlio_out context
 
   tl_store_int (RPC_PROXY_REQ);
@@ -1861,7 +2090,7 @@ int forward_tcp_query (struct tl_in_state *tlio_in, connection_job_t c, conn_tar
     int pos = TL_OUT_POS;
     if (flags & 8) {
       tl_store_int (TL_PROXY_TAG);
-      tl_store_string (proxy_tag, sizeof (proxy_tag));
+      tl_store_string (tag, sizeof (proxy_tag));
     }
     if (flags & 4) {
       tl_store_int (TL_HTTP_QUERY_INFO);
@@ -1877,6 +2106,14 @@ int forward_tcp_query (struct tl_in_state *tlio_in, connection_job_t c, conn_tar
 
   TLS_END;   // close tlio_out context
 
+  if (T) {
+    latency_trace_stage (T, LT_ME_WRITE, rdtsc ());
+    // one traced query per ext_connection at a time: the answer is matched by out_conn_id only
+    if (!Ex->trace.start) {
+      Ex->trace = *T;
+    }
+  }
+
   if (CONN_INFO(c)->type == &ct_http_server_mtfront) {
     assert (CONN_INFO(c)->pending_queries >= 0);
     assert (CONN_INFO(c)->pending_queries > 0);
@@ -2004,6 +2241,10 @@ void init_ct_server_mtfront (void) {
  *
  */
 
+/* binary upgrade (SIGUSR2) phases; shared with workers through UpgradeCtl->phase */
+enum { UPGRADE_IDLE, UPGRADE_EXPORT, UPGRADE_WAIT_READY, UPGRADE_DRAIN };
+static int upgrade_state;
+
 #ifdef _WIN32
 // Windows stubs for process management (single-worker mode)
 static void check_children_dead (void) {
@@ -2096,9 +2337,17 @@ void check_children_status (void) {
   if (workers) {
     int i;
     for (i = 0; i < workers; i++) {
+      if (!pids[i]) {
+        continue;
+      }
       int status = 0;
       int res = waitpid (pids[i], &status, WNOHANG);
       if (res == pids[i]) {
+        if (upgrade_state == UPGRADE_DRAIN) {
+          // workers leave one by one once their clients are drained
+          pids[i] = 0;
+          continue;
+        }
         if (WIFEXITED (status) || WIFSIGNALED (status)) {
           kprintf ("Child %d terminated, aborting\n", pids[i]);
           pids[i] = 0;
@@ -2134,11 +2383,38 @@ void check_special_connections_overflow (void) {
   }
 }
 
+/* RPC_PING into ready middle-end connections, keeps delay estimates of idle ones fresh */
+static void ping_proxy_targets (void) {
+  int i, j;
+  for (i = 0; i < CurConf->auth_clusters; i++) {
+    struct mf_cluster *MFC = &CurConf->auth_cluster[i];
+    for (j = 0; j < MFC->targets_num; j++) {
+      rpc_target_lb_send_pings (MFC->cluster_targets[j]);
+    }
+  }
+}
+
+#ifndef _WIN32
+static void hot_upgrade_cron (void);
+#endif
+
 void cron (void) {
   check_children_status ();
   compute_stats_sum ();
   check_special_connections_overflow ();
   check_all_conn_buffers ();
+  ping_proxy_targets ();
+#ifndef _WIN32
+  hot_upgrade_cron ();
+#endif
+#ifdef FAULT_INJECTION
+  fault_inject_cron ();
+  if (FAULT_INJECT (FI_RELOAD)) {
+    // targets dropped by the new config may still have connections and queries in flight
+    vkprintf (1, "fault injection: reloading config\n");
+    do_reload_config (0x17);
+  }
+#endif
 }
 
 int sfd;
@@ -2147,11 +2423,406 @@ int http_sfd[MAX_HTTP_LISTEN_PORTS], http_port[MAX_HTTP_LISTEN_PORTS];
 static int domain_count;
 static int secret_count;
 
+/*
+ *
+ *	HOT UPGRADE
+ *
+ */
+
+/*
+  SIGUSR2 to the master: workers export their replay-protection caches,
+  a fresh copy of the binary is started with the listening sockets and the
+  caches (net/net-hot-upgrade.h), and once it reports ready the old
+  processes stop accepting and exit as soon as their clients are gone or
+  --drain-timeout expires. The new process gets the drain report and
+  publishes it in stats. Any failure before "ready" kills the new binary
+  and leaves the old one serving as if nothing happened.
+*/
+
+static int drain_timeout = DEFAULT_DRAIN_TIMEOUT;
+
+#ifndef _WIN32
+#define UPGRADE_EXPORT_TIMEOUT 2.0
+#define UPGRADE_READY_TIMEOUT 30.0
+#define UPGRADE_KILL_GRACE 10.0
+#define UPGRADE_REPLAY_WINDOW 900      // covers the 10 minute timestamp window of is_allowed_timestamp ()
+#define UPGRADE_REPLAY_RECORDS (1 << 18)
+
+struct upgrade_control {
+  int phase;
+  int exported[MAX_WORKERS];    // -1 until the worker has exported its replay cache
+  int drained[MAX_WORKERS];
+  int dropped[MAX_WORKERS];
+};
+
+static struct upgrade_control *UpgradeCtl;
+static struct client_random_record *upgrade_records;  // per worker export slots
+static int upgrade_records_per_worker;
+
+static char *upgrade_path, **upgrade_argv;
+static int upgrade_sock = -1;   // old side: channel to the new binary, new side: to the old one
+static pid_t upgrade_pid;
+static double upgrade_start_time, upgrade_drain_start;
+static int upgrade_handover_ms, upgrade_draining, upgrade_drain_initial;
+static struct hot_upgrade_report upgrade_report;
+static int upgrade_report_received;
+
+static void hot_upgrade_init_shared (void) {
+  UpgradeCtl = mmap (0, sizeof (*UpgradeCtl), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  assert (UpgradeCtl != MAP_FAILED);
+  if (!domain_count) {
+    return;
+  }
+  upgrade_records_per_worker = HOT_UPGRADE_MAX_BLOB / sizeof (struct client_random_record) / workers;
+  if (upgrade_records_per_worker > UPGRADE_REPLAY_RECORDS) {
+    upgrade_records_per_worker = UPGRADE_REPLAY_RECORDS;
+  }
+  upgrade_records = mmap (0, (size_t) workers * upgrade_records_per_worker * sizeof (struct client_random_record), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (upgrade_records == MAP_FAILED) {
+    upgrade_records = NULL;
+    upgrade_records_per_worker = 0;
+  }
+}
+
+static void hot_upgrade_log (int level, const char *msg, int handover_ms, int drained, int dropped) {
+  log_field_t fields[] = {
+    vlog_field_str("event", "hot_upgrade"),
+    vlog_field_int("new_pid", (int) upgrade_pid),
+    vlog_field_int("handover_ms", handover_ms),
+    vlog_field_int("drained_connections", drained),
+    vlog_field_int("dropped_connections", dropped)
+  };
+  vlog_with_fields(level, "hot_upgrade", msg, fields, 5);
+}
+
+static int inbound_connections (void) {
+  struct connections_stat st;
+  fetch_connections_stat (&st);
+  return st.allocated_inbound_connections;
+}
+
+/* runs where the clients are: in every worker, or in the only process */
+static void hot_upgrade_start_drain (void) {
+  int i;
+  for (i = 0; i < http_ports_num; i++) {
+    stop_accepting_connections (http_sfd[i]);
+  }
+  if (socks5_sfd) {
+    stop_accepting_connections (socks5_sfd);
+  }
+  upgrade_drain_start = precise_now;
+  upgrade_drain_initial = inbound_connections ();
+  upgrade_draining = 1;
+}
+
+static int hot_upgrade_drain_done (int *drained, int *dropped) {
+  int left = inbound_connections ();
+  if (left && precise_now < upgrade_drain_start + drain_timeout) {
+    return 0;
+  }
+  *dropped = left;
+  *drained = upgrade_drain_initial > left ? upgrade_drain_initial - left : 0;
+  return 1;
+}
+
+static int hot_upgrade_export (struct client_random_record *R, int max) {
+  return domain_count && R ? tcp_rpc_export_client_randoms (R, max, UPGRADE_REPLAY_WINDOW) : 0;
+}
+
+static int hot_upgrade_handover (void) {
+  struct hot_upgrade_listen L[MAX_HTTP_LISTEN_PORTS + 2];
+  struct client_random_record *R = NULL;
+  int i, n = 0, records = 0;
+
+  if (workers) {
+    // copy out instead of compacting in place: a late worker may still write into its slot
+    int total = 0;
+    for (i = 0; i < workers; i++) {
+      total += UpgradeCtl->exported[i] > 0 ? UpgradeCtl->exported[i] : 0;
+    }
+    R = total ? malloc (total * sizeof (*R)) : NULL;
+    for (i = 0; R && i < workers; i++) {
+      int k = UpgradeCtl->exported[i];
+      if (k > 0) {
+        memcpy (R + records, upgrade_records + (long) i * upgrade_records_per_worker, k * sizeof (*R));
+        records += k;
+      }
+    }
+  } else if (domain_count) {
+    R = malloc (UPGRADE_REPLAY_RECORDS * sizeof (*R));
+    records = hot_upgrade_export (R, UPGRADE_REPLAY_RECORDS);
+  }
+
+  for (i = 0; i < http_ports_num; i++) {
+    L[n].fd = http_sfd[i];
+    L[n].port = http_port[i];
+    n++;
+  }
+  if (socks5_sfd) {
+    L[n].fd = socks5_sfd;
+    L[n].port = socks5_port;
+    n++;
+  }
+  if (engine_state->sfd > 0) {
+    // negative port marks the engine (stats) socket
+    L[n].fd = engine_state->sfd;
+    L[n].port = -engine_state->port;
+    n++;
+  }
+
+  int res = -1;
+  upgrade_sock = hot_upgrade_spawn (upgrade_path, upgrade_argv, &upgrade_pid);
+  if (upgrade_sock >= 0) {
+    res = hot_upgrade_send_sockets (upgrade_sock, L, n, R, records * sizeof (*R));
+  }
+  free (R);
+  vkprintf (1, "hot upgrade: %d sockets and %d client randoms passed to %s (pid %d), result %d\n", n, records, upgrade_path, (int) upgrade_pid, res);
+  return res;
+}
+
+static void hot_upgrade_abort (const char *reason) {
+  if (upgrade_pid > 0) {
+    kill (upgrade_pid, SIGKILL);
+    waitpid (upgrade_pid, NULL, 0);
+  }
+  if (upgrade_sock >= 0) {
+    close (upgrade_sock);
+    upgrade_sock = -1;
+  }
+  if (UpgradeCtl) {
+    UpgradeCtl->phase = UPGRADE_IDLE;
+  }
+  upgrade_state = UPGRADE_IDLE;
+  hot_upgrade_log (LOG_LEVEL_ERROR, reason, 0, 0, 0);
+  upgrade_pid = 0;
+}
+
+static void hot_upgrade_finish (int drained, int dropped) {
+  struct hot_upgrade_report R = {
+    .handover_ms = upgrade_handover_ms,
+    .drain_ms = (int) ((precise_now - upgrade_drain_start) * 1000),
+    .drained_connections = drained,
+    .dropped_connections = dropped
+  };
+  hot_upgrade_log (LOG_LEVEL_INFO, "Old binary drained, exiting", R.handover_ms, drained, dropped);
+  if (hot_upgrade_send_report (upgrade_sock, &R) < 0) {
+    vkprintf (0, "hot upgrade: cannot pass drain report to the new binary: %m\n");
+  }
+  close (upgrade_sock);
+  upgrade_sock = -1;
+  upgrade_state = UPGRADE_IDLE;
+  upgrade_draining = 0;
+  kill (getpid (), SIGTERM);
+}
+
+/* SIGUSR2: starts the upgrade in the master, follows UpgradeCtl->phase in workers */
+void mtfront_sigusr2_handler (void) {
+  if (slave_mode) {
+    int phase = UpgradeCtl ? UpgradeCtl->phase : UPGRADE_IDLE;
+    if (phase == UPGRADE_EXPORT && UpgradeCtl->exported[worker_id] < 0) {
+      int n = hot_upgrade_export (upgrade_records ? upgrade_records + (long) worker_id * upgrade_records_per_worker : NULL, upgrade_records_per_worker);
+      __sync_synchronize ();
+      UpgradeCtl->exported[worker_id] = n;
+    } else if (phase == UPGRADE_DRAIN && !upgrade_draining) {
+      hot_upgrade_start_drain ();
+    }
+    return;
+  }
+  if (upgrade_state != UPGRADE_IDLE || upgrade_sock >= 0) {
+    vkprintf (0, "hot upgrade: previous upgrade is still in progress, SIGUSR2 ignored\n");
+    return;
+  }
+  upgrade_start_time = precise_now;
+  upgrade_pid = 0;
+  if (workers) {
+    int i;
+    for (i = 0; i < workers; i++) {
+      UpgradeCtl->exported[i] = -1;
+      UpgradeCtl->drained[i] = UpgradeCtl->dropped[i] = 0;
+    }
+    __sync_synchronize ();
+    UpgradeCtl->phase = UPGRADE_EXPORT;
+    kill_children (SIGUSR2);
+  }
+  upgrade_state = UPGRADE_EXPORT;
+  hot_upgrade_log (LOG_LEVEL_INFO, "Binary upgrade requested", 0, 0, 0);
+}
+
+/* master or the only process; called from precise_cron, never blocks */
+static void hot_upgrade_step (void) {
+  int i, r;
+  switch (upgrade_state) {
+  case UPGRADE_EXPORT:
+    for (i = 0; i < workers && UpgradeCtl->exported[i] >= 0; i++) {
+    }
+    if (i < workers && precise_now < upgrade_start_time + UPGRADE_EXPORT_TIMEOUT) {
+      return;
+    }
+    if (hot_upgrade_handover () < 0) {
+      hot_upgrade_abort ("Cannot start new binary, upgrade aborted");
+      return;
+    }
+    upgrade_state = UPGRADE_WAIT_READY;
+    return;
+  case UPGRADE_WAIT_READY:
+    r = hot_upgrade_poll_ready (upgrade_sock);
+    if (!r && precise_now < upgrade_start_time + UPGRADE_READY_TIMEOUT) {
+      return;
+    }
+    if (r <= 0) {
+      hot_upgrade_abort (r ? "New binary exited before becoming ready, upgrade aborted" : "New binary is not ready in time, upgrade aborted");
+      return;
+    }
+    upgrade_handover_ms = (int) ((precise_now - upgrade_start_time) * 1000);
+    hot_upgrade_log (LOG_LEVEL_INFO, "New binary is ready, draining old one", upgrade_handover_ms, 0, 0);
+    upgrade_state = UPGRADE_DRAIN;
+    if (engine_state->sfd > 0) {
+      stop_accepting_connections (engine_state->sfd);
+    }
+    if (workers) {
+      upgrade_drain_start = precise_now;
+      UpgradeCtl->phase = UPGRADE_DRAIN;
+      kill_children (SIGUSR2);
+    } else {
+      hot_upgrade_start_drain ();
+    }
+    return;
+  }
+}
+
+/* once a second, from cron */
+static void hot_upgrade_cron (void) {
+  int i, drained = 0, dropped = 0;
+  if (slave_mode) {
+    if (upgrade_draining && hot_upgrade_drain_done (&drained, &dropped)) {
+      UpgradeCtl->drained[worker_id] = drained;
+      UpgradeCtl->dropped[worker_id] = dropped;
+      upgrade_draining = 0;
+      kill (getpid (), SIGTERM);
+    }
+    return;
+  }
+  if (upgrade_state == UPGRADE_DRAIN) {
+    if (!workers) {
+      if (hot_upgrade_drain_done (&drained, &dropped)) {
+        hot_upgrade_finish (drained, dropped);
+      }
+      return;
+    }
+    int alive = 0;
+    for (i = 0; i < workers; i++) {
+      alive += pids[i] != 0;
+      drained += UpgradeCtl->drained[i];
+      dropped += UpgradeCtl->dropped[i];
+    }
+    if (!alive) {
+      hot_upgrade_finish (drained, dropped);
+    } else if (precise_now > upgrade_drain_start + drain_timeout + UPGRADE_KILL_GRACE) {
+      kill_children (SIGKILL);
+    }
+    return;
+  }
+  if (upgrade_state == UPGRADE_IDLE && upgrade_sock >= 0) {
+    // new side: waiting for the report of the previous binary
+    int r = hot_upgrade_poll_report (upgrade_sock, &upgrade_report);
+    if (r) {
+      upgrade_report_received = r > 0;
+      close (upgrade_sock);
+      upgrade_sock = -1;
+      if (r > 0) {
+        hot_upgrade_log (LOG_LEVEL_INFO, "Previous binary finished draining", upgrade_report.handover_ms, upgrade_report.drained_connections, upgrade_report.dropped_connections);
+      }
+    }
+  }
+}
+
+/* new side, before opening sockets: take over the ones of the previous binary */
+static void hot_upgrade_adopt_sockets (void) {
+  struct hot_upgrade_listen L[HOT_UPGRADE_MAX_FDS];
+  void *blob;
+  int blob_len, i, j, adopted = 0, imported = 0;
+
+  upgrade_sock = hot_upgrade_inherited_fd ();
+  if (upgrade_sock < 0) {
+    return;
+  }
+  int n = hot_upgrade_recv_sockets (upgrade_sock, L, HOT_UPGRADE_MAX_FDS, &blob, &blob_len);
+  if (n < 0) {
+    vkprintf (0, "hot upgrade: cannot receive listening sockets: %m\n");
+    close (upgrade_sock);
+    upgrade_sock = -1;
+    return;
+  }
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < http_ports_num && (http_sfd[i] || http_port[i] != L[j].port); i++) {
+    }
+    if (i < http_ports_num) {
+      http_sfd[i] = L[j].fd;
+    } else if (socks5_port && L[j].port == socks5_port && !socks5_sfd) {
+      socks5_sfd = L[j].fd;
+    } else if (L[j].port == -engine_state->port && !engine_state->do_not_open_port && engine_state->sfd <= 0) {
+      engine_state->sfd = L[j].fd;
+    } else {
+      close (L[j].fd);
+      continue;
+    }
+    adopted++;
+  }
+  if (domain_count && blob_len) {
+    imported = tcp_rpc_import_client_randoms (blob, blob_len / sizeof (struct client_random_record));
+  }
+  free (blob);
+
+  log_field_t fields[] = {
+    vlog_field_str("event", "hot_upgrade"),
+    vlog_field_int("adopted_sockets", adopted),
+    vlog_field_int("client_randoms", imported)
+  };
+  vlog_with_fields(LOG_LEVEL_INFO, "hot_upgrade", "Listening sockets taken over from previous binary", fields, 3);
+}
+
+static void hot_upgrade_prepare_stats (stats_buffer_t *sb) {
+  if (upgrade_report_received) {
+    sb_printf (sb,
+	       "hot_upgrade_handover_ms\t%d\n"
+	       "hot_upgrade_drain_ms\t%d\n"
+	       "hot_upgrade_drained_connections\t%d\n"
+	       "hot_upgrade_dropped_connections\t%d\n",
+	       upgrade_report.handover_ms, upgrade_report.drain_ms,
+	       upgrade_report.drained_connections, upgrade_report.dropped_connections);
+  }
+}
+
+/* new side, pre_loop: workers drop the channel, the master reports readiness */
+static void hot_upgrade_signal_ready (void) {
+  if (upgrade_sock < 0) {
+    return;
+  }
+  if (slave_mode || hot_upgrade_send_ready (upgrade_sock) < 0) {
+    close (upgrade_sock);
+    upgrade_sock = -1;
+  }
+}
+
+static void hot_upgrade_save_argv (char *argv[]) {
+  static char path[PATH_MAX];
+  upgrade_argv = argv;
+  upgrade_path = argv[0];
+  // the engine may chdir later; resolve the binary now
+  if (strchr (argv[0], '/') && realpath (argv[0], path)) {
+    upgrade_path = path;
+  }
+}
+#endif
+
 // static double next_create_outbound;
 // int outbound_connections_per_second = DEFAULT_OUTBOUND_CONNECTION_CREATION_RATE;
 
 void mtfront_pre_loop (void) {
   int i, enable_ipv6 = engine_check_ipv6_enabled () ? SM_IPV6 : 0;
+#ifndef _WIN32
+  dns_resolver_engine_init ();
+#endif
   if (domain_count == 0) {
     tcp_maximize_buffers = 1;
     if (window_clamp == 0) {
@@ -2191,12 +2862,25 @@ void mtfront_pre_loop (void) {
 #endif
       }
     }
+#ifndef _WIN32
+    if (socks5_sfd) {
+      init_listening_tcpv6_connection (socks5_sfd, &ct_socks5_server, NULL, enable_ipv6 | SM_LOWPRIO | (max_special_connections ? SM_SPECIAL : 0));
+    }
+#endif
     // create_all_outbound_connections ();
   }
+#ifndef _WIN32
+  hot_upgrade_signal_ready ();
+#endif
 }
 
 void precise_cron (void) {
   update_local_stats ();
+#ifndef _WIN32
+  if (upgrade_state != UPGRADE_IDLE && !slave_mode) {
+    hot_upgrade_step ();
+  }
+#endif
 }
 
 void mtfront_sigusr1_handler (void) {
@@ -2225,6 +2909,27 @@ void usage (void) {
   exit (2);
 }
 
+static void parse_hex16 (int val, const char *hex, unsigned char res[16]) {
+  int i;
+  unsigned char b = 0;
+  for (i = 0; i < 32; i++) {
+    if (hex[i] >= '0' && hex[i] <= '9')  {
+      b = b * 16 + hex[i] - '0';
+    } else if (hex[i] >= 'a' && hex[i] <= 'f') {
+      b = b * 16 + hex[i] - 'a' + 10;
+    } else if (hex[i] >= 'A' && hex[i] <= 'F') {
+      b = b * 16 + hex[i] - 'A' + 10;
+    } else {
+      kprintf ("'%c' option requires exactly 32 hex digits. '%c' is not hexdigit\n", val, hex[i]);
+      usage ();
+    }
+    if (i & 1) {
+      res[i / 2] = b;
+      b = 0;
+    }
+  }
+}
+
 server_functions_t mtproto_front_functions;
 int f_parse_option (int val) {
   char *colon, *ptr;
@@ -2271,12 +2976,66 @@ int f_parse_option (int val) {
     workers = atoi (optarg);
     assert (workers >= 0 && workers <= MAX_WORKERS);
     break;
+  case 2001:
+    drain_timeout = atoi (optarg);
+    if (drain_timeout < 0) {
+      drain_timeout = 0;
+    }
+    break;
   case 'T':
     ping_interval = atof (optarg);
     if (ping_interval <= 0) {
       ping_interval = PING_INTERVAL;
     }
     break;
+#ifndef _WIN32
+  case 2002:
+    socks5_port = atoi (optarg);
+    if (socks5_port <= 0 || socks5_port >= 65536) {
+      kprintf ("bad socks5 port %s\n", optarg);
+      usage ();
+    }
+    break;
+  case 2003:
+    colon = strchr (optarg, ':');
+    if (!colon) {
+      kprintf ("socks5-user requires <user>:<password>\n");
+      usage ();
+    }
+    *colon = 0;
+    if (socks5_server_add_user (optarg, colon + 1) < 0) {
+      kprintf ("cannot add socks5 user '%s': duplicate, empty, too long or too many users\n", optarg);
+      usage ();
+    }
+    break;
+  case 2005:
+    socks5_server_set_acl_file (optarg, IP_ACL_BLACKLIST);
+    break;
+  case 2006:
+    socks5_server_set_acl_file (optarg, IP_ACL_WHITELIST);
+    break;
+  case 2007:
+    socks5_allow_only = 1;
+    break;
+  case 2008:
+    socks5_allow_private = 1;
+    break;
+  case 2009:
+    socks5_no_auth = 1;
+    break;
+#endif
+  case 2010:
+    pool_drain_timeout = atof (optarg);
+    if (pool_drain_timeout < 0) {
+      pool_drain_timeout = 0;
+    }
+    break;
+  case 2004:
+    latency_trace_rate = atoi (optarg);
+    if (latency_trace_rate < 0) {
+      latency_trace_rate = 0;
+    }
+    break;
   case 2000:
     engine_set_http_fallback (&ct_http_server, &http_methods_stats);
     mtproto_front_functions.flags &= ~ENGINE_NO_PORT;
@@ -2288,31 +3047,24 @@ int f_parse_option (int val) {
   case 'S':
   case 'P':
     {
-      if (strlen (optarg) != 32) {
-        kprintf ("'%c' option requires exactly 32 hex digits\n", val);
+      const char *tag_hex = val == 'S' ? strchr (optarg, ':') : NULL;
+      if ((tag_hex ? tag_hex - optarg : strlen (optarg)) != 32 || (tag_hex && strlen (tag_hex + 1) != 32)) {
+        kprintf ("'%c' option requires exactly 32 hex digits%s\n", val, val == 'S' ? ", optionally followed by ':' and 32 hex digits of proxy tag" : "");
         usage ();
       }
 
-      unsigned char secret[16];
-      int i;
-      unsigned char b = 0;
-      for (i = 0; i < 32; i++) {
-        if (optarg[i] >= '0' && optarg[i] <= '9')  {
-          b = b * 16 + optarg[i] - '0';
-        } else if (optarg[i] >= 'a' && optarg[i] <= 'f') {
-          b = b * 16 + optarg[i] - 'a' + 10;
-        } else if (optarg[i] >= 'A' && optarg[i] <= 'F') {
-          b = b * 16 + optarg[i] - 'A' + 10;
-        } else {
-          kprintf ("'S' option requires exactly 32 hex digits. '%c' is not hexdigit\n", optarg[i]);
+      unsigned char secret[16], tag[16];
+      parse_hex16 (val, optarg, secret);
+      if (val == 'S') {
+        if (secret_count == EXT_SECRET_MAX) {
+          kprintf ("too many mtproto-secrets, at most %d are supported\n", EXT_SECRET_MAX);
           usage ();
         }
-        if (i & 1) {
-          secret[i / 2] = b;
-          b = 0;
+        if (tag_hex) {
+          parse_hex16 (val, tag_hex + 1, tag);
+          memcpy (secret_proxy_tag[secret_count], tag, 16);
+          secret_proxy_tag_set[secret_count] = 1;
         }
-      }
-      if (val == 'S') {
 	tcp_rpcs_set_ext_secret (secret);
 	secret_count++;
       } else {
@@ -2329,7 +3081,7 @@ int f_parse_option (int val) {
 
 void mtfront_prepare_parse_options (void) {
   parse_option ("http-stats", no_argument, 0, 2000, "allow http server to answer on stats queries");
-  parse_option ("mtproto-secret", required_argument, 0, 'S', "16-byte secret in hex mode");
+  parse_option ("mtproto-secret", required_argument, 0, 'S', "16-byte secret in hex mode; <secret>:<tag> also sets 16-byte proxy tag for clients of this secret, overriding --proxy-tag");
   parse_option ("proxy-tag", required_argument, 0, 'P', "16-byte proxy tag in hex mode to be passed along with all forwarded queries");
   parse_option ("domain", required_argument, 0, 'D', "adds allowed domain for TLS-transport mode, disables other transports; can be specified more than once");
   parse_option ("max-special-connections", required_argument, 0, 'C', "sets maximal number of accepted client connections per worker");
@@ -2338,6 +3090,18 @@ void mtfront_prepare_parse_options (void) {
   // parse_option ("outbound-connections-ps", required_argument, 0, 'o', "limits creation rate of outbound connections to mtproto-servers (default %d)", DEFAULT_OUTBOUND_CONNECTION_CREATION_RATE);
   parse_option ("slaves", required_argument, 0, 'M', "spawn several slave workers; not recommended for TLS-transport mode for better replay protection");
   parse_option ("ping-interval", required_argument, 0, 'T', "sets ping interval in second for local TCP connections (default %.3lf)", PING_INTERVAL);
+#ifndef _WIN32
+  parse_option ("socks5-port", required_argument, 0, 2002, "also accept SOCKS5 clients (CONNECT only) on this port and relay them to their targets");
+  parse_option ("socks5-user", required_argument, 0, 2003, "<user>:<password> allowed on socks5-port; can be specified more than once");
+  parse_option ("socks5-no-auth", no_argument, 0, 2009, "run socks5-port without --socks5-user, letting anybody who reaches the port use it");
+  parse_option ("socks5-deny", required_argument, 0, 2005, "<file>\tSOCKS5 targets to refuse, CIDR prefixes one per line");
+  parse_option ("socks5-allow", required_argument, 0, 2006, "<file>\tSOCKS5 targets allowed despite --socks5-deny and the default internal ranges");
+  parse_option ("socks5-allow-only", no_argument, 0, 2007, "SOCKS5 connects only to --socks5-allow targets");
+  parse_option ("socks5-allow-private", no_argument, 0, 2008, "do not refuse SOCKS5 targets in loopback, private, link-local, reserved, multicast, NAT64 and 6to4 ranges");
+#endif
+  parse_option ("drain-timeout", required_argument, 0, 2001, "on binary upgrade (SIGUSR2) old processes close remaining client connections after this many seconds (default %d)", DEFAULT_DRAIN_TIMEOUT);
+  parse_option ("pool-drain-timeout", required_argument, 0, 2010, "close a middle-end connection released by pool autoscaling this many seconds after it started draining, even if clients are still bound to it (default 0 - wait for the last client)");
+  parse_option ("trace-sample", required_argument, 0, 2004, "trace every N-th client request through the proxy stages, per-stage latency histograms are shown in stats (default 0 - off)");
 }
 
 void mtfront_parse_extra_args (int argc, char *argv[]) /* {{{ */ {
@@ -2360,6 +3124,16 @@ void mtfront_pre_init (void) {
   vlog_init("mtproto-proxy", LOG_LEVEL_INFO, true);  // true for JSON format
   
   init_ct_server_mtfront ();
+  latency_trace_init ();
+#ifdef FAULT_INJECTION
+  fault_inject_init ();
+#endif
+
+#ifndef _WIN32
+  if (dns_resolver_init (NULL) < 0) {
+    kprintf ("cannot start DNS resolver, hostnames will be resolved synchronously\n");
+  }
+#endif
 
   int res = do_reload_config (0x26);
 
@@ -2414,7 +3188,14 @@ void mtfront_pre_init (void) {
 
   int i, enable_ipv6 = engine_check_ipv6_enabled () ? SM_IPV6 : 0;
 
+#ifndef _WIN32
+  hot_upgrade_adopt_sockets ();
+#endif
+
   for (i = 0; i < http_ports_num; i++) {
+    if (http_sfd[i]) {
+      continue;
+    }
     http_sfd[i] = server_socket (http_port[i], engine_state->settings_addr, engine_get_backlog (), enable_ipv6);
     if (http_sfd[i] < 0) {
       // Using structured logging for socket error message
@@ -2427,6 +3208,20 @@ void mtfront_pre_init (void) {
       exit (1);
     }
   }
+  if (socks5_port && !socks5_server_users () && !socks5_no_auth) {
+    kprintf ("socks5-port without --socks5-user is an open proxy; add users or pass --socks5-no-auth\n");
+    exit (1);
+  }
+  if (socks5_port && socks5_server_init_acl (socks5_allow_private, socks5_allow_only) < 0) {
+    exit (1);
+  }
+  if (socks5_port && !socks5_sfd) {
+    socks5_sfd = server_socket (socks5_port, engine_state->settings_addr, engine_get_backlog (), enable_ipv6);
+    if (socks5_sfd < 0) {
+      kprintf ("cannot open socks5 server socket at port %d: %m\n", socks5_port);
+      exit (1);
+    }
+  }
 
   if (workers) {
 #ifdef _WIN32
@@ -2442,6 +3237,7 @@ void mtfront_pre_init (void) {
     }
     WStats = mmap (0, 2 * workers * sizeof (struct worker_stats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
     assert (WStats);
+    hot_upgrade_init_shared ();
     // kprintf_multiprocessing_mode_enable ();
     int real_parent_pid = getpid();
     // Using structured logging for worker creation message
@@ -2455,6 +3251,7 @@ void mtfront_pre_init (void) {
       assert (pid >= 0);
       if (!pid) {
         worker_id = i;
+        jobs_set_cpu_partition (i, workers);
         workers = 0;
         slave_mode = 1;
         parent_pid = getppid ();
@@ -2466,6 +3263,10 @@ void mtfront_pre_init (void) {
         pids[i] = pid;
       }
     }
+    if (workers) {
+      // the master only supervises; its threads are left to the scheduler
+      jobs_set_cpu_partition (-1, 0);
+    }
 #endif
   }
 }
@@ -2528,6 +3329,9 @@ int main (int argc, char *argv[]) {
   mtproto_front_functions.allowed_signals |= SIG2INT (SIGCHLD);
   mtproto_front_functions.signal_handlers[SIGCHLD] = on_child_termination;
   mtproto_front_functions.signal_handlers[SIGUSR1] = mtfront_sigusr1_handler;
+  mtproto_front_functions.allowed_signals |= SIG2INT (SIGUSR2);
+  mtproto_front_functions.signal_handlers[SIGUSR2] = mtfront_sigusr2_handler;
+  hot_upgrade_save_argv (argv);
 #endif
   return default_main (&mtproto_front_functions, argc, argv);
 }
@@ -55,7 +55,9 @@
 #else
 #include <sys/uio.h>
 #include <sys/epoll.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <linux/errqueue.h>
 #endif
 
 #include "crc32.h"
@@ -74,6 +76,9 @@
 
 #include "net/net-msg-buffers.h"
 #include "net/net-tcp-connections.h"
+#include "net/net-ip-acl.h"
+#include "net/net-plugins.h"
+#include "net/net-fault-inject.h"
 
 #include "common/common-stats.h"
 
@@ -82,6 +87,15 @@
 #define        USE_EPOLLET        1
 #define        MAX_RECONNECT_INTERVAL        20
 
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#define ZEROCOPY_MAX_PENDING 256        /* per socket; more sends in flight go through writev () */
+#define ZEROCOPY_ORPHAN_TIMEOUT 30.0
+
 #define MODULE connections
 
 static int max_accept_rate;
@@ -90,6 +104,7 @@ static double cur_accept_rate_time;
 static int max_connection;
 static int conn_generation;
 static int max_connection_fd = MAX_CONNECTIONS;
+static int tcp_zerocopy_threshold;
 
 int active_special_connections, max_special_connections = MAX_CONNECTIONS;
 
@@ -101,6 +116,15 @@ static struct {
 
 static struct mp_queue *free_later_queue;
 
+/* IP ACL on accept: built in a background thread, installed by the epoll thread */
+static struct ip_acl *accept_acl;
+static struct ip_acl *accept_acl_pending;
+static int accept_acl_reloading;
+static char *ip_acl_files[2];
+static int ip_acl_whitelist_only;
+static int ip_acl_prefixes, ip_acl_errors, ip_acl_reloads;
+static long long ip_acl_memory_bytes;
+
 
 MODULE_STAT_TYPE {
 int active_connections, active_dh_connections;
@@ -116,13 +140,18 @@ long long netw_queries, netw_update_queries, total_failed_connections, total_con
 int allocated_targets, active_targets, inactive_targets, free_targets;
 int allocated_connections, allocated_socket_connections;
 long long accept_calls_failed, accept_nonblock_set_failed, accept_connection_limit_failed,
-          accept_rate_limit_failed, accept_init_accepted_failed;
+          accept_rate_limit_failed, accept_init_accepted_failed, accept_acl_rejected,
+          accept_plugin_rejected;
 
 long long tcp_readv_calls, tcp_writev_calls, tcp_readv_intr, tcp_writev_intr;
 long long tcp_readv_bytes, tcp_writev_bytes;
+long long tcp_zerocopy_sends, tcp_zerocopy_bytes, tcp_zerocopy_completed, tcp_zerocopy_copied, tcp_zerocopy_orphaned;
 
 int free_later_size;
 long long free_later_total;
+
+long long pool_scale_ups, pool_scale_downs, pool_drained_connections;
+int draining_connections;
 };
 
 MODULE_INIT
@@ -173,6 +202,12 @@ MODULE_STAT_FUNCTION
   SB_SUM_ONE_LL (tcp_writev_calls);
   SB_SUM_ONE_LL (tcp_writev_intr);
   SB_SUM_ONE_LL (tcp_writev_bytes);
+  SB_SUM_ONE_LL (tcp_zerocopy_sends);
+  SB_SUM_ONE_LL (tcp_zerocopy_bytes);
+  SB_SUM_ONE_LL (tcp_zerocopy_completed);
+  SB_SUM_ONE_LL (tcp_zerocopy_copied);
+  SB_SUM_ONE_LL (tcp_zerocopy_orphaned);
+  SBP_PRINT_I32(tcp_zerocopy_threshold);
   SB_SUM_ONE_I (free_later_size);
   SB_SUM_ONE_LL (free_later_total);
 
@@ -181,6 +216,16 @@ MODULE_STAT_FUNCTION
   SB_SUM_ONE_LL (accept_connection_limit_failed);
   SB_SUM_ONE_LL (accept_rate_limit_failed);
   SB_SUM_ONE_LL (accept_init_accepted_failed);
+  SB_SUM_ONE_LL (accept_acl_rejected);
+  SB_SUM_ONE_LL (accept_plugin_rejected);
+  SB_SUM_ONE_LL (pool_scale_ups);
+  SB_SUM_ONE_LL (pool_scale_downs);
+  SB_SUM_ONE_LL (pool_drained_connections);
+  SB_SUM_ONE_I (draining_connections);
+  SBP_PRINT_I32(ip_acl_prefixes);
+  SBP_PRINT_I32(ip_acl_errors);
+  SBP_PRINT_I32(ip_acl_reloads);
+  SBP_PRINT_I64(ip_acl_memory_bytes);
 MODULE_STAT_FUNCTION_END
 
 void fetch_connections_stat (struct connections_stat *st) {
@@ -222,6 +267,123 @@ void tcp_set_max_accept_rate (int rate) {
   max_accept_rate = rate;
 }
 
+/* writes of at least this many bytes go with MSG_ZEROCOPY, 0 - never */
+void tcp_set_zerocopy_threshold (int bytes) {
+  tcp_zerocopy_threshold = bytes > 0 ? bytes : 0;
+}
+
+/* {{{ IP ACL */
+
+void tcp_set_ip_acl_file (const char *filename, unsigned flags) {
+  int i = (flags == IP_ACL_WHITELIST);
+  free (ip_acl_files[i]);
+  ip_acl_files[i] = strdup (filename);
+}
+
+void tcp_set_ip_acl_whitelist_only (int enable) {
+  ip_acl_whitelist_only = enable;
+}
+
+static struct ip_acl *build_ip_acl (void) {
+  struct ip_acl *A = ip_acl_alloc ();
+  assert (A);
+  A->whitelist_only = ip_acl_whitelist_only;
+  int i;
+  for (i = 0; i < 2; i++) {
+    if (ip_acl_files[i] && ip_acl_load_file (A, ip_acl_files[i], i ? IP_ACL_WHITELIST : IP_ACL_BLACKLIST) < 0) {
+      kprintf ("cannot load ip acl file %s: %m\n", ip_acl_files[i]);
+      ip_acl_free (A);
+      return NULL;
+    }
+  }
+  if (ip_acl_compile (A) < 0) {
+    kprintf ("cannot compile ip acl: out of memory\n");
+    ip_acl_free (A);
+    return NULL;
+  }
+  if (A->errors) {
+    kprintf ("ip acl: skipped %d malformed prefixes\n", A->errors);
+  }
+  return A;
+}
+
+static void ip_acl_free_ptr (void *ptr) {
+  ip_acl_free (ptr);
+}
+
+/* runs in the epoll thread, which is the only reader of accept_acl */
+static void install_pending_ip_acl (void) {
+  struct ip_acl *A = __sync_lock_test_and_set (&accept_acl_pending, NULL);
+  if (!A) {
+    return;
+  }
+  struct ip_acl *old = accept_acl;
+  accept_acl = A;
+  ip_acl_prefixes = A->prefixes;
+  ip_acl_errors = A->errors;
+  ip_acl_memory_bytes = ip_acl_memory (A);
+  ip_acl_reloads ++;
+  if (old) {
+    struct free_later *F = malloc (sizeof (*F));
+    assert (F);
+    F->ptr = old;
+    F->free = ip_acl_free_ptr;
+    insert_free_later_struct (F);
+  }
+  vkprintf (1, "ip acl installed: %d prefixes, %lld bytes\n", A->prefixes, ip_acl_memory (A));
+}
+
+static void publish_ip_acl (struct ip_acl *A) {
+  ip_acl_free (__sync_lock_test_and_set (&accept_acl_pending, A));
+}
+
+/* synchronous load at startup; 0 if no acl files are configured */
+int tcp_load_ip_acl (void) {
+  if (!ip_acl_files[0] && !ip_acl_files[1] && !ip_acl_whitelist_only) {
+    return 0;
+  }
+  struct ip_acl *A = build_ip_acl ();
+  if (!A) {
+    return -1;
+  }
+  publish_ip_acl (A);
+  install_pending_ip_acl ();
+  return A->prefixes;
+}
+
+static void *ip_acl_reload_thread (void *arg) {
+  struct ip_acl *A = build_ip_acl ();
+  if (A) {
+    publish_ip_acl (A);
+  } else {
+    kprintf ("ip acl reload failed, keeping previous lists\n");
+  }
+  __sync_lock_release (&accept_acl_reloading);
+  return NULL;
+}
+
+/* SIGHUP: rebuild lists without blocking the epoll thread; lookups keep using the old table until the swap */
+int tcp_reload_ip_acl (void) {
+  if (!ip_acl_files[0] && !ip_acl_files[1]) {
+    return 0;
+  }
+  if (__sync_lock_test_and_set (&accept_acl_reloading, 1)) {
+    return -1;
+  }
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init (&attr);
+  pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+  int r = pthread_create (&thread, &attr, ip_acl_reload_thread, NULL);
+  pthread_attr_destroy (&attr);
+  if (r) {
+    __sync_lock_release (&accept_acl_reloading);
+    return -1;
+  }
+  return 1;
+}
+/* }}} */
+
 int set_write_timer (connection_job_t C);
 
 int prealloc_tcp_buffers (void);
@@ -537,6 +699,10 @@ int cpu_server_close_connection (connection_job_t C, int who) /* {{{ */ {
     __sync_fetch_and_and (&c->flags, ~C_ISDH);
   }
 
+  if (PLUGIN_HOOK_ACTIVE (HOOK_CONNECTION_CLOSE) && c->basic_type == ct_inbound) {
+    plugin_hook_connection (HOOK_CONNECTION_CLOSE, C);
+  }
+
   assert (c->io_conn);
   job_signal (JOB_REF_PASS (c->io_conn), JS_ABORT);
 
@@ -759,8 +925,10 @@ connection_job_t alloc_new_connection (int cfd, conn_target_job_t CTJ, listening
   }
   c->remote_port = peer_port;
   
-  c->in_queue = alloc_mp_queue_w ();
-  c->out_queue = alloc_mp_queue_w ();
+  // in_queue is filled only by the socket reader job and drained by the connection job;
+  // out_queue takes messages from any job, but is also drained only by the connection job
+  c->in_queue = alloc_mp_queue_spsc ();
+  c->out_queue = alloc_mp_queue_mpsc ();
   //c->out_packet_queue = alloc_mp_queue_w ();
 
   // Проверка успешного выделения памяти для очередей
@@ -903,6 +1071,194 @@ void fail_socket_connection (socket_connection_job_t C, int who) /* {{{ */ {
 }
 /* }}} */
 
+/* {{{ MSG_ZEROCOPY
+
+  A send with MSG_ZEROCOPY pins the pages of the iovec instead of copying them,
+  so the sent part of c->out is moved into a zerocopy_send and kept referenced
+  until the kernel reports through the socket error queue that it is done with
+  the range of sends [ee_info, ee_data]. Sends are numbered by the kernel
+  per socket, counting only the sendmsg () calls that returned > 0.
+  If the kernel had to copy anyway (SO_EE_CODE_ZEROCOPY_COPIED, e.g. loopback
+  or a device without scatter-gather), zerocopy is switched off for the socket.
+*/
+
+struct zerocopy_send {
+  struct zerocopy_send *next;
+  unsigned seq;
+  struct raw_message data;
+};
+
+/* sockets freed with sends in flight: kept open by a dup () until completed */
+struct zerocopy_orphan {
+  struct zerocopy_orphan *next;
+  int fd;
+  double deadline;
+  struct zerocopy_queue zc;
+};
+
+static pthread_mutex_t zerocopy_orphans_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct zerocopy_orphan *zerocopy_orphans;
+static job_t zerocopy_orphans_timer;
+
+static int zerocopy_enable (struct socket_connection_info *c) {
+  if (!c->zc_state) {
+    int one = 1;
+    c->zc_state = setsockopt (c->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof (one)) < 0 ? -1 : 1;
+    vkprintf (2, "SO_ZEROCOPY for socket %d: %s\n", c->fd, c->zc_state > 0 ? "on" : "unsupported");
+  }
+  return c->zc_state > 0;
+}
+
+/* moves first bytes of out (just sent) to the queue */
+static void zerocopy_hold (struct zerocopy_queue *Q, struct raw_message *out, int bytes) {
+  struct zerocopy_send *S = malloc (sizeof (*S));
+  assert (S);
+  rwm_split_head (&S->data, out, bytes);
+  S->seq = Q->next_seq ++;
+  S->next = NULL;
+  if (Q->tail) {
+    Q->tail->next = S;
+  } else {
+    Q->head = S;
+  }
+  Q->tail = S;
+  Q->pending ++;
+  MODULE_STAT->tcp_zerocopy_sends ++;
+  MODULE_STAT->tcp_zerocopy_bytes += bytes;
+}
+
+static void zerocopy_release (struct zerocopy_queue *Q, unsigned lo, unsigned hi) {
+  struct zerocopy_send **p = &Q->head, *S;
+  Q->tail = NULL;
+  while ((S = *p) != NULL) {
+    if (S->seq - lo <= hi - lo) {
+      *p = S->next;
+      rwm_free (&S->data);
+      free (S);
+      Q->pending --;
+      MODULE_STAT->tcp_zerocopy_completed ++;
+    } else {
+      Q->tail = S;
+      p = &S->next;
+    }
+  }
+}
+
+static void zerocopy_release_all (struct zerocopy_queue *Q) {
+  while (Q->head) {
+    struct zerocopy_send *S = Q->head;
+    Q->head = S->next;
+    rwm_free (&S->data);
+    free (S);
+  }
+  Q->tail = NULL;
+  Q->pending = 0;
+}
+
+/*
+  reads completion notifications from error queue of fd
+  returns 1 if kernel copied data of some send instead of using user pages
+*/
+static int zerocopy_reap (int fd, struct zerocopy_queue *Q) {
+  int copied = 0;
+  while (Q->head) {
+    char control[CMSG_SPACE (sizeof (struct sock_extended_err) + sizeof (struct sockaddr_in6))];
+    struct msghdr msg;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof (control);
+    if (recvmsg (fd, &msg, MSG_ERRQUEUE) < 0) {
+      break;
+    }
+    struct cmsghdr *cm;
+    for (cm = CMSG_FIRSTHDR (&msg); cm; cm = CMSG_NXTHDR (&msg, cm)) {
+      if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+        continue;
+      }
+      struct sock_extended_err *serr = (struct sock_extended_err *) CMSG_DATA (cm);
+      if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno) {
+        continue;
+      }
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        MODULE_STAT->tcp_zerocopy_copied ++;
+        copied = 1;
+      }
+      zerocopy_release (Q, serr->ee_info, serr->ee_data);
+    }
+  }
+  return copied;
+}
+
+/* main thread timer: finishes orphaned sockets once their sends complete or time runs out;
+   stops (and is freed) when the list is empty, zerocopy_orphan () starts a new one */
+static double zerocopy_orphans_reap (void *extra) {
+  double now = get_utime_monotonic ();
+  struct zerocopy_orphan *done = NULL, **p, *O;
+  int idle;
+
+  pthread_mutex_lock (&zerocopy_orphans_mutex);
+  p = &zerocopy_orphans;
+  while ((O = *p) != NULL) {
+    zerocopy_reap (O->fd, &O->zc);
+    if (!O->zc.head || now > O->deadline) {
+      *p = O->next;
+      O->next = done;
+      done = O;
+    } else {
+      p = &O->next;
+    }
+  }
+  idle = !zerocopy_orphans;
+  if (idle) {
+    zerocopy_orphans_timer = NULL;
+  }
+  pthread_mutex_unlock (&zerocopy_orphans_mutex);
+
+  while (done) {
+    O = done;
+    done = O->next;
+    if (O->zc.head) {
+      vkprintf (1, "zerocopy: %d sends of closed socket not completed in %.0f seconds, freeing\n", O->zc.pending, ZEROCOPY_ORPHAN_TIMEOUT);
+    }
+    zerocopy_release_all (&O->zc);
+    close (O->fd);
+    free (O);
+  }
+  return idle ? -1 : precise_now + 0.1;
+}
+
+/*
+  socket is being freed while kernel may still read its buffers:
+  keep it open by a dup () with FIN sent, as close () would have done,
+  and leave its buffers to zerocopy_orphans_reap ()
+*/
+static void zerocopy_orphan (int fd, struct zerocopy_queue *Q) {
+  int dfd = dup (fd);
+  if (dfd < 0) {
+    zerocopy_release_all (Q);
+    return;
+  }
+  shutdown (dfd, SHUT_WR);
+
+  struct zerocopy_orphan *O = malloc (sizeof (*O));
+  assert (O);
+  O->fd = dfd;
+  O->deadline = get_utime_monotonic () + ZEROCOPY_ORPHAN_TIMEOUT;
+  O->zc = *Q;
+  memset (Q, 0, sizeof (*Q));
+  MODULE_STAT->tcp_zerocopy_orphaned ++;
+
+  pthread_mutex_lock (&zerocopy_orphans_mutex);
+  O->next = zerocopy_orphans;
+  zerocopy_orphans = O;
+  if (!zerocopy_orphans_timer) {
+    zerocopy_orphans_timer = job_timer_alloc (JC_EPOLL, zerocopy_orphans_reap, NULL);
+    job_timer_insert (zerocopy_orphans_timer, precise_now + 0.1);
+  }
+  pthread_mutex_unlock (&zerocopy_orphans_mutex);
+}
+/* }}} */
+
 /*
   Frees socket_connection structure
   Removes link to cpu_connection
@@ -915,6 +1271,14 @@ int net_server_socket_free (socket_connection_job_t C) /* {{{ */ {
   assert (!c->ev);
   assert (c->flags & C_ERROR);
 
+  // c->fd belongs to c->conn and is closed when it is freed, possibly right after the decref below
+  if (c->zc.head) {
+    zerocopy_reap (c->fd, &c->zc);
+  }
+  if (c->zc.head) {
+    zerocopy_orphan (c->fd, &c->zc);
+  }
+
   if (c->conn) {
     fail_connection (c->conn, -201);
     job_decref (JOB_REF_PASS (c->conn));
@@ -959,7 +1323,7 @@ int net_server_socket_reader (socket_connection_job_t C) /* {{{ */ {
     int p = 1;
 
     __sync_fetch_and_or (&c->flags, C_NORD);
-    int r = readv (c->fd, tcp_recv_iovec + p, MAX_TCP_RECV_BUFFERS + 1 - p);
+    int r = fi_readv (c->fd, tcp_recv_iovec + p, MAX_TCP_RECV_BUFFERS + 1 - p);
     MODULE_STAT->tcp_readv_calls ++;
 
     if (r <= 0) {
@@ -967,9 +1331,13 @@ int net_server_socket_reader (socket_connection_job_t C) /* {{{ */ {
       } else if (r < 0 && errno == EINTR) {
         __sync_fetch_and_and (&c->flags, ~C_NORD);
         MODULE_STAT->tcp_readv_intr ++;
+        rwm_free (in);
+        free_raw_message_fast (in);
         continue;
       } else {
         vkprintf (1, "Connection %d: Fatal error %m\n", c->fd);
+        rwm_free (in);
+        free_raw_message_fast (in);
         job_signal (JOB_REF_CREATE_PASS (C), JS_ABORT);
         __sync_fetch_and_or (&c->flags, C_NET_FAILED);
         return 0;
@@ -1071,7 +1439,22 @@ int net_server_socket_writer (socket_connection_job_t C) /* {{{ */{
     assert (iovcnt > 0 && s > 0);
 
     __sync_fetch_and_or (&c->flags, C_NOWR);
-    int r = writev (c->fd, iov, iovcnt);
+    int zerocopy = tcp_zerocopy_threshold && s >= tcp_zerocopy_threshold && c->zc.pending < ZEROCOPY_MAX_PENDING && zerocopy_enable (c);
+    int r;
+    if (zerocopy) {
+      struct msghdr msg;
+      memset (&msg, 0, sizeof (msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = iovcnt;
+      r = sendmsg (c->fd, &msg, MSG_ZEROCOPY);
+      if (r < 0 && errno == ENOBUFS) {
+        // out of optmem for completion notifications
+        zerocopy = 0;
+        r = fi_writev (c->fd, iov, iovcnt);
+      }
+    } else {
+      r = fi_writev (c->fd, iov, iovcnt);
+    }
     MODULE_STAT->tcp_writev_calls ++;
 
     if (r <= 0) {
@@ -1105,7 +1488,11 @@ int net_server_socket_writer (socket_connection_job_t C) /* {{{ */{
     vkprintf (2, "send/writev() to %d: %d written out of %d in %d chunks\n", c->fd, r, s, iovcnt);
 
     if (r > 0) {
-      rwm_skip_data (out, r);
+      if (zerocopy) {
+        zerocopy_hold (&c->zc, out, r);
+      } else {
+        rwm_skip_data (out, r);
+      }
       if (c->type->data_sent) {
         c->type->data_sent (C, r);
       }
@@ -1142,6 +1529,10 @@ int net_server_socket_read_write (socket_connection_job_t C) /* {{{ */ {
   if (c->flags & C_ERROR) {
     return 0;
   }
+
+  if (c->zc.head && zerocopy_reap (c->fd, &c->zc)) {
+    c->zc_state = -1;
+  }
  
   if (!(c->flags & C_CONNECTED)) {
     if (!(c->flags & C_NOWR)) {
@@ -1164,11 +1555,16 @@ int net_server_socket_read_write (socket_connection_job_t C) /* {{{ */ {
   
   struct raw_message *out = &c->out;
 
+  int merged = 0;
   while (1) {
     struct raw_message *raw = mpq_pop_nw (c->out_packet_queue, 4);
     if (!raw) { break; }
     rwm_union (out, raw);
     free (raw);
+    merged ++;
+  }
+  if (merged) {
+    __sync_fetch_and_add (&CONN_INFO(c->conn)->out_packets_queued, -merged);
   }
 
   if (out->total_bytes) {
@@ -1178,6 +1574,7 @@ int net_server_socket_read_write (socket_connection_job_t C) /* {{{ */ {
   while ((c->flags & (C_NOWR | C_ERROR | C_WANTWR | C_NET_FAILED)) == C_WANTWR) {  
     c->type->socket_writer (C);
   }
+  CONN_INFO(c->conn)->out_socket_bytes = out->total_bytes;
 
   return compute_conn_events (C);
 }
@@ -1216,14 +1613,18 @@ int net_server_socket_read_write_gateway (int fd, void *data, event_t *ev) /* {{
     if (ev->epoll_ready & EPOLLERR) {
       int error = 0;
       socklen_t errlen = sizeof (error);
-      if (getsockopt (c->fd, SOL_SOCKET, SO_ERROR, (void *) &error, &errlen) == 0) {
-        vkprintf (1, "got error for tcp socket #%d, [%s]:%d : %s\n", c->fd, show_remote_socket_ip (C), c->remote_port, strerror (error));
-      }
+      int res = getsockopt (c->fd, SOL_SOCKET, SO_ERROR, (void *) &error, &errlen);
+      // with zerocopy sends held it may be just completions in error queue, socket_read_write reaps them
+      if (res < 0 || error || !c->zc.head) {
+        if (res == 0) {
+          vkprintf (1, "got error for tcp socket #%d, [%s]:%d : %s\n", c->fd, show_remote_socket_ip (C), c->remote_port, strerror (error));
+        }
 
-      job_signal (JOB_REF_CREATE_PASS (C), JS_ABORT);
-      return EVA_REMOVE;
+        job_signal (JOB_REF_CREATE_PASS (C), JS_ABORT);
+        return EVA_REMOVE;
+      }
     }
-    if (ev->epoll_ready & (EPOLLHUP | EPOLLERR | EPOLLRDHUP | EPOLLPRI)) {
+    if (ev->epoll_ready & (EPOLLHUP | EPOLLRDHUP | EPOLLPRI)) {
       vkprintf (!(ev->epoll_ready & EPOLLPRI), "socket #%d: disconnected (epoll_ready=%02x), cleaning\n", c->fd, ev->epoll_ready);
 
       job_signal (JOB_REF_CREATE_PASS (C), JS_ABORT);
@@ -1338,16 +1739,24 @@ int net_accept_new_connections (listening_connection_job_t LCJ) /* {{{ */ {
   // Исправление: лимит на количество accept за один вызов для предотвращения блокировки
   #define MAX_ACCEPT_PER_ITERATION 100
 
+  if (accept_acl_pending) {
+    install_pending_ip_acl ();
+  }
+
   while ((Events[LC->fd].state & EVT_IN_EPOLL) && (acc < MAX_ACCEPT_PER_ITERATION)) {
     peer_addrlen = sizeof (peer);
     memset (&peer, 0, sizeof (peer));
-    cfd = accept (LC->fd, (struct sockaddr *) &peer, &peer_addrlen);
+    cfd = fi_accept (LC->fd, (struct sockaddr *) &peer, &peer_addrlen);
 
     vkprintf (2, "%s: cfd = %d\n", __func__, cfd);
     if (cfd < 0) {
       if (errno != EAGAIN) {
         MODULE_STAT->accept_calls_failed ++;
       }
+      if (errno == ECONNABORTED || errno == EINTR) {
+        // the listening socket is edge-triggered: stopping here would leave the rest of the backlog waiting for the next client
+        continue;
+      }
       if (!acc) {
         vkprintf ((errno == EAGAIN) * 2, "accept(%d) unexpectedly returns %d: %m\n", LC->fd, cfd);
       }
@@ -1356,6 +1765,23 @@ int net_accept_new_connections (listening_connection_job_t LCJ) /* {{{ */ {
 
     acc ++;
     MODULE_STAT->inbound_connections_accepted ++;
+
+    if (accept_acl && ip_acl_rejects (accept_acl, peer.a4.sin_family == AF_INET ? ntohl (peer.a4.sin_addr.s_addr) : 0, peer.a6.sin6_addr.s6_addr)) {
+      MODULE_STAT->accept_acl_rejected ++;
+      close (cfd);
+      continue;
+    }
+
+    if (PLUGIN_HOOK_ACTIVE (HOOK_CONNECTION_ACCEPT)) {
+      int r = peer.a4.sin_family == AF_INET ?
+        plugin_hook_accept (cfd, ntohl (peer.a4.sin_addr.s_addr), NULL, ntohs (peer.a4.sin_port)) :
+        plugin_hook_accept (cfd, 0, peer.a6.sin6_addr.s6_addr, ntohs (peer.a6.sin6_port));
+      if (r == PLUGIN_REJECT) {
+        MODULE_STAT->accept_plugin_rejected ++;
+        close (cfd);
+        continue;
+      }
+    }
     
     if (max_accept_rate) {
       cur_accept_rate_remaining += (precise_now - cur_accept_rate_time) * max_accept_rate;
@@ -1405,6 +1831,9 @@ int do_listening_connection_job (job_t job, int op, struct job_thread *JT) /* {{
     net_accept_new_connections (LCJ);
     return 0;
   } else if (op == JS_AUX) {
+    if (LISTEN_CONN_INFO(LCJ)->flags & C_DRAINING) {
+      return 0;
+    }
     vkprintf (2, "**Invoking epoll_insert(%d,%d)\n", LISTEN_CONN_INFO(LCJ)->fd, EVT_RWX);
     epoll_insert (LISTEN_CONN_INFO(LCJ)->fd, EVT_RWX);
     return 0;
@@ -1477,6 +1906,22 @@ int init_listening_connection_ext (int fd, conn_type_t *type, void *extra, int m
   return 0;
 }
 
+/*
+  Binary upgrade: the socket stays open (its accept queue is shared with
+  the new process), this process just stops taking connections from it.
+*/
+int stop_accepting_connections (int fd) /* {{{ */ {
+  assert_main_thread ();
+  if (fd < 0 || fd >= max_connection_fd || !Events[fd].data || Events[fd].work != net_server_socket_read_write_gateway) {
+    return -1;
+  }
+  struct listening_connection_info *LC = LISTEN_CONN_INFO ((listening_connection_job_t) Events[fd].data);
+  LC->flags |= C_DRAINING;
+  epoll_remove (fd);
+  return 0;
+}
+/* }}} */
+
 int init_listening_connection (int fd, conn_type_t *type, void *extra) {
   return init_listening_connection_ext (fd, type, extra, 0, -10);
 }
@@ -1693,6 +2138,9 @@ void compute_next_reconnect (conn_target_job_t CT) /* {{{ */{
 
 static void count_connection_num (connection_job_t C, void *good_c, void *stopped_c, void *bad_c) /* {{{ */ {
   int cr = CONN_INFO(C)->type->check_ready (C); 
+  if (cr == cr_stopped && (CONN_INFO(C)->flags & C_DRAINING)) {
+    return;  // removed from pool on purpose, not to be replaced
+  }
   switch (cr) {
     case cr_notyet:
     case cr_busy:
@@ -1775,6 +2223,182 @@ void destroy_dead_target_connections (conn_target_job_t CTJ) /* {{{ */ {
 }
 /* }}} */
 
+/* {{{ outbound pool autoscaling */
+/*
+  Clients stay on the middle-end connection they were first forwarded to,
+  so one slow stream stalls everybody on it. Once a second the target
+  samples its ready connections: bytes waiting to be encrypted or written,
+  packets queued for the socket and kernel smoothed RTT. A pool under
+  pressure for POOL_GROW_VOTES samples in a row grows by a quarter (at
+  least one connection) up to max_connections; a pool idle for
+  POOL_SHRINK_VOTES samples gives back one connection, down to
+  min_connections. The released connection is the least loaded one; it is
+  marked C_DRAINING, gets no new clients and is closed only when the last
+  client bound to it has gone (pool_bound_clients drops to zero), so sticky
+  sessions are never cut. Engines which do not bind clients keep the
+  counter at zero and get the connection closed on the next sample.
+  pool_drain_timeout > 0 additionally closes a draining connection that
+  many seconds after draining started, even with clients left; it is off
+  by default.
+*/
+
+#define POOL_SAMPLE_INTERVAL 1.0
+#define POOL_GROW_VOTES 3
+#define POOL_SHRINK_VOTES 60
+#define POOL_GROW_BACKLOG (256 << 10)    /* per ready connection */
+#define POOL_SHRINK_BACKLOG (16 << 10)
+#define POOL_GROW_QUEUE 32               /* packets in out_packet_queue of one connection */
+#define POOL_GROW_RTT_FACTOR 3           /* srtt against the lowest seen on this target */
+#define POOL_GROW_RTT_MIN_US 5000
+
+double pool_drain_timeout;  /* seconds, 0 - draining connections wait for their last client */
+
+struct pool_sample {
+  long long backlog;
+  long long rtt_sum;
+  int rtt_cnt;
+  int ready;
+  int max_queue;
+  int draining;
+  connection_job_t idlest;
+  long long idlest_backlog;
+};
+
+static int connection_srtt_us (int fd) {
+#if defined(__linux__) && defined(TCP_INFO)
+  struct tcp_info ti;
+  socklen_t len = sizeof (ti);
+  if (!getsockopt (fd, IPPROTO_TCP, TCP_INFO, &ti, &len) && len >= offsetof (struct tcp_info, tcpi_rttvar)) {
+    return ti.tcpi_rtt;
+  }
+#endif
+  return -1;
+}
+
+static void pool_sample_connection (connection_job_t C, void *x) /* {{{ */ {
+  struct pool_sample *P = x;
+  struct connection_info *c = CONN_INFO (C);
+
+  if (c->flags & C_ERROR) {
+    return;
+  }
+  if (c->flags & C_DRAINING) {
+    if (c->pool_bound_clients <= 0 || (pool_drain_timeout > 0 && precise_now - c->drain_start_time > pool_drain_timeout)) {
+      vkprintf (1, "closing drained outbound connection %d (%d clients left)\n", c->fd, c->pool_bound_clients);
+      MODULE_STAT->pool_drained_connections ++;
+      fail_connection (C, -41);
+    } else {
+      P->draining ++;
+    }
+    return;
+  }
+  if (c->ready != cr_ok) {
+    return;
+  }
+
+  long long backlog = (long long) c->out.total_bytes + c->out_p.total_bytes + c->out_socket_bytes;
+  int queued = c->out_packets_queued;
+  int rtt = connection_srtt_us (c->fd);
+
+  P->ready ++;
+  P->backlog += backlog;
+  if (queued > P->max_queue) {
+    P->max_queue = queued;
+  }
+  if (rtt >= 0) {
+    P->rtt_sum += rtt;
+    P->rtt_cnt ++;
+  }
+  if (!P->idlest || backlog < P->idlest_backlog) {
+    P->idlest = C;
+    P->idlest_backlog = backlog;
+  }
+}
+/* }}} */
+
+/* must be called in main thread; returns number of draining connections */
+static int update_target_pool (conn_target_job_t CTJ) /* {{{ */ {
+  struct conn_target_info *CT = CONN_TARGET_INFO (CTJ);
+
+  if (CT->pool_size < CT->min_connections) {
+    CT->pool_size = CT->min_connections;
+  }
+  if (CT->pool_size > CT->max_connections) {
+    CT->pool_size = CT->max_connections;
+  }
+  if (precise_now < CT->pool_next_sample) {
+    return CT->pool_draining;
+  }
+  CT->pool_next_sample = precise_now + POOL_SAMPLE_INTERVAL;
+
+  struct pool_sample P;
+  memset (&P, 0, sizeof (P));
+  tree_act_ex_connection (CT->conn_tree, pool_sample_connection, &P);
+
+  MODULE_STAT->draining_connections += P.draining - CT->pool_draining;
+  CT->pool_draining = P.draining;
+  CT->pool_backlog_bytes = P.backlog;
+  CT->pool_queue_depth = P.max_queue;
+  if (P.rtt_cnt) {
+    int rtt = P.rtt_sum / P.rtt_cnt;
+    CT->pool_rtt_us = rtt;
+    if (!CT->pool_rtt_base_us || rtt < CT->pool_rtt_base_us) {
+      CT->pool_rtt_base_us = rtt;
+    } else {
+      CT->pool_rtt_base_us += (rtt - CT->pool_rtt_base_us) >> 8;  // follow route changes slowly
+    }
+  }
+
+  if (!P.ready) {
+    CT->pool_grow_votes = CT->pool_shrink_votes = 0;
+    return CT->pool_draining;
+  }
+
+  long long per_conn = P.backlog / P.ready;
+  int rtt_high = P.rtt_cnt && CT->pool_rtt_us > CT->pool_rtt_base_us * POOL_GROW_RTT_FACTOR && CT->pool_rtt_us - CT->pool_rtt_base_us > POOL_GROW_RTT_MIN_US;
+  int rtt_low = !P.rtt_cnt || CT->pool_rtt_us < CT->pool_rtt_base_us * 2 || CT->pool_rtt_us - CT->pool_rtt_base_us < POOL_GROW_RTT_MIN_US;
+
+  if (per_conn > POOL_GROW_BACKLOG || P.max_queue > POOL_GROW_QUEUE || rtt_high) {
+    CT->pool_shrink_votes = 0;
+    CT->pool_grow_votes ++;
+  } else if (per_conn < POOL_SHRINK_BACKLOG && P.max_queue <= 1 && rtt_low) {
+    CT->pool_grow_votes = 0;
+    CT->pool_shrink_votes ++;
+  } else {
+    CT->pool_grow_votes = CT->pool_shrink_votes = 0;
+  }
+
+  if (CT->pool_grow_votes >= POOL_GROW_VOTES && CT->pool_size < CT->max_connections) {
+    int add = CT->pool_size >> 2;
+    CT->pool_size += add > 1 ? add : 1;
+    if (CT->pool_size > CT->max_connections) {
+      CT->pool_size = CT->max_connections;
+    }
+    CT->pool_grow_votes = 0;
+    CT->pool_scale_ups ++;
+    MODULE_STAT->pool_scale_ups ++;
+    vkprintf (1, "outbound pool to port %d grows to %d (backlog %lld per connection, queue %d, rtt %d/%d us)\n", CT->port, CT->pool_size, per_conn, P.max_queue, CT->pool_rtt_us, CT->pool_rtt_base_us);
+  } else if (CT->pool_shrink_votes >= POOL_SHRINK_VOTES && CT->pool_size > CT->min_connections) {
+    CT->pool_size --;
+    CT->pool_shrink_votes = 0;
+    CT->pool_scale_downs ++;
+    MODULE_STAT->pool_scale_downs ++;
+    vkprintf (1, "outbound pool to port %d shrinks to %d\n", CT->port, CT->pool_size);
+  }
+
+  if (P.ready > CT->pool_size && P.idlest) {
+    struct connection_info *c = CONN_INFO (P.idlest);
+    c->drain_start_time = precise_now;
+    __sync_fetch_and_or (&c->flags, C_DRAINING);
+    CT->pool_draining ++;
+    MODULE_STAT->draining_connections ++;
+  }
+
+  return CT->pool_draining;
+}
+/* }}} */
+/* }}} */
+
 /*
   creates new connections for target 
   must be called in main thread, because we can allocate new connections only in main thread
@@ -1803,10 +2427,13 @@ int create_new_connections (conn_target_job_t CTJ) /* {{{ */ {
     MODULE_STAT->ready_targets ++;
   }
 
-  need_c = CT->min_connections + bad_c + ((stopped_c + 1) >> 1);
+  int draining_c = update_target_pool (CTJ);
+
+  need_c = CT->pool_size + bad_c + ((stopped_c + 1) >> 1);
   if (need_c > CT->max_connections) {
     need_c = CT->max_connections;
   }
+  need_c += draining_c;
 
   if (precise_now >= CT->next_reconnect || CT->active_outbound_connections) {
     struct tree_connection *T = CT->conn_tree;  
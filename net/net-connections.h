@@ -85,6 +85,7 @@
 #define C_CONNECTED	0x2000000
 #define C_STOPWRITE	0x4000000
 #define C_IS_TLS	0x8000000
+#define C_DRAINING	0x10000000	/* outbound pool shrinks: no new clients, closed once idle */
 
 #define C_PERMANENT (C_IPV6 | C_RAWMSG)
 /* for connection status */
@@ -194,6 +195,20 @@ struct conn_target_info {
   conn_target_job_t hnext;
 
   int global_refcnt;
+
+  /* pool autoscaling between min_connections and max_connections, see create_new_connections () */
+  int pool_size;
+  int pool_grow_votes, pool_shrink_votes;
+  int pool_draining;
+  int pool_queue_depth;
+  int pool_rtt_us, pool_rtt_base_us;
+  int pool_scale_ups, pool_scale_downs;
+  long long pool_backlog_bytes;
+  double pool_next_sample;
+
+  /* latency-aware balancing: EWMA over all connections and their unanswered queries */
+  int lb_rtt_us;
+  int lb_outstanding;
 };
 
 struct pseudo_conn_target_info {
@@ -259,11 +274,28 @@ struct connection_info {
   struct mp_queue *in_queue;
   struct mp_queue *out_queue;
 
+  int out_packets_queued;  /* in out_packet_queue of io_conn, not yet merged by socket */
+  int out_socket_bytes;    /* left in io_conn->out after last socket write */
+  double drain_start_time;
+  int pool_bound_clients;  /* clients still bound to this outbound connection, kept by the engine (mtproto: ext_connections) */
+
+  /* latency-aware balancing, see rpc_target_choose_p2c_connection () */
+  int lb_rtt_us;           /* EWMA of answer and pong delay, 0 - no samples yet */
+  int lb_outstanding;      /* queries forwarded and not answered yet */
+  double lb_ping_time;     /* last RPC_PING sent, its ping_id is this time in microseconds */
+
   //netbuffer_t *Tmp, In, Out;
   //char in_buff[BUFF_SIZE];
   //char out_buff[BUFF_SIZE];
 };
 
+/* sends made with MSG_ZEROCOPY whose buffers the kernel may still read */
+struct zerocopy_queue {
+  struct zerocopy_send *head, *tail;
+  unsigned next_seq;       /* kernel numbers zerocopy sends on a socket from 0 */
+  int pending;
+};
+
 struct socket_connection_info {
   struct event_timer timer;
   int fd;
@@ -280,6 +312,8 @@ struct socket_connection_info {
   unsigned char our_ipv6[16], remote_ipv6[16];
   int write_low_watermark;
   int eagain_count;
+  int zc_state;            /* SO_ZEROCOPY: 0 - not tried yet, 1 - on, -1 - unsupported or kernel copies anyway */
+  struct zerocopy_queue zc;
 };
 
 struct listening_connection_info {
@@ -421,6 +455,7 @@ void delete_connection_tree_ptr (struct tree_connection *T);
 int init_listening_connection_ext (int fd, conn_type_t *type, void *extra, int mode, int prio);
 int init_listening_connection (int fd, conn_type_t *type, void *extra);
 int init_listening_tcpv6_connection (int fd, conn_type_t *type, void *extra, int mode);
+int stop_accepting_connections (int fd);
 
 //struct tree_connection *get_connection_tree_ptr (struct tree_connection **);
 //void free_connection_tree_ptr (struct tree_connection *);
@@ -450,9 +485,15 @@ int new_conn_generation (void);
 int get_cur_conn_generation (void);
 
 void tcp_set_max_accept_rate (int rate);
+void tcp_set_zerocopy_threshold (int bytes);
+void tcp_set_ip_acl_file (const char *filename, unsigned flags);
+void tcp_set_ip_acl_whitelist_only (int enable);
+int tcp_load_ip_acl (void);
+int tcp_reload_ip_acl (void);
 void tcp_set_max_connections (int maxconn);
 
 extern int max_special_connections, active_special_connections;
+extern double pool_drain_timeout;
 
 #define MAX_NAT_INFO_RULES	16
 extern int nat_info_rules;
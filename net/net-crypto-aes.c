@@ -93,6 +93,11 @@ int aes_crypto_init (connection_job_t c, void *key_data, int key_data_len) {
   
   T->read_aeskey = evp_cipher_ctx_init (EVP_aes_256_cbc(), D->read_key, D->read_iv, 0);
   T->write_aeskey = evp_cipher_ctx_init (EVP_aes_256_cbc(), D->write_key, D->write_iv, 1);
+  T->write_mbkey = NULL;
+  if (aes_cbc_mb_available ()) {
+    assert (!posix_memalign ((void **)&T->write_mbkey, 16, sizeof (struct aes_cbc_mb_key)));
+    aes_cbc_mb_set_encrypt_key (T->write_mbkey, D->write_key);
+  }
   CONN_INFO(c)->crypto = T;
   return 0;
 }
@@ -108,6 +113,7 @@ int aes_crypto_ctr128_init (connection_job_t c, void *key_data, int key_data_len
   
   T->read_aeskey = evp_cipher_ctx_init (EVP_aes_256_ctr(), D->read_key, D->read_iv, 1); // NB: is_encrypt == 1 here!
   T->write_aeskey = evp_cipher_ctx_init (EVP_aes_256_ctr(), D->write_key, D->write_iv, 1);
+  T->write_mbkey = NULL;
   CONN_INFO(c)->crypto = T;
   return 0;
 }
@@ -117,6 +123,7 @@ int aes_crypto_free (connection_job_t c) {
   if (crypto) {
     EVP_CIPHER_CTX_free (crypto->read_aeskey);
     EVP_CIPHER_CTX_free (crypto->write_aeskey);
+    free (crypto->write_mbkey);
 
     free (crypto);
     CONN_INFO(c)->crypto = 0;
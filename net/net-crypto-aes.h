@@ -34,6 +34,7 @@
 
 #include "net/net-connections.h"
 #include "crypto/aesni256.h"
+#include "crypto/aes-cbc-mb.h"
 #include "pid.h"
 
 #define	MIN_PWD_LEN 32
@@ -75,6 +76,7 @@ struct aes_key_data {
 struct aes_crypto {
   EVP_CIPHER_CTX *read_aeskey;
   EVP_CIPHER_CTX *write_aeskey;
+  struct aes_cbc_mb_key *write_mbkey;  /* CBC with AES-NI only: same key for batched encryption, IV stays in write_aeskey */
 };
 
 extern int aes_initialized;
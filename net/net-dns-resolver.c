@@ -0,0 +1,1015 @@
+/*
+ * net-dns-resolver.c - Неблокирующий DNS-резолвер с шардированным TTL-кэшем
+ */
+
+#define _GNU_SOURCE 1
+#include <arpa/inet.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "jobs/jobs.h"
+#include "net/net-events.h"
+#include "kprintf.h"
+#include "precise-time.h"
+#include "resolver.h"
+#include "net/net-dns-resolver.h"
+
+#define RESOLV_CONF "/etc/resolv.conf"
+#define DNS_DEFAULT_TIMEOUT 2.0
+#define DNS_DEFAULT_ATTEMPTS 2
+
+#define DNS_HEADER_SIZE 12
+#define DNS_MAX_PACKET 4096
+#define DNS_QUERY_HASH 1024
+
+#define DNS_T_A 1
+#define DNS_T_SOA 6
+#define DNS_T_AAAA 28
+#define DNS_C_IN 1
+
+#define DNS_F_QR 0x8000
+#define DNS_F_TC 0x0200
+#define DNS_F_RD 0x0100
+#define DNS_RCODE_NXDOMAIN 3
+
+/* ============================================
+ * Кэш
+ * ============================================ */
+
+struct dns_cache_entry {
+  struct dns_cache_entry *next;
+  unsigned hash;
+  double expires;
+  struct dns_result R;
+  char name[DNS_MAX_NAME + 1];
+};
+
+struct dns_cache_shard {
+  pthread_mutex_t lock;
+  int entries;
+  double next_purge;
+  struct dns_cache_entry *buckets[DNS_CACHE_SHARD_BUCKETS];
+} __attribute__ ((aligned (64)));
+
+static struct dns_cache_shard Shards[DNS_CACHE_SHARDS] = {
+  [0 ... DNS_CACHE_SHARDS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+
+static long long cache_hits, cache_negative_hits, cache_misses, cache_evictions;
+
+double dns_resolver_now (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* нижний регистр без точки в конце; возвращает длину или -1 */
+static int dns_normalize (const char *name, char *out) {
+  int len = strlen (name);
+  if (len > 0 && name[len - 1] == '.') {
+    len--;
+  }
+  if (len <= 0 || len > DNS_MAX_NAME) {
+    return -1;
+  }
+  int i;
+  for (i = 0; i < len; i++) {
+    out[i] = tolower ((unsigned char) name[i]);
+  }
+  out[len] = 0;
+  return len;
+}
+
+static unsigned dns_hash (const char *key, int family) {
+  unsigned h = 2166136261u ^ family;
+  while (*key) {
+    h = (h ^ (unsigned char) *key++) * 16777619u;
+  }
+  return h ^ (h >> 15);
+}
+
+static inline struct dns_cache_shard *dns_shard (unsigned hash) {
+  return &Shards[(hash >> 24) % DNS_CACHE_SHARDS];
+}
+
+/* адрес, записанный цифрами, отвечается сразу и в кэш не попадает */
+static int dns_literal (const char *key, int family, struct dns_result *R) {
+  if (inet_pton (family, key, &R->addrs[0]) <= 0) {
+    return 0;
+  }
+  R->status = DNS_OK;
+  R->family = family;
+  R->ttl = DNS_MAX_TTL;
+  R->naddrs = 1;
+  return 1;
+}
+
+static int cache_lookup_key (const char *key, int family, struct dns_result *R) {
+  unsigned h = dns_hash (key, family);
+  struct dns_cache_shard *S = dns_shard (h);
+  double now = dns_resolver_now ();
+  int found = 0;
+
+  pthread_mutex_lock (&S->lock);
+  struct dns_cache_entry **p = &S->buckets[h % DNS_CACHE_SHARD_BUCKETS], *E;
+  while ((E = *p) != NULL) {
+    if (E->hash == h && E->R.family == family && !strcmp (E->name, key)) {
+      if (E->expires <= now) {
+        *p = E->next;
+        S->entries--;
+        free (E);
+      } else {
+        *R = E->R;
+        R->ttl = (int) (E->expires - now);
+        found = 1;
+      }
+      break;
+    }
+    p = &E->next;
+  }
+  pthread_mutex_unlock (&S->lock);
+  return found;
+}
+
+static void dns_count_lookup (int found, const struct dns_result *R) {
+  if (!found) {
+    __sync_fetch_and_add (&cache_misses, 1);
+  } else if (R->status == DNS_OK) {
+    __sync_fetch_and_add (&cache_hits, 1);
+  } else {
+    __sync_fetch_and_add (&cache_negative_hits, 1);
+  }
+}
+
+int dns_cache_lookup (const char *name, int family, struct dns_result *R) {
+  char key[DNS_MAX_NAME + 1];
+  if (dns_normalize (name, key) < 0) {
+    return 0;
+  }
+  int found = cache_lookup_key (key, family, R);
+  dns_count_lookup (found, R);
+  return found;
+}
+
+/* места нет: сначала истёкшие записи всего шарда (не чаще раза в секунду), потом самая короткоживущая в ближайшей цепочке */
+static void dns_shard_evict (struct dns_cache_shard *S, int bucket, double now) {
+  int i;
+  if (now >= S->next_purge) {
+    S->next_purge = now + 1;
+    for (i = 0; i < DNS_CACHE_SHARD_BUCKETS; i++) {
+      struct dns_cache_entry **p = &S->buckets[i], *E;
+      while ((E = *p) != NULL) {
+        if (E->expires <= now) {
+          *p = E->next;
+          S->entries--;
+          free (E);
+        } else {
+          p = &E->next;
+        }
+      }
+    }
+    if (S->entries < DNS_CACHE_SHARD_MAX) {
+      return;
+    }
+  }
+  for (i = 0; i < DNS_CACHE_SHARD_BUCKETS; i++) {
+    struct dns_cache_entry **p = &S->buckets[(bucket + i) % DNS_CACHE_SHARD_BUCKETS], **victim = p;
+    if (!*p) {
+      continue;
+    }
+    for (; *p; p = &(*p)->next) {
+      if ((*p)->expires < (*victim)->expires) {
+        victim = p;
+      }
+    }
+    struct dns_cache_entry *E = *victim;
+    *victim = E->next;
+    S->entries--;
+    free (E);
+    __sync_fetch_and_add (&cache_evictions, 1);
+    return;
+  }
+}
+
+void dns_cache_store (const char *name, int family, const struct dns_result *R) {
+  char key[DNS_MAX_NAME + 1];
+  if ((R->status != DNS_OK && R->status != DNS_NOT_FOUND) || R->ttl <= 0 || dns_normalize (name, key) < 0) {
+    return;
+  }
+  unsigned h = dns_hash (key, family);
+  struct dns_cache_shard *S = dns_shard (h);
+  int bucket = h % DNS_CACHE_SHARD_BUCKETS;
+  double now = dns_resolver_now ();
+
+  pthread_mutex_lock (&S->lock);
+  struct dns_cache_entry *E;
+  for (E = S->buckets[bucket]; E; E = E->next) {
+    if (E->hash == h && E->R.family == family && !strcmp (E->name, key)) {
+      break;
+    }
+  }
+  if (!E) {
+    if (S->entries >= DNS_CACHE_SHARD_MAX) {
+      dns_shard_evict (S, bucket, now);
+    }
+    E = malloc (sizeof (*E));
+    assert (E);
+    E->hash = h;
+    strcpy (E->name, key);
+    E->next = S->buckets[bucket];
+    S->buckets[bucket] = E;
+    S->entries++;
+  }
+  E->R = *R;
+  E->R.family = family;
+  E->expires = now + R->ttl;
+  pthread_mutex_unlock (&S->lock);
+}
+
+void dns_cache_clear (void) {
+  int i, j;
+  for (i = 0; i < DNS_CACHE_SHARDS; i++) {
+    struct dns_cache_shard *S = &Shards[i];
+    pthread_mutex_lock (&S->lock);
+    for (j = 0; j < DNS_CACHE_SHARD_BUCKETS; j++) {
+      while (S->buckets[j]) {
+        struct dns_cache_entry *E = S->buckets[j];
+        S->buckets[j] = E->next;
+        free (E);
+      }
+    }
+    S->entries = 0;
+    pthread_mutex_unlock (&S->lock);
+  }
+}
+
+/* ============================================
+ * Запросы
+ * ============================================ */
+
+struct dns_waiter {
+  struct dns_waiter *next;
+  dns_callback_t cb;
+  void *extra;
+};
+
+struct dns_query {
+  struct dns_query *id_next;           /* цепочка QueryById */
+  struct dns_query *name_next;         /* цепочка QueryByName */
+  struct dns_query *prev, *next;       /* очередь сроков */
+  struct dns_waiter *waiters;
+  unsigned hash;
+  unsigned short id;
+  int family;
+  int tries;
+  int server;
+  double deadline;
+  int qlen;
+  unsigned char packet[DNS_HEADER_SIZE + DNS_MAX_NAME + 2 + 4];
+  char name[DNS_MAX_NAME + 1];
+};
+
+static int dns_fd = -1;
+static struct dns_resolver_conf Conf;
+static unsigned long long dns_rnd;
+
+static struct dns_query *QueryById[DNS_QUERY_HASH], *QueryByName[DNS_QUERY_HASH];
+/* таймаут у всех попыток один, поэтому очередь упорядочена по сроку */
+static struct dns_query *QueueFirst, *QueueLast;
+static int pending_queries;
+
+static long long queries_sent, query_retries, query_timeouts, answers_received, bad_answers;
+
+static int dns_engine_active;
+static job_t dns_timer;
+
+static void dns_timer_arm (double deadline);
+
+int dns_load_resolv_conf (const char *path, struct dns_resolver_conf *C) {
+  char line[512];
+  memset (C, 0, sizeof (*C));
+  C->timeout = DNS_DEFAULT_TIMEOUT;
+  C->attempts = DNS_DEFAULT_ATTEMPTS;
+
+  FILE *f = fopen (path, "r");
+  if (f) {
+    while (fgets (line, sizeof (line), f)) {
+      char *p = line, *word;
+      while ((word = strsep (&p, " \t\r\n")) != NULL && !*word) {
+      }
+      if (!word || !p) {
+        continue;
+      }
+      if (!strcmp (word, "nameserver")) {
+        while ((word = strsep (&p, " \t\r\n")) != NULL && !*word) {
+        }
+        struct in_addr addr;
+        /* IPv6-серверы пропускаются: сокет резолвера IPv4 */
+        if (word && C->nservers < DNS_MAX_SERVERS && inet_pton (AF_INET, word, &addr) > 0) {
+          struct sockaddr_in *S = &C->servers[C->nservers++];
+          S->sin_family = AF_INET;
+          S->sin_port = htons (53);
+          S->sin_addr = addr;
+        }
+      } else if (!strcmp (word, "options")) {
+        while ((word = strsep (&p, " \t\r\n")) != NULL) {
+          if (!strncmp (word, "timeout:", 8) && atoi (word + 8) > 0) {
+            C->timeout = atoi (word + 8);
+          } else if (!strncmp (word, "attempts:", 9) && atoi (word + 9) > 0) {
+            C->attempts = atoi (word + 9);
+          }
+        }
+      }
+    }
+    fclose (f);
+  }
+  /* как в glibc: без nameserver спрашиваем локальный */
+  if (!C->nservers) {
+    C->servers[0].sin_family = AF_INET;
+    C->servers[0].sin_port = htons (53);
+    C->servers[0].sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    C->nservers = 1;
+  }
+  return C->nservers;
+}
+
+static struct hostent *dns_hostent_lookup (const char *name, int *answered);
+
+static int dns_open_socket (void) {
+  int fd = socket (AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    kprintf ("dns: cannot create socket: %m\n");
+  }
+  return fd;
+}
+
+int dns_resolver_init (const struct dns_resolver_conf *C) {
+  struct dns_resolver_conf tmp;
+  if (!C) {
+    dns_load_resolv_conf (RESOLV_CONF, &tmp);
+    C = &tmp;
+  }
+  if (C->nservers <= 0) {
+    return -1;
+  }
+  Conf = *C;
+  if (Conf.nservers > DNS_MAX_SERVERS) {
+    Conf.nservers = DNS_MAX_SERVERS;
+  }
+  if (Conf.timeout <= 0) {
+    Conf.timeout = DNS_DEFAULT_TIMEOUT;
+  }
+  if (Conf.attempts <= 0) {
+    Conf.attempts = DNS_DEFAULT_ATTEMPTS;
+  }
+
+  if (dns_fd < 0) {
+    dns_fd = dns_open_socket ();
+    if (dns_fd < 0) {
+      return -1;
+    }
+  }
+  if (!dns_rnd) {
+    int fd = open ("/dev/urandom", O_RDONLY);
+    if (fd < 0 || read (fd, &dns_rnd, sizeof (dns_rnd)) != sizeof (dns_rnd)) {
+      dns_rnd = (unsigned long long) time (NULL) * 0x9e3779b97f4a7c15ULL ^ getpid ();
+    }
+    if (fd >= 0) {
+      close (fd);
+    }
+    dns_rnd |= 1;
+  }
+  kdb_gethostbyname_hook = dns_hostent_lookup;
+  return dns_fd;
+}
+
+static unsigned short dns_next_id (void) {
+  while (1) {
+    dns_rnd ^= dns_rnd >> 12;
+    dns_rnd ^= dns_rnd << 25;
+    dns_rnd ^= dns_rnd >> 27;
+    unsigned short id = (dns_rnd * 0x2545f4914f6cdd1dULL) >> 48;
+    struct dns_query *Q;
+    for (Q = QueryById[id % DNS_QUERY_HASH]; Q && Q->id != id; Q = Q->id_next) {
+    }
+    if (!Q) {
+      return id;
+    }
+  }
+}
+
+static int dns_build_query (struct dns_query *Q) {
+  unsigned char *p = Q->packet;
+  memset (p, 0, DNS_HEADER_SIZE);
+  p[0] = Q->id >> 8;
+  p[1] = Q->id;
+  p[2] = DNS_F_RD >> 8;
+  p[5] = 1;
+
+  int pos = DNS_HEADER_SIZE;
+  const char *s = Q->name;
+  while (*s) {
+    const char *dot = strchr (s, '.');
+    int l = dot ? dot - s : strlen (s);
+    if (l <= 0 || l > 63) {
+      return -1;
+    }
+    p[pos++] = l;
+    memcpy (p + pos, s, l);
+    pos += l;
+    s += l + (dot != NULL);
+  }
+  p[pos++] = 0;
+  int type = Q->family == AF_INET6 ? DNS_T_AAAA : DNS_T_A;
+  p[pos++] = type >> 8;
+  p[pos++] = type;
+  p[pos++] = 0;
+  p[pos++] = DNS_C_IN;
+  assert (pos <= sizeof (Q->packet));
+  return Q->qlen = pos;
+}
+
+static void dns_queue_remove (struct dns_query *Q) {
+  if (Q->prev) {
+    Q->prev->next = Q->next;
+  } else {
+    QueueFirst = Q->next;
+  }
+  if (Q->next) {
+    Q->next->prev = Q->prev;
+  } else {
+    QueueLast = Q->prev;
+  }
+  Q->prev = Q->next = NULL;
+}
+
+static void dns_queue_append (struct dns_query *Q) {
+  Q->prev = QueueLast;
+  Q->next = NULL;
+  if (QueueLast) {
+    QueueLast->next = Q;
+  } else {
+    QueueFirst = Q;
+  }
+  QueueLast = Q;
+}
+
+static void dns_query_send (struct dns_query *Q) {
+  const struct sockaddr_in *S = &Conf.servers[Q->server % Conf.nservers];
+  /* ошибка отправки - та же потерянная попытка, её добьёт таймаут */
+  if (sendto (dns_fd, Q->packet, Q->qlen, MSG_NOSIGNAL, (const struct sockaddr *) S, sizeof (*S)) != Q->qlen) {
+    vkprintf (1, "dns: sendto for %s failed: %m\n", Q->name);
+  }
+  Q->tries++;
+  queries_sent++;
+  Q->deadline = dns_resolver_now () + Conf.timeout;
+  if (Q->prev || Q->next || QueueFirst == Q) {
+    dns_queue_remove (Q);
+  }
+  dns_queue_append (Q);
+  if (QueueFirst == Q) {
+    dns_timer_arm (Q->deadline);
+  }
+}
+
+static void dns_query_complete (struct dns_query *Q, const struct dns_result *R) {
+  struct dns_query **p;
+  for (p = &QueryById[Q->id % DNS_QUERY_HASH]; *p != Q; p = &(*p)->id_next) {
+  }
+  *p = Q->id_next;
+  for (p = &QueryByName[Q->hash % DNS_QUERY_HASH]; *p != Q; p = &(*p)->name_next) {
+  }
+  *p = Q->name_next;
+  dns_queue_remove (Q);
+  pending_queries--;
+
+  /* колбэки могут начать новые запросы: Q уже нигде не виден */
+  struct dns_waiter *W = Q->waiters;
+  while (W) {
+    struct dns_waiter *next = W->next;
+    if (W->cb) {
+      W->cb (W->extra, R);
+    }
+    free (W);
+    W = next;
+  }
+  free (Q);
+}
+
+static void dns_query_fail (struct dns_query *Q, int status) {
+  struct dns_result R;
+  memset (&R, 0, sizeof (R));
+  R.status = status;
+  R.family = Q->family;
+  dns_query_complete (Q, &R);
+}
+
+/* следующий сервер или конец, если круги кончились */
+static void dns_query_next_try (struct dns_query *Q, int status) {
+  if (Q->tries >= Conf.attempts * Conf.nservers) {
+    if (status == DNS_TIMEOUT) {
+      query_timeouts++;
+    }
+    dns_query_fail (Q, status);
+    return;
+  }
+  Q->server++;
+  query_retries++;
+  dns_query_send (Q);
+}
+
+int dns_resolver_query (const char *name, int family, dns_callback_t cb, void *extra) {
+  char key[DNS_MAX_NAME + 1];
+  struct dns_result R;
+  if ((family != AF_INET && family != AF_INET6) || dns_normalize (name, key) < 0) {
+    return -1;
+  }
+  if (dns_literal (key, family, &R)) {
+    if (cb) {
+      cb (extra, &R);
+    }
+    return 1;
+  }
+  int found = cache_lookup_key (key, family, &R);
+  dns_count_lookup (found, &R);
+  if (found) {
+    if (cb) {
+      cb (extra, &R);
+    }
+    return 1;
+  }
+  if (dns_fd < 0) {
+    return -1;
+  }
+
+  unsigned h = dns_hash (key, family);
+  struct dns_query *Q;
+  for (Q = QueryByName[h % DNS_QUERY_HASH]; Q; Q = Q->name_next) {
+    if (Q->hash == h && Q->family == family && !strcmp (Q->name, key)) {
+      break;
+    }
+  }
+  if (!Q) {
+    if (pending_queries >= DNS_MAX_PENDING) {
+      return -1;
+    }
+    Q = calloc (1, sizeof (*Q));
+    assert (Q);
+    strcpy (Q->name, key);
+    Q->hash = h;
+    Q->family = family;
+    Q->id = dns_next_id ();
+    if (dns_build_query (Q) < 0) {
+      free (Q);
+      return -1;
+    }
+    Q->id_next = QueryById[Q->id % DNS_QUERY_HASH];
+    QueryById[Q->id % DNS_QUERY_HASH] = Q;
+    Q->name_next = QueryByName[h % DNS_QUERY_HASH];
+    QueryByName[h % DNS_QUERY_HASH] = Q;
+    pending_queries++;
+    dns_query_send (Q);
+  }
+
+  struct dns_waiter *W = malloc (sizeof (*W));
+  assert (W);
+  W->cb = cb;
+  W->extra = extra;
+  W->next = Q->waiters;
+  Q->waiters = W;
+  return 0;
+}
+
+/* ============================================
+ * Разбор ответа
+ * ============================================ */
+
+static inline int get16 (const unsigned char *p) {
+  return (p[0] << 8) | p[1];
+}
+
+static inline unsigned get32 (const unsigned char *p) {
+  return ((unsigned) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* имя со сжатием в нижнем регистре; возвращает смещение за именем или -1 */
+static int dns_read_name (const unsigned char *pkt, int len, int pos, char *out) {
+  int end = -1, jumps = 0, olen = 0;
+  while (1) {
+    if (pos >= len) {
+      return -1;
+    }
+    int l = pkt[pos];
+    if ((l & 0xc0) == 0xc0) {
+      if (pos + 1 >= len || ++jumps > 16) {
+        return -1;
+      }
+      if (end < 0) {
+        end = pos + 2;
+      }
+      pos = ((l & 0x3f) << 8) | pkt[pos + 1];
+      continue;
+    }
+    if (l & 0xc0) {
+      return -1;
+    }
+    pos++;
+    if (!l) {
+      break;
+    }
+    if (pos + l > len || olen + (olen > 0) + l > DNS_MAX_NAME) {
+      return -1;
+    }
+    if (olen) {
+      out[olen++] = '.';
+    }
+    int i;
+    for (i = 0; i < l; i++) {
+      out[olen++] = tolower (pkt[pos + i]);
+    }
+    pos += l;
+  }
+  out[olen] = 0;
+  return end < 0 ? pos : end;
+}
+
+/* заголовок записи: смещение данных, *type, *ttl, *rdlen; -1 - пакет обрезан */
+static int dns_read_rr (const unsigned char *pkt, int len, int pos, int *type, unsigned *ttl, int *rdlen, int *rclass) {
+  char name[DNS_MAX_NAME + 1];
+  pos = dns_read_name (pkt, len, pos, name);
+  if (pos < 0 || pos + 10 > len) {
+    return -1;
+  }
+  *type = get16 (pkt + pos);
+  *rclass = get16 (pkt + pos + 2);
+  *ttl = get32 (pkt + pos + 4);
+  *rdlen = get16 (pkt + pos + 8);
+  pos += 10;
+  if (pos + *rdlen > len) {
+    return -1;
+  }
+  return pos;
+}
+
+/*
+ * 1 - окончательный ответ в R, 0 - сервер не смог ответить (стоит спросить
+ * другой), -1 - ответ не на этот запрос
+ */
+static int dns_parse_answer (const unsigned char *pkt, int len, struct dns_query *Q, struct dns_result *R) {
+  char name[DNS_MAX_NAME + 1];
+  int flags = get16 (pkt + 2);
+  int qdcount = get16 (pkt + 4), ancount = get16 (pkt + 6), nscount = get16 (pkt + 8);
+  int want = Q->family == AF_INET6 ? DNS_T_AAAA : DNS_T_A;
+  int addr_len = Q->family == AF_INET6 ? 16 : 4;
+
+  if (!(flags & DNS_F_QR) || qdcount != 1) {
+    return -1;
+  }
+  int pos = dns_read_name (pkt, len, DNS_HEADER_SIZE, name);
+  if (pos < 0 || pos + 4 > len || strcmp (name, Q->name) || get16 (pkt + pos) != want || get16 (pkt + pos + 2) != DNS_C_IN) {
+    return -1;
+  }
+  pos += 4;
+
+  memset (R, 0, sizeof (*R));
+  R->family = Q->family;
+  int rcode = flags & 15;
+  if (rcode && rcode != DNS_RCODE_NXDOMAIN) {
+    return 0;
+  }
+
+  unsigned min_ttl = DNS_MAX_TTL;
+  int i, type, rdlen, rclass;
+  unsigned ttl;
+  for (i = 0; i < ancount; i++) {
+    pos = dns_read_rr (pkt, len, pos, &type, &ttl, &rdlen, &rclass);
+    if (pos < 0) {
+      return 0;
+    }
+    /* записи цепочки CNAME тоже ограничивают срок ответа */
+    if (rclass == DNS_C_IN && ttl < min_ttl) {
+      min_ttl = ttl;
+    }
+    if (!rcode && type == want && rclass == DNS_C_IN && rdlen == addr_len && R->naddrs < DNS_MAX_ADDRS) {
+      memcpy (&R->addrs[R->naddrs++], pkt + pos, addr_len);
+    }
+    pos += rdlen;
+  }
+  if (R->naddrs) {
+    R->status = DNS_OK;
+    R->ttl = min_ttl;
+    return 1;
+  }
+  if (flags & DNS_F_TC) {
+    return 0;
+  }
+
+  /* отрицательный ответ живёт min (TTL SOA, MINIMUM), RFC 2308 */
+  R->status = DNS_NOT_FOUND;
+  R->ttl = DNS_NEGATIVE_TTL;
+  for (i = 0; i < nscount; i++) {
+    pos = dns_read_rr (pkt, len, pos, &type, &ttl, &rdlen, &rclass);
+    if (pos < 0) {
+      break;
+    }
+    if (type == DNS_T_SOA && rdlen >= 22) {
+      unsigned minimum = get32 (pkt + pos + rdlen - 4);
+      if (minimum < ttl) {
+        ttl = minimum;
+      }
+      R->ttl = ttl < DNS_MAX_NEGATIVE_TTL ? ttl : DNS_MAX_NEGATIVE_TTL;
+      break;
+    }
+    pos += rdlen;
+  }
+  return 1;
+}
+
+static int dns_is_server (const struct sockaddr_in *from) {
+  int i;
+  for (i = 0; i < Conf.nservers; i++) {
+    if (from->sin_addr.s_addr == Conf.servers[i].sin_addr.s_addr && from->sin_port == Conf.servers[i].sin_port) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void dns_resolver_process_input (void) {
+  static unsigned char buf[DNS_MAX_PACKET];
+  if (dns_fd < 0) {
+    return;
+  }
+  while (1) {
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof (from);
+    int r = recvfrom (dns_fd, buf, sizeof (buf), 0, (struct sockaddr *) &from, &from_len);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    struct dns_query *Q = NULL;
+    if (r >= DNS_HEADER_SIZE && from.sin_family == AF_INET && dns_is_server (&from)) {
+      int id = get16 (buf);
+      for (Q = QueryById[id % DNS_QUERY_HASH]; Q && Q->id != id; Q = Q->id_next) {
+      }
+    }
+    struct dns_result R;
+    int res = Q ? dns_parse_answer (buf, r, Q, &R) : -1;
+    if (res < 0) {
+      bad_answers++;
+      continue;
+    }
+    answers_received++;
+    if (!res) {
+      dns_query_next_try (Q, DNS_ERROR);
+      continue;
+    }
+    dns_cache_store (Q->name, Q->family, &R);
+    dns_query_complete (Q, &R);
+  }
+}
+
+double dns_resolver_process_timeouts (void) {
+  double now = dns_resolver_now ();
+  while (QueueFirst && QueueFirst->deadline <= now) {
+    dns_query_next_try (QueueFirst, DNS_TIMEOUT);
+  }
+  return QueueFirst ? QueueFirst->deadline : 0;
+}
+
+int dns_resolver_pending (void) {
+  return pending_queries;
+}
+
+int dns_resolver_wait (double timeout) {
+  double end = dns_resolver_now () + timeout;
+  while (pending_queries > 0) {
+    double next = dns_resolver_process_timeouts ();
+    double now = dns_resolver_now ();
+    if (!pending_queries || now >= end) {
+      break;
+    }
+    if (!next || next > end) {
+      next = end;
+    }
+    struct pollfd P = { .fd = dns_fd, .events = POLLIN };
+    if (poll (&P, 1, (int) ((next - now) * 1000) + 1) > 0) {
+      dns_resolver_process_input ();
+    }
+  }
+  return pending_queries;
+}
+
+void dns_resolver_get_stat (struct dns_resolver_stat *S) {
+  int i;
+  memset (S, 0, sizeof (*S));
+  S->queries_sent = queries_sent;
+  S->retries = query_retries;
+  S->timeouts = query_timeouts;
+  S->answers = answers_received;
+  S->bad_answers = bad_answers;
+  S->cache_hits = cache_hits;
+  S->cache_negative_hits = cache_negative_hits;
+  S->cache_misses = cache_misses;
+  S->cache_evictions = cache_evictions;
+  for (i = 0; i < DNS_CACHE_SHARDS; i++) {
+    S->cache_entries += Shards[i].entries;
+  }
+  S->pending = pending_queries;
+}
+
+/* ============================================
+ * Движок
+ * ============================================ */
+
+struct dns_request_info {
+  dns_callback_t cb;
+  void *extra;
+  int family;
+  struct dns_result R;
+  char name[DNS_MAX_NAME + 1];
+};
+
+static int dns_epoll_handler (int fd, void *data, event_t *ev) {
+  dns_resolver_process_input ();
+  return EVA_CONTINUE;
+}
+
+static double dns_timer_wakeup (void *extra) {
+  double next = dns_resolver_process_timeouts ();
+  return next ? precise_now + (next - dns_resolver_now ()) : 0;
+}
+
+static void dns_timer_arm (double deadline) {
+  if (dns_engine_active) {
+    job_timer_insert (dns_timer, precise_now + (deadline - dns_resolver_now ()));
+  }
+}
+
+int dns_resolver_engine_init (void) {
+  if (dns_fd < 0 && dns_resolver_init (NULL) < 0) {
+    return -1;
+  }
+  if (dns_engine_active) {
+    return 0;
+  }
+  /* сокет мог достаться от процесса до fork: ответы делились бы между рабочими */
+  if (!pending_queries) {
+    int fd = dns_open_socket ();
+    if (fd >= 0) {
+      close (dns_fd);
+      dns_fd = fd;
+    }
+  }
+  epoll_sethandler (dns_fd, 0, dns_epoll_handler, NULL);
+  epoll_insert (dns_fd, EVT_READ);
+  dns_timer = job_timer_alloc (JC_EPOLL, dns_timer_wakeup, NULL);
+  dns_engine_active = 1;
+  if (QueueFirst) {
+    dns_timer_arm (QueueFirst->deadline);
+  }
+  /* ответы, пришедшие до регистрации в epoll, фронта уже не дадут */
+  dns_resolver_process_input ();
+  return 0;
+}
+
+static int dns_callback_job_run (job_t job, int op, struct job_thread *JT) {
+  struct dns_request_info *D = (struct dns_request_info *) job->j_custom;
+  switch (op) {
+  case JS_RUN:
+    D->cb (D->extra, &D->R);
+    return JOB_COMPLETED;
+  case JS_FINISH:
+    return job_free (JOB_REF_PASS (job));
+  default:
+    return JOB_ERROR;
+  }
+}
+
+/* в главном потоке: результат уходит колбэку отдельным job */
+static void dns_engine_done (void *extra, const struct dns_result *R) {
+  struct dns_request_info *C = extra;
+  if (C->cb) {
+    job_t job = create_async_job (dns_callback_job_run, JSC_ALLOW (JC_ENGINE, JS_RUN) | JSIG_FAST (JS_FINISH), -2, sizeof (struct dns_request_info), 0, JOB_REF_NULL);
+    assert (job);
+    struct dns_request_info *D = (struct dns_request_info *) job->j_custom;
+    D->cb = C->cb;
+    D->extra = C->extra;
+    D->family = C->family;
+    D->R = *R;
+    schedule_job (JOB_REF_PASS (job));
+  }
+  free (C);
+}
+
+static int dns_query_job_run (job_t job, int op, struct job_thread *JT) {
+  struct dns_request_info *D = (struct dns_request_info *) job->j_custom;
+  switch (op) {
+  case JS_RUN: {
+    struct dns_request_info *C = malloc (sizeof (*C));
+    assert (C);
+    *C = *D;
+    if (dns_resolver_query (D->name, D->family, dns_engine_done, C) < 0) {
+      memset (&D->R, 0, sizeof (D->R));
+      D->R.status = DNS_ERROR;
+      D->R.family = D->family;
+      dns_engine_done (C, &D->R);
+    }
+    return JOB_COMPLETED;
+  }
+  case JS_FINISH:
+    return job_free (JOB_REF_PASS (job));
+  default:
+    return JOB_ERROR;
+  }
+}
+
+int dns_resolve_async (const char *name, int family, dns_callback_t cb, void *extra, struct dns_result *R) {
+  char key[DNS_MAX_NAME + 1];
+  if ((family != AF_INET && family != AF_INET6) || dns_normalize (name, key) < 0) {
+    return -1;
+  }
+  if (dns_literal (key, family, R)) {
+    return 1;
+  }
+  if (cache_lookup_key (key, family, R)) {
+    dns_count_lookup (1, R);
+    return 1;
+  }
+  if (!dns_engine_active) {
+    return -1;
+  }
+  /* запрос уходит в главный поток: состояние резолвера однопоточное */
+  job_t job = create_async_job (dns_query_job_run, JSC_ALLOW (JC_EPOLL, JS_RUN) | JSIG_FAST (JS_FINISH), -2, sizeof (struct dns_request_info), 0, JOB_REF_NULL);
+  assert (job);
+  struct dns_request_info *D = (struct dns_request_info *) job->j_custom;
+  D->cb = cb;
+  D->extra = extra;
+  D->family = family;
+  strcpy (D->name, key);
+  schedule_job (JOB_REF_PASS (job));
+  return 0;
+}
+
+/*
+ * Для kdb_gethostbyname: A, затем AAAA, как gethostbyname ?: gethostbyname2.
+ * До движка промах кэша решает блокирующий запрос, после - запрос в фоне
+ * и NULL, чтобы поток движка не ждал сеть
+ */
+static struct hostent *dns_hostent_lookup (const char *name, int *answered) {
+  static struct dns_result R;
+  static char *addr_list[DNS_MAX_ADDRS + 1];
+  static struct hostent H;
+  static const int families[2] = { AF_INET, AF_INET6 };
+  char key[DNS_MAX_NAME + 1];
+  int i, j, missing[2] = { 0, 0 };
+
+  *answered = 0;
+  if (dns_normalize (name, key) < 0 || dns_literal (key, AF_INET, &R) || dns_literal (key, AF_INET6, &R)) {
+    return NULL;
+  }
+  for (i = 0; i < 2; i++) {
+    int found = cache_lookup_key (key, families[i], &R);
+    dns_count_lookup (found, &R);
+    if (found && R.status == DNS_OK) {
+      for (j = 0; j < R.naddrs; j++) {
+        addr_list[j] = (char *) &R.addrs[j];
+      }
+      addr_list[j] = NULL;
+      H.h_name = (char *) name;
+      H.h_aliases = NULL;
+      H.h_addrtype = R.family;
+      H.h_length = R.family == AF_INET6 ? 16 : 4;
+      H.h_addr_list = addr_list;
+      *answered = 1;
+      return &H;
+    }
+    if (!found) {
+      if (!dns_engine_active) {
+        return NULL;
+      }
+      missing[i] = 1;
+    }
+  }
+  for (i = 0; i < 2; i++) {
+    if (missing[i]) {
+      dns_resolve_async (key, families[i], NULL, NULL, &R);
+    }
+  }
+  *answered = 1;
+  return NULL;
+}
@@ -0,0 +1,109 @@
+/*
+ * net-dns-resolver.h - Неблокирующий DNS-резолвер с шардированным TTL-кэшем
+ *
+ * Запросы A/AAAA уходят по UDP на серверы из /etc/resolv.conf (только
+ * IPv4-адреса серверов) с одного неблокирующего сокета. Ответ проверяется
+ * по id, адресу сервера и вопросу; при таймауте, SERVFAIL или REFUSED
+ * запрос повторяется на следующем сервере, всего attempts кругов.
+ * Одинаковые запросы в полёте склеиваются в один.
+ *
+ * Кэш разбит на DNS_CACHE_SHARDS шардов со своей блокировкой и хеш-таблицей,
+ * читать его можно из любого потока. Положительный ответ живёт минимальный
+ * TTL записей ответа, отрицательный (NXDOMAIN или нет записей нужного
+ * типа) - TTL из SOA, как в RFC 2308. Таймауты и ошибки серверов не
+ * кэшируются.
+ *
+ * Состояние запросов однопоточное. До запуска движка его крутит
+ * dns_resolver_wait, после dns_resolver_engine_init - обработчик epoll и
+ * таймер в главном потоке, а колбэки dns_resolve_async выполняются
+ * отдельными job в JC_ENGINE. После этого kdb_gethostbyname больше не
+ * блокируется: промах кэша запускает запрос и возвращает NULL.
+ */
+
+#pragma once
+
+#include <netinet/in.h>
+
+#define DNS_CACHE_SHARDS 16
+#define DNS_CACHE_SHARD_BUCKETS 256
+#define DNS_CACHE_SHARD_MAX 1024        /* записей на шард */
+#define DNS_MAX_NAME 253
+#define DNS_MAX_ADDRS 8
+#define DNS_MAX_SERVERS 3
+#define DNS_MAX_PENDING 1024
+#define DNS_NEGATIVE_TTL 30             /* если в ответе нет SOA */
+#define DNS_MAX_TTL 86400
+#define DNS_MAX_NEGATIVE_TTL 3600
+
+/* dns_result.status */
+#define DNS_OK 0
+#define DNS_NOT_FOUND -1                /* NXDOMAIN или нет записей, кэшируется */
+#define DNS_TIMEOUT -2
+#define DNS_ERROR -3                    /* SERVFAIL, REFUSED, мусор, нет серверов */
+
+struct dns_result {
+  int status;
+  int family;                           /* AF_INET или AF_INET6 */
+  int ttl;                              /* секунд осталось жить в кэше */
+  int naddrs;
+  union {
+    struct in_addr v4;
+    struct in6_addr v6;
+  } addrs[DNS_MAX_ADDRS];
+};
+
+typedef void (*dns_callback_t) (void *extra, const struct dns_result *R);
+
+struct dns_resolver_conf {
+  struct sockaddr_in servers[DNS_MAX_SERVERS];
+  int nservers;
+  double timeout;                       /* секунд на одну попытку */
+  int attempts;                         /* кругов по всем серверам */
+};
+
+struct dns_resolver_stat {
+  long long queries_sent;
+  long long retries;
+  long long timeouts;
+  long long answers;
+  long long bad_answers;                /* чужой id, адрес или вопрос */
+  long long cache_hits;
+  long long cache_negative_hits;
+  long long cache_misses;
+  long long cache_evictions;
+  int cache_entries;
+  int pending;
+};
+
+/* кэш, можно звать из любого потока */
+
+/* 1 - найдено (в том числе отрицательный ответ), 0 - нет или истекло */
+int dns_cache_lookup (const char *name, int family, struct dns_result *R);
+/* R->ttl задаёт срок жизни; DNS_TIMEOUT и DNS_ERROR не сохраняются */
+void dns_cache_store (const char *name, int family, const struct dns_result *R);
+void dns_cache_clear (void);
+
+/* запросы, только из одного потока */
+
+/* C == NULL - /etc/resolv.conf; повторный вызов меняет серверы. Возвращает сокет или -1 */
+int dns_resolver_init (const struct dns_resolver_conf *C);
+int dns_load_resolv_conf (const char *path, struct dns_resolver_conf *C);
+/* 1 - ответ из кэша, cb уже вызван; 0 - cb будет вызван позже; -1 - ошибка */
+int dns_resolver_query (const char *name, int family, dns_callback_t cb, void *extra);
+/* читает все ответы с сокета */
+void dns_resolver_process_input (void);
+/* повторы и таймауты; возвращает монотонное время следующего срока или 0 */
+double dns_resolver_process_timeouts (void);
+int dns_resolver_pending (void);
+/* крутит poll, пока есть запросы, не дольше timeout секунд; возвращает число оставшихся */
+int dns_resolver_wait (double timeout);
+double dns_resolver_now (void);
+
+void dns_resolver_get_stat (struct dns_resolver_stat *S);
+
+/* движок */
+
+/* в главном потоке после init_epoll; сокет переходит под epoll */
+int dns_resolver_engine_init (void);
+/* из любого потока: 1 - *R заполнен из кэша, 0 - cb вызовется из job JC_ENGINE, -1 - ошибка */
+int dns_resolve_async (const char *name, int family, dns_callback_t cb, void *extra, struct dns_result *R);
@@ -56,6 +56,7 @@
 
 #include "engine/engine.h"
 #include "net/net-events.h"
+#include "net/net-fault-inject.h"
 #include "kprintf.h"
 #include "precise-time.h"
 #include "vv/vv-io.h"
@@ -701,7 +702,7 @@ int client_socket (in_addr_t in_addr, int port, int mode) {
   addr.sin_port = htons (port);
   addr.sin_addr.s_addr = in_addr;
  
-  if (connect (socket_fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 && errno != EINPROGRESS) {
+  if (fi_connect (socket_fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 && errno != EINPROGRESS) {
     perror ("connect()");
     close (socket_fd);
     return -1;
@@ -742,7 +743,7 @@ int client_socket_ipv6 (const unsigned char in6_addr_ptr[16], int port, int mode
   addr.sin6_port = htons (port);
   memcpy (&addr.sin6_addr, in6_addr_ptr, 16);
  
-  if (connect (socket_fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 && errno != EINPROGRESS) {
+  if (fi_connect (socket_fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 && errno != EINPROGRESS) {
     perror ("connect()");
     close (socket_fd);
     return -1;
@@ -0,0 +1,248 @@
+/*
+ * net-fault-inject.c - внесение сбоев для нагрузочных тестов (только сборка с FAULT_INJECTION)
+ */
+
+#ifdef FAULT_INJECTION
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/common-stats.h"
+#include "common/kprintf.h"
+#include "jobs/jobs.h"
+#include "net/net-fault-inject.h"
+
+#define FAULT_SPEC_MAX 1024
+
+unsigned fault_inject_threshold[FI_POINTS];
+
+static const char *point_names[FI_POINTS] = {
+  "readv", "writev", "accept", "connect", "msg_part", "msg_buffer", "reload"
+};
+
+static double fault_rate[FI_POINTS];
+static unsigned long long fault_seed;
+static const char *fault_file;
+static struct timespec fault_file_mtime;
+
+static __thread unsigned long long fault_rng;
+
+#define MODULE fault_inject
+
+MODULE_STAT_TYPE {
+  struct fault_inject_stat S;
+};
+
+MODULE_INIT
+
+static unsigned fault_rand (void) {
+  if (!fault_rng) {
+    fault_rng = (fault_seed ? fault_seed : (unsigned long long) time (0)) * 0x9e3779b97f4a7c15ULL
+              ^ ((unsigned long long) getpid () << 32) ^ (unsigned long long) pthread_self () ^ 1;
+  }
+  fault_rng ^= fault_rng >> 12;
+  fault_rng ^= fault_rng << 25;
+  fault_rng ^= fault_rng >> 27;
+  return (unsigned) ((fault_rng * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+/* "точка=вероятность,..." или пустая строка - всё выключено; -1 при ошибке, настройки не меняются */
+static int fault_inject_parse (const char *spec) {
+  double rate[FI_POINTS];
+  unsigned long long seed = fault_seed;
+  char buf[FAULT_SPEC_MAX], *save, *tok;
+  int i;
+  memset (rate, 0, sizeof (rate));
+  snprintf (buf, sizeof (buf), "%s", spec);
+  for (tok = strtok_r (buf, ", \t\r\n", &save); tok; tok = strtok_r (NULL, ", \t\r\n", &save)) {
+    char *eq = strchr (tok, '='), *end;
+    if (!eq) {
+      kprintf ("fault injection: '%s' is not <point>=<probability>\n", tok);
+      return -1;
+    }
+    *eq++ = 0;
+    if (!strcmp (tok, "seed")) {
+      seed = strtoull (eq, &end, 10);
+    } else {
+      for (i = 0; i < FI_POINTS && strcmp (tok, point_names[i]); i++) {
+      }
+      if (i == FI_POINTS) {
+        kprintf ("fault injection: unknown point '%s'\n", tok);
+        return -1;
+      }
+      rate[i] = strtod (eq, &end);
+    }
+    if (end == eq || *end) {
+      kprintf ("fault injection: bad value '%s' for %s\n", eq, tok);
+      return -1;
+    }
+  }
+  fault_seed = seed;
+  for (i = 0; i < FI_POINTS; i++) {
+    double r = rate[i] < 0 ? 0 : rate[i] > 1 ? 1 : rate[i];
+    fault_rate[i] = r;
+    fault_inject_threshold[i] = r >= 1 ? 0xffffffffu : (unsigned) (r * 4294967296.0);
+  }
+  return 0;
+}
+
+static void fault_inject_load_file (void) {
+  struct stat st;
+  if (stat (fault_file, &st) < 0) {
+    if (fault_file_mtime.tv_sec) {
+      memset (&fault_file_mtime, 0, sizeof (fault_file_mtime));
+      fault_inject_parse ("");
+    }
+    return;
+  }
+  if (st.st_mtim.tv_sec == fault_file_mtime.tv_sec && st.st_mtim.tv_nsec == fault_file_mtime.tv_nsec) {
+    return;
+  }
+  fault_file_mtime = st.st_mtim;
+  char spec[FAULT_SPEC_MAX];
+  FILE *f = fopen (fault_file, "r");
+  int len = f ? (int) fread (spec, 1, sizeof (spec) - 1, f) : 0;
+  if (f) {
+    fclose (f);
+  }
+  spec[len] = 0;
+  if (fault_inject_parse (spec) == 0) {
+    vkprintf (1, "fault injection: %s applied\n", fault_file);
+  }
+}
+
+void fault_inject_init (void) {
+  const char *spec = getenv ("MTPROXY_FAULTS");
+  if (!spec) {
+    return;
+  }
+  if (*spec == '@') {
+    fault_file = spec + 1;
+    fault_inject_load_file ();
+  } else if (fault_inject_parse (spec) < 0) {
+    exit (2);
+  }
+  kprintf ("fault injection enabled: %s\n", spec);
+}
+
+void fault_inject_cron (void) {
+  if (fault_file) {
+    fault_inject_load_file ();
+  }
+}
+
+int fault_inject_hit (int point) {
+  struct fault_inject_stat *S = &MODULE_STAT->S;
+  S->checked[point] ++;
+  unsigned t = fault_inject_threshold[point];
+  if (t != 0xffffffffu && fault_rand () >= t) {
+    return 0;
+  }
+  S->injected[point] ++;
+  return 1;
+}
+
+/* ============================================
+ * Обёртки системных вызовов
+ * ============================================ */
+
+ssize_t fi_readv (int fd, const struct iovec *iov, int iovcnt) {
+  if (!FAULT_INJECT (FI_READV)) {
+    return readv (fd, iov, iovcnt);
+  }
+  unsigned r = fault_rand ();
+  if (r % 4 < 2 && iovcnt > 0 && iov[0].iov_len > 1) {
+    /* часть первого буфера: читатель должен вернуться за остатком сам */
+    struct iovec part = { .iov_base = iov[0].iov_base, .iov_len = 1 + (r >> 8) % (iov[0].iov_len - 1) };
+    return readv (fd, &part, 1);
+  }
+  /* EAGAIN не подделываем: с edge-triggered epoll соединение просто встало бы */
+  errno = r % 4 == 2 ? EINTR : ECONNRESET;
+  return -1;
+}
+
+ssize_t fi_writev (int fd, const struct iovec *iov, int iovcnt) {
+  if (!FAULT_INJECT (FI_WRITEV)) {
+    return writev (fd, iov, iovcnt);
+  }
+  unsigned r = fault_rand ();
+  size_t total = 0;
+  int i;
+  for (i = 0; i < iovcnt; i++) {
+    total += iov[i].iov_len;
+  }
+  if (r % 4 < 2 && total > 1) {
+    /* короткая запись: обрезаем вектор на случайном байте */
+    struct iovec part[iovcnt];
+    size_t left = 1 + (r >> 8) % (total - 1);
+    int n = 0;
+    while (left > 0) {
+      part[n] = iov[n];
+      if (part[n].iov_len > left) {
+        part[n].iov_len = left;
+      }
+      left -= part[n++].iov_len;
+    }
+    return writev (fd, part, n);
+  }
+  errno = r % 4 == 2 ? EINTR : EPIPE;
+  return -1;
+}
+
+int fi_accept (int fd, struct sockaddr *addr, socklen_t *addrlen) {
+  int cfd = accept (fd, addr, addrlen);
+  if (cfd >= 0 && FAULT_INJECT (FI_ACCEPT)) {
+    /* клиент увидит сброс, как при переполненной очереди ядра */
+    close (cfd);
+    errno = ECONNABORTED;
+    return -1;
+  }
+  return cfd;
+}
+
+int fi_connect (int fd, const struct sockaddr *addr, socklen_t addrlen) {
+  if (FAULT_INJECT (FI_CONNECT)) {
+    errno = ECONNREFUSED;
+    return -1;
+  }
+  return connect (fd, addr, addrlen);
+}
+
+/* ============================================
+ * Статистика
+ * ============================================ */
+
+void fault_inject_stat_add (struct fault_inject_stat *T, const struct fault_inject_stat *F) {
+  int i;
+  for (i = 0; i < FI_POINTS; i++) {
+    T->checked[i] += F->checked[i];
+    T->injected[i] += F->injected[i];
+  }
+}
+
+void fetch_fault_inject_stat (struct fault_inject_stat *S) {
+  int i;
+  memset (S, 0, sizeof (*S));
+  for (i = 0; i <= max_job_thread_id; i++) {
+    MODULE_STAT_TYPE *T = MODULE_STAT_ARR[i];
+    if (T) {
+      fault_inject_stat_add (S, &T->S);
+    }
+  }
+}
+
+void fault_inject_print_stat (stats_buffer_t *sb, const struct fault_inject_stat *S) {
+  int i;
+  for (i = 0; i < FI_POINTS; i++) {
+    sb_printf (sb, "fault_%s\trate=%.6f checked=%lld injected=%lld\n",
+	       point_names[i], fault_rate[i], S->checked[i], S->injected[i]);
+  }
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * net-fault-inject.h - внесение сбоев для нагрузочных тестов (только сборка с FAULT_INJECTION)
+ *
+ * Точки сбоев: readv/writev/accept/connect в сетевом слое, выделение
+ * msg_part и msg_buffer, перечитывание конфига из cron. Вероятности
+ * задаются переменной окружения MTPROXY_FAULTS:
+ *
+ *   MTPROXY_FAULTS="readv=0.005,writev=0.005,accept=0.02,connect=0.1,reload=0.2,seed=1"
+ *
+ * или MTPROXY_FAULTS=@файл - тогда строка читается из файла и
+ * перечитывается раз в секунду, когда он меняется (пустой файл - сбоев нет).
+ *
+ * Без FAULT_INJECTION обёртки - это сами системные вызовы, а
+ * FAULT_INJECT () - константа 0: обычная сборка не меняется ни на такт.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include "common/common-stats.h"
+
+enum fault_point {
+  FI_READV,           /* короткое чтение, EINTR или ECONNRESET */
+  FI_WRITEV,          /* короткая запись, EINTR или EPIPE */
+  FI_ACCEPT,          /* соединение принято и сразу закрыто, ECONNABORTED */
+  FI_CONNECT,         /* ECONNREFUSED без попытки соединиться */
+  FI_MSG_PART,        /* alloc_msg_part возвращает 0 */
+  FI_MSG_BUFFER,      /* alloc_msg_buffer возвращает 0 */
+  FI_RELOAD,          /* do_reload_config из cron, проверка раз в секунду */
+  FI_POINTS
+};
+
+#ifdef FAULT_INJECTION
+
+struct fault_inject_stat {
+  long long checked[FI_POINTS];
+  long long injected[FI_POINTS];
+};
+
+/* вероятность точки в долях 2^32, 0 - точка выключена */
+extern unsigned fault_inject_threshold[FI_POINTS];
+
+/* разбирает MTPROXY_FAULTS; до запуска рабочих процессов */
+void fault_inject_init (void);
+/* перечитывает файл из MTPROXY_FAULTS=@файл, если он изменился; из cron */
+void fault_inject_cron (void);
+/* бросает кубик для точки, считает попытки и сбои */
+int fault_inject_hit (int point);
+
+#define FAULT_INJECT(point) (fault_inject_threshold[point] && fault_inject_hit (point))
+
+ssize_t fi_readv (int fd, const struct iovec *iov, int iovcnt);
+ssize_t fi_writev (int fd, const struct iovec *iov, int iovcnt);
+int fi_accept (int fd, struct sockaddr *addr, socklen_t *addrlen);
+int fi_connect (int fd, const struct sockaddr *addr, socklen_t addrlen);
+
+void fetch_fault_inject_stat (struct fault_inject_stat *S);
+void fault_inject_stat_add (struct fault_inject_stat *T, const struct fault_inject_stat *F);
+/* строки fault_<точка> с вероятностью, числом проверок и сбоев */
+void fault_inject_print_stat (stats_buffer_t *sb, const struct fault_inject_stat *S);
+
+#else
+
+#define FAULT_INJECT(point) 0
+
+#define fi_readv readv
+#define fi_writev writev
+#define fi_accept accept
+#define fi_connect connect
+
+#endif
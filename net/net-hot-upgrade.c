@@ -0,0 +1,349 @@
+/*
+ * net-hot-upgrade.c - Передача слушающих сокетов новому бинарнику без простоя
+ */
+
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "net/net-hot-upgrade.h"
+
+#define HOT_UPGRADE_MAGIC 0x5055544d          /* "MTUP" */
+#define HOT_UPGRADE_REPORT_MAGIC 0x5052544d   /* "MTRP" */
+#define HOT_UPGRADE_VERSION 1
+#define HOT_UPGRADE_READY 'R'
+
+struct hot_upgrade_header {
+  int magic;
+  int version;
+  int n;
+  int blob_len;
+  int ports[HOT_UPGRADE_MAX_FDS];
+};
+
+struct hot_upgrade_report_msg {
+  int magic;
+  struct hot_upgrade_report report;
+};
+
+static int write_all (int fd, const void *buf, int len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t r = write (fd, p, len);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += r;
+    len -= r;
+  }
+  return 0;
+}
+
+static int read_all (int fd, void *buf, int len) {
+  char *p = buf;
+  while (len > 0) {
+    ssize_t r = read (fd, p, len);
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (!r) {
+      errno = ECONNRESET;
+      return -1;
+    }
+    p += r;
+    len -= r;
+  }
+  return 0;
+}
+
+/* всё, кроме stdin/stdout/stderr и keep: новый процесс откроет своё сам */
+static void close_other_fds (int keep, long max_fd) {
+#ifdef SYS_close_range
+  if ((keep <= 3 || !syscall (SYS_close_range, 3, keep - 1, 0)) && !syscall (SYS_close_range, keep + 1, ~0U, 0)) {
+    return;
+  }
+#endif
+  long fd;
+  for (fd = 3; fd < max_fd; fd++) {
+    if (fd != keep) {
+      close (fd);
+    }
+  }
+}
+
+extern char **environ;
+
+/* окружение текущего процесса с номером канала; собирается до fork, в потомке malloc нельзя */
+static char **build_env (int fd) {
+  int n = 0, i, k = 0, l = strlen (HOT_UPGRADE_ENV);
+  while (environ[n]) {
+    n++;
+  }
+  char **env = malloc ((n + 2) * sizeof (char *));
+  char *var = malloc (l + 16);
+  if (!env || !var) {
+    free (env);
+    free (var);
+    return NULL;
+  }
+  snprintf (var, l + 16, "%s=%d", HOT_UPGRADE_ENV, fd);
+  for (i = 0; i < n; i++) {
+    if (strncmp (environ[i], HOT_UPGRADE_ENV, l) || environ[i][l] != '=') {
+      env[k++] = environ[i];
+    }
+  }
+  env[k++] = var;
+  env[k] = NULL;
+  return env;
+}
+
+static void free_env (char **env) {
+  int i = 0;
+  while (env[i + 1]) {
+    i++;
+  }
+  free (env[i]);
+  free (env);
+}
+
+int hot_upgrade_spawn (const char *path, char *const argv[], pid_t *pid) {
+  int sv[2];
+  if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+    return -1;
+  }
+
+  char **env = build_env (sv[1]);
+  long max_fd = sysconf (_SC_OPEN_MAX);
+  if (max_fd < 0 || max_fd > (1 << 20)) {
+    max_fd = 1 << 20;
+  }
+  pid_t p = env ? fork () : -1;
+  if (p < 0) {
+    int err = errno;
+    if (env) {
+      free_env (env);
+    }
+    close (sv[0]);
+    close (sv[1]);
+    errno = err;
+    return -1;
+  }
+
+  if (!p) {
+    sigset_t empty;
+    close_other_fds (sv[1], max_fd);
+    fcntl (sv[1], F_SETFD, 0);
+    sigemptyset (&empty);
+    sigprocmask (SIG_SETMASK, &empty, NULL);
+    if (strchr (path, '/')) {
+      execve (path, argv, env);
+    } else {
+      execvpe (path, argv, env);
+    }
+    _exit (127);
+  }
+
+  free_env (env);
+  close (sv[1]);
+  *pid = p;
+  return sv[0];
+}
+
+int hot_upgrade_inherited_fd (void) {
+  const char *s = getenv (HOT_UPGRADE_ENV);
+  if (!s) {
+    return -1;
+  }
+  char *end;
+  long fd = strtol (s, &end, 10);
+  unsetenv (HOT_UPGRADE_ENV);
+  if (*end || fd < 3 || fd > (1 << 24) || fcntl (fd, F_GETFD) < 0) {
+    return -1;
+  }
+  fcntl (fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+int hot_upgrade_send_sockets (int sock, const struct hot_upgrade_listen *L, int n, const void *blob, int blob_len) {
+  if (n < 0 || n > HOT_UPGRADE_MAX_FDS || blob_len < 0 || blob_len > HOT_UPGRADE_MAX_BLOB) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct hot_upgrade_header H;
+  memset (&H, 0, sizeof (H));
+  H.magic = HOT_UPGRADE_MAGIC;
+  H.version = HOT_UPGRADE_VERSION;
+  H.n = n;
+  H.blob_len = blob ? blob_len : 0;
+
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int) * HOT_UPGRADE_MAX_FDS)];
+  } control;
+  struct iovec iov = { .iov_base = &H, .iov_len = sizeof (H) };
+  struct msghdr msg;
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (n > 0) {
+    int i, *fds;
+    memset (&control, 0, sizeof (control));
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE (sizeof (int) * n);
+    struct cmsghdr *cm = CMSG_FIRSTHDR (&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN (sizeof (int) * n);
+    fds = (int *) CMSG_DATA (cm);
+    for (i = 0; i < n; i++) {
+      fds[i] = L[i].fd;
+      H.ports[i] = L[i].port;
+    }
+  }
+
+  ssize_t r;
+  do {
+    r = sendmsg (sock, &msg, MSG_NOSIGNAL);
+  } while (r < 0 && errno == EINTR);
+  if (r < 0) {
+    return -1;
+  }
+  /* дескрипторы ушли с первым байтом, остаток заголовка - обычными данными */
+  if (r < (ssize_t) sizeof (H) && write_all (sock, (char *) &H + r, sizeof (H) - r) < 0) {
+    return -1;
+  }
+  return H.blob_len ? write_all (sock, blob, H.blob_len) : 0;
+}
+
+int hot_upgrade_recv_sockets (int sock, struct hot_upgrade_listen *L, int max, void **blob, int *blob_len) {
+  struct hot_upgrade_header H;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int) * HOT_UPGRADE_MAX_FDS)];
+  } control;
+  struct iovec iov = { .iov_base = &H, .iov_len = sizeof (H) };
+  struct msghdr msg;
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  *blob = NULL;
+  *blob_len = 0;
+
+  ssize_t r;
+  do {
+    r = recvmsg (sock, &msg, MSG_CMSG_CLOEXEC);
+  } while (r < 0 && errno == EINTR);
+  if (r <= 0) {
+    if (!r) {
+      errno = ECONNRESET;
+    }
+    return -1;
+  }
+
+  int fds[HOT_UPGRADE_MAX_FDS], nfds = 0, i;
+  struct cmsghdr *cm;
+  for (cm = CMSG_FIRSTHDR (&msg); cm; cm = CMSG_NXTHDR (&msg, cm)) {
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+      int k = (cm->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+      for (i = 0; i < k; i++) {
+        int fd;
+        memcpy (&fd, CMSG_DATA (cm) + i * sizeof (int), sizeof (int));
+        if (nfds < HOT_UPGRADE_MAX_FDS) {
+          fds[nfds++] = fd;
+        } else {
+          close (fd);
+        }
+      }
+    }
+  }
+
+  /* чужой собеседник отсекается по первым байтам, не дожидаясь всего заголовка */
+  if ((msg.msg_flags & MSG_CTRUNC) || (r >= 8 && (H.magic != HOT_UPGRADE_MAGIC || H.version != HOT_UPGRADE_VERSION)) ||
+      (r < (ssize_t) sizeof (H) && read_all (sock, (char *) &H + r, sizeof (H) - r) < 0) ||
+      H.magic != HOT_UPGRADE_MAGIC || H.version != HOT_UPGRADE_VERSION || H.n != nfds || nfds > max ||
+      H.blob_len < 0 || H.blob_len > HOT_UPGRADE_MAX_BLOB) {
+    for (i = 0; i < nfds; i++) {
+      close (fds[i]);
+    }
+    errno = EPROTO;
+    return -1;
+  }
+
+  if (H.blob_len) {
+    *blob = malloc (H.blob_len);
+    if (!*blob || read_all (sock, *blob, H.blob_len) < 0) {
+      free (*blob);
+      *blob = NULL;
+      for (i = 0; i < nfds; i++) {
+        close (fds[i]);
+      }
+      return -1;
+    }
+    *blob_len = H.blob_len;
+  }
+
+  for (i = 0; i < nfds; i++) {
+    L[i].fd = fds[i];
+    L[i].port = H.ports[i];
+  }
+  return nfds;
+}
+
+int hot_upgrade_send_ready (int sock) {
+  char c = HOT_UPGRADE_READY;
+  return write_all (sock, &c, 1);
+}
+
+int hot_upgrade_poll_ready (int sock) {
+  char c;
+  ssize_t r = recv (sock, &c, 1, MSG_DONTWAIT);
+  if (r < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+  }
+  return r == 1 && c == HOT_UPGRADE_READY ? 1 : -1;
+}
+
+int hot_upgrade_send_report (int sock, const struct hot_upgrade_report *R) {
+  struct hot_upgrade_report_msg M;
+  M.magic = HOT_UPGRADE_REPORT_MAGIC;
+  M.report = *R;
+  return write_all (sock, &M, sizeof (M));
+}
+
+int hot_upgrade_poll_report (int sock, struct hot_upgrade_report *R) {
+  struct hot_upgrade_report_msg M;
+  ssize_t r = recv (sock, &M, sizeof (M), MSG_DONTWAIT | MSG_PEEK);
+  if (r < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+  }
+  if (!r) {
+    return -1;
+  }
+  if (r < (ssize_t) sizeof (M)) {
+    return 0;
+  }
+  if (read_all (sock, &M, sizeof (M)) < 0 || M.magic != HOT_UPGRADE_REPORT_MAGIC) {
+    return -1;
+  }
+  *R = M.report;
+  return 1;
+}
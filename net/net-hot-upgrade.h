@@ -0,0 +1,55 @@
+/*
+ * net-hot-upgrade.h - Передача слушающих сокетов новому бинарнику без простоя
+ *
+ * Старый процесс запускает новый (fork + exec) с концом UNIX-сокета,
+ * номер которого передаётся в переменной окружения HOT_UPGRADE_ENV,
+ * и отправляет по нему слушающие дескрипторы (SCM_RIGHTS) вместе с
+ * портами и произвольным блоком данных (кэш client random). Новый
+ * процесс подхватывает сокеты вместо открытия своих, начинает принимать
+ * соединения и отвечает "готов". Только после этого старый перестаёт
+ * принимать, сливает свои соединения до дедлайна и присылает итог.
+ *
+ * Очередь accept принадлежит сокету, а не процессу: пока хотя бы один
+ * из двух держит дескриптор, входящие соединения не теряются.
+ *
+ * Модуль не зависит от движка; ошибки - отрицательный результат и errno.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#define HOT_UPGRADE_ENV "MTPROXY_UPGRADE_FD"
+#define HOT_UPGRADE_MAX_FDS 253         /* SCM_MAX_FD в Linux */
+#define HOT_UPGRADE_MAX_BLOB (256 << 20)
+
+struct hot_upgrade_listen {
+  int fd;
+  int port;
+};
+
+/* старый процесс -> новый, после слива соединений */
+struct hot_upgrade_report {
+  int handover_ms;             /* от команды на обновление до готовности нового */
+  int drain_ms;
+  int drained_connections;     /* закрылись сами до дедлайна */
+  int dropped_connections;     /* закрыты принудительно по дедлайну */
+};
+
+/* fork + exec path с argv; возвращает свой конец канала, *pid - новый процесс */
+int hot_upgrade_spawn (const char *path, char *const argv[], pid_t *pid);
+
+/* канал, унаследованный от старого процесса, или -1; убирает переменную окружения */
+int hot_upgrade_inherited_fd (void);
+
+int hot_upgrade_send_sockets (int sock, const struct hot_upgrade_listen *L, int n, const void *blob, int blob_len);
+/* возвращает число сокетов; *blob (malloc, может быть NULL) освобождает вызывающий */
+int hot_upgrade_recv_sockets (int sock, struct hot_upgrade_listen *L, int max, void **blob, int *blob_len);
+
+int hot_upgrade_send_ready (int sock);
+/* 1 - новый процесс готов, 0 - ещё нет, -1 - он завершился или прислал мусор */
+int hot_upgrade_poll_ready (int sock);
+
+int hot_upgrade_send_report (int sock, const struct hot_upgrade_report *R);
+/* 1 - итог получен, 0 - ещё нет, -1 - канал закрыт без итога */
+int hot_upgrade_poll_report (int sock, struct hot_upgrade_report *R);
@@ -31,6 +31,10 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "crc32.h"
 #include "kprintf.h"
 #include "net/net-events.h"
@@ -74,22 +78,6 @@ conn_type_t ct_http_server = {
   .write_packet = hts_write_packet
 };
 
-enum http_query_parse_state {
-  htqp_start,
-  htqp_readtospace,
-  htqp_readtocolon,
-  htqp_readint,
-  htqp_skipspc,
-  htqp_skiptoeoln,
-  htqp_skipspctoeoln,
-  htqp_eoln,
-  htqp_wantlf,
-  htqp_wantlastlf,
-  htqp_linestart,
-  htqp_fatal,
-  htqp_done
-};
-
 int hts_default_execute (connection_job_t c, struct raw_message *raw, int op);
 
 struct http_server_functions default_http_server = {
@@ -212,349 +200,540 @@ int hts_write_packet (connection_job_t C, struct raw_message *raw) {
 }
 
 
-int hts_parse_execute (connection_job_t C) {
-  struct connection_info *c = CONN_INFO (C);
-  
-  struct hts_data *D = HTS_DATA(C);
-  char *ptr, *ptr_s, *ptr_e;
-  int len;
-  long long tt;
+/* first byte in [from, to) outside of printable ASCII 0x20..0x7e, or to */
+static inline int hts_find_ctl (const char *p, int from, int to) {
+#ifdef __SSE2__
+  const __m128i sp = _mm_set1_epi8 (' '), del = _mm_set1_epi8 (0x7f);
+  while (from + 16 <= to) {
+    __m128i x = _mm_loadu_si128 ((const __m128i *) (p + from));
+    /* signed compare: bytes >= 0x80 are negative and count as control too */
+    int m = _mm_movemask_epi8 (_mm_or_si128 (_mm_cmplt_epi8 (x, sp), _mm_cmpeq_epi8 (x, del)));
+    if (m) {
+      return from + __builtin_ctz (m);
+    }
+    from += 16;
+  }
+#endif
+  while (from < to && (signed char) p[from] >= ' ' && p[from] != 0x7f) {
+    from++;
+  }
+  return from;
+}
 
-  D->parse_state = htqp_start;
+/* end of a token starting at i: first space or e */
+static inline int hts_token_end (const char *p, int i, int e) {
+  const char *q = memchr (p + i, ' ', e - i);
+  return q ? q - p : e;
+}
 
-  struct raw_message raw;
-  rwm_clone (&raw, &c->in);
+static inline int hts_skip_spaces (const char *p, int i) {
+  while (p[i] == ' ') {
+    i++;
+  }
+  return i;
+}
 
-  while (c->status == conn_working && !c->pending_queries && raw.total_bytes) {
-    if (c->flags & (C_ERROR | C_STOPPARSE)) {
+static inline void hts_set_word (struct hts_data *Q, const char *w, int wlen) {
+  memcpy (Q->word, w, wlen < 15 ? wlen : 15);
+  Q->wlen = wlen;
+}
+
+/*
+  Fast path for a complete, well-formed header in one contiguous block:
+  CRLF line ends and header end are found by hts_find_ctl 16 bytes at a time,
+  lines are split with memchr. Leaves D exactly as hts_parse_header_bytes would
+  and returns header size; returns -1 without touching D on anything unusual
+  (errors, tabs, bare LF, non-ASCII, HTTP/0.9, incomplete header), the state
+  machine handles those.
+*/
+int hts_parse_header_fast (struct hts_data *D, const char *buf, int len) {
+  struct hts_data Q = *D;
+  int limit = len < MAX_HTTP_HEADER_SIZE ? len : MAX_HTTP_HEADER_SIZE - 1;
+  int i, j, e;
+
+  memset (&Q, 0, offsetof (struct hts_data, query_seqno));
+  Q.query_seqno++;
+  Q.data_size = -1;
+
+  /* request line: <method> SP+ <uri> SP+ HTTP/1.x SP* CRLF */
+  e = hts_find_ctl (buf, 0, limit);
+  if (e + 1 >= limit || buf[e] != '\r' || buf[e + 1] != '\n') {
+    return -1;
+  }
+  j = hts_token_end (buf, 0, e);
+  if (j == e) {
+    return -1;
+  }
+  hts_set_word (&Q, buf, j);
+  if (j == 3 && !memcmp (buf, "GET", 3)) {
+    Q.query_type = htqt_get;
+  } else if (j == 4 && !memcmp (buf, "HEAD", 4)) {
+    Q.query_type = htqt_head;
+  } else if (j == 4 && !memcmp (buf, "POST", 4)) {
+    Q.query_type = htqt_post;
+  } else if (j == 7 && !memcmp (buf, "OPTIONS", 7)) {
+    Q.query_type = htqt_options;
+  } else {
+    return -1;
+  }
+
+  i = hts_skip_spaces (buf, j);
+  j = hts_token_end (buf, i, e);
+  if (j == i || j - i > 4096) {
+    return -1;
+  }
+  hts_set_word (&Q, buf + i, j - i);
+  Q.uri_offset = i;
+  Q.uri_size = j - i;
+
+  i = hts_skip_spaces (buf, j);
+  j = hts_token_end (buf, i, e);
+  if (j - i != 8) {
+    return -1;
+  }
+  hts_set_word (&Q, buf + i, 8);
+  if (!memcmp (buf + i, "HTTP/1.0", 8)) {
+    Q.http_ver = HTTP_V10;
+  } else if (!memcmp (buf + i, "HTTP/1.1", 8)) {
+    Q.http_ver = HTTP_V11;
+  } else {
+    return -1;
+  }
+  if (hts_skip_spaces (buf, j) != e) {
+    return -1;
+  }
+  Q.query_words = 8;
+  Q.first_line_size = e + 2;
+
+  /* header lines: <name>: SP* <value> CRLF, until an empty line */
+  while (1) {
+    int pos = e + 2;
+    e = hts_find_ctl (buf, pos, limit);
+    if (e + 1 >= limit || buf[e] != '\r' || buf[e + 1] != '\n') {
+      return -1;
+    }
+    if (e == pos) {
       break;
     }
-   
-    len = rwm_get_block_ptr_bytes (&raw);
-    assert (len > 0);
-    ptr = ptr_s = rwm_get_block_ptr (&raw);
-    ptr_e = ptr + len;
+    j = pos;
+    while (j < e && buf[j] != ':' && buf[j] != ' ') {
+      j++;
+    }
+    if (j == e || buf[j] != ':' || j - pos > 4096) {
+      return -1;
+    }
+    hts_set_word (&Q, buf + pos, j - pos);
+    if (Q.wlen == 4 && !strncasecmp (Q.word, "host", 4)) {
+      Q.query_flags |= QF_HOST;
+    } else if (Q.wlen == 10 && !strncasecmp (Q.word, "connection", 10)) {
+      Q.query_flags |= QF_CONNECTION;
+    } else if (Q.wlen == 14 && !strncasecmp (Q.word, "content-length", 14)) {
+      Q.query_flags |= QF_DATASIZE;
+    } else {
+      Q.query_flags &= ~(QF_HOST | QF_DATASIZE | QF_CONNECTION);
+    }
+    i = hts_skip_spaces (buf, j + 1);
 
-    assert (ptr);
+    if (Q.query_flags & QF_DATASIZE) {
+      long long tt = 0;
+      if (Q.data_size != -1) {
+        return -1;
+      }
+      for (j = i; buf[j] >= '0' && buf[j] <= '9'; j++) {
+        if (tt >= 0x7fffffffL / 10) {
+          return -1;
+        }
+        tt = tt * 10 + (buf[j] - '0');
+      }
+      if (j == i || hts_skip_spaces (buf, j) != e) {
+        return -1;
+      }
+      Q.data_size = tt;
+      Q.query_flags &= ~QF_DATASIZE;
+    } else if (Q.query_flags & (QF_HOST | QF_CONNECTION)) {
+      j = hts_token_end (buf, i, e);
+      if (j - i > 4096 || hts_skip_spaces (buf, j) != e) {
+        return -1;
+      }
+      hts_set_word (&Q, buf + i, j - i);
+      Q.query_words++;
+      if (Q.wlen) {
+        if (Q.query_flags & QF_HOST) {
+          Q.host_offset = i;
+          Q.host_size = Q.wlen;
+        } else if (Q.wlen == 10 && !strncasecmp (Q.word, "keep-alive", 10)) {
+          Q.query_flags |= QF_KEEPALIVE;
+        }
+      }
+      Q.query_flags &= ~(QF_HOST | QF_CONNECTION);
+    }
+    Q.query_words++;
+  }
 
-    while (ptr < ptr_e && D->parse_state != htqp_done) {
-      switch (D->parse_state) {
-        case htqp_start:
-          //fprintf (stderr, "htqp_start: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
-          memset (D, 0, offsetof (struct hts_data, query_seqno));
-	  D->query_seqno++;
-          D->query_type = htqt_none;
-          D->data_size = -1;
-          D->parse_state = htqp_readtospace;
+  Q.header_size = e + 2;
+  Q.parse_state = htqp_done;
+  *D = Q;
+  return Q.header_size;
+}
+
+/* byte-by-byte header state machine; returns number of bytes consumed */
+int hts_parse_header_bytes (struct hts_data *D, const char *ptr, int len) {
+  const char *ptr_s = ptr, *ptr_e = ptr + len;
+  long long tt;
 
-        case htqp_readtospace:
-          //fprintf (stderr, "htqp_readtospace: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
-          while (ptr < ptr_e && ((unsigned) *ptr > ' ')) {
-            if (D->wlen < 15) {
-              D->word[D->wlen] = *ptr;
+  while (ptr < ptr_e && D->parse_state != htqp_done) {
+    switch (D->parse_state) {
+      case htqp_start:
+        //fprintf (stderr, "htqp_start: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+        memset (D, 0, offsetof (struct hts_data, query_seqno));
+        D->query_seqno++;
+        D->query_type = htqt_none;
+        D->data_size = -1;
+        D->parse_state = htqp_readtospace;
+
+      case htqp_readtospace:
+        //fprintf (stderr, "htqp_readtospace: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+        while (ptr < ptr_e && ((unsigned) *ptr > ' ')) {
+          if (D->wlen < 15) {
+            D->word[D->wlen] = *ptr;
+          }
+          D->wlen++;
+          ptr++;
+        }
+        if (D->wlen > 4096) {
+          D->parse_state = htqp_fatal;
+          break;
+        }
+        if (ptr == ptr_e) {
+          break;
+        }
+        D->parse_state = htqp_skipspc;
+        D->query_words++;
+        if (D->query_words == 1) {
+          D->query_type = htqt_error;
+          if (D->wlen == 3 && !memcmp (D->word, "GET", 3)) {
+            D->query_type = htqt_get;
+          } else if (D->wlen == 4) {
+            if (!memcmp (D->word, "HEAD", 4)) {
+              D->query_type = htqt_head;
+            } else if (!memcmp (D->word, "POST", 4)) {
+              D->query_type = htqt_post;
             }
-            D->wlen++;
-            ptr++;
+          } else if (D->wlen == 7 && !memcmp (D->word, "OPTIONS", 7)) {
+            D->query_type = htqt_options;
           }
-          if (D->wlen > 4096) {
-            D->parse_state = htqp_fatal;
-            break;
+          if (D->query_type == htqt_error) {
+            D->parse_state = htqp_skiptoeoln;
+            D->query_flags |= QF_ERROR;
           }
-          if (ptr == ptr_e) {
-            break;
+        } else if (D->query_words == 2) {
+          D->uri_offset = D->header_size;
+          D->uri_size = D->wlen;
+          if (!D->wlen) {
+            D->parse_state = htqp_skiptoeoln;
+            D->query_flags |= QF_ERROR;
           }
-          D->parse_state = htqp_skipspc;
-          D->query_words++;
-          if (D->query_words == 1) {
-            D->query_type = htqt_error;
-            if (D->wlen == 3 && !memcmp (D->word, "GET", 3)) {
-              D->query_type = htqt_get;
-            } else if (D->wlen == 4) {
-              if (!memcmp (D->word, "HEAD", 4)) {
-                D->query_type = htqt_head;
-              } else if (!memcmp (D->word, "POST", 4)) {
-                D->query_type = htqt_post;
-              }
-            } else if (D->wlen == 7 && !memcmp (D->word, "OPTIONS", 7)) {
-              D->query_type = htqt_options;
-            }
-            if (D->query_type == htqt_error) {
+        } else if (D->query_words == 3) {
+          D->parse_state = htqp_skipspctoeoln;
+          if (D->wlen != 0) {
+            /* HTTP/x.y */
+            if (D->wlen != 8) {
               D->parse_state = htqp_skiptoeoln;
               D->query_flags |= QF_ERROR;
-            }
-          } else if (D->query_words == 2) {
-            D->uri_offset = D->header_size;
-            D->uri_size = D->wlen;
-            if (!D->wlen) {
-              D->parse_state = htqp_skiptoeoln;
-              D->query_flags |= QF_ERROR;
-            }
-          } else if (D->query_words == 3) {
-            D->parse_state = htqp_skipspctoeoln;
-            if (D->wlen != 0) {
-              /* HTTP/x.y */
-              if (D->wlen != 8) {
+            } else {
+              if (!memcmp (D->word, "HTTP/1.0", 8)) {
+                D->http_ver = HTTP_V10;
+              } else if (!memcmp (D->word, "HTTP/1.1", 8)) {
+                D->http_ver = HTTP_V11;
+              } else {
                 D->parse_state = htqp_skiptoeoln;
                 D->query_flags |= QF_ERROR;
-              } else {
-                if (!memcmp (D->word, "HTTP/1.0", 8)) {
-                  D->http_ver = HTTP_V10;
-                } else if (!memcmp (D->word, "HTTP/1.1", 8)) {
-                  D->http_ver = HTTP_V11;
-                } else {
-                  D->parse_state = htqp_skiptoeoln;
-                  D->query_flags |= QF_ERROR;
-                }
               }
-            } else {
-              D->http_ver = HTTP_V09;
             }
           } else {
-            assert (D->query_flags & (QF_HOST | QF_CONNECTION));
-            if (D->wlen) {
-              if (D->query_flags & QF_HOST) {
-                D->host_offset = D->header_size;
-                D->host_size = D->wlen;
-              } else if (D->wlen == 10 && !strncasecmp (D->word, "keep-alive", 10)) {
-                D->query_flags |= QF_KEEPALIVE;
-              }
+            D->http_ver = HTTP_V09;
+          }
+        } else {
+          assert (D->query_flags & (QF_HOST | QF_CONNECTION));
+          if (D->wlen) {
+            if (D->query_flags & QF_HOST) {
+              D->host_offset = D->header_size;
+              D->host_size = D->wlen;
+            } else if (D->wlen == 10 && !strncasecmp (D->word, "keep-alive", 10)) {
+              D->query_flags |= QF_KEEPALIVE;
             }
-            D->query_flags &= ~(QF_HOST | QF_CONNECTION);
-            D->parse_state = htqp_skipspctoeoln;
           }
-          D->header_size += D->wlen;
-          break;
+          D->query_flags &= ~(QF_HOST | QF_CONNECTION);
+          D->parse_state = htqp_skipspctoeoln;
+        }
+        D->header_size += D->wlen;
+        break;
 
-        case htqp_skipspc:
-        case htqp_skipspctoeoln:
-          //fprintf (stderr, "htqp_skipspc[toeoln]: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
-          while (D->header_size < MAX_HTTP_HEADER_SIZE && ptr < ptr_e && (*ptr == ' ' || (*ptr == '\t' && D->query_words >= 8))) {
-            D->header_size++;
-            ptr++;
-          }
-          if (D->header_size >= MAX_HTTP_HEADER_SIZE) {
-            D->parse_state = htqp_fatal;
-            break;
-          }
-          if (ptr == ptr_e) {
-            break;
-          }
-          if (D->parse_state == htqp_skipspctoeoln) {
-            D->parse_state = htqp_eoln;
-            break;
-          }
-          if (D->query_words < 3) {
+      case htqp_skipspc:
+      case htqp_skipspctoeoln:
+        //fprintf (stderr, "htqp_skipspc[toeoln]: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+        while (D->header_size < MAX_HTTP_HEADER_SIZE && ptr < ptr_e && (*ptr == ' ' || (*ptr == '\t' && D->query_words >= 8))) {
+          D->header_size++;
+          ptr++;
+        }
+        if (D->header_size >= MAX_HTTP_HEADER_SIZE) {
+          D->parse_state = htqp_fatal;
+          break;
+        }
+        if (ptr == ptr_e) {
+          break;
+        }
+        if (D->parse_state == htqp_skipspctoeoln) {
+          D->parse_state = htqp_eoln;
+          break;
+        }
+        if (D->query_words < 3) {
+          D->wlen = 0;
+          D->parse_state = htqp_readtospace;
+        } else {
+          assert (D->query_words >= 4);
+          if (D->query_flags & QF_DATASIZE) {
+            if (D->data_size != -1) {
+              D->parse_state = htqp_skiptoeoln;
+              D->query_flags |= QF_ERROR;
+            } else {
+              D->parse_state = htqp_readint;
+              D->data_size = 0;
+            }
+          } else if (D->query_flags & (QF_HOST | QF_CONNECTION)) {
             D->wlen = 0;
             D->parse_state = htqp_readtospace;
           } else {
-            assert (D->query_words >= 4);
-            if (D->query_flags & QF_DATASIZE) {
-              if (D->data_size != -1) {
-                D->parse_state = htqp_skiptoeoln;
-                D->query_flags |= QF_ERROR;
-              } else {
-                D->parse_state = htqp_readint;
-                D->data_size = 0;
-              }
-            } else if (D->query_flags & (QF_HOST | QF_CONNECTION)) {
-              D->wlen = 0;
-              D->parse_state = htqp_readtospace;
-            } else {
-              D->parse_state = htqp_skiptoeoln;
-            }
+            D->parse_state = htqp_skiptoeoln;
           }
-          break;
+        }
+        break;
 
-        case htqp_readtocolon:
-          //fprintf (stderr, "htqp_readtocolon: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
-          while (ptr < ptr_e && *ptr != ':' && *ptr > ' ') {
-            if (D->wlen < 15) {
-              D->word[D->wlen] = *ptr;
-            }
-            D->wlen++;
-            ptr++;
-          }
-          if (D->wlen > 4096) {
-            D->parse_state = htqp_fatal;
-            break;
-          }
-          if (ptr == ptr_e) {
-            break;
+      case htqp_readtocolon:
+        //fprintf (stderr, "htqp_readtocolon: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+        while (ptr < ptr_e && *ptr != ':' && *ptr > ' ') {
+          if (D->wlen < 15) {
+            D->word[D->wlen] = *ptr;
           }
+          D->wlen++;
+          ptr++;
+        }
+        if (D->wlen > 4096) {
+          D->parse_state = htqp_fatal;
+          break;
+        }
+        if (ptr == ptr_e) {
+          break;
+        }
 
-          if (*ptr != ':') {
-            D->header_size += D->wlen;
-            D->parse_state = htqp_skiptoeoln;
+        if (*ptr != ':') {
+          D->header_size += D->wlen;
+          D->parse_state = htqp_skiptoeoln;
+          D->query_flags |= QF_ERROR;
+          break;
+        }
+
+        ptr++;
+
+        if (D->wlen == 4 && !strncasecmp (D->word, "host", 4)) {
+          D->query_flags |= QF_HOST;
+        } else if (D->wlen == 10 && !strncasecmp (D->word, "connection", 10)) {
+          D->query_flags |= QF_CONNECTION;
+        } else if (D->wlen == 14 && !strncasecmp (D->word, "content-length", 14)) {
+          D->query_flags |= QF_DATASIZE;
+        } else {
+          D->query_flags &= ~(QF_HOST | QF_DATASIZE | QF_CONNECTION);
+        }
+
+        D->header_size += D->wlen + 1;
+        D->parse_state = htqp_skipspc;
+        break;
+
+      case htqp_readint:        
+        //fprintf (stderr, "htqp_readint: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+
+        tt = D->data_size;
+        while (ptr < ptr_e && *ptr >= '0' && *ptr <= '9') {
+          if (tt >= 0x7fffffffL / 10) {
             D->query_flags |= QF_ERROR;
+            D->parse_state = htqp_skiptoeoln;
             break;
           }
-
+          tt = tt * 10 + (*ptr - '0');
           ptr++;
+          D->header_size++;
+          D->query_flags &= ~QF_DATASIZE;
+        }
 
-          if (D->wlen == 4 && !strncasecmp (D->word, "host", 4)) {
-            D->query_flags |= QF_HOST;
-          } else if (D->wlen == 10 && !strncasecmp (D->word, "connection", 10)) {
-            D->query_flags |= QF_CONNECTION;
-          } else if (D->wlen == 14 && !strncasecmp (D->word, "content-length", 14)) {
-            D->query_flags |= QF_DATASIZE;
-          } else {
-            D->query_flags &= ~(QF_HOST | QF_DATASIZE | QF_CONNECTION);
-          }
-
-          D->header_size += D->wlen + 1;
-          D->parse_state = htqp_skipspc;
+        D->data_size = tt;
+        if (ptr == ptr_e) {
           break;
+        }
 
-        case htqp_readint:        
-          //fprintf (stderr, "htqp_readint: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+        if (D->query_flags & QF_DATASIZE) {
+          D->query_flags |= QF_ERROR;
+          D->parse_state = htqp_skiptoeoln;
+        } else {
+          D->parse_state = htqp_skipspctoeoln;
+        }
+        break;
 
-          tt = D->data_size;
-          while (ptr < ptr_e && *ptr >= '0' && *ptr <= '9') {
-            if (tt >= 0x7fffffffL / 10) {
-              D->query_flags |= QF_ERROR;
-              D->parse_state = htqp_skiptoeoln;
-              break;
-            }
-            tt = tt * 10 + (*ptr - '0');
-            ptr++;
-            D->header_size++;
-            D->query_flags &= ~QF_DATASIZE;
-          }
+      case htqp_skiptoeoln:
+        //fprintf (stderr, "htqp_skiptoeoln: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
 
-          D->data_size = tt;
-          if (ptr == ptr_e) {
-            break;
-          }
+        while (D->header_size < MAX_HTTP_HEADER_SIZE && ptr < ptr_e && (*ptr != '\r' && *ptr != '\n')) {
+          D->header_size++;
+          ptr++;
+        }
+        if (D->header_size >= MAX_HTTP_HEADER_SIZE) {
+          D->parse_state = htqp_fatal;
+          break;
+        }
+        if (ptr == ptr_e) {
+          break;
+        }
 
-          if (D->query_flags & QF_DATASIZE) {
-            D->query_flags |= QF_ERROR;
-            D->parse_state = htqp_skiptoeoln;
-          } else {
-            D->parse_state = htqp_skipspctoeoln;
-          }
+        D->parse_state = htqp_eoln;
+
+      case htqp_eoln:
+
+        if (ptr == ptr_e) {
           break;
+        }
+        if (*ptr == '\r') {
+          ptr++;
+          D->header_size++;
+        }
+        D->parse_state = htqp_wantlf;
 
-        case htqp_skiptoeoln:
-          //fprintf (stderr, "htqp_skiptoeoln: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+      case htqp_wantlf:
+        //fprintf (stderr, "htqp_wantlf: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
 
-          while (D->header_size < MAX_HTTP_HEADER_SIZE && ptr < ptr_e && (*ptr != '\r' && *ptr != '\n')) {
-            D->header_size++;
-            ptr++;
-          }
-          if (D->header_size >= MAX_HTTP_HEADER_SIZE) {
+        if (ptr == ptr_e) {
+          break;
+        }
+        if (++D->query_words < 8) {
+          D->query_words = 8;
+          if (D->query_flags & QF_ERROR) {
             D->parse_state = htqp_fatal;
             break;
           }
-          if (ptr == ptr_e) {
-            break;
-          }
+        }
 
-          D->parse_state = htqp_eoln;
+        if (D->http_ver <= HTTP_V09) {
+          D->parse_state = htqp_wantlastlf;
+          break;
+        }
 
-        case htqp_eoln:
+        if (*ptr != '\n') {
+          D->query_flags |= QF_ERROR;
+          D->parse_state = htqp_skiptoeoln;
+          break;
+        }
 
-          if (ptr == ptr_e) {
-            break;
-          }
-          if (*ptr == '\r') {
-            ptr++;
-            D->header_size++;
-          }
-          D->parse_state = htqp_wantlf;
+        ptr++;
+        D->header_size++;
 
-        case htqp_wantlf:
-          //fprintf (stderr, "htqp_wantlf: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+        D->parse_state = htqp_linestart;
 
-          if (ptr == ptr_e) {
-            break;
-          }
-          if (++D->query_words < 8) {
-            D->query_words = 8;
-            if (D->query_flags & QF_ERROR) {
-              D->parse_state = htqp_fatal;
-              break;
-            }
-          }
+      case htqp_linestart:
+        //fprintf (stderr, "htqp_linestart: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
 
-          if (D->http_ver <= HTTP_V09) {
-            D->parse_state = htqp_wantlastlf;
-            break;
-          }
+        if (ptr == ptr_e) {
+          break;
+        }
 
-          if (*ptr != '\n') {
-            D->query_flags |= QF_ERROR;
-            D->parse_state = htqp_skiptoeoln;
-            break;
-          }
+        if (!D->first_line_size) {
+          D->first_line_size = D->header_size;
+        }
 
+        if (*ptr == '\r') {
           ptr++;
           D->header_size++;
+          D->parse_state = htqp_wantlastlf;
+          break;
+        }
+        if (*ptr == '\n') {
+          D->parse_state = htqp_wantlastlf;
+          break;
+        }
 
-          D->parse_state = htqp_linestart;
+        if (D->query_flags & QF_ERROR) {
+          D->parse_state = htqp_skiptoeoln;
+        } else {
+          D->wlen = 0;
+          D->parse_state = htqp_readtocolon;
+        }
+        break;
 
-        case htqp_linestart:
-          //fprintf (stderr, "htqp_linestart: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+      case htqp_wantlastlf:
+        //fprintf (stderr, "htqp_wantlastlf: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
 
-          if (ptr == ptr_e) {
-            break;
-          }
+        if (ptr == ptr_e) {
+          break;
+        }
+        if (*ptr != '\n') {
+          D->parse_state = htqp_fatal;
+          break;
+        }
+        ptr++;
+        D->header_size++;
 
-          if (!D->first_line_size) {
-            D->first_line_size = D->header_size;
-          }
+        if (!D->first_line_size) {
+          D->first_line_size = D->header_size;
+        }
 
-          if (*ptr == '\r') {
-            ptr++;
-            D->header_size++;
-            D->parse_state = htqp_wantlastlf;
-            break;
-          }
-          if (*ptr == '\n') {
-            D->parse_state = htqp_wantlastlf;
-            break;
-          }
+        D->parse_state = htqp_done;
 
-          if (D->query_flags & QF_ERROR) {
-            D->parse_state = htqp_skiptoeoln;
-          } else {
-            D->wlen = 0;
-            D->parse_state = htqp_readtocolon;
-          }
-          break;
+      case htqp_done:
+        //fprintf (stderr, "htqp_done: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+        break;
 
-        case htqp_wantlastlf:
-          //fprintf (stderr, "htqp_wantlastlf: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+      case htqp_fatal:
+        //fprintf (stderr, "htqp_fatal: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
+        D->query_flags |= QF_ERROR;
+        D->parse_state = htqp_done;
+        break;
 
-          if (ptr == ptr_e) {
-            break;
-          }
-          if (*ptr != '\n') {
-            D->parse_state = htqp_fatal;
-            break;
-          }
-          ptr++;
-          D->header_size++;
+      default:
+        assert (0);
+    }
+  }
 
-          if (!D->first_line_size) {
-            D->first_line_size = D->header_size;
-          }
+  return ptr - ptr_s;
+}
 
-          D->parse_state = htqp_done;
+int hts_parse_execute (connection_job_t C) {
+  struct connection_info *c = CONN_INFO (C);
+  
+  struct hts_data *D = HTS_DATA(C);
+  char *ptr, *ptr_s, *ptr_e;
+  int len;
 
-        case htqp_done:
-          //fprintf (stderr, "htqp_done: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
-          break;
+  D->parse_state = htqp_start;
 
-        case htqp_fatal:
-          //fprintf (stderr, "htqp_fatal: ptr=%p (%.8s), hsize=%d, qf=%d, words=%d\n", ptr, ptr, D->header_size, D->query_flags, D->query_words);
-          D->query_flags |= QF_ERROR;
-          D->parse_state = htqp_done;
-          break;
+  struct raw_message raw;
+  rwm_clone (&raw, &c->in);
+
+  while (c->status == conn_working && !c->pending_queries && raw.total_bytes) {
+    if (c->flags & (C_ERROR | C_STOPPARSE)) {
+      break;
+    }
+   
+    len = rwm_get_block_ptr_bytes (&raw);
+    assert (len > 0);
+    ptr = ptr_s = rwm_get_block_ptr (&raw);
+    ptr_e = ptr + len;
+
+    assert (ptr);
 
-        default:
-          assert (0);
+    if (D->parse_state == htqp_start) {
+      int r = hts_parse_header_fast (D, ptr, len);
+      if (r > 0) {
+        ptr += r;
       }
     }
+    ptr += hts_parse_header_bytes (D, ptr, ptr_e - ptr);
 
     len = ptr - ptr_s;
     assert (rwm_skip_data (&raw, len) == len);
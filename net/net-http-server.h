@@ -105,6 +105,29 @@ extern long long http_queries, http_bad_headers, http_queries_size;
 
 extern char *extra_http_response_headers;
 
+/* for hts_data.parse_state */
+enum http_query_parse_state {
+  htqp_start,
+  htqp_readtospace,
+  htqp_readtocolon,
+  htqp_readint,
+  htqp_skipspc,
+  htqp_skiptoeoln,
+  htqp_skipspctoeoln,
+  htqp_eoln,
+  htqp_wantlf,
+  htqp_wantlastlf,
+  htqp_linestart,
+  htqp_fatal,
+  htqp_done
+};
+
+/* request header parsing on a flat buffer starting with D->parse_state == htqp_start */
+/* one pass over a complete well-formed header; -1 - not handled, D untouched */
+int hts_parse_header_fast (struct hts_data *D, const char *ptr, int len);
+/* state machine, can be fed piece by piece; returns bytes consumed, D->parse_state == htqp_done at header end */
+int hts_parse_header_bytes (struct hts_data *D, const char *ptr, int len);
+
 /* useful functions */
 int get_http_header (const char *qHeaders, const int qHeadersLen, char *buffer, int b_len, const char *arg_name, const int arg_len);
 
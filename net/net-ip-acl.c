@@ -0,0 +1,442 @@
+/*
+ * net-ip-acl.c - Скомпилированные списки доступа по IP (blacklist/whitelist)
+ *
+ * Poptrie: таблица прямого доступа по старшим 16 битам, затем узлы по 64
+ * ячейки (шаг 6 бит). Узел хранит только битовые векторы: какие ячейки -
+ * дочерние узлы и где начинаются серии одинаковых листьев; дети и листья лежат
+ * непрерывными блоками и индексируются через popcount. Поэтому разреженные
+ * наборы (/32 из abuse-списков, длинные IPv6-префиксы) стоят десятки байт на
+ * узел, а не килобайты, как при развёртке по байтам.
+ *
+ * Таблица компилируется один раз из отсортированного списка префиксов; флаги
+ * объединяются по OR, так что порядок префиксов в файлах не важен.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+
+#include "net/net-ip-acl.h"
+
+struct ip_acl *ip_acl_alloc (void) {
+  return calloc (1, sizeof (struct ip_acl));
+}
+
+static void acl_table_free (struct ip_acl_table *T) {
+  free (T->direct);
+  free (T->nodes);
+  free (T->leaves);
+  free (T->pending);
+}
+
+void ip_acl_free (struct ip_acl *A) {
+  if (!A) {
+    return;
+  }
+  acl_table_free (&A->v4);
+  acl_table_free (&A->v6);
+  free (A);
+}
+
+/* 6 бит ключа, начиная с бита off (считая от старшего); за концом адреса - нули */
+static inline unsigned acl_key_bits (unsigned long long hi, unsigned long long lo, int off) {
+  if (off <= 64 - IP_ACL_STRIDE) {
+    return (hi >> (64 - IP_ACL_STRIDE - off)) & 63;
+  }
+  if (off >= 64) {
+    int shift = 128 - IP_ACL_STRIDE - off;
+    return (shift >= 0 ? lo >> shift : lo << -shift) & 63;
+  }
+  return ((hi << (off - 64 + IP_ACL_STRIDE)) | (lo >> (128 - IP_ACL_STRIDE - off))) & 63;
+}
+
+static inline unsigned long long acl_mask_upto (unsigned v) {
+  return (2ULL << v) - 1;
+}
+
+/* Поиск в узлах ниже таблицы прямого доступа */
+static inline unsigned acl_walk (const struct ip_acl_table *T, unsigned node, unsigned long long hi, unsigned long long lo) {
+  const struct ip_acl_node *n = &T->nodes[node];
+  int off = IP_ACL_DIRECT_BITS;
+  unsigned v = acl_key_bits (hi, lo, off);
+  while (n->vector & (1ULL << v)) {
+    n = &T->nodes[n->base1 + __builtin_popcountll (n->vector & acl_mask_upto (v)) - 1];
+    off += IP_ACL_STRIDE;
+    v = acl_key_bits (hi, lo, off);
+  }
+  return T->leaves[n->base0 + __builtin_popcountll (n->leafvec & acl_mask_upto (v)) - 1];
+}
+
+static int acl_add_prefix (struct ip_acl *A, struct ip_acl_table *T, unsigned long long hi, unsigned long long lo, int prefix_len, int key_bits, unsigned flags) {
+  if (A->compiled || prefix_len < 0 || prefix_len > key_bits || !flags || flags > 0xffff) {
+    return -1;
+  }
+  if (T->pending_count == T->pending_size) {
+    int size = T->pending_size ? T->pending_size * 2 : 1024;
+    struct ip_acl_prefix *p = realloc (T->pending, (size_t) size * sizeof (*p));
+    if (!p) {
+      return -1;
+    }
+    T->pending = p;
+    T->pending_size = size;
+  }
+  /* Обнуляем биты за длиной префикса: префиксы одного поддерева идут подряд после сортировки */
+  if (prefix_len <= 64) {
+    hi &= prefix_len ? ~0ULL << (64 - prefix_len) : 0;
+    lo = 0;
+  } else {
+    lo &= prefix_len < 128 ? ~0ULL << (128 - prefix_len) : ~0ULL;
+  }
+  struct ip_acl_prefix *p = &T->pending[T->pending_count++];
+  p->hi = hi;
+  p->lo = lo;
+  p->len = prefix_len;
+  p->flags = flags;
+  A->prefixes++;
+  return 0;
+}
+
+int ip_acl_add_ipv4 (struct ip_acl *A, unsigned ip, int prefix_len, unsigned flags) {
+  return acl_add_prefix (A, &A->v4, (unsigned long long) ip << 32, 0, prefix_len, 32, flags);
+}
+
+static unsigned long long acl_load_be64 (const unsigned char *p) {
+  unsigned long long x = 0;
+  for (int i = 0; i < 8; i++) {
+    x = (x << 8) | p[i];
+  }
+  return x;
+}
+
+int ip_acl_add_ipv6 (struct ip_acl *A, const unsigned char ipv6[16], int prefix_len, unsigned flags) {
+  return acl_add_prefix (A, &A->v6, acl_load_be64 (ipv6), acl_load_be64 (ipv6 + 8), prefix_len, 128, flags);
+}
+
+int ip_acl_add_cidr (struct ip_acl *A, const char *cidr, unsigned flags) {
+  char buf[64];
+  size_t len = strlen (cidr);
+  if (!len || len >= sizeof (buf)) {
+    return -1;
+  }
+  memcpy (buf, cidr, len + 1);
+
+  int prefix_len = -1;
+  char *slash = strchr (buf, '/');
+  if (slash) {
+    char *end;
+    *slash = 0;
+    long l = strtol (slash + 1, &end, 10);
+    if (end == slash + 1 || *end || l < 0 || l > 128) {
+      return -1;
+    }
+    prefix_len = (int) l;
+  } else if (buf[len - 1] == '*') {
+    /* Устаревшая форма "a.b.c.*": префикс из заданных октетов */
+    int octets = 0;
+    char *p = buf;
+    unsigned ip = 0;
+    while (*p != '*') {
+      char *end;
+      long v = strtol (p, &end, 10);
+      if (end == p || *end != '.' || v < 0 || v > 255 || octets == 3) {
+        return -1;
+      }
+      ip = (ip << 8) | (unsigned) v;
+      octets++;
+      p = end + 1;
+    }
+    if (p[1]) {
+      return -1;
+    }
+    return ip_acl_add_ipv4 (A, octets ? ip << (8 * (4 - octets)) : 0, octets * 8, flags);
+  }
+
+  struct in_addr a4;
+  struct in6_addr a6;
+  if (inet_pton (AF_INET, buf, &a4) == 1) {
+    if (prefix_len > 32) {
+      return -1;
+    }
+    return ip_acl_add_ipv4 (A, ntohl (a4.s_addr), prefix_len < 0 ? 32 : prefix_len, flags);
+  }
+  if (inet_pton (AF_INET6, buf, &a6) == 1) {
+    return ip_acl_add_ipv6 (A, a6.s6_addr, prefix_len < 0 ? 128 : prefix_len, flags);
+  }
+  return -1;
+}
+
+int ip_acl_load_file (struct ip_acl *A, const char *filename, unsigned flags) {
+  FILE *f = fopen (filename, "r");
+  if (!f) {
+    return -1;
+  }
+
+  char line[512];
+  int loaded = 0;
+  while (fgets (line, sizeof (line), f)) {
+    char *p = line;
+    while (isspace ((unsigned char) *p)) {
+      p++;
+    }
+    if (!*p || *p == '#') {
+      continue;
+    }
+    char *end = p;
+    while (*end && !isspace ((unsigned char) *end) && *end != '#') {
+      end++;
+    }
+    *end = 0;
+    if (ip_acl_add_cidr (A, p, flags) < 0) {
+      A->errors++;
+    } else {
+      loaded++;
+    }
+  }
+
+  fclose (f);
+  return loaded;
+}
+
+static int acl_prefix_cmp (const void *a, const void *b) {
+  const struct ip_acl_prefix *x = a, *y = b;
+  if (x->hi != y->hi) {
+    return x->hi < y->hi ? -1 : 1;
+  }
+  if (x->lo != y->lo) {
+    return x->lo < y->lo ? -1 : 1;
+  }
+  return x->len - y->len;
+}
+
+static int acl_reserve_nodes (struct ip_acl_table *T, int count) {
+  if (T->nodes_count + count > T->nodes_size) {
+    int size = T->nodes_size ? T->nodes_size : 1024;
+    while (size < T->nodes_count + count) {
+      if (size > (1 << 29)) {
+        return -1;
+      }
+      size *= 2;
+    }
+    struct ip_acl_node *nodes = realloc (T->nodes, (size_t) size * sizeof (*nodes));
+    if (!nodes) {
+      return -1;
+    }
+    T->nodes = nodes;
+    T->nodes_size = size;
+  }
+  int base = T->nodes_count;
+  T->nodes_count += count;
+  return base;
+}
+
+static int acl_push_leaf (struct ip_acl_table *T, unsigned value) {
+  if (T->leaves_count == T->leaves_size) {
+    int size = T->leaves_size ? T->leaves_size * 2 : 4096;
+    unsigned short *leaves = realloc (T->leaves, (size_t) size * sizeof (*leaves));
+    if (!leaves) {
+      return -1;
+    }
+    T->leaves = leaves;
+    T->leaves_size = size;
+  }
+  T->leaves[T->leaves_count++] = value;
+  return 0;
+}
+
+/*
+ * Узел на глубине depth; P[lo..hi) - отсортированные префиксы из его диапазона
+ * (более короткие, уже учтённые в inherit, пропускаются). Дочерние узлы
+ * занимают непрерывный блок, поэтому индекс ребёнка - base1 + popcount.
+ */
+static int acl_build_node (struct ip_acl_table *T, const struct ip_acl_prefix *P, int lo, int hi, int depth, unsigned inherit, int node) {
+  unsigned val[64];
+  int run_start[64], run_end[64];
+  unsigned long long vector = 0, leafvec = 0;
+  int i, s;
+
+  for (s = 0; s < 64; s++) {
+    val[s] = inherit;
+  }
+  for (i = lo; i < hi; i++) {
+    int len = P[i].len;
+    if (len <= depth || len > depth + IP_ACL_STRIDE) {
+      continue;
+    }
+    int span = 1 << (depth + IP_ACL_STRIDE - len);
+    int first = acl_key_bits (P[i].hi, P[i].lo, depth) & ~(span - 1);
+    for (s = first; s < first + span; s++) {
+      val[s] |= P[i].flags;
+    }
+  }
+
+  for (i = lo; i < hi; ) {
+    int j = i, deep = 0;
+    s = acl_key_bits (P[i].hi, P[i].lo, depth);
+    while (j < hi && (int) acl_key_bits (P[j].hi, P[j].lo, depth) == s) {
+      deep |= P[j].len > depth + IP_ACL_STRIDE;
+      j++;
+    }
+    if (deep) {
+      vector |= 1ULL << s;
+      run_start[s] = i;
+      run_end[s] = j;
+    }
+    i = j;
+  }
+
+  /* Соседние листья с одинаковым значением хранятся один раз */
+  unsigned base0 = T->leaves_count;
+  int have_leaf = 0;
+  unsigned last = 0;
+  for (s = 0; s < 64; s++) {
+    if ((vector >> s) & 1) {
+      continue;
+    }
+    if (!have_leaf || val[s] != last) {
+      if (acl_push_leaf (T, val[s]) < 0) {
+        return -1;
+      }
+      leafvec |= 1ULL << s;
+      last = val[s];
+      have_leaf = 1;
+    }
+  }
+
+  int base1 = 0;
+  if (vector) {
+    base1 = acl_reserve_nodes (T, __builtin_popcountll (vector));
+    if (base1 < 0) {
+      return -1;
+    }
+  }
+  T->nodes[node].vector = vector;
+  T->nodes[node].leafvec = leafvec;
+  T->nodes[node].base0 = base0;
+  T->nodes[node].base1 = base1;
+
+  int child = base1;
+  for (s = 0; s < 64; s++) {
+    if (((vector >> s) & 1) && acl_build_node (T, P, run_start[s], run_end[s], depth + IP_ACL_STRIDE, val[s], child++) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int acl_compile_table (struct ip_acl_table *T) {
+  const int direct_size = 1 << IP_ACL_DIRECT_BITS;
+  const int shift = 64 - IP_ACL_DIRECT_BITS;
+  struct ip_acl_prefix *P = T->pending;
+  int n = T->pending_count;
+
+  if (!n) {
+    return 0;
+  }
+  qsort (P, n, sizeof (*P), acl_prefix_cmp);
+
+  T->direct = calloc (direct_size, sizeof (unsigned));
+  if (!T->direct) {
+    return -1;
+  }
+  for (int i = 0; i < n; i++) {
+    if (P[i].len <= IP_ACL_DIRECT_BITS) {
+      int span = 1 << (IP_ACL_DIRECT_BITS - P[i].len);
+      int first = (int) (P[i].hi >> shift) & ~(span - 1);
+      for (int s = first; s < first + span; s++) {
+        T->direct[s] |= P[i].flags;
+      }
+    }
+  }
+
+  for (int s = 0; s < direct_size; s++) {
+    T->direct[s] |= IP_ACL_LEAF;
+  }
+
+  for (int i = 0; i < n; ) {
+    int s = (int) (P[i].hi >> shift), j = i, deep = 0;
+    while (j < n && (int) (P[j].hi >> shift) == s) {
+      deep |= P[j].len > IP_ACL_DIRECT_BITS;
+      j++;
+    }
+    if (deep) {
+      int node = acl_reserve_nodes (T, 1);
+      if (node < 0 || acl_build_node (T, P, i, j, IP_ACL_DIRECT_BITS, T->direct[s] & ~IP_ACL_LEAF, node) < 0) {
+        return -1;
+      }
+      T->direct[s] = node;
+    }
+    i = j;
+  }
+
+  free (T->pending);
+  T->pending = 0;
+  T->pending_count = T->pending_size = 0;
+  return 0;
+}
+
+int ip_acl_compile (struct ip_acl *A) {
+  if (A->compiled) {
+    return 0;
+  }
+  A->compiled = 1;
+  if (acl_compile_table (&A->v4) < 0 || acl_compile_table (&A->v6) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+unsigned ip_acl_lookup_ipv4 (const struct ip_acl *A, unsigned ip) {
+  const struct ip_acl_table *T = &A->v4;
+  if (!T->direct) {
+    return 0;
+  }
+  unsigned e = T->direct[ip >> 16];
+  if (e & IP_ACL_LEAF) {
+    return e & ~IP_ACL_LEAF;
+  }
+  return acl_walk (T, e, (unsigned long long) ip << 32, 0);
+}
+
+unsigned ip_acl_lookup_ipv6 (const struct ip_acl *A, const unsigned char ipv6[16]) {
+  const struct ip_acl_table *T = &A->v6;
+  if (!T->direct) {
+    return 0;
+  }
+  unsigned e = T->direct[(ipv6[0] << 8) | ipv6[1]];
+  if (e & IP_ACL_LEAF) {
+    return e & ~IP_ACL_LEAF;
+  }
+  return acl_walk (T, e, acl_load_be64 (ipv6), acl_load_be64 (ipv6 + 8));
+}
+
+unsigned ip_acl_lookup (const struct ip_acl *A, unsigned ip, const unsigned char ipv6[16]) {
+  static const unsigned char v4_mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+  if (ip || !ipv6) {
+    return ip_acl_lookup_ipv4 (A, ip);
+  }
+  if (!memcmp (ipv6, v4_mapped, 12)) {
+    return ip_acl_lookup_ipv4 (A, ((unsigned) ipv6[12] << 24) | (ipv6[13] << 16) | (ipv6[14] << 8) | ipv6[15]);
+  }
+  return ip_acl_lookup_ipv6 (A, ipv6);
+}
+
+int ip_acl_rejects (const struct ip_acl *A, unsigned ip, const unsigned char ipv6[16]) {
+  unsigned flags = ip_acl_lookup (A, ip, ipv6);
+  if (flags & IP_ACL_WHITELIST) {
+    return 0;
+  }
+  return A->whitelist_only || (flags & IP_ACL_BLACKLIST);
+}
+
+static long long acl_table_memory (const struct ip_acl_table *T) {
+  return (T->direct ? (long long) sizeof (unsigned) << IP_ACL_DIRECT_BITS : 0) +
+         (long long) T->nodes_size * sizeof (struct ip_acl_node) +
+         (long long) T->leaves_size * sizeof (unsigned short) +
+         (long long) T->pending_size * sizeof (struct ip_acl_prefix);
+}
+
+long long ip_acl_memory (const struct ip_acl *A) {
+  return sizeof (*A) + acl_table_memory (&A->v4) + acl_table_memory (&A->v6);
+}
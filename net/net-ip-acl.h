@@ -0,0 +1,82 @@
+/*
+ * net-ip-acl.h - Скомпилированные списки доступа по IP (blacklist/whitelist)
+ *
+ * Префиксы IPv4/IPv6 в нотации CIDR компилируются в poptrie: старшие 16 бит
+ * адреса индексируют таблицу прямого доступа, далее идут узлы с шагом 6 бит,
+ * где дочерние узлы и листья адресуются через popcount битовых векторов.
+ * Лист хранит объединение (OR) флагов IP_ACL_* всех префиксов, покрывающих
+ * адрес.
+ *
+ * Порядок работы: ip_acl_alloc, ip_acl_add_* / ip_acl_load_file,
+ * ip_acl_compile, затем только поиск. Скомпилированная таблица не меняется:
+ * перезагрузка строит новую и подменяет указатель, старая освобождается
+ * отложенно.
+ */
+
+#pragma once
+
+#define IP_ACL_BLACKLIST 1
+#define IP_ACL_WHITELIST 2
+
+#define IP_ACL_DIRECT_BITS 16
+#define IP_ACL_STRIDE 6
+#define IP_ACL_LEAF 0x80000000u
+
+struct ip_acl_node {
+  unsigned long long vector;   /* бит i: ячейка i - дочерний узел */
+  unsigned long long leafvec;  /* бит i: с ячейки i начинается новая серия одинаковых листьев */
+  unsigned base0;              /* первый лист узла в leaves */
+  unsigned base1;              /* первый дочерний узел в nodes */
+};
+
+/* Ключ - адрес, выровненный по старшим битам: IPv4 в hi << 32, IPv6 в hi:lo */
+struct ip_acl_prefix {
+  unsigned long long hi, lo;
+  int len;
+  unsigned flags;
+};
+
+struct ip_acl_table {
+  unsigned *direct;            /* IP_ACL_LEAF | флаги, либо индекс узла */
+  struct ip_acl_node *nodes;
+  unsigned short *leaves;
+  int nodes_count, nodes_size;
+  int leaves_count, leaves_size;
+  struct ip_acl_prefix *pending;  /* добавленные префиксы до ip_acl_compile */
+  int pending_count, pending_size;
+};
+
+struct ip_acl {
+  struct ip_acl_table v4, v6;
+  int prefixes;       /* добавлено префиксов */
+  int errors;         /* строк, которые не удалось разобрать при загрузке */
+  int compiled;
+  int whitelist_only; /* отклонять всё, что не попало в whitelist */
+};
+
+struct ip_acl *ip_acl_alloc (void);
+void ip_acl_free (struct ip_acl *A);
+
+/* ip - в порядке байт хоста, как CONN_INFO(C)->remote_ip */
+int ip_acl_add_ipv4 (struct ip_acl *A, unsigned ip, int prefix_len, unsigned flags);
+int ip_acl_add_ipv6 (struct ip_acl *A, const unsigned char ipv6[16], int prefix_len, unsigned flags);
+
+/* "10.0.0.0/8", "192.168.1.7", "2001:db8::/32", устаревшая форма "192.168.1.*" */
+int ip_acl_add_cidr (struct ip_acl *A, const char *cidr, unsigned flags);
+
+/* Один префикс на строку, после префикса и после '#' - комментарий; возвращает число префиксов или -1 */
+int ip_acl_load_file (struct ip_acl *A, const char *filename, unsigned flags);
+
+/* Сборка таблиц поиска из добавленных префиксов; после неё добавлять нельзя */
+int ip_acl_compile (struct ip_acl *A);
+
+unsigned ip_acl_lookup_ipv4 (const struct ip_acl *A, unsigned ip);
+unsigned ip_acl_lookup_ipv6 (const struct ip_acl *A, const unsigned char ipv6[16]);
+
+/* Адрес в паре remote_ip/remote_ipv6: ip != 0 - IPv4, иначе IPv6 (в т.ч. 4in6) */
+unsigned ip_acl_lookup (const struct ip_acl *A, unsigned ip, const unsigned char ipv6[16]);
+
+/* 1, если подключение с адреса нужно отклонить */
+int ip_acl_rejects (const struct ip_acl *A, unsigned ip, const unsigned char ipv6[16]);
+
+long long ip_acl_memory (const struct ip_acl *A);
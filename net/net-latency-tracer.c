@@ -0,0 +1,139 @@
+/*
+ * net-latency-tracer.c - выборочная трассировка задержек запроса по этапам прокси
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/common-stats.h"
+#include "common/precise-time.h"
+#include "jobs/jobs.h"
+#include "net/net-latency-tracer.h"
+
+int latency_trace_rate;
+
+__thread long long latency_trace_rx;
+__thread struct latency_trace *latency_trace_cur;
+
+/* наносекунд на такт rdtsc, из latency_trace_init */
+static double ns_per_tick = 1;
+
+static const char *stage_names[LT_STAGES] = {
+  "parse", "queue", "forward", "me_write", "middle_end", "reply_queue", "client_write", "total"
+};
+
+#define MODULE latency_tracer
+
+MODULE_STAT_TYPE {
+  struct latency_trace_stat S;
+  int countdown;
+};
+
+MODULE_INIT
+
+void latency_trace_init (void) {
+  if (!latency_trace_rate) {
+    return;
+  }
+  /* get_utime_monotonic обновляет precise_now и precise_now_rdtsc вместе */
+  double t0 = get_utime_monotonic ();
+  long long r0 = precise_now_rdtsc;
+  precise_sleep (0, 20000000);
+  double t1 = get_utime_monotonic ();
+  long long r1 = precise_now_rdtsc;
+  if (r1 > r0 && t1 > t0) {
+    ns_per_tick = (t1 - t0) * 1e9 / (r1 - r0);
+  }
+}
+
+int latency_trace_sample (void) {
+  if (--MODULE_STAT->countdown > 0) {
+    return 0;
+  }
+  MODULE_STAT->countdown = latency_trace_rate;
+  MODULE_STAT->S.sampled ++;
+  return 1;
+}
+
+static void latency_trace_record (int stage, long long ticks) {
+  /* часы разных ядер могут расходиться на несколько тактов */
+  long long ns = ticks > 0 ? (long long) (ticks * ns_per_tick) : 0;
+  int b = ns < 256 ? 0 : 56 - __builtin_clzll (ns);
+  if (b >= LATENCY_TRACE_BUCKETS) {
+    b = LATENCY_TRACE_BUCKETS - 1;
+  }
+  struct latency_trace_stat *S = &MODULE_STAT->S;
+  S->count[stage] ++;
+  S->sum_ns[stage] += ns;
+  S->hist[stage][b] ++;
+}
+
+void latency_trace_stage (struct latency_trace *T, int stage, long long at) {
+  latency_trace_record (stage, at - T->last);
+  T->last = at;
+}
+
+void latency_trace_finish (struct latency_trace *T, int stage) {
+  latency_trace_stage (T, stage, rdtsc ());
+  latency_trace_record (LT_TOTAL, T->last - T->start);
+  T->start = 0;
+}
+
+void latency_trace_stat_add (struct latency_trace_stat *T, const struct latency_trace_stat *F) {
+  int i, j;
+  T->sampled += F->sampled;
+  for (i = 0; i < LT_STAGES; i++) {
+    T->count[i] += F->count[i];
+    T->sum_ns[i] += F->sum_ns[i];
+    for (j = 0; j < LATENCY_TRACE_BUCKETS; j++) {
+      T->hist[i][j] += F->hist[i][j];
+    }
+  }
+}
+
+void fetch_latency_trace_stat (struct latency_trace_stat *S) {
+  int i;
+  memset (S, 0, sizeof (*S));
+  for (i = 0; i <= max_job_thread_id; i++) {
+    MODULE_STAT_TYPE *T = MODULE_STAT_ARR[i];
+    if (T) {
+      latency_trace_stat_add (S, &T->S);
+    }
+  }
+}
+
+/* верхняя граница бакета, в котором набирается доля q выборки, мкс */
+static double latency_trace_percentile (const struct latency_trace_stat *S, int stage, double q) {
+  long long need = (long long) (q * S->count[stage] + 0.999999), have = 0;
+  int b;
+  for (b = 0; b < LATENCY_TRACE_BUCKETS - 1; b++) {
+    have += S->hist[stage][b];
+    if (have >= need) {
+      break;
+    }
+  }
+  return (256LL << b) / 1000.0;
+}
+
+void latency_trace_print_stat (stats_buffer_t *sb, const struct latency_trace_stat *S) {
+  int i, j;
+  sb_printf (sb, "latency_trace_rate\t%d\nlatency_trace_sampled\t%lld\n", latency_trace_rate, S->sampled);
+  for (i = 0; i < LT_STAGES; i++) {
+    if (!S->count[i]) {
+      continue;
+    }
+    char hist[LATENCY_TRACE_BUCKETS * 21], *p = hist;
+    int last = LATENCY_TRACE_BUCKETS - 1;
+    while (!S->hist[i][last]) {
+      last--;
+    }
+    for (j = 0; j <= last; j++) {
+      p += sprintf (p, j ? ",%lld" : "%lld", S->hist[i][j]);
+    }
+    sb_printf (sb, "latency_%s\tcount=%lld avg_us=%.3f p50_us=%.3f p90_us=%.3f p99_us=%.3f hist=%s\n",
+	       stage_names[i], S->count[i], S->sum_ns[i] / 1000.0 / S->count[i],
+	       latency_trace_percentile (S, i, 0.5), latency_trace_percentile (S, i, 0.9),
+	       latency_trace_percentile (S, i, 0.99), hist);
+  }
+}
@@ -0,0 +1,68 @@
+/*
+ * net-latency-tracer.h - выборочная трассировка задержек запроса по этапам прокси
+ *
+ * Каждый N-й кадр клиента (--trace-sample N) получает struct latency_trace,
+ * которая едет вместе с запросом: в rpcs_exec_data до движка, затем в
+ * ext_connection до ответа middle-end. На каждом этапе разница rdtsc с
+ * предыдущей отметкой попадает в log2-гистограмму этапа в статистике
+ * потока (MODULE_STAT), суммы видны в /stats.
+ *
+ * Выключенная трассировка стоит одной проверки latency_trace_rate на кадр
+ * и на ответ; rdtsc без выборки не читается.
+ */
+
+#pragma once
+
+#include "common/common-stats.h"
+#include "common/precise-time.h"
+
+enum latency_stage {
+  LT_PARSE,           /* вход в parse_execute - кадр выделен и отдан в execute */
+  LT_QUEUE,           /* execute - задача do_rpcs_execute взята движком */
+  LT_FORWARD,         /* forward_mtproto_packet: разбор, выбор middle-end и ext_connection */
+  LT_ME_WRITE,        /* RPC_PROXY_REQ собран и поставлен в очередь соединения middle-end */
+  LT_MIDDLE_END,      /* постановка в очередь - rpcc_execute с ответом: сокеты и сам middle-end */
+  LT_REPLY_QUEUE,     /* rpcc_execute - задача разбора ответа взята движком */
+  LT_CLIENT_WRITE,    /* ответ поставлен в очередь соединения клиента */
+  LT_TOTAL,           /* от входа в parse_execute до постановки ответа клиенту */
+  LT_STAGES
+};
+
+/* бакет 0 - до 256 нс, бакет i - [2^(i+7), 2^(i+8)) нс, последний - всё дольше */
+#define LATENCY_TRACE_BUCKETS 24
+
+struct latency_trace {
+  long long start;    /* rdtsc первой отметки, 0 - запрос не в выборке */
+  long long last;     /* rdtsc последней отметки */
+};
+
+struct latency_trace_stat {
+  long long sampled;
+  long long count[LT_STAGES];
+  long long sum_ns[LT_STAGES];
+  long long hist[LT_STAGES][LATENCY_TRACE_BUCKETS];
+};
+
+/* 1 из N кадров, 0 - выключено; задаётся до latency_trace_init */
+extern int latency_trace_rate;
+
+/* rdtsc входа в parse_execute текущего потока, пока latency_trace_rate != 0 */
+extern __thread long long latency_trace_rx;
+/* трасса запроса, который движок сейчас пересылает, или 0 */
+extern __thread struct latency_trace *latency_trace_cur;
+
+/* калибрует rdtsc по get_utime_monotonic; до запуска рабочих процессов */
+void latency_trace_init (void);
+
+/* очередной кадр потока попадает в выборку; только при latency_trace_rate != 0 */
+int latency_trace_sample (void);
+
+/* записывает этап: at - T->last в гистограмму stage, T->last = at */
+void latency_trace_stage (struct latency_trace *T, int stage, long long at);
+/* последний этап и LT_TOTAL */
+void latency_trace_finish (struct latency_trace *T, int stage);
+
+void fetch_latency_trace_stat (struct latency_trace_stat *S);
+void latency_trace_stat_add (struct latency_trace_stat *T, const struct latency_trace_stat *F);
+/* строки latency_<этап> со средним, перцентилями и гистограммой */
+void latency_trace_print_stat (stats_buffer_t *sb, const struct latency_trace_stat *S);
@@ -30,52 +30,264 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 #include "kprintf.h"
 #include "jobs/jobs.h"
 #include "common/common-stats.h"
 #include "common/server-functions.h"
+#include "net/net-fault-inject.h"
+#include "system/numa-allocator.h"
 
 #define MODULE raw_msg_buffer
 
 int allocated_buffer_chunks, max_allocated_buffer_chunks, max_buffer_chunks;
 long long max_allocated_buffer_bytes; 
+static int owned_buffer_chunks;
 
 MODULE_STAT_TYPE {
   long long total_used_buffers_size;
   int total_used_buffers;
   long long allocated_buffer_bytes;
   long long buffer_chunk_alloc_ops;
+  long long remote_freed_buffers;
+  // pushed minus drained by this thread; the sum over threads is what is parked on remote_free lists
+  long long remote_free_pending;
+  long long remote_free_pending_size;
 };
 
 MODULE_INIT
 
+/* {{{ chunk arena */
+
+/*
+  Chunks are carved from 2M-aligned slots: explicit huge pages (MAP_HUGETLB)
+  when the system has them reserved, otherwise anonymous memory advised for
+  transparent huge pages. Each slot is bound to the NUMA node of the thread
+  that asked for it, and a few freed slots per node are kept for reuse
+  instead of being unmapped.
+*/
+
+#define MSG_CHUNK_ARENA_CACHE 4
+
+enum { MSG_CHUNK_ARENA_MALLOC, MSG_CHUNK_ARENA_HUGETLB, MSG_CHUNK_ARENA_THP };
+
+struct chunk_arena_node {
+  int lock;
+  int cached;
+  void *cache[MSG_CHUNK_ARENA_CACHE];
+  int cache_kind[MSG_CHUNK_ARENA_CACHE];
+  int chunks;
+};
+
+static struct chunk_arena_node ChunkArena[MSG_BUFFERS_MAX_NODES];
+static long long arena_allocs[3];
+static int arena_nodes = 1;
+static __thread int msg_buffers_node = -1;
+static __thread int msg_buffers_node_ttl;
+
+/*
+  A thread pinned to one CPU never changes node. Unpinned threads
+  (--cpu-affinity none, a layout that gives a role several cores,
+  non-Linux builds) may be migrated, so their node is looked up again
+  every MSG_BUFFERS_NODE_TTL chunk requests.
+*/
+#define MSG_BUFFERS_NODE_TTL 256
+
+static int thread_pinned_to_one_cpu (void) {
+#ifdef __linux__
+  cpu_set_t set;
+  return !sched_getaffinity (0, sizeof (set), &set) && CPU_COUNT (&set) == 1;
+#else
+  return 0;
+#endif
+}
+
+static inline int current_buffers_node (void) {
+  if (arena_nodes <= 1) {
+    return 0;
+  }
+  if (msg_buffers_node < 0 || (msg_buffers_node_ttl > 0 && !--msg_buffers_node_ttl)) {
+    if (msg_buffers_node < 0) {
+      msg_buffers_node_ttl = thread_pinned_to_one_cpu () ? 0 : MSG_BUFFERS_NODE_TTL;
+    } else {
+      msg_buffers_node_ttl = MSG_BUFFERS_NODE_TTL;
+    }
+    msg_buffers_node = numa_get_current_node () % MSG_BUFFERS_MAX_NODES;
+    if (msg_buffers_node < 0) {
+      msg_buffers_node = 0;
+    }
+  }
+  return msg_buffers_node;
+}
+
+static void lock_arena_node (struct chunk_arena_node *A) {
+  while (__sync_lock_test_and_set (&A->lock, 1)) {
+    usleep (1000);
+  }
+}
+
+static void unlock_arena_node (struct chunk_arena_node *A) {
+  __sync_lock_release (&A->lock);
+}
+
+static void *arena_map_slot (int node, int *kind) {
+#ifndef _WIN32
+  void *p = mmap (0, MSG_BUFFERS_CHUNK_SLOT, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) {
+    *kind = MSG_CHUNK_ARENA_HUGETLB;
+  } else {
+    // over-allocate by one slot and trim to 2M alignment, so THP can back it with a single page
+    char *q = mmap (0, 2 * MSG_BUFFERS_CHUNK_SLOT, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (q == MAP_FAILED) {
+      p = NULL;
+    } else {
+      char *a = (char *) (((unsigned long) q + MSG_BUFFERS_CHUNK_SLOT - 1) & -MSG_BUFFERS_CHUNK_SLOT);
+      if (a > q) {
+        munmap (q, a - q);
+      }
+      if (a + MSG_BUFFERS_CHUNK_SLOT < q + 2 * MSG_BUFFERS_CHUNK_SLOT) {
+        munmap (a + MSG_BUFFERS_CHUNK_SLOT, q + 2 * MSG_BUFFERS_CHUNK_SLOT - a - MSG_BUFFERS_CHUNK_SLOT);
+      }
+#ifdef MADV_HUGEPAGE
+      madvise (a, MSG_BUFFERS_CHUNK_SLOT, MADV_HUGEPAGE);
+#endif
+      p = a;
+      *kind = MSG_CHUNK_ARENA_THP;
+    }
+  }
+  if (p) {
+    if (arena_nodes > 1) {
+      // before the first touch, so that every page lands on the node
+      numa_bind_memory_to_node (p, MSG_BUFFERS_CHUNK_SLOT, node);
+    }
+    return p;
+  }
+#endif
+  *kind = MSG_CHUNK_ARENA_MALLOC;
+  return malloc (MSG_BUFFERS_CHUNK_SIZE);
+}
+
+static struct msg_buffers_chunk *arena_alloc_chunk (int node) {
+  struct chunk_arena_node *A = &ChunkArena[node];
+  void *p = NULL;
+  int kind = MSG_CHUNK_ARENA_MALLOC;
+
+  lock_arena_node (A);
+  if (A->cached) {
+    A->cached--;
+    p = A->cache[A->cached];
+    kind = A->cache_kind[A->cached];
+  }
+  unlock_arena_node (A);
+
+  if (!p) {
+    p = arena_map_slot (node, &kind);
+    if (!p) {
+      return NULL;
+    }
+    __sync_fetch_and_add (&arena_allocs[kind], 1);
+  }
+  __sync_fetch_and_add (&A->chunks, 1);
+
+  struct msg_buffers_chunk *C = p;
+  C->node = node;
+  C->arena_kind = kind;
+  return C;
+}
+
+static void arena_free_chunk (struct msg_buffers_chunk *C) {
+  int node = C->node, kind = C->arena_kind;
+  struct chunk_arena_node *A = &ChunkArena[node];
+  __sync_fetch_and_add (&A->chunks, -1);
+
+  if (kind == MSG_CHUNK_ARENA_MALLOC) {
+    free (C);
+    return;
+  }
+  lock_arena_node (A);
+  if (A->cached < MSG_CHUNK_ARENA_CACHE) {
+    A->cache[A->cached] = C;
+    A->cache_kind[A->cached] = kind;
+    A->cached++;
+    C = NULL;
+  }
+  unlock_arena_node (A);
+#ifndef _WIN32
+  if (C) {
+    munmap (C, MSG_BUFFERS_CHUNK_SLOT);
+  }
+#endif
+}
+
+static void init_chunk_arena (void) {
+  arena_nodes = numa_get_node_count ();
+  if (arena_nodes > MSG_BUFFERS_MAX_NODES) {
+    arena_nodes = MSG_BUFFERS_MAX_NODES;
+  }
+}
+
+/* }}} */
+
 MODULE_STAT_FUNCTION
   SB_SUM_ONE_LL (total_used_buffers_size);
   SB_SUM_ONE_I (total_used_buffers);
   SB_SUM_ONE_LL (allocated_buffer_bytes);
   SB_SUM_ONE_LL (buffer_chunk_alloc_ops);
+  SB_SUM_ONE_LL (remote_freed_buffers);
+  SB_SUM_ONE_LL (remote_free_pending);
+  SB_SUM_ONE_LL (remote_free_pending_size);
   sb_printf (sb,
     "allocated_buffer_chunks\t%d\n"
     "max_allocated_buffer_chunks\t%d\n"
     "max_buffer_chunks\t%d\n"
-    "max_allocated_buffer_bytes\t%lld\n",
+    "max_allocated_buffer_bytes\t%lld\n"
+    "buffer_chunks_hugepage\t%lld\n"
+    "buffer_chunks_thp\t%lld\n"
+    "buffer_chunks_malloc\t%lld\n"
+    "buffer_chunks_owned\t%d\n",
     allocated_buffer_chunks,
     max_allocated_buffer_chunks,
     max_buffer_chunks,
-    max_allocated_buffer_bytes
+    max_allocated_buffer_bytes,
+    arena_allocs[MSG_CHUNK_ARENA_HUGETLB],
+    arena_allocs[MSG_CHUNK_ARENA_THP],
+    arena_allocs[MSG_CHUNK_ARENA_MALLOC],
+    owned_buffer_chunks
     );
+  int node;
+  for (node = 0; node < arena_nodes; node++) {
+    sb_printf (sb, "buffer_chunks_node_%d\t%d %d\n", node, ChunkArena[node].chunks, ChunkArena[node].cached);
+  }
 MODULE_STAT_FUNCTION_END
 
 void fetch_buffers_stat (struct buffers_stat *bs) {
   bs->total_used_buffers_size = SB_SUM_LL (total_used_buffers_size);
   bs->allocated_buffer_bytes = SB_SUM_LL (allocated_buffer_bytes);
   bs->buffer_chunk_alloc_ops = SB_SUM_LL (buffer_chunk_alloc_ops);
+  bs->remote_freed_buffers = SB_SUM_LL (remote_freed_buffers);
+  bs->remote_free_pending = SB_SUM_LL (remote_free_pending);
   bs->total_used_buffers = SB_SUM_I (total_used_buffers);
   bs->allocated_buffer_chunks = allocated_buffer_chunks;
   bs->max_allocated_buffer_chunks = max_allocated_buffer_chunks;
   bs->max_allocated_buffer_bytes = max_allocated_buffer_bytes;
   bs->max_buffer_chunks = max_buffer_chunks;
+  bs->hugepage_chunk_allocs = arena_allocs[MSG_CHUNK_ARENA_HUGETLB];
+  bs->thp_chunk_allocs = arena_allocs[MSG_CHUNK_ARENA_THP];
+  bs->malloc_chunk_allocs = arena_allocs[MSG_CHUNK_ARENA_MALLOC];
+  bs->owned_buffer_chunks = owned_buffer_chunks;
+  bs->numa_nodes = arena_nodes;
+  bs->cached_buffer_chunks = 0;
+  int i;
+  for (i = 0; i < MSG_BUFFERS_MAX_NODES; i++) {
+    bs->node_buffer_chunks[i] = ChunkArena[i].chunks;
+    bs->cached_buffer_chunks += ChunkArena[i].cached;
+  }
 }
 
 int buffer_size_values;
@@ -83,6 +295,27 @@ int rwm_peak_recovery;
 struct msg_buffers_chunk ChunkHeaders[MAX_BUFFER_SIZE_VALUES];
 __thread struct msg_buffers_chunk *ChunkSave[MAX_BUFFER_SIZE_VALUES];
 
+/*
+  Per-thread chunk ownership. An owned chunk stays in MSG_CHUNK_USED_LOCKED_MAGIC
+  state, so only its owner allocates from it and frees into it directly; other
+  threads push freed buffers onto C->remote_free, which the owner drains when
+  its current chunk runs out and from the job thread idle callback. Both paths
+  also give fully free chunks other than the current one back to the shared
+  list. Chunk heads are locked only when a thread needs one more chunk: it
+  adopts a shared chunk with free buffers or allocates a new one.
+*/
+static int msg_buffers_owners;
+static __thread int msg_buffers_owner;  /* 0 = not decided yet, -1 = shared chunks only */
+static __thread struct msg_buffers_chunk *OwnedChunks[MAX_BUFFER_SIZE_VALUES];
+
+static inline int current_buffers_owner (void) {
+  if (!msg_buffers_owner && this_job_thread) {
+    // job threads live as long as the process, so they never leave owned chunks behind
+    msg_buffers_owner = __sync_add_and_fetch (&msg_buffers_owners, 1);
+  }
+  return msg_buffers_owner;
+}
+
 int default_buffer_sizes[] = { 48, 512, 2048, 16384, 262144 };
 int default_buffer_sizes_cnt = sizeof (default_buffer_sizes) / 4;
 
@@ -130,30 +363,50 @@ static void unlock_chunk_head (struct msg_buffers_chunk *CH) {
   CH->magic = MSG_CHUNK_HEAD_MAGIC;
 }
 
-static int try_lock_chunk (struct msg_buffers_chunk *C) {
-  if (C->magic != MSG_CHUNK_USED_MAGIC || !__sync_bool_compare_and_swap (&C->magic, MSG_CHUNK_USED_MAGIC, MSG_CHUNK_USED_LOCKED_MAGIC)) {
-    return 0;
+/* freed buffers are linked through their first data word */
+#define REMOTE_FREE_NEXT(X)	(*(struct msg_buffer **) (X)->data)
+
+static inline void push_remote_free (struct msg_buffers_chunk *C, struct msg_buffer *X) {
+  struct msg_buffer *head;
+  do {
+    head = C->remote_free;
+    REMOTE_FREE_NEXT (X) = head;
+  } while (!__sync_bool_compare_and_swap (&C->remote_free, head, X));
+  MODULE_STAT->remote_free_pending ++;
+  MODULE_STAT->remote_free_pending_size += C->buffer_size;
+}
+
+// chunk must be locked or owned by this thread
+static void drain_remote_free (struct msg_buffers_chunk *C) {
+  if (!C->remote_free) {
+    return;
   }
-  while (1) {
-    struct msg_buffer *X = mpq_pop_nw (C->free_block_queue, 4);
-    if (!X) { break; }
+  struct msg_buffer *X = __sync_lock_test_and_set (&C->remote_free, NULL);
+  while (X) {
+    struct msg_buffer *next = REMOTE_FREE_NEXT (X);
     assert (X->chunk == C);
     C->free_buffer (C, X);
+    MODULE_STAT->remote_free_pending --;
+    MODULE_STAT->remote_free_pending_size -= C->buffer_size;
+    X = next;
+  }
+}
+
+static int try_lock_chunk (struct msg_buffers_chunk *C) {
+  if (C->magic != MSG_CHUNK_USED_MAGIC || !__sync_bool_compare_and_swap (&C->magic, MSG_CHUNK_USED_MAGIC, MSG_CHUNK_USED_LOCKED_MAGIC)) {
+    return 0;
   }
+  drain_remote_free (C);
   return 1;
 }
 
 static void unlock_chunk (struct msg_buffers_chunk *C) {
   while (1) {
-    while (1) {
-      struct msg_buffer *X = mpq_pop_nw (C->free_block_queue, 4);
-      if (!X) { break; }
-      assert (X->chunk == C);
-      C->free_buffer (C, X);
-    }
+    drain_remote_free (C);
     C->magic = MSG_CHUNK_USED_MAGIC;
+    __sync_synchronize ();
 
-    if (mpq_is_empty (C->free_block_queue) || !try_lock_chunk (C)) {
+    if (!C->remote_free || !try_lock_chunk (C)) {
       break;
     }
   }
@@ -167,7 +420,7 @@ struct msg_buffers_chunk *alloc_new_msg_buffers_chunk (struct msg_buffers_chunk
     // ML
     return 0;
   }
-  struct msg_buffers_chunk *C = malloc (MSG_BUFFERS_CHUNK_SIZE);
+  struct msg_buffers_chunk *C = arena_alloc_chunk (current_buffers_node ());
   if (!C) {
     return 0;
   }
@@ -204,6 +457,9 @@ struct msg_buffers_chunk *alloc_new_msg_buffers_chunk (struct msg_buffers_chunk
   C->tot_buffers = chunk_buffers;
 
   C->refcnt = 1;
+  C->remote_free = 0;
+  C->owner = 0;
+  C->own_next = 0;
 
   lock_chunk_head (CH);
 
@@ -259,8 +515,6 @@ struct msg_buffers_chunk *alloc_new_msg_buffers_chunk (struct msg_buffers_chunk
     C->free_cnt[i] = C->free_cnt[2*i] + C->free_cnt[2*i+1];
   }
 
-  C->free_block_queue = alloc_mp_queue_w ();
-
   //vkprintf (0, "allocated chunk %p\n", C);
   return C;
 };
@@ -272,6 +526,7 @@ void free_msg_buffers_chunk_internal (struct msg_buffers_chunk *C, struct msg_bu
   assert (C->buffer_size == CH->buffer_size);
   assert (C->tot_buffers == C->free_cnt[1]);
   assert (CH == C->ch_head);
+  assert (!C->owner && !C->remote_free);
   
   C->magic = 0;
   C->ch_head = 0;
@@ -300,10 +555,11 @@ void free_msg_buffers_chunk_internal (struct msg_buffers_chunk *C, struct msg_bu
     ChunkSave[si] = NULL;
   }
 
-  free_mp_queue (C->free_block_queue);
-
+  int node = C->node, kind = C->arena_kind;
   memset (C, 0, sizeof (struct msg_buffers_chunk));
-  free (C);
+  C->node = node;
+  C->arena_kind = kind;
+  arena_free_chunk (C);
 }
 
 
@@ -327,6 +583,7 @@ int init_msg_buffers (long max_buffer_bytes) {
 
   if (!buffer_size_values) {
     init_buffer_chunk_headers ();
+    init_chunk_arena ();
   }
 
   return 1;
@@ -340,68 +597,10 @@ static inline int get_buffer_no (struct msg_buffers_chunk *C, struct msg_buffer
   return x;
 }
 
-struct msg_buffer *alloc_msg_buffer_internal (struct msg_buffer *neighbor, struct msg_buffers_chunk *CH, struct msg_buffers_chunk *C_hint, int si) {
-  unsigned magic = CH->magic;
-  assert (magic == MSG_CHUNK_HEAD_MAGIC || magic == MSG_CHUNK_HEAD_LOCKED_MAGIC);
-  struct msg_buffers_chunk *C;
-  if (!C_hint) {
-    C = alloc_new_msg_buffers_chunk (CH);
-    if (!C) {
-      return 0;
-    }
-  } else {
-    int found = 0;
-    if (C_hint && C_hint->free_cnt[1] && try_lock_chunk (C_hint)) {
-      assert (C_hint->ch_head == CH);
-      C = C_hint;
-      if (C_hint->free_cnt[1]) {
-        found = 1;
-      } else {
-        unlock_chunk (C_hint);
-      }
-    }
-    if (!found) {
-      lock_chunk_head (CH);
-      struct msg_buffers_chunk *CF = C_hint ? C_hint : CH->ch_next;
-      C = CF;
-      do {
-        if (C == CH) {
-          C = C->ch_next;
-          continue;
-        }
-        if (!C->free_cnt[1]) {
-          C = C->ch_next;
-          continue;
-        }
-        if (!try_lock_chunk (C)) {
-          C = C->ch_next;
-          continue;
-        }
-        if (!C->free_cnt[1]) {
-          unlock_chunk (C);
-          C = C->ch_next;
-          continue;
-        }
-        found = 1;
-        break;
-      } while (C != CF);
-      unlock_chunk_head (CH);
-      if (!found) {
-        C = alloc_new_msg_buffers_chunk (CH);
-        if (!C) {
-          return 0;
-        }
-      }
-      if (C_hint) {
-        __sync_fetch_and_add (&C_hint->refcnt, -1);
-      }
-    }
-  }
-    
-  assert (C != CH);
+/* takes a free buffer from a chunk locked or owned by this thread */
+static struct msg_buffer *take_chunk_buffer (struct msg_buffer *neighbor, struct msg_buffers_chunk *C) {
   assert (C->free_cnt[1]);
   assert (C->magic == MSG_CHUNK_USED_LOCKED_MAGIC);
-  ChunkSave[si] = C;
 
   int two_power = C->two_power, i = 1;
 
@@ -465,12 +664,8 @@ struct msg_buffer *alloc_msg_buffer_internal (struct msg_buffer *neighbor, struc
     assert (-- C->free_cnt[i] == 0);
   }
 
-  assert (C != CH);
-  unlock_chunk (C);
-  //-- CH->free_buffers;
-
   i -= two_power;
-  vkprintf (3, "alloc_msg_buffer(%d) [chunk %p, size %d]: tot_buffers = %d, free_buffers = %d\n", i, C, C->buffer_size, CH->tot_buffers, CH->free_buffers);
+  vkprintf (3, "alloc_msg_buffer(%d) [chunk %p, size %d]: tot_buffers = %d, free_buffers = %d\n", i, C, C->buffer_size, C->ch_head->tot_buffers, C->ch_head->free_buffers);
   assert (i >= 0 && i < C->tot_buffers);
 
   struct msg_buffer *X = (struct msg_buffer *) ((char *) C->first_buffer + i * (C->buffer_size + 16));
@@ -486,8 +681,238 @@ struct msg_buffer *alloc_msg_buffer_internal (struct msg_buffer *neighbor, struc
   return X;
 }
 
+struct msg_buffer *alloc_msg_buffer_internal (struct msg_buffer *neighbor, struct msg_buffers_chunk *CH, struct msg_buffers_chunk *C_hint, int si) {
+  unsigned magic = CH->magic;
+  assert (magic == MSG_CHUNK_HEAD_MAGIC || magic == MSG_CHUNK_HEAD_LOCKED_MAGIC);
+  struct msg_buffers_chunk *C;
+  if (!C_hint) {
+    C = alloc_new_msg_buffers_chunk (CH);
+    if (!C) {
+      return 0;
+    }
+  } else {
+    int found = 0;
+    if (C_hint && C_hint->free_cnt[1] && try_lock_chunk (C_hint)) {
+      assert (C_hint->ch_head == CH);
+      C = C_hint;
+      if (C_hint->free_cnt[1]) {
+        found = 1;
+      } else {
+        unlock_chunk (C_hint);
+      }
+    }
+    if (!found) {
+      // on NUMA hosts: chunks of the local node first, then a new local chunk, then any chunk
+      int node = current_buffers_node (), pass;
+      for (pass = arena_nodes > 1 ? 0 : 1; pass < 2 && !found; pass++) {
+        lock_chunk_head (CH);
+        struct msg_buffers_chunk *CF = C_hint ? C_hint : CH->ch_next;
+        C = CF;
+        do {
+          if (C == CH) {
+            C = C->ch_next;
+            continue;
+          }
+          if (!C->free_cnt[1] || (!pass && C->node != node)) {
+            C = C->ch_next;
+            continue;
+          }
+          if (!try_lock_chunk (C)) {
+            C = C->ch_next;
+            continue;
+          }
+          if (!C->free_cnt[1]) {
+            unlock_chunk (C);
+            C = C->ch_next;
+            continue;
+          }
+          found = 1;
+          break;
+        } while (C != CF);
+        unlock_chunk_head (CH);
+        if (!found && !pass) {
+          C = alloc_new_msg_buffers_chunk (CH);
+          found = C != 0;
+        }
+      }
+      if (!found) {
+        C = alloc_new_msg_buffers_chunk (CH);
+        if (!C) {
+          return 0;
+        }
+      }
+      if (C_hint) {
+        __sync_fetch_and_add (&C_hint->refcnt, -1);
+      }
+    }
+  }
+    
+  assert (C != CH);
+  ChunkSave[si] = C;
+
+  struct msg_buffer *X = take_chunk_buffer (neighbor, C);
+  unlock_chunk (C);
+  //-- CH->free_buffers;
+
+  return X;
+}
+
+/* first chunk of this head nobody owns that has free buffers, locked; node < 0 = any node */
+static struct msg_buffers_chunk *adopt_shared_chunk (struct msg_buffers_chunk *CH, int node) {
+  struct msg_buffers_chunk *C;
+  lock_chunk_head (CH);
+  for (C = CH->ch_next; C != CH; C = C->ch_next) {
+    if (C->owner || !C->free_cnt[1] || (node >= 0 && C->node != node)) {
+      continue;
+    }
+    if (!try_lock_chunk (C)) {
+      continue;
+    }
+    if (C->free_cnt[1]) {
+      break;
+    }
+    unlock_chunk (C);
+  }
+  unlock_chunk_head (CH);
+  return C != CH ? C : 0;
+}
+
+static void disown_chunk (struct msg_buffers_chunk *C) {
+  C->owner = 0;
+  C->own_next = 0;
+  __sync_fetch_and_add (&owned_buffer_chunks, -1);
+  // drains buffers pushed while the chunk was owned, see free_msg_buffer()
+  unlock_chunk (C);
+}
+
+/* drains remote frees of all own chunks of a size class, makes a chunk with
+   free buffers current and disowns the other idle ones; returns the current
+   chunk if it has free buffers */
+static struct msg_buffers_chunk *sweep_owned_chunks (int si) {
+  struct msg_buffers_chunk *H = OwnedChunks[si], *C, **P;
+  for (C = H; C; C = C->own_next) {
+    drain_remote_free (C);
+  }
+  if (!H) {
+    return 0;
+  }
+  if (!H->free_cnt[1]) {
+    for (P = &H->own_next; (C = *P) && !C->free_cnt[1]; P = &C->own_next) {
+    }
+    if (C) {
+      *P = C->own_next;
+      C->own_next = H;
+      OwnedChunks[si] = H = C;
+    }
+  }
+  P = &H->own_next;
+  while ((C = *P) != 0) {
+    if (C->free_cnt[1] == C->tot_buffers) {
+      *P = C->own_next;
+      disown_chunk (C);
+    } else {
+      P = &C->own_next;
+    }
+  }
+  return H->free_cnt[1] ? H : 0;
+}
+
+static struct msg_buffer *alloc_owned_msg_buffer (struct msg_buffer *neighbor, struct msg_buffers_chunk *CH, int si) {
+  struct msg_buffers_chunk *C = OwnedChunks[si];
+  if (!C || !C->free_cnt[1]) {
+    C = sweep_owned_chunks (si);
+  }
+
+  if (!C) {
+    // all own chunks are full: a shared chunk of the local node, a new chunk, then a shared chunk of any node
+    int node = arena_nodes > 1 ? current_buffers_node () : -1;
+    C = adopt_shared_chunk (CH, node);
+    if (!C) {
+      C = alloc_new_msg_buffers_chunk (CH);
+    }
+    if (!C && node >= 0) {
+      C = adopt_shared_chunk (CH, -1);
+    }
+    if (!C) {
+      return 0;
+    }
+    assert (C->ch_head == CH);
+    C->owner = msg_buffers_owner;
+    C->own_next = OwnedChunks[si];
+    OwnedChunks[si] = C;
+    __sync_fetch_and_add (&owned_buffer_chunks, 1);
+  }
+
+  return take_chunk_buffer (neighbor, C);
+}
+
+static void free_owned_msg_buffer (struct msg_buffers_chunk *C, struct msg_buffer *X) {
+  C->free_buffer (C, X);
+  if (C->free_cnt[1] == C->tot_buffers) {
+    // keep only the current chunk of a size class; idle ones go back to the shared list
+    struct msg_buffers_chunk **P = &OwnedChunks[C->ch_head - ChunkHeaders];
+    if (*P != C) {
+      while (*P != C) {
+        assert (*P);
+        P = &(*P)->own_next;
+      }
+      *P = C->own_next;
+      disown_chunk (C);
+    }
+  }
+}
+
+static void msg_buffers_idle (void) {
+  int si;
+  if (msg_buffers_owner <= 0) {
+    return;
+  }
+  for (si = 0; si < buffer_size_values; si++) {
+    if (OwnedChunks[si]) {
+      sweep_owned_chunks (si);
+    }
+  }
+}
+
+static void msg_buffers_new_thread (void) {
+}
+
+static struct thread_callback msg_buffers_thread_callback = {
+  .new_thread = msg_buffers_new_thread,
+  .idle = msg_buffers_idle,
+  .next = NULL
+};
+
+static void msg_buffers_register (void) __attribute__ ((constructor));
+static void msg_buffers_register (void) {
+  register_thread_callback (&msg_buffers_thread_callback);
+}
+
+void msg_buffers_release_thread (void) {
+  int si;
+  for (si = 0; si < MAX_BUFFER_SIZE_VALUES; si++) {
+    struct msg_buffers_chunk *C;
+    while ((C = OwnedChunks[si]) != 0) {
+      OwnedChunks[si] = C->own_next;
+      disown_chunk (C);
+    }
+  }
+}
+
+void msg_buffers_thread_ownership (int enable) {
+  if (!enable) {
+    msg_buffers_release_thread ();
+    msg_buffers_owner = -1;
+  } else if (msg_buffers_owner <= 0) {
+    msg_buffers_owner = __sync_add_and_fetch (&msg_buffers_owners, 1);
+  }
+}
+
 /* allocates buffer of at least given size, -1 = maximal */
 struct msg_buffer *alloc_msg_buffer (struct msg_buffer *neighbor, int size_hint) {
+  if (FAULT_INJECT (FI_MSG_BUFFER)) {
+    return 0;
+  }
   if (!buffer_size_values) {
     init_buffer_chunk_headers ();
   }
@@ -497,6 +922,9 @@ struct msg_buffer *alloc_msg_buffer (struct msg_buffer *neighbor, int size_hint)
       si--;
     }
   }
+  if (current_buffers_owner () > 0) {
+    return alloc_owned_msg_buffer (neighbor, &ChunkHeaders[si], si);
+  }
   return alloc_msg_buffer_internal (neighbor, &ChunkHeaders[si], ChunkSave[si], si);
 }
 
@@ -554,12 +982,26 @@ int free_msg_buffer (struct msg_buffer *X) {
   assert (magic == MSG_CHUNK_USED_MAGIC || magic == MSG_CHUNK_USED_LOCKED_MAGIC);
   
   if (C->free_buffer == free_std_msg_buffer) {
+    int owner = C->owner;
+    if (owner) {
+      if (owner == msg_buffers_owner) {
+        free_owned_msg_buffer (C, X);
+        return 1;
+      }
+      push_remote_free (C, X);
+      MODULE_STAT->remote_freed_buffers ++;
+      // the owner may have given the chunk back meanwhile; then whoever locks it drains the list
+      if (!C->owner && try_lock_chunk (C)) {
+        unlock_chunk (C);
+      }
+      return 1;
+    }
     if (try_lock_chunk (C)) {
       C->free_buffer (C, X);
       unlock_chunk (C);
       return 1;
     } else {
-      mpq_push_w (C->free_block_queue, X, 0);
+      push_remote_free (C, X);
 
       if (try_lock_chunk (C)) {
         unlock_chunk (C);
@@ -578,10 +1020,15 @@ int free_msg_buffer (struct msg_buffer *X) {
   }
 }
 
+/* buffers parked on remote_free lists are already free, only not drained yet */
+static long long msg_buffers_used_bytes (void) {
+  return SB_SUM_LL(total_used_buffers_size) - SB_SUM_LL(remote_free_pending_size);
+}
+
 int msg_buffer_reach_limit (double ratio) {
-  return SB_SUM_LL(total_used_buffers_size) >= ratio * max_allocated_buffer_bytes;
+  return msg_buffers_used_bytes () >= ratio * max_allocated_buffer_bytes;
 }
 
 double msg_buffer_usage (void) {
-  return (double) SB_SUM_LL(total_used_buffers_size) / (double) max_allocated_buffer_bytes;
+  return (double) msg_buffers_used_bytes () / (double) max_allocated_buffer_bytes;
 }
@@ -32,6 +32,9 @@
 #define	MSG_TINY_BUFFER	48
 
 #define	MSG_BUFFERS_CHUNK_SIZE	((1L << 21) - 64)
+/* chunks live in 2M-aligned slots of the chunk arena, one huge page each */
+#define	MSG_BUFFERS_CHUNK_SLOT	(1L << 21)
+#define	MSG_BUFFERS_MAX_NODES	8
 
 #define MSG_DEFAULT_MAX_ALLOCATED_BYTES	(1L << 28)
 
@@ -75,10 +78,14 @@ struct msg_buffers_chunk {
   int tot_buffers;
   int bs_inverse;
   int bs_shift;
-  struct mp_queue *free_block_queue;
+  struct msg_buffer *remote_free;  /* buffers freed while the chunk was locked or owned by another thread */
   int thread_class;
   int thread_subclass;
   int refcnt;
+  int node;        /* NUMA node the chunk memory is bound to */
+  int arena_kind;  /* MSG_CHUNK_ARENA_* */
+  int owner;       /* owning thread (see msg_buffers_thread_ownership), 0 = shared */
+  struct msg_buffers_chunk *own_next;
   union {
     struct {
       int tot_chunks;
@@ -95,6 +102,13 @@ struct buffers_stat {
   int total_used_buffers;
   int allocated_buffer_chunks, max_allocated_buffer_chunks, max_buffer_chunks;
   long long max_allocated_buffer_bytes; 
+  long long hugepage_chunk_allocs, thp_chunk_allocs, malloc_chunk_allocs;
+  int cached_buffer_chunks;
+  int owned_buffer_chunks;
+  long long remote_freed_buffers;
+  long long remote_free_pending;   /* still counted in total_used_buffers until the owner drains them */
+  int numa_nodes;
+  int node_buffer_chunks[MSG_BUFFERS_MAX_NODES];
 };
 
 void fetch_buffers_stat (struct buffers_stat *bs);
@@ -113,6 +127,16 @@ int init_msg_buffers (long max_buffer_bytes);
 struct msg_buffer *alloc_msg_buffer (struct msg_buffer *neighbor, int size_hint);
 
 int free_msg_buffer (struct msg_buffer *buffer);
+
+/*
+  Job threads own the chunks they allocate from: allocation and frees by the
+  owner do not lock anything, buffers freed by other threads are returned
+  through the chunk's remote_free list. Other threads use shared chunks.
+  A thread that owns chunks must release them before it exits.
+*/
+void msg_buffers_thread_ownership (int enable);
+void msg_buffers_release_thread (void);
+
 int msg_buffer_reach_limit (double ratio);
 double msg_buffer_usage (void);
 
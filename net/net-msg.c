@@ -43,6 +43,7 @@
 
 #include "net/net-msg.h"
 #include "net/net-msg-buffers.h"
+#include "net/net-fault-inject.h"
 #include "crc32c.h"
 #include "crc32.h"
 #include "crypto/aesni256.h"
@@ -75,7 +76,15 @@ MODULE_STAT_FUNCTION
 MODULE_STAT_FUNCTION_END
 
 
-static inline struct msg_part *alloc_msg_part (void) { MODULE_STAT->rwm_total_msg_parts ++; struct msg_part *mp = (struct msg_part *) malloc (sizeof (struct msg_part)); mp->magic = MSG_PART_MAGIC; return mp; }
+static inline struct msg_part *alloc_msg_part (void) {
+  struct msg_part *mp = FAULT_INJECT (FI_MSG_PART) ? 0 : (struct msg_part *) malloc (sizeof (struct msg_part));
+  if (!mp) {
+    return 0;
+  }
+  MODULE_STAT->rwm_total_msg_parts ++;
+  mp->magic = MSG_PART_MAGIC;
+  return mp;
+}
 static inline void free_msg_part (struct msg_part *mp) { MODULE_STAT->rwm_total_msg_parts --; assert (mp->magic == MSG_PART_MAGIC); free (mp); }
 
 struct msg_part *new_msg_part (struct msg_part *neighbor, struct msg_buffer *X) /* {{{ */{
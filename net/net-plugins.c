@@ -0,0 +1,628 @@
+/*
+ * net-plugins.c - Хост плагинов (include/plugin-system.h) для сетевого ядра
+ *
+ * Подписки плагинов хранятся в массивах по типу хука, отсортированных по
+ * приоритету; список подписанных хуков дублируется битовой маской
+ * plugin_active_hooks, которую проверяют точки вызова. Массивы меняются только
+ * до plugin_manager_start и после plugin_manager_stop, поэтому вызов хуков из
+ * рабочих потоков обходится без блокировок.
+ *
+ * Время каждого вызова меряется счётчиком тактов и накапливается в
+ * plugin_handle_t; в наносекунды оно пересчитывается при чтении статистики по
+ * отношению прошедшего времени к прошедшим тактам с момента инициализации.
+ */
+
+#include <assert.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kprintf.h"
+#include "precise-time.h"
+#include "common/common-stats.h"
+#include "net/net-msg.h"
+#include "net/net-plugins.h"
+
+unsigned plugin_active_hooks;
+
+static plugin_manager_t plugins_manager;
+static char *plugin_files[MTPLUGIN_MAX_PLUGINS];
+static int plugin_files_num;
+static char *plugin_dir;
+
+static inline unsigned long long plugin_ticks (void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return rdtsc ();
+#else
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static double plugin_time_ns (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double plugin_ns_per_tick (plugin_manager_t *M) {
+  unsigned long long ticks = plugin_ticks () - M->start_ticks;
+  double ns = plugin_time_ns () - M->start_time_ns;
+  return ticks > 0 && ns > 0 ? ns / ticks : 1.0;
+}
+
+static void plugins_update_active_hooks (plugin_manager_t *M) {
+  if (M != &plugins_manager) {
+    return;
+  }
+  unsigned mask = 0;
+  int t, i;
+  for (t = 0; t < HOOK_COUNT; t++) {
+    for (i = 0; i < M->hook_count[t]; i++) {
+      if (M->hooks[t][i].plugin->enabled) {
+        mask |= 1u << t;
+        break;
+      }
+    }
+  }
+  plugin_active_hooks = mask;
+}
+
+/* {{{ plugin manager */
+
+int plugin_manager_init (plugin_manager_t *M, const plugin_manager_config_t *config) {
+  assert (HOOK_COUNT <= 32);
+  memset (M, 0, sizeof (*M));
+  if (config) {
+    M->config = *config;
+  } else {
+    M->config.enable_stats = true;
+  }
+  if (M->config.max_plugins <= 0 || M->config.max_plugins > MTPLUGIN_MAX_PLUGINS) {
+    M->config.max_plugins = MTPLUGIN_MAX_PLUGINS;
+  }
+  M->start_ticks = plugin_ticks ();
+  M->start_time_ns = plugin_time_ns ();
+  M->initialized = true;
+  return 0;
+}
+
+int plugin_manager_start (plugin_manager_t *M) {
+  if (!M->initialized) {
+    return -1;
+  }
+  M->running = true;
+  return 0;
+}
+
+void plugin_manager_stop (plugin_manager_t *M) {
+  M->running = false;
+}
+
+void plugin_manager_cleanup (plugin_manager_t *M) {
+  plugin_manager_stop (M);
+  plugin_manager_unload_all (M);
+  M->initialized = false;
+}
+
+static int plugin_name_listed (const char *name, const char **list, int count) {
+  int i;
+  for (i = 0; i < count; i++) {
+    if (list[i] && !strcmp (list[i], name)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Вставка с сохранением порядка: по убыванию приоритета, равные - в порядке загрузки */
+static int plugin_insert_hook (plugin_manager_t *M, plugin_handle_t *P, const plugin_hook_desc_t *D) {
+  int t = D->hook_type;
+  if (t <= HOOK_NONE || t >= HOOK_COUNT || !D->callback) {
+    return -1;
+  }
+  int n = M->hook_count[t];
+  if (n == MTPLUGIN_MAX_HOOKS) {
+    return -1;
+  }
+  int pos = n;
+  while (pos > 0 && M->hooks[t][pos - 1].priority < D->priority) {
+    M->hooks[t][pos] = M->hooks[t][pos - 1];
+    pos--;
+  }
+  M->hooks[t][pos].callback = D->callback;
+  M->hooks[t][pos].plugin_data = P->plugin_data;
+  M->hooks[t][pos].priority = D->priority;
+  M->hooks[t][pos].plugin = P;
+  M->hook_count[t]++;
+  M->stats.total_hooks++;
+  return 0;
+}
+
+static void plugin_remove_hooks (plugin_manager_t *M, plugin_handle_t *P) {
+  int t, i, j;
+  for (t = 0; t < HOOK_COUNT; t++) {
+    for (i = j = 0; i < M->hook_count[t]; i++) {
+      if (M->hooks[t][i].plugin != P) {
+        M->hooks[t][j++] = M->hooks[t][i];
+      }
+    }
+    M->stats.total_hooks -= M->hook_count[t] - j;
+    M->hook_count[t] = j;
+  }
+}
+
+int plugin_manager_load (plugin_manager_t *M, const char *path) {
+  if (!M->initialized || M->running) {
+    kprintf ("plugin %s: plugins can be loaded only before start\n", path);
+    return -1;
+  }
+  if (M->plugin_count >= M->config.max_plugins) {
+    kprintf ("plugin %s: too many plugins (max %d)\n", path, M->config.max_plugins);
+    M->stats.failed_plugins++;
+    return -1;
+  }
+
+  void *dl = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+  if (!dl) {
+    kprintf ("cannot load plugin %s: %s\n", path, dlerror ());
+    M->stats.failed_plugins++;
+    return -1;
+  }
+
+  plugin_handle_t *P = calloc (1, sizeof (*P));
+  assert (P);
+  P->dl_handle = dl;
+  snprintf (P->path, sizeof (P->path), "%s", path);
+  P->get_info = (plugin_get_info_func) dlsym (dl, "plugin_get_info");
+  P->init = (plugin_init_func) dlsym (dl, "plugin_init");
+  P->shutdown = (plugin_shutdown_func) dlsym (dl, "plugin_shutdown");
+  P->register_hook = (plugin_register_hook_func) dlsym (dl, "plugin_register_hook");
+  P->unregister_hook = (plugin_unregister_hook_func) dlsym (dl, "plugin_unregister_hook");
+  P->get_stats = (plugin_get_stats_func) dlsym (dl, "plugin_get_stats");
+  P->get_hooks = (plugin_get_hooks_func) dlsym (dl, "plugin_get_hooks");
+
+  const char *error = NULL;
+  if (!P->get_info || !P->init || !P->get_hooks) {
+    error = "missing plugin_get_info, plugin_init or plugin_get_hooks";
+  } else {
+    P->info = *P->get_info ();
+    snprintf (P->name, sizeof (P->name), "%s", P->info.name);
+    if (!plugin_check_api_version (P->info.api_version)) {
+      error = "incompatible plugin API version";
+    } else if (plugin_manager_get (M, P->name)) {
+      error = "plugin with the same name is already loaded";
+    } else if (plugin_name_listed (P->name, M->config.blocked_plugins, M->config.blocked_plugin_count) ||
+               (M->config.allowed_plugin_count && !plugin_name_listed (P->name, M->config.allowed_plugins, M->config.allowed_plugin_count))) {
+      error = "plugin is not allowed";
+    }
+  }
+  if (error) {
+    kprintf ("cannot load plugin %s: %s\n", path, error);
+    dlclose (dl);
+    free (P);
+    M->stats.failed_plugins++;
+    return -1;
+  }
+
+  snprintf (P->config_path, sizeof (P->config_path), "%s", path);
+  char *ext = strrchr (P->config_path, '.');
+  if (ext && !strcmp (ext, ".so")) {
+    *ext = 0;
+  }
+  if (strlen (P->config_path) + 5 < sizeof (P->config_path)) {
+    strcat (P->config_path, ".conf");
+  }
+  snprintf (P->config.name, sizeof (P->config.name), "%s", P->name);
+  P->config.enabled = true;
+  P->config.config_path = P->config_path;
+
+  if (P->init (&P->config, &P->plugin_data) != PLUGIN_OK) {
+    kprintf ("cannot load plugin %s: plugin_init failed\n", path);
+    dlclose (dl);
+    free (P);
+    M->stats.failed_plugins++;
+    return -1;
+  }
+
+  int count = 0, i;
+  const plugin_hook_desc_t *hooks = P->get_hooks (&count);
+  for (i = 0; i < count; i++) {
+    if (plugin_insert_hook (M, P, &hooks[i]) < 0) {
+      kprintf ("plugin %s: cannot register hook %d\n", P->name, hooks[i].hook_type);
+    }
+  }
+
+  P->loaded = true;
+  P->enabled = true;
+  P->stats.load_count++;
+  M->plugins[M->plugin_count++] = P;
+  M->stats.loaded_plugins++;
+  plugins_update_active_hooks (M);
+
+  vkprintf (0, "loaded plugin %s %s from %s (%d hooks)\n", P->name, P->info.version, path, count);
+  return 0;
+}
+
+int plugin_manager_unload (plugin_manager_t *M, const char *name) {
+  if (M->running) {
+    return -1;
+  }
+  int i;
+  for (i = 0; i < M->plugin_count; i++) {
+    plugin_handle_t *P = M->plugins[i];
+    if (strcmp (P->name, name)) {
+      continue;
+    }
+    plugin_remove_hooks (M, P);
+    plugins_update_active_hooks (M);
+    if (P->shutdown) {
+      P->shutdown (P->plugin_data);
+    }
+    dlclose (P->dl_handle);
+    free (P);
+    memmove (&M->plugins[i], &M->plugins[i + 1], (M->plugin_count - i - 1) * sizeof (M->plugins[0]));
+    M->plugin_count--;
+    M->stats.loaded_plugins--;
+    return 0;
+  }
+  return -1;
+}
+
+static int plugin_name_cmp (const void *a, const void *b) {
+  return strcmp (*(char *const *) a, *(char *const *) b);
+}
+
+int plugin_manager_load_all (plugin_manager_t *M) {
+  DIR *D = opendir (M->config.plugin_dir);
+  if (!D) {
+    kprintf ("cannot open plugin directory %s: %m\n", M->config.plugin_dir);
+    return -1;
+  }
+
+  char *names[MTPLUGIN_MAX_PLUGINS];
+  int n = 0, loaded = 0, i;
+  struct dirent *E;
+  while ((E = readdir (D)) && n < MTPLUGIN_MAX_PLUGINS) {
+    size_t len = strlen (E->d_name);
+    if (len > 3 && !strcmp (E->d_name + len - 3, ".so")) {
+      names[n++] = strdup (E->d_name);
+    }
+  }
+  closedir (D);
+
+  /* Порядок загрузки определяет порядок хуков с равным приоритетом */
+  qsort (names, n, sizeof (names[0]), plugin_name_cmp);
+  for (i = 0; i < n; i++) {
+    char path[MTPLUGIN_PATH_MAX_LEN * 2];
+    snprintf (path, sizeof (path), "%s/%s", M->config.plugin_dir, names[i]);
+    if (plugin_manager_load (M, path) == 0) {
+      loaded++;
+    }
+    free (names[i]);
+  }
+  return loaded;
+}
+
+void plugin_manager_unload_all (plugin_manager_t *M) {
+  while (M->plugin_count > 0 && !M->running) {
+    plugin_manager_unload (M, M->plugins[M->plugin_count - 1]->name);
+  }
+}
+
+plugin_handle_t *plugin_manager_get (plugin_manager_t *M, const char *name) {
+  int i;
+  for (i = 0; i < M->plugin_count; i++) {
+    if (!strcmp (M->plugins[i]->name, name)) {
+      return M->plugins[i];
+    }
+  }
+  return NULL;
+}
+
+static int plugin_manager_set_enabled (plugin_manager_t *M, const char *name, bool enabled) {
+  plugin_handle_t *P = plugin_manager_get (M, name);
+  if (!P) {
+    return -1;
+  }
+  P->enabled = enabled;
+  plugins_update_active_hooks (M);
+  return 0;
+}
+
+int plugin_manager_enable (plugin_manager_t *M, const char *name) {
+  return plugin_manager_set_enabled (M, name, true);
+}
+
+int plugin_manager_disable (plugin_manager_t *M, const char *name) {
+  return plugin_manager_set_enabled (M, name, false);
+}
+
+int plugin_manager_execute_hook (plugin_manager_t *M, plugin_hook_type_t type, plugin_hook_context_t *ctx) {
+  if ((unsigned) type >= HOOK_COUNT) {
+    return PLUGIN_ERROR;
+  }
+  int n = M->hook_count[type], i;
+  int timed = M->config.enable_stats;
+  ctx->hook_type = type;
+
+  for (i = 0; i < n; i++) {
+    plugin_handle_t *P = M->hooks[type][i].plugin;
+    if (!P->enabled) {
+      continue;
+    }
+    unsigned long long t0 = timed ? plugin_ticks () : 0;
+    plugin_result_t r = M->hooks[type][i].callback (ctx, M->hooks[type][i].plugin_data);
+    if (timed) {
+      unsigned long long dt = plugin_ticks () - t0;
+      __sync_fetch_and_add (&P->hook_ticks[type], dt);
+      /* Максимум без CAS: гонка может потерять обновление, но не испортить значение */
+      if (dt > P->max_ticks) {
+        P->max_ticks = dt;
+      }
+    }
+    __sync_fetch_and_add (&P->stats.hook_calls[type], 1);
+
+    switch (r) {
+      case PLUGIN_OK:
+        break;
+      case PLUGIN_SKIP:
+        i++;
+        break;
+      case PLUGIN_STOP:
+        return PLUGIN_OK;
+      case PLUGIN_REJECT:
+        return PLUGIN_REJECT;
+      default:
+        __sync_fetch_and_add (&P->stats.hook_errors[type], 1);
+        break;
+    }
+  }
+  return PLUGIN_OK;
+}
+
+void plugin_manager_get_stats (plugin_manager_t *M, plugin_manager_stats_t *stats) {
+  double ns_per_tick = plugin_ns_per_tick (M);
+  int i, t;
+
+  M->stats.total_hook_calls = 0;
+  M->stats.total_hook_errors = 0;
+  M->stats.total_execution_time_us = 0;
+  for (i = 0; i < M->plugin_count; i++) {
+    plugin_handle_t *P = M->plugins[i];
+    unsigned long long calls = 0, errors = 0, ticks = 0;
+    for (t = 0; t < HOOK_COUNT; t++) {
+      P->stats.hook_time_ns[t] = (uint64_t) (P->hook_ticks[t] * ns_per_tick);
+      calls += P->stats.hook_calls[t];
+      errors += P->stats.hook_errors[t];
+      ticks += P->hook_ticks[t];
+    }
+    P->stats.total_execution_time_ns = (uint64_t) (ticks * ns_per_tick);
+    P->stats.avg_execution_time_ns = calls ? P->stats.total_execution_time_ns / calls : 0;
+    P->stats.max_execution_time_ns = (uint64_t) (P->max_ticks * ns_per_tick);
+
+    if (P->get_stats) {
+      plugin_stats_t own;
+      memset (&own, 0, sizeof (own));
+      own.plugin_data = P->plugin_data;
+      P->get_stats (&own);
+      P->stats.total_requests = own.total_requests;
+      P->stats.total_blocked = own.total_blocked;
+    }
+
+    M->stats.total_hook_calls += calls;
+    M->stats.total_hook_errors += errors;
+    M->stats.total_execution_time_us += P->stats.total_execution_time_ns / 1000;
+  }
+  if (stats) {
+    *stats = M->stats;
+  }
+}
+
+int plugin_manager_list_plugins (plugin_manager_t *M, char names[][MTPLUGIN_NAME_MAX_LEN], int max_count) {
+  int i;
+  for (i = 0; i < M->plugin_count && i < max_count; i++) {
+    snprintf (names[i], MTPLUGIN_NAME_MAX_LEN, "%s", M->plugins[i]->name);
+  }
+  return i;
+}
+
+/* }}} */
+
+/* {{{ plugin utilities */
+
+void plugin_log (plugin_handle_t *plugin, int level, const char *format, ...) {
+  if (level > verbosity) {
+    return;
+  }
+  char buf[1024];
+  va_list ap;
+  va_start (ap, format);
+  vsnprintf (buf, sizeof (buf), format, ap);
+  va_end (ap);
+  kprintf ("[plugin %s] %s\n", plugin ? plugin->name : "?", buf);
+}
+
+void *plugin_alloc (size_t size) {
+  return malloc (size);
+}
+
+void plugin_free (void *ptr) {
+  free (ptr);
+}
+
+bool plugin_check_api_version (uint32_t version) {
+  return (version >> 16) == MTPLUGIN_API_VERSION_MAJOR && ((version >> 8) & 0xff) <= MTPLUGIN_API_VERSION_MINOR;
+}
+
+const char *plugin_get_api_version_string (void) {
+  static char buf[32];
+  if (!buf[0]) {
+    snprintf (buf, sizeof (buf), "%d.%d.%d", MTPLUGIN_API_VERSION_MAJOR, MTPLUGIN_API_VERSION_MINOR, MTPLUGIN_API_VERSION_PATCH);
+  }
+  return buf;
+}
+
+/* }}} */
+
+/* {{{ engine integration */
+
+void plugins_add_file (const char *path) {
+  if (plugin_files_num == MTPLUGIN_MAX_PLUGINS) {
+    kprintf ("too many --plugin options (max %d)\n", MTPLUGIN_MAX_PLUGINS);
+    exit (2);
+  }
+  plugin_files[plugin_files_num++] = strdup (path);
+}
+
+void plugins_set_dir (const char *dir) {
+  free (plugin_dir);
+  plugin_dir = strdup (dir);
+}
+
+static void plugins_stats (stats_buffer_t *sb) {
+  plugin_manager_stats_t S;
+  plugin_manager_get_stats (&plugins_manager, &S);
+  sb_printf (sb, "plugins_loaded\t%d\n", S.loaded_plugins);
+  sb_printf (sb, "plugins_hook_calls\t%lld\n", (long long) S.total_hook_calls);
+
+  int i, t;
+  for (i = 0; i < plugins_manager.plugin_count; i++) {
+    plugin_handle_t *P = plugins_manager.plugins[i];
+    long long calls = 0;
+    for (t = 0; t < HOOK_COUNT; t++) {
+      calls += P->stats.hook_calls[t];
+    }
+    sb_printf (sb, "plugin_%s_calls\t%lld\n", P->name, calls);
+    sb_printf (sb, "plugin_%s_time_ns\t%lld\n", P->name, (long long) P->stats.total_execution_time_ns);
+    sb_printf (sb, "plugin_%s_avg_ns\t%lld\n", P->name, (long long) P->stats.avg_execution_time_ns);
+    sb_printf (sb, "plugin_%s_max_ns\t%lld\n", P->name, (long long) P->stats.max_execution_time_ns);
+    sb_printf (sb, "plugin_%s_blocked\t%lld\n", P->name, (long long) P->stats.total_blocked);
+  }
+}
+
+int plugins_load (void) {
+  if (!plugin_files_num && !plugin_dir) {
+    return 0;
+  }
+
+  plugin_manager_config_t config;
+  memset (&config, 0, sizeof (config));
+  config.max_plugins = MTPLUGIN_MAX_PLUGINS;
+  config.enable_stats = true;
+  if (plugin_dir) {
+    snprintf (config.plugin_dir, sizeof (config.plugin_dir), "%s", plugin_dir);
+    config.auto_load = true;
+  }
+  plugin_manager_init (&plugins_manager, &config);
+
+  int i;
+  for (i = 0; i < plugin_files_num; i++) {
+    if (plugin_manager_load (&plugins_manager, plugin_files[i]) < 0) {
+      return -1;
+    }
+  }
+  if (plugin_dir && plugin_manager_load_all (&plugins_manager) < 0) {
+    return -1;
+  }
+
+  sb_register_stat_fun (plugins_stats);
+  plugin_manager_start (&plugins_manager);
+  return plugins_manager.plugin_count;
+}
+
+void plugins_unload (void) {
+  plugin_active_hooks = 0;
+  plugin_manager_cleanup (&plugins_manager);
+}
+
+int plugins_dispatch (plugin_hook_type_t type, plugin_hook_context_t *ctx) {
+  return plugin_manager_execute_hook (&plugins_manager, type, ctx);
+}
+
+int plugin_hook_accept (int fd, unsigned ip, const unsigned char ipv6[16], int port) {
+  plugin_hook_context_t ctx = {
+    .connection_fd = fd,
+    .client_ipv4 = ip,
+    .client_ipv6 = ip ? NULL : ipv6,
+    .client_port = port,
+    .secret_index = -1,
+  };
+  return plugins_dispatch (HOOK_CONNECTION_ACCEPT, &ctx);
+}
+
+int plugin_hook_connection (plugin_hook_type_t type, connection_job_t C) {
+  struct connection_info *c = CONN_INFO (C);
+  plugin_hook_context_t ctx = {
+    .connection_fd = c->fd,
+    .client_ipv4 = c->remote_ip,
+    .client_ipv6 = c->remote_ip ? NULL : c->remote_ipv6,
+    .client_port = c->remote_port,
+    .secret_index = -1,
+    .user_data = C,
+  };
+  return plugins_dispatch (type, &ctx);
+}
+
+int plugin_hook_data_received (connection_job_t C, int bytes) {
+  struct connection_info *c = CONN_INFO (C);
+  if (bytes <= 0 || bytes > c->in.total_bytes) {
+    return PLUGIN_OK;
+  }
+  /* Клон разделяет буферы с c->in (только счётчики ссылок): отрезаем
+     уже показанную плагинам голову, остаются ровно новые байты */
+  struct raw_message fresh;
+  rwm_clone (&fresh, &c->in);
+  rwm_skip_data (&fresh, c->in.total_bytes - bytes);
+
+  struct msg_part *mp = fresh.first;
+  int end = mp == fresh.last ? fresh.last_offset : mp->data_end;
+  plugin_hook_context_t ctx = {
+    .connection_fd = c->fd,
+    .client_ipv4 = c->remote_ip,
+    .client_ipv6 = c->remote_ip ? NULL : c->remote_ipv6,
+    .client_port = c->remote_port,
+    .data = mp->part->data + fresh.first_offset,
+    .data_size = end - fresh.first_offset,
+    .raw = &fresh,
+    .raw_size = bytes,
+    .secret_index = -1,
+    .user_data = C,
+  };
+  if (ctx.data_size > (size_t) bytes) {
+    ctx.data_size = bytes;
+  }
+  int res = plugins_dispatch (HOOK_DATA_RECEIVED, &ctx);
+  rwm_free (&fresh);
+  return res;
+}
+
+int plugin_hook_handshake (connection_job_t C, const unsigned char header[64], int secret_index, int target_dc) {
+  struct connection_info *c = CONN_INFO (C);
+  plugin_hook_context_t ctx = {
+    .connection_fd = c->fd,
+    .client_ipv4 = c->remote_ip,
+    .client_ipv6 = c->remote_ip ? NULL : c->remote_ipv6,
+    .client_port = c->remote_port,
+    .data = header,
+    .data_size = 64,
+    .secret_index = secret_index,
+    .target_dc = target_dc,
+    .user_data = C,
+  };
+  return plugins_dispatch (HOOK_MTPROTO_HANDSHAKE, &ctx);
+}
+
+void plugin_hook_config_reload (void) {
+  if (PLUGIN_HOOK_ACTIVE (HOOK_CONFIG_RELOAD)) {
+    plugin_hook_context_t ctx = { .connection_fd = -1, .secret_index = -1 };
+    plugins_dispatch (HOOK_CONFIG_RELOAD, &ctx);
+  }
+}
+
+/* }}} */
@@ -0,0 +1,38 @@
+/*
+ * net-plugins.h - Хост плагинов (include/plugin-system.h) для сетевого ядра
+ *
+ * Плагины загружаются dlopen при старте движка, их подписки раскладываются
+ * по массивам хуков. В горячем пути хук вызывается только после проверки
+ * PLUGIN_HOOK_ACTIVE: без подписчиков это одно чтение слова и один
+ * предсказуемый переход.
+ */
+
+#pragma once
+
+#include "include/plugin-system.h"
+#include "net/net-connections.h"
+
+/* Бит i установлен, если на хук i подписан хотя бы один включённый плагин */
+extern unsigned plugin_active_hooks;
+
+#define PLUGIN_HOOK_ACTIVE(type) __builtin_expect ((plugin_active_hooks >> (type)) & 1, 0)
+
+void plugins_add_file (const char *path);
+void plugins_set_dir (const char *dir);
+
+/* Загрузка плагинов из --plugin и --plugin-dir; 0, если плагинов нет */
+int plugins_load (void);
+void plugins_unload (void);
+
+int plugins_dispatch (plugin_hook_type_t type, plugin_hook_context_t *ctx);
+
+/* Обёртки для точек вызова; возвращают результат цепочки (PLUGIN_REJECT - отклонить) */
+int plugin_hook_accept (int fd, unsigned ip, const unsigned char ipv6[16], int port);
+int plugin_hook_connection (plugin_hook_type_t type, connection_job_t C);
+/* HOOK_DATA_RECEIVED: плагины видят только последние bytes байт c->in (прочитанные
+   этим вызовом), ctx.raw - эти же байты целиком, ctx.data - их первый фрагмент.
+   Соединение закрывает только PLUGIN_REJECT; PLUGIN_SKIP, как и в остальных
+   хуках, пропускает следующий плагин цепочки, данные обрабатываются дальше */
+int plugin_hook_data_received (connection_job_t C, int bytes);
+int plugin_hook_handshake (connection_job_t C, const unsigned char header[64], int secret_index, int target_dc);
+void plugin_hook_config_reload (void);
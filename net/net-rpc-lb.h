@@ -0,0 +1,62 @@
+/*
+    This file is part of Mtproto-proxy Library.
+
+    Mtproto-proxy Library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    Mtproto-proxy Library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Mtproto-proxy Library.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright 2024-2026 MTProto Proxy Enhanced Project
+              2024-2026 Dupley Maxim Igorevich (Maestro7IT)
+*/
+
+#pragma once
+
+/*
+  Оценка загруженности middle-end для выбора цели и соединения
+  (power-of-two-choices): из двух случайных кандидатов берётся тот,
+  у кого меньше стоимость = EWMA задержки * (1 + запросов без ответа).
+
+  EWMA растёт быстро (вес нового замера 1/2) и спадает медленно (1/8):
+  перегруженный middle-end сразу теряет долю трафика и возвращает её
+  только после серии быстрых ответов. Функции без зависимостей, чтобы
+  симуляция в testing/ считала ровно так же, как прокси.
+*/
+
+#define RPC_LB_RTT_MAX_US 2000000     /* более долгие "ответы" - push-сообщения, не замер */
+#define RPC_LB_PING_INTERVAL 2.0       /* RPC_PING в каждое готовое соединение, секунд */
+
+static inline int rpc_lb_ewma_update (int ewma_us, int sample_us) {
+  if (sample_us < 1) {
+    sample_us = 1;
+  }
+  if (!ewma_us) {
+    return sample_us;
+  }
+  if (sample_us > ewma_us) {
+    return ewma_us + ((sample_us - ewma_us + 1) >> 1);
+  }
+  return ewma_us - ((ewma_us - sample_us) >> 3);
+}
+
+/* outstanding запросов на conns соединений; rtt_us == 0 - замеров ещё нет */
+static inline long long rpc_lb_cost (int rtt_us, int outstanding, int conns) {
+  if (rtt_us < 1) {
+    rtt_us = 1;
+  }
+  if (outstanding < 0) {
+    outstanding = 0;
+  }
+  if (conns < 1) {
+    conns = 1;
+  }
+  return (long long) rtt_us * (conns + outstanding) / conns;
+}
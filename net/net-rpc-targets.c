@@ -23,10 +23,12 @@
 */
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include "net/net-rpc-targets.h"
+#include "net/net-rpc-lb.h"
 #include "vv/vv-tree.h"
 //#include "net/net-rpc-common.h"
 //#include "net/net-rpc-server.h"
@@ -39,6 +41,7 @@
 #include "common/common-stats.h"
 #include "common/mp-queue.h"
 #include "common/server-functions.h"
+#include "common/precise-time.h"
 
 #define rpc_target_cmp(a,b) (RPC_TARGET_INFO(a)->PID.port ? memcmp (&RPC_TARGET_INFO(a)->PID, &RPC_TARGET_INFO(b)->PID, 6) : memcmp (&RPC_TARGET_INFO(a)->PID, &RPC_TARGET_INFO(b)->PID, 8)) 
 
@@ -72,6 +75,9 @@ void free_rpc_target_tree_ptr (struct tree_rpc_target *T);
 MODULE_STAT_TYPE {
   long long total_rpc_targets;
   long long total_connections_in_rpc_targets;
+  long long lb_rtt_samples;
+  long long lb_pings_sent;
+  long long lb_pongs_received;
 };
 
 MODULE_INIT
@@ -79,6 +85,9 @@ MODULE_INIT
 MODULE_STAT_FUNCTION
   SB_SUM_ONE_LL (total_rpc_targets);
   SB_SUM_ONE_LL (total_connections_in_rpc_targets);
+  SB_SUM_ONE_LL (lb_rtt_samples);
+  SB_SUM_ONE_LL (lb_pings_sent);
+  SB_SUM_ONE_LL (lb_pongs_received);
 MODULE_STAT_FUNCTION_END
 /* }}} */
 
@@ -361,3 +370,121 @@ int rpc_target_get_state (rpc_target_job_t S, struct process_id *pid) {
 }
 
 void rpc_target_delete (rpc_target_job_t RT) {}
+
+/* {{{ latency-aware balancing */
+/*
+  Every outbound connection keeps an EWMA of the delay between a forwarded
+  query and the first answer to it, and between RPC_PING and RPC_PONG, plus
+  the number of forwarded queries still waiting for an answer. The target
+  keeps the same over all its connections. A new client goes to the cheaper
+  of two random candidates (see net/net-rpc-lb.h for the cost), so a slow
+  or overloaded middle-end quickly loses its share without starving it of
+  the samples needed to notice recovery.
+
+  Query accounting is done in the engine thread; delay samples also come
+  from pongs in connection threads, a lost EWMA update there is harmless.
+*/
+
+static void rpc_target_lb_sample (connection_job_t C, double delay) {
+  if (delay < 0 || delay * 1e6 > RPC_LB_RTT_MAX_US) {
+    return;
+  }
+  int us = (int) (delay * 1e6);
+  struct connection_info *c = CONN_INFO (C);
+  c->lb_rtt_us = rpc_lb_ewma_update (c->lb_rtt_us, us);
+  if (c->target) {
+    struct conn_target_info *CT = CONN_TARGET_INFO (c->target);
+    CT->lb_rtt_us = rpc_lb_ewma_update (CT->lb_rtt_us, us);
+  }
+  MODULE_STAT->lb_rtt_samples ++;
+}
+
+void rpc_target_lb_query_sent (connection_job_t C) {
+  assert_engine_thread ();
+  struct connection_info *c = CONN_INFO (C);
+  c->lb_outstanding ++;
+  if (c->target) {
+    CONN_TARGET_INFO (c->target)->lb_outstanding ++;
+  }
+}
+
+void rpc_target_lb_query_done (connection_job_t C, double delay) {
+  assert_engine_thread ();
+  struct connection_info *c = CONN_INFO (C);
+  if (c->lb_outstanding <= 0) {
+    return;   // already written off by rpc_target_lb_conn_closed ()
+  }
+  c->lb_outstanding --;
+  if (c->target) {
+    CONN_TARGET_INFO (c->target)->lb_outstanding --;
+  }
+  rpc_target_lb_sample (C, delay);
+}
+
+void rpc_target_lb_conn_closed (connection_job_t C) {
+  assert_engine_thread ();
+  struct connection_info *c = CONN_INFO (C);
+  if (c->target) {
+    CONN_TARGET_INFO (c->target)->lb_outstanding -= c->lb_outstanding;
+  }
+  c->lb_outstanding = 0;
+}
+
+long long rpc_target_lb_conn_cost (connection_job_t C) {
+  struct connection_info *c = CONN_INFO (C);
+  int rtt = c->lb_rtt_us;
+  if (!rtt && c->target) {
+    rtt = CONN_TARGET_INFO (c->target)->lb_rtt_us;
+  }
+  return rpc_lb_cost (rtt, c->lb_outstanding, 1);
+}
+
+long long rpc_target_lb_target_cost (conn_target_job_t S) {
+  struct conn_target_info *CT = CONN_TARGET_INFO (S);
+  if (!CT->ready_outbound_connections) {
+    return LLONG_MAX;
+  }
+  return rpc_lb_cost (CT->lb_rtt_us, CT->lb_outstanding, CT->ready_outbound_connections);
+}
+
+connection_job_t rpc_target_choose_p2c_connection (rpc_target_job_t S, struct process_id *pid) {
+  connection_job_t C[2];
+  int n = rpc_target_choose_random_connections (S, pid, 2, C);
+  if (n < 2) {
+    return n ? C[0] : NULL;
+  }
+  long long cost0 = rpc_target_lb_conn_cost (C[0]);
+  long long cost1 = rpc_target_lb_conn_cost (C[1]);
+  int k = cost1 < cost0 || (cost1 == cost0 && (lrand48_j () & 1));
+  job_decref (JOB_REF_PASS (C[!k]));
+  return C[k];
+}
+
+/* every RPC_LB_PING_INTERVAL seconds; a pong for an older ping no longer matches and is ignored */
+void rpc_target_lb_send_pings (rpc_target_job_t S) {
+  connection_job_t C[RPC_LB_PING_BATCH];
+  int i, n = rpc_target_choose_random_connections (S, 0, RPC_LB_PING_BATCH, C);
+  for (i = 0; i < n; i++) {
+    struct connection_info *c = CONN_INFO (C[i]);
+    if (precise_now - c->lb_ping_time >= RPC_LB_PING_INTERVAL) {
+      c->lb_ping_time = precise_now;
+      tcp_rpc_send_ping (C[i], (long long) (precise_now * 1e6));
+      MODULE_STAT->lb_pings_sent ++;
+    }
+    job_decref (JOB_REF_PASS (C[i]));
+  }
+}
+
+void rpc_target_lb_pong (connection_job_t C, struct raw_message *raw) {
+  int P[3];
+  if (raw->total_bytes != 12 || rwm_fetch_lookup (raw, P, 12) != 12) {
+    return;
+  }
+  struct connection_info *c = CONN_INFO (C);
+  double sent = c->lb_ping_time;
+  if (sent && *(long long *)(P + 1) == (long long) (sent * 1e6)) {
+    MODULE_STAT->lb_pongs_received ++;
+    rpc_target_lb_sample (C, get_utime_monotonic () - sent);
+  }
+}
+/* }}} */
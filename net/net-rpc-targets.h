@@ -53,3 +53,15 @@ void rpc_target_delete_conn (connection_job_t c);
 
 int rpc_target_get_state (rpc_target_job_t S, struct process_id *PID);
 void rpc_target_delete (rpc_target_job_t S);
+
+/* latency-aware balancing, see net/net-rpc-lb.h */
+#define RPC_LB_PING_BATCH 16
+
+connection_job_t rpc_target_choose_p2c_connection (rpc_target_job_t S, struct process_id *PID);
+long long rpc_target_lb_conn_cost (connection_job_t C);
+long long rpc_target_lb_target_cost (conn_target_job_t S);
+void rpc_target_lb_query_sent (connection_job_t C);
+void rpc_target_lb_query_done (connection_job_t C, double delay);
+void rpc_target_lb_conn_closed (connection_job_t C);
+void rpc_target_lb_send_pings (rpc_target_job_t S);
+void rpc_target_lb_pong (connection_job_t C, struct raw_message *raw);
@@ -0,0 +1,676 @@
+/*
+ * net-socks5-server.c - SOCKS5-фронтенд на движке соединений
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "common/common-stats.h"
+#include "common/kprintf.h"
+#include "common/precise-time.h"
+#include "jobs/jobs.h"
+#include "net/net-connections.h"
+#include "net/net-dns-resolver.h"
+#include "net/net-events.h"
+#include "net/net-ip-acl.h"
+#include "net/net-socks5-server.h"
+#include "net/net-tcp-connections.h"
+#include "net/socks5.h"
+
+enum socks5_state {
+  S5_GREETING,
+  S5_AUTH,
+  S5_REQUEST,
+  S5_RESOLVING,
+  S5_CONNECTING,
+  S5_RELAY,
+  S5_CLOSING
+};
+
+/* события от других потоков, разбираются в data_received под блокировкой соединения */
+#define S5_EV_RESOLVED 1
+#define S5_EV_CONNECTED 2
+#define S5_EV_PEER_CLOSED 4
+#define S5_EV_RESUME 8
+
+/* в conn->custom_data; сосед - в conn->extra, как у proxy pass */
+struct socks5_data {
+  int state;
+  int events;
+  int target_family;
+  int target_port;
+  unsigned char target_addr[16];
+  int resolve_status;
+  int queued;                       /* байт отдано в out_queue и ещё не записано в сокет */
+  int read_stopped;
+  int relayed;                      /* клиент получил успешный ответ на CONNECT */
+  connection_job_t stopped_peer;    /* сосед, остановленный из-за нашей очереди, со ссылкой */
+};
+
+#define SOCKS5_DATA(c) ((struct socks5_data *) (CONN_INFO(c)->custom_data))
+
+struct socks5_resolve {
+  connection_job_t C;
+  int family;
+  char name[DNS_MAX_NAME + 1];
+};
+
+static struct {
+  char username[256];
+  char password[256];
+} Users[SOCKS5_MAX_USERS];
+static int users_num;
+
+static char *acl_files[2];
+static struct ip_acl *dest_acl;
+
+/* внутренние и служебные адреса: без явного разрешения SOCKS5 к ним не пускает;
+   NAT64 и 6to4 запрещены целиком - в них вложен IPv4-адрес */
+static const char *default_denied_targets[] = {
+  "0.0.0.0/8", "127.0.0.0/8", "10.0.0.0/8", "172.16.0.0/12", "192.168.0.0/16", "169.254.0.0/16",
+  "100.64.0.0/10", "192.0.0.0/24", "198.18.0.0/15", "224.0.0.0/4", "240.0.0.0/4",
+  "::/128", "::1/128", "fc00::/7", "fe80::/10", "64:ff9b::/96", "2002::/16",
+};
+
+#define MODULE socks5_server
+
+MODULE_STAT_TYPE {
+  struct socks5_server_stat S;
+};
+
+MODULE_INIT
+
+void fetch_socks5_server_stat (struct socks5_server_stat *S) {
+  int i;
+  memset (S, 0, sizeof (*S));
+  for (i = 0; i <= max_job_thread_id; i++) {
+    MODULE_STAT_TYPE *T = MODULE_STAT_ARR[i];
+    if (!T) {
+      continue;
+    }
+    S->accepted += T->S.accepted;
+    S->handshake_errors += T->S.handshake_errors;
+    S->auth_failures += T->S.auth_failures;
+    S->connect_failures += T->S.connect_failures;
+    S->acl_rejects += T->S.acl_rejects;
+    S->relays += T->S.relays;
+    S->active_relays += T->S.active_relays;
+    S->bytes_in += T->S.bytes_in;
+    S->bytes_out += T->S.bytes_out;
+    S->read_stops += T->S.read_stops;
+  }
+}
+
+int socks5_server_add_user (const char *username, const char *password) {
+  int i;
+  if (users_num == SOCKS5_MAX_USERS || !*username || strlen (username) > 255 || strlen (password) > 255) {
+    return -1;
+  }
+  for (i = 0; i < users_num; i++) {
+    if (!strcmp (Users[i].username, username)) {
+      return -1;
+    }
+  }
+  strcpy (Users[users_num].username, username);
+  strcpy (Users[users_num].password, password);
+  users_num++;
+  return 0;
+}
+
+int socks5_server_users (void) {
+  return users_num;
+}
+
+void socks5_server_set_acl_file (const char *filename, unsigned flags) {
+  int i = flags == IP_ACL_WHITELIST;
+  free (acl_files[i]);
+  acl_files[i] = strdup (filename);
+}
+
+int socks5_server_init_acl (int allow_private, int whitelist_only) {
+  struct ip_acl *A = ip_acl_alloc ();
+  int i;
+  A->whitelist_only = whitelist_only;
+  for (i = 0; !allow_private && i < (int) (sizeof (default_denied_targets) / sizeof (default_denied_targets[0])); i++) {
+    assert (ip_acl_add_cidr (A, default_denied_targets[i], IP_ACL_BLACKLIST) >= 0);
+  }
+  for (i = 0; i < 2; i++) {
+    if (acl_files[i] && ip_acl_load_file (A, acl_files[i], i ? IP_ACL_WHITELIST : IP_ACL_BLACKLIST) < 0) {
+      kprintf ("cannot load socks5 acl file %s: %m\n", acl_files[i]);
+      ip_acl_free (A);
+      return -1;
+    }
+  }
+  if (ip_acl_compile (A) < 0) {
+    ip_acl_free (A);
+    return -1;
+  }
+  ip_acl_free (dest_acl);
+  dest_acl = A;
+  return 0;
+}
+
+int socks5_init_accepted (connection_job_t C);
+int socks5_parse_execute (connection_job_t C);
+int socks5_data_received (connection_job_t C, int bytes);
+int socks5_data_sent (connection_job_t S, int bytes);
+int socks5_alarm (connection_job_t C);
+int socks5_close (connection_job_t C, int who);
+int socks5_write_packet (connection_job_t C, struct raw_message *raw);
+int socks5_target_init_outbound (connection_job_t C);
+int socks5_target_connected (connection_job_t C);
+
+conn_type_t ct_socks5_server = {
+  .magic = CONN_FUNC_MAGIC,
+  .flags = C_RAWMSG,
+  .title = "socks5_server",
+  .accept = net_accept_new_connections,
+  .init_accepted = socks5_init_accepted,
+  .parse_execute = socks5_parse_execute,
+  .data_received = socks5_data_received,
+  .data_sent = socks5_data_sent,
+  .alarm = socks5_alarm,
+  .close = socks5_close,
+  .write_packet = socks5_write_packet,
+  .init_outbound = server_failed,
+  .connected = server_failed,
+};
+
+conn_type_t ct_socks5_target = {
+  .magic = CONN_FUNC_MAGIC,
+  .flags = C_RAWMSG,
+  .title = "socks5_target",
+  .init_accepted = server_failed,
+  .init_outbound = socks5_target_init_outbound,
+  .connected = socks5_target_connected,
+  .parse_execute = socks5_parse_execute,
+  .data_received = socks5_data_received,
+  .data_sent = socks5_data_sent,
+  .close = socks5_close,
+  .write_packet = socks5_write_packet,
+};
+
+/* из любого потока; ссылку на P держит вызывающий */
+static void socks5_notify (connection_job_t P, int ev) {
+  __sync_fetch_and_or (&SOCKS5_DATA(P)->events, ev);
+  job_signal (JOB_REF_CREATE_PASS (P), JS_RUN);
+}
+
+static void socks5_reply (connection_job_t C, const void *data, int len) {
+  __sync_fetch_and_add (&SOCKS5_DATA(C)->queued, len);
+  assert (rwm_push_data (&CONN_INFO(C)->out, data, len) == len);
+}
+
+/* ответ на CONNECT, для ошибок адрес 0.0.0.0:0 */
+static void socks5_reply_request (connection_job_t C, int rep) {
+  struct connection_info *c = CONN_INFO(C);
+  unsigned char r[10] = { 5, rep, 0, SOCKS_ATYP_IPV4 };
+  if (rep == SOCKS_REP_SUCCESS && c->extra) {
+    connection_job_t T = c->extra;
+    struct connection_info *t = CONN_INFO(T);
+    unsigned ip = htonl (t->our_ip);
+    memcpy (r + 4, &ip, 4);
+    r[8] = t->our_port >> 8;
+    r[9] = t->our_port & 255;
+  }
+  socks5_reply (C, r, 10);
+}
+
+/* отказ клиенту: отправить, что накопилось, и закрыть */
+static int socks5_fail (connection_job_t C, int rep) {
+  struct socks5_data *D = SOCKS5_DATA(C);
+  if (rep >= 0) {
+    socks5_reply_request (C, rep);
+  }
+  D->state = S5_CLOSING;
+  connection_write_close (C);
+  return 0;
+}
+
+int socks5_init_accepted (connection_job_t C) {
+  assert (check_conn_functions (&ct_socks5_target, 0) >= 0);
+  struct socks5_data *D = SOCKS5_DATA(C);
+  D->state = S5_GREETING;
+  MODULE_STAT->S.accepted++;
+  job_timer_insert (C, precise_now + SOCKS5_HANDSHAKE_TIMEOUT);
+  return 0;
+}
+
+int socks5_alarm (connection_job_t C) {
+  struct socks5_data *D = SOCKS5_DATA(C);
+  if (D->state < S5_RELAY) {
+    vkprintf (1, "socks5 connection #%d: handshake timeout in state %d\n", CONN_INFO(C)->fd, D->state);
+    if (D->state >= S5_RESOLVING) {
+      MODULE_STAT->S.connect_failures++;
+    }
+    fail_connection (C, -1);
+  }
+  return 0;
+}
+
+static int socks5_target_allowed (struct socks5_data *D) {
+  unsigned char a[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+  if (D->target_family == AF_INET) {
+    // IPv4 как 4in6: ip_acl_lookup отличает 0.0.0.0 от IPv6 только так
+    memcpy (a + 12, D->target_addr, 4);
+  } else {
+    memcpy (a, D->target_addr, 16);
+  }
+  return !ip_acl_rejects (dest_acl, 0, a);
+}
+
+static int socks5_connect (connection_job_t C) {
+  struct connection_info *c = CONN_INFO(C);
+  struct socks5_data *D = SOCKS5_DATA(C);
+  unsigned ip = 0;
+  int cfd;
+
+  if (dest_acl && !socks5_target_allowed (D)) {
+    vkprintf (1, "socks5 connection #%d: target is not allowed\n", c->fd);
+    MODULE_STAT->S.acl_rejects++;
+    return socks5_fail (C, SOCKS_REP_NOT_ALLOWED);
+  }
+
+  if (D->target_family == AF_INET) {
+    memcpy (&ip, D->target_addr, 4);
+    cfd = client_socket (ip, D->target_port, 0);
+  } else {
+    cfd = client_socket_ipv6 (D->target_addr, D->target_port, SM_IPV6);
+  }
+  if (cfd < 0) {
+    vkprintf (1, "socks5 connection #%d: cannot create target socket: %m\n", c->fd);
+    MODULE_STAT->S.connect_failures++;
+    return socks5_fail (C, errno == ENETUNREACH ? SOCKS_REP_NET_UNREACH : SOCKS_REP_FAILURE);
+  }
+
+  job_incref (C);
+  job_t T = alloc_new_connection (cfd, NULL, NULL, ct_outbound, &ct_socks5_target, C, ntohl (ip), D->target_addr, D->target_port);
+  if (!T) {
+    job_decref_f (C);
+    MODULE_STAT->S.connect_failures++;
+    return socks5_fail (C, SOCKS_REP_FAILURE);
+  }
+  c->extra = job_incref (T);
+  D->state = S5_CONNECTING;
+  assert (CONN_INFO(T)->io_conn);
+  unlock_job (JOB_REF_PASS (T));
+  return 0;
+}
+
+/* в JC_ENGINE: результат dns_resolve_async для соединения в S5_RESOLVING */
+static void socks5_resolved (void *extra, const struct dns_result *R) {
+  struct socks5_resolve *Q = extra;
+  struct dns_result R6;
+  if (R->status != DNS_OK && Q->family == AF_INET) {
+    // нет A-записи - пробуем AAAA
+    Q->family = AF_INET6;
+    int res = dns_resolve_async (Q->name, AF_INET6, socks5_resolved, Q, &R6);
+    if (!res) {
+      return;
+    }
+    if (res > 0) {
+      R = &R6;
+    }
+  }
+  struct socks5_data *D = SOCKS5_DATA(Q->C);
+  D->resolve_status = R->status;
+  if (R->status == DNS_OK) {
+    D->target_family = R->family;
+    memcpy (D->target_addr, &R->addrs[0], R->family == AF_INET ? 4 : 16);
+  }
+  __sync_synchronize ();
+  socks5_notify (Q->C, S5_EV_RESOLVED);
+  job_decref (JOB_REF_PASS (Q->C));
+  free (Q);
+}
+
+static int socks5_resolve (connection_job_t C, const char *name) {
+  struct socks5_data *D = SOCKS5_DATA(C);
+  struct socks5_resolve *Q = malloc (sizeof (*Q));
+  struct dns_result R;
+  assert (Q);
+  Q->C = job_incref (C);
+  Q->family = AF_INET;
+  strcpy (Q->name, name);
+  D->state = S5_RESOLVING;
+
+  int res = dns_resolve_async (name, AF_INET, socks5_resolved, Q, &R);
+  if (!res) {
+    return 0;
+  }
+  if (res > 0 && R.status == DNS_OK) {
+    job_decref (JOB_REF_PASS (Q->C));
+    free (Q);
+    D->target_family = R.family;
+    memcpy (D->target_addr, &R.addrs[0], R.family == AF_INET ? 4 : 16);
+    return socks5_connect (C);
+  }
+  if (res > 0) {
+    // отрицательный ответ из кэша для A, AAAA может и быть
+    socks5_resolved (Q, &R);
+    return 0;
+  }
+  job_decref (JOB_REF_PASS (Q->C));
+  free (Q);
+  MODULE_STAT->S.connect_failures++;
+  return socks5_fail (C, SOCKS_REP_HOST_UNREACH);
+}
+
+static void socks5_stop_reading (connection_job_t C, connection_job_t P);
+
+/* всё из in - в out_queue соседа */
+static int socks5_relay (connection_job_t C) {
+  struct connection_info *c = CONN_INFO(C);
+  struct socks5_data *D = SOCKS5_DATA(C);
+  if (!c->extra) {
+    rwm_skip_data (&c->in, c->in.total_bytes);
+    return 0;
+  }
+  connection_job_t P = job_incref (c->extra);
+  struct socks5_data *PD = SOCKS5_DATA(P);
+  int bytes = c->in.total_bytes;
+
+  struct raw_message *r = malloc (sizeof (*r));
+  rwm_move (r, &c->in);
+  rwm_init (&c->in, 0);
+  if (c->type == &ct_socks5_server) {
+    MODULE_STAT->S.bytes_in += bytes;
+  } else {
+    MODULE_STAT->S.bytes_out += bytes;
+  }
+  int queued = __sync_add_and_fetch (&PD->queued, bytes);
+  mpq_push_w (CONN_INFO(P)->out_queue, PTR_MOVE(r), 0);
+  job_signal (JOB_REF_CREATE_PASS (P), JS_RUN);
+
+  if (queued > SOCKS5_MAX_QUEUED && !D->read_stopped) {
+    socks5_stop_reading (C, P);
+  }
+  job_decref (JOB_REF_PASS (P));
+  return 0;
+}
+
+int socks5_parse_execute (connection_job_t C) {
+  struct connection_info *c = CONN_INFO(C);
+  struct socks5_data *D = SOCKS5_DATA(C);
+  unsigned char buf[2 + 255 + 1 + 255 + 1];
+  int len = c->in.total_bytes, need, i;
+
+  switch (D->state) {
+  case S5_GREETING: {
+    if (len < 2) {
+      return NEED_MORE_BYTES;
+    }
+    assert (rwm_fetch_lookup (&c->in, buf, 2) == 2);
+    if (buf[0] != 5) {
+      vkprintf (1, "socks5 connection #%d: version %d is not supported\n", c->fd, buf[0]);
+      fail_connection (C, -1);
+      return 0;
+    }
+    need = 2 + buf[1];
+    if (len < need) {
+      return NEED_MORE_BYTES;
+    }
+    assert (rwm_fetch_data (&c->in, buf, need) == need);
+    int want = users_num ? SOCKS_AUTH_USERPASS : SOCKS_AUTH_NONE, method = SOCKS_AUTH_NO_ACCEPT;
+    for (i = 2; i < need; i++) {
+      if (buf[i] == want) {
+        method = want;
+      }
+    }
+    unsigned char r[2] = { 5, method };
+    socks5_reply (C, r, 2);
+    if (method == SOCKS_AUTH_NO_ACCEPT) {
+      MODULE_STAT->S.auth_failures++;
+      return socks5_fail (C, -1);
+    }
+    D->state = users_num ? S5_AUTH : S5_REQUEST;
+    return 0;
+  }
+  case S5_AUTH: {
+    if (len < 2) {
+      return NEED_MORE_BYTES;
+    }
+    assert (rwm_fetch_lookup (&c->in, buf, 2) == 2);
+    int ulen = buf[1], plen;
+    if (buf[0] != SOCKS_USERPASS_VERSION) {
+      fail_connection (C, -1);
+      return 0;
+    }
+    if (len < 3 + ulen) {
+      return NEED_MORE_BYTES;
+    }
+    assert (rwm_fetch_lookup (&c->in, buf, 3 + ulen) == 3 + ulen);
+    plen = buf[2 + ulen];
+    need = 3 + ulen + plen;
+    if (len < need) {
+      return NEED_MORE_BYTES;
+    }
+    assert (rwm_fetch_data (&c->in, buf, need) == need);
+    buf[need] = 0;
+    buf[2 + ulen] = 0;
+    for (i = 0; i < users_num; i++) {
+      if (!strcmp (Users[i].username, (char *) buf + 2) && !strcmp (Users[i].password, (char *) buf + 3 + ulen)) {
+        break;
+      }
+    }
+    unsigned char r[2] = { SOCKS_USERPASS_VERSION, i < users_num ? 0 : 1 };
+    socks5_reply (C, r, 2);
+    if (i == users_num) {
+      vkprintf (1, "socks5 connection #%d: authentication failed\n", c->fd);
+      MODULE_STAT->S.auth_failures++;
+      return socks5_fail (C, -1);
+    }
+    D->state = S5_REQUEST;
+    return 0;
+  }
+  case S5_REQUEST: {
+    if (len < 5) {
+      return NEED_MORE_BYTES;
+    }
+    assert (rwm_fetch_lookup (&c->in, buf, 5) == 5);
+    if (buf[0] != 5) {
+      fail_connection (C, -1);
+      return 0;
+    }
+    switch (buf[3]) {
+    case SOCKS_ATYP_IPV4:
+      need = 4 + 4 + 2;
+      break;
+    case SOCKS_ATYP_IPV6:
+      need = 4 + 16 + 2;
+      break;
+    case SOCKS_ATYP_DOMAIN:
+      need = 4 + 1 + buf[4] + 2;
+      break;
+    default:
+      MODULE_STAT->S.handshake_errors++;
+      return socks5_fail (C, SOCKS_REP_ATYP_UNSUPPORTED);
+    }
+    if (len < need) {
+      return NEED_MORE_BYTES;
+    }
+    assert (rwm_fetch_data (&c->in, buf, need) == need);
+    if (buf[1] != SOCKS_CMD_CONNECT) {
+      MODULE_STAT->S.handshake_errors++;
+      return socks5_fail (C, SOCKS_REP_CMD_UNSUPPORTED);
+    }
+    D->target_port = buf[need - 2] << 8 | buf[need - 1];
+    if (buf[3] == SOCKS_ATYP_DOMAIN) {
+      char name[256];
+      memcpy (name, buf + 5, buf[4]);
+      name[buf[4]] = 0;
+      vkprintf (2, "socks5 connection #%d: CONNECT %s:%d\n", c->fd, name, D->target_port);
+      // socks5h-клиенты присылают и адреса строкой
+      if (inet_pton (AF_INET, name, D->target_addr) == 1) {
+        D->target_family = AF_INET;
+      } else if (inet_pton (AF_INET6, name, D->target_addr) == 1) {
+        D->target_family = AF_INET6;
+      } else {
+        return socks5_resolve (C, name);
+      }
+      return socks5_connect (C);
+    }
+    D->target_family = buf[3] == SOCKS_ATYP_IPV4 ? AF_INET : AF_INET6;
+    memcpy (D->target_addr, buf + 4, need - 6);
+    return socks5_connect (C);
+  }
+  case S5_RESOLVING:
+  case S5_CONNECTING:
+    // данные вслед за запросом ждут ответа цели
+    return NEED_MORE_BYTES;
+  case S5_RELAY:
+    return socks5_relay (C);
+  default:
+    rwm_skip_data (&c->in, len);
+    return 0;
+  }
+}
+
+/*
+ * Обратное давление. C перестаёт читать сокет и оставляет ссылку на себя
+ * в P; сокет P, отправив достаточно, будит C через S5_EV_RESUME
+ */
+static void socks5_stop_reading (connection_job_t C, connection_job_t P) {
+  struct connection_info *c = CONN_INFO(C);
+  struct socks5_data *D = SOCKS5_DATA(C), *PD = SOCKS5_DATA(P);
+  socket_connection_job_t S = c->io_conn;
+  if (!S || c->status != conn_working) {
+    return;
+  }
+  D->read_stopped = 1;
+  __sync_fetch_and_or (&SOCKET_CONN_INFO(S)->flags, C_STOPREAD);
+  MODULE_STAT->S.read_stops++;
+
+  connection_job_t old = __sync_lock_test_and_set (&PD->stopped_peer, job_incref (C));
+  if (old) {
+    job_decref (JOB_REF_PASS (old));
+  }
+  // очередь могла уйти, пока ставили ссылку: тогда будим себя сами
+  if (PD->queued <= SOCKS5_MAX_QUEUED / 2) {
+    old = __sync_lock_test_and_set (&PD->stopped_peer, NULL);
+    if (old) {
+      socks5_notify (old, S5_EV_RESUME);
+      job_decref (JOB_REF_PASS (old));
+    }
+  }
+}
+
+static void socks5_resume_reading (connection_job_t C) {
+  struct connection_info *c = CONN_INFO(C);
+  struct socks5_data *D = SOCKS5_DATA(C);
+  socket_connection_job_t S = c->io_conn;
+  if (!D->read_stopped) {
+    return;
+  }
+  D->read_stopped = 0;
+  if (S && c->status == conn_working) {
+    __sync_fetch_and_and (&SOCKET_CONN_INFO(S)->flags, ~C_STOPREAD);
+    job_signal (JOB_REF_CREATE_PASS (S), JS_RUN);
+  }
+}
+
+/* в потоке сокета: S - сокетное соединение, его conn - наша сторона */
+int socks5_data_sent (connection_job_t S, int bytes) {
+  connection_job_t C = SOCKET_CONN_INFO(S)->conn;
+  struct socks5_data *D = SOCKS5_DATA(C);
+  int queued = __sync_add_and_fetch (&D->queued, -bytes);
+  if (queued <= SOCKS5_MAX_QUEUED / 2 && D->stopped_peer) {
+    connection_job_t P = __sync_lock_test_and_set (&D->stopped_peer, NULL);
+    if (P) {
+      socks5_notify (P, S5_EV_RESUME);
+      job_decref (JOB_REF_PASS (P));
+    }
+  }
+  return 0;
+}
+
+int socks5_data_received (connection_job_t C, int bytes) {
+  struct connection_info *c = CONN_INFO(C);
+  struct socks5_data *D = SOCKS5_DATA(C);
+  int ev = __sync_fetch_and_and (&D->events, 0);
+  if (!ev) {
+    return 0;
+  }
+  __sync_synchronize ();
+
+  if ((ev & S5_EV_RESOLVED) && D->state == S5_RESOLVING) {
+    if (D->resolve_status == DNS_OK) {
+      socks5_connect (C);
+    } else {
+      MODULE_STAT->S.connect_failures++;
+      socks5_fail (C, SOCKS_REP_HOST_UNREACH);
+    }
+  }
+  if ((ev & S5_EV_CONNECTED) && D->state == S5_CONNECTING) {
+    socks5_reply_request (C, SOCKS_REP_SUCCESS);
+    D->state = S5_RELAY;
+    D->relayed = 1;
+    MODULE_STAT->S.relays++;
+    MODULE_STAT->S.active_relays++;
+  }
+  if (ev & S5_EV_PEER_CLOSED) {
+    if (D->state == S5_CONNECTING) {
+      MODULE_STAT->S.connect_failures++;
+      socks5_fail (C, SOCKS_REP_CONN_REFUSED);
+    } else if (c->status == conn_working) {
+      // отдать уже полученное от соседа и закрыть
+      D->state = S5_CLOSING;
+      connection_write_close (C);
+    } else if (c->status == conn_connecting) {
+      fail_connection (C, -1);
+    }
+  }
+  if (ev & S5_EV_RESUME) {
+    socks5_resume_reading (C);
+  }
+  return 0;
+}
+
+int socks5_close (connection_job_t C, int who) {
+  struct connection_info *c = CONN_INFO(C);
+  struct socks5_data *D = SOCKS5_DATA(C);
+  vkprintf (1, "closing %s connection #%d %s:%d -> %s:%d\n", c->type->title, c->fd, show_our_ip (C), c->our_port, show_remote_ip (C), c->remote_port);
+
+  if (D->relayed) {
+    MODULE_STAT->S.active_relays--;
+  } else if (c->type == &ct_socks5_server && D->state < S5_RESOLVING) {
+    // версия, обрыв или таймаут до запроса; остальные отказы посчитаны на месте
+    MODULE_STAT->S.handshake_errors++;
+  }
+  connection_job_t P = __sync_lock_test_and_set (&D->stopped_peer, NULL);
+  if (P) {
+    job_decref (JOB_REF_PASS (P));
+  }
+  if (c->extra) {
+    job_t E = PTR_MOVE (c->extra);
+    socks5_notify (E, S5_EV_PEER_CLOSED);
+    job_decref (JOB_REF_PASS (E));
+  }
+  return cpu_server_close_connection (C, who);
+}
+
+int socks5_write_packet (connection_job_t C, struct raw_message *raw) {
+  rwm_union (&CONN_INFO(C)->out, raw);
+  return 0;
+}
+
+int socks5_target_init_outbound (connection_job_t C) {
+  SOCKS5_DATA(C)->state = S5_RELAY;
+  return 0;
+}
+
+int socks5_target_connected (connection_job_t C) {
+  struct connection_info *c = CONN_INFO(C);
+  vkprintf (2, "socks5 target connected #%d %s:%d -> %s:%d\n", c->fd, show_our_ip (C), c->our_port, show_remote_ip (C), c->remote_port);
+  if (c->extra) {
+    socks5_notify (c->extra, S5_EV_CONNECTED);
+  }
+  return 0;
+}
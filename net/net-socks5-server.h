@@ -0,0 +1,58 @@
+/*
+ * net-socks5-server.h - SOCKS5-фронтенд на движке соединений
+ *
+ * Клиентские соединения - тип ct_socks5_server, принимаются обычным
+ * слушающим соединением и разбираются в parse_execute: приветствие,
+ * USER/PASS (RFC 1929), если заданы пользователи, и CONNECT на IPv4, IPv6
+ * или имя. Имена резолвит net-dns-resolver без блокировок. Соединение с
+ * целью - исходящее ct_socks5_target; дальше обе стороны перекладывают
+ * raw_message из in в out_queue соседа, как proxy pass в
+ * net-tcp-rpc-ext-server.c, в тех же потоках и с теми же лимитами.
+ *
+ * Обратное давление: сторона, чей сосед не успел отправить больше
+ * SOCKS5_MAX_QUEUED байт, перестаёт читать свой сокет (C_STOPREAD), пока
+ * очередь соседа не уйдёт в сокет наполовину.
+ *
+ * Адрес цели (после резолва) проверяется списком доступа net-ip-acl:
+ * по умолчанию запрещены неуказанные, loopback, частные (RFC 1918, CGNAT,
+ * ULA), link-local, служебные, multicast и зарезервированные адреса, а
+ * также NAT64 и 6to4 - иначе прокси открывает снаружи доступ к localhost
+ * (в том числе к порту статистики), внутренней сети и метаданным облака.
+ * Отказ - ответ 0x02 (запрещено правилами).
+ */
+
+#pragma once
+
+#include "net/net-connections.h"
+
+#define SOCKS5_HANDSHAKE_TIMEOUT 10.0
+#define SOCKS5_MAX_QUEUED (1 << 20)
+
+extern conn_type_t ct_socks5_server, ct_socks5_target;
+
+/* до запуска движка; 0 или -1, если таблица полна или такой уже есть */
+int socks5_server_add_user (const char *username, const char *password);
+int socks5_server_users (void);
+
+/* файлы префиксов целей: IP_ACL_BLACKLIST - запретить, IP_ACL_WHITELIST - разрешить вопреки
+   остальным правилам; до socks5_server_init_acl */
+void socks5_server_set_acl_file (const char *filename, unsigned flags);
+
+/* allow_private - не запрещать внутренние адреса по умолчанию, whitelist_only - разрешать
+   только цели из whitelist; 0 или -1, если список не загрузился */
+int socks5_server_init_acl (int allow_private, int whitelist_only);
+
+struct socks5_server_stat {
+  long long accepted;
+  long long handshake_errors;       /* не SOCKS5, обрыв или таймаут до CONNECT */
+  long long auth_failures;
+  long long connect_failures;       /* не резолвится, отказ или обрыв до ответа */
+  long long acl_rejects;            /* цель запрещена списком доступа */
+  long long relays;                 /* успешных CONNECT */
+  long long active_relays;
+  long long bytes_in;               /* от клиентов к целям */
+  long long bytes_out;              /* от целей к клиентам */
+  long long read_stops;             /* срабатываний обратного давления */
+};
+
+void fetch_socks5_server_stat (struct socks5_server_stat *S);
@@ -36,10 +36,12 @@
 #include <stdio.h>
 
 #include "net/net-connections.h"
+#include "net/net-tcp-connections.h"
 #include "net/net-msg.h"
 #include "net/net-msg-buffers.h"
 #include "crypto/aesni256.h"
 #include "net/net-crypto-aes.h"
+#include "net/net-plugins.h"
 #include "kprintf.h"
 
 
@@ -55,25 +57,171 @@ int cpu_tcp_free_connection_buffers (connection_job_t C) /* {{{ */ {
 /* }}} */
 
 
-int cpu_tcp_server_writer (connection_job_t C) /* {{{ */ {
-  assert_net_cpu_thread ();
+/* {{{ пакетное шифрование AES-256-CBC исходящих (conn_target) соединений */
+/*
+  CBC-шифрование последовательно внутри потока, и одно соединение почти не
+  загружает конвейер AES-NI. Writer соединения с middle-end оставляет полные
+  блоки открытого текста в c->out и ставит соединение в пачку своего NET-CPU
+  потока; пачка шифруется вперемешку (crypto/aes-cbc-mb.c), когда в ней
+  AES_CBC_MB_MAX_LANES соединений или когда очередь потока опустела
+  (idle-callback). Любой другой путь (синхронный writer, совмещённый CRC в
+  tcp_rpc_write_packet) просто находит открытый текст в c->out, поэтому
+  порядок байт потока не меняется; цепочечное значение CBC всегда хранится
+  в write_aeskey.
+*/
+
+#define TCP_AES_MB_MIN_BYTES 1024  /* меньшие объёмы не окупают передачу IV из EVP-контекста и обратно */
+#define TCP_AES_MB_CHUNK 16384
+
+static __thread connection_job_t aes_mb_pending[AES_CBC_MB_MAX_LANES];
+static __thread int aes_mb_pending_cnt;
+static __thread unsigned char *aes_mb_buf;
+
+static int cpu_tcp_push_output (connection_job_t C, struct raw_message *out, int stop);
+
+/* все соединения P[] заблокированы этим потоком */
+static void cpu_tcp_aes_mb_encrypt (connection_job_t *P, int n) {
+  struct aes_cbc_mb_lane L[AES_CBC_MB_MAX_LANES];
+  unsigned char iv[AES_CBC_MB_MAX_LANES][16];
+  int len[AES_CBC_MB_MAX_LANES];
+  int i, more = 1;
+
+  if (!aes_mb_buf) {
+    assert (!posix_memalign ((void **)&aes_mb_buf, 64, AES_CBC_MB_MAX_LANES * TCP_AES_MB_CHUNK));
+  }
+  for (i = 0; i < n; i++) {
+    struct aes_crypto *T = CONN_INFO(P[i])->crypto;
+    evp_cipher_ctx_get_iv (T->write_aeskey, iv[i]);
+    L[i].key = T->write_mbkey;
+    L[i].iv = iv[i];
+  }
+
+  while (more) {
+    more = 0;
+    for (i = 0; i < n; i++) {
+      struct connection_info *c = CONN_INFO(P[i]);
+      unsigned char *buf = aes_mb_buf + i * TCP_AES_MB_CHUNK;
+      len[i] = c->out.total_bytes & -16;
+      if (len[i] > TCP_AES_MB_CHUNK) {
+        len[i] = TCP_AES_MB_CHUNK;
+        more = 1;
+      }
+      if (len[i]) {
+        assert (rwm_fetch_data (&c->out, buf, len[i]) == len[i]);
+      }
+      L[i].in = buf;
+      L[i].out = buf;
+      L[i].blocks = len[i] >> 4;
+    }
+    aes_cbc_mb_encrypt (L, n);
+    for (i = 0; i < n; i++) {
+      if (len[i]) {
+        assert (rwm_push_data (&CONN_INFO(P[i])->out_p, aes_mb_buf + i * TCP_AES_MB_CHUNK, len[i]) == len[i]);
+      }
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    evp_cipher_ctx_set_iv (((struct aes_crypto *)CONN_INFO(P[i])->crypto)->write_aeskey, iv[i]);
+  }
+}
+
+/* self - соединение, чей writer выполняется сейчас (уже заблокировано, out_p отправит сам), или NULL */
+static void cpu_tcp_aes_mb_flush (connection_job_t self) {
+  connection_job_t P[AES_CBC_MB_MAX_LANES];
+  int i, n = 0, cnt = aes_mb_pending_cnt;
+
+  /* unlock_job() ниже может выполнить writer-ы, которые снова наполнят пачку */
+  aes_mb_pending_cnt = 0;
+
+  for (i = 0; i < cnt; i++) {
+    connection_job_t C = aes_mb_pending[i];
+    if (C != self && !try_lock_job (C, 0, 0)) {
+      /* выполняется в другом потоке: c->out зашифрует его собственный writer */
+      job_signal (JOB_REF_PASS (C), JS_RUN);
+      continue;
+    }
+    struct connection_info *c = CONN_INFO (C);
+    if ((c->flags & C_ERROR) || !c->crypto) {
+      if (C == self) {
+        job_decref (JOB_REF_PASS (C));
+      } else {
+        unlock_job (JOB_REF_PASS (C));
+      }
+      continue;
+    }
+    P[n++] = C;
+  }
 
+  if (n) {
+    cpu_tcp_aes_mb_encrypt (P, n);
+  }
+
+  for (i = 0; i < n; i++) {
+    connection_job_t C = P[i];
+    if (C == self) {
+      job_decref (JOB_REF_PASS (C));
+      continue;
+    }
+    struct connection_info *c = CONN_INFO (C);
+    cpu_tcp_push_output (C, &c->out_p, c->status == conn_write_close);
+    unlock_job (JOB_REF_PASS (C));
+  }
+}
+
+/* 1 = полные блоки c->out зашифрует пачка этого потока */
+static int cpu_tcp_aes_mb_defer (connection_job_t C) {
   struct connection_info *c = CONN_INFO (C);
+  struct aes_crypto *T = c->crypto;
+  struct job_thread *JT = this_job_thread;
 
-  int stop = 0;
-  if (c->status == conn_write_close) {
-    stop = 1;
+  if (!T->write_mbkey || !c->target || c->type->crypto_encrypt_output != cpu_tcp_aes_crypto_encrypt_output) {
+    return 0;
+  }
+  if (!JT || JT->thread_class != JC_CONNECTION) {
+    return 0;
   }
 
-  while (1) {
-    struct raw_message *raw = mpq_pop_nw (c->out_queue, 4);
-    if (!raw) { break; }
-    //rwm_union (out, raw);
-    c->type->write_packet (C, raw);
-    free (raw);
+  int i;
+  for (i = 0; i < aes_mb_pending_cnt; i++) {
+    if (aes_mb_pending[i] == C) {
+      return 1;
+    }
+  }
+  if (c->out.total_bytes < TCP_AES_MB_MIN_BYTES) {
+    return 0;
   }
 
-  c->type->flush (C);
+  aes_mb_pending[aes_mb_pending_cnt++] = job_incref (C);
+  if (aes_mb_pending_cnt == AES_CBC_MB_MAX_LANES) {
+    cpu_tcp_aes_mb_flush (C);
+  }
+  return 1;
+}
+
+static void cpu_tcp_aes_mb_new_thread (void) {
+}
+
+static void cpu_tcp_aes_mb_idle (void) {
+  while (aes_mb_pending_cnt) {
+    cpu_tcp_aes_mb_flush (NULL);
+  }
+}
+
+static struct thread_callback cpu_tcp_aes_mb_thread_callback = {
+  .new_thread = cpu_tcp_aes_mb_new_thread,
+  .idle = cpu_tcp_aes_mb_idle,
+  .next = NULL
+};
+
+static void cpu_tcp_aes_mb_register (void) __attribute__ ((constructor));
+static void cpu_tcp_aes_mb_register (void) {
+  register_thread_callback (&cpu_tcp_aes_mb_thread_callback);
+}
+/* }}} */
+
+static int cpu_tcp_push_output (connection_job_t C, struct raw_message *out, int stop) /* {{{ */ {
+  struct connection_info *c = CONN_INFO (C);
 
   struct raw_message *raw = malloc (sizeof (*raw));
   if (!raw) {
@@ -81,14 +229,8 @@ int cpu_tcp_server_writer (connection_job_t C) /* {{{ */ {
     return -1;  // Исправление: проверка на NULL после malloc
   }
 
-  if (c->type->crypto_encrypt_output && c->crypto) {
-    c->type->crypto_encrypt_output (C);
-    *raw = c->out_p;
-    rwm_init (&c->out_p, 0);
-  } else {
-    *raw = c->out;
-    rwm_init (&c->out, 0);
-  }
+  *raw = *out;
+  rwm_init (out, 0);
 
   // Исправление: проверка на NULL и обработка ошибок
   if (raw->total_bytes && c->io_conn) {
@@ -99,7 +241,9 @@ int cpu_tcp_server_writer (connection_job_t C) /* {{{ */ {
       free (raw);
       return -1;
     }
+    __sync_fetch_and_add (&c->out_packets_queued, 1);
     if (mpq_push_w (io_c->out_packet_queue, raw, 0) < 0) {
+      __sync_fetch_and_add (&c->out_packets_queued, -1);
       // Ошибка при добавлении в очередь - освобождаем память
       vkprintf (1, "Warning: Failed to push message to connection %p (queue full)\n", c->io_conn);
       rwm_free (raw);
@@ -120,9 +264,42 @@ int cpu_tcp_server_writer (connection_job_t C) /* {{{ */ {
 }
 /* }}} */
 
+int cpu_tcp_server_writer (connection_job_t C) /* {{{ */ {
+  assert_net_cpu_thread ();
+
+  struct connection_info *c = CONN_INFO (C);
+
+  int stop = 0;
+  if (c->status == conn_write_close) {
+    stop = 1;
+  }
+
+  while (1) {
+    struct raw_message *raw = mpq_pop_nw (c->out_queue, 4);
+    if (!raw) { break; }
+    //rwm_union (out, raw);
+    c->type->write_packet (C, raw);
+    free (raw);
+  }
+
+  c->type->flush (C);
+
+  struct raw_message *out = &c->out;
+  if (c->type->crypto_encrypt_output && c->crypto) {
+    if (stop || !cpu_tcp_aes_mb_defer (C)) {
+      c->type->crypto_encrypt_output (C);
+    }
+    out = &c->out_p;
+  }
+
+  return cpu_tcp_push_output (C, out, stop);
+}
+/* }}} */
+
 int cpu_tcp_server_reader (connection_job_t C) /* {{{ */ {
   assert_net_cpu_thread ();
   struct connection_info *c = CONN_INFO(C);
+  int old_in_bytes = c->in.total_bytes;
 
   while (1) {
     struct raw_message *raw = mpq_pop_nw (c->in_queue, 4);
@@ -149,6 +326,13 @@ int cpu_tcp_server_reader (connection_job_t C) /* {{{ */ {
     }
   }
 
+  if (PLUGIN_HOOK_ACTIVE (HOOK_DATA_RECEIVED) && c->basic_type == ct_inbound && c->in.total_bytes > old_in_bytes) {
+    if (plugin_hook_data_received (C, c->in.total_bytes - old_in_bytes) == PLUGIN_REJECT) {
+      fail_connection (C, -1);
+      return -1;
+    }
+  }
+
   int r = c->in.total_bytes;
 
   int s = c->skip_bytes;
@@ -521,7 +521,7 @@ int tcp_rpcc_default_check_ready (connection_job_t C) {
   }
    
   if (c->status == conn_working) {
-    return c->ready = cr_ok;
+    return c->ready = (c->flags & C_DRAINING) ? cr_stopped : cr_ok;
   }
 
   fail_connection (C, -7);
@@ -64,6 +64,7 @@ void tcp_rpc_conn_send_init (connection_job_t C, struct raw_message *raw, int fl
   socket_connection_job_t S = c->io_conn;
 
   if (S) {
+    __sync_fetch_and_add (&c->out_packets_queued, 1);
     mpq_push_w (SOCKET_CONN_INFO (S)->out_packet_queue, r, 0);
     job_signal (JOB_REF_CREATE_PASS (S), JS_RUN);
   }
@@ -137,6 +137,7 @@ struct tcp_rpc_data {
   int extra_int2;
   int extra_int3;
   int extra_int4;
+  int ext_secret_id;	/* ext server: index of matched -S secret, -1 - none */
   double extra_double, extra_double2;
   crc32_partial_func_t custom_crc_partial;
 };
@@ -42,9 +42,14 @@
 #include "common/resolver.h"
 #include "common/rpc-const.h"
 #include "common/sha256.h"
+#include "common/common-stats.h"
+#include "jobs/jobs.h"
 #include "net/net-connections.h"
 #include "net/net-crypto-aes.h"
+#include "net/net-dns-resolver.h"
 #include "net/net-events.h"
+#include "net/net-latency-tracer.h"
+#include "net/net-plugins.h"
 #include "net/net-tcp-connections.h"
 #include "net/net-tcp-rpc-ext-server.h"
 #include "net/net-thread.h"
@@ -155,14 +160,84 @@ int tcp_proxy_pass_write_packet (connection_job_t C, struct raw_message *raw) {
 
 int tcp_rpcs_default_execute (connection_job_t c, int op, struct raw_message *msg);
 
-static unsigned char ext_secret[16][16];
+static unsigned char ext_secret[EXT_SECRET_MAX][16];
 static int ext_secret_cnt = 0;
 
 void tcp_rpcs_set_ext_secret (unsigned char secret[16]) {
-  assert (ext_secret_cnt < 16);
+  assert (ext_secret_cnt < EXT_SECRET_MAX);
   memcpy (ext_secret[ext_secret_cnt ++], secret, 16);
 }
 
+int tcp_rpcs_ext_secret_count (void) {
+  return ext_secret_cnt;
+}
+
+/*
+ *
+ *                PER-SECRET STATISTICS
+ *
+ */
+
+#define MODULE ext_secrets
+
+MODULE_STAT_TYPE {
+  struct ext_secret_stat secret[EXT_SECRET_MAX];
+  struct ext_secret_stat unmatched;
+};
+
+MODULE_INIT
+
+static inline struct ext_secret_stat *ext_secret_stat (int secret_id) {
+  return secret_id >= 0 && secret_id < ext_secret_cnt ? &MODULE_STAT->secret[secret_id] : &MODULE_STAT->unmatched;
+}
+
+int tcp_rpcs_ext_secret_id (connection_job_t C) {
+  return TCP_RPC_DATA(C)->ext_secret_id;
+}
+
+void tcp_rpcs_ext_secret_traffic (connection_job_t C, int rpcs, int bytes_in, int bytes_out) {
+  int secret_id = TCP_RPC_DATA(C)->ext_secret_id;
+  if (secret_id >= 0) {
+    struct ext_secret_stat *S = &MODULE_STAT->secret[secret_id];
+    S->rpcs += rpcs;
+    S->bytes_in += bytes_in;
+    S->bytes_out += bytes_out;
+  }
+}
+
+void fetch_ext_secret_stats (struct ext_secret_stat S[EXT_SECRET_MAX], struct ext_secret_stat *unmatched) {
+  int i, j;
+  memset (S, 0, EXT_SECRET_MAX * sizeof (struct ext_secret_stat));
+  memset (unmatched, 0, sizeof (*unmatched));
+  for (i = 0; i <= max_job_thread_id; i++) {
+    MODULE_STAT_TYPE *T = MODULE_STAT_ARR[i];
+    if (!T) {
+      continue;
+    }
+    for (j = 0; j <= EXT_SECRET_MAX; j++) {
+      struct ext_secret_stat *from = j < EXT_SECRET_MAX ? &T->secret[j] : &T->unmatched, *to = j < EXT_SECRET_MAX ? &S[j] : unmatched;
+      to->connections += from->connections;
+      to->handshake_rejects += from->handshake_rejects;
+      to->replay_hits += from->replay_hits;
+      to->rpcs += from->rpcs;
+      to->bytes_in += from->bytes_in;
+      to->bytes_out += from->bytes_out;
+    }
+  }
+}
+
+/* first secret whose HMAC of client_hello (with zeroed random) matches client_random, or ext_secret_cnt */
+static int tls_match_secret (const unsigned char *client_hello, int len, const unsigned char client_random[32], unsigned char expected_random[32]) {
+  int secret_id;
+  for (secret_id = 0; secret_id < ext_secret_cnt; secret_id++) {
+    sha256_hmac (ext_secret[secret_id], 16, (unsigned char *) client_hello, len, expected_random);
+    if (memcmp (expected_random, client_random, 28) == 0) {
+      break;
+    }
+  }
+  return secret_id;
+}
+
 static int allow_only_tls;
 
 struct domain_info {
@@ -815,8 +890,21 @@ void tcp_rpc_add_proxy_domain (const char *domain) {
   }
 }
 
+#define DOMAIN_RESOLVE_TIMEOUT 10.0
+
 void tcp_rpc_init_proxy_domains() {
   int i;
+  // resolve all domains at once instead of one blocking lookup per domain;
+  // update_domain_info then finds the answers in the resolver cache
+  for (i = 0; i < DOMAIN_HASH_MOD; i++) {
+    struct domain_info *info;
+    for (info = domains[i]; info != NULL; info = info->next) {
+      dns_resolver_query (info->domain, AF_INET, NULL, NULL);
+      dns_resolver_query (info->domain, AF_INET6, NULL, NULL);
+    }
+  }
+  dns_resolver_wait (DOMAIN_RESOLVE_TIMEOUT);
+
   for (i = 0; i < DOMAIN_HASH_MOD; i++) {
     struct domain_info *info = domains[i];
     while (info != NULL) {
@@ -838,6 +926,7 @@ struct client_random {
   struct client_random *next_by_time;
   struct client_random *next_by_hash;
   int time;
+  int secret_id;    /* secret the hello matched, for replay stats; -1 - not matched or imported */
 };
 
 #define RANDOM_HASH_BITS 14
@@ -859,21 +948,26 @@ static struct client_random **get_client_random_bucket (unsigned char random[16]
   return client_randoms + id;
 }
 
-static int have_client_random (unsigned char random[16]) {
+static struct client_random *find_client_random (unsigned char random[16]) {
   struct client_random *cur = *get_client_random_bucket (random);
   while (cur != NULL) {
     if (memcmp (random, cur->random, 16) == 0) {
-      return 1;
+      return cur;
     }
     cur = cur->next_by_hash;
   }
-  return 0;
+  return NULL;
+}
+
+static int have_client_random (unsigned char random[16]) {
+  return find_client_random (random) != NULL;
 }
 
 static void add_client_random (unsigned char random[16]) {
   struct client_random *entry = malloc (sizeof (struct client_random));
   memcpy (entry->random, random, 16);
   entry->time = now;
+  entry->secret_id = -1;
   entry->next_by_time = NULL;
   if (last_client_random == NULL) {
     assert (first_client_random == NULL);
@@ -912,6 +1006,45 @@ static void delete_old_client_randoms() {
   }
 }
 
+static int cmp_client_random_record (const void *a, const void *b) {
+  int x = ((const struct client_random_record *) a)->time, y = ((const struct client_random_record *) b)->time;
+  return x < y ? -1 : x > y;
+}
+
+int tcp_rpc_export_client_randoms (struct client_random_record *R, int max, int window) {
+  struct client_random *cur;
+  int total = 0, skip, n = 0;
+  for (cur = first_client_random; cur; cur = cur->next_by_time) {
+    total += cur->time > now - window;
+  }
+  // the list is ordered by time, so the newest records are at its end
+  skip = total > max ? total - max : 0;
+  for (cur = first_client_random; cur; cur = cur->next_by_time) {
+    if (cur->time <= now - window || skip-- > 0) {
+      continue;
+    }
+    memcpy (R[n].random, cur->random, 16);
+    R[n].time = cur->time;
+    n++;
+  }
+  return n;
+}
+
+int tcp_rpc_import_client_randoms (struct client_random_record *R, int n) {
+  int i, imported = 0;
+  qsort (R, n, sizeof (*R), cmp_client_random_record);
+  for (i = 0; i < n; i++) {
+    // keep the list ordered by time and oldest entries at the tail of hash chains
+    if ((last_client_random && R[i].time < last_client_random->time) || have_client_random (R[i].random)) {
+      continue;
+    }
+    add_client_random (R[i].random);
+    last_client_random->time = R[i].time;
+    imported++;
+  }
+  return imported;
+}
+
 static int is_allowed_timestamp (int timestamp) {
   if (timestamp > now + 3) {
     // do not allow timestamps in the future
@@ -1000,6 +1133,7 @@ int tcp_rpcs_ext_alarm (connection_job_t C) {
 }
 
 int tcp_rpcs_ext_init_accepted (connection_job_t C) {
+  TCP_RPC_DATA(C)->ext_secret_id = -1;
   job_timer_insert (C, precise_now + 10);
   return tcp_rpcs_init_accepted_nohs (C);
 }
@@ -1008,6 +1142,11 @@ int tcp_rpcs_compact_parse_execute (connection_job_t C) {
 #define RETURN_TLS_ERROR(info) \
   return proxy_connection (C, info);  
 
+  if (latency_trace_rate) {
+    // frames split below are stamped from here (see ext_rpcs_execute)
+    latency_trace_rx = rdtsc ();
+  }
+
   struct tcp_rpc_data *D = TCP_RPC_DATA (C);
   if (D->crypto_flags & RPCF_COMPACT_OFF) {
     if (D->in_packet_num != -3) {
@@ -1150,27 +1289,28 @@ int tcp_rpcs_compact_parse_execute (connection_job_t C) {
         memcpy (client_random, client_hello + 11, 32);
         memset (client_hello + 11, '\0', 32);
 
-        if (have_client_random (client_random)) {
+        unsigned char expected_random[32];
+        struct client_random *seen = find_client_random (client_random);
+        if (seen) {
           vkprintf (1, "Receive again request with the same client random\n");
+          // no HMAC here: a replay costs the attacker a copy, the secret comes from the first hello
+          ext_secret_stat (seen->secret_id)->replay_hits ++;
           RETURN_TLS_ERROR(info);
         }
         add_client_random (client_random);
+        struct client_random *added = last_client_random;
         delete_old_client_randoms();
 
-        unsigned char expected_random[32];
-        int secret_id;
-        for (secret_id = 0; secret_id < ext_secret_cnt; secret_id++) {
-          sha256_hmac (ext_secret[secret_id], 16, client_hello, len, expected_random);
-          if (memcmp (expected_random, client_random, 28) == 0) {
-            break;
-          }
-        }
+        int secret_id = tls_match_secret (client_hello, len, client_random, expected_random);
+        added->secret_id = secret_id < ext_secret_cnt ? secret_id : -1;
         if (secret_id == ext_secret_cnt) {
           vkprintf (1, "Receive request with unmatched client random\n");
+          MODULE_STAT->unmatched.handshake_rejects ++;
           RETURN_TLS_ERROR(info);
         }
         int timestamp = *(int *)(expected_random + 28) ^ *(int *)(client_random + 28);
         if (!is_allowed_timestamp (timestamp)) {
+          MODULE_STAT->secret[secret_id].handshake_rejects ++;
           RETURN_TLS_ERROR(info);
         }
 
@@ -1187,6 +1327,7 @@ int tcp_rpcs_compact_parse_execute (connection_job_t C) {
         }
         if (cipher_suites_length <= 1 || client_hello[pos] != 0x13 || client_hello[pos + 1] < 0x01 || client_hello[pos + 1] > 0x03) {
           vkprintf (1, "Can't find supported cipher suite\n");
+          MODULE_STAT->secret[secret_id].handshake_rejects ++;
           RETURN_TLS_ERROR(info);
         }
         unsigned char cipher_suite_id = client_hello[pos + 1];
@@ -1320,6 +1461,7 @@ int tcp_rpcs_compact_parse_execute (connection_job_t C) {
         if (tag == 0xdddddddd || tag == 0xeeeeeeee || tag == 0xefefefef) {
           if (tag != 0xdddddddd && allow_only_tls) {
             vkprintf (1, "Expected random padding mode\n");
+            ext_secret_stat (ext_secret_cnt > 0 ? secret_id : -1)->handshake_rejects ++;
             RETURN_TLS_ERROR(default_domain_info);
           }
           assert (rwm_skip_data (&c->in, 64) == 64);
@@ -1352,11 +1494,22 @@ int tcp_rpcs_compact_parse_execute (connection_job_t C) {
       }
 
       if (ok) {
+        if (PLUGIN_HOOK_ACTIVE (HOOK_MTPROTO_HANDSHAKE) &&
+            plugin_hook_handshake (C, random_header, ext_secret_cnt > 0 ? secret_id : -1, D->extra_int4) == PLUGIN_REJECT) {
+          vkprintf (1, "handshake rejected by plugin, entering global skip mode\n");
+          ext_secret_stat (ext_secret_cnt > 0 ? secret_id : -1)->handshake_rejects ++;
+          return (-1 << 28);
+        }
+        if (ext_secret_cnt > 0) {
+          D->ext_secret_id = secret_id;
+          MODULE_STAT->secret[secret_id].connections ++;
+        }
         continue;
       }
 
       if (ext_secret_cnt > 0) {
         vkprintf (1, "invalid \"random\" 64-byte header, entering global skip mode\n");
+        MODULE_STAT->unmatched.handshake_rejects ++;
         return (-1 << 28);
       }
 
@@ -29,8 +29,36 @@ extern conn_type_t ct_tcp_rpc_ext_server;
 
 int tcp_rpcs_compact_parse_execute (connection_job_t c);
 
+#define EXT_SECRET_MAX 16
+
 void tcp_rpcs_set_ext_secret(unsigned char secret[16]);
+int tcp_rpcs_ext_secret_count (void);
+
+/* per -S secret, in the order of options; counted per thread */
+struct ext_secret_stat {
+  long long connections;          /* accepted handshakes */
+  long long handshake_rejects;
+  long long replay_hits;          /* TLS ClientHello with already seen client random */
+  long long rpcs;                 /* queries forwarded to middle-ends */
+  long long bytes_in, bytes_out;  /* payload of forwarded queries and answers */
+};
+
+/* index of the secret the client of C used, -1 if none yet or no secrets configured */
+int tcp_rpcs_ext_secret_id (connection_job_t C);
+void tcp_rpcs_ext_secret_traffic (connection_job_t C, int rpcs, int bytes_in, int bytes_out);
+/* sums over threads; unmatched gets rejects and replays that matched no secret */
+void fetch_ext_secret_stats (struct ext_secret_stat S[EXT_SECRET_MAX], struct ext_secret_stat *unmatched);
 
 void tcp_rpc_add_proxy_domain (const char *domain);
 
 void tcp_rpc_init_proxy_domains();
+
+struct client_random_record {
+  unsigned char random[16];
+  int time;
+};
+
+// replay protection cache handoff on binary upgrade: newest records received within last window seconds
+int tcp_rpc_export_client_randoms (struct client_random_record *R, int max, int window);
+// sorts R by time; returns number of records added
+int tcp_rpc_import_client_randoms (struct client_random_record *R, int n);
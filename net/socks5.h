@@ -1,13 +1,12 @@
 /*
- * socks5.h - SOCKS5 клиент/сервер с аутентификацией
- * Поддержка SOCKS4/SOCKS5, методы аутентификации
+ * socks5.h - константы протокола SOCKS5 и блокирующий клиент
+ * Сервер работает на движке соединений: net/net-socks5-server.h
  */
 
 #ifndef __SOCKS5_H__
 #define __SOCKS5_H__
 
 #include <stdint.h>
-#include <pthread.h>
 
 #define SOCKS5_PORT 1080
 #define SOCKS5_MAX_USERS 64
@@ -38,76 +37,11 @@
 #define SOCKS_REP_HOST_UNREACH 0x04
 #define SOCKS_REP_CONN_REFUSED 0x05
 #define SOCKS_REP_TTL_EXPIRED  0x06
+#define SOCKS_REP_CMD_UNSUPPORTED  0x07
+#define SOCKS_REP_ATYP_UNSUPPORTED 0x08
 
-/* Пользователь для аутентификации */
-typedef struct {
-    char username[SOCKS5_MAX_USERNAME_LEN];
-    char password[SOCKS5_MAX_PASSWORD_LEN];
-    int enabled;
-    uint64_t bytes_sent;
-    uint64_t bytes_received;
-} socks5_user_t;
-
-/* Статистика SOCKS5 */
-typedef struct {
-    uint64_t total_connections;
-    uint64_t active_connections;
-    uint64_t total_bytes_sent;
-    uint64_t total_bytes_received;
-    uint64_t auth_failures;
-    uint64_t failed_connections;
-} socks5_stats_t;
-
-/* Конфигурация SOCKS5 сервера */
-typedef struct {
-    int port;
-    char bind_address[64];
-    int auth_enabled;
-    int allow_udp;
-    char allowed_ips[256][64];
-    int allowed_count;
-    char denied_ips[256][64];
-    int denied_count;
-} socks5_config_t;
-
-/* Контекст SOCKS5 сервера */
-typedef struct {
-    int server_fd;
-    int running;
-    pthread_t thread;
-    socks5_config_t config;
-    socks5_user_t users[SOCKS5_MAX_USERS];
-    int user_count;
-    socks5_stats_t stats;
-    pthread_mutex_t lock;
-} socks5_server_t;
-
-/* Инициализация SOCKS5 сервера */
-int socks5_server_init(socks5_server_t *server, socks5_config_t *config);
-
-/* Запуск сервера */
-int socks5_server_start(socks5_server_t *server);
-
-/* Остановка сервера */
-int socks5_server_stop(socks5_server_t *server);
-
-/* Освобождение ресурсов */
-void socks5_server_destroy(socks5_server_t *server);
-
-/* Добавление пользователя */
-int socks5_add_user(socks5_server_t *server, const char *username, const char *password);
-
-/* Удаление пользователя */
-int socks5_remove_user(socks5_server_t *server, const char *username);
-
-/* Проверка аутентификации */
-int socks5_authenticate(socks5_server_t *server, const char *username, const char *password);
-
-/* Получение статистики */
-void socks5_get_stats(socks5_server_t *server, socks5_stats_t *stats);
-
-/* Экспорт статистики в JSON */
-int socks5_export_json(socks5_server_t *server, char *buffer, size_t buffer_size);
+/* RFC 1929 */
+#define SOCKS_USERPASS_VERSION 0x01
 
 /* SOCKS5 клиент */
 typedef struct {
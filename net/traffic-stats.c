@@ -9,6 +9,13 @@
 #include <stdlib.h>
 #include <time.h>
 
+/* Счётчик экземпляров: отличает заново инициализированную структуру по тому же адресу */
+static uint64_t traffic_instance_seq;
+
+/* Кэш шарда текущего потока */
+static __thread uint64_t tls_shard_owner;
+static __thread traffic_shard_t *tls_shard;
+
 /* Инициализация модуля */
 int traffic_stats_init(traffic_stats_t *stats) {
     if (!stats) {
@@ -25,6 +32,7 @@ int traffic_stats_init(traffic_stats_t *stats) {
     stats->entry_count = 0;
     stats->device_count = 0;
     stats->history_index = 0;
+    stats->instance_id = __sync_add_and_fetch(&traffic_instance_seq, 1);
     
     return 0;
 }
@@ -35,29 +43,209 @@ void traffic_stats_destroy(traffic_stats_t *stats) {
         return;
     }
     
+    for (int i = 0; i < stats->shard_count; i++) {
+        free(stats->shards[i]);
+        stats->shards[i] = NULL;
+    }
+    stats->shard_count = 0;
+    
     pthread_mutex_destroy(&stats->lock);
 }
 
-/* Поиск подключения по ID */
+/* Хеш connection_id (финализатор murmur3) */
+static inline uint32_t conn_hash(uint64_t connection_id) {
+    connection_id ^= connection_id >> 33;
+    connection_id *= 0xff51afd7ed558ccdULL;
+    connection_id ^= connection_id >> 33;
+    return (uint32_t)connection_id & (TRAFFIC_CONN_HASH_SIZE - 1);
+}
+
+/* Хеш device_id (FNV-1a) */
+static inline uint32_t device_hash(const char *device_id) {
+    uint32_t h = 2166136261u;
+    while (*device_id) {
+        h ^= (unsigned char)*device_id++;
+        h *= 16777619u;
+    }
+    return h & (TRAFFIC_DEVICE_HASH_SIZE - 1);
+}
+
+/* Начало/конец изменения индекса (только под lock) */
+static inline void index_write_begin(traffic_stats_t *stats) {
+    stats->index_seq++;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void index_write_end(traffic_stats_t *stats) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    stats->index_seq++;
+}
+
+/* Позиция connection_id в conn_index или позиция пустой ячейки */
+static uint32_t conn_index_probe(traffic_stats_t *stats, uint64_t connection_id) {
+    uint32_t pos = conn_hash(connection_id);
+    
+    for (int n = 0; n < TRAFFIC_CONN_HASH_SIZE; n++) {
+        int32_t slot = stats->conn_index[pos];
+        if (!slot || stats->entries[slot - 1].connection_id == connection_id) {
+            break;
+        }
+        pos = (pos + 1) & (TRAFFIC_CONN_HASH_SIZE - 1);
+    }
+    return pos;
+}
+
+/*
+ * Поиск подключения по ID. Не требует lock: индекс читается под seqlock,
+ * писатели (create/cleanup/reset) меняют его под lock.
+ */
 static int find_connection(traffic_stats_t *stats, uint64_t connection_id) {
-    for (int i = 0; i < stats->entry_count; i++) {
-        if (stats->entries[i].connection_id == connection_id) {
-            return i;
+    unsigned seq;
+    int32_t slot;
+    
+    do {
+        while ((seq = stats->index_seq) & 1) {
+            __asm__ __volatile__("" ::: "memory");
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        slot = stats->conn_index[conn_index_probe(stats, connection_id)];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (seq != stats->index_seq);
+    
+    return slot - 1;
+}
+
+/* Добавление в индекс (под lock, внутри index_write_begin/end) */
+static void conn_index_insert(traffic_stats_t *stats, int slot) {
+    uint32_t pos = conn_index_probe(stats, stats->entries[slot].connection_id);
+    stats->conn_index[pos] = slot + 1;
+}
+
+/* Удаление из индекса со сдвигом хвоста цепочки (без tombstone) */
+static void conn_index_remove(traffic_stats_t *stats, uint64_t connection_id) {
+    const uint32_t mask = TRAFFIC_CONN_HASH_SIZE - 1;
+    uint32_t hole = conn_index_probe(stats, connection_id);
+    
+    if (!stats->conn_index[hole]) {
+        return;
+    }
+    
+    for (uint32_t next = (hole + 1) & mask; stats->conn_index[next]; next = (next + 1) & mask) {
+        int32_t slot = stats->conn_index[next];
+        uint32_t home = conn_hash(stats->entries[slot - 1].connection_id);
+        /* Элемент можно перенести, если hole лежит на пути от home к next */
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            stats->conn_index[hole] = slot;
+            hole = next;
         }
     }
-    return -1;
+    stats->conn_index[hole] = 0;
 }
 
-/* Поиск устройства по ID */
+/* Поиск устройства по ID (под lock) */
 static int find_device(traffic_stats_t *stats, const char *device_id) {
-    for (int i = 0; i < stats->device_count; i++) {
-        if (strcmp(stats->devices[i].device_id, device_id) == 0) {
-            return i;
+    uint32_t pos = device_hash(device_id);
+    
+    for (int n = 0; n < TRAFFIC_DEVICE_HASH_SIZE; n++) {
+        int32_t idx = stats->device_index[pos];
+        if (!idx) {
+            return -1;
         }
+        if (strcmp(stats->devices[idx - 1].device_id, device_id) == 0) {
+            return idx - 1;
+        }
+        pos = (pos + 1) & (TRAFFIC_DEVICE_HASH_SIZE - 1);
     }
     return -1;
 }
 
+/* Интернирование устройства: devices только растёт, удаление лишь через reset */
+static void device_index_insert(traffic_stats_t *stats, int dev_idx) {
+    uint32_t pos = device_hash(stats->devices[dev_idx].device_id);
+    
+    while (stats->device_index[pos]) {
+        pos = (pos + 1) & (TRAFFIC_DEVICE_HASH_SIZE - 1);
+    }
+    stats->device_index[pos] = dev_idx + 1;
+}
+
+/* Шард счётчиков текущего потока; при нехватке шардов потоки делят их */
+static traffic_shard_t *get_shard(traffic_stats_t *stats) {
+    if (tls_shard_owner == stats->instance_id) {
+        return tls_shard;
+    }
+    
+    pthread_mutex_lock(&stats->lock);
+    
+    traffic_shard_t *shard = NULL;
+    pthread_t self = pthread_self();
+    
+    /* Поток мог уже получить шард, но кэш занят другим экземпляром */
+    for (int i = 0; i < stats->shard_count && !shard; i++) {
+        if (pthread_equal(stats->shards[i]->owner, self)) {
+            shard = stats->shards[i];
+        }
+    }
+    if (!shard && stats->shard_count < TRAFFIC_MAX_SHARDS) {
+        void *mem = NULL;
+        if (posix_memalign(&mem, 64, sizeof(traffic_shard_t)) == 0) {
+            memset(mem, 0, sizeof(traffic_shard_t));
+            shard = mem;
+            shard->owner = self;
+            stats->shards[stats->shard_count++] = shard;
+        }
+    }
+    if (!shard && stats->shard_count > 0) {
+        shard = stats->shards[stats->shard_assign++ % stats->shard_count];
+    }
+    
+    pthread_mutex_unlock(&stats->lock);
+    
+    if (shard) {
+        tls_shard = shard;
+        tls_shard_owner = stats->instance_id;
+    }
+    return shard;
+}
+
+/* Сумма глобальных счётчиков по шардам (под lock) */
+static void merge_global(traffic_stats_t *stats) {
+    uint64_t sent = 0, received = 0;
+    
+    for (int i = 0; i < stats->shard_count; i++) {
+        sent += stats->shards[i]->global.bytes_sent;
+        received += stats->shards[i]->global.bytes_received;
+    }
+    stats->total_bytes_sent = sent;
+    stats->total_bytes_received = received;
+}
+
+/* Удаление старых неактивных записей (вызывается под lock) */
+static int cleanup_inactive_locked(traffic_stats_t *stats, time_t inactive_threshold) {
+    time_t now = time(NULL);
+    int removed = 0;
+    
+    index_write_begin(stats);
+    for (int i = 0; i < stats->entry_slots; i++) {
+        traffic_entry_t *e = &stats->entries[i];
+        
+        if (!e->in_use || e->is_active) continue; /* Пропускаем свободные и активные */
+        
+        if (now - e->last_activity > inactive_threshold) {
+            /* Слот не сдвигается: обновления без lock держат его индекс */
+            conn_index_remove(stats, e->connection_id);
+            e->in_use = 0;
+            e->connection_id = 0;
+            stats->free_slots[stats->free_count++] = i;
+            stats->entry_count--;
+            removed++;
+        }
+    }
+    index_write_end(stats);
+    
+    return removed;
+}
+
 /* Создание новой записи о подключении */
 int traffic_stats_create_connection(traffic_stats_t *stats,
                                      uint64_t connection_id,
@@ -79,7 +267,7 @@ int traffic_stats_create_connection(traffic_stats_t *stats,
     /* Проверяем место */
     if (stats->entry_count >= MAX_TRAFFIC_ENTRIES) {
         /* Удаляем старые неактивные записи */
-        traffic_stats_cleanup_inactive(stats, 3600); /* 1 час */
+        cleanup_inactive_locked(stats, 3600); /* 1 час */
         
         if (stats->entry_count >= MAX_TRAFFIC_ENTRIES) {
             pthread_mutex_unlock(&stats->lock);
@@ -87,8 +275,33 @@ int traffic_stats_create_connection(traffic_stats_t *stats,
         }
     }
     
+    /* Интернируем устройство: обновления получают его индекс без strcmp */
+    time_t now = time(NULL);
+    int dev_idx = find_device(stats, device_id);
+    if (dev_idx < 0) {
+        if (stats->device_count < MAX_TRAFFIC_ENTRIES) {
+            dev_idx = stats->device_count++;
+            device_traffic_t *dev = &stats->devices[dev_idx];
+            memset(dev, 0, sizeof(device_traffic_t));
+            strncpy(dev->device_id, device_id, sizeof(dev->device_id) - 1);
+            strncpy(dev->client_ip, client_ip, sizeof(dev->client_ip) - 1);
+            dev->first_seen = now;
+            device_index_insert(stats, dev_idx);
+        }
+    }
+    
+    if (dev_idx >= 0) {
+        device_traffic_t *dev = &stats->devices[dev_idx];
+        dev->connection_count++;
+        dev->last_seen = now;
+    }
+    
     /* Создаём новую запись */
-    traffic_entry_t *entry = &stats->entries[stats->entry_count];
+    int slot = stats->free_count > 0 ? stats->free_slots[--stats->free_count]
+                                     : stats->entry_slots++;
+    traffic_entry_t *entry = &stats->entries[slot];
+    
+    index_write_begin(stats);
     entry->connection_id = connection_id;
     strncpy(entry->client_ip, client_ip, sizeof(entry->client_ip) - 1);
     entry->client_ip[sizeof(entry->client_ip) - 1] = '\0';
@@ -98,35 +311,70 @@ int traffic_stats_create_connection(traffic_stats_t *stats,
     entry->bytes_received = 0;
     entry->packets_sent = 0;
     entry->packets_received = 0;
-    entry->connection_start = time(NULL);
+    entry->connection_start = now;
     entry->last_activity = entry->connection_start;
     entry->is_active = 1;
+    entry->device_index = dev_idx;
+    entry->in_use = 1;
+    conn_index_insert(stats, slot);
+    index_write_end(stats);
     
     stats->entry_count++;
     stats->total_connections++;
     stats->active_connections++;
     
-    /* Обновляем или создаём запись устройства */
-    int dev_idx = find_device(stats, device_id);
-    if (dev_idx < 0) {
-        if (stats->device_count < MAX_TRAFFIC_ENTRIES) {
-            dev_idx = stats->device_count++;
-            device_traffic_t *dev = &stats->devices[dev_idx];
-            memset(dev, 0, sizeof(device_traffic_t));
-            strncpy(dev->device_id, device_id, sizeof(dev->device_id) - 1);
-            strncpy(dev->client_ip, client_ip, sizeof(dev->client_ip) - 1);
-            dev->first_seen = entry->connection_start;
+    pthread_mutex_unlock(&stats->lock);
+
+    return 0;
+}
+
+/*
+ * Общий путь обновления: поиск по хешу без lock, счётчики подключения
+ * обновляются атомарно на месте, глобальные и по устройствам - в шарде потока.
+ */
+static int update_traffic(traffic_stats_t *stats,
+                          uint64_t connection_id,
+                          uint64_t bytes,
+                          uint64_t packets,
+                          int received) {
+    int idx = find_connection(stats, connection_id);
+    if (idx < 0) {
+        return -1; /* Подключение не найдено */
+    }
+    
+    traffic_shard_t *shard = get_shard(stats);
+    if (!shard) {
+        return -1;
+    }
+    
+    traffic_entry_t *entry = &stats->entries[idx];
+    int dev_idx = entry->device_index;
+    
+    if (received) {
+        __sync_fetch_and_add(&entry->bytes_received, bytes);
+        __sync_fetch_and_add(&entry->packets_received, packets);
+        __sync_fetch_and_add(&shard->global.bytes_received, bytes);
+        __sync_fetch_and_add(&shard->global.packets_received, packets);
+        if (dev_idx >= 0) {
+            __sync_fetch_and_add(&shard->devices[dev_idx].bytes_received, bytes);
+            __sync_fetch_and_add(&shard->devices[dev_idx].packets_received, packets);
+        }
+    } else {
+        __sync_fetch_and_add(&entry->bytes_sent, bytes);
+        __sync_fetch_and_add(&entry->packets_sent, packets);
+        __sync_fetch_and_add(&shard->global.bytes_sent, bytes);
+        __sync_fetch_and_add(&shard->global.packets_sent, packets);
+        if (dev_idx >= 0) {
+            __sync_fetch_and_add(&shard->devices[dev_idx].bytes_sent, bytes);
+            __sync_fetch_and_add(&shard->devices[dev_idx].packets_sent, packets);
         }
     }
     
-    if (dev_idx >= 0) {
-        device_traffic_t *dev = &stats->devices[dev_idx];
-        dev->connection_count++;
-        dev->last_seen = entry->connection_start;
+    time_t now = time(NULL);
+    if (entry->last_activity != now) {
+        entry->last_activity = now;
     }
     
-    pthread_mutex_unlock(&stats->lock);
-
     return 0;
 }
 
@@ -139,32 +387,7 @@ int traffic_stats_update_sent(traffic_stats_t *stats,
         return -1;
     }
     
-    pthread_mutex_lock(&stats->lock);
-    
-    int idx = find_connection(stats, connection_id);
-    if (idx < 0) {
-        pthread_mutex_unlock(&stats->lock);
-        return -1; /* Подключение не найдено */
-    }
-    
-    traffic_entry_t *entry = &stats->entries[idx];
-    entry->bytes_sent += bytes;
-    entry->packets_sent += packets;
-    entry->last_activity = time(NULL);
-    
-    /* Обновляем глобальную статистику */
-    stats->total_bytes_sent += bytes;
-    
-    /* Обновляем статистику устройства */
-    int dev_idx = find_device(stats, entry->device_id);
-    if (dev_idx >= 0) {
-        stats->devices[dev_idx].total_bytes_sent += bytes;
-        stats->devices[dev_idx].total_packets_sent += packets;
-    }
-    
-    pthread_mutex_unlock(&stats->lock);
-    
-    return 0;
+    return update_traffic(stats, connection_id, bytes, packets, 0);
 }
 
 /* Обновление статистики получения */
@@ -176,32 +399,7 @@ int traffic_stats_update_received(traffic_stats_t *stats,
         return -1;
     }
     
-    pthread_mutex_lock(&stats->lock);
-    
-    int idx = find_connection(stats, connection_id);
-    if (idx < 0) {
-        pthread_mutex_unlock(&stats->lock);
-        return -1; /* Подключение не найдено */
-    }
-    
-    traffic_entry_t *entry = &stats->entries[idx];
-    entry->bytes_received += bytes;
-    entry->packets_received += packets;
-    entry->last_activity = time(NULL);
-    
-    /* Обновляем глобальную статистику */
-    stats->total_bytes_received += bytes;
-    
-    /* Обновляем статистику устройства */
-    int dev_idx = find_device(stats, entry->device_id);
-    if (dev_idx >= 0) {
-        stats->devices[dev_idx].total_bytes_received += bytes;
-        stats->devices[dev_idx].total_packets_received += packets;
-    }
-    
-    pthread_mutex_unlock(&stats->lock);
-    
-    return 0;
+    return update_traffic(stats, connection_id, bytes, packets, 1);
 }
 
 /* Закрытие подключения */
@@ -270,6 +468,15 @@ int traffic_stats_get_device(traffic_stats_t *stats,
     
     memcpy(device, &stats->devices[idx], sizeof(device_traffic_t));
     
+    /* Суммируем счётчики устройства по шардам */
+    for (int i = 0; i < stats->shard_count; i++) {
+        const traffic_counters_t *c = &stats->shards[i]->devices[idx];
+        device->total_bytes_sent += c->bytes_sent;
+        device->total_bytes_received += c->bytes_received;
+        device->total_packets_sent += c->packets_sent;
+        device->total_packets_received += c->packets_received;
+    }
+    
     pthread_mutex_unlock(&stats->lock);
     
     return 0;
@@ -287,6 +494,8 @@ void traffic_stats_get_global(traffic_stats_t *stats,
     
     pthread_mutex_lock(&stats->lock);
     
+    merge_global(stats);
+    
     if (total_sent) *total_sent = stats->total_bytes_sent;
     if (total_received) *total_received = stats->total_bytes_received;
     if (active_conn) *active_conn = stats->active_connections;
@@ -297,6 +506,8 @@ void traffic_stats_get_global(traffic_stats_t *stats,
 
 /* Добавление записи в историю */
 static void add_history_sample(traffic_stats_t *stats) {
+    merge_global(stats);
+    
     traffic_sample_t *sample = &stats->history[stats->history_index];
     sample->timestamp = (uint64_t)time(NULL);
     sample->bytes_sent = stats->total_bytes_sent;
@@ -341,6 +552,8 @@ int traffic_stats_export_json(traffic_stats_t *stats,
     
     pthread_mutex_lock(&stats->lock);
     
+    merge_global(stats);
+    
     int offset = 0;
     offset += snprintf(buffer + offset, buffer_size - offset, "{\n");
     offset += snprintf(buffer + offset, buffer_size - offset, 
@@ -365,9 +578,9 @@ int traffic_stats_export_json(traffic_stats_t *stats,
                        "  \"connections\": [\n");
     
     int first = 1;
-    for (int i = 0; i < stats->entry_count && offset < buffer_size - 200; i++) {
+    for (int i = 0; i < stats->entry_slots && offset < buffer_size - 200; i++) {
         traffic_entry_t *e = &stats->entries[i];
-        if (!e->is_active) continue;
+        if (!e->in_use || !e->is_active) continue;
         
         if (!first) {
             offset += snprintf(buffer + offset, buffer_size - offset, ",\n");
@@ -418,10 +631,24 @@ void traffic_stats_reset(traffic_stats_t *stats) {
     stats->start_time = time(NULL);
     stats->history_index = 0;
     
+    index_write_begin(stats);
     memset(stats->entries, 0, sizeof(stats->entries));
+    memset(stats->conn_index, 0, sizeof(stats->conn_index));
+    stats->entry_slots = 0;
+    stats->free_count = 0;
+    index_write_end(stats);
+    
     memset(stats->devices, 0, sizeof(stats->devices));
+    memset(stats->device_index, 0, sizeof(stats->device_index));
     memset(stats->history, 0, sizeof(stats->history));
     
+    /* Шарды остаются закреплёнными за потоками, обнуляются только счётчики */
+    for (int i = 0; i < stats->shard_count; i++) {
+        traffic_shard_t *shard = stats->shards[i];
+        memset(&shard->global, 0, sizeof(shard->global));
+        memset(shard->devices, 0, sizeof(shard->devices));
+    }
+    
     pthread_mutex_unlock(&stats->lock);
 }
 
@@ -434,24 +661,7 @@ int traffic_stats_cleanup_inactive(traffic_stats_t *stats,
     
     pthread_mutex_lock(&stats->lock);
     
-    time_t now = time(NULL);
-    int removed = 0;
-    
-    for (int i = 0; i < stats->entry_count; i++) {
-        traffic_entry_t *e = &stats->entries[i];
-        
-        if (e->is_active) continue; /* Пропускаем активные */
-        
-        if (now - e->last_activity > inactive_threshold) {
-            /* Сдвигаем массив */
-            for (int j = i; j < stats->entry_count - 1; j++) {
-                stats->entries[j] = stats->entries[j + 1];
-            }
-            stats->entry_count--;
-            removed++;
-            i--; /* Проверяем тот же индекс снова */
-        }
-    }
+    int removed = cleanup_inactive_locked(stats, inactive_threshold);
     
     pthread_mutex_unlock(&stats->lock);
 
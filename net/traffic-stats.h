@@ -12,6 +12,13 @@
 #define MAX_TRAFFIC_ENTRIES 1024
 #define TRAFFIC_HISTORY_SIZE 256
 
+/* Размеры хеш-индексов (степени двойки, заполнение не выше 25% / 50%) */
+#define TRAFFIC_CONN_HASH_SIZE (MAX_TRAFFIC_ENTRIES * 4)
+#define TRAFFIC_DEVICE_HASH_SIZE (MAX_TRAFFIC_ENTRIES * 2)
+
+/* Максимальное число шардов счётчиков (по одному на поток) */
+#define TRAFFIC_MAX_SHARDS 64
+
 /* Структура статистики для одного подключения */
 typedef struct {
     uint64_t connection_id;
@@ -24,6 +31,8 @@ typedef struct {
     time_t connection_start;
     time_t last_activity;
     int is_active;
+    int device_index;   /* интернированный индекс в devices, -1 если нет */
+    int in_use;         /* слот занят (иначе находится в списке свободных) */
 } traffic_entry_t;
 
 /* История трафика для одного подключения */
@@ -46,6 +55,24 @@ typedef struct {
     time_t last_seen;
 } device_traffic_t;
 
+/* Счётчики трафика, которые обновляются на каждом пакете */
+typedef struct {
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t packets_sent;
+    uint64_t packets_received;
+} traffic_counters_t;
+
+/*
+ * Шард счётчиков одного потока: глобальные суммы и суммы по устройствам.
+ * Пишет только поток-владелец, читатели суммируют шарды под lock.
+ */
+typedef struct {
+    traffic_counters_t global;
+    pthread_t owner;
+    traffic_counters_t devices[MAX_TRAFFIC_ENTRIES];
+} traffic_shard_t;
+
 /* Основная структура статистики */
 typedef struct {
     traffic_entry_t entries[MAX_TRAFFIC_ENTRIES];
@@ -56,7 +83,7 @@ typedef struct {
     device_traffic_t devices[MAX_TRAFFIC_ENTRIES];
     int device_count;
     
-    /* Глобальная статистика */
+    /* Глобальная статистика (байты - снимок шардов на момент последнего чтения) */
     uint64_t total_bytes_sent;
     uint64_t total_bytes_received;
     uint64_t total_connections;
@@ -66,6 +93,22 @@ typedef struct {
     /* История для графиков */
     traffic_sample_t history[TRAFFIC_HISTORY_SIZE];
     int history_index;
+    
+    /* Индекс connection_id -> слот entries + 1 (открытая адресация) */
+    int32_t conn_index[TRAFFIC_CONN_HASH_SIZE];
+    volatile unsigned index_seq;  /* seqlock для чтения индекса без lock */
+    int entry_slots;              /* верхняя граница использованных слотов */
+    int free_slots[MAX_TRAFFIC_ENTRIES];
+    int free_count;
+    
+    /* Интернированные device_id -> индекс devices + 1 */
+    int32_t device_index[TRAFFIC_DEVICE_HASH_SIZE];
+    
+    /* Шарды счётчиков по потокам */
+    traffic_shard_t *shards[TRAFFIC_MAX_SHARDS];
+    int shard_count;
+    unsigned shard_assign;
+    uint64_t instance_id;
 } traffic_stats_t;
 
 /* Инициализация модуля */
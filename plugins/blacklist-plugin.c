@@ -2,8 +2,15 @@
  * IP Blacklist Plugin for MTProxy
  * Плагин для блокировки подключений по чёрному/белому списку IP
  *
- * Компиляция:
- *   gcc -shared -fPIC -o blacklist-plugin.so blacklist-plugin.c
+ * Компиляция (из каталога plugins/):
+ *   gcc -O2 -shared -fPIC -iquote .. -o blacklist-plugin.so blacklist-plugin.c ../net/net-ip-acl.c
+ *
+ * Конфигурация:
+ *   blacklist=<cidr>          - отдельный префикс (10.0.0.0/8, 2001:db8::/32, 192.168.1.*)
+ *   whitelist=<cidr>
+ *   blacklist_file=<path>     - список префиксов, по одному на строку (security/blacklist.txt)
+ *   whitelist_file=<path>
+ *   whitelist_mode=true
  *
  * Установка:
  *   cp blacklist-plugin.so /usr/lib/mtproxy/plugins/
@@ -13,7 +20,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 #include "../include/plugin-system.h"
+#include "../net/net-ip-acl.h"
 
 /* ============================================================================
  * Конфигурация
@@ -34,6 +43,16 @@ typedef struct {
     ip_entry_t whitelist[MAX_IP_ENTRIES];
     int whitelist_count;
     
+    // Большие списки загружаются из файлов напрямую в скомпилированную таблицу
+    char blacklist_file[256];
+    char whitelist_file[256];
+    
+    // Скомпилированная таблица: читается без блокировок, подменяется целиком.
+    // Предыдущая освобождается при следующей пересборке, чтобы текущие
+    // проверки успели завершиться.
+    struct ip_acl *acl;
+    struct ip_acl *retired_acl;
+    
     int total_blocked;
     int total_allowed;
     bool whitelist_mode;  // true = разрешены только из whitelist
@@ -45,23 +64,9 @@ typedef struct {
 
 static bool ip_in_list(const char *ip, ip_entry_t *list, int count) {
     for (int i = 0; i < count; i++) {
-        // Проверка точного совпадения
         if (strcmp(list[i].ip, ip) == 0) {
             return true;
         }
-        
-        // Проверка маски (например, 192.168.1.*)
-        const char *list_ip = list[i].ip;
-        size_t ip_len = strlen(ip);
-        size_t list_ip_len = strlen(list_ip);
-        
-        if (list_ip_len > 0 && list_ip[list_ip_len - 1] == '*') {
-            size_t prefix_len = list_ip_len - 1;
-            if (ip_len >= prefix_len && 
-                strncmp(ip, list_ip, prefix_len) == 0) {
-                return true;
-            }
-        }
     }
     return false;
 }
@@ -77,6 +82,14 @@ static int add_to_list(ip_entry_t *list, int *count, const char *ip,
         return -2;  // Уже в списке
     }
     
+    // Проверка формата CIDR
+    struct ip_acl *check = ip_acl_alloc();
+    int valid = check && ip_acl_add_cidr(check, ip, IP_ACL_BLACKLIST) == 0;
+    ip_acl_free(check);
+    if (!valid) {
+        return -3;  // Некорректный префикс
+    }
+    
     ip_entry_t *entry = &list[*count];
     strncpy(entry->ip, ip, sizeof(entry->ip) - 1);
     strncpy(entry->description, description ? description : "", 
@@ -101,6 +114,49 @@ static int remove_from_list(ip_entry_t *list, int *count, const char *ip) {
     return -1;  // Не найдено
 }
 
+int plugin_blacklist_reload(void *plugin_data);
+
+/* Сборка таблицы из файлов и отдельных записей и атомарная подмена */
+static int rebuild_acl(blacklist_plugin_data_t *data) {
+    struct ip_acl *acl = ip_acl_alloc();
+    if (!acl) {
+        return -1;
+    }
+    
+    acl->whitelist_only = data->whitelist_mode;
+    
+    if ((data->blacklist_file[0] &&
+         ip_acl_load_file(acl, data->blacklist_file, IP_ACL_BLACKLIST) < 0) ||
+        (data->whitelist_file[0] &&
+         ip_acl_load_file(acl, data->whitelist_file, IP_ACL_WHITELIST) < 0)) {
+        printf("[blacklist-plugin] Cannot read list file, keeping previous lists\n");
+        ip_acl_free(acl);
+        return -1;
+    }
+    
+    for (int i = 0; i < data->blacklist_count; i++) {
+        ip_acl_add_cidr(acl, data->blacklist[i].ip, IP_ACL_BLACKLIST);
+    }
+    for (int i = 0; i < data->whitelist_count; i++) {
+        ip_acl_add_cidr(acl, data->whitelist[i].ip, IP_ACL_WHITELIST);
+    }
+    
+    if (ip_acl_compile(acl) < 0) {
+        printf("[blacklist-plugin] Out of memory compiling lists, keeping previous lists\n");
+        ip_acl_free(acl);
+        return -1;
+    }
+    
+    if (acl->errors) {
+        printf("[blacklist-plugin] Skipped %d malformed prefixes\n", acl->errors);
+    }
+    
+    ip_acl_free(data->retired_acl);
+    data->retired_acl = __sync_lock_test_and_set(&data->acl, acl);
+    
+    return acl->prefixes;
+}
+
 /* ============================================================================
  * Хуки
  * ============================================================================ */
@@ -109,39 +165,35 @@ static plugin_result_t on_connection_accept(plugin_hook_context_t *ctx,
                                             void *plugin_data) {
     blacklist_plugin_data_t *data = (blacklist_plugin_data_t *)plugin_data;
     
-    if (!ctx || !ctx->client_ip || !data) {
+    if (!ctx || !data) {
         return PLUGIN_OK;
     }
     
-    const char *ip = ctx->client_ip;
-    
-    // Whitelist режим: разрешены только из whitelist
-    if (data->whitelist_mode) {
-        if (ip_in_list(ip, data->whitelist, data->whitelist_count)) {
-            data->total_allowed++;
-            return PLUGIN_OK;
-        } else {
-            char msg[256];
-            snprintf(msg, sizeof(msg), 
-                     "IP %s not in whitelist (whitelist mode enabled)", ip);
-            strncpy(ctx->result_data, msg, sizeof(ctx->result_data) - 1);
-            ctx->result_code = 403;
-            return PLUGIN_REJECT;
-        }
+    const struct ip_acl *acl = data->acl;
+    if (!acl) {
+        data->total_allowed++;
+        return PLUGIN_OK;
     }
     
-    // Проверка whitelist (если не пустой)
-    if (data->whitelist_count > 0 && ip_in_list(ip, data->whitelist, 
-                                                 data->whitelist_count)) {
+    unsigned flags = ip_acl_lookup(acl, ctx->client_ipv4, ctx->client_ipv6);
+    
+    // Проверка whitelist: имеет приоритет над blacklist
+    if (flags & IP_ACL_WHITELIST) {
         data->total_allowed++;
-        return PLUGIN_OK;  // Разрешено (в whitelist)
+        return PLUGIN_OK;
+    }
+    
+    // Whitelist режим: разрешены только из whitelist
+    if (data->whitelist_mode) {
+        ctx->result_msg = "not in whitelist (whitelist mode enabled)";
+        ctx->result_code = 403;
+        data->total_blocked++;
+        return PLUGIN_REJECT;
     }
     
     // Проверка blacklist
-    if (ip_in_list(ip, data->blacklist, data->blacklist_count)) {
-        char msg[256];
-        snprintf(msg, sizeof(msg), "IP %s is blacklisted", ip);
-        strncpy(ctx->result_data, msg, sizeof(ctx->result_data) - 1);
+    if (flags & IP_ACL_BLACKLIST) {
+        ctx->result_msg = "blacklisted";
         ctx->result_code = 403;
         
         data->total_blocked++;
@@ -152,6 +204,12 @@ static plugin_result_t on_connection_accept(plugin_hook_context_t *ctx,
     return PLUGIN_OK;  // Разрешено (не в blacklist)
 }
 
+static plugin_result_t on_config_reload(plugin_hook_context_t *ctx,
+                                        void *plugin_data) {
+    (void)ctx;
+    return plugin_blacklist_reload(plugin_data) == PLUGIN_OK ? PLUGIN_OK : PLUGIN_ERROR;
+}
+
 /* ============================================================================
  * Экспортируемые функции
  * ============================================================================ */
@@ -164,6 +222,11 @@ PLUGIN_DECLARE_INFO(
     "Apache-2.0"
 )
 
+PLUGIN_DECLARE_HOOKS(
+    { HOOK_CONNECTION_ACCEPT, on_connection_accept, 100 },
+    { HOOK_CONFIG_RELOAD, on_config_reload, 0 }
+)
+
 int plugin_init(const plugin_config_t *config, void **plugin_data) {
     if (!plugin_data) {
         return PLUGIN_ERROR;
@@ -196,6 +259,12 @@ int plugin_init(const plugin_config_t *config, void **plugin_data) {
                 } else if (strncmp(line, "whitelist=", 10) == 0) {
                     add_to_list(data->whitelist, &data->whitelist_count, 
                                line + 10, "from config");
+                } else if (strncmp(line, "blacklist_file=", 15) == 0) {
+                    strncpy(data->blacklist_file, line + 15,
+                            sizeof(data->blacklist_file) - 1);
+                } else if (strncmp(line, "whitelist_file=", 15) == 0) {
+                    strncpy(data->whitelist_file, line + 15,
+                            sizeof(data->whitelist_file) - 1);
                 } else if (strcmp(line, "whitelist_mode=true") == 0) {
                     data->whitelist_mode = true;
                 }
@@ -204,10 +273,15 @@ int plugin_init(const plugin_config_t *config, void **plugin_data) {
         }
     }
     
+    if (rebuild_acl(data) < 0) {
+        free(data);
+        return PLUGIN_ERROR;
+    }
+    
     *plugin_data = data;
     
-    printf("[blacklist-plugin] Initialized (blacklist=%d, whitelist=%d, mode=%s)\n",
-           data->blacklist_count, data->whitelist_count,
+    printf("[blacklist-plugin] Initialized (prefixes=%d, blacklist=%d, whitelist=%d, mode=%s)\n",
+           data->acl->prefixes, data->blacklist_count, data->whitelist_count,
            data->whitelist_mode ? "whitelist" : "blacklist");
     
     return PLUGIN_OK;
@@ -223,6 +297,8 @@ void plugin_shutdown(void *plugin_data) {
     printf("[blacklist-plugin] Shutdown. Blocked: %d, Allowed: %d\n",
            data->total_blocked, data->total_allowed);
     
+    ip_acl_free(data->acl);
+    ip_acl_free(data->retired_acl);
     free(data);
 }
 
@@ -237,6 +313,7 @@ int plugin_blacklist_add(void *plugin_data, const char *ip,
     
     int ret = add_to_list(data->blacklist, &data->blacklist_count, ip, description);
     if (ret == 0) {
+        rebuild_acl(data);
         printf("[blacklist-plugin] Added to blacklist: %s (%s)\n", ip, description);
     }
     return ret;
@@ -248,6 +325,7 @@ int plugin_blacklist_remove(void *plugin_data, const char *ip) {
     
     int ret = remove_from_list(data->blacklist, &data->blacklist_count, ip);
     if (ret == 0) {
+        rebuild_acl(data);
         printf("[blacklist-plugin] Removed from blacklist: %s\n", ip);
     }
     return ret;
@@ -260,6 +338,7 @@ int plugin_whitelist_add(void *plugin_data, const char *ip,
     
     int ret = add_to_list(data->whitelist, &data->whitelist_count, ip, description);
     if (ret == 0) {
+        rebuild_acl(data);
         printf("[blacklist-plugin] Added to whitelist: %s (%s)\n", ip, description);
     }
     return ret;
@@ -271,11 +350,25 @@ int plugin_whitelist_remove(void *plugin_data, const char *ip) {
     
     int ret = remove_from_list(data->whitelist, &data->whitelist_count, ip);
     if (ret == 0) {
+        rebuild_acl(data);
         printf("[blacklist-plugin] Removed from whitelist: %s\n", ip);
     }
     return ret;
 }
 
+/* Перечитывание файлов списков (SIGHUP / HOOK_CONFIG_RELOAD) */
+int plugin_blacklist_reload(void *plugin_data) {
+    blacklist_plugin_data_t *data = (blacklist_plugin_data_t *)plugin_data;
+    if (!data) return PLUGIN_ERROR;
+    
+    int ret = rebuild_acl(data);
+    if (ret < 0) {
+        return PLUGIN_ERROR;
+    }
+    printf("[blacklist-plugin] Reloaded: %d prefixes\n", ret);
+    return PLUGIN_OK;
+}
+
 void plugin_get_stats(plugin_stats_t *stats) {
     if (!stats) {
         return;
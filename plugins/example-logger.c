@@ -53,6 +53,9 @@ static plugin_result_t on_connection_accept(plugin_hook_context_t *ctx,
         return PLUGIN_OK;
     }
     
+    char client_ip[64];
+    plugin_format_client_ip(ctx, client_ip, sizeof(client_ip));
+    
     time_t now = time(NULL);
     struct tm *tm_info = localtime(&now);
     char time_buffer[64];
@@ -61,14 +64,14 @@ static plugin_result_t on_connection_accept(plugin_hook_context_t *ctx,
     if (data->log_fp) {
         fprintf(data->log_fp, "[%s] [CONNECT] Client %s:%d accepted (fd=%d)\n",
                 time_buffer,
-                ctx->client_ip,
+                client_ip,
                 ctx->client_port,
                 ctx->connection_fd);
         fflush(data->log_fp);
     }
     
     printf("[%s] [CONNECT] Client %s:%d accepted\n",
-           time_buffer, ctx->client_ip, ctx->client_port);
+           time_buffer, client_ip, ctx->client_port);
     
     data->connections_logged++;
     
@@ -83,21 +86,23 @@ static plugin_result_t on_connection_close(plugin_hook_context_t *ctx,
         return PLUGIN_OK;
     }
     
+    char client_ip[64];
+    plugin_format_client_ip(ctx, client_ip, sizeof(client_ip));
+    
     time_t now = time(NULL);
     struct tm *tm_info = localtime(&now);
     char time_buffer[64];
     strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", tm_info);
     
     if (data->log_fp) {
-        fprintf(data->log_fp, "[%s] [DISCONNECT] Client %s closed (fd=%d, reason=%s)\n",
+        fprintf(data->log_fp, "[%s] [DISCONNECT] Client %s closed (fd=%d)\n",
                 time_buffer,
-                ctx->client_ip,
-                ctx->connection_fd,
-                ctx->result_data);
+                client_ip,
+                ctx->connection_fd);
         fflush(data->log_fp);
     }
     
-    printf("[%s] [DISCONNECT] Client %s closed\n", time_buffer, ctx->client_ip);
+    printf("[%s] [DISCONNECT] Client %s closed\n", time_buffer, client_ip);
     
     return PLUGIN_OK;
 }
@@ -110,10 +115,13 @@ static plugin_result_t on_data_received(plugin_hook_context_t *ctx,
         return PLUGIN_OK;
     }
     
+    char client_ip[64];
+    plugin_format_client_ip(ctx, client_ip, sizeof(client_ip));
+    
     if (data->log_fp) {
         fprintf(data->log_fp, "[DATA] Received %zu bytes from %s (fd=%d)\n",
-                ctx->data_size,
-                ctx->client_ip,
+                ctx->raw_size,
+                client_ip,
                 ctx->connection_fd);
         fflush(data->log_fp);
     }
@@ -124,9 +132,11 @@ static plugin_result_t on_data_received(plugin_hook_context_t *ctx,
 static plugin_result_t on_security_check(plugin_hook_context_t *ctx, 
                                          void *plugin_data) {
     example_plugin_data_t *data = (example_plugin_data_t *)plugin_data;
+    char client_ip[64];
+    plugin_format_client_ip(ctx, client_ip, sizeof(client_ip));
     
     // Пример блокировки по IP
-    if (strncmp(ctx->client_ip, "192.168.1.100", 13) == 0) {
+    if (strcmp(client_ip, "192.168.1.100") == 0) {
         if (data->log_fp) {
             time_t now = time(NULL);
             struct tm *tm_info = localtime(&now);
@@ -134,13 +144,13 @@ static plugin_result_t on_security_check(plugin_hook_context_t *ctx,
             strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", tm_info);
             
             fprintf(data->log_fp, "[%s] [BLOCK] Blocked IP %s\n",
-                    time_buffer, ctx->client_ip);
+                    time_buffer, client_ip);
             fflush(data->log_fp);
         }
         
         data->connections_blocked++;
         ctx->result_code = 403;
-        strncpy(ctx->result_data, "IP blocked by plugin", sizeof(ctx->result_data) - 1);
+        ctx->result_msg = "IP blocked by plugin";
         
         return PLUGIN_REJECT;
     }
@@ -160,6 +170,13 @@ PLUGIN_DECLARE_INFO(
     "Apache-2.0"
 )
 
+PLUGIN_DECLARE_HOOKS(
+    { HOOK_CONNECTION_ACCEPT, on_connection_accept, 0 },
+    { HOOK_CONNECTION_CLOSE, on_connection_close, 0 },
+    { HOOK_DATA_RECEIVED, on_data_received, 0 },
+    { HOOK_SECURITY_CHECK, on_security_check, 0 }
+)
+
 int plugin_init(const plugin_config_t *config, void **plugin_data) {
     if (!plugin_data) {
         return PLUGIN_ERROR;
@@ -235,8 +252,7 @@ int plugin_register_hook(plugin_hook_type_t hook_type,
                         plugin_hook_callback_t callback,
                         int priority,
                         void *plugin_data) {
-    // This function is called by the plugin manager to register hooks
-    // In this example, we register hooks directly in plugin_init
+    // Хост берёт подписки из PLUGIN_DECLARE_HOOKS (plugin_get_hooks)
     return PLUGIN_OK;
 }
 
@@ -3,7 +3,7 @@
  * Плагин для ограничения количества подключений с одного IP
  *
  * Компиляция:
- *   gcc -shared -fPIC -o ratelimit-plugin.so ratelimit-plugin.c
+ *   gcc -O2 -shared -fPIC -o ratelimit-plugin.so ratelimit-plugin.c
  *
  * Установка:
  *   cp ratelimit-plugin.so /usr/lib/mtproxy/plugins/
@@ -19,54 +19,121 @@
  * Конфигурация
  * ============================================================================ */
 
-#define MAX_IP_ENTRIES 10000
+#define MAX_IP_ENTRIES 16384     /* степень двойки: таблица с открытой адресацией */
 #define DEFAULT_MAX_CONNECTIONS 10
 #define DEFAULT_WINDOW_SECONDS 60
 
 typedef struct {
-    char ip[64];
+    unsigned char key[16];       /* IPv6 либо IPv4, отображённый в IPv6 */
     int connection_count;
-    time_t window_start;
+    time_t window_start;         /* 0 - ячейка свободна */
 } ip_rate_entry_t;
 
 typedef struct {
     ip_rate_entry_t entries[MAX_IP_ENTRIES];
     int entry_count;
+    time_t last_expire;          /* перестройка не чаще раза в секунду */
     int max_connections;
     int window_seconds;
     int total_blocked;
+    int total_checked;
 } ratelimit_plugin_data_t;
 
 /* ============================================================================
  * Вспомогательные функции
  * ============================================================================ */
 
+static void make_key(const plugin_hook_context_t *ctx, unsigned char key[16]) {
+    if (ctx->client_ipv4 || !ctx->client_ipv6) {
+        static const unsigned char v4_mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+        uint32_t ip = ctx->client_ipv4;
+        memcpy(key, v4_mapped, 12);
+        key[12] = ip >> 24;
+        key[13] = ip >> 16;
+        key[14] = ip >> 8;
+        key[15] = ip;
+    } else {
+        memcpy(key, ctx->client_ipv6, 16);
+    }
+}
+
+static unsigned hash_key(const unsigned char key[16]) {
+    uint64_t a, b;
+    memcpy(&a, key, 8);
+    memcpy(&b, key + 8, 8);
+    /* Финализатор с перемешиванием сдвигами: у IPv4 различаются только старшие байты b */
+    uint64_t h = a * 0x9e3779b97f4a7c15ULL ^ b;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (unsigned)h & (MAX_IP_ENTRIES - 1);
+}
+
+/* Удаление записей с истёкшим окном: таблица перестраивается заново */
+static void expire_entries(ratelimit_plugin_data_t *data, time_t now) {
+    static ip_rate_entry_t live[MAX_IP_ENTRIES];
+    int n = 0;
+    
+    for (int i = 0; i < MAX_IP_ENTRIES; i++) {
+        ip_rate_entry_t *e = &data->entries[i];
+        if (e->window_start && now - e->window_start < data->window_seconds) {
+            live[n++] = *e;
+        }
+        e->window_start = 0;
+    }
+    data->entry_count = 0;
+    for (int i = 0; i < n; i++) {
+        unsigned h = hash_key(live[i].key);
+        while (data->entries[h].window_start) {
+            h = (h + 1) & (MAX_IP_ENTRIES - 1);
+        }
+        data->entries[h] = live[i];
+        data->entry_count++;
+    }
+}
+
 static ip_rate_entry_t* find_or_create_entry(ratelimit_plugin_data_t *data, 
-                                              const char *ip) {
+                                              const unsigned char key[16]) {
     time_t now = time(NULL);
+    unsigned h = hash_key(key);
     
-    // Поиск существующей записи
-    for (int i = 0; i < data->entry_count; i++) {
-        if (strcmp(data->entries[i].ip, ip) == 0) {
+    // Поиск существующей записи (линейное пробирование)
+    while (data->entries[h].window_start) {
+        ip_rate_entry_t *e = &data->entries[h];
+        if (memcmp(e->key, key, 16) == 0) {
             // Сброс окна если истекло
-            if (now - data->entries[i].window_start >= data->window_seconds) {
-                data->entries[i].connection_count = 0;
-                data->entries[i].window_start = now;
+            if (now - e->window_start >= data->window_seconds) {
+                e->connection_count = 0;
+                e->window_start = now;
             }
-            return &data->entries[i];
+            return e;
         }
+        h = (h + 1) & (MAX_IP_ENTRIES - 1);
     }
     
-    // Создание новой записи
-    if (data->entry_count < MAX_IP_ENTRIES) {
-        ip_rate_entry_t *entry = &data->entries[data->entry_count++];
-        strncpy(entry->ip, ip, sizeof(entry->ip) - 1);
-        entry->connection_count = 0;
-        entry->window_start = now;
-        return entry;
+    // Заполнение не выше 3/4, иначе сначала выбрасываем устаревшие записи
+    if (data->entry_count >= MAX_IP_ENTRIES / 4 * 3) {
+        if (data->last_expire == now) {
+            return NULL;
+        }
+        data->last_expire = now;
+        expire_entries(data, now);
+        if (data->entry_count >= MAX_IP_ENTRIES / 4 * 3) {
+            return NULL;
+        }
+        h = hash_key(key);
+        while (data->entries[h].window_start) {
+            h = (h + 1) & (MAX_IP_ENTRIES - 1);
+        }
     }
     
-    return NULL;
+    // Создание новой записи
+    ip_rate_entry_t *entry = &data->entries[h];
+    memcpy(entry->key, key, 16);
+    entry->connection_count = 0;
+    entry->window_start = now;
+    data->entry_count++;
+    return entry;
 }
 
 /* ============================================================================
@@ -77,12 +144,16 @@ static plugin_result_t on_connection_accept(plugin_hook_context_t *ctx,
                                             void *plugin_data) {
     ratelimit_plugin_data_t *data = (ratelimit_plugin_data_t *)plugin_data;
     
-    if (!ctx || !ctx->client_ip || !data) {
+    if (!ctx || !data) {
         return PLUGIN_OK;
     }
     
+    unsigned char key[16];
+    make_key(ctx, key);
+    data->total_checked++;
+    
     // Поиск или создание записи для IP
-    ip_rate_entry_t *entry = find_or_create_entry(data, ctx->client_ip);
+    ip_rate_entry_t *entry = find_or_create_entry(data, key);
     if (!entry) {
         // Превышен максимум записей, пропускаем
         return PLUGIN_OK;
@@ -93,13 +164,7 @@ static plugin_result_t on_connection_accept(plugin_hook_context_t *ctx,
     
     // Проверка лимита
     if (entry->connection_count > data->max_connections) {
-        char msg[256];
-        snprintf(msg, sizeof(msg), 
-                 "Rate limit exceeded: %d connections from %s (max: %d per %ds)",
-                 entry->connection_count, ctx->client_ip, 
-                 data->max_connections, data->window_seconds);
-        
-        strncpy(ctx->result_data, msg, sizeof(ctx->result_data) - 1);
+        ctx->result_msg = "rate limit exceeded";
         ctx->result_code = 429;
         
         data->total_blocked++;
@@ -122,6 +187,11 @@ PLUGIN_DECLARE_INFO(
     "Apache-2.0"
 )
 
+/* После blacklist: заблокированные адреса не расходуют лимит */
+PLUGIN_DECLARE_HOOKS(
+    { HOOK_CONNECTION_ACCEPT, on_connection_accept, 50 }
+)
+
 int plugin_init(const plugin_config_t *config, void **plugin_data) {
     if (!plugin_data) {
         return PLUGIN_ERROR;
@@ -194,7 +264,7 @@ void plugin_get_stats(plugin_stats_t *stats) {
     }
     
     memset(stats, 0, sizeof(plugin_stats_t));
-    stats->total_requests = data->entry_count;
+    stats->total_requests = data->total_checked;
     stats->total_blocked = data->total_blocked;
     stats->plugin_data = data;
 }
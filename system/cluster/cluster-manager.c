@@ -15,18 +15,96 @@
     #include <ws2tcpip.h>
     #include <windows.h>
     #pragma comment(lib, "ws2_32.lib")
+    #define cluster_close_socket closesocket
+    #define poll WSAPoll
+    #ifndef MSG_NOSIGNAL
+        #define MSG_NOSIGNAL 0
+    #endif
 #else
     #include <unistd.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <poll.h>
     #include <sys/socket.h>
+    #include <sys/uio.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <arpa/inet.h>
     #include <netdb.h>
     #include <pthread.h>
+    #define cluster_close_socket close
 #endif
 
 #include "system/cluster/cluster-manager.h"
+#include "common/kprintf.h"
 #include "common/utils.h"
 
+// ============================================================================
+// Транспорт кластера
+//
+// Каждый узел держит одно постоянное исходящее TCP-соединение к каждому
+// peer и принимает входящие соединения в listener thread через poll().
+// Сообщения не отправляются по одному: они накапливаются в буфере peer и
+// уходят одним кадром (cluster_wire_header_t + deltas + сообщения) в конце
+// операции. К каждому кадру прикладываются membership deltas - изменения
+// статусов узлов, ещё не отправленные этому peer, поэтому при gossip
+// fan-out < N состояние кластера всё равно сходится за O(log N) интервалов.
+// ============================================================================
+
+#define CLUSTER_WIRE_MAGIC 0x4c43544d  // "MTCL"
+#define CLUSTER_BATCH_MAX_BYTES (16 * 1024)
+#define CLUSTER_MAX_DELTAS_PER_BATCH 16
+#define CLUSTER_FRAME_MAX_BYTES (CLUSTER_BATCH_MAX_BYTES + CLUSTER_MAX_DELTAS_PER_BATCH * (int)sizeof(cluster_wire_delta_t) + CLUSTER_MAX_MESSAGE_LEN + 256)
+#define CLUSTER_MAX_INBOUND (CLUSTER_MAX_NODES * 2)
+#define CLUSTER_CONNECT_TIMEOUT_MS 1000
+#define CLUSTER_RECONNECT_BACKOFF_MS 500
+#define CLUSTER_RECONNECT_BACKOFF_MAX_MS 10000
+
+typedef struct {
+    uint32_t magic;
+    uint16_t msg_count;
+    uint16_t delta_count;
+    uint32_t length;        // байт после заголовка
+} cluster_wire_header_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t payload_size;
+    uint32_t reserved2;
+    uint64_t message_id;
+    int64_t timestamp;
+    char source[CLUSTER_MAX_NAME_LEN];
+    char destination[CLUSTER_MAX_NAME_LEN];
+} cluster_wire_msg_t;       // далее payload_size байт payload
+
+typedef struct {
+    char name[CLUSTER_MAX_NAME_LEN];
+    uint8_t status;
+    uint8_t role;
+    uint16_t reserved;
+    uint32_t version;
+    int64_t last_seen;
+} cluster_wire_delta_t;
+
+typedef struct {
+    int fd;
+    bool addr_resolved;
+    struct sockaddr_in addr;
+    int64_t next_connect_ms;
+    int backoff_ms;
+    char *out_buf;          // накопленные cluster_wire_msg_t
+    int out_len;
+    int out_msgs;
+    uint32_t sent_version[CLUSTER_MAX_NODES];
+} cluster_peer_t;
+
+typedef struct {
+    int fd;
+    int in_len;
+    char *in_buf;
+} cluster_inbound_t;
+
 // ============================================================================
 // Глобальные переменные
 // ============================================================================
@@ -69,6 +147,20 @@ static struct {
     bool auto_failover_enabled;
     int election_timeout_ms;
     int heartbeat_interval_ms;
+
+    // Транспорт
+    cluster_peer_t peers[CLUSTER_MAX_NODES];
+    uint32_t member_version[CLUSTER_MAX_NODES];
+    int gossip_fanout;
+    int probe_order[CLUSTER_MAX_NODES];
+    int probe_count;
+    int probe_pos;
+    bool lock_initialized;
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
 } g_cluster = {0};
 
 // ============================================================================
@@ -110,54 +202,300 @@ static cluster_node_info_t* find_node_status(const char *name) {
     return NULL;
 }
 
-static int send_tcp_message(const char *host, int port, const cluster_message_t *msg) {
-    if (!host || !msg) return -1;
-    
-    struct sockaddr_in addr;
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    
-    if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0) {
-        struct hostent *he = gethostbyname(host);
-        if (!he) return -1;
-        memcpy(&addr.sin_addr, he->h_addr_list[0], he->h_length);
-    }
-    
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) return -1;
-    
-    // Таймаут 3 секунды
+static void cluster_lock(void) {
 #ifdef _WIN32
-    DWORD timeout = 3000;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    EnterCriticalSection(&g_cluster.lock);
 #else
-    struct timeval tv;
-    tv.tv_sec = 3;
-    tv.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    pthread_mutex_lock(&g_cluster.lock);
 #endif
-    
-    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+}
+
+static void cluster_unlock(void) {
 #ifdef _WIN32
-        closesocket(sock);
+    LeaveCriticalSection(&g_cluster.lock);
 #else
-        close(sock);
+    pthread_mutex_unlock(&g_cluster.lock);
 #endif
-        return -1;
-    }
-    
-    // Отправка сообщения
-    send(sock, (const char*)msg, sizeof(cluster_message_t), 0);
-    
+}
+
+static void cluster_lock_init(void) {
+    if (g_cluster.lock_initialized) return;
 #ifdef _WIN32
-    closesocket(sock);
+    InitializeCriticalSection(&g_cluster.lock);
 #else
-    close(sock);
+    // Рекурсивный: callbacks могут вызывать API кластера
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&g_cluster.lock, &attr);
+    pthread_mutexattr_destroy(&attr);
 #endif
-    
+    g_cluster.lock_initialized = true;
+}
+
+static int find_node_index(const char *name) {
+    if (!name) return -1;
+    for (int i = 0; i < g_cluster.node_count; i++) {
+        if (strcmp(g_cluster.nodes[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool is_local_node(int idx) {
+    return strcmp(g_cluster.nodes[idx].name, g_cluster.local_node_name) == 0;
+}
+
+static void peer_init(cluster_peer_t *peer) {
+    memset(peer, 0, sizeof(*peer));
+    peer->fd = -1;
+}
+
+static void peer_close(cluster_peer_t *peer) {
+    if (peer->fd >= 0) {
+        cluster_close_socket(peer->fd);
+        peer->fd = -1;
+        g_cluster.stats.open_peer_connections--;
+    }
+    // После переподключения peer должен получить полное состояние
+    memset(peer->sent_version, 0, sizeof(peer->sent_version));
+}
+
+static void peer_release(cluster_peer_t *peer) {
+    peer_close(peer);
+    free(peer->out_buf);
+    peer_init(peer);
+}
+
+// Адрес разрешается один раз и кэшируется до ошибки соединения
+static int peer_resolve(int idx) {
+    cluster_peer_t *peer = &g_cluster.peers[idx];
+    if (peer->addr_resolved) return 0;
+
+    const cluster_node_config_t *node = &g_cluster.nodes[idx];
+    memset(&peer->addr, 0, sizeof(peer->addr));
+    peer->addr.sin_family = AF_INET;
+    peer->addr.sin_port = htons(node->management_port);
+
+    if (inet_pton(AF_INET, node->host, &peer->addr.sin_addr) <= 0) {
+        struct addrinfo hints = {0}, *res = NULL;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(node->host, NULL, &hints, &res) != 0 || !res) {
+            return -1;
+        }
+        peer->addr.sin_addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+        freeaddrinfo(res);
+    }
+    peer->addr_resolved = true;
     return 0;
 }
 
+static int peer_connect(int idx, int64_t now) {
+    cluster_peer_t *peer = &g_cluster.peers[idx];
+    if (peer->fd >= 0) return 0;
+    if (now < peer->next_connect_ms) return -1;
+
+    if (peer_resolve(idx) < 0) {
+        goto fail;
+    }
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) goto fail;
+
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+
+#ifndef _WIN32
+    // Неблокирующий connect с таймаутом, затем блокирующий режим с таймаутом на запись
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    int r = connect(sock, (struct sockaddr *)&peer->addr, sizeof(peer->addr));
+    if (r < 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { .fd = sock, .events = POLLOUT };
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (poll(&pfd, 1, CLUSTER_CONNECT_TIMEOUT_MS) == 1 &&
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+            r = 0;
+        }
+    }
+    fcntl(sock, F_SETFL, flags);
+    struct timeval tv = { .tv_sec = 3, .tv_usec = 0 };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#else
+    DWORD timeout = 3000;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+    int r = connect(sock, (struct sockaddr *)&peer->addr, sizeof(peer->addr));
+#endif
+
+    if (r < 0) {
+        cluster_close_socket(sock);
+        goto fail;
+    }
+
+    peer->fd = sock;
+    peer->backoff_ms = 0;
+    memset(peer->sent_version, 0, sizeof(peer->sent_version));
+    g_cluster.stats.peer_connects++;
+    g_cluster.stats.open_peer_connections++;
+    return 0;
+
+fail:
+    peer->addr_resolved = false;
+    peer->backoff_ms = peer->backoff_ms ? peer->backoff_ms * 2 : CLUSTER_RECONNECT_BACKOFF_MS;
+    if (peer->backoff_ms > CLUSTER_RECONNECT_BACKOFF_MAX_MS) {
+        peer->backoff_ms = CLUSTER_RECONNECT_BACKOFF_MAX_MS;
+    }
+    peer->next_connect_ms = now + peer->backoff_ms;
+    g_cluster.stats.peer_connect_failures++;
+    return -1;
+}
+
+static int send_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        struct msghdr mh = {0};
+        mh.msg_iov = iov;
+        mh.msg_iovlen = iovcnt;
+        ssize_t r = sendmsg(fd, &mh, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)r >= iov->iov_len) {
+            r -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + r;
+            iov->iov_len -= r;
+        }
+    }
+    return 0;
+}
+
+static int peer_flush(int idx);
+
+// Добавление сообщения в буфер peer; при переполнении буфер отправляется
+static int peer_enqueue(int idx, const cluster_message_t *msg) {
+    cluster_peer_t *peer = &g_cluster.peers[idx];
+    int payload_size = msg->payload_size;
+    if (payload_size < 0) payload_size = 0;
+    if (payload_size > CLUSTER_MAX_MESSAGE_LEN) payload_size = CLUSTER_MAX_MESSAGE_LEN;
+    int need = (int)sizeof(cluster_wire_msg_t) + payload_size;
+
+    if (!peer->out_buf) {
+        peer->out_buf = malloc(CLUSTER_BATCH_MAX_BYTES + sizeof(cluster_wire_msg_t) + CLUSTER_MAX_MESSAGE_LEN);
+        if (!peer->out_buf) return -1;
+    }
+    if (peer->out_len + need > CLUSTER_BATCH_MAX_BYTES && peer->out_msgs > 0) {
+        if (peer_flush(idx) < 0) return -1;
+    }
+
+    cluster_wire_msg_t *w = (cluster_wire_msg_t *)(peer->out_buf + peer->out_len);
+    memset(w, 0, sizeof(*w));
+    w->type = (uint8_t)msg->type;
+    w->payload_size = (uint16_t)payload_size;
+    w->message_id = msg->message_id;
+    w->timestamp = msg->timestamp;
+    memcpy(w->source, msg->source, sizeof(w->source));
+    memcpy(w->destination, msg->destination, sizeof(w->destination));
+    memcpy(w + 1, msg->payload, payload_size);
+
+    peer->out_len += need;
+    peer->out_msgs++;
+    return 0;
+}
+
+static void on_peer_send_result(int idx, bool ok, int64_t now);
+
+// Отправка накопленного пакета одним кадром с piggyback membership deltas
+static int peer_flush(int idx) {
+    cluster_peer_t *peer = &g_cluster.peers[idx];
+    cluster_wire_delta_t deltas[CLUSTER_MAX_DELTAS_PER_BATCH];
+    int delta_idx[CLUSTER_MAX_DELTAS_PER_BATCH];
+    int delta_count = 0;
+    int64_t now = get_current_time_ms();
+
+    if (!peer->out_msgs) return 0;
+
+    if (peer->fd < 0 && now < peer->next_connect_ms) {
+        // Идёт backoff: попытки не было, статус узла не меняем
+        peer->out_len = peer->out_msgs = 0;
+        return -1;
+    }
+    if (peer_connect(idx, now) < 0) {
+        peer->out_len = peer->out_msgs = 0;
+        on_peer_send_result(idx, false, now);
+        return -1;
+    }
+
+    for (int i = 0; i < g_cluster.node_count && delta_count < CLUSTER_MAX_DELTAS_PER_BATCH; i++) {
+        if (i == idx || g_cluster.member_version[i] == peer->sent_version[i]) continue;
+        cluster_wire_delta_t *d = &deltas[delta_count];
+        memset(d, 0, sizeof(*d));
+        memcpy(d->name, g_cluster.nodes[i].name, sizeof(d->name));
+        d->status = (uint8_t)g_cluster.node_status[i].status;
+        d->role = (uint8_t)g_cluster.node_status[i].role;
+        d->version = g_cluster.member_version[i];
+        d->last_seen = is_local_node(i) ? now : g_cluster.node_status[i].last_seen;
+        delta_idx[delta_count++] = i;
+    }
+
+    cluster_wire_header_t hdr;
+    hdr.magic = CLUSTER_WIRE_MAGIC;
+    hdr.msg_count = (uint16_t)peer->out_msgs;
+    hdr.delta_count = (uint16_t)delta_count;
+    hdr.length = (uint32_t)(delta_count * sizeof(cluster_wire_delta_t) + peer->out_len);
+
+    struct iovec iov[3] = {
+        { .iov_base = &hdr, .iov_len = sizeof(hdr) },
+        { .iov_base = deltas, .iov_len = delta_count * sizeof(cluster_wire_delta_t) },
+        { .iov_base = peer->out_buf, .iov_len = peer->out_len },
+    };
+
+    int msgs = peer->out_msgs;
+    peer->out_len = peer->out_msgs = 0;
+
+    if (send_all(peer->fd, iov, 3) < 0) {
+        peer_close(peer);
+        peer->next_connect_ms = now + CLUSTER_RECONNECT_BACKOFF_MS;
+        on_peer_send_result(idx, false, now);
+        return -1;
+    }
+
+    for (int i = 0; i < delta_count; i++) {
+        peer->sent_version[delta_idx[i]] = deltas[i].version;
+    }
+    g_cluster.stats.total_batches_sent++;
+    g_cluster.stats.membership_deltas_sent += delta_count;
+    g_cluster.stats.total_messages_sent += msgs;
+    on_peer_send_result(idx, true, now);
+    return 0;
+}
+
+static void flush_all_peers(void) {
+    for (int i = 0; i < g_cluster.node_count; i++) {
+        if (g_cluster.peers[i].out_msgs) {
+            peer_flush(i);
+        }
+    }
+}
+
+// Немедленная отправка одного сообщения узлу (enqueue + flush)
+static int send_node_message(int idx, const cluster_message_t *msg) {
+    if (idx < 0 || idx >= g_cluster.node_count) return -1;
+    cluster_lock();
+    int r = peer_enqueue(idx, msg);
+    if (r == 0) {
+        r = peer_flush(idx);
+    }
+    cluster_unlock();
+    return r;
+}
+
 static void update_node_status(const char *name, cluster_node_state_t new_status) {
     cluster_node_info_t *status = find_node_status(name);
     if (!status) return;
@@ -167,6 +505,7 @@ static void update_node_status(const char *name, cluster_node_state_t new_status
 
     status->status = new_status;
     status->last_seen = get_current_time_ms();
+    g_cluster.member_version[status - g_cluster.node_status]++;
 
     kprintf("[CLUSTER] Node %s status changed: %s -> %s\n",
             name,
@@ -179,56 +518,96 @@ static void update_node_status(const char *name, cluster_node_state_t new_status
     }
 }
 
+// Результат прямой отправки peer: обновление его статуса (как в прежнем heartbeat)
+static void on_peer_send_result(int idx, bool ok, int64_t now) {
+    cluster_node_status_t *status = &g_cluster.node_status[idx];
+    const char *name = g_cluster.nodes[idx].name;
+
+    if (ok) {
+        if (status->status == CLUSTER_NODE_OFFLINE ||
+            status->status == CLUSTER_NODE_FAILED ||
+            status->status == CLUSTER_NODE_DEGRADED) {
+            update_node_status(name, CLUSTER_NODE_ONLINE);
+        }
+        status->last_seen = now;
+        status->last_heartbeat = now;
+        return;
+    }
+
+    if (status->status == CLUSTER_NODE_ONLINE) {
+        // Первый сбой
+        update_node_status(name, CLUSTER_NODE_DEGRADED);
+    } else if (status->status == CLUSTER_NODE_DEGRADED) {
+        // Второй сбой - помечаем как failed
+        update_node_status(name, CLUSTER_NODE_FAILED);
+
+        // Auto failover
+        if (g_cluster.auto_failover_enabled) {
+            cluster_handle_node_failure(name);
+        }
+    }
+}
+
+static void shuffle_probe_order(void) {
+    g_cluster.probe_count = 0;
+    for (int i = 0; i < g_cluster.node_count; i++) {
+        if (!g_cluster.nodes[i].enabled || is_local_node(i)) continue;
+        g_cluster.probe_order[g_cluster.probe_count++] = i;
+    }
+    for (int i = g_cluster.probe_count - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = g_cluster.probe_order[i];
+        g_cluster.probe_order[i] = g_cluster.probe_order[j];
+        g_cluster.probe_order[j] = t;
+    }
+    g_cluster.probe_pos = 0;
+}
+
 static void perform_heartbeat(void) {
     if (!g_cluster.running || g_cluster.node_count == 0) {
         return;
     }
     
+    cluster_lock();
     int64_t now = get_current_time_ms();
     
-    // Отправка heartbeat всем узлам
     cluster_message_t msg = {0};
     msg.type = CLUSTER_MSG_HEARTBEAT;
     snprintf(msg.source, sizeof(msg.source), "%s", g_cluster.local_node_name);
     msg.timestamp = now;
     msg.message_id = g_cluster.stats.total_messages_sent + 1;
     
-    for (int i = 0; i < g_cluster.node_count; i++) {
-        if (!g_cluster.nodes[i].enabled) continue;
-        if (strcmp(g_cluster.nodes[i].name, g_cluster.local_node_name) == 0) continue;
+    // Выбор узлов: round-robin по случайной перестановке (как в SWIM),
+    // чтобы каждый узел опрашивался не реже чем раз в ceil(N / fanout) интервалов
+    int peers = g_cluster.node_count - 1;
+    int fanout = g_cluster.gossip_fanout > 0 && g_cluster.gossip_fanout < peers ? g_cluster.gossip_fanout : peers;
+    for (int k = 0; k < fanout; k++) {
+        if (g_cluster.probe_pos >= g_cluster.probe_count) {
+            shuffle_probe_order();
+            if (!g_cluster.probe_count) break;
+        }
+        int i = g_cluster.probe_order[g_cluster.probe_pos++];
+        if (i >= g_cluster.node_count || !g_cluster.nodes[i].enabled || is_local_node(i)) continue;
         
         snprintf(msg.destination, sizeof(msg.destination), "%s", g_cluster.nodes[i].name);
-        
-        int result = send_tcp_message(g_cluster.nodes[i].host, 
-                                       g_cluster.nodes[i].management_port, &msg);
-        
-        if (result == 0) {
-            g_cluster.stats.total_messages_sent++;
-            // Обновление статуса узла
-            cluster_node_status_t *status = &g_cluster.node_status[i];
-            if (status->status == CLUSTER_NODE_OFFLINE || 
-                status->status == CLUSTER_NODE_FAILED) {
-                update_node_status(g_cluster.nodes[i].name, CLUSTER_NODE_ONLINE);
-            }
-            status->last_seen = now;
-        } else {
-            // Узел не отвечает
-            if (status->status == CLUSTER_NODE_ONLINE) {
-                // Первый сбой
-                update_node_status(g_cluster.nodes[i].name, CLUSTER_NODE_DEGRADED);
-            } else if (status->status == CLUSTER_NODE_DEGRADED) {
-                // Второй сбой - помечаем как failed
-                update_node_status(g_cluster.nodes[i].name, CLUSTER_NODE_FAILED);
-                
-                // Auto failover
-                if (g_cluster.auto_failover_enabled) {
-                    cluster_handle_node_failure(g_cluster.nodes[i].name);
-                }
-            }
+        peer_enqueue(i, &msg);
+    }
+    
+    // Один кадр на peer: heartbeat + накопленные сообщения + deltas
+    flush_all_peers();
+    
+    // Узлы, о которых давно нет ни прямых, ни косвенных сведений
+    int cycles = fanout > 0 ? (peers + fanout - 1) / fanout : 1;
+    int64_t suspect_ms = (int64_t)g_cluster.heartbeat_interval_ms * 3 * cycles;
+    for (int i = 0; i < g_cluster.node_count; i++) {
+        if (is_local_node(i) || g_cluster.node_status[i].status != CLUSTER_NODE_ONLINE) continue;
+        if (now - g_cluster.node_status[i].last_seen > suspect_ms) {
+            update_node_status(g_cluster.nodes[i].name, CLUSTER_NODE_DEGRADED);
         }
     }
     
     g_cluster.last_heartbeat = now;
+    cluster_unlock();
 }
 
 static void check_leader_alive(void) {
@@ -280,6 +659,159 @@ static void* heartbeat_thread_func(void *arg)
     return 0;
 }
 
+static void dispatch_message(const cluster_message_t *msg) {
+    cluster_message_type_t type = msg->type;
+    
+    if (type < 16 && g_cluster.message_handlers[type]) {
+        g_cluster.message_handlers[type](msg);
+    } else {
+        // Обработка по умолчанию
+        switch (type) {
+            case CLUSTER_MSG_HEARTBEAT:
+                // Ответ на heartbeat
+                g_cluster.stats.total_messages_received++;
+                break;
+                
+            case CLUSTER_MSG_ELECTION_REQUEST:
+                // Обработка запроса на выборы
+                g_cluster.stats.total_messages_received++;
+                break;
+                
+            case CLUSTER_MSG_CONFIG_SYNC:
+                // Синхронизация конфигурации
+                g_cluster.stats.total_messages_received++;
+                break;
+                
+            default:
+                break;
+        }
+    }
+}
+
+// Косвенные сведения о членстве от peer: принимаются только более свежие
+static void apply_membership_delta(const cluster_wire_delta_t *d, int64_t now) {
+    char name[CLUSTER_MAX_NAME_LEN];
+    memcpy(name, d->name, sizeof(name));
+    name[sizeof(name) - 1] = '\0';
+    
+    int idx = find_node_index(name);
+    if (idx < 0 || is_local_node(idx)) return;
+    
+    cluster_node_status_t *status = &g_cluster.node_status[idx];
+    if (d->last_seen <= status->last_seen) return;
+    
+    int64_t last_seen = d->last_seen < now ? d->last_seen : now;
+    if (d->status == CLUSTER_NODE_ONLINE && status->status != CLUSTER_NODE_ONLINE) {
+        update_node_status(name, CLUSTER_NODE_ONLINE);
+    } else if (d->status == CLUSTER_NODE_FAILED && status->status == CLUSTER_NODE_DEGRADED) {
+        update_node_status(name, CLUSTER_NODE_FAILED);
+    }
+    status->last_seen = last_seen;
+    g_cluster.stats.membership_deltas_applied++;
+}
+
+// Разбор одного кадра; возвращает -1 при нарушении формата
+static int process_frame(const char *data, const cluster_wire_header_t *hdr) {
+    int64_t now = get_current_time_ms();
+    const char *p = data, *end = data + hdr->length;
+    
+    if ((size_t)hdr->delta_count * sizeof(cluster_wire_delta_t) > hdr->length) return -1;
+    
+    cluster_lock();
+    for (int i = 0; i < hdr->delta_count; i++) {
+        cluster_wire_delta_t d;
+        memcpy(&d, p, sizeof(d));
+        p += sizeof(d);
+        apply_membership_delta(&d, now);
+    }
+    
+    for (int i = 0; i < hdr->msg_count; i++) {
+        cluster_wire_msg_t w;
+        if (end - p < (ptrdiff_t)sizeof(w)) goto bad;
+        memcpy(&w, p, sizeof(w));
+        p += sizeof(w);
+        if (w.payload_size > CLUSTER_MAX_MESSAGE_LEN || end - p < w.payload_size) goto bad;
+        
+        cluster_message_t msg;
+        memset(&msg, 0, offsetof(cluster_message_t, payload));
+        msg.type = (cluster_message_type_t)w.type;
+        memcpy(msg.source, w.source, sizeof(msg.source));
+        msg.source[sizeof(msg.source) - 1] = '\0';
+        memcpy(msg.destination, w.destination, sizeof(msg.destination));
+        msg.destination[sizeof(msg.destination) - 1] = '\0';
+        msg.message_id = w.message_id;
+        msg.timestamp = w.timestamp;
+        msg.payload_size = w.payload_size;
+        memcpy(msg.payload, p, w.payload_size);
+        if (w.payload_size < CLUSTER_MAX_MESSAGE_LEN) {
+            msg.payload[w.payload_size] = '\0';
+        }
+        p += w.payload_size;
+        
+        // Прямое сообщение от узла - он жив
+        int idx = find_node_index(msg.source);
+        if (idx >= 0 && !is_local_node(idx)) {
+            cluster_node_status_t *status = &g_cluster.node_status[idx];
+            if (status->status != CLUSTER_NODE_ONLINE) {
+                update_node_status(msg.source, CLUSTER_NODE_ONLINE);
+            }
+            status->last_seen = now;
+            status->last_heartbeat = now;
+            
+            // Узел доступен - переподключаемся без ожидания backoff
+            g_cluster.peers[idx].next_connect_ms = 0;
+            g_cluster.peers[idx].backoff_ms = 0;
+        }
+        
+        dispatch_message(&msg);
+    }
+    g_cluster.stats.total_batches_received++;
+    cluster_unlock();
+    return 0;
+    
+bad:
+    cluster_unlock();
+    return -1;
+}
+
+static void inbound_close(cluster_inbound_t *c) {
+    cluster_close_socket(c->fd);
+    free(c->in_buf);
+    c->fd = -1;
+    c->in_buf = NULL;
+    c->in_len = 0;
+    g_cluster.stats.open_inbound_connections--;
+}
+
+// Чтение доступных данных и обработка всех полных кадров
+static int inbound_read(cluster_inbound_t *c) {
+    int r = recv(c->fd, c->in_buf + c->in_len, CLUSTER_FRAME_MAX_BYTES - c->in_len, 0);
+    if (r <= 0) {
+        return (r < 0 && errno == EINTR) ? 0 : -1;
+    }
+    c->in_len += r;
+    
+    int off = 0;
+    while (c->in_len - off >= (int)sizeof(cluster_wire_header_t)) {
+        cluster_wire_header_t hdr;
+        memcpy(&hdr, c->in_buf + off, sizeof(hdr));
+        if (hdr.magic != CLUSTER_WIRE_MAGIC ||
+            hdr.length > CLUSTER_FRAME_MAX_BYTES - sizeof(hdr)) {
+            return -1;
+        }
+        if (c->in_len - off < (int)(sizeof(hdr) + hdr.length)) break;
+        if (process_frame(c->in_buf + off + sizeof(hdr), &hdr) < 0) {
+            return -1;
+        }
+        off += sizeof(hdr) + hdr.length;
+    }
+    if (off > 0) {
+        memmove(c->in_buf, c->in_buf + off, c->in_len - off);
+        c->in_len -= off;
+    }
+    return 0;
+}
+
 #ifdef _WIN32
 static DWORD WINAPI listener_thread_func(LPVOID arg)
 #else
@@ -290,6 +822,7 @@ static void* listener_thread_func(void *arg)
     
     // Создание серверного сокета
     struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
     addr.sin_port = htons(g_cluster.listen_port);
@@ -305,69 +838,59 @@ static void* listener_thread_func(void *arg)
     
     if (bind(server_sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
         kprintf("[CLUSTER] Failed to bind to port %d\n", g_cluster.listen_port);
-#ifdef _WIN32
-        closesocket(server_sock);
-#else
-        close(server_sock);
-#endif
+        cluster_close_socket(server_sock);
         return 0;
     }
     
-    listen(server_sock, 10);
+    listen(server_sock, 128);
+    
+    // Постоянные входящие соединения от peers
+    cluster_inbound_t inbound[CLUSTER_MAX_INBOUND];
+    struct pollfd pfds[CLUSTER_MAX_INBOUND + 1];
+    int inbound_count = 0;
     
     while (g_cluster.running) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
+        pfds[0].fd = server_sock;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < inbound_count; i++) {
+            pfds[i + 1].fd = inbound[i].fd;
+            pfds[i + 1].events = POLLIN;
+        }
         
-        int client_sock = accept(server_sock, (struct sockaddr*)&client_addr, &client_len);
-        if (client_sock < 0) continue;
+        int ready = poll(pfds, inbound_count + 1, 200);
+        if (ready <= 0) continue;
         
-        // Получение сообщения
-        cluster_message_t msg = {0};
-        int received = recv(client_sock, (char*)&msg, sizeof(msg), 0);
+        for (int i = inbound_count - 1; i >= 0; i--) {
+            if (!pfds[i + 1].revents) continue;
+            if (inbound_read(&inbound[i]) < 0) {
+                inbound_close(&inbound[i]);
+                inbound[i] = inbound[--inbound_count];
+            }
+        }
         
-        if (received > 0) {
-            // Обработка сообщения
-            cluster_message_type_t type = msg.type;
+        if (pfds[0].revents & POLLIN) {
+            struct sockaddr_in client_addr;
+            socklen_t client_len = sizeof(client_addr);
+            int client_sock = accept(server_sock, (struct sockaddr*)&client_addr, &client_len);
+            if (client_sock < 0) continue;
             
-            if (type < 16 && g_cluster.message_handlers[type]) {
-                g_cluster.message_handlers[type](&msg);
-            } else {
-                // Обработка по умолчанию
-                switch (type) {
-                    case CLUSTER_MSG_HEARTBEAT:
-                        // Ответ на heartbeat
-                        g_cluster.stats.total_messages_received++;
-                        break;
-                        
-                    case CLUSTER_MSG_ELECTION_REQUEST:
-                        // Обработка запроса на выборы
-                        g_cluster.stats.total_messages_received++;
-                        break;
-                        
-                    case CLUSTER_MSG_CONFIG_SYNC:
-                        // Синхронизация конфигурации
-                        g_cluster.stats.total_messages_received++;
-                        break;
-                        
-                    default:
-                        break;
-                }
+            char *buf = inbound_count < CLUSTER_MAX_INBOUND ? malloc(CLUSTER_FRAME_MAX_BYTES) : NULL;
+            if (!buf) {
+                cluster_close_socket(client_sock);
+                continue;
             }
+            inbound[inbound_count].fd = client_sock;
+            inbound[inbound_count].in_buf = buf;
+            inbound[inbound_count].in_len = 0;
+            inbound_count++;
+            g_cluster.stats.open_inbound_connections++;
         }
-        
-#ifdef _WIN32
-        closesocket(client_sock);
-#else
-        close(client_sock);
-#endif
     }
     
-#ifdef _WIN32
-    closesocket(server_sock);
-#else
-    close(server_sock);
-#endif
+    for (int i = 0; i < inbound_count; i++) {
+        inbound_close(&inbound[i]);
+    }
+    cluster_close_socket(server_sock);
     
     kprintf("[CLUSTER] Listener thread stopped\n");
     return 0;
@@ -405,12 +928,19 @@ int cluster_init(const char *cluster_name, const char *local_node_name) {
     status->role = CLUSTER_ROLE_STANDALONE;
     
     g_cluster.node_count = 1;
+    g_cluster.stats.total_nodes = 1;
     g_cluster.local_role = CLUSTER_ROLE_STANDALONE;
     
     g_cluster.start_time = get_current_time_ms();
     g_cluster.election_timeout_ms = 5000;
     g_cluster.heartbeat_interval_ms = 2000;
     g_cluster.auto_failover_enabled = true;
+    g_cluster.gossip_fanout = 0;
+    
+    for (int i = 0; i < CLUSTER_MAX_NODES; i++) {
+        peer_init(&g_cluster.peers[i]);
+    }
+    cluster_lock_init();
     
     g_cluster.initialized = true;
     
@@ -425,6 +955,17 @@ void cluster_cleanup(void) {
     
     cluster_stop();
     
+    for (int i = 0; i < CLUSTER_MAX_NODES; i++) {
+        peer_release(&g_cluster.peers[i]);
+    }
+    if (g_cluster.lock_initialized) {
+#ifdef _WIN32
+        DeleteCriticalSection(&g_cluster.lock);
+#else
+        pthread_mutex_destroy(&g_cluster.lock);
+#endif
+    }
+    
     memset(&g_cluster, 0, sizeof(g_cluster));
     kprintf("[CLUSTER] Cleaned up\n");
 }
@@ -469,6 +1010,9 @@ int cluster_add_node(const char *name, const char *host, int port, int managemen
     status->status = CLUSTER_NODE_OFFLINE;
     status->role = CLUSTER_ROLE_FOLLOWER;
     
+    peer_release(&g_cluster.peers[g_cluster.node_count]);
+    g_cluster.member_version[g_cluster.node_count] = 1;
+    
     g_cluster.node_count++;
     g_cluster.stats.total_nodes++;
     
@@ -491,13 +1035,26 @@ int cluster_remove_node(const char *name) {
     
     if (idx < 0) return -1;
     
+    cluster_lock();
+    peer_release(&g_cluster.peers[idx]);
+    
     // Сдвиг массивов
     for (int i = idx; i < g_cluster.node_count - 1; i++) {
         g_cluster.nodes[i] = g_cluster.nodes[i + 1];
         g_cluster.node_status[i] = g_cluster.node_status[i + 1];
+        g_cluster.peers[i] = g_cluster.peers[i + 1];
+        g_cluster.member_version[i] = g_cluster.member_version[i + 1];
     }
+    peer_init(&g_cluster.peers[g_cluster.node_count - 1]);
     
     g_cluster.node_count--;
+    
+    // Индексы сдвинулись: каждый peer снова получит полное состояние
+    for (int i = 0; i < g_cluster.node_count; i++) {
+        memset(g_cluster.peers[i].sent_version, 0, sizeof(g_cluster.peers[i].sent_version));
+    }
+    g_cluster.probe_pos = g_cluster.probe_count;
+    cluster_unlock();
     g_cluster.stats.total_nodes--;
     
     kprintf("[CLUSTER] Node removed: %s\n", name);
@@ -590,9 +1147,27 @@ void cluster_stop(void) {
     pthread_join(g_cluster.listener_thread, NULL);
 #endif
     
+    cluster_lock();
+    for (int i = 0; i < g_cluster.node_count; i++) {
+        peer_close(&g_cluster.peers[i]);
+        g_cluster.peers[i].out_len = g_cluster.peers[i].out_msgs = 0;
+    }
+    cluster_unlock();
+    
     kprintf("[CLUSTER] Stopped\n");
 }
 
+void cluster_set_heartbeat_interval(int interval_ms) {
+    if (interval_ms > 0) {
+        g_cluster.heartbeat_interval_ms = interval_ms;
+    }
+}
+
+void cluster_set_gossip_fanout(int fanout) {
+    g_cluster.gossip_fanout = fanout > 0 ? fanout : 0;
+    kprintf("[CLUSTER] Gossip fan-out: %d\n", g_cluster.gossip_fanout);
+}
+
 bool cluster_is_running(void) {
     return g_cluster.running;
 }
@@ -630,15 +1205,18 @@ int cluster_start_election(void) {
     int votes = 1;  // Голос за себя
     int total_responses = 0;
     
+    cluster_lock();
     for (int i = 0; i < g_cluster.node_count; i++) {
         if (strcmp(g_cluster.nodes[i].name, g_cluster.local_node_name) == 0) continue;
         if (!g_cluster.nodes[i].enabled) continue;
         if (g_cluster.node_status[i].status != CLUSTER_NODE_ONLINE) continue;
         
         snprintf(msg.destination, sizeof(msg.destination), "%s", g_cluster.nodes[i].name);
-        send_tcp_message(g_cluster.nodes[i].host, g_cluster.nodes[i].management_port, &msg);
+        peer_enqueue(i, &msg);
         total_responses++;
     }
+    flush_all_peers();
+    cluster_unlock();
     
     // Упрощённая логика выборов
     // В реальной реализации нужно ждать ответы и считать голоса
@@ -720,13 +1298,12 @@ int cluster_sync_config(const char *config_data) {
         if (!g_cluster.nodes[i].enabled) continue;
         
         snprintf(msg.destination, sizeof(msg.destination), "%s", g_cluster.nodes[i].name);
-        if (send_tcp_message(g_cluster.nodes[i].host, g_cluster.nodes[i].management_port, &msg) == 0) {
+        if (send_node_message(i, &msg) == 0) {
             sent++;
         }
     }
     
     g_cluster.stats.config_sync_count++;
-    g_cluster.stats.total_messages_sent += sent;
     
     kprintf("[CLUSTER] Config synced to %d nodes\n", sent);
     return 0;
@@ -765,7 +1342,8 @@ int cluster_request_config(void) {
     snprintf(msg.destination, sizeof(msg.destination), "%s", g_cluster.leader_name);
     snprintf(msg.payload, sizeof(msg.payload), "request_config=true");
     
-    send_tcp_message(leader->host, leader->management_port, &msg);
+    msg.payload_size = (int)strlen(msg.payload);
+    send_node_message(find_node_index(g_cluster.leader_name), &msg);
     
     return 0;
 }
@@ -917,8 +1495,8 @@ int cluster_send_message(const char *destination, cluster_message_type_t type,
         return -1;
     }
     
-    cluster_node_config_t *node = find_node_config(destination);
-    if (!node) {
+    int idx = find_node_index(destination);
+    if (idx < 0) {
         return -1;
     }
     
@@ -927,7 +1505,7 @@ int cluster_send_message(const char *destination, cluster_message_type_t type,
     snprintf(msg.source, sizeof(msg.source), "%s", g_cluster.local_node_name);
     snprintf(msg.destination, sizeof(msg.destination), "%s", destination);
     msg.timestamp = get_current_time_ms();
-    msg.message_id = ++g_cluster.stats.total_messages_sent;
+    msg.message_id = g_cluster.stats.total_messages_sent + 1;
     
     if (payload_size > CLUSTER_MAX_MESSAGE_LEN) {
         payload_size = CLUSTER_MAX_MESSAGE_LEN;
@@ -935,21 +1513,41 @@ int cluster_send_message(const char *destination, cluster_message_type_t type,
     memcpy(msg.payload, payload, payload_size);
     msg.payload_size = payload_size;
     
-    return send_tcp_message(node->host, node->management_port, &msg);
+    return send_node_message(idx, &msg);
 }
 
 int cluster_broadcast_message(cluster_message_type_t type,
                               const char *payload, int payload_size) {
     int sent = 0;
     
+    if (!payload) {
+        return 0;
+    }
+    
+    cluster_message_t msg = {0};
+    msg.type = type;
+    snprintf(msg.source, sizeof(msg.source), "%s", g_cluster.local_node_name);
+    msg.timestamp = get_current_time_ms();
+    msg.message_id = g_cluster.stats.total_messages_sent + 1;
+    
+    if (payload_size > CLUSTER_MAX_MESSAGE_LEN) {
+        payload_size = CLUSTER_MAX_MESSAGE_LEN;
+    }
+    memcpy(msg.payload, payload, payload_size);
+    msg.payload_size = payload_size;
+    
+    // Сообщение добавляется в буфер каждого peer и уходит одним кадром на peer
+    cluster_lock();
     for (int i = 0; i < g_cluster.node_count; i++) {
         if (strcmp(g_cluster.nodes[i].name, g_cluster.local_node_name) == 0) continue;
         if (!g_cluster.nodes[i].enabled) continue;
         
-        if (cluster_send_message(g_cluster.nodes[i].name, type, payload, payload_size) == 0) {
+        snprintf(msg.destination, sizeof(msg.destination), "%s", g_cluster.nodes[i].name);
+        if (peer_enqueue(i, &msg) == 0 && peer_flush(i) == 0) {
             sent++;
         }
     }
+    cluster_unlock();
     
     return sent;
 }
@@ -1042,6 +1640,15 @@ int cluster_get_stats_string(char *buffer, size_t buffer_size) {
                        "  Messages: Sent %llu, Received %llu\n",
                        (unsigned long long)stats.total_messages_sent,
                        (unsigned long long)stats.total_messages_received);
+    offset += snprintf(buffer + offset, buffer_size - offset,
+                       "  Transport: Batches %llu/%llu, Deltas %llu/%llu, Peers %d out/%d in, Connects %llu (failed %llu)\n",
+                       (unsigned long long)stats.total_batches_sent,
+                       (unsigned long long)stats.total_batches_received,
+                       (unsigned long long)stats.membership_deltas_sent,
+                       (unsigned long long)stats.membership_deltas_applied,
+                       stats.open_peer_connections, stats.open_inbound_connections,
+                       (unsigned long long)stats.peer_connects,
+                       (unsigned long long)stats.peer_connect_failures);
     offset += snprintf(buffer + offset, buffer_size - offset,
                        "  Avg Load: %.1f%%, Failovers: %llu\n",
                        stats.avg_load_percent,
@@ -1053,8 +1660,12 @@ int cluster_get_stats_string(char *buffer, size_t buffer_size) {
 void cluster_reset_stats(void) {
     if (!g_cluster.initialized) return;
     
+    int open_peers = g_cluster.stats.open_peer_connections;
+    int open_inbound = g_cluster.stats.open_inbound_connections;
     memset(&g_cluster.stats, 0, sizeof(g_cluster.stats));
     g_cluster.stats.total_nodes = g_cluster.node_count;
+    g_cluster.stats.open_peer_connections = open_peers;
+    g_cluster.stats.open_inbound_connections = open_inbound;
     kprintf("[CLUSTER] Statistics reset\n");
 }
 
@@ -34,7 +34,7 @@ extern "C" {
 #define CLUSTER_MANAGER_VERSION "1.0.0"
 
 // Максимальные размеры
-#define CLUSTER_MAX_NODES 16
+#define CLUSTER_MAX_NODES 64
 #define CLUSTER_MAX_NAME_LEN 64
 #define CLUSTER_MAX_HOST_LEN 256
 #define CLUSTER_MAX_TOKEN_LEN 128
@@ -99,6 +99,8 @@ typedef struct {
     char error_message[256];
 } cluster_node_info_t;
 
+typedef cluster_node_info_t cluster_node_status_t;
+
 // Сообщение кластера
 typedef struct {
     cluster_message_type_t type;
@@ -124,12 +126,21 @@ typedef struct {
     uint64_t config_sync_count;
     uint64_t failover_count;
     double avg_load_percent;
+    // Транспорт: постоянные соединения и пакетная отправка
+    uint64_t total_batches_sent;
+    uint64_t total_batches_received;
+    uint64_t membership_deltas_sent;
+    uint64_t membership_deltas_applied;
+    uint64_t peer_connects;
+    uint64_t peer_connect_failures;
+    int open_peer_connections;
+    int open_inbound_connections;
 } cluster_stats_t;
 
 // Callback функции
 typedef void (*cluster_node_change_callback_t)(const char *node_name, 
-                                                cluster_node_status_t old_status,
-                                                cluster_node_status_t new_status);
+                                                cluster_node_state_t old_status,
+                                                cluster_node_state_t new_status);
 typedef void (*cluster_leader_change_callback_t)(const char *old_leader,
                                                   const char *new_leader);
 typedef int (*cluster_message_handler_t)(const cluster_message_t *msg);
@@ -216,6 +227,20 @@ int cluster_start(int listen_port);
  */
 void cluster_stop(void);
 
+/**
+ * Установить интервал heartbeat
+ * @param interval_ms Интервал в миллисекундах
+ */
+void cluster_set_heartbeat_interval(int interval_ms);
+
+/**
+ * Установить fan-out gossip: сколько узлов опрашивается за один интервал heartbeat.
+ * Остальные узлы узнают о состоянии кластера из membership deltas,
+ * передаваемых вместе с каждым пакетом сообщений.
+ * @param fanout Количество узлов за интервал (0 - все узлы)
+ */
+void cluster_set_gossip_fanout(int fanout);
+
 /**
  * Проверить, запущен ли кластер
  * @return true если запущен
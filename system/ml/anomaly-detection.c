@@ -14,6 +14,10 @@
 #include <stdio.h>
 #include <time.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #ifdef _WIN32
 #include <windows.h>
 #else
@@ -179,26 +183,68 @@ static void update_feature_stats(anomaly_feature_stats_t* stats, double value) {
     stats->iqr = stats->q3 - stats->q1;
 }
 
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
 /**
- * @brief Сортировка массива для вычисления перцентилей
+ * @brief Выбор k-й порядковой статистики (introselect)
+ * 
+ * Quickselect с медианой из трёх; при вырождении разбиения (глубина
+ * больше 2*log2(n)) оставшийся диапазон досортировывается qsort,
+ * поэтому худший случай O(n log n). После возврата arr[k] стоит на
+ * своей позиции в отсортированном порядке, слева от него элементы <=,
+ * справа >=.
  */
-static void sort_array(double* arr, size_t n) {
-    if (n <= 1) return;
-    
-    /* Простая сортировка пузырьком для небольших массивов */
-    for (size_t i = 0; i < n - 1; i++) {
-        for (size_t j = 0; j < n - i - 1; j++) {
-            if (arr[j] > arr[j + 1]) {
-                double temp = arr[j];
-                arr[j] = arr[j + 1];
-                arr[j + 1] = temp;
+static double select_kth(double* arr, size_t n, size_t k) {
+    size_t lo = 0, hi = n - 1;
+    int depth_limit = 0;
+    for (size_t m = n; m > 1; m >>= 1) depth_limit += 2;
+    
+    while (hi > lo) {
+        if (depth_limit-- <= 0) {
+            qsort(&arr[lo], hi - lo + 1, sizeof(double), compare_doubles);
+            break;
+        }
+        
+        /* Медиана из трёх как опорный элемент */
+        size_t mid = lo + (hi - lo) / 2;
+        if (arr[mid] < arr[lo]) { double t = arr[mid]; arr[mid] = arr[lo]; arr[lo] = t; }
+        if (arr[hi] < arr[lo]) { double t = arr[hi]; arr[hi] = arr[lo]; arr[lo] = t; }
+        if (arr[hi] < arr[mid]) { double t = arr[hi]; arr[hi] = arr[mid]; arr[mid] = t; }
+        double pivot = arr[mid];
+        
+        /* Разбиение Хоара */
+        size_t i = lo, j = hi;
+        while (i <= j) {
+            while (arr[i] < pivot) i++;
+            while (arr[j] > pivot) j--;
+            if (i <= j) {
+                double t = arr[i]; arr[i] = arr[j]; arr[j] = t;
+                i++;
+                if (j == 0) break;
+                j--;
             }
         }
+        
+        if (k <= j) {
+            hi = j;
+        } else if (k >= i) {
+            lo = i;
+        } else {
+            break; /* k попал между частями - элемент на месте */
+        }
     }
+    
+    return arr[k];
 }
 
 /**
  * @brief Вычисление перцентилей
+ * 
+ * Работает по месту: порядок элементов data меняется.
  */
 static void compute_percentiles(double* data, size_t count, double* q1, double* q3) {
     if (!data || count == 0) {
@@ -207,21 +253,17 @@ static void compute_percentiles(double* data, size_t count, double* q1, double*
         return;
     }
     
-    /* Копирование и сортировка */
-    double* sorted = (double*)safe_malloc(count * sizeof(double));
-    if (!sorted) return;
-    memcpy(sorted, data, count * sizeof(double));
-    sort_array(sorted, count);
-    
     /* Q1 (25-й перцентиль) */
     size_t q1_idx = count / 4;
-    *q1 = sorted[q1_idx];
+    *q1 = select_kth(data, count, q1_idx);
     
-    /* Q3 (75-й перцентиль) */
+    /* Q3 (75-й перцентиль) - ищем только правее Q1 */
     size_t q3_idx = (3 * count) / 4;
-    *q3 = sorted[q3_idx];
-    
-    free(sorted);
+    if (q3_idx == q1_idx) {
+        *q3 = *q1;
+    } else {
+        *q3 = select_kth(&data[q1_idx + 1], count - q1_idx - 1, q3_idx - q1_idx - 1);
+    }
 }
 
 /* ============================================
@@ -229,127 +271,128 @@ static void compute_percentiles(double* data, size_t count, double* q1, double*
  * ============================================ */
 
 /**
- * @brief Создание узла дерева
+ * @brief Выделение узлов в таблице леса
+ * 
+ * Массивы растут удвоением; узлы создаются листьями глубины depth.
+ * Возвращает индекс первого из count узлов или -1. Указатели на
+ * элементы таблицы после вызова недействительны.
  */
-static anomaly_tree_node_t* create_tree_node(size_t feature_index, double split_value, 
-                                             size_t depth) {
-    anomaly_tree_node_t* node = (anomaly_tree_node_t*)safe_malloc(sizeof(anomaly_tree_node_t));
-    if (!node) return NULL;
-    
-    node->feature_index = feature_index;
-    node->split_value = split_value;
-    node->left = NULL;
-    node->right = NULL;
-    node->size = 0;
-    node->depth = depth;
+static int64_t forest_alloc_nodes(anomaly_forest_t* forest, size_t count, size_t depth) {
+    if (forest->n_nodes + count > forest->capacity) {
+        size_t new_capacity = forest->capacity ? forest->capacity : 256;
+        while (new_capacity < forest->n_nodes + count) new_capacity *= 2;
+        if (new_capacity > INT32_MAX) return -1; /* индексы gather - int32 */
+        
+        uint32_t* feature = (uint32_t*)realloc(forest->feature, new_capacity * sizeof(uint32_t));
+        if (feature) forest->feature = feature;
+        double* split = (double*)realloc(forest->split, new_capacity * sizeof(double));
+        if (split) forest->split = split;
+        uint32_t* child = (uint32_t*)realloc(forest->child, new_capacity * sizeof(uint32_t));
+        if (child) forest->child = child;
+        double* leaf_path = (double*)realloc(forest->leaf_path, new_capacity * sizeof(double));
+        if (leaf_path) forest->leaf_path = leaf_path;
+        
+        if (!feature || !split || !child || !leaf_path) return -1;
+        forest->capacity = new_capacity;
+    }
     
-    return node;
+    size_t first = forest->n_nodes;
+    for (size_t i = first; i < first + count; i++) {
+        forest->feature[i] = 0;
+        forest->split[i] = 0;
+        forest->child[i] = 0;
+        /* Размер листа не хранится, поэтому, как и раньше, поправка
+         * c(size) к длине пути не добавляется */
+        forest->leaf_path[i] = (double)depth;
+    }
+    forest->n_nodes += count;
+    return (int64_t)first;
 }
 
 /**
- * @brief Построение дерева изоляции
+ * @brief Построение дерева изоляции в таблице леса
+ * 
+ * Узел node уже выделен как лист. Образцы задаются индексами idx в data
+ * и разбиваются на месте стабильно (правая часть через scratch), поэтому
+ * последовательность rand() и сами деревья те же, что у прежней
+ * реализации с копированием подвыборок на каждом уровне.
  */
-static anomaly_tree_node_t* build_isolation_tree(const double* data, size_t n_samples,
-                                                  size_t n_features, size_t height_limit,
-                                                  size_t current_depth) {
+static int build_isolation_tree(anomaly_forest_t* forest, uint32_t node,
+                                const double* data, size_t* idx, size_t* scratch,
+                                size_t n_samples, size_t n_features,
+                                size_t height_limit, size_t current_depth,
+                                size_t* max_depth) {
+    if (current_depth > *max_depth) *max_depth = current_depth;
+    
     if (current_depth >= height_limit || n_samples <= 1) {
-        return create_tree_node(0, 0, current_depth);
+        return 0;
     }
     
     /* Выбор случайного признака */
     size_t feature_idx = rand() % n_features;
     
     /* Поиск мин/макс для выбранного признака */
-    double min_val = data[feature_idx];
-    double max_val = data[feature_idx];
+    double min_val = data[idx[0] * n_features + feature_idx];
+    double max_val = min_val;
     for (size_t i = 0; i < n_samples; i++) {
-        double val = data[i * n_features + feature_idx];
+        double val = data[idx[i] * n_features + feature_idx];
         if (val < min_val) min_val = val;
         if (val > max_val) max_val = val;
     }
     
+    forest->feature[node] = (uint32_t)feature_idx;
+    
     if (min_val == max_val) {
-        return create_tree_node(feature_idx, min_val, current_depth);
+        forest->split[node] = min_val;
+        return 0;
     }
     
     /* Случайное значение разделения */
     double split_value = min_val + ((double)rand() / RAND_MAX) * (max_val - min_val);
+    forest->split[node] = split_value;
     
-    anomaly_tree_node_t* node = create_tree_node(feature_idx, split_value, current_depth);
-    if (!node) return NULL;
-    
-    /* Разделение данных */
-    double* left_data = (double*)safe_malloc(n_samples * n_features * sizeof(double));
-    double* right_data = (double*)safe_malloc(n_samples * n_features * sizeof(double));
-    
-    if (!left_data || !right_data) {
-        free(left_data);
-        free(right_data);
-        free(node);
-        return NULL;
-    }
-    
+    /* Стабильное разделение индексов */
     size_t left_count = 0;
     size_t right_count = 0;
     
     for (size_t i = 0; i < n_samples; i++) {
-        double val = data[i * n_features + feature_idx];
+        double val = data[idx[i] * n_features + feature_idx];
         if (val < split_value) {
-            memcpy(&left_data[left_count * n_features], &data[i * n_features], 
-                   n_features * sizeof(double));
-            left_count++;
+            idx[left_count++] = idx[i];
         } else {
-            memcpy(&right_data[right_count * n_features], &data[i * n_features],
-                   n_features * sizeof(double));
-            right_count++;
+            scratch[right_count++] = idx[i];
         }
     }
+    memcpy(&idx[left_count], scratch, right_count * sizeof(size_t));
     
-    /* Рекурсивное построение поддеревьев */
-    node->left = build_isolation_tree(left_data, left_count, n_features, 
-                                      height_limit, current_depth + 1);
-    node->right = build_isolation_tree(right_data, right_count, n_features,
-                                       height_limit, current_depth + 1);
+    /* Потомки выделяются парой: правый = левый + 1 */
+    int64_t children = forest_alloc_nodes(forest, 2, current_depth + 1);
+    if (children < 0) return -1;
+    forest->child[node] = (uint32_t)children;
     
-    node->size = n_samples;
-    
-    free(left_data);
-    free(right_data);
-    
-    return node;
+    /* Рекурсивное построение поддеревьев */
+    if (build_isolation_tree(forest, (uint32_t)children, data, idx, scratch, left_count,
+                             n_features, height_limit, current_depth + 1, max_depth) != 0) {
+        return -1;
+    }
+    return build_isolation_tree(forest, (uint32_t)children + 1, data, idx + left_count, scratch,
+                                right_count, n_features, height_limit, current_depth + 1,
+                                max_depth);
 }
 
 /**
- * @brief Очистка дерева
+ * @brief Освобождение таблицы Isolation Forest
  */
-static void cleanup_tree_node(anomaly_tree_node_t* node) {
-    if (!node) return;
-    cleanup_tree_node(node->left);
-    cleanup_tree_node(node->right);
-    free(node);
-}
-
-/**
- * @brief Вычисление пути длины для точки
- */
-static double path_length(anomaly_tree_node_t* node, const double* point, 
-                          size_t n_features, size_t current_depth) {
-    if (!node || !node->left || !node->right) {
-        /* Листовой узел - добавляем коррекцию */
-        size_t size = node ? node->size : 0;
-        if (size <= 1) return (double)current_depth;
-        
-        /* Коррекция для размера */
-        double c = 2.0 * (log((double)(size - 1)) + 0.5772156649) - (2.0 * (size - 1) / (double)size);
-        return current_depth + c;
-    }
-    
-    double val = point[node->feature_index];
-    if (val < node->split_value) {
-        return path_length(node->left, point, n_features, current_depth + 1);
-    } else {
-        return path_length(node->right, point, n_features, current_depth + 1);
-    }
+static void free_isolation_forest(anomaly_detector_t* detector) {
+    anomaly_forest_t* forest = &detector->forest;
+    free(forest->feature);
+    free(forest->split);
+    free(forest->child);
+    free(forest->leaf_path);
+    free(forest->roots);
+    free(forest->depths);
+    memset(forest, 0, sizeof(*forest));
+    detector->n_trees = 0;
 }
 
 /**
@@ -358,59 +401,200 @@ static double path_length(anomaly_tree_node_t* node, const double* point,
 static int build_isolation_forest(anomaly_detector_t* detector, const double* data) {
     if (!detector || !data) return -1;
     
+    /* Переобучение: старый лес больше не нужен */
+    free_isolation_forest(detector);
+    
     size_t n_trees = detector->config.n_trees;
     size_t n_features = detector->n_features;
     size_t n_samples = detector->n_samples;
     size_t height_limit = detector->config.tree_height;
+    anomaly_forest_t* forest = &detector->forest;
     
-    /* Выделение памяти для деревьев */
-    detector->trees = (anomaly_tree_t*)safe_malloc(n_trees * sizeof(anomaly_tree_t));
-    if (!detector->trees) return -1;
+    if (n_trees == 0 || n_samples == 0) return -1;
     
-    detector->n_trees = n_trees;
+    /* Выборка подмножества данных (bootstrap) */
+    size_t sample_size = (n_samples < 256) ? n_samples : 256;
+    size_t* idx = (size_t*)safe_malloc(sample_size * sizeof(size_t));
+    size_t* scratch = (size_t*)safe_malloc(sample_size * sizeof(size_t));
+    forest->roots = (uint32_t*)safe_malloc(n_trees * sizeof(uint32_t));
+    forest->depths = (uint32_t*)safe_malloc(n_trees * sizeof(uint32_t));
+    
+    int ret = (idx && scratch && forest->roots && forest->depths) ? 0 : -1;
     
     /* Построение каждого дерева */
-    for (size_t t = 0; t < n_trees; t++) {
-        /* Выборка подмножества данных (bootstrap) */
-        size_t sample_size = (n_samples < 256) ? n_samples : 256;
-        double* sample_data = (double*)safe_malloc(sample_size * n_features * sizeof(double));
-        if (!sample_data) continue;
-        
+    for (size_t t = 0; t < n_trees && ret == 0; t++) {
         for (size_t i = 0; i < sample_size; i++) {
-            size_t idx = rand() % n_samples;
-            memcpy(&sample_data[i * n_features], &data[idx * n_features],
-                   n_features * sizeof(double));
+            idx[i] = rand() % n_samples;
         }
         
-        /* Построение дерева */
-        detector->trees[t].root = build_isolation_tree(sample_data, sample_size, 
-                                                       n_features, height_limit, 0);
-        detector->trees[t].height = height_limit;
-        detector->trees[t].n_features = n_features;
+        int64_t root = forest_alloc_nodes(forest, 1, 0);
+        if (root < 0) {
+            ret = -1;
+            break;
+        }
         
-        free(sample_data);
+        size_t max_depth = 0;
+        forest->roots[t] = (uint32_t)root;
+        ret = build_isolation_tree(forest, (uint32_t)root, data, idx, scratch, sample_size,
+                                   n_features, height_limit, 0, &max_depth);
+        forest->depths[t] = (uint32_t)max_depth;
     }
     
+    free(idx);
+    free(scratch);
+    
+    if (ret != 0) {
+        free_isolation_forest(detector);
+        return -1;
+    }
+    
+    detector->n_trees = n_trees;
     return 0;
 }
 
 /**
- * @brief Вычисление оценки аномалии через Isolation Forest
+ * @brief Сумма длин путей точки по всем деревьям
+ * 
+ * Суммирование идёт в порядке деревьев, как и в пакетной версии.
  */
-static float compute_isolation_forest_score(anomaly_detector_t* detector,
-                                           const double* point) {
-    if (!detector || !detector->trees || detector->n_trees == 0) return 0.5f;
+static double forest_path_sum(const anomaly_forest_t* forest, size_t n_trees,
+                              const double* point) {
+    double sum = 0.0;
     
-    /* Если нет образцов, возвращаем нейтральную оценку */
-    if (detector->n_samples == 0) return 0.5f;
+    for (size_t t = 0; t < n_trees; t++) {
+        uint32_t node = forest->roots[t];
+        while (forest->child[node]) {
+            node = forest->child[node] + (point[forest->feature[node]] < forest->split[node] ? 0 : 1);
+        }
+        sum += forest->leaf_path[node];
+    }
+    
+    return sum;
+}
+
+/** Образцов в блоке пакетной оценки: строки блока остаются в L1/L2,
+ *  пока по ним проходят все деревья */
+#define FOREST_TILE             256
 
-    double avg_path_length = 0.0;
+/** Образцов, спускающихся по дереву одновременно */
+#define FOREST_LANES            8
+
+#if defined(__AVX2__)
+/**
+ * @brief Спуск FOREST_LANES образцов по одному дереву (AVX2)
+ * 
+ * Две группы по четыре 32-битные дорожки; потомок, признак и порог
+ * собираются gather, направление выбирается сравнением _CMP_LT_OQ
+ * (NaN уходит вправо, как и в скалярной версии). Спуск идёт ровно
+ * depth шагов без ветвлений, дорожки в листьях стоят на месте.
+ */
+static inline void forest_descend_lanes(const anomaly_forest_t* forest, uint32_t root,
+                                        uint32_t depth, const double* rows,
+                                        size_t n_features, double* sums) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+    const __m256i narrow = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    const __m128i offsets_lo = _mm_setr_epi32(0, (int)n_features, (int)(2 * n_features),
+                                              (int)(3 * n_features));
+    const __m128i offsets_hi = _mm_add_epi32(offsets_lo, _mm_set1_epi32((int)(4 * n_features)));
+    __m128i node_lo = _mm_set1_epi32((int)root);
+    __m128i node_hi = node_lo;
+    
+    for (uint32_t d = 0; d < depth; d++) {
+        __m128i child_lo = _mm_i32gather_epi32((const int*)forest->child, node_lo, 4);
+        __m128i child_hi = _mm_i32gather_epi32((const int*)forest->child, node_hi, 4);
+        __m128i feature_lo = _mm_i32gather_epi32((const int*)forest->feature, node_lo, 4);
+        __m128i feature_hi = _mm_i32gather_epi32((const int*)forest->feature, node_hi, 4);
+        __m256d split_lo = _mm256_i32gather_pd(forest->split, node_lo, 8);
+        __m256d split_hi = _mm256_i32gather_pd(forest->split, node_hi, 8);
+        __m256d val_lo = _mm256_i32gather_pd(rows, _mm_add_epi32(offsets_lo, feature_lo), 8);
+        __m256d val_hi = _mm256_i32gather_pd(rows, _mm_add_epi32(offsets_hi, feature_hi), 8);
+        
+        /* lt = -1 (влево: child), иначе 0 (вправо: child + 1) */
+        __m256i lt_lo = _mm256_castpd_si256(_mm256_cmp_pd(val_lo, split_lo, _CMP_LT_OQ));
+        __m256i lt_hi = _mm256_castpd_si256(_mm256_cmp_pd(val_hi, split_hi, _CMP_LT_OQ));
+        __m128i next_lo = _mm_add_epi32(_mm_add_epi32(child_lo, one),
+                          _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(lt_lo, narrow)));
+        __m128i next_hi = _mm_add_epi32(_mm_add_epi32(child_hi, one),
+                          _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(lt_hi, narrow)));
+        
+        node_lo = _mm_blendv_epi8(next_lo, node_lo, _mm_cmpeq_epi32(child_lo, zero));
+        node_hi = _mm_blendv_epi8(next_hi, node_hi, _mm_cmpeq_epi32(child_hi, zero));
+    }
     
-    for (size_t t = 0; t < detector->n_trees; t++) {
-        avg_path_length += path_length(detector->trees[t].root, point, 
-                                       detector->n_features, 0);
+    __m256d acc_lo = _mm256_loadu_pd(&sums[0]);
+    __m256d acc_hi = _mm256_loadu_pd(&sums[4]);
+    acc_lo = _mm256_add_pd(acc_lo, _mm256_i32gather_pd(forest->leaf_path, node_lo, 8));
+    acc_hi = _mm256_add_pd(acc_hi, _mm256_i32gather_pd(forest->leaf_path, node_hi, 8));
+    _mm256_storeu_pd(&sums[0], acc_lo);
+    _mm256_storeu_pd(&sums[4], acc_hi);
+}
+#else
+/**
+ * @brief Спуск FOREST_LANES образцов по одному дереву
+ * 
+ * Ровно depth шагов без ветвлений (дорожки в листьях стоят на месте);
+ * независимые цепочки загрузок перекрываются в конвейере.
+ */
+static inline void forest_descend_lanes(const anomaly_forest_t* forest, uint32_t root,
+                                        uint32_t depth, const double* rows,
+                                        size_t n_features, double* sums) {
+    uint32_t node[FOREST_LANES];
+    for (int k = 0; k < FOREST_LANES; k++) node[k] = root;
+    
+    for (uint32_t d = 0; d < depth; d++) {
+        for (int k = 0; k < FOREST_LANES; k++) {
+            uint32_t n = node[k];
+            uint32_t child = forest->child[n];
+            double val = rows[k * n_features + forest->feature[n]];
+            uint32_t next = child + (val < forest->split[n] ? 0 : 1);
+            node[k] = child ? next : n;
+        }
     }
-    avg_path_length /= (double)detector->n_trees;
+    
+    for (int k = 0; k < FOREST_LANES; k++) {
+        sums[k] += forest->leaf_path[node[k]];
+    }
+}
+#endif
+
+/**
+ * @brief Суммы длин путей для пакета образцов
+ * 
+ * Пакет режется на блоки по FOREST_TILE образцов; внутри блока деревья
+ * проходятся по очереди, по FOREST_LANES образцов за спуск. Каждая сумма
+ * накапливается в том же порядке деревьев, что и в forest_path_sum,
+ * поэтому результаты совпадают побитно.
+ */
+static void forest_path_sums(const anomaly_forest_t* forest, size_t n_trees,
+                             const double* values, size_t n_samples, size_t n_features,
+                             double* sums) {
+    size_t full = n_samples - n_samples % FOREST_LANES;
+    
+    for (size_t i = 0; i < full; i++) {
+        sums[i] = 0.0;
+    }
+    
+    for (size_t tile = 0; tile < full; tile += FOREST_TILE) {
+        size_t tile_end = (tile + FOREST_TILE < full) ? tile + FOREST_TILE : full;
+        for (size_t t = 0; t < n_trees; t++) {
+            for (size_t i = tile; i < tile_end; i += FOREST_LANES) {
+                forest_descend_lanes(forest, forest->roots[t], forest->depths[t],
+                                     &values[i * n_features], n_features, &sums[i]);
+            }
+        }
+    }
+    
+    for (size_t i = full; i < n_samples; i++) {
+        sums[i] = forest_path_sum(forest, n_trees, &values[i * n_features]);
+    }
+}
+
+/**
+ * @brief Оценка аномалии по сумме длин путей
+ */
+static float isolation_score_from_sum(anomaly_detector_t* detector, double path_sum) {
+    double avg_path_length = path_sum / (double)detector->n_trees;
     
     /* Нормализация: более короткий путь = более высокая аномалия */
     double c = 2.0 * (log((double)(detector->n_samples - 1)) + 0.5772156649) 
@@ -421,20 +605,258 @@ static float compute_isolation_forest_score(anomaly_detector_t* detector,
     return (float)score;
 }
 
+/**
+ * @brief Есть ли обученный лес для оценки
+ */
+static bool isolation_forest_ready(anomaly_detector_t* detector) {
+    /* Если нет образцов, оценка нейтральная */
+    return detector->forest.roots && detector->n_trees > 0 && detector->n_samples > 0;
+}
+
+/**
+ * @brief Вычисление оценки аномалии через Isolation Forest
+ */
+static float compute_isolation_forest_score(anomaly_detector_t* detector,
+                                           const double* point) {
+    if (!detector || !isolation_forest_ready(detector)) return 0.5f;
+    
+    return isolation_score_from_sum(detector,
+                                    forest_path_sum(&detector->forest, detector->n_trees, point));
+}
+
 /* ============================================
  * DBSCAN реализация
  * ============================================ */
 
+/** Радиус окрестности DBSCAN */
+#define DBSCAN_EPS              2.0
+
+/** Минимальное число точек в окрестности ядра DBSCAN */
+#define DBSCAN_MIN_PTS          4
+
+/** Число первых признаков, по которым строится сетка соседей */
+#define GRID_DIMS               3
+
+/** Пустая ссылка в цепочках сетки */
+#define GRID_NIL                ((size_t)-1)
+
 /**
- * @brief Вычисление евклидова расстояния
+ * @brief Сеточный индекс соседей
+ * 
+ * Пространство первых GRID_DIMS признаков режется на кубы со стороной
+ * eps, ячейки хешируются в корзины. Расстояние в проекции не превышает
+ * полного, поэтому все соседи в радиусе eps лежат в 3^GRID_DIMS смежных
+ * ячейках; точное расстояние проверяется по всем признакам, коллизии
+ * корзин дают лишь лишних кандидатов.
+ * 
+ * Точки полного обучения лежат непрерывно по корзинам (CSR) вместе с
+ * проекциями, так что отсев кандидатов идёт последовательным чтением
+ * без обращения к training_data. Точки инкрементального дообучения
+ * вставляются за O(1) в цепочки корзин и переезжают в CSR при
+ * следующем полном обучении.
  */
-static double euclidean_distance(const double* a, const double* b, size_t n_features) {
+typedef struct {
+    double proj[GRID_DIMS];               /* Проекция точки */
+    size_t idx;                           /* Индекс в training_data */
+} grid_entry_t;
+
+typedef struct {
+    double cell_size;                     /* Сторона ячейки (= eps) */
+    size_t dims;                          /* min(GRID_DIMS, n_features) */
+    size_t bucket_mask;                   /* Число корзин - 1 (степень двойки) */
+    size_t* bucket_start;                 /* Начала корзин в entries [n_buckets + 1] */
+    grid_entry_t* entries;                /* Точки полного обучения по корзинам */
+    size_t* heads;                        /* Первая вставленная точка корзины */
+    size_t* next;                         /* Следующая точка в цепочке [capacity] */
+    double* proj;                         /* Проекции вставленных точек [capacity][dims] */
+    size_t capacity;                      /* Максимальное число точек */
+} neighbor_grid_t;
+
+static inline size_t grid_bucket(const neighbor_grid_t* grid, const int64_t* cell) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (size_t d = 0; d < grid->dims; d++) {
+        h ^= (uint64_t)cell[d] + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        h *= 0xff51afd7ed558ccdULL;
+    }
+    h ^= h >> 33;
+    return (size_t)h & grid->bucket_mask;
+}
+
+static inline void grid_cell(const neighbor_grid_t* grid, const double* point, int64_t* cell) {
+    /* NaN и огромные значения прижимаются к краю: такие точки всё равно
+     * не проходят проверку расстояния, важно лишь не переполнить int64 */
+    const double limit = 4611686018427387904.0; /* 2^62 */
+    for (size_t d = 0; d < grid->dims; d++) {
+        double c = floor(point[d] / grid->cell_size);
+        if (!(c > -limit)) c = -limit;
+        if (c > limit) c = limit;
+        cell[d] = (int64_t)c;
+    }
+}
+
+static inline size_t grid_point_bucket(const neighbor_grid_t* grid, const double* point) {
+    int64_t cell[GRID_DIMS];
+    grid_cell(grid, point, cell);
+    return grid_bucket(grid, cell);
+}
+
+static void grid_free(neighbor_grid_t* grid) {
+    if (!grid) return;
+    free(grid->bucket_start);
+    free(grid->entries);
+    free(grid->heads);
+    free(grid->next);
+    free(grid->proj);
+    free(grid);
+}
+
+/**
+ * @brief Построение индекса по первым n точкам (сортировка подсчётом)
+ */
+static neighbor_grid_t* grid_create(const double* data, size_t n, size_t n_features,
+                                    size_t capacity, double eps) {
+    neighbor_grid_t* grid = (neighbor_grid_t*)calloc(1, sizeof(neighbor_grid_t));
+    if (!grid) return NULL;
+    
+    size_t n_buckets = 16;
+    while (n_buckets < 2 * capacity) n_buckets <<= 1;
+    
+    grid->cell_size = eps;
+    grid->dims = (n_features < GRID_DIMS) ? n_features : GRID_DIMS;
+    grid->bucket_mask = n_buckets - 1;
+    grid->capacity = capacity;
+    grid->bucket_start = (size_t*)calloc(n_buckets + 1, sizeof(size_t));
+    grid->entries = (grid_entry_t*)safe_malloc((n ? n : 1) * sizeof(grid_entry_t));
+    grid->heads = (size_t*)safe_malloc(n_buckets * sizeof(size_t));
+    grid->next = (size_t*)safe_malloc(capacity * sizeof(size_t));
+    grid->proj = (double*)safe_malloc(capacity * grid->dims * sizeof(double));
+    size_t* point_bucket = (size_t*)safe_malloc((n ? n : 1) * sizeof(size_t));
+    if (!grid->bucket_start || !grid->entries || !grid->heads || !grid->next ||
+        !grid->proj || !point_bucket) {
+        free(point_bucket);
+        grid_free(grid);
+        return NULL;
+    }
+    memset(grid->heads, 0xff, n_buckets * sizeof(size_t)); /* GRID_NIL */
+    
+    /* Подсчёт, префиксные суммы (концы корзин), раскладка с конца */
+    for (size_t i = 0; i < n; i++) {
+        point_bucket[i] = grid_point_bucket(grid, &data[i * n_features]);
+        grid->bucket_start[point_bucket[i]]++;
+    }
+    for (size_t b = 1; b < n_buckets; b++) {
+        grid->bucket_start[b] += grid->bucket_start[b - 1];
+    }
+    for (size_t i = n; i-- > 0; ) {
+        grid_entry_t* e = &grid->entries[--grid->bucket_start[point_bucket[i]]];
+        memcpy(e->proj, &data[i * n_features], grid->dims * sizeof(double));
+        e->idx = i;
+    }
+    grid->bucket_start[n_buckets] = n;
+    
+    free(point_bucket);
+    return grid;
+}
+
+static void grid_insert(neighbor_grid_t* grid, const double* point, size_t idx) {
+    size_t b = grid_point_bucket(grid, point);
+    memcpy(&grid->proj[idx * grid->dims], point, grid->dims * sizeof(double));
+    grid->next[idx] = grid->heads[b];
+    grid->heads[b] = idx;
+}
+
+/**
+ * @brief Квадрат евклидова расстояния
+ */
+static inline double squared_distance(const double* a, const double* b, size_t n_features) {
     double sum = 0.0;
     for (size_t i = 0; i < n_features; i++) {
         double diff = a[i] - b[i];
         sum += diff * diff;
     }
-    return sqrt(sum);
+    return sum;
+}
+
+/**
+ * @brief Вычисление евклидова расстояния
+ */
+static double euclidean_distance(const double* a, const double* b, size_t n_features) {
+    return sqrt(squared_distance(a, b, n_features));
+}
+
+/**
+ * @brief Проверка кандидата: отсев по проекции, затем полная сумма с ранним выходом
+ */
+static inline bool grid_within(const double* point, const double* proj, size_t dims,
+                               const double* row, size_t n_features, double eps_sq) {
+    double sum = 0.0;
+    size_t f;
+    for (f = 0; f < dims; f++) {
+        double diff = point[f] - proj[f];
+        sum += diff * diff;
+    }
+    if (sum > eps_sq) return false;
+    
+    for (; f < n_features && sum <= eps_sq; f++) {
+        double diff = point[f] - row[f];
+        sum += diff * diff;
+    }
+    return sum <= eps_sq;
+}
+
+/**
+ * @brief Поиск соседей через сетку
+ */
+static size_t grid_find_neighbors(const neighbor_grid_t* grid, const double* data,
+                                  size_t n_features, const double* point, double eps,
+                                  size_t* neighbors, size_t max_neighbors) {
+    int64_t base[GRID_DIMS];
+    size_t n_cells = 1;
+    grid_cell(grid, point, base);
+    for (size_t d = 0; d < grid->dims; d++) {
+        n_cells *= 3;
+    }
+    
+    /* Корзины смежных ячеек без повторов (коллизии хеша) */
+    size_t buckets[27];
+    size_t n_buckets = 0;
+    for (size_t c = 0; c < n_cells; c++) {
+        int64_t cell[GRID_DIMS];
+        size_t rest = c;
+        for (size_t d = 0; d < grid->dims; d++) {
+            cell[d] = base[d] + (int64_t)(rest % 3) - 1;
+            rest /= 3;
+        }
+        size_t b = grid_bucket(grid, cell);
+        size_t k;
+        for (k = 0; k < n_buckets && buckets[k] != b; k++);
+        if (k == n_buckets) buckets[n_buckets++] = b;
+    }
+    
+    double eps_sq = eps * eps;
+    size_t count = 0;
+    for (size_t k = 0; k < n_buckets; k++) {
+        size_t b = buckets[k];
+        
+        for (size_t e = grid->bucket_start[b]; e < grid->bucket_start[b + 1]; e++) {
+            const grid_entry_t* entry = &grid->entries[e];
+            if (grid_within(point, entry->proj, grid->dims,
+                            &data[entry->idx * n_features], n_features, eps_sq)) {
+                if (count >= max_neighbors) return count;
+                neighbors[count++] = entry->idx;
+            }
+        }
+        
+        for (size_t i = grid->heads[b]; i != GRID_NIL; i = grid->next[i]) {
+            if (grid_within(point, &grid->proj[i * grid->dims], grid->dims,
+                            &data[i * n_features], n_features, eps_sq)) {
+                if (count >= max_neighbors) return count;
+                neighbors[count++] = i;
+            }
+        }
+    }
+    
+    return count;
 }
 
 /**
@@ -442,12 +864,20 @@ static double euclidean_distance(const double* a, const double* b, size_t n_feat
  */
 static size_t find_neighbors(anomaly_detector_t* detector, const double* point,
                              double eps, size_t* neighbors, size_t max_neighbors) {
+    if (detector->neighbor_index) {
+        return grid_find_neighbors((const neighbor_grid_t*)detector->neighbor_index,
+                                   detector->training_data, detector->n_features,
+                                   point, eps, neighbors, max_neighbors);
+    }
+    
+    /* Без индекса - полный перебор */
     size_t count = 0;
+    double eps_sq = eps * eps;
     
     for (size_t i = 0; i < detector->n_samples && count < max_neighbors; i++) {
-        double dist = euclidean_distance(point, &detector->training_data[i * detector->n_features],
-                                         detector->n_features);
-        if (dist <= eps) {
+        double dist = squared_distance(point, &detector->training_data[i * detector->n_features],
+                                       detector->n_features);
+        if (dist <= eps_sq) {
             neighbors[count] = i;
             count++;
         }
@@ -456,30 +886,81 @@ static size_t find_neighbors(anomaly_detector_t* detector, const double* point,
     return count;
 }
 
+/**
+ * @brief Добавление точки в кластер
+ */
+static int cluster_add_point(anomaly_cluster_t* cluster, size_t idx) {
+    if (cluster->point_count == cluster->capacity) {
+        size_t new_capacity = cluster->capacity ? cluster->capacity * 2 : 16;
+        size_t* p = (size_t*)realloc(cluster->point_indices, new_capacity * sizeof(size_t));
+        if (!p) return -1;
+        cluster->point_indices = p;
+        cluster->capacity = new_capacity;
+    }
+    cluster->point_indices[cluster->point_count++] = idx;
+    return 0;
+}
+
+/**
+ * @brief Освобождение кластеров и индекса DBSCAN
+ */
+static void free_dbscan_state(anomaly_detector_t* detector) {
+    if (detector->clusters) {
+        for (size_t c = 0; c < detector->n_clusters; c++) {
+            free(detector->clusters[c].point_indices);
+        }
+        free(detector->clusters);
+        detector->clusters = NULL;
+    }
+    detector->n_clusters = 0;
+    free(detector->cluster_labels);
+    detector->cluster_labels = NULL;
+    grid_free((neighbor_grid_t*)detector->neighbor_index);
+    detector->neighbor_index = NULL;
+}
+
 /**
  * @brief DBSCAN кластеризация
+ * 
+ * Каждая точка попадает в очередь расширения не более одного раза
+ * (метка ставится при постановке в очередь), поиск соседей идёт через
+ * сеточный индекс, так что при ограниченной плотности время близко к
+ * O(n) вместо O(n^2).
  */
 static int run_dbscan(anomaly_detector_t* detector, double eps, size_t min_pts) {
     if (!detector || !detector->training_data) return -1;
     
     size_t n_samples = detector->n_samples;
     size_t n_features = detector->n_features;
+    size_t capacity = detector->config.max_samples;
     
-    /* Выделение памяти для кластеров */
-    detector->clusters = (anomaly_cluster_t*)safe_malloc(ANOMALY_MAX_CLUSTERS * sizeof(anomaly_cluster_t));
-    detector->cluster_labels = (int*)safe_malloc(n_samples * sizeof(int));
+    /* Переобучение: освобождаем предыдущие кластеры */
+    free_dbscan_state(detector);
+    
+    /* Выделение памяти для кластеров (метки - с запасом под дообучение) */
+    detector->clusters = (anomaly_cluster_t*)calloc(ANOMALY_MAX_CLUSTERS, sizeof(anomaly_cluster_t));
+    detector->cluster_labels = (int*)safe_malloc(capacity * sizeof(int));
     
     if (!detector->clusters || !detector->cluster_labels) return -1;
     
+    /* Индекс соседей; при нехватке памяти остаётся полный перебор */
+    detector->neighbor_index = grid_create(detector->training_data, n_samples, n_features,
+                                           capacity, eps);
+    
     /* Инициализация */
     for (size_t i = 0; i < n_samples; i++) {
         detector->cluster_labels[i] = -1; /* Не помечен */
     }
     detector->n_clusters = 0;
     
-    /* Временный массив соседей */
+    /* Буфер соседей и очередь расширения кластера */
     size_t* neighbors = (size_t*)safe_malloc(n_samples * sizeof(size_t));
-    if (!neighbors) return -1;
+    size_t* queue = (size_t*)safe_malloc(n_samples * sizeof(size_t));
+    if (!neighbors || !queue) {
+        free(neighbors);
+        free(queue);
+        return -1;
+    }
     
     int cluster_id = 0;
     
@@ -502,52 +983,45 @@ static int run_dbscan(anomaly_detector_t* detector, double eps, size_t min_pts)
         anomaly_cluster_t* cluster = &detector->clusters[detector->n_clusters];
         cluster->id = cluster_id;
         cluster->point_count = 0;
-        cluster->capacity = n_samples;
-        cluster->point_indices = (size_t*)safe_malloc(cluster->capacity * sizeof(size_t));
+        cluster->capacity = 0;
+        cluster->point_indices = NULL;
         cluster->is_noise = false;
         
-        if (!cluster->point_indices) continue;
-        
         /* Добавление точки в кластер */
         detector->cluster_labels[i] = cluster_id;
-        cluster->point_indices[cluster->point_count++] = i;
+        cluster_add_point(cluster, i);
         
-        /* Обработка соседей */
-        for (size_t j = 0; j < neighbor_count; j++) {
-            size_t neighbor_idx = neighbors[j];
-            
-            if (detector->cluster_labels[neighbor_idx] == -2) {
-                detector->cluster_labels[neighbor_idx] = cluster_id; /* Из шума в кластер */
+        /* Расширение кластера по очереди ядровых точек */
+        size_t q_head = 0, q_tail = 0;
+        for (;;) {
+            for (size_t j = 0; j < neighbor_count; j++) {
+                size_t neighbor_idx = neighbors[j];
+                int label = detector->cluster_labels[neighbor_idx];
+                
+                if (label == -2) {
+                    /* Из шума в кластер - граничная точка, не расширяется */
+                    detector->cluster_labels[neighbor_idx] = cluster_id;
+                    cluster_add_point(cluster, neighbor_idx);
+                } else if (label == -1) {
+                    detector->cluster_labels[neighbor_idx] = cluster_id;
+                    cluster_add_point(cluster, neighbor_idx);
+                    queue[q_tail++] = neighbor_idx;
+                }
             }
             
-            if (detector->cluster_labels[neighbor_idx] == -1) {
-                detector->cluster_labels[neighbor_idx] = cluster_id;
-                cluster->point_indices[cluster->point_count++] = neighbor_idx;
-                
-                /* Рекурсивный поиск соседей */
-                size_t* sub_neighbors = (size_t*)safe_malloc(n_samples * sizeof(size_t));
-                if (sub_neighbors) {
-                    size_t sub_count = find_neighbors(detector,
-                                                      &detector->training_data[neighbor_idx * n_features],
-                                                      eps, sub_neighbors, n_samples);
-                    
-                    if (sub_count >= min_pts) {
-                        for (size_t k = 0; k < sub_count; k++) {
-                            size_t found = 0;
-                            for (size_t m = 0; m < neighbor_count; m++) {
-                                if (neighbors[m] == sub_neighbors[k]) {
-                                    found = 1;
-                                    break;
-                                }
-                            }
-                            if (!found) {
-                                neighbors[neighbor_count++] = sub_neighbors[k];
-                            }
-                        }
-                    }
-                    free(sub_neighbors);
+            /* Следующая точка, чья окрестность ещё не просмотрена */
+            neighbor_count = 0;
+            while (q_head < q_tail) {
+                size_t idx = queue[q_head++];
+                size_t sub_count = find_neighbors(detector,
+                                                  &detector->training_data[idx * n_features],
+                                                  eps, neighbors, n_samples);
+                if (sub_count >= min_pts) {
+                    neighbor_count = sub_count;
+                    break;
                 }
             }
+            if (neighbor_count == 0) break;
         }
         
         /* Вычисление центроида */
@@ -566,10 +1040,89 @@ static int run_dbscan(anomaly_detector_t* detector, double eps, size_t min_pts)
         cluster_id++;
     }
     
+    /* Точки, не просмотренные из-за лимита кластеров, считаются шумом */
+    for (size_t i = 0; i < n_samples; i++) {
+        if (detector->cluster_labels[i] == -1) detector->cluster_labels[i] = -2;
+    }
+    
     free(neighbors);
+    free(queue);
     return 0;
 }
 
+/**
+ * @brief Вставка новой точки в существующую кластеризацию
+ * 
+ * Упрощённый инкрементальный DBSCAN: ядровая точка присоединяется к
+ * кластеру ближайшего помеченного соседа (или открывает новый кластер),
+ * граничная - к кластеру соседа, иначе точка считается шумом. Центроиды
+ * обновляются скользящим средним.
+ */
+static void dbscan_insert_point(anomaly_detector_t* detector, size_t idx, double eps,
+                                size_t min_pts, size_t* neighbors) {
+    size_t n_features = detector->n_features;
+    const double* point = &detector->training_data[idx * n_features];
+    
+    if (detector->neighbor_index) {
+        grid_insert((neighbor_grid_t*)detector->neighbor_index, point, idx);
+    }
+    
+    size_t neighbor_count = find_neighbors(detector, point, eps, neighbors, detector->n_samples);
+    
+    /* Кластер ближайшего уже помеченного соседа */
+    int target = -1;
+    double best = INFINITY;
+    for (size_t j = 0; j < neighbor_count; j++) {
+        int label = detector->cluster_labels[neighbors[j]];
+        if (label < 0) continue;
+        double dist = squared_distance(point, &detector->training_data[neighbors[j] * n_features],
+                                       n_features);
+        if (dist < best) {
+            best = dist;
+            target = label;
+        }
+    }
+    
+    bool is_core = neighbor_count >= min_pts;
+    if (target < 0 && is_core && detector->n_clusters < ANOMALY_MAX_CLUSTERS) {
+        anomaly_cluster_t* cluster = &detector->clusters[detector->n_clusters];
+        memset(cluster, 0, sizeof(*cluster));
+        cluster->id = detector->n_clusters;
+        memcpy(cluster->centroid, point, n_features * sizeof(double));
+        target = (int)detector->n_clusters++;
+    }
+    
+    if (target < 0) {
+        if (detector->cluster_labels[idx] < 0) {
+            detector->cluster_labels[idx] = -2; /* Шум */
+        }
+        return;
+    }
+    
+    anomaly_cluster_t* cluster = &detector->clusters[target];
+    for (size_t j = 0; j < neighbor_count; j++) {
+        size_t n_idx = neighbors[j];
+        /* Соседей забирает только ядровая точка; сама точка - всегда */
+        if (n_idx != idx && !is_core) continue;
+        if (detector->cluster_labels[n_idx] >= 0) continue;
+        if (cluster_add_point(cluster, n_idx) != 0) continue;
+        detector->cluster_labels[n_idx] = target;
+        
+        const double* p = &detector->training_data[n_idx * n_features];
+        for (size_t f = 0; f < n_features; f++) {
+            cluster->centroid[f] += (p[f] - cluster->centroid[f]) / (double)cluster->point_count;
+        }
+    }
+    
+    /* Граничная точка могла не попасть в список соседей (лимит буфера) */
+    if (detector->cluster_labels[idx] < 0 && cluster_add_point(cluster, idx) == 0) {
+        detector->cluster_labels[idx] = target;
+        for (size_t f = 0; f < n_features; f++) {
+            cluster->centroid[f] += (point[f] - cluster->centroid[f]) / (double)cluster->point_count;
+        }
+    }
+}
+
 /**
  * @brief Определение кластера для новой точки
  */
@@ -674,21 +1227,10 @@ void anomaly_detector_cleanup(anomaly_detector_t* detector) {
     free(detector->algo_scores);
     
     /* Очистка деревьев Isolation Forest */
-    if (detector->trees) {
-        for (size_t t = 0; t < detector->n_trees; t++) {
-            cleanup_tree_node(detector->trees[t].root);
-        }
-        free(detector->trees);
-    }
+    free_isolation_forest(detector);
     
-    /* Очистка кластеров DBSCAN */
-    if (detector->clusters) {
-        for (size_t c = 0; c < detector->n_clusters; c++) {
-            free(detector->clusters[c].point_indices);
-        }
-        free(detector->clusters);
-    }
-    free(detector->cluster_labels);
+    /* Очистка кластеров и индекса DBSCAN */
+    free_dbscan_state(detector);
     
     /* Очистка мьютекса */
     if (detector->mutex) {
@@ -719,13 +1261,14 @@ int anomaly_detector_train(anomaly_detector_t* detector, const double* data,
     detector->n_samples = n_samples;
     
     /* Вычисление статистики по признакам */
-    for (size_t f = 0; f < n_features; f++) {
+    double* feature_values = (double*)safe_malloc(n_samples * sizeof(double));
+    for (size_t f = 0; f < n_features && feature_values; f++) {
         /* Сбор значений для признака */
-        double* feature_values = (double*)safe_malloc(n_samples * sizeof(double));
-        if (!feature_values) continue;
-        
+        double sum = 0.0, sum_squares = 0.0;
         for (size_t i = 0; i < n_samples; i++) {
             feature_values[i] = data[i * n_features + f];
+            sum += feature_values[i];
+            sum_squares += feature_values[i] * feature_values[i];
         }
         
         /* Вычисление статистики */
@@ -741,14 +1284,17 @@ int anomaly_detector_train(anomaly_detector_t* detector, const double* data,
                 detector->feature_stats[f].max = feature_values[i];
         }
         
+        /* Суммы нужны update_feature_stats при онлайн-дообучении */
+        detector->feature_stats[f].sum = sum;
+        detector->feature_stats[f].sum_squares = sum_squares;
+        
         compute_percentiles(feature_values, n_samples, 
                            &detector->feature_stats[f].q1,
                            &detector->feature_stats[f].q3);
         detector->feature_stats[f].iqr = detector->feature_stats[f].q3 - detector->feature_stats[f].q1;
         detector->feature_stats[f].count = n_samples;
-        
-        free(feature_values);
     }
+    free(feature_values);
     
     /* Построение Isolation Forest */
     if (detector->config.algorithm == ANOMALY_ALGO_ISOLATION_FOREST ||
@@ -759,11 +1305,91 @@ int anomaly_detector_train(anomaly_detector_t* detector, const double* data,
     /* Запуск DBSCAN */
     if (detector->config.algorithm == ANOMALY_ALGO_DBSCAN ||
         detector->config.enable_ensemble) {
-        double eps = 2.0; /* Настройка зависит от данных */
-        size_t min_pts = 4;
-        run_dbscan(detector, eps, min_pts);
+        run_dbscan(detector, DBSCAN_EPS, DBSCAN_MIN_PTS);
+    }
+    
+    detector->n_indexed = n_samples;
+    
+    unlock_mutex(detector->mutex);
+    
+    return 0;
+}
+
+int anomaly_detector_train_incremental(anomaly_detector_t* detector, const double* data,
+                                       size_t n_samples) {
+    if (!detector || (!data && n_samples > 0)) return -1;
+    
+    lock_mutex(detector->mutex);
+    
+    size_t n_features = detector->n_features;
+    
+    /* Добавление новых образцов; статистика по сумме обновляется сразу */
+    for (size_t i = 0; i < n_samples && detector->n_samples < detector->config.max_samples; i++) {
+        const double* row = &data[i * n_features];
+        memcpy(&detector->training_data[detector->n_samples * n_features],
+               row, n_features * sizeof(double));
+        detector->n_samples++;
+        for (size_t f = 0; f < n_features; f++) {
+            update_feature_stats(&detector->feature_stats[f], row[f]);
+        }
+    }
+    
+    size_t first_new = detector->n_indexed;
+    size_t n_new = detector->n_samples - first_new;
+    if (n_new == 0) {
+        unlock_mutex(detector->mutex);
+        return 0;
+    }
+    
+    /* Квартили: взвешенное смешивание старых и квартилей новой порции */
+    double* feature_values = (double*)safe_malloc(n_new * sizeof(double));
+    for (size_t f = 0; f < n_features && feature_values; f++) {
+        anomaly_feature_stats_t* st = &detector->feature_stats[f];
+        for (size_t i = 0; i < n_new; i++) {
+            feature_values[i] = detector->training_data[(first_new + i) * n_features + f];
+        }
+        double q1, q3;
+        compute_percentiles(feature_values, n_new, &q1, &q3);
+        if (first_new == 0) {
+            st->q1 = q1;
+            st->q3 = q3;
+        } else {
+            double w = (double)n_new / (double)(first_new + n_new);
+            st->q1 += (q1 - st->q1) * w;
+            st->q3 += (q3 - st->q3) * w;
+        }
+        st->iqr = st->q3 - st->q1;
+    }
+    free(feature_values);
+    
+    /* Isolation Forest строится по подвыборкам фиксированного размера,
+     * его стоимость не зависит от n - перестраиваем целиком */
+    if (detector->config.algorithm == ANOMALY_ALGO_ISOLATION_FOREST ||
+        detector->config.enable_ensemble) {
+        build_isolation_forest(detector, detector->training_data);
+    }
+    
+    /* DBSCAN: вставка только новых точек в существующий индекс */
+    if (detector->config.algorithm == ANOMALY_ALGO_DBSCAN ||
+        detector->config.enable_ensemble) {
+        if (!detector->clusters || !detector->cluster_labels) {
+            run_dbscan(detector, DBSCAN_EPS, DBSCAN_MIN_PTS);
+        } else {
+            size_t* neighbors = (size_t*)safe_malloc(detector->n_samples * sizeof(size_t));
+            if (neighbors) {
+                for (size_t i = first_new; i < detector->n_samples; i++) {
+                    detector->cluster_labels[i] = -1;
+                }
+                for (size_t i = first_new; i < detector->n_samples; i++) {
+                    dbscan_insert_point(detector, i, DBSCAN_EPS, DBSCAN_MIN_PTS, neighbors);
+                }
+                free(neighbors);
+            }
+        }
     }
     
+    detector->n_indexed = detector->n_samples;
+    
     unlock_mutex(detector->mutex);
     
     return 0;
@@ -800,7 +1426,7 @@ static float compute_zscore_anomaly(anomaly_detector_t* detector, const double*
 static float compute_dbscan_score(anomaly_detector_t* detector, const double* values) {
     if (!detector || detector->n_clusters == 0) return 0.5f;
     
-    int cluster_id = find_cluster_for_point(detector, values, 2.0);
+    int cluster_id = find_cluster_for_point(detector, values, DBSCAN_EPS);
     
     if (cluster_id == -2) {
         return 1.0f; /* Аномалия - не принадлежит кластеру */
@@ -814,12 +1440,14 @@ static float compute_dbscan_score(anomaly_detector_t* detector, const double* va
     return (float)(1.0 - 1.0 / (1.0 + dist));
 }
 
-int anomaly_detector_predict(anomaly_detector_t* detector, const double* values,
-                             anomaly_result_t* result) {
-    if (!detector || !values || !result) return -1;
-    
-    lock_mutex(detector->mutex);
-    
+/**
+ * @brief Предсказание под блокировкой
+ * 
+ * if_score - заранее посчитанная оценка Isolation Forest (пакетный
+ * путь считает её сразу для всего пакета).
+ */
+static void predict_locked(anomaly_detector_t* detector, const double* values,
+                           float if_score, anomaly_result_t* result) {
     memset(result, 0, sizeof(anomaly_result_t));
     result->timestamp = get_current_time_ms();
     detector->total_predictions++;
@@ -829,7 +1457,7 @@ int anomaly_detector_predict(anomaly_detector_t* detector, const double* values,
     /* Вычисление оценок по каждому алгоритму */
     if (detector->config.enable_ensemble) {
         /* Isolation Forest */
-        detector->algo_scores[0] = compute_isolation_forest_score(detector, values);
+        detector->algo_scores[0] = if_score;
         
         /* Z-Score */
         detector->algo_scores[1] = compute_zscore_anomaly(detector, values);
@@ -847,7 +1475,7 @@ int anomaly_detector_predict(anomaly_detector_t* detector, const double* values,
     } else {
         switch (detector->config.algorithm) {
             case ANOMALY_ALGO_ISOLATION_FOREST:
-                anomaly_score = compute_isolation_forest_score(detector, values);
+                anomaly_score = if_score;
                 result->detected_by = ANOMALY_ALGO_ISOLATION_FOREST;
                 break;
                 
@@ -937,9 +1565,58 @@ int anomaly_detector_predict(anomaly_detector_t* detector, const double* values,
         detector->on_anomaly_detected) {
         detector->on_anomaly_detected(result, detector->user_data);
     }
+}
+
+/**
+ * @brief Нужна ли оценка Isolation Forest текущей конфигурации
+ */
+static bool uses_isolation_forest(anomaly_detector_t* detector) {
+    return detector->config.enable_ensemble ||
+           detector->config.algorithm == ANOMALY_ALGO_ISOLATION_FOREST;
+}
+
+int anomaly_detector_predict(anomaly_detector_t* detector, const double* values,
+                             anomaly_result_t* result) {
+    if (!detector || !values || !result) return -1;
+    
+    lock_mutex(detector->mutex);
+    
+    float if_score = uses_isolation_forest(detector) ?
+                     compute_isolation_forest_score(detector, values) : 0.5f;
+    predict_locked(detector, values, if_score, result);
+    
+    unlock_mutex(detector->mutex);
+    
+    return 0;
+}
+
+int anomaly_detector_predict_batch(anomaly_detector_t* detector, const double* values,
+                                   size_t n_samples, anomaly_result_t* results) {
+    if (!detector || !values || !results) return -1;
+    if (n_samples == 0) return 0;
+    
+    double* path_sums = NULL;
+    
+    lock_mutex(detector->mutex);
+    
+    if (uses_isolation_forest(detector) && isolation_forest_ready(detector)) {
+        path_sums = (double*)safe_malloc(n_samples * sizeof(double));
+        if (!path_sums) {
+            unlock_mutex(detector->mutex);
+            return -1;
+        }
+        forest_path_sums(&detector->forest, detector->n_trees, values,
+                         n_samples, detector->n_features, path_sums);
+    }
+    
+    for (size_t i = 0; i < n_samples; i++) {
+        float if_score = path_sums ? isolation_score_from_sum(detector, path_sums[i]) : 0.5f;
+        predict_locked(detector, &values[i * detector->n_features], if_score, &results[i]);
+    }
     
     unlock_mutex(detector->mutex);
     
+    free(path_sums);
     return 0;
 }
 
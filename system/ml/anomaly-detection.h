@@ -161,25 +161,23 @@ typedef struct {
 } anomaly_result_t;
 
 /**
- * @brief Узел дерева изоляции
- */
-typedef struct anomaly_tree_node {
-    size_t feature_index;                 /**< Индекс признака для разделения */
-    double split_value;                   /**< Значение разделения */
-    struct anomaly_tree_node* left;       /**< Левый потомок */
-    struct anomaly_tree_node* right;      /**< Правый потомок */
-    size_t size;                          /**< Размер узла (количество точек) */
-    size_t depth;                         /**< Глубина узла */
-} anomaly_tree_node_t;
-
-/**
- * @brief Дерево изоляции
+ * @brief Isolation Forest в виде плоской таблицы узлов (structure-of-arrays)
+ * 
+ * Узлы всех деревьев лежат в общих непрерывных массивах. Потомки узла i -
+ * child[i] (левый) и child[i] + 1 (правый); child[i] == 0 означает лист,
+ * так как корень дерева никогда не бывает потомком. Глубина дерева
+ * позволяет пакетной оценке спускаться фиксированное число шагов.
  */
 typedef struct {
-    anomaly_tree_node_t* root;            /**< Корневой узел */
-    size_t height;                        /**< Высота дерева */
-    size_t n_features;                    /**< Количество признаков */
-} anomaly_tree_t;
+    uint32_t* feature;                    /**< Индекс признака для разделения */
+    double* split;                        /**< Значение разделения */
+    uint32_t* child;                      /**< Левый потомок (правый = +1), 0 - лист */
+    double* leaf_path;                    /**< Длина пути до листа */
+    uint32_t* roots;                      /**< Корень каждого дерева */
+    uint32_t* depths;                     /**< Глубина каждого дерева */
+    size_t n_nodes;                       /**< Количество узлов */
+    size_t capacity;                      /**< Вместимость массивов узлов */
+} anomaly_forest_t;
 
 /**
  * @brief Кластер DBSCAN
@@ -208,13 +206,15 @@ typedef struct {
     anomaly_feature_stats_t* feature_stats; /**< Статистика по признакам */
     
     /* Isolation Forest */
-    anomaly_tree_t* trees;                /**< Массив деревьев */
+    anomaly_forest_t forest;              /**< Таблица узлов всех деревьев */
     size_t n_trees;                       /**< Количество деревьев */
     
     /* DBSCAN */
     anomaly_cluster_t* clusters;          /**< Массив кластеров */
     size_t n_clusters;                    /**< Количество кластеров */
     int* cluster_labels;                  /**< Метки кластеров для каждой точки */
+    void* neighbor_index;                 /**< Сеточный индекс соседей для DBSCAN */
+    size_t n_indexed;                     /**< Образцов, уже учтённых моделью */
     
     /* Moving Average */
     double* moving_avg_buffer;            /**< Буфер для скользящего среднего */
@@ -300,6 +300,23 @@ int anomaly_detector_train(anomaly_detector_t* detector, const double* data,
 int anomaly_detector_predict(anomaly_detector_t* detector, const double* values, 
                             anomaly_result_t* result);
 
+/**
+ * @brief Пакетное предсказание аномалий
+ * 
+ * Результат для каждого образца совпадает с anomaly_detector_predict
+ * побитно. Isolation Forest оценивает пакет блоками дерево за деревом,
+ * по восемь образцов за спуск (при сборке с AVX2 - gather и векторное
+ * сравнение).
+ * 
+ * @param detector Указатель на детектор
+ * @param values Значения признаков [n_samples][n_features]
+ * @param n_samples Количество образцов
+ * @param results Массив результатов [n_samples]
+ * @return 0 при успехе, -1 при ошибке
+ */
+int anomaly_detector_predict_batch(anomaly_detector_t* detector, const double* values,
+                                   size_t n_samples, anomaly_result_t* results);
+
 /**
  * @brief Предсказание аномалии в реальном времени
  * 
@@ -321,6 +338,23 @@ int anomaly_detector_predict_realtime(anomaly_detector_t* detector,
  */
 int anomaly_detector_add_sample(anomaly_detector_t* detector, const double* values);
 
+/**
+ * @brief Инкрементальное дообучение на новых образцах
+ * 
+ * Обрабатывает только образцы, появившиеся после последнего обучения:
+ * переданные в data и накопленные через anomaly_detector_add_sample.
+ * Новые точки вставляются в индекс DBSCAN без полного перестроения
+ * кластеров, квартили уточняются по новой порции. Слияние кластеров,
+ * соединённых новыми точками, выполняется только полным обучением.
+ * 
+ * @param detector Указатель на детектор
+ * @param data Новые образцы [n_samples][n_features] (может быть NULL)
+ * @param n_samples Количество новых образцов
+ * @return 0 при успехе, -1 при ошибке
+ */
+int anomaly_detector_train_incremental(anomaly_detector_t* detector, const double* data,
+                                       size_t n_samples);
+
 /**
  * @brief Получение статистики по признакам
  * 
@@ -5,6 +5,18 @@
 
 #include "numa-allocator.h"
 
+#ifdef __linux__
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#endif
+
 // Глобальный контекст NUMA
 static numa_context_t g_numa_ctx = {0};
 
@@ -30,8 +42,10 @@ int numa_init(numa_context_t *ctx) {
     ctx->stats.total_nodes = 1;  // По умолчанию один узел
     
     // Проверка наличия NUMA
-    ctx->numa_available = 0;  // В реальной реализации проверить через libnuma
-    ctx->max_nodes = 1;
+    ctx->max_nodes = numa_get_node_count();
+    ctx->numa_available = ctx->max_nodes > 1;
+    ctx->stats.total_nodes = ctx->max_nodes;
+    ctx->stats.current_node = numa_get_current_node();
     
     // Копирование в глобальный контекст
     g_numa_ctx = *ctx;
@@ -53,10 +67,10 @@ int numa_init_with_config(numa_context_t *ctx, const numa_config_t *config) {
     ctx->stats.remote_allocations = 0;
     ctx->stats.allocation_failures = 0;
     ctx->stats.memory_migrations = 0;
-    ctx->stats.current_node = 0;
-    ctx->stats.total_nodes = 1;
-    ctx->numa_available = 0;
-    ctx->max_nodes = 1;
+    ctx->max_nodes = numa_get_node_count();
+    ctx->numa_available = ctx->max_nodes > 1;
+    ctx->stats.total_nodes = ctx->max_nodes;
+    ctx->stats.current_node = numa_get_current_node();
     
     // Копирование в глобальный контекст
     g_numa_ctx = *ctx;
@@ -140,14 +154,18 @@ void numa_free(void *ptr, size_t size) {
     // free(ptr);
 }
 
-// Привязка памяти к конкретному узлу NUMA
+// Привязка памяти к конкретному узлу NUMA (предпочтительный узел, без libnuma)
 int numa_bind_memory_to_node(void *ptr, size_t size, int node_id) {
-    if (!ptr || node_id < 0) {
+    if (!ptr || node_id < 0 || node_id >= 64) {
         return -1;
     }
     
-    // В реальной реализации здесь будет вызов mbind() или аналогичной функции
-    // В целях совместимости с MTProxy возвращаем успешный результат
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long mask = 1UL << node_id;
+    if (syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, &mask, 64, 0) < 0) {
+        return -1;
+    }
+#endif
     return 0;
 }
 
@@ -163,12 +181,43 @@ int numa_move_memory_to_node(void *ptr, size_t size, int target_node) {
     return 0;
 }
 
-// Получение текущего узла NUMA
+// Получение текущего узла NUMA (узел процессора, на котором сейчас поток)
 int numa_get_current_node(void) {
-    // В реальной реализации здесь будет вызов numa_node_of_cpu() или аналогичной функции
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) {
+        return (int) node;
+    }
+#endif
     return 0;  // Возвращаем узел 0 по умолчанию
 }
 
+// Количество узлов NUMA: по /sys/devices/system/node, без libnuma
+int numa_get_node_count(void) {
+    static int node_count;
+    if (node_count > 0) {
+        return node_count;
+    }
+    int count = 0;
+#ifdef __linux__
+    DIR *d = opendir("/sys/devices/system/node");
+    if (d) {
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL) {
+            if (!strncmp(e->d_name, "node", 4) && e->d_name[4] >= '0' && e->d_name[4] <= '9') {
+                int id = atoi(e->d_name + 4);
+                if (id + 1 > count) {
+                    count = id + 1;
+                }
+            }
+        }
+        closedir(d);
+    }
+#endif
+    node_count = count > 0 ? count : 1;
+    return node_count;
+}
+
 // Получение узла NUMA для конкретного адреса
 int numa_get_node_for_address(void *ptr) {
     if (!ptr) {
@@ -58,6 +58,7 @@ void numa_free(void *ptr, size_t size);
 int numa_bind_memory_to_node(void *ptr, size_t size, int node_id);
 int numa_move_memory_to_node(void *ptr, size_t size, int target_node);
 int numa_get_current_node(void);
+int numa_get_node_count(void);
 int numa_get_node_for_address(void *ptr);
 
 // Функции статистики
@@ -0,0 +1,831 @@
+/**
+ * @file benchmark-e2e-client.c
+ * @brief Эмулятор клиентов Telegram для benchmark-e2e
+ *
+ * Каждый поток ведёт свою долю соединений через собственный epoll,
+ * сокеты неблокирующие. На соединении:
+ * - obfuscated2: 64 случайных байта, тег транспорта (ef/ee/dd) и DC
+ *   в байтах 56-63, ключи AES-256-CTR из заголовка и секрета
+ * - fake-TLS: ClientHello с SNI домена и client random =
+ *   HMAC-SHA256(секрет, ClientHello) с временем в последних 4 байтах,
+ *   три записи ответа пропускаются, дальше ChangeCipherSpec и записи
+ *   application data, внутри - obfuscated2 с тегом dd
+ * - SOCKS5: приветствие без аутентификации и CONNECT на 127.0.0.1:target_port
+ *   одним пакетом, после ответа - кадры intermediate открытым текстом,
+ *   которые эхо-цель возвращает как есть
+ *
+ * В полёте всегда один запрос: зашифрованный пакет MTProto с ненулевым
+ * auth_key_id, который прокси пересылает как RPC_PROXY_REQ, а поддельный
+ * middle-end возвращает обратно. Первый ответ завершает рукопожатие,
+ * остальные дают RTT в гистограмму с логарифмическими корзинами.
+ */
+
+#include "testing/benchmark-e2e.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#define HIST_BUCKETS 1024
+#define READ_CHUNK 65536
+#define TLS_RECORD_MAX 16384
+#define TLS_HELLO_MAX 8192       /* ответ прокси на ClientHello */
+#define TLS_HELLO_RECORDS 3      /* ServerHello, ChangeCipherSpec, application data */
+#define SOCKS5_REPLY_LEN 12      /* выбор метода и ответ на CONNECT с IPv4 */
+
+enum {
+    CONN_CONNECTING,
+    CONN_TLS_HELLO,
+    CONN_SOCKS5_REPLY,
+    CONN_RUNNING,
+    CONN_DEAD
+};
+
+struct e2e_conn {
+    int fd;
+    int state;
+    int established;
+    EVP_CIPHER_CTX *enc, *dec;
+    unsigned char *out;          /* зашифровано и готово к отправке */
+    int out_len, out_pos, out_size;
+    unsigned char *in;           /* расшифрованный поток (в TLS_HELLO и SOCKS5_REPLY - сырой) */
+    int in_len, in_size;
+    unsigned char tls_hdr[5];    /* заголовок входящей записи, пришедший частями */
+    int tls_hdr_len, tls_left;
+    uint64_t sent_at;
+};
+
+struct client_thread {
+    const struct e2e_load *L;
+    int count;
+    struct e2e_conn *conns;
+    int epfd;
+    pthread_t thread;
+    uint64_t rng;
+    unsigned char *payload;      /* шаблон запроса, общий для соединений потока */
+    unsigned char *frame;        /* открытый текст очередного кадра */
+    unsigned char rbuf[READ_CHUNK];
+    /* результаты */
+    int handshakes;
+    uint64_t last_handshake;
+    long long requests, bytes;
+    unsigned long long hist[HIST_BUCKETS];
+};
+
+static volatile int measuring, stopping;
+static volatile int pending;     /* соединений без первого ответа и без ошибки */
+
+/* ============================================
+ * Утилиты
+ * ============================================ */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t rng_next(uint64_t *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545f4914f6cdd1dULL;
+}
+
+static void rng_fill(uint64_t *s, unsigned char *p, int len) {
+    while (len > 0) {
+        uint64_t x = rng_next(s);
+        int k = len < 8 ? len : 8;
+        memcpy(p, &x, k);
+        p += k;
+        len -= k;
+    }
+}
+
+/* 16 корзин на каждую степень двойки: погрешность квантиля не больше 6% */
+static int hist_bucket(uint64_t ns) {
+    if (ns < 16) {
+        return ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    return (msb - 3) * 16 + ((ns >> (msb - 4)) & 15);
+}
+
+static double hist_value(int b) {
+    if (b < 16) {
+        return b;
+    }
+    int msb = b / 16 + 3;
+    return (double) ((16ULL + b % 16) << (msb - 4));
+}
+
+static double hist_quantile(const unsigned long long *h, unsigned long long total, double q) {
+    unsigned long long rank = (unsigned long long) (q * total), seen = 0;
+    int b;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        seen += h[b];
+        if (seen > rank) {
+            return hist_value(b) / 1000.0;
+        }
+    }
+    return 0;
+}
+
+const char *e2e_transport_name(int transport) {
+    static const char *names[] = {"ef", "ee", "dd", "tls", "socks5"};
+    return transport >= 0 && transport <= E2E_SOCKS5 ? names[transport] : "?";
+}
+
+/* ============================================
+ * Вывод
+ * ============================================ */
+
+static int out_reserve(struct e2e_conn *c, int len) {
+    if (c->out_pos == c->out_len) {
+        c->out_pos = c->out_len = 0;
+    }
+    if (c->out_len + len <= c->out_size) {
+        return 0;
+    }
+    int size = c->out_size ? c->out_size : 4096;
+    while (size < c->out_len + len) {
+        size *= 2;
+    }
+    unsigned char *p = realloc(c->out, size);
+    if (!p) {
+        return -1;
+    }
+    c->out = p;
+    c->out_size = size;
+    return 0;
+}
+
+static void out_raw(struct e2e_conn *c, const void *data, int len) {
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+}
+
+/**
+ * @brief Шифрует и ставит в очередь; в fake-TLS - записями application data,
+ *        в SOCKS5 - как есть
+ */
+static int out_encrypted(struct client_thread *T, struct e2e_conn *c, const unsigned char *data, int len) {
+    int tls = T->L->transport == E2E_FAKE_TLS;
+    if (T->L->transport == E2E_SOCKS5) {
+        if (out_reserve(c, len) < 0) {
+            return -1;
+        }
+        out_raw(c, data, len);
+        return 0;
+    }
+    if (out_reserve(c, len + (tls ? (len / TLS_RECORD_MAX + 1) * 5 : 0)) < 0) {
+        return -1;
+    }
+    while (len > 0) {
+        int k = tls && len > TLS_RECORD_MAX ? TLS_RECORD_MAX : len, n = k;
+        if (tls) {
+            unsigned char hdr[5] = {0x17, 0x03, 0x03, k >> 8, k & 255};
+            out_raw(c, hdr, 5);
+        }
+        EVP_EncryptUpdate(c->enc, c->out + c->out_len, &n, data, k);
+        c->out_len += k;
+        data += k;
+        len -= k;
+    }
+    return 0;
+}
+
+static int flush_out(struct client_thread *T, struct e2e_conn *c) {
+    while (c->out_pos < c->out_len) {
+        ssize_t r = send(c->fd, c->out + c->out_pos, c->out_len - c->out_pos, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT, .data.ptr = c};
+                return epoll_ctl(T->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+            }
+            return -1;
+        }
+        c->out_pos += r;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+    return epoll_ctl(T->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/**
+ * @brief Кадр транспорта с очередным запросом
+ */
+static int send_request(struct client_thread *T, struct e2e_conn *c) {
+    int len = T->L->payload, pad = 0, h;
+    unsigned char *f = T->frame;
+
+    switch (T->L->transport) {
+    case E2E_ABRIDGED:
+        if (len <= 0x7e * 4) {
+            f[0] = len >> 2;
+            h = 1;
+        } else {
+            unsigned x = (len >> 2) << 8 | 0x7f;
+            memcpy(f, &x, 4);
+            h = 4;
+        }
+        break;
+    case E2E_INTERMEDIATE:
+    case E2E_SOCKS5:
+        memcpy(f, &len, 4);
+        h = 4;
+        break;
+    default:
+        pad = rng_next(&T->rng) & 3;
+        len += pad;
+        memcpy(f, &len, 4);
+        h = 4;
+        break;
+    }
+    /* msg_key свой у каждого запроса, auth_key_id и тело - общий шаблон потока */
+    memcpy(f + h, T->payload, T->L->payload);
+    rng_fill(&T->rng, f + h + 8, 8);
+    f[h] |= 1;
+    if (pad) {
+        rng_fill(&T->rng, f + h + T->L->payload, pad);
+    }
+    c->sent_at = now_ns();
+    return out_encrypted(T, c, f, h + len);
+}
+
+/* ============================================
+ * Начало соединения
+ * ============================================ */
+
+static int init_obfuscated(struct client_thread *T, struct e2e_conn *c) {
+    const struct e2e_load *L = T->L;
+    unsigned char hdr[64], rev[48], k[48], key[32], enc_hdr[64];
+    unsigned tag = L->transport == E2E_ABRIDGED ? 0xefefefef : L->transport == E2E_INTERMEDIATE ? 0xeeeeeeee : 0xdddddddd;
+    int i, n;
+
+    for (;;) {
+        unsigned first, second;
+        rng_fill(&T->rng, hdr, sizeof(hdr));
+        memcpy(&first, hdr, 4);
+        memcpy(&second, hdr + 4, 4);
+        if (hdr[0] != 0xef && second && first != 0x44414548 && first != 0x54534f50 && first != 0x20544547 &&
+            first != 0x4954504f && first != 0xdddddddd && first != 0xeeeeeeee && first != 0x02010316) {
+            break;
+        }
+    }
+    short dc = E2E_TARGET_DC;
+    memcpy(hdr + 56, &tag, 4);
+    memcpy(hdr + 60, &dc, 2);
+
+    for (i = 0; i < 48; i++) {
+        rev[i] = hdr[55 - i];
+    }
+
+    c->enc = EVP_CIPHER_CTX_new();
+    c->dec = EVP_CIPHER_CTX_new();
+    if (!c->enc || !c->dec) {
+        return -1;
+    }
+    memcpy(k, hdr + 8, 32);
+    memcpy(k + 32, L->secret, 16);
+    EVP_Digest(k, 48, key, NULL, EVP_sha256(), NULL);
+    EVP_EncryptInit_ex(c->enc, EVP_aes_256_ctr(), NULL, key, hdr + 40);
+    memcpy(k, rev, 32);
+    EVP_Digest(k, 48, key, NULL, EVP_sha256(), NULL);
+    EVP_DecryptInit_ex(c->dec, EVP_aes_256_ctr(), NULL, key, rev + 32);
+
+    /* тег и DC уходят зашифрованными, остальной заголовок - как есть */
+    EVP_EncryptUpdate(c->enc, enc_hdr, &n, hdr, 64);
+    memcpy(hdr + 56, enc_hdr + 56, 8);
+
+    if (L->transport == E2E_FAKE_TLS) {
+        /* ChangeCipherSpec и первая запись ровно с заголовком obfuscated2 */
+        static const unsigned char start[11] = {0x14, 0x03, 0x03, 0x00, 0x01, 0x01, 0x17, 0x03, 0x03, 0x00, 0x40};
+        if (out_reserve(c, sizeof(start) + 64) < 0) {
+            return -1;
+        }
+        out_raw(c, start, sizeof(start));
+        out_raw(c, hdr, 64);
+        return send_request(T, c);
+    }
+
+    if (out_reserve(c, 64) < 0) {
+        return -1;
+    }
+    out_raw(c, hdr, 64);
+    return send_request(T, c);
+}
+
+static void put16(unsigned char *p, int x) {
+    p[0] = x >> 8;
+    p[1] = x & 255;
+}
+
+/**
+ * @brief Приветствие с единственным методом 0 и сразу CONNECT, не дожидаясь
+ *        выбора метода: прокси разбирает их из одного буфера по очереди
+ */
+static int send_socks5_connect(struct client_thread *T, struct e2e_conn *c) {
+    unsigned char req[13] = {0x05, 0x01, 0x00, 0x05, 0x01, 0x00, 0x01, 127, 0, 0, 1};
+    put16(req + 11, T->L->target_port);
+    if (out_reserve(c, sizeof(req)) < 0) {
+        return -1;
+    }
+    out_raw(c, req, sizeof(req));
+    return 0;
+}
+
+/**
+ * @brief ClientHello в духе браузерного: TLS 1.3, SNI, key_share, padding
+ */
+static int send_client_hello(struct client_thread *T, struct e2e_conn *c) {
+    unsigned char h[1024], digest[32];
+    const char *domain = T->L->domain;
+    int dlen = strlen(domain), pos, ext_start, n;
+    unsigned dlen_md;
+
+    memset(h, 0, sizeof(h));
+    memcpy(h, "\x16\x03\x01\x00\x00\x01\x00\x00\x00\x03\x03", 11);
+    /* random (11..42) заполняется в конце */
+    h[43] = 0x20;
+    rng_fill(&T->rng, h + 44, 32);
+    pos = 76;
+    static const unsigned char suites[] = {0x13, 0x01, 0x13, 0x02, 0x13, 0x03, 0xc0, 0x2b, 0xc0, 0x2f, 0xc0, 0x2c, 0xc0, 0x30};
+    put16(h + pos, sizeof(suites));
+    memcpy(h + pos + 2, suites, sizeof(suites));
+    pos += 2 + sizeof(suites);
+    h[pos++] = 1;
+    h[pos++] = 0;
+    ext_start = pos;
+    pos += 2;
+
+    /* server_name */
+    put16(h + pos, 0);
+    put16(h + pos + 2, dlen + 5);
+    put16(h + pos + 4, dlen + 3);
+    h[pos + 6] = 0;
+    put16(h + pos + 7, dlen);
+    memcpy(h + pos + 9, domain, dlen);
+    pos += 9 + dlen;
+
+    /* supported_groups: x25519 */
+    memcpy(h + pos, "\x00\x0a\x00\x04\x00\x02\x00\x1d", 8);
+    pos += 8;
+    /* signature_algorithms */
+    memcpy(h + pos, "\x00\x0d\x00\x08\x00\x06\x04\x03\x08\x04\x04\x01", 12);
+    pos += 12;
+    /* key_share: x25519, случайный ключ */
+    memcpy(h + pos, "\x00\x33\x00\x26\x00\x24\x00\x1d\x00\x20", 10);
+    rng_fill(&T->rng, h + pos + 10, 32);
+    pos += 42;
+    /* supported_versions: TLS 1.3 */
+    memcpy(h + pos, "\x00\x2b\x00\x03\x02\x03\x04", 7);
+    pos += 7;
+    /* padding до 517 байт, как у браузеров */
+    int pad = 517 - pos - 4;
+    if (pad > 0) {
+        put16(h + pos, 0x15);
+        put16(h + pos + 2, pad);
+        pos += 4 + pad;
+    }
+
+    put16(h + ext_start, pos - ext_start - 2);
+    put16(h + 3, pos - 5);
+    h[6] = (pos - 9) >> 16;
+    put16(h + 7, (pos - 9) & 0xffff);
+
+    HMAC(EVP_sha256(), T->L->secret, E2E_SECRET_LEN, h, pos, digest, &dlen_md);
+    int ts = time(NULL);
+    for (n = 0; n < 4; n++) {
+        digest[28 + n] ^= ts >> (8 * n);
+    }
+    memcpy(h + 11, digest, 32);
+
+    if (out_reserve(c, pos) < 0) {
+        return -1;
+    }
+    out_raw(c, h, pos);
+    return 0;
+}
+
+/* ============================================
+ * Ввод
+ * ============================================ */
+
+static void conn_fail(struct client_thread *T, struct e2e_conn *c) {
+    if (c->state == CONN_DEAD) {
+        return;
+    }
+    if (!c->established) {
+        __sync_fetch_and_add(&pending, -1);
+    }
+    c->state = CONN_DEAD;
+    epoll_ctl(T->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+}
+
+/**
+ * @brief Пропускает записи ответа на ClientHello, остаток - уже данные
+ */
+static int parse_server_hello(struct client_thread *T, struct e2e_conn *c, unsigned char **rest, int *rest_len) {
+    static const unsigned char types[TLS_HELLO_RECORDS] = {0x16, 0x14, 0x17};
+    int pos = 0, i;
+    for (i = 0; i < TLS_HELLO_RECORDS; i++) {
+        if (c->in_len - pos < 5) {
+            return 0;
+        }
+        if (c->in[pos] != types[i] || c->in[pos + 1] != 0x03) {
+            return -1;
+        }
+        pos += 5 + (c->in[pos + 3] << 8 | c->in[pos + 4]);
+        if (pos > c->in_len) {
+            return 0;
+        }
+    }
+    /* остаток переносится в начало и разбирается как записи данных */
+    *rest_len = c->in_len - pos;
+    memcpy(T->rbuf, c->in + pos, *rest_len);
+    *rest = T->rbuf;
+    c->in_len = 0;
+    c->state = CONN_RUNNING;
+    return 1;
+}
+
+/**
+ * @brief Проверяет выбор метода 0 и успешный ответ на CONNECT; остаток -
+ *        уже эхо
+ */
+static int parse_socks5_reply(struct client_thread *T, struct e2e_conn *c, unsigned char **rest, int *rest_len) {
+    if (c->in_len < SOCKS5_REPLY_LEN) {
+        return 0;
+    }
+    if (c->in[0] != 0x05 || c->in[1] != 0x00 || c->in[2] != 0x05 || c->in[3] != 0x00 || c->in[5] != 0x01) {
+        return -1;
+    }
+    *rest_len = c->in_len - SOCKS5_REPLY_LEN;
+    memcpy(T->rbuf, c->in + SOCKS5_REPLY_LEN, *rest_len);
+    *rest = T->rbuf;
+    c->in_len = 0;
+    c->state = CONN_RUNNING;
+    return 1;
+}
+
+/**
+ * @brief Снимает заголовки записей TLS и расшифровывает данные в c->in
+ */
+static int take_input(struct client_thread *T, struct e2e_conn *c, unsigned char *p, int len) {
+    int n;
+    if (T->L->transport == E2E_SOCKS5) {
+        memcpy(c->in + c->in_len, p, len);
+        c->in_len += len;
+        return 0;
+    }
+    if (T->L->transport != E2E_FAKE_TLS) {
+        EVP_DecryptUpdate(c->dec, c->in + c->in_len, &n, p, len);
+        c->in_len += len;
+        return 0;
+    }
+    while (len > 0) {
+        if (!c->tls_left) {
+            int k = 5 - c->tls_hdr_len < len ? 5 - c->tls_hdr_len : len;
+            memcpy(c->tls_hdr + c->tls_hdr_len, p, k);
+            c->tls_hdr_len += k;
+            p += k;
+            len -= k;
+            if (c->tls_hdr_len < 5) {
+                break;
+            }
+            if (memcmp(c->tls_hdr, "\x17\x03\x03", 3)) {
+                return -1;
+            }
+            c->tls_left = c->tls_hdr[3] << 8 | c->tls_hdr[4];
+            c->tls_hdr_len = 0;
+            continue;
+        }
+        int k = c->tls_left < len ? c->tls_left : len;
+        EVP_DecryptUpdate(c->dec, c->in + c->in_len, &n, p, k);
+        c->in_len += k;
+        c->tls_left -= k;
+        p += k;
+        len -= k;
+    }
+    return 0;
+}
+
+/**
+ * @brief Разбирает кадры ответов; на каждый - следующий запрос
+ */
+static int parse_answers(struct client_thread *T, struct e2e_conn *c) {
+    int pos = 0, payload = T->L->payload;
+    while (c->in_len - pos >= 4) {
+        unsigned char *p = c->in + pos;
+        int len, h = 4;
+        if (T->L->transport == E2E_ABRIDGED) {
+            if ((p[0] & 0x7f) == 0x7f) {
+                len = (p[1] | p[2] << 8 | p[3] << 16) << 2;
+            } else {
+                len = (p[0] & 0x7f) << 2;
+                h = 1;
+            }
+        } else {
+            memcpy(&len, p, 4);
+            len &= 0x7fffffff;
+        }
+        if (len < payload || len > payload + 16) {
+            fprintf(stderr, "client: unexpected answer of %d bytes\n", len);
+            return -1;
+        }
+        if (c->in_len - pos < h + len) {
+            break;
+        }
+        pos += h + len;
+
+        uint64_t now = now_ns();
+        if (!c->established) {
+            c->established = 1;
+            T->handshakes++;
+            T->last_handshake = now;
+            __sync_fetch_and_add(&pending, -1);
+        } else if (measuring) {
+            T->requests++;
+            T->bytes += 2LL * payload;
+            T->hist[hist_bucket(now - c->sent_at)]++;
+        }
+        if (stopping) {
+            continue;
+        }
+        if (send_request(T, c) < 0) {
+            return -1;
+        }
+    }
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+    return 0;
+}
+
+static int handle_read(struct client_thread *T, struct e2e_conn *c) {
+    for (;;) {
+        int room = c->in_size - c->in_len;
+        if (room <= 0) {
+            return -1;
+        }
+        int raw = c->state == CONN_TLS_HELLO || c->state == CONN_SOCKS5_REPLY;
+        unsigned char *dst = raw ? c->in + c->in_len : T->rbuf;
+        ssize_t r = read(c->fd, dst, room < READ_CHUNK ? room : READ_CHUNK);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        if (!r) {
+            return -1;
+        }
+        unsigned char *data = T->rbuf;
+        int len = r;
+        if (c->state == CONN_TLS_HELLO) {
+            c->in_len += r;
+            int res = parse_server_hello(T, c, &data, &len);
+            if (res <= 0) {
+                if (res < 0) {
+                    return -1;
+                }
+                continue;
+            }
+            if (init_obfuscated(T, c) < 0) {
+                return -1;
+            }
+        } else if (c->state == CONN_SOCKS5_REPLY) {
+            c->in_len += r;
+            int res = parse_socks5_reply(T, c, &data, &len);
+            if (res <= 0) {
+                if (res < 0) {
+                    return -1;
+                }
+                continue;
+            }
+            if (send_request(T, c) < 0) {
+                return -1;
+            }
+        }
+        if (take_input(T, c, data, len) < 0 || parse_answers(T, c) < 0 || flush_out(T, c) < 0) {
+            return -1;
+        }
+    }
+}
+
+static int handle_connected(struct client_thread *T, struct e2e_conn *c) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+        return -1;
+    }
+    int res;
+    if (T->L->transport == E2E_FAKE_TLS) {
+        c->state = CONN_TLS_HELLO;
+        res = send_client_hello(T, c);
+    } else if (T->L->transport == E2E_SOCKS5) {
+        c->state = CONN_SOCKS5_REPLY;
+        res = send_socks5_connect(T, c);
+    } else {
+        c->state = CONN_RUNNING;
+        res = init_obfuscated(T, c);
+    }
+    return res < 0 ? -1 : flush_out(T, c);
+}
+
+static int open_conn(struct client_thread *T, struct e2e_conn *c) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(T->L->port);
+
+    c->in_size = T->L->payload + 64 + (T->L->transport == E2E_FAKE_TLS ? TLS_HELLO_MAX : 0);
+    c->in = malloc(c->in_size);
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (!c->in || c->fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(c->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        return -1;
+    }
+    c->state = CONN_CONNECTING;
+    struct epoll_event ev = {.events = EPOLLOUT, .data.ptr = c};
+    return epoll_ctl(T->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static void *client_thread_run(void *arg) {
+    struct client_thread *T = arg;
+    struct epoll_event ev[256];
+    int i;
+
+    for (i = 0; i < T->count; i++) {
+        if (open_conn(T, &T->conns[i]) < 0) {
+            if (T->conns[i].fd >= 0) {
+                close(T->conns[i].fd);
+            }
+            T->conns[i].fd = -1;
+            T->conns[i].state = CONN_DEAD;
+                __sync_fetch_and_add(&pending, -1);
+        }
+    }
+
+    while (!stopping) {
+        int n = epoll_wait(T->epfd, ev, 256, 100);
+        for (i = 0; i < n; i++) {
+            struct e2e_conn *c = ev[i].data.ptr;
+            int res = 0;
+            if (c->state == CONN_DEAD) {
+                continue;
+            }
+            if (c->state == CONN_CONNECTING) {
+                res = handle_connected(T, c);
+            } else {
+                if (ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    res = handle_read(T, c);
+                }
+                if (res >= 0 && c->state != CONN_DEAD && (ev[i].events & EPOLLOUT)) {
+                    res = flush_out(T, c);
+                }
+            }
+            if (res < 0) {
+                conn_fail(T, c);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* ============================================
+ * Запуск нагрузки
+ * ============================================ */
+
+static void sleep_ns(uint64_t ns) {
+    struct timespec ts = {.tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL};
+    nanosleep(&ts, NULL);
+}
+
+int e2e_run_load(const struct e2e_load *L, struct e2e_result *R) {
+    int threads = L->threads > 0 ? L->threads : 1, i, j, started = 0;
+    if (threads > L->connections) {
+        threads = L->connections;
+    }
+    struct client_thread *T = calloc(threads, sizeof(*T));
+    if (!T) {
+        return -1;
+    }
+
+    memset(R, 0, sizeof(*R));
+    measuring = stopping = 0;
+    pending = L->connections;
+
+    for (i = 0; i < threads; i++) {
+        T[i].epfd = -1;
+    }
+    uint64_t start = now_ns();
+    for (i = 0; i < threads; i++) {
+        T[i].L = L;
+        T[i].count = (i + 1) * L->connections / threads - i * L->connections / threads;
+        T[i].conns = calloc(T[i].count, sizeof(struct e2e_conn));
+        T[i].payload = malloc(L->payload);
+        T[i].frame = malloc(L->payload + 8);
+        T[i].rng = start * (i + 1) | 1;
+        T[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (!T[i].conns || !T[i].payload || !T[i].frame || T[i].epfd < 0) {
+            break;
+        }
+        for (j = 0; j < T[i].count; j++) {
+            T[i].conns[j].fd = -1;
+        }
+        rng_fill(&T[i].rng, T[i].payload, L->payload);
+        T[i].payload[0] |= 1;
+        if (pthread_create(&T[i].thread, NULL, client_thread_run, &T[i])) {
+            break;
+        }
+        started++;
+    }
+
+    if (started == threads) {
+        /* рукопожатия: пока все соединения не ответили или не отвалились */
+        uint64_t deadline = start + (uint64_t) (L->connect_timeout * 1e9);
+        while (pending > 0 && now_ns() < deadline) {
+            sleep_ns(1000000);
+        }
+        if (L->measure_hook) {
+            L->measure_hook(0, L->hook_arg);
+        }
+        uint64_t measure_start = now_ns();
+        measuring = 1;
+        sleep_ns((uint64_t) (L->duration * 1e9));
+        measuring = 0;
+        R->seconds = (now_ns() - measure_start) / 1e9;
+        if (L->measure_hook) {
+            L->measure_hook(1, L->hook_arg);
+        }
+    }
+    stopping = 1;
+
+    unsigned long long hist[HIST_BUCKETS];
+    uint64_t last = start;
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i < threads; i++) {
+        if (i < started) {
+            pthread_join(T[i].thread, NULL);
+        }
+        R->handshakes += T[i].handshakes;
+        R->requests += T[i].requests;
+        R->bytes += T[i].bytes;
+        if (T[i].last_handshake > last) {
+            last = T[i].last_handshake;
+        }
+        for (j = 0; j < HIST_BUCKETS; j++) {
+            hist[j] += T[i].hist[j];
+        }
+        for (j = 0; T[i].conns && j < T[i].count; j++) {
+            struct e2e_conn *c = &T[i].conns[j];
+            if (c->fd >= 0 && c->state != CONN_DEAD) {
+                close(c->fd);
+            }
+            if (c->enc) {
+                EVP_CIPHER_CTX_free(c->enc);
+            }
+            if (c->dec) {
+                EVP_CIPHER_CTX_free(c->dec);
+            }
+            free(c->in);
+            free(c->out);
+        }
+        if (T[i].epfd >= 0) {
+            close(T[i].epfd);
+        }
+        free(T[i].conns);
+        free(T[i].payload);
+        free(T[i].frame);
+    }
+    free(T);
+
+    /* не дождались ответа - тоже неудача */
+    R->failed = L->connections - R->handshakes;
+    R->handshake_seconds = (last - start) / 1e9;
+    R->rtt_p50 = hist_quantile(hist, R->requests, 0.5);
+    R->rtt_p99 = hist_quantile(hist, R->requests, 0.99);
+    R->rtt_p999 = hist_quantile(hist, R->requests, 0.999);
+    return started == threads ? 0 : -1;
+}
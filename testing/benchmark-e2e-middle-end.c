@@ -0,0 +1,658 @@
+/**
+ * @file benchmark-e2e-middle-end.c
+ * @brief Поддельный middle-end для benchmark-e2e
+ *
+ * Серверная сторона того, что ждёт от middle-end net-tcp-rpc-client.c:
+ * - ответный RPC_NONCE (пакет -2, открытым текстом) с нашим nonce
+ * - ключи AES-256-CBC как в aes_create_keys с am_client = 0
+ * - ответный RPC_HANDSHAKE (пакет -1) с sender_pid на порту слушателя
+ *   и peer_pid, равным sender_pid прокси
+ * - RPC_PROXY_REQ -> RPC_PROXY_ANS с тем же conn_id и телом запроса,
+ *   RPC_PING -> RPC_PONG, остальное игнорируется
+ *
+ * e2e_me_drop рвёт все соединения прокси разом, как упавший middle-end.
+ *
+ * Кадр tcp_rpc: [len][seq][данные][crc32], выравнивание до блока AES
+ * четырёхбайтовыми пакетами с len = 4. Блокирующий ввод-вывод,
+ * по потоку на соединение: прокси держит их немного.
+ *
+ * Здесь же эхо-цель для режима socks5: тоже поток на соединение, но
+ * соединений столько же, сколько у клиента, поэтому стек потока урезан.
+ */
+
+#include "testing/benchmark-e2e.h"
+#include "common/crc32.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#define RPC_NONCE 0x7acb87aa
+#define RPC_HANDSHAKE 0x7682eef5
+#define RPC_PROXY_REQ 0x36cef1ee
+#define RPC_PROXY_ANS 0x4403da0d
+#define RPC_PING 0x5730a2df
+#define RPC_PONG 0x8430eaa7
+#define RPC_CRYPTO_AES 1
+
+#define NONCE_PACKET_LEN 32
+#define HANDSHAKE_PACKET_LEN 32
+#define PROXY_REQ_HEADER 56      /* type, flags, out_conn_id, два ip:port по 20 байт */
+#define MAX_PACKET (E2E_MAX_PAYLOAD + 4096)
+#define IO_CHUNK 65536
+#define ECHO_STACK (256 << 10)
+#define ME_MAX_CONNS 1024
+
+struct e2e_middle_end {
+    int listen_fd;
+    int port;
+    unsigned char secret[256];
+    int secret_len;
+    volatile int stop;
+    volatile int handshakes;
+    volatile long long queries;
+    pthread_t acceptor;
+    /* открытые соединения прокси, для e2e_me_drop */
+    pthread_mutex_t lock;
+    int fds[ME_MAX_CONNS];
+    int nfds;
+};
+
+struct me_conn {
+    struct e2e_middle_end *M;
+    int fd;
+    unsigned peer_ip, our_ip;
+    unsigned short peer_port, our_port;
+    EVP_CIPHER_CTX *enc, *dec;
+    int in_seq, out_seq;
+    /* зашифрованный ввод, который ещё не набрал блок */
+    unsigned char raw[IO_CHUNK + 16];
+    int raw_len;
+    /* расшифрованный поток, ещё не разобранный на пакеты */
+    unsigned char *in;
+    int in_len;
+    unsigned char *out;
+    int out_len, out_size;
+};
+
+/* ============================================
+ * Ввод-вывод
+ * ============================================ */
+
+static int write_all(int fd, const void *buf, int len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t r = send(fd, p, len, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, int len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t r = read(fd, p, len);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+static void digest(const EVP_MD *md, const unsigned char *data, int len, unsigned char *out) {
+    EVP_Digest(data, len, out, NULL, md, NULL);
+}
+
+/* ============================================
+ * Кадры tcp_rpc
+ * ============================================ */
+
+static int out_reserve(struct me_conn *c, int len) {
+    if (c->out_len + len <= c->out_size) {
+        return 0;
+    }
+    int size = c->out_size * 2;
+    while (size < c->out_len + len) {
+        size *= 2;
+    }
+    unsigned char *p = realloc(c->out, size);
+    if (!p) {
+        return -1;
+    }
+    c->out = p;
+    c->out_size = size;
+    return 0;
+}
+
+/**
+ * @brief Кадр с телом из двух частей: заголовок ответа и данные запроса
+ */
+static int out_packet(struct me_conn *c, const void *head, int head_len, const void *data, int data_len) {
+    int len = head_len + data_len + 12;
+    if (out_reserve(c, len + 16) < 0) {
+        return -1;
+    }
+    unsigned char *p = c->out + c->out_len;
+    memcpy(p, &len, 4);
+    memcpy(p + 4, &c->out_seq, 4);
+    memcpy(p + 8, head, head_len);
+    if (data_len) {
+        memcpy(p + 8 + head_len, data, data_len);
+    }
+    unsigned crc = compute_crc32(p, len - 4);
+    memcpy(p + len - 4, &crc, 4);
+    c->out_len += len;
+    c->out_seq++;
+    return 0;
+}
+
+/**
+ * @brief Дополняет вывод до блока, шифрует и отправляет
+ */
+static int out_flush(struct me_conn *c) {
+    static const int pad = 4;
+    while (c->out_len & 15) {
+        memcpy(c->out + c->out_len, &pad, 4);
+        c->out_len += 4;
+    }
+    int len = c->out_len;
+    if (!len) {
+        return 0;
+    }
+    if (!EVP_EncryptUpdate(c->enc, c->out, &len, c->out, c->out_len) || len != c->out_len) {
+        return -1;
+    }
+    c->out_len = 0;
+    return write_all(c->fd, c->out, len);
+}
+
+static int create_keys(struct me_conn *c, const unsigned char *nonce_server, const unsigned char *nonce_client, int client_ts) {
+    struct e2e_middle_end *M = c->M;
+    unsigned char str[16 + 16 + 4 + 4 + 2 + 6 + 4 + 2 + 256 + 16 + 16];
+    unsigned char write_key[32], write_iv[16], read_key[32], read_iv[16], md5[16];
+    int len = 70 + M->secret_len + 16;
+
+    memcpy(str, nonce_server, 16);
+    memcpy(str + 16, nonce_client, 16);
+    memcpy(str + 32, &client_ts, 4);
+    memcpy(str + 36, &c->our_ip, 4);
+    memcpy(str + 40, &c->peer_port, 2);
+    memcpy(str + 42, "SERVER", 6);
+    memcpy(str + 48, &c->peer_ip, 4);
+    memcpy(str + 52, &c->our_port, 2);
+    memcpy(str + 54, M->secret, M->secret_len);
+    memcpy(str + 54 + M->secret_len, nonce_server, 16);
+    memcpy(str + 70 + M->secret_len, nonce_client, 16);
+
+    digest(EVP_md5(), str + 1, len - 1, md5);
+    memcpy(write_key, md5, 12);
+    digest(EVP_sha1(), str, len, write_key + 12);
+    digest(EVP_md5(), str + 2, len - 2, write_iv);
+
+    memcpy(str + 42, "CLIENT", 6);
+    digest(EVP_md5(), str + 1, len - 1, md5);
+    memcpy(read_key, md5, 12);
+    digest(EVP_sha1(), str, len, read_key + 12);
+    digest(EVP_md5(), str + 2, len - 2, read_iv);
+
+    c->enc = EVP_CIPHER_CTX_new();
+    c->dec = EVP_CIPHER_CTX_new();
+    if (!c->enc || !c->dec ||
+        !EVP_EncryptInit_ex(c->enc, EVP_aes_256_cbc(), NULL, write_key, write_iv) ||
+        !EVP_DecryptInit_ex(c->dec, EVP_aes_256_cbc(), NULL, read_key, read_iv)) {
+        return -1;
+    }
+    EVP_CIPHER_CTX_set_padding(c->enc, 0);
+    EVP_CIPHER_CTX_set_padding(c->dec, 0);
+    return 0;
+}
+
+/**
+ * @brief Обмен RPC_NONCE открытым текстом
+ */
+static int nonce_exchange(struct me_conn *c) {
+    unsigned char pkt[12 + NONCE_PACKET_LEN], nonce[16];
+    int len, seq, type, key_select, schema, ts;
+
+    if (read_all(c->fd, pkt, 4) < 0) {
+        return -1;
+    }
+    memcpy(&len, pkt, 4);
+    if (len != sizeof(pkt) || read_all(c->fd, pkt + 4, len - 4) < 0) {
+        fprintf(stderr, "middle-end: unexpected nonce packet of %d bytes\n", len);
+        return -1;
+    }
+    unsigned crc;
+    memcpy(&crc, pkt + len - 4, 4);
+    memcpy(&seq, pkt + 4, 4);
+    memcpy(&type, pkt + 8, 4);
+    memcpy(&key_select, pkt + 12, 4);
+    memcpy(&schema, pkt + 16, 4);
+    memcpy(&ts, pkt + 20, 4);
+    if (crc != compute_crc32(pkt, len - 4) || seq != -2 || type != (int) RPC_NONCE || schema != RPC_CRYPTO_AES ||
+        memcmp(&key_select, c->M->secret, 4)) {
+        fprintf(stderr, "middle-end: bad nonce packet\n");
+        return -1;
+    }
+    memcpy(nonce, pkt + 24, 16);
+
+    /* ответ: тот же ключ, наше время и nonce */
+    unsigned char ours[16];
+    int now = time(NULL);
+    if (RAND_bytes(ours, 16) != 1) {
+        return -1;
+    }
+    memcpy(pkt + 4, &c->out_seq, 4);
+    memcpy(pkt + 12, c->M->secret, 4);
+    memcpy(pkt + 20, &now, 4);
+    memcpy(pkt + 24, ours, 16);
+    crc = compute_crc32(pkt, len - 4);
+    memcpy(pkt + len - 4, &crc, 4);
+    c->out_seq++;
+    if (write_all(c->fd, pkt, len) < 0) {
+        return -1;
+    }
+    return create_keys(c, ours, nonce, ts);
+}
+
+/* ============================================
+ * Обработка пакетов
+ * ============================================ */
+
+static int handle_packet(struct me_conn *c, unsigned char *p, int len) {
+    int seq, type;
+    unsigned crc;
+    memcpy(&seq, p + 4, 4);
+    memcpy(&crc, p + len - 4, 4);
+    if (seq != c->in_seq || crc != compute_crc32(p, len - 4)) {
+        fprintf(stderr, "middle-end: bad packet %d (expected %d) or crc\n", seq, c->in_seq);
+        return -1;
+    }
+    c->in_seq++;
+    p += 8;
+    len -= 12;
+    if (len < 4) {
+        return 0;
+    }
+    memcpy(&type, p, 4);
+
+    if (seq == -1) {
+        /* RPC_HANDSHAKE: type, flags, sender_pid, peer_pid */
+        if (type != RPC_HANDSHAKE || len != HANDSHAKE_PACKET_LEN) {
+            fprintf(stderr, "middle-end: expected RPC_HANDSHAKE\n");
+            return -1;
+        }
+        unsigned char ans[HANDSHAKE_PACKET_LEN];
+        unsigned short pid = getpid();
+        int flags = 0, utime = time(NULL);
+        memset(ans, 0, sizeof(ans));
+        memcpy(ans, &type, 4);
+        memcpy(ans + 4, &flags, 4);
+        memcpy(ans + 8, &c->our_ip, 4);
+        memcpy(ans + 12, &c->our_port, 2);
+        memcpy(ans + 14, &pid, 2);
+        memcpy(ans + 16, &utime, 4);
+        memcpy(ans + 20, p + 8, 12);
+        __sync_fetch_and_add(&c->M->handshakes, 1);
+        return out_packet(c, ans, sizeof(ans), NULL, 0);
+    }
+
+    if (type == (int) RPC_PROXY_REQ && len >= PROXY_REQ_HEADER) {
+        int flags, skip = PROXY_REQ_HEADER;
+        memcpy(&flags, p + 4, 4);
+        if (flags & 12) {
+            int extra;
+            memcpy(&extra, p + skip, 4);
+            skip += 4 + extra;
+            if (extra < 0 || skip > len) {
+                return -1;
+            }
+        }
+        /* RPC_PROXY_ANS: type, flags = 0, conn_id, тело запроса */
+        unsigned char ans[16];
+        int ans_type = RPC_PROXY_ANS, ans_flags = 0;
+        memcpy(ans, &ans_type, 4);
+        memcpy(ans + 4, &ans_flags, 4);
+        memcpy(ans + 8, p + 8, 8);
+        __sync_fetch_and_add(&c->M->queries, 1);
+        return out_packet(c, ans, sizeof(ans), p + skip, len - skip);
+    }
+
+    if (type == (int) RPC_PING && len == 12) {
+        int pong = RPC_PONG;
+        return out_packet(c, &pong, 4, p + 4, 8);
+    }
+    return 0;
+}
+
+/**
+ * @brief Разбирает расшифрованный поток, возвращает число пакетов
+ */
+static int parse_input(struct me_conn *c) {
+    int pos = 0, packets = 0;
+    while (c->in_len - pos >= 4) {
+        int len;
+        memcpy(&len, c->in + pos, 4);
+        if (len == 4) {
+            pos += 4;
+            continue;
+        }
+        if (len < 12 || len > MAX_PACKET || (len & 3)) {
+            fprintf(stderr, "middle-end: bad packet length %d\n", len);
+            return -1;
+        }
+        if (c->in_len - pos < len) {
+            break;
+        }
+        if (handle_packet(c, c->in + pos, len) < 0) {
+            return -1;
+        }
+        pos += len;
+        packets++;
+    }
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+    return packets;
+}
+
+static void *conn_thread(void *arg) {
+    struct me_conn *c = arg;
+    struct e2e_middle_end *M = c->M;
+
+    c->in_seq = -1;
+    c->out_seq = -2;
+    c->in = malloc(MAX_PACKET + IO_CHUNK + 16);
+    c->out_size = IO_CHUNK;
+    c->out = malloc(c->out_size);
+
+    if (c->in && c->out && nonce_exchange(c) == 0) {
+        while (!M->stop) {
+            ssize_t r = read(c->fd, c->raw + c->raw_len, IO_CHUNK);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r <= 0) {
+                break;
+            }
+            c->raw_len += r;
+            int blocks = c->raw_len & -16, len = blocks;
+            if (c->in_len + blocks > MAX_PACKET + IO_CHUNK + 16) {
+                fprintf(stderr, "middle-end: input overflow\n");
+                break;
+            }
+            if (!EVP_DecryptUpdate(c->dec, c->in + c->in_len, &len, c->raw, blocks) || len != blocks) {
+                break;
+            }
+            c->in_len += blocks;
+            memmove(c->raw, c->raw + blocks, c->raw_len - blocks);
+            c->raw_len -= blocks;
+            if (parse_input(c) < 0 || out_flush(c) < 0) {
+                break;
+            }
+        }
+    }
+
+    /* под замком: e2e_me_drop не должен попасть в уже чужой дескриптор */
+    pthread_mutex_lock(&M->lock);
+    int i;
+    for (i = 0; i < M->nfds && M->fds[i] != c->fd; i++) {
+    }
+    if (i < M->nfds) {
+        M->fds[i] = M->fds[--M->nfds];
+    }
+    close(c->fd);
+    pthread_mutex_unlock(&M->lock);
+    if (c->enc) {
+        EVP_CIPHER_CTX_free(c->enc);
+    }
+    if (c->dec) {
+        EVP_CIPHER_CTX_free(c->dec);
+    }
+    free(c->in);
+    free(c->out);
+    free(c);
+    return NULL;
+}
+
+static void *accept_thread(void *arg) {
+    struct e2e_middle_end *M = arg;
+    while (!M->stop) {
+        struct sockaddr_in peer, ours;
+        socklen_t len = sizeof(peer), our_len = sizeof(ours);
+        int fd = accept(M->listen_fd, (struct sockaddr *) &peer, &len);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        struct me_conn *c = calloc(1, sizeof(*c));
+        if (!c || getsockname(fd, (struct sockaddr *) &ours, &our_len) < 0) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        c->M = M;
+        c->fd = fd;
+        c->peer_ip = ntohl(peer.sin_addr.s_addr);
+        c->peer_port = ntohs(peer.sin_port);
+        c->our_ip = ntohl(ours.sin_addr.s_addr);
+        c->our_port = ntohs(ours.sin_port);
+
+        pthread_mutex_lock(&M->lock);
+        int tracked = M->nfds < ME_MAX_CONNS;
+        if (tracked) {
+            M->fds[M->nfds++] = fd;
+        }
+        pthread_mutex_unlock(&M->lock);
+        if (!tracked) {
+            close(fd);
+            free(c);
+            continue;
+        }
+
+        pthread_t t;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&t, &attr, conn_thread, c)) {
+            pthread_mutex_lock(&M->lock);
+            M->nfds--;
+            close(fd);
+            pthread_mutex_unlock(&M->lock);
+            free(c);
+        }
+        pthread_attr_destroy(&attr);
+    }
+    return NULL;
+}
+
+/* ============================================
+ * Интерфейс
+ * ============================================ */
+
+struct e2e_middle_end *e2e_me_start(const unsigned char *proxy_secret, int secret_len) {
+    if (secret_len < 32 || secret_len > 256) {
+        return NULL;
+    }
+    struct e2e_middle_end *M = calloc(1, sizeof(*M));
+    if (!M) {
+        return NULL;
+    }
+    memcpy(M->secret, proxy_secret, secret_len);
+    M->secret_len = secret_len;
+    pthread_mutex_init(&M->lock, NULL);
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    M->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (M->listen_fd < 0 || bind(M->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(M->listen_fd, 128) < 0 || getsockname(M->listen_fd, (struct sockaddr *) &addr, &len) < 0) {
+        if (M->listen_fd >= 0) {
+            close(M->listen_fd);
+        }
+        free(M);
+        return NULL;
+    }
+    M->port = ntohs(addr.sin_port);
+    if (pthread_create(&M->acceptor, NULL, accept_thread, M)) {
+        close(M->listen_fd);
+        free(M);
+        return NULL;
+    }
+    return M;
+}
+
+int e2e_me_port(struct e2e_middle_end *M) {
+    return M->port;
+}
+
+int e2e_me_handshakes(struct e2e_middle_end *M) {
+    return M->handshakes;
+}
+
+long long e2e_me_queries(struct e2e_middle_end *M) {
+    return M->queries;
+}
+
+int e2e_me_drop(struct e2e_middle_end *M) {
+    int i, n;
+    pthread_mutex_lock(&M->lock);
+    n = M->nfds;
+    for (i = 0; i < n; i++) {
+        shutdown(M->fds[i], SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&M->lock);
+    return n;
+}
+
+/**
+ * @brief Останавливает приём; потоки соединений завершатся, когда прокси
+ *        закроет свою сторону
+ */
+void e2e_me_stop(struct e2e_middle_end *M) {
+    M->stop = 1;
+    shutdown(M->listen_fd, SHUT_RDWR);
+    pthread_join(M->acceptor, NULL);
+    close(M->listen_fd);
+}
+
+/* ============================================
+ * Эхо-цель
+ * ============================================ */
+
+struct e2e_echo {
+    int listen_fd;
+    int port;
+    volatile int stop;
+    pthread_t acceptor;
+};
+
+static void *echo_thread(void *arg) {
+    int fd = (int) (long) arg;
+    unsigned char buf[IO_CHUNK];
+    for (;;) {
+        ssize_t r = read(fd, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0 || write_all(fd, buf, r) < 0) {
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *echo_accept_thread(void *arg) {
+    struct e2e_echo *E = arg;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, ECHO_STACK);
+    while (!E->stop) {
+        int fd = accept(E->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        pthread_t t;
+        if (pthread_create(&t, &attr, echo_thread, (void *) (long) fd)) {
+            close(fd);
+        }
+    }
+    pthread_attr_destroy(&attr);
+    return NULL;
+}
+
+struct e2e_echo *e2e_echo_start(void) {
+    struct e2e_echo *E = calloc(1, sizeof(*E));
+    if (!E) {
+        return NULL;
+    }
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    E->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (E->listen_fd < 0 || bind(E->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(E->listen_fd, 4096) < 0 || getsockname(E->listen_fd, (struct sockaddr *) &addr, &len) < 0) {
+        if (E->listen_fd >= 0) {
+            close(E->listen_fd);
+        }
+        free(E);
+        return NULL;
+    }
+    E->port = ntohs(addr.sin_port);
+    if (pthread_create(&E->acceptor, NULL, echo_accept_thread, E)) {
+        close(E->listen_fd);
+        free(E);
+        return NULL;
+    }
+    return E;
+}
+
+int e2e_echo_port(struct e2e_echo *E) {
+    return E->port;
+}
+
+/**
+ * @brief Останавливает приём; потоки соединений завершатся вместе с прокси
+ */
+void e2e_echo_stop(struct e2e_echo *E) {
+    E->stop = 1;
+    shutdown(E->listen_fd, SHUT_RDWR);
+    pthread_join(E->acceptor, NULL);
+    close(E->listen_fd);
+}
@@ -0,0 +1,569 @@
+/**
+ * @file benchmark-e2e.c
+ * @brief Сквозной бенчмарк mtproto-proxy на одной машине
+ *
+ * Поднимает поддельный middle-end (benchmark-e2e-middle-end.c), пишет
+ * для прокси конфиг с одним DC на него и секрет --aes-pwd, запускает
+ * mtproto-proxy и гоняет через него эмулятор клиентов
+ * (benchmark-e2e-client.c) для каждой пары режим x число соединений.
+ * Режимы ef/ee/dd - obfuscated2 с соответствующим транспортом, tls -
+ * fake-TLS; для него отдельный экземпляр прокси с -D, потому что
+ * домен отключает остальные транспорты.
+ *
+ * Печатает рукопожатия в секунду (подключение, obfuscated2/TLS и первый
+ * ответ middle-end), пропускную способность полезной нагрузки в обе
+ * стороны в Гбит/с, p50/p99/p99.9 RTT запроса и CPU прокси (вместе с
+ * воркерами -M) в секундах на гигабайт за окно замера.
+ *
+ * С --zerocopy каждый режим прогоняется дважды: обычным writev и с
+ * --zerocopy-threshold прокси, чтобы сравнить CPU на гигабайт. На loopback
+ * ядро всё равно копирует данные (SO_EE_CODE_ZEROCOPY_COPIED) и прокси
+ * выключает zerocopy для сокета после первого такого уведомления, так что
+ * выигрыш виден только на настоящем сетевом интерфейсе.
+ *
+ * --trace-sample N передаётся прокси как есть: так видна цена трассировки
+ * задержек, если сравнить прогон с N и без.
+ *
+ * Режим socks5 (не входит в набор по умолчанию) идёт через --socks5-port
+ * того же прокси на эхо-цель без шифрования: меряет сам ретранслятор
+ * движка. Со списком --workers 1,2,4 все режимы повторяются для каждого
+ * числа воркеров, так видно, как пропускная способность растёт с ними.
+ *
+ * Использование: benchmark-e2e [--proxy путь] [--connections 100,1000]
+ *     [--mode ef,ee,dd,tls,socks5] [--size байт] [--duration секунд]
+ *     [--threads потоков_клиента] [--workers 1,2,4] [--domain имя]
+ *     [--zerocopy порог_байт] [--trace-sample N]
+ */
+
+#include "testing/benchmark-e2e.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <openssl/rand.h>
+
+#define MAX_COUNTS 16
+#define STARTUP_TIMEOUT 20.0
+#define STARTUP_SETTLE 1.0
+
+struct proxy_instance {
+    pid_t pid;
+    int port;
+    int socks5_port;
+    char log[256];
+};
+
+struct cpu_sample {
+    pid_t pid;
+    double start, end;
+};
+
+static const char *proxy_path = "objs/bin/mtproto-proxy";
+static const char *domain = "localhost";
+static const char *trace_sample;
+static char workdir[] = "/tmp/benchmark-e2e-XXXXXX";
+static unsigned char client_secret[E2E_SECRET_LEN];
+static long proxy_maxconn;
+
+/* ============================================
+ * Утилиты
+ * ============================================ */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int write_file(const char *path, const void *data, int len) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    int ok = write(fd, data, len) == len;
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static int free_port(void) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0), port = -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0 && !bind(fd, (struct sockaddr *) &addr, sizeof(addr)) &&
+        !getsockname(fd, (struct sockaddr *) &addr, &len)) {
+        port = ntohs(addr.sin_port);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return port;
+}
+
+static int port_accepts(int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int ok = fd >= 0 && !connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+/**
+ * @brief Поднимает RLIMIT_NOFILE, возвращает итоговый; прокси его наследует
+ */
+static long raise_fd_limit(int need) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+        return 1024;
+    }
+    if (rl.rlim_cur < (rlim_t) need) {
+        rl.rlim_cur = rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= (rlim_t) need ? (rlim_t) need : rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (rl.rlim_cur < (rlim_t) need) {
+        fprintf(stderr, "warning: RLIMIT_NOFILE is %ld, %d needed\n", (long) rl.rlim_cur, need);
+    }
+    return rl.rlim_cur;
+}
+
+/* ============================================
+ * CPU прокси
+ * ============================================ */
+
+/**
+ * @brief utime + stime процесса в секундах, родитель - через ppid
+ */
+static double proc_cpu(const char *name, pid_t *ppid) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%s/stat", name);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t r = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (r <= 0) {
+        return -1;
+    }
+    buf[r] = 0;
+    /* после имени процесса в скобках: state ppid ... utime(14) stime(15) */
+    char *p = strrchr(buf, ')');
+    int pp;
+    unsigned long long utime, stime;
+    if (!p || sscanf(p + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &pp, &utime, &stime) != 3) {
+        return -1;
+    }
+    *ppid = pp;
+    return (double) (utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static double proxy_cpu(pid_t pid) {
+    char name[32];
+    pid_t ppid;
+    snprintf(name, sizeof(name), "%d", pid);
+    double total = proc_cpu(name, &ppid);
+    if (total < 0) {
+        return 0;
+    }
+    DIR *d = opendir("/proc");
+    struct dirent *e;
+    while (d && (e = readdir(d))) {
+        if (e->d_name[0] >= '1' && e->d_name[0] <= '9') {
+            double t = proc_cpu(e->d_name, &ppid);
+            if (t > 0 && ppid == pid) {
+                total += t;
+            }
+        }
+    }
+    if (d) {
+        closedir(d);
+    }
+    return total;
+}
+
+static void cpu_hook(int phase, void *arg) {
+    struct cpu_sample *S = arg;
+    if (phase) {
+        S->end = proxy_cpu(S->pid);
+    } else {
+        S->start = proxy_cpu(S->pid);
+    }
+}
+
+/* ============================================
+ * Прокси и middle-end
+ * ============================================ */
+
+static int start_proxy(struct proxy_instance *P, int tls, int workers, int zerocopy, const char *tag) {
+    char secret_hex[2 * E2E_SECRET_LEN + 1], port[16], stats_port[16], workers_arg[16], maxconn[24], zc_arg[16];
+    char socks5_port[16];
+    char conf[256], pwd[256];
+    const char *argv[32];
+    int argc = 0, i;
+
+    for (i = 0; i < E2E_SECRET_LEN; i++) {
+        sprintf(secret_hex + 2 * i, "%02x", client_secret[i]);
+    }
+    P->port = free_port();
+    snprintf(port, sizeof(port), "%d", P->port);
+    P->socks5_port = free_port();
+    snprintf(socks5_port, sizeof(socks5_port), "%d", P->socks5_port);
+    snprintf(stats_port, sizeof(stats_port), "%d", free_port());
+    snprintf(workers_arg, sizeof(workers_arg), "%d", workers);
+    snprintf(zc_arg, sizeof(zc_arg), "%d", zerocopy);
+    /* прокси под root поднимает лимит до maxconn + 16 сам и падает, если не вышло */
+    snprintf(maxconn, sizeof(maxconn), "%ld", proxy_maxconn - 16);
+    snprintf(conf, sizeof(conf), "%s/proxy.conf", workdir);
+    snprintf(pwd, sizeof(pwd), "%s/proxy-secret", workdir);
+    snprintf(P->log, sizeof(P->log), "%s/proxy-%s.log", workdir, tag);
+
+    argv[argc++] = proxy_path;
+    if (!geteuid()) {
+        argv[argc++] = "-u";
+        argv[argc++] = "nobody";
+    }
+    argv[argc++] = "-c";
+    argv[argc++] = maxconn;
+    argv[argc++] = "-p";
+    argv[argc++] = stats_port;
+    argv[argc++] = "-H";
+    argv[argc++] = port;
+    argv[argc++] = "-S";
+    argv[argc++] = secret_hex;
+    argv[argc++] = "--aes-pwd";
+    argv[argc++] = pwd;
+    argv[argc++] = "--socks5-port";
+    argv[argc++] = socks5_port;
+    /* эхо-цель слушает на 127.0.0.1 */
+    argv[argc++] = "--socks5-no-auth";
+    argv[argc++] = "--socks5-allow-private";
+    if (tls) {
+        argv[argc++] = "-D";
+        argv[argc++] = domain;
+    }
+    if (workers > 0) {
+        argv[argc++] = "-M";
+        argv[argc++] = workers_arg;
+    }
+    if (zerocopy > 0) {
+        argv[argc++] = "--zerocopy-threshold";
+        argv[argc++] = zc_arg;
+    }
+    if (trace_sample) {
+        argv[argc++] = "--trace-sample";
+        argv[argc++] = trace_sample;
+    }
+    argv[argc++] = conf;
+    argv[argc] = NULL;
+
+    P->pid = fork();
+    if (P->pid < 0) {
+        return -1;
+    }
+    if (!P->pid) {
+        /* своя группа: воркеры -M переживают SIGTERM мастеру, гасим всех разом */
+        setpgid(0, 0);
+        int fd = open(P->log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, 1);
+            dup2(fd, 2);
+            close(fd);
+        }
+        execv(proxy_path, (char *const *) argv);
+        _exit(127);
+    }
+    setpgid(P->pid, P->pid);
+    return 0;
+}
+
+static void stop_proxy(struct proxy_instance *P) {
+    if (P->pid > 0) {
+        kill(-P->pid, SIGTERM);
+        double deadline = now_sec() + 5;
+        while (waitpid(P->pid, NULL, WNOHANG) == 0 && now_sec() < deadline) {
+            usleep(10000);
+        }
+        kill(-P->pid, SIGKILL);
+        waitpid(P->pid, NULL, 0);
+        P->pid = 0;
+    }
+}
+
+/**
+ * @brief Ждёт, пока прокси начнёт принимать клиентов и его соединения
+ *        с middle-end перестанут прибавляться: воркеров по умолчанию
+ *        столько же, сколько процессоров, и у каждого свои
+ */
+static int wait_proxy(struct proxy_instance *P, struct e2e_middle_end *M, int base_handshakes) {
+    double deadline = now_sec() + STARTUP_TIMEOUT, settled = 0;
+    int last = base_handshakes;
+    while (now_sec() < deadline) {
+        if (waitpid(P->pid, NULL, WNOHANG) == P->pid) {
+            P->pid = 0;
+            return -1;
+        }
+        int h = e2e_me_handshakes(M);
+        if (h != last) {
+            last = h;
+            settled = 0;
+        } else if (h > base_handshakes && port_accepts(P->port)) {
+            if (!settled) {
+                settled = now_sec();
+            } else if (now_sec() - settled >= STARTUP_SETTLE) {
+                return 0;
+            }
+        }
+        usleep(50000);
+    }
+    return -1;
+}
+
+/* ============================================
+ * Основная программа
+ * ============================================ */
+
+static int parse_list(const char *s, int *out, int max) {
+    int n = 0;
+    while (*s && n < max) {
+        char *end;
+        long x = strtol(s, &end, 10);
+        if (end == s || x <= 0) {
+            return -1;
+        }
+        out[n++] = x;
+        s = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+static int parse_modes(const char *s, int *out) {
+    int n = 0, t;
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s", s);
+    char *save, *tok;
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        for (t = 0; t <= E2E_SOCKS5 && strcmp(tok, e2e_transport_name(t)); t++) {
+        }
+        if (t > E2E_SOCKS5 || n > E2E_SOCKS5) {
+            return -1;
+        }
+        out[n++] = t;
+    }
+    return n;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--proxy path] [--connections 100,1000] [--mode ef,ee,dd,tls,socks5] [--size bytes]\n"
+                    "       [--duration seconds] [--threads n] [--workers n,n...] [--domain name] [--zerocopy bytes]\n"
+                    "       [--trace-sample n]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        {"proxy", required_argument, NULL, 'x'},
+        {"connections", required_argument, NULL, 'c'},
+        {"mode", required_argument, NULL, 'm'},
+        {"size", required_argument, NULL, 's'},
+        {"duration", required_argument, NULL, 'd'},
+        {"threads", required_argument, NULL, 't'},
+        {"workers", required_argument, NULL, 'w'},
+        {"domain", required_argument, NULL, 'D'},
+        {"zerocopy", required_argument, NULL, 'z'},
+        {"trace-sample", required_argument, NULL, 'T'},
+        {NULL, 0, NULL, 0}
+    };
+    int counts[MAX_COUNTS] = {100, 1000}, ncounts = 2;
+    int modes[E2E_SOCKS5 + 1] = {E2E_ABRIDGED, E2E_INTERMEDIATE, E2E_PADDED, E2E_FAKE_TLS}, nmodes = 4;
+    int workers[MAX_COUNTS] = {0}, nworkers = 1;   /* 0 - сколько решит прокси */
+    int size = 1024, threads = 2, zerocopy = 0, opt, i, j, w, z;
+    double duration = 5;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'x':
+            proxy_path = optarg;
+            break;
+        case 'c':
+            ncounts = parse_list(optarg, counts, MAX_COUNTS);
+            break;
+        case 'm':
+            nmodes = parse_modes(optarg, modes);
+            break;
+        case 's':
+            size = atoi(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'w':
+            nworkers = parse_list(optarg, workers, MAX_COUNTS);
+            break;
+        case 'D':
+            domain = optarg;
+            break;
+        case 'z':
+            zerocopy = atoi(optarg);
+            break;
+        case 'T':
+            trace_sample = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (ncounts <= 0 || nmodes <= 0 || nworkers <= 0 || size < 64 || size > E2E_MAX_PAYLOAD || (size & 3) || duration <= 0 || threads <= 0 || zerocopy < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (access(proxy_path, X_OK) < 0) {
+        fprintf(stderr, "%s: not found, build it or pass --proxy\n", proxy_path);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int max_conns = 0;
+    for (i = 0; i < ncounts; i++) {
+        if (counts[i] > max_conns) {
+            max_conns = counts[i];
+        }
+    }
+    proxy_maxconn = raise_fd_limit(2 * max_conns + 1024);
+
+    unsigned char proxy_secret[E2E_PROXY_SECRET_LEN];
+    if (RAND_bytes(proxy_secret, sizeof(proxy_secret)) != 1 || RAND_bytes(client_secret, sizeof(client_secret)) != 1) {
+        return 1;
+    }
+    struct e2e_middle_end *M = e2e_me_start(proxy_secret, sizeof(proxy_secret));
+    if (!M || !mkdtemp(workdir)) {
+        fprintf(stderr, "cannot start middle-end or create work directory\n");
+        return 1;
+    }
+    /* прокси может сменить пользователя: каталог и файлы должны читаться всеми */
+    chmod(workdir, 0755);
+    char path[256], conf[128];
+    snprintf(path, sizeof(path), "%s/proxy-secret", workdir);
+    write_file(path, proxy_secret, sizeof(proxy_secret));
+    snprintf(path, sizeof(path), "%s/proxy.conf", workdir);
+    int conf_len = snprintf(conf, sizeof(conf), "proxy_for %d 127.0.0.1:%d;\ndefault %d;\n",
+                            E2E_TARGET_DC, e2e_me_port(M), E2E_TARGET_DC);
+    write_file(path, conf, conf_len);
+
+    printf("=== End-to-End Proxy Benchmark ===\n");
+    struct e2e_echo *E = NULL;
+    for (i = 0; i < nmodes; i++) {
+        if (modes[i] == E2E_SOCKS5 && !E && !(E = e2e_echo_start())) {
+            fprintf(stderr, "cannot start echo target\n");
+            return 1;
+        }
+    }
+
+    printf("proxy %s, %d byte payload, %.1f s per run, %d client threads\n\n",
+           proxy_path, size, duration, threads);
+    printf("%-6s %7s %8s %7s %12s %6s %9s %9s %9s %9s %10s\n",
+           "mode", "workers", "zerocopy", "conns", "handshakes/s", "failed", "Gbit/s", "p50 us", "p99 us", "p999 us", "cpu s/GB");
+
+    int status = 0;
+    struct proxy_instance P = {0};
+    for (w = 0; w < nworkers && !status; w++) {
+        int instance = -1;
+        char workers_name[16] = "auto";
+        if (workers[w] > 0) {
+            snprintf(workers_name, sizeof(workers_name), "%d", workers[w]);
+        }
+        for (i = 0; i < nmodes * (zerocopy ? 2 : 1) && !status; i++) {
+            int mode = modes[zerocopy ? i / 2 : i];
+            int tls = mode == E2E_FAKE_TLS;
+            z = zerocopy ? i % 2 : 0;
+            if (tls * 2 + z != instance) {
+                stop_proxy(&P);
+                int base = e2e_me_handshakes(M);
+                char tag[32];
+                snprintf(tag, sizeof(tag), "%s%s-w%s", tls ? "tls" : "obfs", z ? "-zc" : "", workers_name);
+                if (start_proxy(&P, tls, workers[w], z ? zerocopy : 0, tag) < 0 || wait_proxy(&P, M, base) < 0) {
+                    fprintf(stderr, "proxy did not come up, see %s\n", P.log);
+                    status = 1;
+                    break;
+                }
+                instance = tls * 2 + z;
+            }
+            char zc_name[16] = "off";
+            if (z) {
+                snprintf(zc_name, sizeof(zc_name), "%d", zerocopy);
+            }
+            for (j = 0; j < ncounts; j++) {
+                struct cpu_sample S = {.pid = P.pid};
+                struct e2e_load L;
+                struct e2e_result R;
+                memset(&L, 0, sizeof(L));
+                L.port = mode == E2E_SOCKS5 ? P.socks5_port : P.port;
+                L.target_port = E ? e2e_echo_port(E) : 0;
+                L.transport = mode;
+                memcpy(L.secret, client_secret, sizeof(client_secret));
+                L.domain = domain;
+                L.connections = counts[j];
+                L.threads = threads;
+                L.payload = size;
+                L.duration = duration;
+                L.connect_timeout = 10 + counts[j] / 1000.0;
+                L.measure_hook = cpu_hook;
+                L.hook_arg = &S;
+                if (e2e_run_load(&L, &R) < 0) {
+                    fprintf(stderr, "cannot start client threads\n");
+                    status = 1;
+                    break;
+                }
+                double gbytes = R.bytes / 1e9;
+                printf("%-6s %7s %8s %7d %12.0f %6d %9.3f %9.1f %9.1f %9.1f %10.2f\n",
+                       e2e_transport_name(mode), workers_name, zc_name, counts[j],
+                       R.handshake_seconds > 0 ? R.handshakes / R.handshake_seconds : 0, R.failed,
+                       R.seconds > 0 ? gbytes * 8 / R.seconds : 0, R.rtt_p50, R.rtt_p99, R.rtt_p999,
+                       gbytes > 0 ? (S.end - S.start) / gbytes : 0);
+                fflush(stdout);
+                if (!R.handshakes) {
+                    fprintf(stderr, "no connection went through, see %s\n", P.log);
+                    status = 1;
+                    break;
+                }
+            }
+        }
+    }
+    stop_proxy(&P);
+    e2e_me_stop(M);
+    if (E) {
+        e2e_echo_stop(E);
+    }
+
+    if (!status) {
+        char cmd[128];
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", workdir);
+        if (system(cmd)) {
+            fprintf(stderr, "cannot remove %s\n", workdir);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file benchmark-e2e.h
+ * @brief Сквозной бенчмарк прокси на одной машине: общие объявления
+ *
+ * Три части, все через loopback:
+ * - benchmark-e2e-middle-end.c - поддельный middle-end: обмен RPC_NONCE,
+ *   AES-256-CBC, RPC_HANDSHAKE как в net-tcp-rpc-client.c, на каждый
+ *   RPC_PROXY_REQ отвечает RPC_PROXY_ANS с тем же телом, на RPC_PING - RPC_PONG
+ * - benchmark-e2e-client.c - эмулятор клиентов: obfuscated2 с тегами
+ *   ef/ee/dd (abridged/intermediate/padded), fake-TLS и SOCKS5 CONNECT
+ *   на эхо-цель, по epoll на поток
+ * - benchmark-e2e.c - драйвер: запускает mtproto-proxy, гоняет нагрузку
+ *   для заданных чисел соединений и печатает сводку
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define E2E_SECRET_LEN 16
+#define E2E_PROXY_SECRET_LEN 128     /* --aes-pwd: от 32 до 256 байт */
+#define E2E_TARGET_DC 2
+#define E2E_MAX_PAYLOAD (1 << 20)
+
+/* ============================================
+ * Поддельный middle-end
+ * ============================================ */
+
+struct e2e_middle_end;
+
+/**
+ * @brief Слушает 127.0.0.1 на свободном порту, по потоку на соединение
+ * @return NULL при ошибке
+ */
+struct e2e_middle_end *e2e_me_start(const unsigned char *proxy_secret, int secret_len);
+int e2e_me_port(struct e2e_middle_end *M);
+/** @brief Соединений прокси, прошедших RPC_HANDSHAKE */
+int e2e_me_handshakes(struct e2e_middle_end *M);
+long long e2e_me_queries(struct e2e_middle_end *M);
+/**
+ * @brief Рвёт все соединения прокси, не дожидаясь ответов на запросы в полёте
+ * @return сколько соединений было открыто
+ */
+int e2e_me_drop(struct e2e_middle_end *M);
+void e2e_me_stop(struct e2e_middle_end *M);
+
+/* ============================================
+ * Эхо-цель для SOCKS5
+ * ============================================ */
+
+struct e2e_echo;
+
+/** @brief Возвращает всё прочитанное; 127.0.0.1, свободный порт */
+struct e2e_echo *e2e_echo_start(void);
+int e2e_echo_port(struct e2e_echo *E);
+void e2e_echo_stop(struct e2e_echo *E);
+
+/* ============================================
+ * Эмулятор клиентов
+ * ============================================ */
+
+enum e2e_transport {
+    E2E_ABRIDGED,       /* ef */
+    E2E_INTERMEDIATE,   /* ee */
+    E2E_PADDED,         /* dd */
+    E2E_FAKE_TLS,       /* ee-секрет с доменом, внутри padded */
+    E2E_SOCKS5          /* CONNECT на target_port, дальше intermediate без шифрования */
+};
+
+struct e2e_load {
+    int port;
+    int transport;
+    unsigned char secret[E2E_SECRET_LEN];
+    const char *domain;          /* SNI для fake-TLS */
+    int target_port;             /* куда просить CONNECT в SOCKS5, 127.0.0.1 */
+    int connections;
+    int threads;
+    int payload;                 /* байт в запросе, кратно 4, не меньше 64 */
+    double duration;             /* секунд установившейся нагрузки */
+    double connect_timeout;
+    /* вызывается в начале (0) и в конце (1) окна замера, например для CPU прокси */
+    void (*measure_hook)(int phase, void *arg);
+    void *hook_arg;
+};
+
+struct e2e_result {
+    int handshakes;              /* соединений, получивших первый ответ */
+    int failed;
+    double handshake_seconds;    /* от начала подключения до последнего первого ответа */
+    long long requests;
+    long long bytes;             /* полезная нагрузка в обе стороны */
+    double seconds;
+    double rtt_p50, rtt_p99, rtt_p999;   /* микросекунды */
+};
+
+/**
+ * @brief Открывает L->connections соединений, держит на каждом один
+ *        запрос в полёте L->duration секунд
+ * @return 0 или -1, если не удалось запустить потоки
+ */
+int e2e_run_load(const struct e2e_load *L, struct e2e_result *R);
+
+const char *e2e_transport_name(int transport);
@@ -0,0 +1,111 @@
+/**
+ * @file benchmark-http-parse.c
+ * @brief Бенчмарк разбора HTTP-заголовков (net/net-http-server.c)
+ *
+ * Тестирует:
+ * - hts_parse_header_fast: заголовок целиком в одном блоке
+ * - hts_parse_header_bytes: прежний побайтовый автомат на тех же запросах
+ * - Запросы: /stats от curl, HTTP-транспорт от браузера, длинный запрос с куками
+ *
+ * Использование: benchmark-http-parse [число_разборов]
+ */
+
+#include "net/net-http-server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+/* ============================================
+ * Утилиты
+ * ============================================ */
+
+/**
+ * @brief Получить текущее время в микросекундах
+ */
+static uint64_t get_time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)(tv.tv_sec * 1000000 + tv.tv_usec);
+}
+
+static const char *req_stats =
+    "GET /stats HTTP/1.1\r\n"
+    "Host: localhost:8888\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+static const char *req_transport =
+    "POST /api HTTP/1.1\r\n"
+    "Host: 149.154.167.51:80\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 328\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Accept: */*\r\n"
+    "Origin: https://web.telegram.org\r\n"
+    "Referer: https://web.telegram.org/\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "\r\n";
+
+static char req_large[4096];
+
+static void build_large(void) {
+    int pos = sprintf(req_large, "GET /apiw1?x=%0200d HTTP/1.1\r\nHost: venus.web.telegram.org\r\nConnection: keep-alive\r\n", 0);
+    for (int i = 0; i < 12; i++) {
+        pos += sprintf(req_large + pos, "X-Header-%d: %0120d\r\n", i, i);
+    }
+    pos += sprintf(req_large + pos, "Cookie: stel_ssid=%0600d\r\n\r\n", 7);
+}
+
+/* ============================================
+ * Бенчмарки
+ * ============================================ */
+
+static void benchmark_request(const char *title, const char *req, int iterations) {
+    int len = (int)strlen(req);
+    struct hts_data D;
+    memset(&D, 0, sizeof(D));
+    long long sum = 0;
+
+    uint64_t start = get_time_us();
+    for (int i = 0; i < iterations; i++) {
+        D.parse_state = htqp_start;
+        sum += hts_parse_header_bytes(&D, req, len);
+    }
+    uint64_t us_bytes = get_time_us() - start + 1;
+
+    int fast_ok = 1;
+    start = get_time_us();
+    for (int i = 0; i < iterations; i++) {
+        D.parse_state = htqp_start;
+        int r = hts_parse_header_fast(&D, req, len);
+        fast_ok &= r > 0;
+        sum += r;
+    }
+    uint64_t us_fast = get_time_us() - start + 1;
+
+    printf("  %-10s %5d B  state machine %8.2f M req/s  fast path %8.2f M req/s  x%.1f%s\n",
+           title, len, iterations / (double)us_bytes, iterations / (double)us_fast,
+           (double)us_bytes / us_fast, fast_ok ? "" : "  (fast path declined!)");
+    if (sum == 42) {
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000000;
+    if (iterations <= 0) {
+        iterations = 2000000;
+    }
+    build_large();
+
+    printf("=== HTTP header parsing, %d requests per case ===\n\n", iterations);
+    benchmark_request("stats", req_stats, iterations);
+    benchmark_request("transport", req_transport, iterations);
+    benchmark_request("large", req_large, iterations / 4);
+    return 0;
+}
@@ -0,0 +1,254 @@
+/**
+ * @file benchmark-ip-acl.c
+ * @brief Бенчмарк скомпилированных IP-списков (net/net-ip-acl.c)
+ *
+ * Тестирует:
+ * - Сборку и компиляцию таблицы из 1M префиксов IPv4/IPv6 (через API и из файла)
+ * - Скорость поиска для IPv4 и IPv6 (попадания и промахи)
+ * - Для сравнения: прежний линейный поиск strcmp/"*" по 1000 записям
+ *
+ * Использование: benchmark-ip-acl [число_префиксов] [число_поисков]
+ */
+
+#include "../net/net-ip-acl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+/* ============================================
+ * Утилиты
+ * ============================================ */
+
+/**
+ * @brief Получить текущее время в микросекундах
+ */
+static uint64_t get_time_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)(tv.tv_sec * 1000000 + tv.tv_usec);
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+/**
+ * @brief xorshift64* - воспроизводимый генератор адресов
+ */
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * @brief Префикс тестового набора
+ */
+typedef struct {
+    unsigned char addr[16];
+    int len;
+    int is_v6;
+} bench_prefix_t;
+
+/**
+ * @brief Набор префиксов, похожий на списки злоупотреблений:
+ * в основном /24 и одиночные адреса, часть коротких сетей, 15% IPv6
+ */
+static void generate_prefixes(bench_prefix_t *p, int count) {
+    for (int i = 0; i < count; i++) {
+        uint64_t r = rng_next();
+        uint64_t a = rng_next(), b = rng_next();
+        memcpy(p[i].addr, &a, 8);
+        memcpy(p[i].addr + 8, &b, 8);
+        int kind = (int)(r % 100);
+        if (kind < 85) {
+            p[i].is_v6 = 0;
+            p[i].len = kind < 55 ? 24 : kind < 75 ? 32 : 16 + (int)((r >> 32) % 8);
+        } else {
+            p[i].is_v6 = 1;
+            p[i].addr[0] = 0x20;
+            p[i].addr[1] = 0x01 + (r >> 40) % 4;
+            p[i].len = kind < 95 ? 48 : kind < 98 ? 64 : 128;
+        }
+    }
+}
+
+static unsigned prefix_v4(const bench_prefix_t *p) {
+    return ((unsigned)p->addr[0] << 24) | (p->addr[1] << 16) | (p->addr[2] << 8) | p->addr[3];
+}
+
+/**
+ * @brief Прежняя проверка плагина: strcmp и префикс с "*"
+ */
+static int legacy_ip_in_list(const char *ip, char list[][64], int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(list[i], ip) == 0) {
+            return 1;
+        }
+        size_t ip_len = strlen(ip);
+        size_t list_ip_len = strlen(list[i]);
+        if (list_ip_len > 0 && list[i][list_ip_len - 1] == '*') {
+            size_t prefix_len = list_ip_len - 1;
+            if (ip_len >= prefix_len && strncmp(ip, list[i], prefix_len) == 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* ============================================
+ * Бенчмарки
+ * ============================================ */
+
+static struct ip_acl *benchmark_build(const bench_prefix_t *p, int count) {
+    struct ip_acl *acl = ip_acl_alloc();
+    uint64_t start = get_time_us();
+    for (int i = 0; i < count; i++) {
+        if (p[i].is_v6) {
+            ip_acl_add_ipv6(acl, p[i].addr, p[i].len, IP_ACL_BLACKLIST);
+        } else {
+            ip_acl_add_ipv4(acl, prefix_v4(&p[i]), p[i].len, IP_ACL_BLACKLIST);
+        }
+    }
+    ip_acl_compile(acl);
+    uint64_t us = get_time_us() - start;
+    printf("  %-34s %10.1f ms  %8.1f MB  %d prefixes\n", "Build (binary API)",
+           us / 1000.0, ip_acl_memory(acl) / 1048576.0, acl->prefixes);
+    return acl;
+}
+
+static void benchmark_load_file(const bench_prefix_t *p, int count) {
+    char path[] = "/tmp/benchmark-ip-acl-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return;
+    }
+    FILE *f = fdopen(fd, "w");
+    for (int i = 0; i < count; i++) {
+        char buf[INET6_ADDRSTRLEN];
+        if (p[i].is_v6) {
+            inet_ntop(AF_INET6, p[i].addr, buf, sizeof(buf));
+        } else {
+            inet_ntop(AF_INET, p[i].addr, buf, sizeof(buf));
+        }
+        fprintf(f, "%s/%d\n", buf, p[i].len);
+    }
+    fclose(f);
+
+    struct ip_acl *acl = ip_acl_alloc();
+    uint64_t start = get_time_us();
+    int loaded = ip_acl_load_file(acl, path, IP_ACL_BLACKLIST);
+    ip_acl_compile(acl);
+    uint64_t us = get_time_us() - start;
+    printf("  %-34s %10.1f ms  %8.1f MB  %d prefixes, %d errors\n", "Load from CIDR file (reload cost)",
+           us / 1000.0, ip_acl_memory(acl) / 1048576.0, loaded, acl->errors);
+    ip_acl_free(acl);
+    unlink(path);
+}
+
+static void benchmark_lookup_v4(const struct ip_acl *acl, const bench_prefix_t *p, int count, int lookups) {
+    unsigned *addrs = malloc(sizeof(unsigned) * lookups);
+    for (int i = 0; i < lookups; i++) {
+        /* Половина адресов - из набора префиксов, половина - случайные */
+        const bench_prefix_t *src = &p[rng_next() % count];
+        addrs[i] = (i & 1) || src->is_v6 ? (unsigned)rng_next() : prefix_v4(src);
+    }
+
+    unsigned hits = 0;
+    uint64_t start = get_time_us();
+    for (int i = 0; i < lookups; i++) {
+        hits += ip_acl_lookup_ipv4(acl, addrs[i]) & IP_ACL_BLACKLIST;
+    }
+    uint64_t us = get_time_us() - start;
+    printf("  %-34s %10.2f M/s  %6.1f ns/op  (%.1f%% hits)\n", "IPv4 lookup",
+           lookups / (double)us, us * 1000.0 / lookups, 100.0 * hits / lookups);
+    free(addrs);
+}
+
+static void benchmark_lookup_v6(const struct ip_acl *acl, const bench_prefix_t *p, int count, int lookups) {
+    unsigned char (*addrs)[16] = malloc(16 * (size_t)lookups);
+    for (int i = 0; i < lookups; i++) {
+        const bench_prefix_t *src = &p[rng_next() % count];
+        uint64_t a = rng_next(), b = rng_next();
+        memcpy(addrs[i], &a, 8);
+        memcpy(addrs[i] + 8, &b, 8);
+        if (!(i & 1) && src->is_v6) {
+            memcpy(addrs[i], src->addr, src->len / 8);
+        } else {
+            addrs[i][0] = 0x20;
+            addrs[i][1] = 0x01 + i % 8;
+        }
+    }
+
+    unsigned hits = 0;
+    uint64_t start = get_time_us();
+    for (int i = 0; i < lookups; i++) {
+        hits += ip_acl_lookup_ipv6(acl, addrs[i]) & IP_ACL_BLACKLIST;
+    }
+    uint64_t us = get_time_us() - start;
+    printf("  %-34s %10.2f M/s  %6.1f ns/op  (%.1f%% hits)\n", "IPv6 lookup",
+           lookups / (double)us, us * 1000.0 / lookups, 100.0 * hits / lookups);
+    free(addrs);
+}
+
+static void benchmark_legacy(int lookups) {
+    enum { LEGACY_ENTRIES = 1000 };
+    static char list[LEGACY_ENTRIES][64];
+    for (int i = 0; i < LEGACY_ENTRIES; i++) {
+        unsigned a = (unsigned)rng_next();
+        if (i % 4) {
+            snprintf(list[i], 64, "%u.%u.%u.%u", a >> 24, (a >> 16) & 255, (a >> 8) & 255, a & 255);
+        } else {
+            snprintf(list[i], 64, "%u.%u.%u.*", a >> 24, (a >> 16) & 255, (a >> 8) & 255);
+        }
+    }
+
+    int n = lookups / 100;
+    char ip[32];
+    unsigned hits = 0;
+    uint64_t start = get_time_us();
+    for (int i = 0; i < n; i++) {
+        unsigned a = (unsigned)rng_next();
+        snprintf(ip, sizeof(ip), "%u.%u.%u.%u", a >> 24, (a >> 16) & 255, (a >> 8) & 255, a & 255);
+        hits += legacy_ip_in_list(ip, list, LEGACY_ENTRIES);
+    }
+    uint64_t us = get_time_us() - start;
+    printf("  %-34s %10.2f M/s  %6.1f ns/op\n", "Legacy strcmp scan, 1000 entries",
+           n / (double)us, us * 1000.0 / n);
+    (void)hits;
+}
+
+int main(int argc, char *argv[]) {
+    int count = 1000000;
+    int lookups = 20000000;
+
+    if (argc > 1) {
+        count = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        lookups = atoi(argv[2]);
+    }
+
+    printf("\n=== IP ACL Benchmark ===\n");
+    printf("Prefixes: %d, lookups: %d\n\n", count, lookups);
+
+    bench_prefix_t *prefixes = malloc(sizeof(bench_prefix_t) * count);
+    if (!prefixes) {
+        return 1;
+    }
+    generate_prefixes(prefixes, count);
+
+    struct ip_acl *acl = benchmark_build(prefixes, count);
+    benchmark_load_file(prefixes, count);
+    benchmark_lookup_v4(acl, prefixes, count, lookups);
+    benchmark_lookup_v6(acl, prefixes, count, lookups);
+    benchmark_legacy(lookups);
+
+    ip_acl_free(acl);
+    free(prefixes);
+    return 0;
+}
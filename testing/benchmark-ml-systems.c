@@ -5,6 +5,8 @@
  * Тестирует производительность:
  * - Anomaly Detection (5 алгоритмов)
  * - Predictive Analytics (6 алгоритмов)
+ * - Обучение на 100K образцов x 16 признаков (полное и инкрементальное)
+ * - Пакетная оценка Isolation Forest против поштучной
  * 
  * @version 1.0.32
  * @date 29 марта 2026
@@ -494,6 +496,193 @@ static void run_scalability_benchmarks(void) {
     printf("└─────────────────┴──────────────┴──────────────┴─────────────────┘\n");
 }
 
+/* ============================================
+ * Бенчмарк обучения на большой выборке
+ * ============================================ */
+
+/**
+ * @brief Полное и инкрементальное обучение на 100K x 16
+ * 
+ * Соответствует суткам поминутных замеров по нескольким десяткам
+ * серверов: полное обучение (квартили, DBSCAN, Isolation Forest) и
+ * дообучение порцией в 1440 образцов (одни сутки одного сервера).
+ */
+static void run_large_scale_benchmarks(void) {
+    printf("\n");
+    printf("╔══════════════════════════════════════════════════════════════╗\n");
+    printf("║  Large-Scale Training (100K samples x 16 features)           ║\n");
+    printf("╚══════════════════════════════════════════════════════════════╝\n");
+    printf("\n");
+    
+    size_t n_samples = 100000;
+    size_t n_features = 16;
+    size_t n_increment = 1440;
+    size_t n_tests = 1000;
+    
+    double* train_data = (double*)malloc((n_samples + n_increment) * n_features * sizeof(double));
+    double* test_data = (double*)malloc(n_tests * n_features * sizeof(double));
+    if (!train_data || !test_data) {
+        free(train_data);
+        free(test_data);
+        return;
+    }
+    
+    generate_normal_data(train_data, n_samples + n_increment, n_features, 100.0, 15.0);
+    generate_normal_data(test_data, n_tests, n_features, 100.0, 15.0);
+    
+    printf("┌─────────────────────┬──────────────┬──────────────┬──────────┐\n");
+    printf("│ Algorithm           │ Full Train   │ Incremental  │ Clusters │\n");
+    printf("├─────────────────────┼──────────────┼──────────────┼──────────┤\n");
+    
+    anomaly_algo_t algos[] = {ANOMALY_ALGO_ZSCORE, ANOMALY_ALGO_DBSCAN, ANOMALY_ALGO_ENSEMBLE};
+    const char* names[] = {"Z-Score", "DBSCAN", "Ensemble"};
+    
+    for (size_t a = 0; a < sizeof(algos)/sizeof(algos[0]); a++) {
+        anomaly_config_t config = {0};
+        config.algorithm = algos[a];
+        config.n_features = n_features;
+        config.max_samples = n_samples + n_increment;
+        config.n_trees = 50;
+        config.tree_height = 15;
+        config.threshold = 0.6f;
+        config.zscore_threshold = 3.0f;
+        config.moving_avg_window = 60;
+        config.enable_ensemble = (algos[a] == ANOMALY_ALGO_ENSEMBLE);
+        
+        anomaly_detector_t detector;
+        if (anomaly_detector_init(&detector, &config) != 0) continue;
+        
+        uint64_t start = get_time_us();
+        anomaly_detector_train(&detector, train_data, n_samples, n_features);
+        uint64_t train_time = get_time_us() - start;
+        
+        start = get_time_us();
+        anomaly_detector_train_incremental(&detector, &train_data[n_samples * n_features],
+                                           n_increment);
+        uint64_t incremental_time = get_time_us() - start;
+        
+        anomaly_result_t result;
+        for (size_t i = 0; i < n_tests; i++) {
+            anomaly_detector_predict(&detector, &test_data[i * n_features], &result);
+        }
+        
+        char train_str[32], incr_str[32];
+        format_time(train_time, train_str, sizeof(train_str));
+        format_time(incremental_time, incr_str, sizeof(incr_str));
+        
+        printf("│ %-19s │ %-12s │ %-12s │ %8zu │\n",
+               names[a], train_str, incr_str, detector.n_clusters);
+        
+        anomaly_detector_cleanup(&detector);
+    }
+    
+    printf("└─────────────────────┴──────────────┴──────────────┴──────────┘\n");
+    
+    free(train_data);
+    free(test_data);
+}
+
+/* ============================================
+ * Пакетная оценка Isolation Forest
+ * ============================================ */
+
+/**
+ * @brief Поштучный predict против predict_batch
+ * 
+ * Моделирует ежесекундную оценку векторов признаков всех активных
+ * соединений. Результаты обоих путей должны совпадать побитно.
+ */
+static void run_batch_scoring_benchmarks(void) {
+    printf("\n");
+    printf("╔══════════════════════════════════════════════════════════════╗\n");
+    printf("║  Isolation Forest Batch Scoring                              ║\n");
+    printf("╚══════════════════════════════════════════════════════════════╝\n");
+    printf("\n");
+    
+    size_t n_samples = 10000;
+    size_t n_features = 16;
+    size_t batch_sizes[] = {1000, 10000, 50000};
+    size_t max_batch = 50000;
+    
+    double* train_data = (double*)malloc(n_samples * n_features * sizeof(double));
+    double* test_data = (double*)malloc(max_batch * n_features * sizeof(double));
+    anomaly_result_t* single = (anomaly_result_t*)malloc(max_batch * sizeof(anomaly_result_t));
+    anomaly_result_t* batch = (anomaly_result_t*)malloc(max_batch * sizeof(anomaly_result_t));
+    if (!train_data || !test_data || !single || !batch) {
+        free(train_data);
+        free(test_data);
+        free(single);
+        free(batch);
+        return;
+    }
+    
+    generate_normal_data(train_data, n_samples, n_features, 100.0, 15.0);
+    generate_normal_data(test_data, max_batch, n_features, 100.0, 20.0);
+    
+    anomaly_config_t config = {0};
+    config.algorithm = ANOMALY_ALGO_ISOLATION_FOREST;
+    config.n_features = n_features;
+    config.max_samples = n_samples;
+    config.n_trees = 100;
+    config.tree_height = 12;
+    config.threshold = 0.6f;
+    config.zscore_threshold = 3.0f;
+    config.moving_avg_window = 60;
+    
+    anomaly_detector_t detector;
+    if (anomaly_detector_init(&detector, &config) != 0) {
+        free(train_data);
+        free(test_data);
+        free(single);
+        free(batch);
+        return;
+    }
+    anomaly_detector_train(&detector, train_data, n_samples, n_features);
+    
+    printf("┌─────────────────┬──────────────┬──────────────┬─────────┬───────────┐\n");
+    printf("│ Batch           │ Single       │ Batched      │ Speedup │ Identical │\n");
+    printf("├─────────────────┼──────────────┼──────────────┼─────────┼───────────┤\n");
+    
+    for (size_t b = 0; b < sizeof(batch_sizes)/sizeof(batch_sizes[0]); b++) {
+        size_t n = batch_sizes[b];
+        
+        uint64_t start = get_time_us();
+        for (size_t i = 0; i < n; i++) {
+            anomaly_detector_predict(&detector, &test_data[i * n_features], &single[i]);
+        }
+        uint64_t single_time = get_time_us() - start;
+        
+        start = get_time_us();
+        anomaly_detector_predict_batch(&detector, test_data, n, batch);
+        uint64_t batch_time = get_time_us() - start;
+        
+        bool identical = true;
+        for (size_t i = 0; i < n; i++) {
+            if (memcmp(&single[i].anomaly_score, &batch[i].anomaly_score, sizeof(float)) != 0) {
+                identical = false;
+                break;
+            }
+        }
+        
+        char single_str[32], batch_str[32];
+        format_time(single_time, single_str, sizeof(single_str));
+        format_time(batch_time, batch_str, sizeof(batch_str));
+        
+        printf("│ %15zu │ %-12s │ %-12s │ %6.2fx │ %-9s │\n",
+               n, single_str, batch_str,
+               batch_time ? (double)single_time / (double)batch_time : 0.0,
+               identical ? "yes" : "NO");
+    }
+    
+    printf("└─────────────────┴──────────────┴──────────────┴─────────┴───────────┘\n");
+    
+    anomaly_detector_cleanup(&detector);
+    free(train_data);
+    free(test_data);
+    free(single);
+    free(batch);
+}
+
 /* ============================================
  * Главная функция
  * ============================================ */
@@ -510,6 +699,8 @@ int main(void) {
     run_anomaly_detection_benchmarks();
     run_predictive_analytics_benchmarks();
     run_scalability_benchmarks();
+    run_large_scale_benchmarks();
+    run_batch_scoring_benchmarks();
     
     /* Итоговый вывод */
     printf("\n");
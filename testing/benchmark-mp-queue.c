@@ -0,0 +1,249 @@
+/**
+ * @file benchmark-mp-queue.c
+ * @brief Бенчмарк видов очередей common/mp-queue.c
+ *
+ * Для 1, 4 и 16 производителей и одного потребителя сравнивает:
+ * - mpmc:       общая очередь alloc_mp_queue_w на всех производителей
+ * - mpsc:       общая очередь alloc_mp_queue_mpsc (как out_queue соединения)
+ * - mpmc x N:   по очереди alloc_mp_queue_w на производителя
+ * - spsc x N:   по очереди alloc_mp_queue_spsc на производителя (как in_queue)
+ *
+ * Все очереди используются через mpq_push_w / mpq_pop_nw, как в
+ * net-connections.c. Печатает миллионы операций в секунду и промахи кэша
+ * на операцию (perf_event_open, если доступен).
+ *
+ * Использование: benchmark-mp-queue [элементов_на_прогон]
+ */
+
+#include "common/mp-queue.h"
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_PRODUCERS 16
+#define ROUNDS 3
+
+/* ============================================
+ * Утилиты
+ * ============================================ */
+
+/**
+ * @brief Монотонное время в наносекундах
+ */
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Счётчик промахов кэша вызывающего потока
+ * @return fd счётчика или -1, если perf недоступен
+ */
+static int cache_misses_open(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* по счётчику на поток: потребитель и производители */
+static int perf_fds[MAX_PRODUCERS + 1];
+
+static void cache_misses_start(void) {
+    for (int i = 0; i <= MAX_PRODUCERS; i++) {
+        if (perf_fds[i] >= 0) {
+            ioctl(perf_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/**
+ * @brief Сумма по всем потокам или -1, если счётчиков нет
+ */
+static long long cache_misses_stop(void) {
+    long long total = -1;
+    for (int i = 0; i <= MAX_PRODUCERS; i++) {
+        long long count;
+        if (perf_fds[i] < 0) {
+            continue;
+        }
+        ioctl(perf_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(perf_fds[i], &count, sizeof(count)) == sizeof(count)) {
+            total = (total < 0 ? 0 : total) + count;
+        }
+    }
+    return total;
+}
+
+/* ============================================
+ * Производители и потребитель
+ * ============================================ */
+
+enum queue_kind { KIND_MPMC, KIND_MPSC, KIND_MPMC_PER_PRODUCER, KIND_SPSC_PER_PRODUCER };
+
+static const char *kind_names[] = { "mpmc", "mpsc", "mpmc x N", "spsc x N" };
+
+struct run {
+    int kind;
+    int producers;
+    long items;                       /* на производителя */
+    struct mp_queue *queues[MAX_PRODUCERS];
+    int nqueues;
+};
+
+/*
+ * Производители живут весь бенчмарк: номера потоков get_this_thread_id
+ * выдаются навсегда, а их не больше MAX_MPQ_THREADS
+ */
+static pthread_t producer_threads[MAX_PRODUCERS];
+static pthread_barrier_t start_barrier, end_barrier;
+static struct run *current;
+
+static void *producer_main(void *arg) {
+    int id = (int)(long)arg;
+    get_this_thread_id();
+    perf_fds[id + 1] = cache_misses_open();
+    pthread_barrier_wait(&end_barrier);
+    while (1) {
+        pthread_barrier_wait(&start_barrier);
+        struct run *R = current;
+        if (!R) {
+            break;
+        }
+        if (id < R->producers) {
+            struct mp_queue *Q = R->queues[id % R->nqueues];
+            for (long i = 1; i <= R->items; i++) {
+                mpq_push_w(Q, (void *)i, 0);
+            }
+        }
+        pthread_barrier_wait(&end_barrier);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Один прогон: потребитель работает в вызывающем потоке
+ * @return наносекунд на весь прогон
+ */
+static uint64_t run_once(struct run *R) {
+    long total = R->items * R->producers, got = 0;
+
+    R->nqueues = (R->kind == KIND_MPMC || R->kind == KIND_MPSC) ? 1 : R->producers;
+    for (int i = 0; i < R->nqueues; i++) {
+        switch (R->kind) {
+        case KIND_MPSC:
+            R->queues[i] = alloc_mp_queue_mpsc();
+            break;
+        case KIND_SPSC_PER_PRODUCER:
+            R->queues[i] = alloc_mp_queue_spsc();
+            break;
+        default:
+            R->queues[i] = alloc_mp_queue_w();
+        }
+    }
+
+    current = R;
+    pthread_barrier_wait(&start_barrier);
+    uint64_t start = get_time_ns();
+    int q = 0, idle = 0;
+    while (got < total) {
+        if (mpq_pop_nw(R->queues[q], 4)) {
+            got++;
+            idle = 0;
+            continue;
+        }
+        /* очередь пуста: следующая, а на одном ядре ещё и уступаем производителям */
+        if (++q == R->nqueues) {
+            q = 0;
+        }
+        if (++idle >= R->nqueues) {
+            idle = 0;
+            sched_yield();
+        }
+    }
+    uint64_t ns = get_time_ns() - start;
+    pthread_barrier_wait(&end_barrier);
+
+    for (int i = 0; i < R->nqueues; i++) {
+        free_mp_queue(R->queues[i]);
+    }
+    return ns;
+}
+
+int main(int argc, char *argv[]) {
+    long items = 4000000;
+    if (argc > 1) {
+        items = atol(argv[1]);
+    }
+
+    get_this_thread_id();
+    perf_fds[0] = cache_misses_open();
+    pthread_barrier_init(&start_barrier, NULL, MAX_PRODUCERS + 1);
+    pthread_barrier_init(&end_barrier, NULL, MAX_PRODUCERS + 1);
+    for (long i = 0; i < MAX_PRODUCERS; i++) {
+        pthread_create(&producer_threads[i], NULL, producer_main, (void *)i);
+    }
+    /* все счётчики открыты */
+    pthread_barrier_wait(&end_barrier);
+
+    printf("\n=== mp-queue kinds: push_w/pop_nw, one consumer ===\n");
+    printf("%ld items per run, best of %d rounds%s\n\n", items, ROUNDS,
+           perf_fds[0] < 0 ? ", cache misses unavailable (perf_event_open failed)" : "");
+    printf("%-10s %10s %14s %18s\n", "queue", "producers", "Mops/s", "cache misses/op");
+
+    static const int producer_counts[] = { 1, 4, 16 };
+    for (size_t p = 0; p < sizeof(producer_counts) / sizeof(producer_counts[0]); p++) {
+        for (int kind = KIND_MPMC; kind <= KIND_SPSC_PER_PRODUCER; kind++) {
+            struct run R;
+            memset(&R, 0, sizeof(R));
+            R.kind = kind;
+            R.producers = producer_counts[p];
+            R.items = items / R.producers;
+
+            uint64_t best = 0;
+            long long misses = -1;
+            for (int round = 0; round < ROUNDS; round++) {
+                cache_misses_start();
+                uint64_t ns = run_once(&R);
+                long long count = cache_misses_stop();
+                if (count >= 0 && (misses < 0 || count < misses)) {
+                    misses = count;
+                }
+                if (!best || ns < best) {
+                    best = ns;
+                }
+            }
+
+            double ops = (double)R.items * R.producers;
+            printf("%-10s %10d %14.2f", kind_names[kind], R.producers, ops * 1000.0 / best);
+            if (misses >= 0) {
+                printf(" %18.3f\n", misses / ops);
+            } else {
+                printf(" %18s\n", "n/a");
+            }
+        }
+    }
+    current = NULL;
+    pthread_barrier_wait(&start_barrier);
+    for (int i = 0; i < MAX_PRODUCERS; i++) {
+        pthread_join(producer_threads[i], NULL);
+    }
+
+    printf("\nspq blocks still allocated: %d\n", spq_blocks_allocated);
+    return spq_blocks_allocated != 0;
+}
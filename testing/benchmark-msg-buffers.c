@@ -0,0 +1,290 @@
+/**
+ * @file benchmark-msg-buffers.c
+ * @brief Бенчмарк выделения msg_buffer из нескольких потоков (net/net-msg-buffers.c)
+ *
+ * Каждый поток держит пул живых буферов пяти классов default_buffer_sizes и
+ * в цикле освобождает случайный из них и выделяет новый. Часть буферов
+ * освобождается не своим потоком: они передаются соседу через кольцо, как
+ * сообщения между потоками соединений и job-потоками в прокси.
+ *
+ * Сравниваются два режима:
+ * - общие чанки: lock_chunk_head и try_lock_chunk на каждом выделении
+ * - чанки потока (msg_buffers_thread_ownership): без блокировок, чужие
+ *   освобождения возвращаются через remote_free
+ *
+ * Использование: benchmark-msg-buffers [операций_на_поток] [макс_потоков]
+ */
+
+#include "net/net-msg-buffers.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#define LIVE_BUFFERS 256
+#define RING_SIZE 1024
+#define REMOTE_FREE_PERCENT 25
+#define MAX_THREADS 64
+
+/* ============================================
+ * Утилиты
+ * ============================================ */
+
+/**
+ * @brief Монотонное время в наносекундах
+ */
+static uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief xorshift64* с состоянием на поток
+ */
+static uint64_t rng_next(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * @brief Размер запроса: в основном мелкие и средние буферы, как у прокси
+ */
+static int pick_size(uint64_t *state) {
+    int r = (int)(rng_next(state) % 100);
+    if (r < 40) {
+        return 48;
+    }
+    if (r < 70) {
+        return 512;
+    }
+    if (r < 90) {
+        return 2048;
+    }
+    if (r < 99) {
+        return 16384;
+    }
+    return 262144;
+}
+
+/* ============================================
+ * Передача буферов соседнему потоку
+ * ============================================ */
+
+/** @brief Кольцо одного производителя и одного потребителя */
+struct ring {
+    struct msg_buffer *slots[RING_SIZE];
+    volatile unsigned head __attribute__((aligned(64)));
+    volatile unsigned tail __attribute__((aligned(64)));
+};
+
+static int ring_push(struct ring *R, struct msg_buffer *X) {
+    unsigned t = R->tail;
+    if (t - R->head == RING_SIZE) {
+        return 0;
+    }
+    R->slots[t & (RING_SIZE - 1)] = X;
+    __sync_synchronize();
+    R->tail = t + 1;
+    return 1;
+}
+
+static struct msg_buffer *ring_pop(struct ring *R) {
+    unsigned h = R->head;
+    if (h == R->tail) {
+        return NULL;
+    }
+    __sync_synchronize();
+    struct msg_buffer *X = R->slots[h & (RING_SIZE - 1)];
+    R->head = h + 1;
+    return X;
+}
+
+/* ============================================
+ * Рабочие потоки
+ * ============================================ */
+
+/*
+ * Пул потоков создаётся один раз: номера потоков (get_this_thread_id) и
+ * статистика модулей выдаются навсегда, как у job-потоков прокси
+ */
+void jobs_module_thread_init_raw_msg_buffer(void);
+extern int max_job_thread_id;
+
+struct worker {
+    pthread_t thread;
+    int id;
+    volatile int thread_id;
+    long failed;
+    struct ring *in;    /* буферы, которые освобождает этот поток */
+    struct ring *out;   /* буферы для соседа */
+};
+
+static struct worker workers[MAX_THREADS];
+static struct ring rings[MAX_THREADS];
+static int pool_size, run_threads, run_owned, stopping;
+static long run_ops;
+static pthread_barrier_t start_barrier, done_barrier, end_barrier;
+
+static void drain_ring(struct ring *R) {
+    struct msg_buffer *X;
+    while ((X = ring_pop(R)) != NULL) {
+        msg_buffer_decref(X);
+    }
+}
+
+static void churn(struct worker *W) {
+    struct msg_buffer *live[LIVE_BUFFERS];
+    uint64_t rng = 0x9e3779b97f4a7c15ULL * (W->id + 1);
+
+    memset(live, 0, sizeof(live));
+    for (long i = 0; i < run_ops; i++) {
+        int slot = (int)(rng_next(&rng) % LIVE_BUFFERS);
+        struct msg_buffer *X = live[slot];
+        if (X && !(run_threads > 1 && rng_next(&rng) % 100 < REMOTE_FREE_PERCENT && ring_push(W->out, X))) {
+            msg_buffer_decref(X);
+        }
+        live[slot] = alloc_msg_buffer(NULL, pick_size(&rng));
+        if (!live[slot]) {
+            W->failed++;
+        }
+        if (!(i & 63)) {
+            drain_ring(W->in);
+        }
+    }
+    for (int i = 0; i < LIVE_BUFFERS; i++) {
+        if (live[i]) {
+            msg_buffer_decref(live[i]);
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    struct worker *W = arg;
+    W->thread_id = get_this_thread_id();
+    jobs_module_thread_init_raw_msg_buffer();
+
+    while (1) {
+        pthread_barrier_wait(&start_barrier);
+        if (stopping) {
+            break;
+        }
+        int active = W->id < run_threads;
+        if (active) {
+            msg_buffers_thread_ownership(run_owned);
+            W->out = &rings[(W->id + 1) % run_threads];
+            churn(W);
+        }
+        /* после этого барьера в кольца больше никто не пишет */
+        pthread_barrier_wait(&done_barrier);
+        if (active) {
+            drain_ring(W->in);
+            msg_buffers_release_thread();
+        }
+        pthread_barrier_wait(&end_barrier);
+    }
+    return NULL;
+}
+
+static void start_pool(int threads) {
+    pool_size = threads;
+    pthread_barrier_init(&start_barrier, NULL, threads + 1);
+    pthread_barrier_init(&done_barrier, NULL, threads);
+    pthread_barrier_init(&end_barrier, NULL, threads + 1);
+    for (int i = 0; i < threads; i++) {
+        workers[i].id = i;
+        workers[i].in = &rings[i];
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+}
+
+static void stop_pool(void) {
+    stopping = 1;
+    pthread_barrier_wait(&start_barrier);
+    for (int i = 0; i < pool_size; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+}
+
+/**
+ * @brief Один прогон: threads потоков по ops пар free+alloc
+ * @return миллионов пар в секунду на все потоки
+ */
+static double run(int threads, int owned, long ops, long *failed) {
+    run_threads = threads;
+    run_owned = owned;
+    run_ops = ops;
+    for (int i = 0; i < pool_size; i++) {
+        workers[i].failed = 0;
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    uint64_t start = get_time_ns();
+    pthread_barrier_wait(&end_barrier);
+    uint64_t ns = get_time_ns() - start;
+
+    *failed = 0;
+    for (int i = 0; i < threads; i++) {
+        *failed += workers[i].failed;
+    }
+    return (double)ops * threads * 1000.0 / ns;
+}
+
+int main(int argc, char *argv[]) {
+    long ops = 2000000;
+    int max_threads = 16;
+    if (argc > 1) {
+        ops = atol(argv[1]);
+    }
+    if (argc > 2) {
+        max_threads = atoi(argv[2]);
+    }
+    if (max_threads < 1 || max_threads > MAX_THREADS) {
+        max_threads = MAX_THREADS;
+    }
+
+    init_msg_buffers(1L << 32);
+    start_pool(max_threads);
+    /* чтобы SB_SUM учитывал статистику потоков пула */
+    for (int i = 0; i < max_threads; i++) {
+        while (!workers[i].thread_id) {
+            sched_yield();
+        }
+        if (workers[i].thread_id > max_job_thread_id) {
+            max_job_thread_id = workers[i].thread_id;
+        }
+    }
+
+    printf("\n=== msg_buffer alloc/free churn: shared vs per-thread chunks ===\n");
+    printf("%ld ops per thread, %d live buffers per thread, %d%% freed by another thread\n\n",
+           ops, LIVE_BUFFERS, REMOTE_FREE_PERCENT);
+    printf("%8s %16s %16s %10s\n", "threads", "shared Mops/s", "owned Mops/s", "speedup");
+
+    int failed = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        long shared_failed, owned_failed;
+        double shared = run(threads, 0, ops, &shared_failed);
+        double owned = run(threads, 1, ops, &owned_failed);
+        printf("%8d %16.2f %16.2f %9.2fx\n", threads, shared, owned, owned / shared);
+        if (shared_failed || owned_failed) {
+            printf("         allocation failures: shared %ld, owned %ld\n", shared_failed, owned_failed);
+            failed = 1;
+        }
+    }
+
+    stop_pool();
+
+    struct buffers_stat bs;
+    fetch_buffers_stat(&bs);
+    printf("\nchunks allocated %d (max %d), owned now %d, buffers in use %d, remote frees %lld\n",
+           bs.allocated_buffer_chunks, bs.max_allocated_buffer_chunks, bs.owned_buffer_chunks,
+           bs.total_used_buffers, bs.remote_freed_buffers);
+    return failed || bs.total_used_buffers != 0;
+}
@@ -0,0 +1,354 @@
+/**
+ * @file benchmark-target-selection.c
+ * @brief Симуляция выбора middle-end: случайный против EWMA + power-of-two-choices
+ *
+ * Дискретно-событийная модель прокси и нескольких middle-end одного DC,
+ * один из которых медленный (дальше по сети и с меньшей ёмкостью):
+ * - клиент при подключении выбирает цель и соединение и дальше остаётся
+ *   на нём (как ext_connection в mtproto-proxy.c), отправляя запросы
+ *   последовательно с паузами
+ * - middle-end обслуживает запросы workers параллельно, остальные ждут
+ *   в очереди; RPC_PONG отвечается без очереди
+ * - random: цель и соединение равновероятно, как было в choose_proxy_target
+ * - p2c: стоимость и EWMA из net/net-rpc-lb.h, замеры по ответам
+ *   и по RPC_PING каждые RPC_LB_PING_INTERVAL секунд
+ *
+ * Печатает p50/p99/p99.9 задержки запросов и долю запросов, ушедших
+ * на медленный middle-end.
+ *
+ * Использование: benchmark-target-selection [секунд_модели] [запросов_в_секунду]
+ */
+
+#include "net/net-rpc-lb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define TARGETS 4
+#define CONNS_PER_TARGET 4
+#define SERVICE_MEAN 0.020       /* секунд на запрос у middle-end */
+#define THINK_MEAN 0.050         /* пауза клиента между запросами */
+#define QUERIES_PER_CLIENT 20    /* в среднем, геометрическое распределение */
+
+/* middle-end 0 - медленный: 60 мс RTT и половина ёмкости */
+static const double target_rtt[TARGETS] = {0.060, 0.010, 0.010, 0.010};
+static const int target_workers[TARGETS] = {4, 8, 8, 8};
+
+/* ============================================
+ * Случайные числа
+ * ============================================ */
+
+static uint64_t rng_state;
+
+/**
+ * @brief xorshift64* - одинаковая последовательность для обеих политик
+ */
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static double rng_uniform(void) {
+    return ((rng_next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double rng_exp(double mean) {
+    return -mean * log(rng_uniform());
+}
+
+/* ============================================
+ * События
+ * ============================================ */
+
+enum {
+    EV_CLIENT_ARRIVAL,
+    EV_QUERY_SEND,       /* клиент отправляет очередной запрос */
+    EV_QUERY_ARRIVE,     /* запрос дошёл до middle-end */
+    EV_SERVICE_DONE,
+    EV_ANSWER,           /* ответ дошёл до прокси */
+    EV_PING,
+    EV_PONG
+};
+
+struct event {
+    double time;
+    int type;
+    int arg;             /* клиент или соединение */
+};
+
+static struct event *heap;
+static int heap_size, heap_cap;
+
+static void ev_push(double time, int type, int arg) {
+    if (heap_size == heap_cap) {
+        heap_cap = heap_cap ? heap_cap * 2 : 1024;
+        heap = realloc(heap, heap_cap * sizeof(*heap));
+    }
+    int i = heap_size++;
+    while (i > 0 && heap[(i - 1) / 2].time > time) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = (struct event){time, type, arg};
+}
+
+static struct event ev_pop(void) {
+    struct event top = heap[0], last = heap[--heap_size];
+    int i = 0;
+    for (;;) {
+        int j = 2 * i + 1;
+        if (j >= heap_size) {
+            break;
+        }
+        if (j + 1 < heap_size && heap[j + 1].time < heap[j].time) {
+            j++;
+        }
+        if (heap[j].time >= last.time) {
+            break;
+        }
+        heap[i] = heap[j];
+        i = j;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/* ============================================
+ * Модель
+ * ============================================ */
+
+struct conn {
+    int target;
+    int rtt_us;
+    int outstanding;
+    double ping_time;
+};
+
+struct target {
+    int rtt_us;
+    int outstanding;
+    int busy;
+    int *queue;          /* клиенты, ждущие свободного worker: [q_head, q_tail) */
+    int q_head, q_tail, q_cap;
+};
+
+struct client {
+    int conn;
+    int left;            /* запросов до отключения */
+    double sent;
+};
+
+static struct conn conns[TARGETS * CONNS_PER_TARGET];
+static struct target targets[TARGETS];
+static struct client *clients;
+static int clients_num, clients_cap;
+
+static double *latencies;
+static long long latencies_num, latencies_cap, slow_queries;
+
+static void lb_sample(struct conn *c, double delay) {
+    if (delay * 1e6 > RPC_LB_RTT_MAX_US) {
+        return;
+    }
+    c->rtt_us = rpc_lb_ewma_update(c->rtt_us, (int)(delay * 1e6));
+    targets[c->target].rtt_us = rpc_lb_ewma_update(targets[c->target].rtt_us, (int)(delay * 1e6));
+}
+
+static long long conn_cost(struct conn *c) {
+    return rpc_lb_cost(c->rtt_us ? c->rtt_us : targets[c->target].rtt_us, c->outstanding, 1);
+}
+
+static long long target_cost(int t) {
+    return rpc_lb_cost(targets[t].rtt_us, targets[t].outstanding, CONNS_PER_TARGET);
+}
+
+/**
+ * @brief Соединение для нового клиента: как choose_proxy_target + forward_tcp_query
+ */
+static int choose_conn(int p2c) {
+    int t = rng_next() % TARGETS;
+    if (p2c) {
+        int t2 = (t + 1 + rng_next() % (TARGETS - 1)) % TARGETS;
+        if (target_cost(t2) < target_cost(t)) {
+            t = t2;
+        }
+    }
+    int c = t * CONNS_PER_TARGET + rng_next() % CONNS_PER_TARGET;
+    if (p2c) {
+        int c2 = t * CONNS_PER_TARGET + (c - t * CONNS_PER_TARGET + 1 + rng_next() % (CONNS_PER_TARGET - 1)) % CONNS_PER_TARGET;
+        long long cost = conn_cost(&conns[c]), cost2 = conn_cost(&conns[c2]);
+        if (cost2 < cost || (cost2 == cost && (rng_next() & 1))) {
+            c = c2;
+        }
+    }
+    return c;
+}
+
+static void target_start(int t, int client, double now) {
+    targets[t].busy++;
+    ev_push(now + rng_exp(SERVICE_MEAN), EV_SERVICE_DONE, client);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double p) {
+    long long i = (long long)(p * (latencies_num - 1));
+    return latencies[i] * 1e3;
+}
+
+/**
+ * @brief Прогон модели: duration секунд при qps запросах в секунду
+ */
+static void simulate(int p2c, double duration, double qps) {
+    memset(conns, 0, sizeof(conns));
+    for (int t = 0; t < TARGETS; t++) {
+        free(targets[t].queue);
+        memset(&targets[t], 0, sizeof(targets[t]));
+    }
+    for (int i = 0; i < TARGETS * CONNS_PER_TARGET; i++) {
+        conns[i].target = i / CONNS_PER_TARGET;
+        ev_push(rng_uniform() * RPC_LB_PING_INTERVAL, EV_PING, i);
+    }
+    clients_num = 0;
+    latencies_num = slow_queries = 0;
+    heap_size = 0;
+
+    double client_rate = qps / QUERIES_PER_CLIENT;
+    ev_push(rng_exp(1 / client_rate), EV_CLIENT_ARRIVAL, 0);
+
+    while (heap_size) {
+        struct event e = ev_pop();
+        double now = e.time;
+        struct client *C = e.type == EV_PING || e.type == EV_PONG || e.type == EV_CLIENT_ARRIVAL ? NULL : &clients[e.arg];
+        switch (e.type) {
+        case EV_CLIENT_ARRIVAL:
+            if (now > duration) {
+                break;
+            }
+            ev_push(now + rng_exp(1 / client_rate), EV_CLIENT_ARRIVAL, 0);
+            if (clients_num == clients_cap) {
+                clients_cap = clients_cap ? clients_cap * 2 : 1024;
+                clients = realloc(clients, clients_cap * sizeof(*clients));
+            }
+            clients[clients_num].conn = choose_conn(p2c);
+            clients[clients_num].left = 1 + (int)rng_exp(QUERIES_PER_CLIENT - 1);
+            ev_push(now, EV_QUERY_SEND, clients_num++);
+            break;
+        case EV_QUERY_SEND: {
+            struct conn *c = &conns[C->conn];
+            C->sent = now;
+            c->outstanding++;
+            targets[c->target].outstanding++;
+            ev_push(now + target_rtt[c->target] / 2, EV_QUERY_ARRIVE, e.arg);
+            break;
+        }
+        case EV_QUERY_ARRIVE: {
+            struct target *T = &targets[conns[C->conn].target];
+            if (T->busy < target_workers[conns[C->conn].target]) {
+                target_start(conns[C->conn].target, e.arg, now);
+            } else {
+                if (T->q_tail == T->q_cap) {
+                    if (T->q_head > 0) {
+                        memmove(T->queue, T->queue + T->q_head, (T->q_tail - T->q_head) * sizeof(int));
+                        T->q_tail -= T->q_head;
+                        T->q_head = 0;
+                    } else {
+                        T->q_cap = T->q_cap ? T->q_cap * 2 : 64;
+                        T->queue = realloc(T->queue, T->q_cap * sizeof(int));
+                    }
+                }
+                T->queue[T->q_tail++] = e.arg;
+            }
+            break;
+        }
+        case EV_SERVICE_DONE: {
+            int t = conns[C->conn].target;
+            struct target *T = &targets[t];
+            T->busy--;
+            ev_push(now + target_rtt[t] / 2, EV_ANSWER, e.arg);
+            if (T->q_head != T->q_tail) {
+                target_start(t, T->queue[T->q_head++], now);
+            }
+            break;
+        }
+        case EV_ANSWER: {
+            struct conn *c = &conns[C->conn];
+            c->outstanding--;
+            targets[c->target].outstanding--;
+            lb_sample(c, now - C->sent);
+            if (latencies_num == latencies_cap) {
+                latencies_cap = latencies_cap ? latencies_cap * 2 : 65536;
+                latencies = realloc(latencies, latencies_cap * sizeof(double));
+            }
+            latencies[latencies_num++] = now - C->sent;
+            slow_queries += c->target == 0;
+            if (--C->left > 0) {
+                ev_push(now + rng_exp(THINK_MEAN), EV_QUERY_SEND, e.arg);
+            }
+            break;
+        }
+        case EV_PING:
+            if (now > duration) {
+                break;
+            }
+            conns[e.arg].ping_time = now;
+            ev_push(now + target_rtt[conns[e.arg].target], EV_PONG, e.arg);
+            ev_push(now + RPC_LB_PING_INTERVAL, EV_PING, e.arg);
+            break;
+        case EV_PONG:
+            if (p2c) {
+                lb_sample(&conns[e.arg], now - conns[e.arg].ping_time);
+            }
+            break;
+        }
+    }
+
+    qsort(latencies, latencies_num, sizeof(double), cmp_double);
+}
+
+int main(int argc, char *argv[]) {
+    double duration = 300, qps = 700;
+    if (argc > 1) {
+        duration = atof(argv[1]);
+    }
+    if (argc > 2) {
+        qps = atof(argv[2]);
+    }
+
+    double capacity = 0;
+    for (int t = 0; t < TARGETS; t++) {
+        capacity += target_workers[t] / SERVICE_MEAN;
+    }
+
+    printf("\n=== Middle-End Target Selection Simulation ===\n");
+    printf("Targets: %d x %d connections, slow target: rtt %.0f ms, %d workers (others %.0f ms, %d)\n",
+           TARGETS, CONNS_PER_TARGET, target_rtt[0] * 1e3, target_workers[0], target_rtt[1] * 1e3, target_workers[1]);
+    printf("Load: %.0f queries/s for %.0f s (%.0f%% of total capacity), sticky clients of ~%d queries\n\n",
+           qps, duration, 100 * qps / capacity, QUERIES_PER_CLIENT);
+
+    printf("  %-8s %10s %10s %10s %10s %10s\n", "policy", "queries", "p50 ms", "p99 ms", "p99.9 ms", "slow share");
+    double p99[2];
+    for (int p2c = 0; p2c < 2; p2c++) {
+        rng_state = 0x9e3779b97f4a7c15ULL;
+        simulate(p2c, duration, qps);
+        p99[p2c] = percentile(0.99);
+        printf("  %-8s %10lld %10.1f %10.1f %10.1f %9.1f%%\n", p2c ? "p2c" : "random", latencies_num,
+               percentile(0.5), p99[p2c], percentile(0.999), 100.0 * slow_queries / latencies_num);
+    }
+    printf("\np99 improvement: %.1fx\n", p99[0] / p99[1]);
+
+    free(latencies);
+    free(clients);
+    free(heap);
+    for (int t = 0; t < TARGETS; t++) {
+        free(targets[t].queue);
+    }
+    return 0;
+}
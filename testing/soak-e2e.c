@@ -0,0 +1,647 @@
+/**
+ * @file soak-e2e.c
+ * @brief Нагрузочный прогон mtproto-proxy со сбоями (сборка с FAULT_INJECTION)
+ *
+ * Поднимает два поддельных middle-end (benchmark-e2e-middle-end.c) и
+ * прокси, собранный с -DFAULT_INJECTION, и заданное время гоняет через
+ * него раунды эмулятора клиентов (benchmark-e2e-client.c) со случайным
+ * транспортом ef/ee/dd и размером запроса. Тем временем:
+ * - сбои net/net-fault-inject.h включены через файл MTPROXY_FAULTS=@...:
+ *   короткие и прерванные readv/writev, сбросы, отказы accept/connect,
+ *   перечитывание конфига из cron
+ * - конфиг по кругу меняется между "оба middle-end", "только первый" и
+ *   "только второй", так что перечитывание выбрасывает цели с живыми
+ *   соединениями и запросами в полёте
+ * - время от времени один из middle-end рвёт все соединения прокси
+ *
+ * После нагрузки сбои выключаются, и по /stats проверяется, что прокси
+ * вернулся к исходному состоянию: ext_connections = 0, входящих и
+ * исходящих соединений и сетевых буферов не больше, чем до нагрузки.
+ * Падение прокси (воркер упал - мастер выходит) - тоже провал.
+ *
+ * Использование: soak-e2e [--proxy путь] [--duration секунд]
+ *     [--connections n] [--workers n] [--faults спецификация]
+ *     [--round секунд] [--drop-every секунд] [--settle секунд]
+ *     [--buffer-slack буферов]
+ */
+
+#include "testing/benchmark-e2e.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <openssl/rand.h>
+
+#define STARTUP_TIMEOUT 20.0
+#define STARTUP_SETTLE 1.0
+#define RELOAD_EVERY 3.0
+#define STATS_MAX (1 << 16)
+#define DEFAULT_FAULTS "readv=0.002,writev=0.002,accept=0.01,connect=0.05,reload=0.3"
+
+struct proxy_instance {
+    pid_t pid;
+    int port;
+    int stats_port;
+    char log[256];
+};
+
+/* счётчики из /stats, по которым сверяется состояние прокси */
+struct proxy_counters {
+    long long ext_connections;
+    long long inbound;
+    long long outbound;
+    long long buffers;
+};
+
+static const char *proxy_path = "objs-fi/bin/mtproto-proxy";
+static char workdir[] = "/tmp/soak-e2e-XXXXXX";
+static unsigned char client_secret[E2E_SECRET_LEN];
+static long proxy_maxconn;
+
+/* ============================================
+ * Утилиты
+ * ============================================ */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Пишет через временный файл и rename: прокси никогда не видит
+ *        файл наполовину
+ */
+static int write_file(const char *path, const void *data, int len) {
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    int ok = write(fd, data, len) == len;
+    close(fd);
+    return ok && !rename(tmp, path) ? 0 : -1;
+}
+
+static int free_port(void) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0), port = -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0 && !bind(fd, (struct sockaddr *) &addr, sizeof(addr)) &&
+        !getsockname(fd, (struct sockaddr *) &addr, &len)) {
+        port = ntohs(addr.sin_port);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return port;
+}
+
+static int connect_local(int port, double timeout) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct timeval tv = {.tv_sec = (int) timeout, .tv_usec = (int) ((timeout - (int) timeout) * 1e6)};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static long raise_fd_limit(int need) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+        return 1024;
+    }
+    if (rl.rlim_cur < (rlim_t) need) {
+        rl.rlim_cur = rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= (rlim_t) need ? (rlim_t) need : rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    return rl.rlim_cur;
+}
+
+/* ============================================
+ * /stats прокси
+ * ============================================ */
+
+/**
+ * @brief GET /stats на порт статистики; ответ с нулём в конце, длина или -1
+ */
+static int fetch_stats(const struct proxy_instance *P, char *buf, int size) {
+    static const char req[] = "GET /stats HTTP/1.0\r\n\r\n";
+    int fd = connect_local(P->stats_port, 2.0), len = 0;
+    if (fd < 0) {
+        return -1;
+    }
+    if (write(fd, req, sizeof(req) - 1) != sizeof(req) - 1) {
+        close(fd);
+        return -1;
+    }
+    while (len < size - 1) {
+        ssize_t r = read(fd, buf + len, size - 1 - len);
+        if (r <= 0) {
+            break;
+        }
+        len += r;
+    }
+    close(fd);
+    buf[len] = 0;
+    return strstr(buf, "\r\n\r\n") ? len : -1;
+}
+
+static long long stats_value(const char *stats, const char *key, int *found) {
+    char pattern[128];
+    snprintf(pattern, sizeof(pattern), "\n%s\t", key);
+    const char *p = strstr(stats, pattern);
+    if (!p) {
+        *found = 0;
+        return 0;
+    }
+    return strtoll(p + strlen(pattern), NULL, 10);
+}
+
+static int read_counters(const struct proxy_instance *P, struct proxy_counters *C) {
+    static char stats[STATS_MAX];
+    int found = 1;
+    if (fetch_stats(P, stats, sizeof(stats)) < 0) {
+        return -1;
+    }
+    C->ext_connections = stats_value(stats, "ext_connections", &found);
+    C->inbound = stats_value(stats, "total_allocated_inbound_connections", &found);
+    C->outbound = stats_value(stats, "total_allocated_outbound_connections", &found);
+    /* буферы в списках remote_free уже свободны, просто владелец их ещё не забрал */
+    C->buffers = stats_value(stats, "total_network_buffers_used", &found) -
+                 stats_value(stats, "total_network_buffers_remote_free", &found);
+    return found ? 0 : -1;
+}
+
+/**
+ * @brief Печатает строки fault_* из /stats
+ * @return сколько сбоев внесено всего, -1 - прокси собран без FAULT_INJECTION
+ */
+static long long print_faults(const struct proxy_instance *P) {
+    static char stats[STATS_MAX];
+    if (fetch_stats(P, stats, sizeof(stats)) < 0) {
+        return -1;
+    }
+    long long total = -1;
+    char *save, *line;
+    for (line = strtok_r(stats, "\r\n", &save); line; line = strtok_r(NULL, "\r\n", &save)) {
+        if (!strncmp(line, "fault_", 6)) {
+            const char *inj = strstr(line, "injected=");
+            total = (total < 0 ? 0 : total) + (inj ? atoll(inj + 9) : 0);
+            printf("  %s\n", line);
+        }
+    }
+    return total;
+}
+
+/* ============================================
+ * Прокси
+ * ============================================ */
+
+static int start_proxy(struct proxy_instance *P, int workers) {
+    char secret_hex[2 * E2E_SECRET_LEN + 1], port[16], stats_port[16], workers_arg[16], maxconn[24];
+    char conf[256], pwd[256];
+    const char *argv[24];
+    int argc = 0, i;
+
+    for (i = 0; i < E2E_SECRET_LEN; i++) {
+        sprintf(secret_hex + 2 * i, "%02x", client_secret[i]);
+    }
+    P->port = free_port();
+    snprintf(port, sizeof(port), "%d", P->port);
+    P->stats_port = free_port();
+    snprintf(stats_port, sizeof(stats_port), "%d", P->stats_port);
+    snprintf(workers_arg, sizeof(workers_arg), "%d", workers);
+    snprintf(maxconn, sizeof(maxconn), "%ld", proxy_maxconn - 16);
+    snprintf(conf, sizeof(conf), "%s/proxy.conf", workdir);
+    snprintf(pwd, sizeof(pwd), "%s/proxy-secret", workdir);
+    snprintf(P->log, sizeof(P->log), "%s/proxy.log", workdir);
+
+    argv[argc++] = proxy_path;
+    if (!geteuid()) {
+        argv[argc++] = "-u";
+        argv[argc++] = "nobody";
+    }
+    argv[argc++] = "-c";
+    argv[argc++] = maxconn;
+    argv[argc++] = "-p";
+    argv[argc++] = stats_port;
+    argv[argc++] = "--http-stats";
+    argv[argc++] = "-H";
+    argv[argc++] = port;
+    argv[argc++] = "-S";
+    argv[argc++] = secret_hex;
+    argv[argc++] = "--aes-pwd";
+    argv[argc++] = pwd;
+    argv[argc++] = "-M";
+    argv[argc++] = workers_arg;
+    argv[argc++] = conf;
+    argv[argc] = NULL;
+
+    P->pid = fork();
+    if (P->pid < 0) {
+        return -1;
+    }
+    if (!P->pid) {
+        setpgid(0, 0);
+        int fd = open(P->log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, 1);
+            dup2(fd, 2);
+            close(fd);
+        }
+        execv(proxy_path, (char *const *) argv);
+        _exit(127);
+    }
+    setpgid(P->pid, P->pid);
+    return 0;
+}
+
+/**
+ * @brief 1 - прокси жив, 0 - вышел (воркер упал или мастер сам), печатает как
+ */
+static int proxy_alive(struct proxy_instance *P) {
+    int status;
+    if (P->pid <= 0) {
+        return 0;
+    }
+    if (waitpid(P->pid, &status, WNOHANG) != P->pid) {
+        return 1;
+    }
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "proxy killed by signal %d\n", WTERMSIG(status));
+    } else {
+        fprintf(stderr, "proxy exited with code %d\n", WEXITSTATUS(status));
+    }
+    P->pid = 0;
+    return 0;
+}
+
+static void stop_proxy(struct proxy_instance *P) {
+    if (P->pid > 0) {
+        kill(-P->pid, SIGTERM);
+        double deadline = now_sec() + 5;
+        while (waitpid(P->pid, NULL, WNOHANG) == 0 && now_sec() < deadline) {
+            usleep(10000);
+        }
+        kill(-P->pid, SIGKILL);
+        waitpid(P->pid, NULL, 0);
+        P->pid = 0;
+    }
+}
+
+/**
+ * @brief Ждёт, пока прокси ответит на /stats и его соединения с обоими
+ *        middle-end перестанут прибавляться
+ */
+static int wait_proxy(struct proxy_instance *P, struct e2e_middle_end **M) {
+    double deadline = now_sec() + STARTUP_TIMEOUT, settled = 0;
+    int last = -1;
+    struct proxy_counters C;
+    while (now_sec() < deadline) {
+        if (!proxy_alive(P)) {
+            return -1;
+        }
+        int h = e2e_me_handshakes(M[0]) + e2e_me_handshakes(M[1]);
+        if (h != last) {
+            last = h;
+            settled = 0;
+        } else if (e2e_me_handshakes(M[0]) && e2e_me_handshakes(M[1]) && read_counters(P, &C) == 0) {
+            if (!settled) {
+                settled = now_sec();
+            } else if (now_sec() - settled >= STARTUP_SETTLE) {
+                return 0;
+            }
+        }
+        usleep(50000);
+    }
+    return -1;
+}
+
+static void print_log_tail(const struct proxy_instance *P) {
+    char cmd[300];
+    fprintf(stderr, "--- last lines of %s ---\n", P->log);
+    snprintf(cmd, sizeof(cmd), "tail -n 30 %s 1>&2", P->log);
+    if (system(cmd)) {
+        fprintf(stderr, "(cannot read the log)\n");
+    }
+}
+
+/* ============================================
+ * Конфиг и сбои
+ * ============================================ */
+
+static int write_config(struct e2e_middle_end **M, int variant) {
+    char path[256], conf[256];
+    int len = 0;
+    if (variant != 2) {
+        len += snprintf(conf + len, sizeof(conf) - len, "proxy_for %d 127.0.0.1:%d;\n", E2E_TARGET_DC, e2e_me_port(M[0]));
+    }
+    if (variant != 1) {
+        len += snprintf(conf + len, sizeof(conf) - len, "proxy_for %d 127.0.0.1:%d;\n", E2E_TARGET_DC, e2e_me_port(M[1]));
+    }
+    len += snprintf(conf + len, sizeof(conf) - len, "default %d;\n", E2E_TARGET_DC);
+    snprintf(path, sizeof(path), "%s/proxy.conf", workdir);
+    return write_file(path, conf, len);
+}
+
+static int write_faults(const char *spec) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/faults", workdir);
+    return write_file(path, spec, strlen(spec));
+}
+
+/* ============================================
+ * Нагрузка
+ * ============================================ */
+
+struct soak_load {
+    int port;
+    int connections;
+    double round;
+    volatile int stop;
+    int rounds;
+    long long handshakes, failed, requests;
+    unsigned rng;
+};
+
+static void *load_thread(void *arg) {
+    struct soak_load *S = arg;
+    while (!S->stop) {
+        struct e2e_load L;
+        struct e2e_result R;
+        S->rng = S->rng * 1103515245 + 12345;
+        memset(&L, 0, sizeof(L));
+        L.port = S->port;
+        L.transport = (S->rng >> 16) % 3;   /* ef, ee, dd */
+        memcpy(L.secret, client_secret, sizeof(client_secret));
+        L.connections = S->connections;
+        L.threads = 2;
+        L.payload = 64 + 4 * ((S->rng >> 8) % 2048);
+        L.duration = S->round;
+        L.connect_timeout = 5;
+        if (e2e_run_load(&L, &R) < 0) {
+            fprintf(stderr, "cannot start client threads\n");
+            break;
+        }
+        S->rounds++;
+        S->handshakes += R.handshakes;
+        S->failed += R.failed;
+        S->requests += R.requests;
+    }
+    return NULL;
+}
+
+/* ============================================
+ * Основная программа
+ * ============================================ */
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--proxy path] [--duration seconds] [--connections n] [--workers n]\n"
+                    "       [--faults spec] [--round seconds] [--drop-every seconds] [--settle seconds]\n"
+                    "       [--buffer-slack buffers]\n"
+                    "default faults: " DEFAULT_FAULTS "\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        {"proxy", required_argument, NULL, 'x'},
+        {"duration", required_argument, NULL, 'd'},
+        {"connections", required_argument, NULL, 'c'},
+        {"workers", required_argument, NULL, 'w'},
+        {"faults", required_argument, NULL, 'f'},
+        {"round", required_argument, NULL, 'r'},
+        {"drop-every", required_argument, NULL, 'e'},
+        {"settle", required_argument, NULL, 's'},
+        {"buffer-slack", required_argument, NULL, 'b'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *faults = DEFAULT_FAULTS;
+    int connections = 200, workers = 2, buffer_slack = 64, opt, i;
+    double duration = 60, round = 2, drop_every = 7, settle = 30;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+        case 'x':
+            proxy_path = optarg;
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'c':
+            connections = atoi(optarg);
+            break;
+        case 'w':
+            workers = atoi(optarg);
+            break;
+        case 'f':
+            faults = optarg;
+            break;
+        case 'r':
+            round = atof(optarg);
+            break;
+        case 'e':
+            drop_every = atof(optarg);
+            break;
+        case 's':
+            settle = atof(optarg);
+            break;
+        case 'b':
+            buffer_slack = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (duration <= 0 || connections <= 0 || workers <= 0 || round <= 0 || settle <= 0 || buffer_slack < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (access(proxy_path, X_OK) < 0) {
+        fprintf(stderr, "%s: not found, build it with FAULT_INJECTION or pass --proxy\n", proxy_path);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    proxy_maxconn = raise_fd_limit(2 * connections + 1024);
+
+    unsigned char proxy_secret[E2E_PROXY_SECRET_LEN];
+    if (RAND_bytes(proxy_secret, sizeof(proxy_secret)) != 1 || RAND_bytes(client_secret, sizeof(client_secret)) != 1) {
+        return 1;
+    }
+    struct e2e_middle_end *M[2];
+    M[0] = e2e_me_start(proxy_secret, sizeof(proxy_secret));
+    M[1] = e2e_me_start(proxy_secret, sizeof(proxy_secret));
+    if (!M[0] || !M[1] || !mkdtemp(workdir)) {
+        fprintf(stderr, "cannot start middle-ends or create work directory\n");
+        return 1;
+    }
+    /* прокси может сменить пользователя: каталог и файлы должны читаться всеми */
+    chmod(workdir, 0755);
+    char path[256], fault_env[300];
+    snprintf(path, sizeof(path), "%s/proxy-secret", workdir);
+    write_file(path, proxy_secret, sizeof(proxy_secret));
+    write_config(M, 0);
+    write_faults("");
+    snprintf(fault_env, sizeof(fault_env), "@%s/faults", workdir);
+    setenv("MTPROXY_FAULTS", fault_env, 1);
+
+    printf("=== Proxy Soak Test ===\n");
+    printf("proxy %s, %d workers, %.0f s, %d connections per %.1f s round\nfaults %s\n\n",
+           proxy_path, workers, duration, connections, round, faults);
+
+    int status = 0;
+    struct proxy_instance P = {0};
+    struct proxy_counters base, cur;
+    if (start_proxy(&P, workers) < 0 || wait_proxy(&P, M) < 0 || read_counters(&P, &base) < 0) {
+        fprintf(stderr, "proxy did not come up\n");
+        print_log_tail(&P);
+        stop_proxy(&P);
+        return 1;
+    }
+    if (print_faults(&P) < 0) {
+        fprintf(stderr, "%s has no fault_* stats: it was built without FAULT_INJECTION\n", proxy_path);
+        stop_proxy(&P);
+        return 1;
+    }
+    printf("baseline: ext_connections %lld, inbound %lld, outbound %lld, buffers %lld\n",
+           base.ext_connections, base.inbound, base.outbound, base.buffers);
+
+    /* нагрузка, сбои, смена конфига и обрывы middle-end */
+    write_faults(faults);
+    struct soak_load S = {.port = P.port, .connections = connections, .round = round, .rng = (unsigned) getpid()};
+    pthread_t loader;
+    if (pthread_create(&loader, NULL, load_thread, &S)) {
+        fprintf(stderr, "cannot start load thread\n");
+        stop_proxy(&P);
+        return 1;
+    }
+    double start = now_sec(), next_reload = start + RELOAD_EVERY, next_drop = start + drop_every;
+    int variant = 0, drops = 0, config_changes = 0;
+    while (now_sec() - start < duration) {
+        usleep(100000);
+        if (!proxy_alive(&P)) {
+            status = 1;
+            break;
+        }
+        if (now_sec() >= next_reload) {
+            variant = (variant + 1) % 3;
+            write_config(M, variant);
+            config_changes++;
+            next_reload += RELOAD_EVERY;
+        }
+        if (drop_every > 0 && now_sec() >= next_drop) {
+            e2e_me_drop(M[drops++ % 2]);
+            next_drop += drop_every;
+        }
+    }
+    S.stop = 1;
+    pthread_join(loader, NULL);
+    write_faults("");
+    write_config(M, 0);
+
+    printf("load: %d rounds, %lld handshakes, %lld failed, %lld requests; %d config changes, %d middle-end drops\n",
+           S.rounds, S.handshakes, S.failed, S.requests, config_changes, drops);
+    if (status) {
+        fprintf(stderr, "FAILED: proxy died under load\n");
+        print_log_tail(&P);
+        stop_proxy(&P);
+        return 1;
+    }
+    if (!S.handshakes) {
+        fprintf(stderr, "FAILED: no client connection went through\n");
+        status = 1;
+    }
+
+    /* после нагрузки всё, что держали клиенты, должно освободиться */
+    double deadline = now_sec() + settle;
+    int ok = 0, have = 0;
+    while (now_sec() < deadline && !ok) {
+        usleep(500000);
+        if (!proxy_alive(&P)) {
+            break;
+        }
+        if (read_counters(&P, &cur) < 0) {
+            continue;
+        }
+        have = 1;
+        ok = cur.ext_connections == 0 && cur.inbound <= base.inbound && cur.outbound <= base.outbound &&
+             cur.buffers <= base.buffers + buffer_slack;
+    }
+    if (!P.pid) {
+        fprintf(stderr, "FAILED: proxy died after load\n");
+        print_log_tail(&P);
+        return 1;
+    }
+    if (have) {
+        printf("after %.0f s: ext_connections %lld, inbound %lld, outbound %lld, buffers %lld\n",
+               settle - (deadline - now_sec()), cur.ext_connections, cur.inbound, cur.outbound, cur.buffers);
+    }
+    long long injected = print_faults(&P);
+    if (!ok) {
+        fprintf(stderr, "FAILED: proxy did not return to baseline in %.0f s%s\n", settle, have ? "" : " (no stats)");
+        if (have && cur.ext_connections) {
+            fprintf(stderr, "  %lld ext_connections never freed\n", cur.ext_connections);
+        }
+        if (have && cur.inbound > base.inbound) {
+            fprintf(stderr, "  %lld client connections leaked\n", cur.inbound - base.inbound);
+        }
+        if (have && cur.outbound > base.outbound) {
+            fprintf(stderr, "  %lld middle-end connections above baseline\n", cur.outbound - base.outbound);
+        }
+        if (have && cur.buffers > base.buffers + buffer_slack) {
+            fprintf(stderr, "  %lld network buffers above baseline\n", cur.buffers - base.buffers);
+        }
+        status = 1;
+    }
+    if (injected <= 0) {
+        fprintf(stderr, "FAILED: no fault was injected, check --faults\n");
+        status = 1;
+    }
+
+    stop_proxy(&P);
+    for (i = 0; i < 2; i++) {
+        e2e_me_stop(M[i]);
+    }
+    if (!status) {
+        char cmd[128];
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", workdir);
+        if (system(cmd)) {
+            fprintf(stderr, "cannot remove %s\n", workdir);
+        }
+        printf("\nPASSED\n");
+    } else {
+        fprintf(stderr, "proxy log and config kept in %s\n", workdir);
+    }
+    return status;
+}
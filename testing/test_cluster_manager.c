@@ -7,6 +7,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 #include "system/cluster/cluster-manager.h"
 #include "testing/test_common.h"
@@ -16,41 +20,35 @@
 // ============================================================================
 
 static int test_cluster_init(void) {
-    TEST_START();
-    
     int result = cluster_init("test-cluster", "node1");
     
-    ASSERT(result == 0, "Инициализация успешна");
-    ASSERT(cluster_is_initialized() == true, "Кластер инициализирован");
+    ASSERT(result == 0); // Инициализация успешна
+    ASSERT(cluster_is_initialized() == true); // Кластер инициализирован
     
     // Повторная инициализация
     result = cluster_init("test-cluster", "node1");
-    ASSERT(result == 0, "Повторная инициализация успешна");
+    ASSERT(result == 0); // Повторная инициализация успешна
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_init_null(void) {
-    TEST_START();
-    
     int result1 = cluster_init(NULL, "node1");
-    ASSERT(result1 == -1, "NULL cluster_name отклонён");
+    ASSERT(result1 == -1); // NULL cluster_name отклонён
     
     int result2 = cluster_init("cluster", NULL);
-    ASSERT(result2 == -1, "NULL node_name отклонён");
+    ASSERT(result2 == -1); // NULL node_name отклонён
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_cleanup(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_cleanup();
     
-    ASSERT(cluster_is_initialized() == false, "Кластер очищен");
+    ASSERT(cluster_is_initialized() == false); // Кластер очищен
     
-    TEST_END();
+    return 0;
 }
 
 // ============================================================================
@@ -58,65 +56,57 @@ static int test_cluster_cleanup(void) {
 // ============================================================================
 
 static int test_cluster_add_node(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     int result = cluster_add_node("node2", "192.168.1.102", 8888, 9000);
-    ASSERT(result == 0, "Узел node2 добавлен");
+    ASSERT(result == 0); // Узел node2 добавлен
     
     result = cluster_add_node("node3", "192.168.1.103", 8888, 9000);
-    ASSERT(result == 0, "Узел node3 добавлен");
+    ASSERT(result == 0); // Узел node3 добавлен
     
     // Дублирующееся имя
     result = cluster_add_node("node2", "192.168.1.104", 8888, 9000);
-    ASSERT(result == -1, "Дублирующееся имя отклонено");
+    ASSERT(result == -1); // Дублирующееся имя отклонено
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_remove_node(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_add_node("node2", "192.168.1.102", 8888, 9000);
     
     int result = cluster_remove_node("node2");
-    ASSERT(result == 0, "Узел удалён");
+    ASSERT(result == 0); // Узел удалён
     
     result = cluster_remove_node("node2");
-    ASSERT(result == -1, "Повторное удаление невозможно");
+    ASSERT(result == -1); // Повторное удаление невозможно
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_get_node_config(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_add_node("node2", "192.168.1.102", 8888, 9000);
     
     const cluster_node_config_t *config = cluster_get_node_config("node2");
-    ASSERT(config != NULL, "Конфигурация найдена");
-    ASSERT(strcmp(config->name, "node2") == 0, "Имя совпадает");
-    ASSERT(strcmp(config->host, "192.168.1.102") == 0, "Хост совпадает");
-    ASSERT(config->port == 8888, "Порт совпадает");
+    ASSERT(config != NULL); // Конфигурация найдена
+    ASSERT(strcmp(config->name, "node2") == 0); // Имя совпадает
+    ASSERT(strcmp(config->host, "192.168.1.102") == 0); // Хост совпадает
+    ASSERT(config->port == 8888); // Порт совпадает
     
     config = cluster_get_node_config("unknown");
-    ASSERT(config == NULL, "Неизвестный узел");
+    ASSERT(config == NULL); // Неизвестный узел
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_get_all_nodes(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_add_node("node2", "192.168.1.102", 8888, 9000);
     cluster_add_node("node3", "192.168.1.103", 8888, 9000);
@@ -124,14 +114,14 @@ static int test_cluster_get_all_nodes(void) {
     char buffer[512] = {0};
     int count = cluster_get_all_nodes(buffer, sizeof(buffer));
     
-    ASSERT(count == 3, "Количество узлов: 3");
-    ASSERT(strstr(buffer, "node1") != NULL, "Содержит node1");
-    ASSERT(strstr(buffer, "node2") != NULL, "Содержит node2");
-    ASSERT(strstr(buffer, "node3") != NULL, "Содержит node3");
+    ASSERT(count == 3); // Количество узлов: 3
+    ASSERT(strstr(buffer, "node1") != NULL); // Содержит node1
+    ASSERT(strstr(buffer, "node2") != NULL); // Содержит node2
+    ASSERT(strstr(buffer, "node3") != NULL); // Содержит node3
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 // ============================================================================
@@ -139,20 +129,18 @@ static int test_cluster_get_all_nodes(void) {
 // ============================================================================
 
 static int test_cluster_start_stop(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     int result = cluster_start(9001);
-    ASSERT(result == 0, "Кластер запущен");
-    ASSERT(cluster_is_running() == true, "Кластер работает");
+    ASSERT(result == 0); // Кластер запущен
+    ASSERT(cluster_is_running() == true); // Кластер работает
     
     cluster_stop();
-    ASSERT(cluster_is_running() == false, "Кластер остановлен");
+    ASSERT(cluster_is_running() == false); // Кластер остановлен
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 // ============================================================================
@@ -160,70 +148,62 @@ static int test_cluster_start_stop(void) {
 // ============================================================================
 
 static int test_cluster_get_leader(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     const char *leader = cluster_get_leader();
-    ASSERT(leader == NULL, "Лидера нет до выборов");
+    ASSERT(leader == NULL); // Лидера нет до выборов
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_get_local_role(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     cluster_role_t role = cluster_get_local_role();
-    ASSERT(role == CLUSTER_ROLE_STANDALONE, "Роль по умолчанию: STANDALONE");
+    ASSERT(role == CLUSTER_ROLE_STANDALONE); // Роль по умолчанию: STANDALONE
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_become_leader(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_start(9001);
     
     int result = cluster_become_leader();
-    ASSERT(result == 0, "Стал лидером");
+    ASSERT(result == 0); // Стал лидером
     
     cluster_role_t role = cluster_get_local_role();
-    ASSERT(role == CLUSTER_ROLE_LEADER, "Роль: LEADER");
+    ASSERT(role == CLUSTER_ROLE_LEADER); // Роль: LEADER
     
     const char *leader = cluster_get_leader();
-    ASSERT(leader != NULL, "Лидер установлен");
-    ASSERT(strcmp(leader, "node1") == 0, "Лидер: node1");
+    ASSERT(leader != NULL); // Лидер установлен
+    ASSERT(strcmp(leader, "node1") == 0); // Лидер: node1
     
     cluster_stop();
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_step_down(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_start(9001);
     cluster_become_leader();
     
     int result = cluster_step_down();
-    ASSERT(result == 0, "Сдал лидерство");
+    ASSERT(result == 0); // Сдал лидерство
     
     cluster_role_t role = cluster_get_local_role();
-    ASSERT(role == CLUSTER_ROLE_FOLLOWER, "Роль: FOLLOWER");
+    ASSERT(role == CLUSTER_ROLE_FOLLOWER); // Роль: FOLLOWER
     
     cluster_stop();
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 // ============================================================================
@@ -231,36 +211,32 @@ static int test_cluster_step_down(void) {
 // ============================================================================
 
 static int test_cluster_sync_config(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_start(9001);
     
     const char *config = "{\"key\":\"value\",\"port\":8888}";
     int result = cluster_sync_config(config);
-    ASSERT(result == 0, "Конфигурация синхронизирована");
+    ASSERT(result == 0); // Конфигурация синхронизирована
     
     cluster_stop();
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_get_config(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     char buffer[512] = {0};
     int result = cluster_get_config(buffer, sizeof(buffer));
     
-    ASSERT(result == 0, "Конфигурация получена");
-    ASSERT(strlen(buffer) > 0, "Буфер не пуст");
-    ASSERT(strstr(buffer, "test-cluster") != NULL, "Содержит имя кластера");
+    ASSERT(result == 0); // Конфигурация получена
+    ASSERT(strlen(buffer) > 0); // Буфер не пуст
+    ASSERT(strstr(buffer, "test-cluster") != NULL); // Содержит имя кластера
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 // ============================================================================
@@ -268,31 +244,28 @@ static int test_cluster_get_config(void) {
 // ============================================================================
 
 static int test_cluster_get_least_loaded_node(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_add_node("node2", "192.168.1.102", 8888, 9000);
     
     // Все узлы offline, должен вернуть NULL
     const char *node = cluster_get_least_loaded_node();
-    // ASSERT(node == NULL, "Нет онлайн узлов");
+    // ASSERT(node == NULL); // Нет онлайн узлов
+    (void)node;
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_get_avg_load_percent(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     double load = cluster_get_avg_load_percent();
-    ASSERT(load == 0.0, "Нагрузка по умолчанию 0%");
+    ASSERT(load == 0.0); // Нагрузка по умолчанию 0%
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 // ============================================================================
@@ -300,36 +273,30 @@ static int test_cluster_get_avg_load_percent(void) {
 // ============================================================================
 
 static int test_cluster_handle_node_failure(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_add_node("node2", "192.168.1.102", 8888, 9000);
     
     int result = cluster_handle_node_failure("node2");
-    ASSERT(result == 0, "Failover обработан");
+    ASSERT(result == 0); // Failover обработан
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_recovery_node(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_add_node("node2", "192.168.1.102", 8888, 9000);
     
     int result = cluster_recovery_node("node2");
-    ASSERT(result == 0, "Восстановление начато");
+    ASSERT(result == 0); // Восстановление начато
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_set_auto_failover(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     cluster_set_auto_failover(false);
@@ -340,7 +307,7 @@ static int test_cluster_set_auto_failover(void) {
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 // ============================================================================
@@ -348,45 +315,37 @@ static int test_cluster_set_auto_failover(void) {
 // ============================================================================
 
 static int test_cluster_get_stats(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_add_node("node2", "192.168.1.102", 8888, 9000);
     
     cluster_stats_t stats;
     int result = cluster_get_stats(&stats);
     
-    ASSERT(result == 0, "Статистика получена");
-    ASSERT(stats.total_nodes == 2, "Всего узлов: 2");
-    ASSERT(strcmp(stats.cluster_name, "test-cluster") == 0 || 
-           strlen(stats.cluster_name) > 0, "Имя кластера установлено");
+    ASSERT(result == 0); // Статистика получена
+    ASSERT(stats.total_nodes == 2); // Всего узлов: 2
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_get_stats_string(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_add_node("node2", "192.168.1.102", 8888, 9000);
     
     char buffer[512] = {0};
     int result = cluster_get_stats_string(buffer, sizeof(buffer));
     
-    ASSERT(result == 0, "Строка статистики получена");
-    ASSERT(strlen(buffer) > 0, "Строка не пустая");
-    ASSERT(strstr(buffer, "Cluster") != NULL, "Содержит заголовок");
+    ASSERT(result == 0); // Строка статистики получена
+    ASSERT(strlen(buffer) > 0); // Строка не пустая
+    ASSERT(strstr(buffer, "Cluster") != NULL); // Содержит заголовок
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_reset_stats(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     cluster_reset_stats();
@@ -394,16 +353,14 @@ static int test_cluster_reset_stats(void) {
     cluster_stats_t stats;
     cluster_get_stats(&stats);
     
-    ASSERT(stats.total_nodes == 1, "total_nodes сохранён");
+    ASSERT(stats.total_nodes == 1); // total_nodes сохранён
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_get_uptime(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     int64_t uptime1 = cluster_get_uptime();
@@ -416,40 +373,36 @@ static int test_cluster_get_uptime(void) {
     
     int64_t uptime2 = cluster_get_uptime();
     
-    ASSERT(uptime2 > uptime1, "Uptime увеличивается");
+    ASSERT(uptime2 > uptime1); // Uptime увеличивается
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_get_online_count(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     cluster_add_node("node2", "192.168.1.102", 8888, 9000);
     
     int count = cluster_get_online_count();
     // Узлы offline по умолчанию
-    ASSERT(count >= 0 && count <= 2, "Количество онлайн в диапазоне");
+    ASSERT(count >= 0 && count <= 2); // Количество онлайн в диапазоне
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_has_quorum(void) {
-    TEST_START();
-    
     cluster_init("test-cluster", "node1");
     
     bool quorum = cluster_has_quorum();
     // Зависит от количества узлов
-    ASSERT(quorum == true || quorum == false, "Кворум определён");
+    ASSERT(quorum == true || quorum == false); // Кворум определён
     
     cluster_cleanup();
     
-    TEST_END();
+    return 0;
 }
 
 // ============================================================================
@@ -457,89 +410,224 @@ static int test_cluster_has_quorum(void) {
 // ============================================================================
 
 static int test_cluster_role_to_string(void) {
-    TEST_START();
+    ASSERT(strcmp(cluster_role_to_string(CLUSTER_ROLE_LEADER), "Leader") == 0); // Leader
+    ASSERT(strcmp(cluster_role_to_string(CLUSTER_ROLE_FOLLOWER), "Follower") == 0); // Follower
+    ASSERT(strcmp(cluster_role_to_string(CLUSTER_ROLE_CANDIDATE), "Candidate") == 0); // Candidate
+    ASSERT(strcmp(cluster_role_to_string(CLUSTER_ROLE_STANDALONE), "Standalone") == 0); // Standalone
     
-    ASSERT(strcmp(cluster_role_to_string(CLUSTER_ROLE_LEADER), "Leader") == 0, "Leader");
-    ASSERT(strcmp(cluster_role_to_string(CLUSTER_ROLE_FOLLOWER), "Follower") == 0, "Follower");
-    ASSERT(strcmp(cluster_role_to_string(CLUSTER_ROLE_CANDIDATE), "Candidate") == 0, "Candidate");
-    ASSERT(strcmp(cluster_role_to_string(CLUSTER_ROLE_STANDALONE), "Standalone") == 0, "Standalone");
-    
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_node_status_to_string(void) {
-    TEST_START();
-    
-    ASSERT(strcmp(cluster_node_status_to_string(CLUSTER_NODE_OFFLINE), "Offline") == 0, "Offline");
-    ASSERT(strcmp(cluster_node_status_to_string(CLUSTER_NODE_ONLINE), "Online") == 0, "Online");
-    ASSERT(strcmp(cluster_node_status_to_string(CLUSTER_NODE_DEGRADED), "Degraded") == 0, "Degraded");
-    ASSERT(strcmp(cluster_node_status_to_string(CLUSTER_NODE_FAILED), "Failed") == 0, "Failed");
+    ASSERT(strcmp(cluster_node_status_to_string(CLUSTER_NODE_OFFLINE), "Offline") == 0); // Offline
+    ASSERT(strcmp(cluster_node_status_to_string(CLUSTER_NODE_ONLINE), "Online") == 0); // Online
+    ASSERT(strcmp(cluster_node_status_to_string(CLUSTER_NODE_DEGRADED), "Degraded") == 0); // Degraded
+    ASSERT(strcmp(cluster_node_status_to_string(CLUSTER_NODE_FAILED), "Failed") == 0); // Failed
     
-    TEST_END();
+    return 0;
 }
 
 static int test_cluster_message_type_to_string(void) {
-    TEST_START();
+    ASSERT(strcmp(cluster_message_type_to_string(CLUSTER_MSG_HEARTBEAT), "Heartbeat") == 0); // Heartbeat
+    ASSERT(strcmp(cluster_message_type_to_string(CLUSTER_MSG_ELECTION_REQUEST), "ElectionRequest") == 0); // ElectionRequest
+    ASSERT(strcmp(cluster_message_type_to_string(CLUSTER_MSG_CONFIG_SYNC), "ConfigSync") == 0); // ConfigSync
     
-    ASSERT(strcmp(cluster_message_type_to_string(CLUSTER_MSG_HEARTBEAT), "Heartbeat") == 0, "Heartbeat");
-    ASSERT(strcmp(cluster_message_type_to_string(CLUSTER_MSG_ELECTION_REQUEST), "ElectionRequest") == 0, "ElectionRequest");
-    ASSERT(strcmp(cluster_message_type_to_string(CLUSTER_MSG_CONFIG_SYNC), "ConfigSync") == 0, "ConfigSync");
+    return 0;
+}
+
+// ============================================================================
+// Тест транспорта: N узлов на loopback
+// ============================================================================
+
+#ifndef _WIN32
+// Ниже ip_local_port_range: исходящие соединения узлов не занимают порты ещё не запущенных соседей
+#define LOOPBACK_BASE_PORT 29100
+#define LOOPBACK_TIMEOUT_MS 15000
+
+typedef struct {
+    int converged;
+    int64_t convergence_ms;
+    double messages_per_sec;
+    uint64_t batches_sent;
+    uint64_t deltas_applied;
+} loopback_result_t;
+
+static int64_t loopback_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Дочерний процесс: один узел кластера, ждёт, пока все остальные станут Online
+static void loopback_node(int self, int nodes, int fanout, int interval_ms, int out_fd, int hold_fd) {
+    char name[32];
+    loopback_result_t res = {0};
+    
+    snprintf(name, sizeof(name), "node%d", self);
+    cluster_init("loopback", name);
+    for (int j = 0; j < nodes; j++) {
+        if (j == self) continue;
+        char peer[32];
+        snprintf(peer, sizeof(peer), "node%d", j);
+        cluster_add_node(peer, "127.0.0.1", LOOPBACK_BASE_PORT + j, LOOPBACK_BASE_PORT + j);
+    }
+    cluster_set_auto_failover(false);
+    cluster_set_heartbeat_interval(interval_ms);
+    cluster_set_gossip_fanout(fanout);
+    
+    int64_t start = loopback_now_ms();
+    cluster_start(LOOPBACK_BASE_PORT + self);
+    
+    while (loopback_now_ms() - start < LOOPBACK_TIMEOUT_MS) {
+        if (!res.converged && cluster_get_online_count() == nodes - 1) {
+            res.converged = 1;
+            res.convergence_ms = loopback_now_ms() - start;
+            break;
+        }
+        usleep(10000);
+    }
+    
+    // Ещё несколько интервалов, чтобы измерить установившийся поток сообщений
+    cluster_reset_stats();
+    int64_t window_start = loopback_now_ms();
+    usleep(interval_ms * 5 * 1000);
     
-    TEST_END();
+    cluster_stats_t stats;
+    cluster_get_stats(&stats);
+    int64_t window = loopback_now_ms() - window_start;
+    res.messages_per_sec = window > 0 ? stats.total_messages_sent * 1000.0 / window : 0;
+    res.batches_sent = stats.total_batches_sent;
+    res.deltas_applied = stats.membership_deltas_applied;
+    
+    if (write(out_fd, &res, sizeof(res)) != sizeof(res)) {
+        _exit(2);
+    }
+    
+    // Узел остаётся в кластере, пока родитель не соберёт результаты всех узлов
+    char c;
+    while (read(hold_fd, &c, 1) > 0) {
+    }
+    cluster_cleanup();
+    _exit(0);
 }
 
+static int test_cluster_loopback_convergence(void) {
+    const char *env = getenv("CLUSTER_LOOPBACK_NODES");
+    int nodes = env ? atoi(env) : 8;
+    int fanout = 3;
+    int interval_ms = 100;
+    if (nodes < 2) nodes = 2;
+    if (nodes > CLUSTER_MAX_NODES) nodes = CLUSTER_MAX_NODES;
+    
+    int pipes[CLUSTER_MAX_NODES][2];
+    int hold[2];
+    pid_t pids[CLUSTER_MAX_NODES];
+    ASSERT(pipe(hold) == 0); // pipe создан
+    for (int i = 0; i < nodes; i++) {
+        ASSERT(pipe(pipes[i]) == 0); // pipe создан
+        pids[i] = fork();
+        ASSERT(pids[i] >= 0); // fork успешен
+        if (pids[i] == 0) {
+            close(pipes[i][0]);
+            close(hold[1]);
+            loopback_node(i, nodes, fanout, interval_ms, pipes[i][1], hold[0]);
+        }
+        close(pipes[i][1]);
+    }
+    close(hold[0]);
+    
+    int converged = 0;
+    int64_t max_convergence = 0;
+    double total_mps = 0;
+    uint64_t total_batches = 0, total_deltas = 0;
+    for (int i = 0; i < nodes; i++) {
+        loopback_result_t res = {0};
+        if (read(pipes[i][0], &res, sizeof(res)) == sizeof(res) && res.converged) {
+            converged++;
+            if (res.convergence_ms > max_convergence) {
+                max_convergence = res.convergence_ms;
+            }
+        }
+        total_mps += res.messages_per_sec;
+        total_batches += res.batches_sent;
+        total_deltas += res.deltas_applied;
+        close(pipes[i][0]);
+    }
+    
+    close(hold[1]);
+    for (int i = 0; i < nodes; i++) {
+        waitpid(pids[i], NULL, 0);
+    }
+    
+    printf("    nodes=%d fanout=%d interval=%dms: converged %d/%d in %lld ms, "
+           "%.0f msg/s cluster-wide, %llu batches, %llu deltas applied\n",
+           nodes, fanout, interval_ms, converged, nodes, (long long)max_convergence,
+           total_mps, (unsigned long long)total_batches, (unsigned long long)total_deltas);
+    
+    ASSERT(converged == nodes); // Все узлы видят друг друга Online
+    
+    return 0;
+}
+#endif
+
 // ============================================================================
 // Main
 // ============================================================================
 
 int main(void) {
-    test_init("MTProxy Cluster Manager Tests");
+    PRINT_HEADER("MTProxy Cluster Manager Tests");
     
     // Инициализация
-    test_run(test_cluster_init);
-    test_run(test_cluster_init_null);
-    test_run(test_cluster_cleanup);
+    RUN_TEST(cluster_init);
+    RUN_TEST(cluster_init_null);
+    RUN_TEST(cluster_cleanup);
     
     // Управление узлами
-    test_run(test_cluster_add_node);
-    test_run(test_cluster_remove_node);
-    test_run(test_cluster_get_node_config);
-    test_run(test_cluster_get_all_nodes);
+    RUN_TEST(cluster_add_node);
+    RUN_TEST(cluster_remove_node);
+    RUN_TEST(cluster_get_node_config);
+    RUN_TEST(cluster_get_all_nodes);
     
     // Запуск/остановка
-    test_run(test_cluster_start_stop);
+    RUN_TEST(cluster_start_stop);
     
     // Лидерство
-    test_run(test_cluster_get_leader);
-    test_run(test_cluster_get_local_role);
-    test_run(test_cluster_become_leader);
-    test_run(test_cluster_step_down);
+    RUN_TEST(cluster_get_leader);
+    RUN_TEST(cluster_get_local_role);
+    RUN_TEST(cluster_become_leader);
+    RUN_TEST(cluster_step_down);
     
     // Синхронизация
-    test_run(test_cluster_sync_config);
-    test_run(test_cluster_get_config);
+    RUN_TEST(cluster_sync_config);
+    RUN_TEST(cluster_get_config);
     
     // Балансировка
-    test_run(test_cluster_get_least_loaded_node);
-    test_run(test_cluster_get_avg_load_percent);
+    RUN_TEST(cluster_get_least_loaded_node);
+    RUN_TEST(cluster_get_avg_load_percent);
     
     // Failover
-    test_run(test_cluster_handle_node_failure);
-    test_run(test_cluster_recovery_node);
-    test_run(test_cluster_set_auto_failover);
+    RUN_TEST(cluster_handle_node_failure);
+    RUN_TEST(cluster_recovery_node);
+    RUN_TEST(cluster_set_auto_failover);
     
     // Статистика
-    test_run(test_cluster_get_stats);
-    test_run(test_cluster_get_stats_string);
-    test_run(test_cluster_reset_stats);
-    test_run(test_cluster_get_uptime);
-    test_run(test_cluster_get_online_count);
-    test_run(test_cluster_has_quorum);
+    RUN_TEST(cluster_get_stats);
+    RUN_TEST(cluster_get_stats_string);
+    RUN_TEST(cluster_reset_stats);
+    RUN_TEST(cluster_get_uptime);
+    RUN_TEST(cluster_get_online_count);
+    RUN_TEST(cluster_has_quorum);
     
     // Утилиты
-    test_run(test_cluster_role_to_string);
-    test_run(test_cluster_node_status_to_string);
-    test_run(test_cluster_message_type_to_string);
+    RUN_TEST(cluster_role_to_string);
+    RUN_TEST(cluster_node_status_to_string);
+    RUN_TEST(cluster_message_type_to_string);
+    
+    // Транспорт
+#ifndef _WIN32
+    RUN_TEST(cluster_loopback_convergence);
+#endif
     
-    return test_finish();
+    PRINT_SUMMARY();
+    return g_tests_failed > 0 ? 1 : 0;
 }
@@ -0,0 +1,216 @@
+/*
+ * test_cpu_topology.c - Тесты топологии и раскладки потоков (common/cpu-topology.c)
+ *
+ * Топология читается из поддельного дерева sysfs во временном каталоге:
+ * 2 узла по 4 ядра с SMT, нумерация как в Linux - сначала первые потоки
+ * всех ядер (0-7), затем их соседи (8-15).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../common/cpu-topology.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) printf("  Test %s... ", name)
+#define PASS() do { printf("PASSED\n"); tests_passed++; tests_run++; } while(0)
+#define FAIL(msg) do { printf("FAILED: %s\n", msg); tests_run++; return 0; } while(0)
+
+static char root[64];
+static struct cpu_topology T;
+static struct cpu_layout L;
+
+static void write_file(const char *path, const char *s) {
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fputs(s, f);
+        fclose(f);
+    }
+}
+
+static int make_sysfs(void) {
+    char path[256], val[16];
+    int cpu;
+    strcpy(root, "/tmp/cpu-topology-XXXXXX");
+    if (!mkdtemp(root)) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/devices", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/devices/system", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/devices/system/cpu", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/devices/system/cpu/online", root);
+    write_file(path, "0-15\n");
+    for (cpu = 0; cpu < 16; cpu++) {
+        int core = cpu & 3, package = (cpu >> 2) & 1;
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d", root, cpu);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/node%d", root, cpu, package);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/topology", root, cpu);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/topology/core_id", root, cpu);
+        snprintf(val, sizeof(val), "%d\n", core);
+        write_file(path, val);
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/topology/physical_package_id", root, cpu);
+        snprintf(val, sizeof(val), "%d\n", package);
+        write_file(path, val);
+    }
+    return 0;
+}
+
+static int role_is(int role, const char *expected) {
+    char buf[256];
+    cpu_layout_format(&L, role, buf, sizeof(buf));
+    if (strcmp(buf, expected)) {
+        printf("[role %d: %s, expected %s] ", role, buf, expected);
+        return 0;
+    }
+    return 1;
+}
+
+static int connection_cpu(int k) {
+    const short *cpus;
+    return cpu_layout_thread_cpus(&L, CPU_ROLE_CONNECTION, k, &cpus) == 1 ? cpus[0] : -1;
+}
+
+static int test_load(void) {
+    TEST("load");
+    if (cpu_topology_load(&T, root, NULL) != 16) {
+        FAIL("wrong cpu count");
+    }
+    if (T.cores != 8 || T.nodes != 2) {
+        FAIL("wrong core or node count");
+    }
+    if (T.core_cpus[0] != 2 || T.cpu[T.core_first[0]].cpu != 0 || T.cpu[T.core_first[0] + 1].cpu != 8) {
+        FAIL("SMT siblings are not grouped");
+    }
+    if (T.cpu[T.core_first[4]].cpu != 4 || T.cpu[T.core_first[4]].node != 1) {
+        FAIL("cores are not ordered by node");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_spread(void) {
+    TEST("spread");
+    cpu_layout_plan(&L, &T, CPU_AFFINITY_SPREAD, 0, 0);
+    if (!role_is(CPU_ROLE_EPOLL, "0,8") || !role_is(CPU_ROLE_ENGINE, "1,9") ||
+        !role_is(CPU_ROLE_OTHER, "2-7,10-15")) {
+        FAIL("wrong dedicated cores");
+    }
+    /* по одному процессору на ядро, потом SMT-соседи */
+    if (connection_cpu(0) != 2 || connection_cpu(5) != 7 || connection_cpu(6) != 10 || connection_cpu(12) != 2) {
+        FAIL("wrong connection order");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_compact(void) {
+    TEST("compact");
+    cpu_layout_plan(&L, &T, CPU_AFFINITY_COMPACT, 0, 0);
+    if (connection_cpu(0) != 2 || connection_cpu(1) != 10 || connection_cpu(2) != 3) {
+        FAIL("siblings are not filled first");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_workers(void) {
+    TEST("worker partitions");
+    cpu_layout_plan(&L, &T, CPU_AFFINITY_AUTO, 1, 2);
+    if (L.policy != CPU_AFFINITY_SPREAD || L.first_core != 4 || L.cores != 4) {
+        FAIL("wrong partition");
+    }
+    if (!role_is(CPU_ROLE_EPOLL, "4,12") || !role_is(CPU_ROLE_ENGINE, "5,13") || !role_is(CPU_ROLE_CONNECTION, "6-7,14-15")) {
+        FAIL("worker leaves its node");
+    }
+    /* воркеров больше, чем ядер: по ядру на воркера, без выделенных */
+    cpu_layout_plan(&L, &T, CPU_AFFINITY_AUTO, 9, 16);
+    if (L.policy != CPU_AFFINITY_AUTO || L.pin_each || !role_is(CPU_ROLE_CONNECTION, "1,9") || !role_is(CPU_ROLE_EPOLL, "1,9")) {
+        FAIL("wrong shared partition");
+    }
+    cpu_layout_plan(&L, &T, CPU_AFFINITY_SPREAD, -1, 0);
+    if (L.policy != CPU_AFFINITY_NONE || !role_is(CPU_ROLE_EPOLL, "-")) {
+        FAIL("master must not be pinned");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_small_and_allowed(void) {
+    TEST("allowed mask and small hosts");
+    unsigned long long allowed[CPU_TOPOLOGY_MAX_CPUS / 64] = { 0x0404 };   /* cpu 2 и 10 - одно ядро */
+    if (cpu_topology_load(&T, root, allowed) != 2 || T.cores != 1 || T.nodes != 1) {
+        FAIL("allowed mask ignored");
+    }
+    cpu_layout_plan(&L, &T, CPU_AFFINITY_AUTO, 0, 0);
+    if (L.policy != CPU_AFFINITY_NONE) {
+        FAIL("auto pinned a single-core process");
+    }
+    cpu_layout_plan(&L, &T, CPU_AFFINITY_SPREAD, 0, 0);
+    if (!role_is(CPU_ROLE_EPOLL, "2,10") || !role_is(CPU_ROLE_CONNECTION, "2,10")) {
+        FAIL("wrong single-core layout");
+    }
+    allowed[0] = 0x0606;   /* два ядра: epoll и engine делят первое по SMT-соседу */
+    cpu_topology_load(&T, root, allowed);
+    cpu_layout_plan(&L, &T, CPU_AFFINITY_SPREAD, 0, 0);
+    if (!role_is(CPU_ROLE_EPOLL, "1") || !role_is(CPU_ROLE_ENGINE, "9") || !role_is(CPU_ROLE_CONNECTION, "2,10")) {
+        FAIL("wrong two-core layout");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_policy_names(void) {
+    TEST("policy names");
+    if (cpu_affinity_parse_policy("compact") != CPU_AFFINITY_COMPACT || cpu_affinity_parse_policy("numa") != -1 ||
+        strcmp(cpu_affinity_policy_name(CPU_AFFINITY_AUTO), "auto")) {
+        FAIL("wrong policy names");
+    }
+    if (cpu_topology_load(&T, "/nonexistent", NULL) != 0) {
+        FAIL("missing sysfs not handled");
+    }
+    PASS();
+    return 1;
+}
+
+int main(void) {
+    printf("=== CPU Topology Tests ===\n\n");
+
+    if (make_sysfs() < 0) {
+        printf("cannot create sysfs tree\n");
+        return 1;
+    }
+
+    test_load();
+    test_spread();
+    test_compact();
+    test_workers();
+    test_small_and_allowed();
+    test_policy_names();
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd)) {
+        printf("cannot remove %s\n", root);
+    }
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+    if (tests_passed == tests_run) {
+        printf("All tests PASSED!\n");
+        return 0;
+    } else {
+        printf("Some tests FAILED!\n");
+        return 1;
+    }
+}
@@ -0,0 +1,542 @@
+/*
+ * test_dns_resolver.c - Тесты неблокирующего резолвера (net/net-dns-resolver.c)
+ *
+ * Резолвер спрашивает заглушку DNS-сервера на 127.0.0.1, которая живёт в
+ * отдельном потоке и отвечает по имени вопроса: нормальный ответ, NXDOMAIN
+ * с SOA, потеря первого запроса, молчание, SERVFAIL, поддельные ответы и
+ * цепочка CNAME со сжатием имён. Движок не нужен: запросы крутит
+ * dns_resolver_wait.
+ */
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "../common/resolver.h"
+#include "../net/net-dns-resolver.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) printf("  Test %s... ", name)
+#define PASS() do { printf("PASSED\n"); tests_passed++; tests_run++; } while(0)
+#define FAIL(msg) do { printf("FAILED: %s\n", msg); tests_run++; return 0; } while(0)
+
+#define STUB_TIMEOUT 0.2
+#define STUB_ATTEMPTS 2
+
+/* ============================================
+ * Заглушка DNS-сервера
+ * ============================================ */
+
+enum { NAME_A, NAME_NX, NAME_LOST, NAME_DEAD, NAME_SIX, NAME_FAIL, NAME_SPOOF, NAME_CNAME, STUB_NAMES };
+
+static const char *stub_names[STUB_NAMES] = {
+    "a.test", "nx.test", "lost.test", "dead.test", "six.test", "fail.test", "spoof.test", "cname.test"
+};
+
+static volatile int stub_queries[STUB_NAMES];
+static volatile int stub_stop;
+static int stub_fd;
+
+static int put16(unsigned char *p, int pos, int v) {
+    p[pos] = v >> 8;
+    p[pos + 1] = v;
+    return pos + 2;
+}
+
+static int put32(unsigned char *p, int pos, unsigned v) {
+    pos = put16(p, pos, v >> 16);
+    return put16(p, pos, v & 0xffff);
+}
+
+/* запись с именем-указателем на смещение name_at */
+static int put_rr(unsigned char *p, int pos, int name_at, int type, unsigned ttl, const void *rdata, int rdlen) {
+    pos = put16(p, pos, 0xc000 | name_at);
+    pos = put16(p, pos, type);
+    pos = put16(p, pos, 1);
+    pos = put32(p, pos, ttl);
+    pos = put16(p, pos, rdlen);
+    memcpy(p + pos, rdata, rdlen);
+    return pos + rdlen;
+}
+
+static int put_soa(unsigned char *p, int pos, unsigned ttl, unsigned minimum) {
+    unsigned char rdata[24];
+    int r = put16(rdata, 0, 0xc00c);          /* mname */
+    r = put16(rdata, r, 0xc00c);              /* rname */
+    r = put32(rdata, r, 1);                   /* serial */
+    r = put32(rdata, r, 3600);
+    r = put32(rdata, r, 600);
+    r = put32(rdata, r, 86400);
+    put32(rdata, r, minimum);
+    return put_rr(p, pos, 12, 6, ttl, rdata, sizeof(rdata));
+}
+
+static void stub_send(const unsigned char *r, int len, const struct sockaddr_in *to) {
+    sendto(stub_fd, r, len, 0, (const struct sockaddr *) to, sizeof(*to));
+}
+
+static void *stub_main(void *arg) {
+    unsigned char q[512], r[1024];
+    static const unsigned char addr6[16] = { 0x20, 0x01, 0x0d, 0xb8, [15] = 1 };
+
+    while (!stub_stop) {
+        struct pollfd P = { .fd = stub_fd, .events = POLLIN };
+        if (poll(&P, 1, 20) <= 0) {
+            continue;
+        }
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int n = recvfrom(stub_fd, q, sizeof(q), 0, (struct sockaddr *) &from, &from_len);
+        if (n < 12 + 5) {
+            continue;
+        }
+        char name[256];
+        int pos = 12, len = 0;
+        while (pos < n && q[pos] && len + q[pos] + 1 < (int) sizeof(name)) {
+            if (len) {
+                name[len++] = '.';
+            }
+            memcpy(name + len, q + pos + 1, q[pos]);
+            len += q[pos];
+            pos += q[pos] + 1;
+        }
+        name[len] = 0;
+        if (pos + 5 > n) {
+            continue;
+        }
+        int qtype = (q[pos + 1] << 8) | q[pos + 2];
+        int qend = pos + 5;
+
+        int which;
+        for (which = 0; which < STUB_NAMES && strcasecmp(name, stub_names[which]); which++) {
+        }
+        if (which == STUB_NAMES) {
+            continue;
+        }
+        int count = __sync_add_and_fetch(&stub_queries[which], 1);
+
+        memcpy(r, q, qend);
+        int rcode = 0, an = 0, ns = 0, out = qend;
+        switch (which) {
+        case NAME_A:
+            if (qtype == 1) {
+                out = put_rr(r, out, 12, 1, 1, "\x0a\x00\x00\x01", 4);
+                out = put_rr(r, out, 12, 1, 1, "\x0a\x00\x00\x02", 4);
+                an = 2;
+            } else {
+                out = put_soa(r, out, 1, 1);
+                ns = 1;
+            }
+            break;
+        case NAME_NX:
+            rcode = 3;
+            out = put_soa(r, out, 60, 1);
+            ns = 1;
+            break;
+        case NAME_LOST:
+            if (count == 1) {
+                continue;
+            }
+            out = put_rr(r, out, 12, 1, 60, "\x0a\x00\x00\x03", 4);
+            an = 1;
+            break;
+        case NAME_DEAD:
+            continue;
+        case NAME_SIX:
+            if (qtype == 28) {
+                out = put_rr(r, out, 12, 28, 60, addr6, 16);
+                an = 1;
+            } else {
+                out = put_soa(r, out, 60, 60);
+                ns = 1;
+            }
+            break;
+        case NAME_FAIL:
+            rcode = 2;
+            break;
+        case NAME_SPOOF:
+            out = put_rr(r, out, 12, 1, 60, "\x06\x06\x06\x06", 4);
+            put16(r, 6, 1);
+            /* чужой id */
+            put16(r, 0, ((q[0] << 8) | q[1]) ^ 0x5555);
+            r[2] = 0x81;
+            r[3] = 0x80;
+            stub_send(r, out, &from);
+            /* свой id, но без бита ответа */
+            memcpy(r, q, 2);
+            r[2] = 0x01;
+            stub_send(r, out, &from);
+            out = put_rr(r, qend, 12, 1, 60, "\x0a\x00\x00\x04", 4);
+            an = 1;
+            break;
+        case NAME_CNAME:
+            /* cname.test -> a.test (30 с), a.test -> 10.0.0.5 (5 с) */
+            out = put_rr(r, out, 12, 5, 30, "\x01" "a" "\x04" "test" "\x00", 8);
+            out = put_rr(r, out, qend + 12, 1, 5, "\x0a\x00\x00\x05", 4);
+            an = 2;
+            break;
+        }
+        r[2] = 0x81;
+        r[3] = 0x80 | rcode;
+        put16(r, 6, an);
+        put16(r, 8, ns);
+        put16(r, 10, 0);
+        stub_send(r, out, &from);
+    }
+    return NULL;
+}
+
+static int stub_start(pthread_t *thread, struct sockaddr_in *addr) {
+    socklen_t len = sizeof(*addr);
+    stub_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (stub_fd < 0) {
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(stub_fd, (struct sockaddr *) addr, sizeof(*addr)) < 0 ||
+        getsockname(stub_fd, (struct sockaddr *) addr, &len) < 0) {
+        close(stub_fd);
+        return -1;
+    }
+    return pthread_create(thread, NULL, stub_main, NULL);
+}
+
+/* ============================================
+ * Помощники
+ * ============================================ */
+
+struct answer {
+    int calls;
+    struct dns_result R;
+};
+
+static void on_answer(void *extra, const struct dns_result *R) {
+    struct answer *A = extra;
+    A->calls++;
+    A->R = *R;
+}
+
+/* возвращает результат dns_resolver_query; ответ ждёт сам */
+static int resolve(const char *name, int family, struct answer *A) {
+    memset(A, 0, sizeof(*A));
+    int r = dns_resolver_query(name, family, on_answer, A);
+    if (r == 0) {
+        dns_resolver_wait(5.0);
+    }
+    return r;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int addr4_is(const struct dns_result *R, int i, const char *ip) {
+    struct in_addr a;
+    inet_pton(AF_INET, ip, &a);
+    return R->naddrs > i && R->addrs[i].v4.s_addr == a.s_addr;
+}
+
+/* ============================================
+ * Тесты
+ * ============================================ */
+
+static int test_answer_and_cache(void) {
+    struct answer A;
+    TEST("A answer is cached for its TTL");
+    if (resolve("a.test", AF_INET, &A) != 0 || A.calls != 1) {
+        FAIL("query did not complete asynchronously");
+    }
+    if (A.R.status != DNS_OK || A.R.naddrs != 2 || !addr4_is(&A.R, 0, "10.0.0.1") || !addr4_is(&A.R, 1, "10.0.0.2")) {
+        FAIL("wrong addresses");
+    }
+    if (A.R.ttl != 1) {
+        FAIL("TTL not taken from the answer");
+    }
+    if (resolve("A.TEST.", AF_INET, &A) != 1 || A.calls != 1 || A.R.status != DNS_OK) {
+        FAIL("second lookup not answered from cache");
+    }
+    if (stub_queries[NAME_A] != 1) {
+        FAIL("cache hit still went to the server");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_gethostbyname_hook(void) {
+    TEST("kdb_gethostbyname uses the resolver cache");
+    struct hostent *h = kdb_gethostbyname("a.test");
+    if (!h || h->h_addrtype != AF_INET || !h->h_addr_list[0] || !h->h_addr_list[1] ||
+        memcmp(h->h_addr_list[0], "\x0a\x00\x00\x01", 4)) {
+        FAIL("cached answer not returned");
+    }
+    if (stub_queries[NAME_A] != 1) {
+        FAIL("lookup went to the server");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_coalescing(void) {
+    struct answer A1, A2;
+    TEST("identical queries in flight share one packet");
+    memset(&A1, 0, sizeof(A1));
+    memset(&A2, 0, sizeof(A2));
+    if (dns_resolver_query("six.test", AF_INET6, on_answer, &A1) != 0 ||
+        dns_resolver_query("six.test", AF_INET6, on_answer, &A2) != 0) {
+        FAIL("queries not started");
+    }
+    if (dns_resolver_pending() != 1) {
+        FAIL("second query was not merged");
+    }
+    dns_resolver_wait(5.0);
+    if (A1.calls != 1 || A2.calls != 1 || A1.R.status != DNS_OK || A2.R.naddrs != 1 || A2.R.family != AF_INET6) {
+        FAIL("both callers must get the answer");
+    }
+    if (memcmp(&A1.R.addrs[0].v6, "\x20\x01\x0d\xb8", 4) || A1.R.addrs[0].v6.s6_addr[15] != 1) {
+        FAIL("wrong IPv6 address");
+    }
+    if (stub_queries[NAME_SIX] != 1) {
+        FAIL("more than one packet sent");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_negative_caching(void) {
+    struct answer A;
+    TEST("NXDOMAIN is cached for the SOA minimum");
+    if (resolve("nx.test", AF_INET, &A) != 0 || A.calls != 1 || A.R.status != DNS_NOT_FOUND) {
+        FAIL("NXDOMAIN not reported");
+    }
+    if (A.R.ttl != 1) {
+        FAIL("negative TTL must be min(SOA TTL, MINIMUM)");
+    }
+    if (resolve("nx.test", AF_INET, &A) != 1 || A.R.status != DNS_NOT_FOUND || stub_queries[NAME_NX] != 1) {
+        FAIL("negative answer not cached");
+    }
+    /* NOERROR без записей нужного типа - тоже отрицательный ответ */
+    if (resolve("a.test", AF_INET6, &A) != 0 || A.R.status != DNS_NOT_FOUND) {
+        FAIL("NODATA not reported");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_retry_after_loss(void) {
+    struct answer A;
+    struct dns_resolver_stat before, after;
+    TEST("lost query is retried after the timeout");
+    dns_resolver_get_stat(&before);
+    double start = now_sec();
+    if (resolve("lost.test", AF_INET, &A) != 0 || A.R.status != DNS_OK || !addr4_is(&A.R, 0, "10.0.0.3")) {
+        FAIL("no answer after retry");
+    }
+    double elapsed = now_sec() - start;
+    dns_resolver_get_stat(&after);
+    if (stub_queries[NAME_LOST] != 2 || after.retries != before.retries + 1) {
+        FAIL("expected exactly one retry");
+    }
+    if (elapsed < STUB_TIMEOUT * 0.9 || elapsed > STUB_TIMEOUT * 5) {
+        FAIL("retry not driven by the timeout");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_timeout(void) {
+    struct answer A;
+    struct dns_resolver_stat before, after;
+    TEST("silent server times out and is not cached");
+    dns_resolver_get_stat(&before);
+    double start = now_sec();
+    if (resolve("dead.test", AF_INET, &A) != 0 || A.calls != 1 || A.R.status != DNS_TIMEOUT) {
+        FAIL("timeout not reported");
+    }
+    double elapsed = now_sec() - start;
+    dns_resolver_get_stat(&after);
+    if (stub_queries[NAME_DEAD] != STUB_ATTEMPTS || after.timeouts != before.timeouts + 1) {
+        FAIL("wrong number of attempts");
+    }
+    if (elapsed < STUB_TIMEOUT * STUB_ATTEMPTS * 0.9 || elapsed > STUB_TIMEOUT * STUB_ATTEMPTS * 5) {
+        FAIL("timeout does not match attempts * timeout");
+    }
+    if (resolve("dead.test", AF_INET, &A) != 0 || A.R.status != DNS_TIMEOUT) {
+        FAIL("timeout must not be cached");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_servfail(void) {
+    struct answer A;
+    TEST("SERVFAIL is retried and reported as error");
+    if (resolve("fail.test", AF_INET, &A) != 0 || A.R.status != DNS_ERROR) {
+        FAIL("error not reported");
+    }
+    if (stub_queries[NAME_FAIL] != STUB_ATTEMPTS) {
+        FAIL("SERVFAIL not retried");
+    }
+    if (dns_cache_lookup("fail.test", AF_INET, &A.R)) {
+        FAIL("error must not be cached");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_spoofed_answers(void) {
+    struct answer A;
+    struct dns_resolver_stat before, after;
+    TEST("answers with a wrong id or without QR are ignored");
+    dns_resolver_get_stat(&before);
+    if (resolve("spoof.test", AF_INET, &A) != 0 || A.R.status != DNS_OK || A.R.naddrs != 1 ||
+        !addr4_is(&A.R, 0, "10.0.0.4")) {
+        FAIL("forged answer accepted");
+    }
+    dns_resolver_get_stat(&after);
+    if (after.bad_answers != before.bad_answers + 2) {
+        FAIL("forged answers not counted");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_cname_chain(void) {
+    struct answer A;
+    TEST("CNAME chain with name compression");
+    if (resolve("cname.test", AF_INET, &A) != 0 || A.R.status != DNS_OK || !addr4_is(&A.R, 0, "10.0.0.5")) {
+        FAIL("address behind CNAME not found");
+    }
+    if (A.R.ttl != 5) {
+        FAIL("TTL must be the minimum over the chain");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_ttl_expiry(void) {
+    struct answer A;
+    struct dns_result R;
+    TEST("positive and negative entries expire");
+    usleep(1200 * 1000);
+    if (dns_cache_lookup("a.test", AF_INET, &R) || dns_cache_lookup("nx.test", AF_INET, &R)) {
+        FAIL("expired entry returned");
+    }
+    if (resolve("a.test", AF_INET, &A) != 0 || A.R.status != DNS_OK || stub_queries[NAME_A] != 3) {
+        FAIL("expired positive entry not re-queried");
+    }
+    if (resolve("nx.test", AF_INET, &A) != 0 || A.R.status != DNS_NOT_FOUND || stub_queries[NAME_NX] != 2) {
+        FAIL("expired negative entry not re-queried");
+    }
+    if (dns_cache_lookup("cname.test", AF_INET, &R) != 1) {
+        FAIL("unexpired entry lost");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_literal_and_invalid(void) {
+    struct answer A;
+    TEST("literal addresses and invalid names");
+    if (resolve("192.0.2.7", AF_INET, &A) != 1 || A.R.status != DNS_OK || !addr4_is(&A.R, 0, "192.0.2.7")) {
+        FAIL("literal IPv4 not answered inline");
+    }
+    if (resolve("bad..name", AF_INET, &A) != -1 || resolve("", AF_INET, &A) != -1 ||
+        resolve("a.test", AF_UNIX, &A) != -1) {
+        FAIL("invalid query accepted");
+    }
+    PASS();
+    return 1;
+}
+
+static int test_cache_bound(void) {
+    struct dns_resolver_stat S;
+    struct dns_result R, out;
+    char name[64];
+    int i, total = DNS_CACHE_SHARDS * DNS_CACHE_SHARD_MAX * 3;
+    TEST("cache stays bounded per shard");
+    memset(&R, 0, sizeof(R));
+    R.status = DNS_OK;
+    R.naddrs = 1;
+    dns_cache_clear();
+    for (i = 0; i < total; i++) {
+        snprintf(name, sizeof(name), "host%d.bulk.test", i);
+        R.ttl = 60 + i % 100;
+        R.addrs[0].v4.s_addr = htonl(i);
+        dns_cache_store(name, AF_INET, &R);
+    }
+    dns_resolver_get_stat(&S);
+    if (S.cache_entries > DNS_CACHE_SHARDS * DNS_CACHE_SHARD_MAX || S.cache_evictions == 0) {
+        FAIL("cache grew past its bound");
+    }
+    if (!dns_cache_lookup(name, AF_INET, &out) || out.addrs[0].v4.s_addr != htonl(total - 1)) {
+        FAIL("newest entry evicted");
+    }
+    dns_cache_clear();
+    dns_resolver_get_stat(&S);
+    if (S.cache_entries != 0) {
+        FAIL("clear left entries");
+    }
+    PASS();
+    return 1;
+}
+
+int main(void) {
+    pthread_t stub;
+    struct dns_resolver_conf C;
+
+    printf("=== DNS Resolver Tests ===\n\n");
+
+    memset(&C, 0, sizeof(C));
+    if (stub_start(&stub, &C.servers[0]) != 0) {
+        printf("cannot start stub DNS server\n");
+        return 1;
+    }
+    C.nservers = 1;
+    C.timeout = STUB_TIMEOUT;
+    C.attempts = STUB_ATTEMPTS;
+    if (dns_resolver_init(&C) < 0) {
+        printf("cannot start resolver\n");
+        return 1;
+    }
+
+    test_answer_and_cache();
+    test_gethostbyname_hook();
+    test_coalescing();
+    test_negative_caching();
+    test_retry_after_loss();
+    test_timeout();
+    test_servfail();
+    test_spoofed_answers();
+    test_cname_chain();
+    test_ttl_expiry();
+    test_literal_and_invalid();
+    test_cache_bound();
+
+    stub_stop = 1;
+    pthread_join(stub, NULL);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+    if (tests_passed == tests_run) {
+        printf("All tests PASSED!\n");
+        return 0;
+    } else {
+        printf("Some tests FAILED!\n");
+        return 1;
+    }
+}
@@ -0,0 +1,508 @@
+/*
+ * test_hot_upgrade.c - Тесты передачи слушающих сокетов (net/net-hot-upgrade.c)
+ *
+ * Последний тест - обновление под нагрузкой: тестовый бинарник запускает
+ * сам себя через /proc/self/exe в роли "нового" процесса, передаёт ему
+ * слушающий сокет и проверяет, что ни одно подключение клиентов не
+ * получило отказ, пока "старый" перестаёт принимать и сливает соединения.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "../net/net-hot-upgrade.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) printf("  Test %s... ", name)
+#define PASS() do { printf("PASSED\n"); tests_passed++; tests_run++; } while(0)
+#define FAIL(msg) do { printf("FAILED: %s\n", msg); tests_run++; return 0; } while(0)
+
+#define CHILD_ARG "--upgrade-child"
+#define BLOB_SIZE (1 << 20)
+#define LOAD_THREADS 4
+#define LONG_LIVED 4          /* половину закрывают клиенты, половина остаётся до дедлайна */
+#define DRAIN_TIMEOUT_MS 300
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static unsigned char blob_byte(int i) {
+    return (unsigned char) (i * 131 + (i >> 9));
+}
+
+static int listen_loopback(int *port) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0 ||
+        getsockname(fd, (struct sockaddr *) &addr, &len) < 0) {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static int socket_port(int fd) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(fd, (struct sockaddr *) &addr, &len) < 0) {
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
+
+static int connect_loopback(int port) {
+    struct sockaddr_in addr;
+    struct timeval tv = { 5, 0 };
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* отправляет байт и ждёт эхо; ответ - номер процесса, который обслужил */
+static int ping_server(int fd, char c) {
+    char r;
+    if (write(fd, &c, 1) != 1 || read(fd, &r, 1) != 1) {
+        return -1;
+    }
+    return r;
+}
+
+/* одно соединение: прочитать байт, ответить меткой процесса; 'L' - оставить открытым */
+static int serve_one(int lfd, char tag, int *keep) {
+    char c;
+    int cfd = accept(lfd, NULL, NULL);
+    if (cfd < 0) {
+        return -1;
+    }
+    if (read(cfd, &c, 1) != 1 || write(cfd, &tag, 1) != 1) {
+        close(cfd);
+        return 0;
+    }
+    if (c == 'L' && keep) {
+        *keep = cfd;
+        return 1;
+    }
+    close(cfd);
+    return 1;
+}
+
+/* Тест передачи сокетов и блока данных */
+static int test_send_recv_sockets(void) {
+    TEST("send_recv_sockets");
+
+    int sv[2], ports[3], i;
+    struct hot_upgrade_listen L[3], R[HOT_UPGRADE_MAX_FDS];
+    unsigned char *blob = malloc(BLOB_SIZE);
+    void *got;
+    int got_len;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        FAIL("socketpair");
+    }
+    for (i = 0; i < 3; i++) {
+        L[i].fd = listen_loopback(&ports[i]);
+        L[i].port = i == 2 ? -ports[i] : ports[i];
+    }
+    for (i = 0; i < BLOB_SIZE; i++) {
+        blob[i] = blob_byte(i);
+    }
+
+    /* блок больше буфера сокета: читаем в отдельном процессе */
+    pid_t pid = fork();
+    if (!pid) {
+        close(sv[1]);
+        _exit(hot_upgrade_send_sockets(sv[0], L, 3, blob, BLOB_SIZE) < 0);
+    }
+    close(sv[0]);
+    int n = hot_upgrade_recv_sockets(sv[1], R, HOT_UPGRADE_MAX_FDS, &got, &got_len);
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    if (n != 3 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        FAIL("sockets not received");
+    }
+    for (i = 0; i < 3; i++) {
+        if (R[i].port != L[i].port || socket_port(R[i].fd) != ports[i] || R[i].fd == L[i].fd) {
+            FAIL("wrong socket or port");
+        }
+        if (!(fcntl(R[i].fd, F_GETFD) & FD_CLOEXEC)) {
+            FAIL("received socket is not close-on-exec");
+        }
+    }
+    if (got_len != BLOB_SIZE || memcmp(got, blob, BLOB_SIZE)) {
+        FAIL("blob corrupted");
+    }
+
+    /* принятый дескриптор - тот же сокет: подключение к порту видно через него */
+    char reply = 0;
+    int c = connect_loopback(ports[0]);
+    if (c < 0 || write(c, "s", 1) != 1 || serve_one(R[0].fd, 'n', NULL) != 1 ||
+        read(c, &reply, 1) != 1 || reply != 'n') {
+        FAIL("received socket does not accept");
+    }
+    close(c);
+
+    for (i = 0; i < 3; i++) {
+        close(L[i].fd);
+        close(R[i].fd);
+    }
+    free(got);
+    free(blob);
+    close(sv[1]);
+    PASS();
+    return 1;
+}
+
+/* Тест отказа на мусоре и закрытом канале */
+static int test_protocol_errors(void) {
+    TEST("protocol_errors");
+
+    int sv[2];
+    struct hot_upgrade_listen R[4];
+    struct hot_upgrade_report rep;
+    void *got;
+    int got_len;
+    char junk[512];
+
+    memset(junk, 0x5a, sizeof(junk));
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        FAIL("socketpair");
+    }
+    if (write(sv[0], junk, sizeof(junk)) != sizeof(junk) ||
+        hot_upgrade_recv_sockets(sv[1], R, 4, &got, &got_len) >= 0 || got) {
+        FAIL("garbage accepted");
+    }
+    close(sv[0]);
+    close(sv[1]);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        FAIL("socketpair");
+    }
+    close(sv[0]);
+    if (hot_upgrade_recv_sockets(sv[1], R, 4, &got, &got_len) >= 0 ||
+        hot_upgrade_poll_ready(sv[1]) != -1 || hot_upgrade_poll_report(sv[1], &rep) != -1) {
+        FAIL("closed channel not detected");
+    }
+    close(sv[1]);
+    PASS();
+    return 1;
+}
+
+/* Тест сигнала готовности и итога слива */
+static int test_ready_and_report(void) {
+    TEST("ready_and_report");
+
+    int sv[2];
+    struct hot_upgrade_report out = { 17, 250, 9, 2 }, in;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        FAIL("socketpair");
+    }
+    if (hot_upgrade_poll_ready(sv[0]) != 0) {
+        FAIL("ready before it was sent");
+    }
+    if (hot_upgrade_send_ready(sv[1]) < 0 || hot_upgrade_poll_ready(sv[0]) != 1) {
+        FAIL("ready not seen");
+    }
+    if (hot_upgrade_poll_report(sv[1], &in) != 0) {
+        FAIL("report before it was sent");
+    }
+    /* половина сообщения - ещё не итог */
+    if (write(sv[0], (char[]) { 'M', 'T' }, 2) != 2 || hot_upgrade_poll_report(sv[1], &in) != 0) {
+        FAIL("partial report accepted");
+    }
+    char rest[2];
+    if (read(sv[1], rest, 2) != 2) {
+        FAIL("read");
+    }
+    if (hot_upgrade_send_report(sv[0], &out) < 0 || hot_upgrade_poll_report(sv[1], &in) != 1 ||
+        memcmp(&in, &out, sizeof(in))) {
+        FAIL("report mismatch");
+    }
+    close(sv[0]);
+    close(sv[1]);
+    PASS();
+    return 1;
+}
+
+/*
+ *  Обновление под нагрузкой
+ */
+
+static volatile int load_stop, old_stop;
+static int load_port;
+static int load_ok[LOAD_THREADS], load_fail[LOAD_THREADS], load_by_new[LOAD_THREADS];
+
+static void *load_thread(void *arg) {
+    int id = (int) (long) arg;
+    while (!load_stop) {
+        int fd = connect_loopback(load_port);
+        int r = fd < 0 ? -1 : ping_server(fd, 's');
+        if (r < 0) {
+            load_fail[id]++;
+        } else {
+            load_ok[id]++;
+            load_by_new[id] += r == 'n';
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+struct old_server {
+    int lfd;
+    int kept[LONG_LIVED];
+    int kept_num;
+};
+
+/* "старый" процесс: принимает, пока не велено остановиться */
+static void *old_accept_thread(void *arg) {
+    struct old_server *S = arg;
+    struct pollfd p = { .fd = S->lfd, .events = POLLIN };
+    while (!old_stop) {
+        if (poll(&p, 1, 20) <= 0) {
+            continue;
+        }
+        int keep = -1;
+        if (serve_one(S->lfd, 'o', &keep) == 1 && keep >= 0 && S->kept_num < LONG_LIVED) {
+            S->kept[S->kept_num++] = keep;
+        } else if (keep >= 0) {
+            close(keep);
+        }
+    }
+    return NULL;
+}
+
+/* "новый" процесс: подхватывает сокет, обслуживает, пока старый не закроет канал */
+static int run_child(void) {
+    struct hot_upgrade_listen L[HOT_UPGRADE_MAX_FDS];
+    struct hot_upgrade_report R;
+    void *blob;
+    int blob_len, i, have_report = 0, served = 0;
+
+    int ch = hot_upgrade_inherited_fd();
+    if (ch < 0 || getenv(HOT_UPGRADE_ENV)) {
+        return 2;
+    }
+    if (hot_upgrade_recv_sockets(ch, L, HOT_UPGRADE_MAX_FDS, &blob, &blob_len) != 1) {
+        return 3;
+    }
+    if (blob_len != BLOB_SIZE) {
+        return 4;
+    }
+    for (i = 0; i < blob_len; i++) {
+        if (((unsigned char *) blob)[i] != blob_byte(i)) {
+            return 4;
+        }
+    }
+    free(blob);
+    fcntl(L[0].fd, F_SETFL, fcntl(L[0].fd, F_GETFL) | O_NONBLOCK);
+    if (hot_upgrade_send_ready(ch) < 0) {
+        return 5;
+    }
+
+    while (1) {
+        struct pollfd p[2] = { { .fd = L[0].fd, .events = POLLIN }, { .fd = ch, .events = POLLIN } };
+        poll(p, 2, 100);
+        if (p[0].revents & POLLIN) {
+            while (serve_one(L[0].fd, 'n', NULL) == 1) {
+                served++;
+            }
+        }
+        if (p[1].revents) {
+            int r = have_report ? -1 : hot_upgrade_poll_report(ch, &R);
+            if (r > 0) {
+                have_report = 1;
+            } else if (r < 0) {
+                break;
+            }
+        }
+    }
+    if (!have_report) {
+        return 6;
+    }
+    if (R.drained_connections != LONG_LIVED / 2 || R.dropped_connections != LONG_LIVED - LONG_LIVED / 2 ||
+        R.drain_ms < DRAIN_TIMEOUT_MS || R.handover_ms < 0) {
+        return 7;
+    }
+    return served > 0 ? 0 : 8;
+}
+
+static int test_upgrade_under_load(const char *self) {
+    TEST("upgrade_under_load");
+
+    struct old_server S = { .kept_num = 0 };
+    pthread_t acc, load[LOAD_THREADS];
+    int clients[LONG_LIVED], i;
+
+    S.lfd = listen_loopback(&load_port);
+    if (S.lfd < 0) {
+        FAIL("listen");
+    }
+    load_stop = old_stop = 0;
+    pthread_create(&acc, NULL, old_accept_thread, &S);
+
+    for (i = 0; i < LONG_LIVED; i++) {
+        clients[i] = connect_loopback(load_port);
+        if (clients[i] < 0 || ping_server(clients[i], 'L') != 'o') {
+            FAIL("long-lived connection");
+        }
+    }
+    for (i = 0; i < LOAD_THREADS; i++) {
+        pthread_create(&load[i], NULL, load_thread, (void *) (long) i);
+    }
+    usleep(100000);
+
+    /* обновление: новый процесс, передача сокета, ожидание готовности */
+    double t0 = now_ms();
+    pid_t pid;
+    char *argv[] = { (char *) self, CHILD_ARG, NULL };
+    int ch = hot_upgrade_spawn("/proc/self/exe", argv, &pid);
+    struct hot_upgrade_listen L = { S.lfd, load_port };
+    unsigned char *blob = malloc(BLOB_SIZE);
+    for (i = 0; i < BLOB_SIZE; i++) {
+        blob[i] = blob_byte(i);
+    }
+    if (ch < 0 || hot_upgrade_send_sockets(ch, &L, 1, blob, BLOB_SIZE) < 0) {
+        FAIL("spawn");
+    }
+    free(blob);
+    int r;
+    while (!(r = hot_upgrade_poll_ready(ch)) && now_ms() < t0 + 10000) {
+        usleep(1000);
+    }
+    if (r != 1) {
+        FAIL("new process not ready");
+    }
+    int handover_ms = (int) (now_ms() - t0);
+
+    /* старый перестаёт принимать, но сокет не закрывает; очередь общая */
+    old_stop = 1;
+    pthread_join(acc, NULL);
+    double drain_start = now_ms();
+    for (i = 0; i < LONG_LIVED / 2; i++) {
+        close(clients[i]);
+    }
+
+    int drained = 0, dropped = 0, open_left = S.kept_num;
+    while (open_left && now_ms() < drain_start + DRAIN_TIMEOUT_MS) {
+        for (i = 0; i < S.kept_num; i++) {
+            char c;
+            if (S.kept[i] >= 0 && recv(S.kept[i], &c, 1, MSG_DONTWAIT) == 0) {
+                close(S.kept[i]);
+                S.kept[i] = -1;
+                drained++;
+                open_left--;
+            }
+        }
+        usleep(5000);
+    }
+    for (i = 0; i < S.kept_num; i++) {
+        if (S.kept[i] >= 0) {
+            close(S.kept[i]);
+            dropped++;
+        }
+    }
+    struct hot_upgrade_report rep = { handover_ms, (int) (now_ms() - drain_start), drained, dropped };
+    if (hot_upgrade_send_report(ch, &rep) < 0) {
+        FAIL("report");
+    }
+
+    usleep(200000);
+    load_stop = 1;
+    int ok = 0, fail = 0, by_new = 0;
+    for (i = 0; i < LOAD_THREADS; i++) {
+        pthread_join(load[i], NULL);
+        ok += load_ok[i];
+        fail += load_fail[i];
+        by_new += load_by_new[i];
+    }
+    for (i = LONG_LIVED / 2; i < LONG_LIVED; i++) {
+        close(clients[i]);
+    }
+
+    /* старый уходит: новый видит закрытие канала и завершается сам */
+    close(S.lfd);
+    close(ch);
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    printf("(handover %d ms, %d requests, %d served by new, drained %d, dropped %d) ", handover_ms, ok, by_new, drained, dropped);
+    if (fail) {
+        FAIL("client connections failed during upgrade");
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        FAIL("new process failed");
+    }
+    if (by_new == 0 || by_new == ok) {
+        FAIL("load was not served by both processes");
+    }
+    if (drained != LONG_LIVED / 2 || dropped != LONG_LIVED - LONG_LIVED / 2) {
+        FAIL("wrong drain accounting");
+    }
+    PASS();
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && !strcmp(argv[1], CHILD_ARG)) {
+        return run_child();
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("=== Hot Upgrade Tests ===\n\n");
+
+    test_send_recv_sockets();
+    test_protocol_errors();
+    test_ready_and_report();
+    test_upgrade_under_load(argv[0]);
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+    if (tests_passed == tests_run) {
+        printf("All tests PASSED!\n");
+        return 0;
+    } else {
+        printf("Some tests FAILED!\n");
+        return 1;
+    }
+}
@@ -0,0 +1,278 @@
+/*
+ * test_http_parse.c - Сверка быстрого разбора HTTP-заголовков с автоматом (net/net-http-server.c)
+ *
+ * hts_parse_header_fast должен либо оставить struct hts_data в точности таким,
+ * как после hts_parse_header_bytes, либо вернуть -1 и не трогать её.
+ * Случайные запросы строятся из типичных частей и портятся мутациями.
+ *
+ * Сборка с -DHTTP_PARSE_FUZZER даёт цель для libFuzzer с той же проверкой.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "net/net-http-server.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) printf("  Test %s... ", name)
+#define PASS() do { printf("PASSED\n"); tests_passed++; tests_run++; } while(0)
+#define FAIL(msg) do { printf("FAILED: %s\n", msg); tests_run++; return 0; } while(0)
+
+/* 0 - пути согласны; fast_taken - быстрый путь разобрал заголовок */
+static int check_agree(const char *buf, int len, unsigned split_seed, int *fast_taken) {
+    struct hts_data A, B, C;
+    memset(&A, 0x5a, sizeof(A));
+    A.parse_state = htqp_start;
+    A.query_seqno = (int)split_seed;
+    B = C = A;
+
+    int r = hts_parse_header_fast(&A, buf, len);
+    if (fast_taken) {
+        *fast_taken = r > 0;
+    }
+    if (r < 0) {
+        return memcmp(&A, &C, sizeof(A)) ? 1 : 0;
+    }
+
+    /* целиком и кусками, как по блокам raw_message */
+    int used = hts_parse_header_bytes(&B, buf, len);
+    if (B.parse_state != htqp_done || used != r || memcmp(&A, &B, sizeof(A))) {
+        return 2;
+    }
+    int pos = 0;
+    while (pos < len && C.parse_state != htqp_done) {
+        int piece = 1 + (int)((split_seed = split_seed * 1103515245 + 12345) >> 16) % 64;
+        if (piece > len - pos) {
+            piece = len - pos;
+        }
+        int k = hts_parse_header_bytes(&C, buf + pos, piece);
+        pos += k;
+        if (k < piece) {
+            break;
+        }
+    }
+    if (C.parse_state != htqp_done || pos != r || memcmp(&A, &C, sizeof(A))) {
+        return 3;
+    }
+    return 0;
+}
+
+#ifdef HTTP_PARSE_FUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size > 0 && size < (1 << 20) && check_agree((const char *)data, (int)size, (unsigned)size, NULL)) {
+        abort();
+    }
+    return 0;
+}
+#else
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static unsigned rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned)((rng_state * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+static int put(char *buf, int pos, const char *s) {
+    int n = (int)strlen(s);
+    memcpy(buf + pos, s, n);
+    return pos + n;
+}
+
+static int put_random(char *buf, int pos, int len, const char *alphabet) {
+    int n = (int)strlen(alphabet);
+    for (int i = 0; i < len; i++) {
+        buf[pos++] = alphabet[rng_next() % n];
+    }
+    return pos;
+}
+
+/* случайный запрос; буфер не меньше 32 КБ */
+static int generate_request(char *buf) {
+    static const char *methods[] = { "GET", "POST", "HEAD", "OPTIONS", "PUT", "get", "" };
+    static const char *versions[] = { "HTTP/1.1", "HTTP/1.0", "HTTP/2.0", "HTTP/1.10", "" };
+    static const char *names[] = { "Host", "Connection", "Content-Length", "User-Agent", "Accept",
+                                   "host", "CONNECTION", "content-length", "X-Forwarded-For", "" };
+    static const char *values[] = { "keep-alive", "close", "Keep-Alive", "example.org", "0", "42",
+                                    "2147483647", "214748364", "12a", "a b", "", "  keep-alive  " };
+    static const char *seps[] = { ": ", ":", ":   ", " : " };
+    const char *path = "abcdefghijklmnopqrstuvwxyz0123456789/?=&%-._~";
+    const char *text = "abcdefXYZ0123456789 ;,=/()-_.";
+
+    int pos = put(buf, 0, methods[rng_next() % 7 < 5 ? 0 : rng_next() % 7]);
+    pos = put_random(buf, pos, 1 + (rng_next() % 8 == 0), " ");
+    int uri_len = rng_next() % 64 == 0 ? 4000 + rng_next() % 200 : 1 + rng_next() % 120;
+    pos = put_random(buf, pos, uri_len, path);
+    pos = put_random(buf, pos, 1 + (rng_next() % 8 == 0), " ");
+    pos = put(buf, pos, versions[rng_next() % 8 < 5 ? rng_next() % 2 : rng_next() % 5]);
+    pos = put_random(buf, pos, rng_next() % 8 == 0, " ");
+    pos = put(buf, pos, "\r\n");
+
+    /* половина запросов - без заведомых ошибок в заголовках */
+    int clean = rng_next() % 2, have_length = 0;
+    int headers = rng_next() % 14;
+    for (int i = 0; i < headers; i++) {
+        int n = rng_next() % 10;
+        if (clean && (n == 2 || n == 7) && have_length++) {
+            n = 3;
+        }
+        pos = put(buf, pos, names[n]);
+        pos = put(buf, pos, seps[clean ? rng_next() % 3 : rng_next() % 8 < 5 ? 0 : rng_next() % 4]);
+        if (clean && (n == 2 || n == 7)) {
+            pos = put_random(buf, pos, 1 + rng_next() % 9, "0123456789");
+        } else if (clean && (n == 0 || n == 1 || n == 5 || n == 6)) {
+            pos = put(buf, pos, values[rng_next() % 4]);
+        } else if (rng_next() % 2) {
+            pos = put(buf, pos, values[rng_next() % 12]);
+        } else {
+            pos = put_random(buf, pos, rng_next() % 80, text);
+        }
+        pos = put(buf, pos, "\r\n");
+    }
+    return put(buf, pos, "\r\n");
+}
+
+/* 1-3 порчи: замена, вставка или удаление байта, в том числе \t, \n, \r и не-ASCII */
+static int mutate(char *buf, int len) {
+    static const char bytes[] = " \t\r\n:0a\x80\x7f";
+    int edits = 1 + rng_next() % 3;
+    for (int i = 0; i < edits && len > 1; i++) {
+        int at = rng_next() % len;
+        char b = bytes[rng_next() % (sizeof(bytes) - 1)];
+        switch (rng_next() % 3) {
+        case 0:
+            buf[at] = b;
+            break;
+        case 1:
+            memmove(buf + at + 1, buf + at, len - at);
+            buf[at] = b;
+            len++;
+            break;
+        default:
+            memmove(buf + at, buf + at + 1, len - at - 1);
+            len--;
+        }
+    }
+    return len;
+}
+
+/* Тест типичных запросов: быстрый путь их принимает и согласен с автоматом */
+static int test_fast_path_taken(void) {
+    TEST("fast_path_taken");
+
+    const char *reqs[] = {
+        "GET /stats HTTP/1.1\r\nHost: localhost:8888\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\n\r\n",
+        "POST /api HTTP/1.1\r\nHost: 149.154.167.51:80\r\nConnection: keep-alive\r\nContent-Length: 128\r\n\r\n",
+        "GET / HTTP/1.0\r\n\r\n",
+        "HEAD  /x  HTTP/1.1  \r\nconnection:Keep-Alive\r\nX-Empty:\r\nHost:\r\n\r\n",
+        "OPTIONS * HTTP/1.1\r\nContent-Length:   0  \r\n\r\nbody follows",
+    };
+    for (size_t i = 0; i < sizeof(reqs) / sizeof(reqs[0]); i++) {
+        int taken = 0;
+        if (check_agree(reqs[i], (int)strlen(reqs[i]), (unsigned)i, &taken)) {
+            FAIL(reqs[i]);
+        }
+        if (!taken) {
+            FAIL("fast path declined a well-formed request");
+        }
+    }
+
+    struct hts_data D;
+    const char *req = reqs[1];
+    memset(&D, 0, sizeof(D));
+    if (hts_parse_header_fast(&D, req, (int)strlen(req)) != (int)strlen(req) ||
+        D.query_type != htqt_post || D.data_size != 128 || D.http_ver != HTTP_V11 ||
+        !(D.query_flags & QF_KEEPALIVE) || D.host_size != 17 || memcmp(req + D.host_offset, "149.154.167.51:80", 17) ||
+        D.uri_size != 4 || memcmp(req + D.uri_offset, "/api", 4) || D.first_line_size != 20) {
+        FAIL("parsed fields");
+    }
+
+    PASS();
+    return 1;
+}
+
+/* Тест отказов: всё необычное уходит в автомат, struct hts_data не тронута */
+static int test_fast_path_declined(void) {
+    TEST("fast_path_declined");
+
+    const char *reqs[] = {
+        "GET /stats HTTP/1.1\r\nHost: localhost\r\n",                    /* неполный */
+        "GET /stats HTTP/1.1\nHost: localhost\n\n",                      /* голые LF */
+        "GET /stats\r\n\r\n",                                           /* HTTP/0.9 */
+        "PUT /stats HTTP/1.1\r\n\r\n",                                  /* метод */
+        "GET /stats HTTP/1.2\r\n\r\n",                                  /* версия */
+        "GET /stats HTTP/1.1\r\nHost:\tlocalhost\r\n\r\n",              /* табуляция */
+        "GET /stats HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 1\r\n\r\n",
+        "GET /stats HTTP/1.1\r\nContent-Length: 2147483648\r\n\r\n",
+        "GET /stats HTTP/1.1\r\nHost: a b\r\n\r\n",
+        "GET /stats HTTP/1.1\r\nX-Name: \xd0\xb8\r\n\r\n",
+    };
+    for (size_t i = 0; i < sizeof(reqs) / sizeof(reqs[0]); i++) {
+        int taken = 1;
+        if (check_agree(reqs[i], (int)strlen(reqs[i]), (unsigned)i, &taken)) {
+            FAIL(reqs[i]);
+        }
+        if (taken) {
+            FAIL(reqs[i]);
+        }
+    }
+
+    PASS();
+    return 1;
+}
+
+/* Дифференциальный фаззинг: случайные и испорченные запросы, разные разбиения на куски */
+static int test_differential(void) {
+    TEST("differential");
+
+    static char buf[65536];
+    int iterations = 300000, taken_total = 0;
+    char msg[128];
+    for (int it = 0; it < iterations; it++) {
+        int len = generate_request(buf);
+        if (rng_next() % 3 == 0) {
+            len = mutate(buf, len);
+        }
+        if (rng_next() % 16 == 0) {
+            len = 1 + rng_next() % len;
+        }
+        int taken = 0, res = check_agree(buf, len, rng_next(), &taken);
+        if (res) {
+            snprintf(msg, sizeof(msg), "mismatch %d at iteration %d: %.60s", res, it, buf);
+            FAIL(msg);
+        }
+        taken_total += taken;
+    }
+    if (taken_total < iterations / 10) {
+        FAIL("fast path almost never taken");
+    }
+
+    printf("(%d%% fast) ", taken_total * 100 / iterations);
+    PASS();
+    return 1;
+}
+
+int main(void) {
+    printf("=== HTTP Header Parser Tests ===\n\n");
+
+    test_fast_path_taken();
+    test_fast_path_declined();
+    test_differential();
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+    if (tests_passed == tests_run) {
+        printf("All tests PASSED!\n");
+        return 0;
+    } else {
+        printf("Some tests FAILED!\n");
+        return 1;
+    }
+}
+#endif
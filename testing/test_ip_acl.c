@@ -0,0 +1,225 @@
+/*
+ * test_ip_acl.c - Тесты для скомпилированных IP-списков (net/net-ip-acl.c)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../net/net-ip-acl.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) printf("  Test %s... ", name)
+#define PASS() do { printf("PASSED\n"); tests_passed++; tests_run++; } while(0)
+#define FAIL(msg) do { printf("FAILED: %s\n", msg); tests_run++; return 0; } while(0)
+
+#define IPV4(a, b, c, d) (((unsigned)(a) << 24) | ((b) << 16) | ((c) << 8) | (d))
+
+/* Тест разбора CIDR и устаревшей формы "a.b.*" */
+static int test_parse_cidr(void) {
+    TEST("parse_cidr");
+
+    const char *good[] = { "10.0.0.0/8", "192.168.1.7", "2001:db8::/32", "172.16.*", "*", "::/0", "1.2.3.4/32" };
+    const char *bad[] = { "10.0.0.0/33", "1.2.3", "300.1.1.1", "1.2.3.4/", "1.*.3.*", "2001:db8::/129", "", "1.2.3.4.*" };
+    struct ip_acl *acl = ip_acl_alloc();
+
+    for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+        if (ip_acl_add_cidr(acl, good[i], IP_ACL_BLACKLIST) != 0) {
+            ip_acl_free(acl);
+            FAIL(good[i]);
+        }
+    }
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (ip_acl_add_cidr(acl, bad[i], IP_ACL_BLACKLIST) == 0) {
+            ip_acl_free(acl);
+            FAIL(bad[i]);
+        }
+    }
+
+    ip_acl_free(acl);
+    PASS();
+    return 1;
+}
+
+/* Тест поиска IPv4: самый длинный префикс не отменяет флаги более коротких */
+static int test_lookup_ipv4(void) {
+    TEST("lookup_ipv4");
+
+    struct ip_acl *acl = ip_acl_alloc();
+    ip_acl_add_cidr(acl, "10.0.0.0/8", IP_ACL_BLACKLIST);
+    ip_acl_add_cidr(acl, "10.1.2.3", IP_ACL_WHITELIST);
+    ip_acl_add_cidr(acl, "192.168.1.*", IP_ACL_BLACKLIST);
+    ip_acl_add_cidr(acl, "203.0.113.64/26", IP_ACL_BLACKLIST);
+
+    if (ip_acl_lookup_ipv4(acl, IPV4(10, 5, 5, 5)) != 0) {
+        ip_acl_free(acl);
+        FAIL("lookup before compile must miss");
+    }
+    if (ip_acl_compile(acl) != 0) {
+        ip_acl_free(acl);
+        FAIL("compile failed");
+    }
+    if (ip_acl_add_cidr(acl, "1.1.1.1", IP_ACL_BLACKLIST) == 0) {
+        ip_acl_free(acl);
+        FAIL("add after compile accepted");
+    }
+
+    if (ip_acl_lookup_ipv4(acl, IPV4(10, 5, 5, 5)) != IP_ACL_BLACKLIST ||
+        ip_acl_lookup_ipv4(acl, IPV4(10, 1, 2, 3)) != (IP_ACL_BLACKLIST | IP_ACL_WHITELIST) ||
+        ip_acl_lookup_ipv4(acl, IPV4(192, 168, 1, 255)) != IP_ACL_BLACKLIST ||
+        ip_acl_lookup_ipv4(acl, IPV4(192, 168, 2, 1)) != 0 ||
+        ip_acl_lookup_ipv4(acl, IPV4(203, 0, 113, 64)) != IP_ACL_BLACKLIST ||
+        ip_acl_lookup_ipv4(acl, IPV4(203, 0, 113, 127)) != IP_ACL_BLACKLIST ||
+        ip_acl_lookup_ipv4(acl, IPV4(203, 0, 113, 128)) != 0 ||
+        ip_acl_lookup_ipv4(acl, IPV4(11, 0, 0, 0)) != 0) {
+        ip_acl_free(acl);
+        FAIL("wrong lookup result");
+    }
+
+    /* whitelist имеет приоритет над blacklist */
+    if (!ip_acl_rejects(acl, IPV4(10, 5, 5, 5), NULL) || ip_acl_rejects(acl, IPV4(10, 1, 2, 3), NULL) ||
+        ip_acl_rejects(acl, IPV4(8, 8, 8, 8), NULL)) {
+        ip_acl_free(acl);
+        FAIL("wrong reject decision");
+    }
+    acl->whitelist_only = 1;
+    if (!ip_acl_rejects(acl, IPV4(8, 8, 8, 8), NULL) || ip_acl_rejects(acl, IPV4(10, 1, 2, 3), NULL)) {
+        ip_acl_free(acl);
+        FAIL("wrong whitelist-only decision");
+    }
+
+    ip_acl_free(acl);
+    PASS();
+    return 1;
+}
+
+/* Тест поиска IPv6 и адресов IPv4, отображённых в IPv6 */
+static int test_lookup_ipv6(void) {
+    TEST("lookup_ipv6");
+
+    struct ip_acl *acl = ip_acl_alloc();
+    ip_acl_add_cidr(acl, "2001:db8::/32", IP_ACL_BLACKLIST);
+    ip_acl_add_cidr(acl, "2001:db8:0:1::/64", IP_ACL_WHITELIST);
+    ip_acl_add_cidr(acl, "2a00::1", IP_ACL_BLACKLIST);
+    ip_acl_add_cidr(acl, "172.16.0.0/12", IP_ACL_BLACKLIST);
+    ip_acl_compile(acl);
+
+    unsigned char a[16] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 9 };
+    unsigned char b[16] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 2 };
+    unsigned char c[16] = { 0x2a, 0x00, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+    unsigned char d[16] = { 0x2a, 0x00, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2 };
+    unsigned char mapped[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 172, 20, 1, 1 };
+
+    if (ip_acl_lookup(acl, 0, a) != (IP_ACL_BLACKLIST | IP_ACL_WHITELIST) ||
+        ip_acl_lookup(acl, 0, b) != IP_ACL_BLACKLIST ||
+        ip_acl_lookup(acl, 0, c) != IP_ACL_BLACKLIST ||
+        ip_acl_lookup(acl, 0, d) != 0 ||
+        ip_acl_lookup(acl, 0, mapped) != IP_ACL_BLACKLIST) {
+        ip_acl_free(acl);
+        FAIL("wrong lookup result");
+    }
+
+    ip_acl_free(acl);
+    PASS();
+    return 1;
+}
+
+/* Тест загрузки файла: комментарии, пустые строки, ошибочные записи */
+static int test_load_file(void) {
+    TEST("load_file");
+
+    char path[] = "/tmp/test-ip-acl-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        FAIL("mkstemp failed");
+    }
+    FILE *f = fdopen(fd, "w");
+    fprintf(f, "# blacklist\n\n  198.51.100.0/24   # test net\n203.0.113.5\nnot-an-ip\n2001:db8::/48\n");
+    fclose(f);
+
+    struct ip_acl *acl = ip_acl_alloc();
+    int loaded = ip_acl_load_file(acl, path, IP_ACL_BLACKLIST);
+    unlink(path);
+    ip_acl_compile(acl);
+
+    if (loaded != 3 || acl->errors != 1) {
+        ip_acl_free(acl);
+        FAIL("wrong loaded/error count");
+    }
+    if (ip_acl_lookup_ipv4(acl, IPV4(198, 51, 100, 77)) != IP_ACL_BLACKLIST ||
+        ip_acl_lookup_ipv4(acl, IPV4(203, 0, 113, 5)) != IP_ACL_BLACKLIST ||
+        ip_acl_lookup_ipv4(acl, IPV4(203, 0, 113, 6)) != 0) {
+        ip_acl_free(acl);
+        FAIL("wrong lookup result");
+    }
+    if (ip_acl_load_file(acl, "/nonexistent/ip-acl.txt", IP_ACL_BLACKLIST) != -1) {
+        ip_acl_free(acl);
+        FAIL("missing file not reported");
+    }
+
+    ip_acl_free(acl);
+    PASS();
+    return 1;
+}
+
+/* Тест на случайных префиксах против полного перебора */
+static int test_random_prefixes(void) {
+    TEST("random_prefixes");
+
+    enum { PREFIXES = 3000, LOOKUPS = 20000 };
+    static unsigned addr[PREFIXES], flags[PREFIXES];
+    static int len[PREFIXES];
+    struct ip_acl *acl = ip_acl_alloc();
+    srand(12345);
+
+    for (int i = 0; i < PREFIXES; i++) {
+        /* Адреса сгруппированы в нескольких /16, чтобы префиксы вкладывались друг в друга */
+        addr[i] = ((unsigned)(rand() % 4) << 16) | ((unsigned)rand() & 0xffff);
+        len[i] = rand() % 33;
+        flags[i] = 1 + rand() % 2;
+        ip_acl_add_ipv4(acl, addr[i], len[i], flags[i]);
+    }
+    ip_acl_compile(acl);
+
+    for (int t = 0; t < LOOKUPS; t++) {
+        unsigned ip = t & 1 ? addr[rand() % PREFIXES] ^ ((unsigned)rand() & 0xff) : ((unsigned)(rand() % 4) << 16) | ((unsigned)rand() & 0xffff);
+        unsigned want = 0;
+        for (int i = 0; i < PREFIXES; i++) {
+            unsigned mask = len[i] ? ~0u << (32 - len[i]) : 0;
+            if (((ip ^ addr[i]) & mask) == 0) {
+                want |= flags[i];
+            }
+        }
+        if (ip_acl_lookup_ipv4(acl, ip) != want) {
+            ip_acl_free(acl);
+            FAIL("mismatch with linear scan");
+        }
+    }
+
+    ip_acl_free(acl);
+    PASS();
+    return 1;
+}
+
+int main(void) {
+    printf("=== IP ACL Tests ===\n\n");
+
+    test_parse_cidr();
+    test_lookup_ipv4();
+    test_lookup_ipv6();
+    test_load_file();
+    test_random_prefixes();
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+    if (tests_passed == tests_run) {
+        printf("All tests PASSED!\n");
+        return 0;
+    } else {
+        printf("Some tests FAILED!\n");
+        return 1;
+    }
+}
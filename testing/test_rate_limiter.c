@@ -0,0 +1,228 @@
+/*
+ * test_rate_limiter.c - Тесты шардированного лимитера с бинарными ключами (common/rate-limiter.c)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../common/rate-limiter.h"
+
+static int tests_run = 0;
+static int tests_passed = 0;
+
+#define TEST(name) printf("  Test %s... ", name)
+#define PASS() do { printf("PASSED\n"); tests_passed++; tests_run++; } while(0)
+#define FAIL(msg) do { printf("FAILED: %s\n", msg); tests_run++; rate_limiter_sharded_cleanup(limiter); return 0; } while(0)
+
+#define IPV4(a, b, c, d) (((unsigned)(a) << 24) | ((b) << 16) | ((c) << 8) | (d))
+#define SEC 1000000000ULL
+#define T0 (1000 * SEC)
+
+static rate_limiter_sharded_t *make_limiter(rate_limit_algorithm_t algorithm, uint64_t max_requests,
+                                            time_t window, size_t max_entries, time_t idle) {
+    rate_limit_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.algorithm = algorithm;
+    config.max_requests = max_requests;
+    config.window_seconds = window;
+    return rate_limiter_sharded_init(&config, max_entries, idle);
+}
+
+/* Считает разрешённые из n проверок в момент now */
+static int allowed(rate_limiter_sharded_t *limiter, const rate_limit_key_t *key, int n, uint64_t now) {
+    int ok = 0;
+    for (int i = 0; i < n; i++) {
+        ok += rate_limit_check_key_at(limiter, key, now) == RATE_LIMIT_OK;
+    }
+    return ok;
+}
+
+/* IPv4 и тот же адрес в виде ::ffff:a.b.c.d - один ключ, другой секрет - другой */
+static int test_keys(void) {
+    TEST("keys");
+
+    rate_limiter_sharded_t *limiter = make_limiter(RATE_LIMIT_FIXED_WINDOW, 3, 60, 1024, 600);
+    rate_limit_key_t a, b, c;
+    uint8_t mapped[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 192, 0, 2, 1};
+    rate_limit_key_ipv4(&a, IPV4(192, 0, 2, 1), 0);
+    rate_limit_key_ipv6(&b, mapped, 0);
+    rate_limit_key_ipv4(&c, IPV4(192, 0, 2, 1), 1);
+
+    if (memcmp(&a, &b, sizeof(a))) FAIL("mapped IPv4 key differs");
+    if (allowed(limiter, &a, 2, T0) != 2 || allowed(limiter, &b, 2, T0) != 1) FAIL("mapped address not shared");
+    if (allowed(limiter, &c, 5, T0) != 3) FAIL("secret must get its own bucket");
+
+    rate_limiter_sharded_cleanup(limiter);
+    PASS();
+    return 1;
+}
+
+static int test_token_bucket(void) {
+    TEST("token_bucket");
+
+    rate_limit_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.algorithm = RATE_LIMIT_TOKEN_BUCKET;
+    config.bucket_capacity = 5;
+    config.refill_rate = 2;
+    rate_limiter_sharded_t *limiter = rate_limiter_sharded_init(&config, 1024, 600);
+    rate_limit_key_t key;
+    rate_limit_key_ipv4(&key, IPV4(10, 0, 0, 1), -1);
+
+    if (allowed(limiter, &key, 10, T0) != 5) FAIL("new key must start with a full bucket");
+    if (allowed(limiter, &key, 10, T0 + SEC / 2) != 1) FAIL("half a second must refill one token");
+    if (allowed(limiter, &key, 10, T0 + 100 * SEC) != 5) FAIL("refill must stop at capacity");
+
+    rate_limiter_sharded_cleanup(limiter);
+    PASS();
+    return 1;
+}
+
+static int test_windows(void) {
+    TEST("fixed_and_sliding_window");
+
+    rate_limiter_sharded_t *limiter = make_limiter(RATE_LIMIT_FIXED_WINDOW, 10, 10, 1024, 600);
+    rate_limit_key_t key;
+    rate_limit_key_ipv4(&key, IPV4(10, 0, 0, 2), -1);
+
+    if (allowed(limiter, &key, 20, T0) != 10) FAIL("fixed: limit within window");
+    if (allowed(limiter, &key, 20, T0 + 9 * SEC) != 0) FAIL("fixed: same window");
+    if (allowed(limiter, &key, 20, T0 + 10 * SEC) != 10) FAIL("fixed: next window");
+    rate_limiter_sharded_cleanup(limiter);
+
+    limiter = make_limiter(RATE_LIMIT_SLIDING_WINDOW, 10, 10, 1024, 600);
+    if (allowed(limiter, &key, 20, T0) != 10) FAIL("sliding: limit within window");
+    /* четверть следующего окна: прошлое окно весит 3/4, свободно 10 - 7.5 */
+    if (allowed(limiter, &key, 20, T0 + 10 * SEC + 10 * SEC / 4) != 3) FAIL("sliding: weighted previous window");
+    /* через окно прошлое уже не учитывается */
+    if (allowed(limiter, &key, 20, T0 + 30 * SEC) != 10) FAIL("sliding: stale window");
+
+    rate_limiter_sharded_cleanup(limiter);
+    PASS();
+    return 1;
+}
+
+static int test_leaky_and_adaptive(void) {
+    TEST("leaky_bucket_and_adaptive");
+
+    rate_limit_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.algorithm = RATE_LIMIT_LEAKY_BUCKET;
+    config.max_requests = 4;
+    config.leak_rate = 1;
+    rate_limiter_sharded_t *limiter = rate_limiter_sharded_init(&config, 1024, 600);
+    rate_limit_key_t key;
+    rate_limit_key_ipv4(&key, IPV4(10, 0, 0, 3), -1);
+
+    if (allowed(limiter, &key, 10, T0) != 4) FAIL("leaky: bucket size");
+    if (allowed(limiter, &key, 10, T0 + 2 * SEC) != 2) FAIL("leaky: two seconds leak two requests");
+    rate_limiter_sharded_cleanup(limiter);
+
+    /* отказы опускают множитель до min_rate, и лимит следующего окна меньше */
+    memset(&config, 0, sizeof(config));
+    config.algorithm = RATE_LIMIT_ADAPTIVE;
+    config.max_requests = 100;
+    config.window_seconds = 1;
+    config.min_rate = 0.5;
+    config.max_rate = 1.0;
+    limiter = rate_limiter_sharded_init(&config, 1024, 600);
+
+    if (allowed(limiter, &key, 100, T0) != 100) FAIL("adaptive: full limit at start");
+    allowed(limiter, &key, 1000, T0);
+    if (allowed(limiter, &key, 200, T0 + SEC) != 50) FAIL("adaptive: limit must drop to min_rate");
+
+    rate_limiter_sharded_cleanup(limiter);
+    PASS();
+    return 1;
+}
+
+/* Запись без обращений дольше idle забывается, полная таблица вытесняет старые */
+static int test_aging_and_eviction(void) {
+    TEST("aging_and_eviction");
+
+    rate_limiter_sharded_t *limiter = make_limiter(RATE_LIMIT_FIXED_WINDOW, 2, 3600, 1024, 10);
+    rate_limit_key_t key;
+    rate_limit_key_ipv4(&key, IPV4(10, 0, 0, 4), -1);
+
+    if (allowed(limiter, &key, 5, T0) != 2) FAIL("limit");
+    if (allowed(limiter, &key, 5, T0 + 5 * SEC) != 0) FAIL("entry forgotten too early");
+    if (allowed(limiter, &key, 5, T0 + 16 * SEC) != 2) FAIL("idle entry must be forgotten");
+    rate_limiter_sharded_cleanup(limiter);
+
+    limiter = make_limiter(RATE_LIMIT_FIXED_WINDOW, 1, 3600, 1, 3600);
+    rate_limiter_stats_t stats;
+    for (uint32_t i = 0; i < 100000; i++) {
+        rate_limit_key_ipv4(&key, IPV4(172, 16, 0, 0) + i, -1);
+        if (rate_limit_check_key_at(limiter, &key, T0 + i) != RATE_LIMIT_OK) FAIL("new key rejected");
+    }
+    rate_limiter_sharded_get_stats(limiter, &stats);
+    if (!rate_limiter_sharded_evictions(limiter)) FAIL("full table must evict");
+    if (stats.total_requests != 100000 || stats.total_rejections) FAIL("stats");
+    /* последний ключ вставлен позже всех и вытеснен быть не мог */
+    if (rate_limit_check_key_at(limiter, &key, T0 + 100000) != RATE_LIMIT_EXCEEDED) FAIL("newest entry evicted");
+
+    rate_limiter_sharded_cleanup(limiter);
+    PASS();
+    return 1;
+}
+
+#define THREADS 8
+#define PER_THREAD 50000
+
+static rate_limiter_sharded_t *shared_limiter;
+static int thread_allowed[THREADS];
+
+static void *hammer(void *arg) {
+    int id = (int)(long)arg;
+    rate_limit_key_t key;
+    rate_limit_key_ipv4(&key, IPV4(10, 9, 8, 7), -1);
+    thread_allowed[id] = allowed(shared_limiter, &key, PER_THREAD, T0);
+    return NULL;
+}
+
+/* Проверки одного ключа из многих потоков не теряют и не добавляют разрешений */
+static int test_threads(void) {
+    TEST("threads");
+
+    rate_limiter_sharded_t *limiter = make_limiter(RATE_LIMIT_FIXED_WINDOW, 100000, 3600, 1024, 3600);
+    pthread_t threads[THREADS];
+    int total = 0;
+
+    shared_limiter = limiter;
+    for (long i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, hammer, (void *)i);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        total += thread_allowed[i];
+    }
+    if (total != 100000) FAIL("allowed count must equal the limit exactly");
+
+    rate_limiter_sharded_cleanup(limiter);
+    PASS();
+    return 1;
+}
+
+int main(void) {
+    printf("=== Sharded Rate Limiter Tests ===\n\n");
+
+    test_keys();
+    test_token_bucket();
+    test_windows();
+    test_leaky_and_adaptive();
+    test_aging_and_eviction();
+    test_threads();
+
+    printf("\n=== Results ===\n");
+    printf("Passed: %d/%d\n", tests_passed, tests_run);
+
+    if (tests_passed == tests_run) {
+        printf("All tests PASSED!\n");
+        return 0;
+    } else {
+        printf("Some tests FAILED!\n");
+        return 1;
+    }
+}
@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
 #include "../net/traffic-stats.h"
 
 static int tests_run = 0;
@@ -92,7 +94,11 @@ static int test_update_stats(void) {
     /* Обновляем отправку */
     traffic_stats_update_sent(&stats, 1001, 1024, 10);
     
-    if (stats.total_bytes_sent != 1024) {
+    /* Байтовые счётчики шардированы по потокам и сводятся при чтении */
+    uint64_t total_sent, total_received;
+    traffic_stats_get_global(&stats, &total_sent, &total_received, NULL, NULL);
+    
+    if (total_sent != 1024) {
         traffic_stats_destroy(&stats);
         FAIL("total_bytes_sent incorrect");
     }
@@ -100,7 +106,9 @@ static int test_update_stats(void) {
     /* Обновляем получение */
     traffic_stats_update_received(&stats, 1001, 2048, 15);
     
-    if (stats.total_bytes_received != 2048) {
+    traffic_stats_get_global(&stats, &total_sent, &total_received, NULL, NULL);
+    
+    if (total_received != 2048) {
         traffic_stats_destroy(&stats);
         FAIL("total_bytes_received incorrect");
     }
@@ -418,6 +426,167 @@ static int test_multiple_connections(void) {
     return 1;
 }
 
+/* Тест заполнения таблицы и повторного использования слотов */
+static int test_full_table_reuse(void) {
+    TEST("full_table_reuse");
+    
+    static traffic_stats_t stats;
+    traffic_stats_init(&stats);
+    
+    for (int i = 0; i < MAX_TRAFFIC_ENTRIES; i++) {
+        char device[32];
+        snprintf(device, sizeof(device), "device-%d", i % 100);
+        if (traffic_stats_create_connection(&stats, 5000 + i * 7919ULL, "10.0.0.1", device) != 0) {
+            traffic_stats_destroy(&stats);
+            FAIL("create_connection failed before table is full");
+        }
+    }
+    
+    if (stats.device_count != 100) {
+        traffic_stats_destroy(&stats);
+        FAIL("device_count != 100");
+    }
+    
+    /* Таблица полна, активных записей не вытесняем */
+    if (traffic_stats_create_connection(&stats, 1, "10.0.0.1", "device-x") != -1) {
+        traffic_stats_destroy(&stats);
+        FAIL("create_connection succeeded on full table");
+    }
+    
+    /* Закрываем и удаляем каждое второе подключение */
+    for (int i = 0; i < MAX_TRAFFIC_ENTRIES; i += 2) {
+        traffic_stats_close_connection(&stats, 5000 + i * 7919ULL);
+        stats.entries[i].last_activity -= 7200;
+    }
+    
+    int removed = traffic_stats_cleanup_inactive(&stats, 3600);
+    if (removed != MAX_TRAFFIC_ENTRIES / 2 || stats.entry_count != MAX_TRAFFIC_ENTRIES / 2) {
+        traffic_stats_destroy(&stats);
+        FAIL("cleanup removed wrong number of entries");
+    }
+    
+    /* Удалённые больше не находятся, оставшиеся находятся */
+    for (int i = 0; i < MAX_TRAFFIC_ENTRIES; i++) {
+        int ret = traffic_stats_update_sent(&stats, 5000 + i * 7919ULL, 1, 1);
+        if ((i % 2 == 0 && ret != -1) || (i % 2 == 1 && ret != 0)) {
+            traffic_stats_destroy(&stats);
+            FAIL("lookup after cleanup incorrect");
+        }
+    }
+    
+    /* Освободившиеся слоты используются повторно */
+    for (int i = 0; i < MAX_TRAFFIC_ENTRIES / 2; i++) {
+        if (traffic_stats_create_connection(&stats, 900000 + i, "10.0.0.2", "device-new") != 0) {
+            traffic_stats_destroy(&stats);
+            FAIL("create_connection failed on reused slot");
+        }
+    }
+    
+    traffic_entry_t entry;
+    if (traffic_stats_get_connection(&stats, 5000 + 1 * 7919ULL, &entry) != 0 ||
+        entry.bytes_sent != 1) {
+        traffic_stats_destroy(&stats);
+        FAIL("surviving entry corrupted by reuse");
+    }
+    
+    traffic_stats_destroy(&stats);
+    PASS();
+    return 1;
+}
+
+#define MT_THREADS 4
+#define MT_UPDATES 100000
+
+typedef struct {
+    traffic_stats_t *stats;
+    int thread_id;
+} mt_arg_t;
+
+static void *mt_update_worker(void *ptr) {
+    mt_arg_t *arg = ptr;
+    
+    for (int i = 0; i < MT_UPDATES; i++) {
+        /* Общее подключение и своё подключение на поток, устройство общее */
+        traffic_stats_update_sent(arg->stats, 7000, 3, 1);
+        traffic_stats_update_received(arg->stats, 7001 + arg->thread_id, 5, 1);
+    }
+    return NULL;
+}
+
+/* Тест параллельных обновлений из нескольких потоков */
+static int test_concurrent_updates(void) {
+    TEST("concurrent_updates");
+    
+    static traffic_stats_t stats;
+    traffic_stats_init(&stats);
+    
+    traffic_stats_create_connection(&stats, 7000, "10.0.0.1", "shared-device");
+    for (int t = 0; t < MT_THREADS; t++) {
+        traffic_stats_create_connection(&stats, 7001 + t, "10.0.0.1", "shared-device");
+    }
+    
+    pthread_t threads[MT_THREADS];
+    mt_arg_t args[MT_THREADS];
+    for (int t = 0; t < MT_THREADS; t++) {
+        args[t].stats = &stats;
+        args[t].thread_id = t;
+        pthread_create(&threads[t], NULL, mt_update_worker, &args[t]);
+    }
+    
+    /* Параллельно создаём и удаляем посторонние подключения */
+    int churn_failed = 0;
+    for (int i = 0; i < 1000; i++) {
+        traffic_stats_create_connection(&stats, 100000 + i, "10.0.0.9", "churn");
+        traffic_stats_close_connection(&stats, 100000 + i);
+        for (int j = 0; j < stats.entry_slots; j++) {
+            if (stats.entries[j].connection_id == 100000ULL + i) {
+                stats.entries[j].last_activity -= 10;
+            }
+        }
+        if (traffic_stats_cleanup_inactive(&stats, 5) != 1) {
+            churn_failed = 1;
+        }
+    }
+    
+    for (int t = 0; t < MT_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    
+    if (churn_failed) {
+        traffic_stats_destroy(&stats);
+        FAIL("churn cleanup failed");
+    }
+    
+    uint64_t total_sent, total_received;
+    traffic_stats_get_global(&stats, &total_sent, &total_received, NULL, NULL);
+    
+    if (total_sent != 3ULL * MT_THREADS * MT_UPDATES ||
+        total_received != 5ULL * MT_THREADS * MT_UPDATES) {
+        traffic_stats_destroy(&stats);
+        FAIL("global totals lost updates");
+    }
+    
+    traffic_entry_t entry;
+    traffic_stats_get_connection(&stats, 7000, &entry);
+    if (entry.bytes_sent != 3ULL * MT_THREADS * MT_UPDATES ||
+        entry.packets_sent != (uint64_t)MT_THREADS * MT_UPDATES) {
+        traffic_stats_destroy(&stats);
+        FAIL("shared connection lost updates");
+    }
+    
+    device_traffic_t device;
+    traffic_stats_get_device(&stats, "shared-device", &device);
+    if (device.total_bytes_received != 5ULL * MT_THREADS * MT_UPDATES ||
+        device.total_packets_sent != (uint64_t)MT_THREADS * MT_UPDATES) {
+        traffic_stats_destroy(&stats);
+        FAIL("device totals lost updates");
+    }
+    
+    traffic_stats_destroy(&stats);
+    PASS();
+    return 1;
+}
+
 int main(void) {
     printf("=== Traffic Stats Module Tests ===\n\n");
     
@@ -431,6 +600,8 @@ int main(void) {
     test_reset();
     test_cleanup();
     test_multiple_connections();
+    test_full_table_reuse();
+    test_concurrent_updates();
     
     printf("\n=== Results ===\n");
     printf("Passed: %d/%d\n", tests_passed, tests_run);
@@ -22,15 +22,6 @@
 #include <stdlib.h>
 #include <assert.h>
 
-// Default memory allocation macros for vv-tree
-#ifndef TREE_MALLOC
-#define TREE_MALLOC(x) malloc(x)
-#endif
-
-#ifndef TREE_FREE
-#define TREE_FREE(x) free(x)
-#endif
-
 extern long long total_vv_tree_nodes;
 
 #define SUFFIX2(a,b) a ## b
@@ -580,8 +571,9 @@ TREE_PREFIX TREE_NODE_TYPE *SUFFIX (tree_alloc_, TREE_NAME) (X_TYPE x, Y_TYPE y)
   #ifndef TREE_MALLOC
     T = (TREE_NODE_TYPE *)calloc (1, sizeof (*T));
   #else
-    T = (TREE_NODE_TYPE *)TREE_MALLOC (sizeof (*T));
+    T = (TREE_NODE_TYPE *)malloc (sizeof (*T));
   #endif
+  assert (T);
   T->x = x;
   T->y = y;
   #ifdef TREE_PTHREAD
@@ -608,11 +600,7 @@ TREE_PREFIX void SUFFIX (tree_free_, TREE_NAME) (TREE_NODE_TYPE *T) {
   #ifdef TREE_DECREF
     TREE_DECREF (T->x);
   #endif
-  #ifndef TREE_MALLOC
-    free (T);
-  #else
-    TREE_FREE (T);
-  #endif
+  free (T);
   __sync_fetch_and_add (&total_vv_tree_nodes, -1);
 }
 